@@ -71,10 +71,10 @@ std::string g_index_html;
 // Agent 编排服务（启动时 Init 一次，之后只读，可多线程共享）
 book_agent::AgentService g_agent;
 
-// Agent 会话/消息持久化（LevelDB，进程内单实例，内部加锁）
+// Agent 会话/消息持久化（LSMDB，进程内单实例，内部加锁）
 book_agent::SessionStore g_store;
 
-// 长期记忆存储（独立 LevelDB，跨会话全局记忆；见 §16.5 L3）
+// 长期记忆存储（独立 LSMDB，跨会话全局记忆；见 §16.5 L3）
 book_agent::MemoryStore g_mem;
 
 // 记忆机制总开关（关闭则不注入/不抽取/不摘要，但记忆管理接口仍可用）
@@ -1489,7 +1489,7 @@ int main(int argc, char *argv[]) { /*{{{*/
     fprintf(stderr, "agent disabled (init ret:%d)\n", agent_ret);
   }
 
-  // 初始化会话持久化存储（LevelDB）；失败则会话相关接口返回 503，其余功能不受影响
+  // 初始化会话持久化存储（LSMDB）；失败则会话相关接口返回 503，其余功能不受影响
   Code store_ret = g_store.Init(agent_db_path);
   if (store_ret == kOk) {
     fprintf(stderr, "session store ready: db=%s\n", agent_db_path.c_str());
@@ -1497,7 +1497,7 @@ int main(int argc, char *argv[]) { /*{{{*/
     fprintf(stderr, "session store disabled (init ret:%d)\n", store_ret);
   }
 
-  // 初始化长期记忆存储（独立 LevelDB）；失败则记忆接口返回 503，其余功能不受影响
+  // 初始化长期记忆存储（独立 LSMDB）；失败则记忆接口返回 503，其余功能不受影响
   Code mem_ret = g_mem.Init(agent_mem_db_path);
   if (mem_ret == kOk) {
     fprintf(stderr, "memory store ready: db=%s, memory_enable=%d\n", agent_mem_db_path.c_str(), g_memory_enable);
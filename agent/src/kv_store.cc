@@ -4,11 +4,9 @@
 
 #include "agent/src/kv_store.h"
 
-#include "leveldb/db.h"
-#include "leveldb/iterator.h"
-#include "leveldb/options.h"
-#include "leveldb/slice.h"
-#include "leveldb/status.h"
+#include "base/file_util.h"
+#include "base/log.h"
+#include "store/db/lsm/src/lsm_db.h"
 
 namespace book_agent {
 
@@ -24,13 +22,24 @@ KvStore::~KvStore() { /*{{{*/
 base::Code KvStore::Init(const std::string &db_path) { /*{{{*/
   if (db_path.empty()) return base::kInvalidParam;
 
-  leveldb::Options options;
-  options.create_if_missing = true;
-  options.compression = leveldb::kNoCompression;  // demo 关闭压缩，减少外部依赖
+  // 旧版本基于 LevelDB，目录下有 CURRENT 文件；LSMDB 不识别其格式，会当作空库打开，
+  // 因此拒绝打开，需先迁移或移走旧目录，避免会话与记忆数据被静默丢弃
+  bool is_exist = false;
+  base::Code ret = base::CheckFileExist(db_path + "/CURRENT", &is_exist);
+  if (ret != base::kOk) return base::kOpenError;
+  if (is_exist) {
+    LOG_ERR("kv store path:%s is a LevelDB dir, migrate or move it away first\n", db_path.c_str());
+    return base::kInvalidData;
+  }
 
-  leveldb::DB *db = NULL;
-  leveldb::Status status = leveldb::DB::Open(options, db_path, &db);
-  if (!status.ok()) return base::kOpenError;
+  // 会话与记忆写入量小，按间隔刷盘即可；默认不压缩，减少外部依赖
+  store::LSMDB *db = new store::LSMDB();
+  db->SetSyncPolicy(store::kSyncInterval);
+  ret = db->Init(db_path);
+  if (ret != base::kOk) {
+    delete db;
+    return base::kOpenError;
+  }
 
   db_ = db;
 
@@ -40,8 +49,8 @@ base::Code KvStore::Init(const std::string &db_path) { /*{{{*/
 base::Code KvStore::Put(const std::string &key, const std::string &value) { /*{{{*/
   if (db_ == NULL) return base::kNotInit;
 
-  leveldb::Status status = db_->Put(leveldb::WriteOptions(), key, value);
-  if (!status.ok()) return base::kWriteError;
+  base::Code ret = db_->Put(key, value);
+  if (ret != base::kOk) return base::kWriteError;
 
   return base::kOk;
 } /*}}}*/
@@ -50,9 +59,9 @@ base::Code KvStore::Get(const std::string &key, std::string *value) { /*{{{*/
   if (db_ == NULL) return base::kNotInit;
   if (value == NULL) return base::kInvalidParam;
 
-  leveldb::Status status = db_->Get(leveldb::ReadOptions(), key, value);
-  if (status.IsNotFound()) return base::kNotFound;
-  if (!status.ok()) return base::kReadError;
+  base::Code ret = db_->Get(key, value);
+  if (ret == base::kNotFound) return base::kNotFound;
+  if (ret != base::kOk) return base::kReadError;
 
   return base::kOk;
 } /*}}}*/
@@ -60,8 +69,9 @@ base::Code KvStore::Get(const std::string &key, std::string *value) { /*{{{*/
 base::Code KvStore::Delete(const std::string &key) { /*{{{*/
   if (db_ == NULL) return base::kNotInit;
 
-  leveldb::Status status = db_->Delete(leveldb::WriteOptions(), key);
-  if (!status.ok()) return base::kWriteError;
+  base::Code ret = db_->Del(key);
+  if (ret == base::kNotFound) return base::kOk;  // 键不存在也视为删除成功
+  if (ret != base::kOk) return base::kWriteError;
 
   return base::kOk;
 } /*}}}*/
@@ -76,32 +86,39 @@ base::Code KvStore::Scan(const std::string &prefix, const std::string &start_aft
   values->clear();
   next_cursor->clear();
 
-  leveldb::Iterator *it = db_->NewIterator(leveldb::ReadOptions());
+  // 前缀迭代器只包含前缀范围内的 key，空前缀即全量
+  store::LSMIterator *it = NULL;
+  base::Code ret = db_->NewPrefixIterator(prefix, &it);
+  if (ret != base::kOk) return base::kReadError;
 
-  // 定位起点：优先游标，其次前缀，最后从头
+  // 定位起点：优先游标，否则从前缀起点开始（游标小于前缀时等同于前缀起点）
   if (!start_after.empty()) {
-    it->Seek(start_after);
-    if (it->Valid() && it->key().ToString() == start_after) it->Next();  // 游标自身不含
-  } else if (!prefix.empty()) {
-    it->Seek(prefix);
+    ret = it->Seek(start_after);
+    std::string key;
+    if (ret == base::kOk && it->Valid() && it->GetKey(&key) == base::kOk && key == start_after) {
+      ret = it->GoNext();  // 游标自身不含
+    }
   } else {
-    it->SeekToFirst();
+    ret = it->SetFirst();
   }
 
   uint32_t count = 0;
-  for (; it->Valid() && count < limit; it->Next()) {
-    std::string key = it->key().ToString();
-    if (!prefix.empty() && key.compare(0, prefix.size(), prefix) != 0) break;  // 已越过前缀范围
+  for (; ret == base::kOk && it->Valid() && count < limit; ret = it->GoNext()) {
+    std::string key;
+    std::string value;
+    ret = it->GetKey(&key);
+    if (ret == base::kOk) ret = it->GetValue(&value);
+    if (ret != base::kOk) break;
     keys->push_back(key);
-    values->push_back(it->value().ToString());
+    values->push_back(value);
     ++count;
   }
 
   // 满页且后面仍有数据时才给游标
-  if (count == limit && it->Valid()) *next_cursor = keys->back();
+  if (ret == base::kOk && count == limit && it->Valid()) *next_cursor = keys->back();
 
   delete it;
-  return base::kOk;
+  return ret == base::kOk ? base::kOk : base::kReadError;
 } /*}}}*/
 
 }  // namespace book_agent
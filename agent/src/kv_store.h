@@ -12,18 +12,18 @@
 
 #include "base/status.h"
 
-namespace leveldb {
-class DB;
-}  // namespace leveldb
+namespace store {
+class LSMDB;
+}  // namespace store
 
 namespace book_agent {
 
 /**
- * @brief LevelDB 静态库的轻量封装
+ * @brief store::LSMDB 的轻量封装
  *
- * 将 leveldb::DB 的 Open/Put/Get/Delete 接口封装为返回 base::Code 的形式，
- * 屏蔽 leveldb::Status，统一项目的错误码风格。DB 实例进程内单例，
- * leveldb 本身支持多线程并发访问，无需额外加锁。
+ * 将 LSMDB 的 Init/Put/Get/Del 接口封装为 KV 语义（Put 覆盖、Delete 幂等），
+ * 前缀扫描基于 LSMDB 的前缀迭代器。DB 实例进程内单例，
+ * LSMDB 本身支持多线程并发访问，无需额外加锁。
  */
 class KvStore { /*{{{*/
  public:
@@ -31,9 +31,10 @@ class KvStore { /*{{{*/
   ~KvStore();
 
   /**
-   * @brief 打开（不存在则创建）指定路径的 LevelDB 数据库
+   * @brief 打开（不存在则创建）指定路径的 LSMDB 数据库
    * @param db_path 数据库目录路径
-   * @return kOk 成功；kInvalidParam 路径为空；kOpenError 打开失败
+   * @return kOk 成功；kInvalidParam 路径为空；kOpenError 打开失败；
+   *         kInvalidData 目录为旧版 LevelDB 数据（含 CURRENT 文件），需先迁移或移走
    */
   base::Code Init(const std::string &db_path);
 
@@ -78,7 +79,7 @@ class KvStore { /*{{{*/
   KvStore &operator=(const KvStore &w);
 
  private:
-  leveldb::DB *db_;
+  store::LSMDB *db_;
 }; /*}}}*/
 
 }  // namespace book_agent
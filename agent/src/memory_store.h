@@ -32,9 +32,9 @@ struct MemoryItem { /*{{{*/
 }; /*}}}*/
 
 /**
- * @brief 长期记忆的持久化存储（独立 LevelDB 实例，进程内单实例，内部加锁）
+ * @brief 长期记忆的持久化存储（独立 LSMDB 实例，进程内单实例，内部加锁）
  *
- * 与会话库分库存放（不同目录），规避 LevelDB「同目录进程内仅能 Open 一次」限制，
+ * 与会话库分库存放（不同目录），规避 LSMDB「同一目录只能由一个 DB 实例打开」限制，
  * 且记忆是跨会话的全局资产，物理隔离便于导出/清理。key 设计（有序，便于 Scan）：
  *   mem:item:{mem_id}                    -> MemoryItem JSON（主键，按 id 直取）
  *   mem:idx:{scope}:{inv_created}:{mem_id} -> ""（按创建倒序的列表索引，最近在前）
@@ -46,7 +46,7 @@ class MemoryStore { /*{{{*/
   ~MemoryStore();
 
   /**
-   * @brief 打开底层 LevelDB
+   * @brief 打开底层 LSMDB
    * @param db_path 数据库目录（须与会话库不同目录）
    * @return kOk 成功；否则透传 KvStore::Init 的错误码
    */
@@ -76,7 +76,7 @@ class SessionStore { /*{{{*/
   ~SessionStore();
 
   /**
-   * @brief 打开底层 LevelDB
+   * @brief 打开底层 LSMDB
    * @param db_path 数据库目录
    * @return kOk 成功；否则透传 KvStore::Init 的错误码
    */
@@ -149,29 +149,135 @@ double ExponentialMovingAverage::Update(double new_value) {
   return ema_;
 }
 
-TimerWheel::TimerWheel(uint32_t size) {
+TimerWheel::TimerWheel(uint32_t size, uint32_t level_num) { /*{{{*/
   size_ = size > kMinSize ? size : kMinSize;
-  current_slot_ = 0;
-  wheel_.resize(size_);
-}
+  level_num_ = level_num > 1 ? level_num : 2;  // NOTE:htt, timers beyond range are placed in the top level
+  now_tick_ = 0;
+  next_id_ = 1;
+
+  uint64_t span = 1;
+  for (uint32_t i = 0; i < level_num_; ++i) {
+    spans_.push_back(span);
+    if (i > 0 && span > UINT64_MAX / size_ / size_) {  // NOTE:htt, the top level is enough
+      level_num_ = i + 1;
+      break;
+    }
+    span *= size_;
+  }
+
+  wheels_.resize(level_num_);
+  for (uint32_t i = 0; i < level_num_; ++i) {
+    wheels_[i].resize(size_);
+  }
+} /*}}}*/
 
 TimerWheel::~TimerWheel() {}
 
-void TimerWheel::AddTimer(uint32_t timeout, std::function<void()> task) {
-  uint32_t slot = (current_slot_ + timeout) % size_;
-  wheel_[slot].push_back(task);
-}
+uint64_t TimerWheel::AddTimer(uint32_t timeout, std::function<void()> task) { /*{{{*/
+  TimerNode node;
+  node.id = next_id_++;
+  node.expire_tick = now_tick_ + timeout;
+  node.task = task;
+
+  std::list<TimerNode> tmp;
+  tmp.push_back(node);
+  Place(&tmp, tmp.begin());
+
+  return node.id;
+} /*}}}*/
+
+bool TimerWheel::CancelTimer(uint64_t timer_id) { /*{{{*/
+  std::unordered_map<uint64_t, TimerLocation>::iterator it = locations_.find(timer_id);
+  if (it == locations_.end()) return false;
+
+  wheels_[it->second.level][it->second.slot].erase(it->second.it);
+  locations_.erase(it);
+  return true;
+} /*}}}*/
+
+/**
+ * NOTE:htt, node is moved into the slot by splice, so the iterator saved in locations_ is still valid;
+ * level n is used when the timer expires in size^(n+1) ticks, and the slot is cascaded before the timer expires
+ */
+void TimerWheel::Place(std::list<TimerNode> *from, std::list<TimerNode>::iterator it) { /*{{{*/
+  uint64_t expire_tick = it->expire_tick < now_tick_ ? now_tick_ : it->expire_tick;
+  uint64_t delta = expire_tick - now_tick_;
+
+  uint32_t level = 0;
+  while (level + 1 < level_num_ && delta >= spans_[level] * size_) {
+    ++level;
+  }
+  if (delta >= spans_[level] * size_) {
+    expire_tick = now_tick_ + spans_[level] * size_ - 1;  // NOTE:htt, beyond the top level, placed again later
+  }
+
+  uint32_t slot = (expire_tick / spans_[level]) % size_;
+  std::list<TimerNode> &to = wheels_[level][slot];
+  to.splice(to.end(), *from, it);
+
+  TimerLocation &location = locations_[it->id];
+  location.level = level;
+  location.slot = slot;
+  location.it = it;
+} /*}}}*/
 
-void TimerWheel::Tick() {
-  // 执行当前槽中的所有任务
-  for (auto &task : wheel_[current_slot_]) {
+void TimerWheel::Cascade(uint32_t level, uint32_t slot) { /*{{{*/
+  std::list<TimerNode> nodes;
+  nodes.swap(wheels_[level][slot]);
+  while (!nodes.empty()) {
+    Place(&nodes, nodes.begin());
+  }
+} /*}}}*/
+
+void TimerWheel::Tick() { /*{{{*/
+  // 高层的槽到期时先降级到低层
+  for (uint32_t level = level_num_ - 1; level > 0; --level) {
+    if (now_tick_ % spans_[level] == 0) {
+      Cascade(level, (now_tick_ / spans_[level]) % size_);
+    }
+  }
+
+  // 执行当前槽中的所有到期任务, 任务中新加的定时器在下一个 tick 之后才会执行
+  uint64_t cur_tick = now_tick_;
+  std::list<TimerNode> &nodes = wheels_[0][cur_tick % size_];
+  ++now_tick_;
+  while (!nodes.empty() && nodes.front().expire_tick <= cur_tick) {
+    std::function<void()> task;
+    task.swap(nodes.front().task);
+    locations_.erase(nodes.front().id);
+    nodes.pop_front();
     task();
   }
-  // 清空当前槽
-  wheel_[current_slot_].clear();
-  // 移动到下一个槽
-  current_slot_ = (current_slot_ + 1) % size_;
-}
+} /*}}}*/
+
+void TimerWheel::Advance(uint64_t ticks) { /*{{{*/
+  for (uint64_t i = 0; i < ticks; ++i) {
+    if (locations_.empty()) {  // NOTE:htt, nothing to run, so jump to the end directly
+      now_tick_ += ticks - i;
+      return;
+    }
+    Tick();
+  }
+} /*}}}*/
+
+int64_t TimerWheel::GetNextTimeout() const { /*{{{*/
+  if (locations_.empty()) return -1;
+
+  // NOTE:htt, timers of high levels are cascaded into level 0 at the next round of level 0 at the latest
+  uint64_t cascade_ticks = (size_ - now_tick_ % size_) % size_;
+  if (cascade_ticks == 0) {
+    bool has_cascade = false;
+    for (uint32_t level = 1; level < level_num_ && now_tick_ % spans_[level] == 0; ++level) {
+      if (!wheels_[level][(now_tick_ / spans_[level]) % size_].empty()) has_cascade = true;
+    }
+    if (!has_cascade) cascade_ticks = size_;
+  }
+  for (uint64_t i = 0; i < cascade_ticks; ++i) {
+    if (!wheels_[0][(now_tick_ + i) % size_].empty()) return i;
+  }
+
+  return cascade_ticks;
+} /*}}}*/
 
 Code RunLengthEncode(const std::vector<uint32_t> &input, std::vector<std::pair<uint32_t, uint32_t>> *encoded) { /*{{{*/
   if (encoded == NULL) return kInvalidParam;
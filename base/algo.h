@@ -7,8 +7,10 @@
 
 #include <stdint.h>
 
+#include <cmath>
 #include <functional>
 #include <list>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -54,18 +56,51 @@ class ExponentialMovingAverage {
 // NOTE:htt, 时间轮算法是一种高效的定时器管理算法,常用于操作系统和网络系统中处理大量定时任务
 // 算法通过一个循环的轮式数据结构来组织和调度定时事件,使得定时任务的添加、删除和到期处理都能
 // 在常数时间内完成,即 O(1) 的时间复杂度
+// 多层时间轮: 第 n 层的一个槽跨越 size^n 个 tick, 高层槽到期时把其中的定时器降级(cascade)到低层,
+// 超出最高层范围的定时器放在最高层, 降级时按剩余时间重新放置
+const uint32_t kDefaultTimerWheelLevels = 3;
+
 class TimerWheel {
  public:
-  TimerWheel(uint32_t size);
+  TimerWheel(uint32_t size, uint32_t level_num = kDefaultTimerWheelLevels);
   ~TimerWheel();
 
-  void AddTimer(uint32_t timeout, std::function<void()> task);
+  // NOTE:htt, task is called by the timeout-th Tick from now, and the returned id is used to cancel it
+  uint64_t AddTimer(uint32_t timeout, std::function<void()> task);
+  bool CancelTimer(uint64_t timer_id);
+
   void Tick();
+  void Advance(uint64_t ticks);
+
+  // NOTE:htt, ticks from now to the first tick which may have due timers, or -1 if there is no timer
+  int64_t GetNextTimeout() const;
+  uint64_t GetNowTick() const { return now_tick_; }
+  size_t Size() const { return locations_.size(); }
+
+ private:
+  struct TimerNode {
+    uint64_t id;
+    uint64_t expire_tick;
+    std::function<void()> task;
+  };
+
+  struct TimerLocation {
+    uint32_t level;
+    uint32_t slot;
+    std::list<TimerNode>::iterator it;
+  };
+
+  void Place(std::list<TimerNode> *from, std::list<TimerNode>::iterator it);
+  void Cascade(uint32_t level, uint32_t slot);
 
  private:
-  uint32_t size_;                                        // 时间轮的大小
-  int current_slot_;                                     // 当前槽的索引
-  std::vector<std::list<std::function<void()>>> wheel_;  // 时间轮的数据结构
+  uint32_t size_;                                      // 每层时间轮的大小
+  uint32_t level_num_;                                 // 时间轮的层数
+  uint64_t now_tick_;                                  // 下一个要处理的 tick
+  uint64_t next_id_;                                   // 定时器 id, 从 1 开始
+  std::vector<uint64_t> spans_;                        // 第 n 层每个槽跨越的 tick 数, 即 size^n
+  std::vector<std::vector<std::list<TimerNode>>> wheels_;  // 时间轮的数据结构
+  std::unordered_map<uint64_t, TimerLocation> locations_;  // 定时器 id 到所在槽, 用于 O(1) 删除
 };
 
 // NOTE:htt, Run-Length Encoding (RLE) based on auto-incrementing sequences is often used to optimize the storage of
@@ -0,0 +1,555 @@
+// Copyright (c) 2015 The CSUTIL Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/bin_log.h"
+
+#include <ctype.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "base/coding.h"
+#include "base/mutex.h"
+
+namespace base {
+
+static char g_bin_log_path[kFilePathLen] = {0};
+static char g_bin_log_path_fmt[kFilePathLen] = {0};
+static int g_bin_log_level = kErrorLevel;
+static FILE *g_bin_log_fp = NULL;
+static time_t g_bin_log_last_sec = 0;
+static std::vector<BinLogSite *> g_bin_log_sites;
+static Mutex g_bin_log_mutex;
+
+void SetBinLogLevel(int level) { /*{{{*/
+  if (level >= kDebugLevel && level <= kFatalErrorLevel) {
+    g_bin_log_level = level;
+  }
+} /*}}}*/
+
+void SetBinLogFmt(const char *log_path_fmt) { /*{{{*/
+  if (log_path_fmt != NULL && log_path_fmt[0] != '\0') {
+    MutexLock mutex_lock(&g_bin_log_mutex);
+    snprintf(g_bin_log_path_fmt, sizeof(g_bin_log_path_fmt), "%s", log_path_fmt);
+    g_bin_log_last_sec = 0;
+  }
+} /*}}}*/
+
+void InitBinLog(const char *log_path_fmt, int level) { /*{{{*/
+  SetBinLogFmt(log_path_fmt);
+  SetBinLogLevel(level);
+} /*}}}*/
+
+void CloseBinLogStream() { /*{{{*/
+  MutexLock mutex_lock(&g_bin_log_mutex);
+  if (g_bin_log_fp != NULL) {
+    fclose(g_bin_log_fp);
+    g_bin_log_fp = NULL;
+  }
+  g_bin_log_path[0] = '\0';
+  g_bin_log_last_sec = 0;
+} /*}}}*/
+
+static void AppendBinLogStr(const char *str, uint32_t len, std::string *out) { /*{{{*/
+  EncodeVar32(len, out);
+  out->append(str, len);
+} /*}}}*/
+
+static void WriteBinLogRecord(const std::string &body) { /*{{{*/
+  std::string len_str;
+  EncodeVar32(body.size(), &len_str);
+
+  fwrite(len_str.data(), sizeof(char), len_str.size(), g_bin_log_fp);
+  fwrite(body.data(), sizeof(char), body.size(), g_bin_log_fp);
+} /*}}}*/
+
+static void WriteBinLogFormatRecord(const BinLogSite *site) { /*{{{*/
+  const char *file_name = strrchr(site->file_path, '/');
+  file_name = (file_name == NULL) ? site->file_path : (file_name + 1);
+
+  std::string body;
+  body.append(1, kBinLogFormatRecord);
+  EncodeVar32(site->id, &body);
+  EncodeVar32(site->log_level, &body);
+  EncodeVar32(site->line_no, &body);
+  AppendBinLogStr(file_name, strlen(file_name), &body);
+  AppendBinLogStr(site->func, strlen(site->func), &body);
+  AppendBinLogStr(site->format, strlen(site->format), &body);
+
+  WriteBinLogRecord(body);
+} /*}}}*/
+
+/**
+ * NOTE:htt, rotate binary log file by strftime only when the second changes,
+ * and write format records of all call sites at the beginning of a new file
+ */
+static Code CheckBinLog(time_t cur) { /*{{{*/
+  if ('\0' == g_bin_log_path_fmt[0]) return kFileNameNotSet;
+  if (g_bin_log_fp != NULL && cur == g_bin_log_last_sec) return kOk;
+
+  struct tm cur_tm = {0};
+  localtime_r(&cur, &cur_tm);
+
+  char log_path[kFilePathLen] = {0};
+  strftime(log_path, sizeof(log_path), g_bin_log_path_fmt, &cur_tm);
+  g_bin_log_last_sec = cur;
+
+  if (g_bin_log_fp != NULL && strcmp(log_path, g_bin_log_path) == 0) return kOk;
+
+  if (g_bin_log_fp != NULL) {
+    fclose(g_bin_log_fp);
+    g_bin_log_fp = NULL;
+  }
+
+  snprintf(g_bin_log_path, sizeof(g_bin_log_path), "%s", log_path);
+  g_bin_log_fp = fopen(g_bin_log_path, "a");
+  if (g_bin_log_fp == NULL) return kOpenError;
+
+  for (size_t i = 0; i < g_bin_log_sites.size(); ++i) {
+    WriteBinLogFormatRecord(g_bin_log_sites[i]);
+  }
+
+  return kOk;
+} /*}}}*/
+
+static void RegisterBinLogSite(BinLogSite *site) { /*{{{*/
+  MutexLock mutex_lock(&g_bin_log_mutex);
+  if (site->id != 0) return;
+
+  // NOTE:htt, invalid format is registered without args, the decoder prints the format as it is
+  std::vector<BinLogArg> args;
+  Code ret = ParseBinLogFormat(site->format, &args);
+  if (ret == kOk && !args.empty()) {
+    BinLogArg *site_args = new BinLogArg[args.size()];  // NOTE:htt, lives as long as the static call site
+    memcpy(site_args, args.data(), args.size() * sizeof(BinLogArg));
+    site->args = site_args;
+    site->arg_num = args.size();
+  }
+
+  g_bin_log_sites.push_back(site);
+  uint32_t id = g_bin_log_sites.size();
+  __atomic_store_n(&site->id, id, __ATOMIC_RELEASE);
+
+  if (g_bin_log_fp != NULL) WriteBinLogFormatRecord(site);
+} /*}}}*/
+
+void PrintBinLog(BinLogSite *site, ...) { /*{{{*/
+  if (site == NULL || site->log_level < g_bin_log_level || site->format == NULL) return;
+
+  if (__atomic_load_n(&site->id, __ATOMIC_ACQUIRE) == 0) RegisterBinLogSite(site);
+
+  static thread_local std::string body;
+  static thread_local uint64_t tid = 0;
+  if (tid == 0) {
+#if defined(__linux__)
+    tid = syscall(SYS_gettid);
+#elif defined(__APPLE__)
+    pthread_threadid_np(NULL, &tid);
+#endif
+  }
+
+  time_t cur = time(NULL);
+  body.clear();
+  body.append(1, kBinLogDataRecord);
+  EncodeVar32(site->id, &body);
+  EncodeVar64(cur, &body);
+  EncodeVar32(getpid(), &body);
+  EncodeVar64(tid, &body);
+
+  va_list arg_ptr;
+  va_start(arg_ptr, site);
+  int star_value = -1;
+  for (uint32_t i = 0; i < site->arg_num; ++i) {
+    const BinLogArg &arg = site->args[i];
+    uint64_t zigzag_value = 0;
+    switch (arg.type) {
+      case kBinLogStarArg:
+        star_value = va_arg(arg_ptr, int);
+        EncodeZigZag64(star_value, &zigzag_value);
+        EncodeVar64(zigzag_value, &body);
+        break;
+      case kBinLogIntArg:
+        EncodeZigZag64(va_arg(arg_ptr, int), &zigzag_value);
+        EncodeVar64(zigzag_value, &body);
+        break;
+      case kBinLogInt64Arg:
+        EncodeZigZag64(va_arg(arg_ptr, long long), &zigzag_value);
+        EncodeVar64(zigzag_value, &body);
+        break;
+      case kBinLogUIntArg:
+        EncodeVar64(va_arg(arg_ptr, unsigned int), &body);
+        break;
+      case kBinLogUInt64Arg:
+        EncodeVar64(va_arg(arg_ptr, unsigned long long), &body);
+        break;
+      case kBinLogDoubleArg:
+      case kBinLogLongDoubleArg: {
+        double value = (arg.type == kBinLogDoubleArg) ? va_arg(arg_ptr, double) : va_arg(arg_ptr, long double);
+        uint64_t bits = 0;
+        memcpy(&bits, &value, sizeof(bits));
+        EncodeFixed64(bits, &body);
+      } break;
+      case kBinLogStrArg: {
+        const char *str = va_arg(arg_ptr, const char *);
+        if (str == NULL) str = "(null)";
+        int precision = (arg.precision == -2) ? star_value : arg.precision;
+        uint32_t len = (precision >= 0) ? strnlen(str, precision) : strlen(str);
+        AppendBinLogStr(str, len, &body);
+      } break;
+      case kBinLogPtrArg:
+        EncodeVar64(reinterpret_cast<uintptr_t>(va_arg(arg_ptr, void *)), &body);
+        break;
+      default:
+        break;
+    }
+  }
+  va_end(arg_ptr);
+
+  MutexLock mutex_lock(&g_bin_log_mutex);
+  if (CheckBinLog(cur) != kOk) return;
+
+  WriteBinLogRecord(body);
+  fflush(g_bin_log_fp);
+} /*}}}*/
+
+Code ParseBinLogFormat(const char *format, std::vector<BinLogArg> *args) { /*{{{*/
+  if (format == NULL || args == NULL) return kInvalidParam;
+
+  args->clear();
+  const char *pos = format;
+  while (*pos != '\0') {
+    if (*pos != '%') {
+      ++pos;
+      continue;
+    }
+
+    const char *begin = pos++;
+    if (*pos == '%') {
+      ++pos;
+      continue;
+    }
+
+    BinLogArg star_arg = {kBinLogStarArg, 0, 0, -1};
+    while (*pos != '\0' && strchr("-+ #0'", *pos) != NULL) ++pos;
+    if (*pos == '*') {
+      args->push_back(star_arg);
+      ++pos;
+    } else {
+      while (isdigit(*pos)) ++pos;
+    }
+
+    int precision = -1;
+    if (*pos == '.') {
+      ++pos;
+      if (*pos == '*') {
+        args->push_back(star_arg);
+        precision = -2;
+        ++pos;
+      } else {
+        precision = 0;
+        while (isdigit(*pos)) precision = precision * 10 + (*pos++ - '0');
+      }
+    }
+
+    bool is_long = false;
+    bool is_long_double = false;
+    while (*pos != '\0' && strchr("hlLqjzt", *pos) != NULL) {
+      if (*pos == 'L') {
+        is_long_double = true;
+      } else if (*pos != 'h') {
+        is_long = true;
+      }
+      ++pos;
+    }
+
+    BinLogArg arg = {kBinLogIntArg, (uint32_t)(begin - format), 0, precision};
+    switch (*pos) {
+      case 'd':
+      case 'i':
+        arg.type = is_long ? kBinLogInt64Arg : kBinLogIntArg;
+        break;
+      case 'c':
+        arg.type = kBinLogIntArg;
+        break;
+      case 'u':
+      case 'o':
+      case 'x':
+      case 'X':
+        arg.type = is_long ? kBinLogUInt64Arg : kBinLogUIntArg;
+        break;
+      case 'f':
+      case 'F':
+      case 'e':
+      case 'E':
+      case 'g':
+      case 'G':
+      case 'a':
+      case 'A':
+        arg.type = is_long_double ? kBinLogLongDoubleArg : kBinLogDoubleArg;
+        break;
+      case 's':
+        if (is_long) return kInvalidParam;  // NOTE:htt, wide string is not supported
+        arg.type = kBinLogStrArg;
+        break;
+      case 'p':
+        arg.type = kBinLogPtrArg;
+        break;
+      default:
+        return kInvalidParam;
+    }
+    ++pos;
+    arg.end = pos - format;
+    args->push_back(arg);
+  }
+
+  return kOk;
+} /*}}}*/
+
+static Code GetBinLogVar64(const char **pos, const char *end, uint64_t *value) { /*{{{*/
+  *value = 0;
+  for (int shift = 0; *pos < end && shift < 64; shift += 7) {
+    uint8_t ch = *reinterpret_cast<const uint8_t *>((*pos)++);
+    *value |= ((uint64_t)(ch & 0x7f)) << shift;
+    if ((ch & 0x80) == 0) return kOk;
+  }
+
+  return kDataNotEnough;
+} /*}}}*/
+
+static Code GetBinLogVar32(const char **pos, const char *end, uint32_t *value) { /*{{{*/
+  uint64_t tmp_value = 0;
+  Code ret = GetBinLogVar64(pos, end, &tmp_value);
+  *value = (uint32_t)tmp_value;
+  return ret;
+} /*}}}*/
+
+static Code GetBinLogStr(const char **pos, const char *end, std::string *str) { /*{{{*/
+  uint32_t len = 0;
+  Code ret = GetBinLogVar32(pos, end, &len);
+  if (ret != kOk) return ret;
+  if ((uint32_t)(end - *pos) < len) return kDataNotEnough;
+
+  str->assign(*pos, len);
+  *pos += len;
+  return kOk;
+} /*}}}*/
+
+static void AppendBinLogText(std::string *text, const char *spec, ...) { /*{{{*/
+  char buf[kMaxBufLen];
+  va_list arg_ptr;
+  va_start(arg_ptr, spec);
+  int len = vsnprintf(buf, sizeof(buf), spec, arg_ptr);
+  va_end(arg_ptr);
+  if (len < 0) return;
+
+  if (len < (int)sizeof(buf)) {
+    text->append(buf, len);
+    return;
+  }
+
+  std::string extend_buf(len + 1, '\0');
+  va_start(arg_ptr, spec);
+  vsnprintf(&extend_buf[0], len + 1, spec, arg_ptr);
+  va_end(arg_ptr);
+  text->append(extend_buf.data(), len);
+} /*}}}*/
+
+// NOTE:htt, copy literal content of format, "%%" is the same as printf
+static void AppendBinLogLiteral(const std::string &format, uint32_t begin, uint32_t end, std::string *text) { /*{{{*/
+  for (uint32_t i = begin; i < end; ++i) {
+    text->append(1, format[i]);
+    if (format[i] == '%' && i + 1 < end && format[i + 1] == '%') ++i;
+  }
+} /*}}}*/
+
+BinLogDecoder::BinLogDecoder() {}
+
+BinLogDecoder::~BinLogDecoder() {}
+
+Code BinLogDecoder::Decode(const char *data, uint32_t len, std::string *text, uint32_t *used_len) { /*{{{*/
+  if (data == NULL || text == NULL || used_len == NULL) return kInvalidParam;
+
+  *used_len = 0;
+  const char *end = data + len;
+  const char *pos = data;
+  while (pos < end) {
+    const char *record_begin = pos;
+    uint32_t record_len = 0;
+    Code ret = GetBinLogVar32(&pos, end, &record_len);
+    if (ret != kOk || (uint32_t)(end - pos) < record_len) break;
+    if (record_len == 0) return kInvalidData;
+
+    const char *record_end = pos + record_len;
+    char type = *pos++;
+    if (type == kBinLogFormatRecord) {
+      ret = DecodeFormatRecord(pos, record_end);
+    } else if (type == kBinLogDataRecord) {
+      ret = DecodeDataRecord(pos, record_end, text);
+    }  // NOTE:htt, unknown record is skipped for compatibility
+    if (ret != kOk) return ret;
+
+    pos = record_end;
+    *used_len += pos - record_begin;
+  }
+
+  return kOk;
+} /*}}}*/
+
+Code BinLogDecoder::DecodeFormatRecord(const char *pos, const char *end) { /*{{{*/
+  uint32_t id = 0;
+  Format format;
+  Code ret = GetBinLogVar32(&pos, end, &id);
+  if (ret == kOk) ret = GetBinLogVar32(&pos, end, &format.log_level);
+  if (ret == kOk) ret = GetBinLogVar32(&pos, end, &format.line_no);
+  if (ret == kOk) ret = GetBinLogStr(&pos, end, &format.file_name);
+  if (ret == kOk) ret = GetBinLogStr(&pos, end, &format.func);
+  if (ret == kOk) ret = GetBinLogStr(&pos, end, &format.format);
+  if (ret != kOk) return kInvalidData;
+
+  format.is_valid_format = (ParseBinLogFormat(format.format.c_str(), &format.args) == kOk);
+  if (!format.is_valid_format) format.args.clear();
+
+  formats_[id] = format;
+  return kOk;
+} /*}}}*/
+
+Code BinLogDecoder::DecodeDataRecord(const char *pos, const char *end, std::string *text) { /*{{{*/
+  uint32_t id = 0;
+  uint64_t sec = 0;
+  uint32_t pid = 0;
+  uint64_t tid = 0;
+  Code ret = GetBinLogVar32(&pos, end, &id);
+  if (ret == kOk) ret = GetBinLogVar64(&pos, end, &sec);
+  if (ret == kOk) ret = GetBinLogVar32(&pos, end, &pid);
+  if (ret == kOk) ret = GetBinLogVar64(&pos, end, &tid);
+  if (ret != kOk) return kInvalidData;
+
+  std::map<uint32_t, Format>::const_iterator it = formats_.find(id);
+  if (it == formats_.end()) return kNotFound;
+  const Format &format = it->second;
+
+  time_t cur = (time_t)sec;
+  struct tm cur_tm = {0};
+  localtime_r(&cur, &cur_tm);
+  AppendBinLogText(text, "%4d/%02d/%02d %02d:%02d:%02d - [pid:%d][tid:%d][%s][%s %s %d] - ", cur_tm.tm_year + 1900,
+                   cur_tm.tm_mon + 1, cur_tm.tm_mday, cur_tm.tm_hour, cur_tm.tm_min, cur_tm.tm_sec, (int)pid, (int)tid,
+                   GetLogLevel(format.log_level), format.file_name.c_str(), format.func.c_str(), (int)format.line_no);
+
+  if (!format.is_valid_format) {
+    text->append(format.format);
+    text->append("\n");
+    return kOk;
+  }
+
+  uint32_t literal_begin = 0;
+  std::vector<int> star_values;
+  for (size_t i = 0; i < format.args.size(); ++i) {
+    const BinLogArg &arg = format.args[i];
+    uint64_t value = 0;
+    std::string str_value;
+    if (arg.type == kBinLogStrArg) {
+      ret = GetBinLogStr(&pos, end, &str_value);
+    } else if (arg.type == kBinLogDoubleArg || arg.type == kBinLogLongDoubleArg) {
+      if (end - pos < 8) return kInvalidData;
+      ret = DecodeFixed64(std::string(pos, 8), &value);
+      pos += 8;
+    } else {
+      ret = GetBinLogVar64(&pos, end, &value);
+    }
+    if (ret != kOk) return kInvalidData;
+
+    int64_t signed_value = 0;
+    if (arg.type == kBinLogStarArg || arg.type == kBinLogIntArg || arg.type == kBinLogInt64Arg) {
+      DecodeZigZag64(value, &signed_value);
+    }
+    if (arg.type == kBinLogStarArg) {
+      star_values.push_back((int)signed_value);
+      continue;
+    }
+
+    AppendBinLogLiteral(format.format, literal_begin, arg.begin, text);
+    literal_begin = arg.end;
+
+    // NOTE:htt, rebuild conversion: drop length modifiers, fill '*' and use "ll" for integers
+    std::string spec;
+    size_t star_index = 0;
+    for (uint32_t j = arg.begin; j < arg.end - 1; ++j) {
+      char ch = format.format[j];
+      if (strchr("hlLqjzt", ch) != NULL) continue;
+      if (ch == '*') {
+        int star_value = star_index < star_values.size() ? star_values[star_index] : 0;
+        ++star_index;
+        char star_buf[16];
+        snprintf(star_buf, sizeof(star_buf), "%d", star_value);
+        spec.append(star_buf);
+        continue;
+      }
+      spec.append(1, ch);
+    }
+    char conversion = format.format[arg.end - 1];
+    if (arg.type == kBinLogInt64Arg || arg.type == kBinLogUInt64Arg ||
+        (arg.type == kBinLogIntArg && conversion != 'c') || arg.type == kBinLogUIntArg) {
+      spec.append("ll");
+    }
+    spec.append(1, conversion);
+    star_values.clear();
+
+    switch (arg.type) {
+      case kBinLogIntArg:
+        if (conversion == 'c') {
+          AppendBinLogText(text, spec.c_str(), (int)signed_value);
+        } else {
+          AppendBinLogText(text, spec.c_str(), (long long)(int)signed_value);
+        }
+        break;
+      case kBinLogInt64Arg:
+        AppendBinLogText(text, spec.c_str(), (long long)signed_value);
+        break;
+      case kBinLogUIntArg:
+        AppendBinLogText(text, spec.c_str(), (unsigned long long)(unsigned int)value);
+        break;
+      case kBinLogUInt64Arg:
+        AppendBinLogText(text, spec.c_str(), (unsigned long long)value);
+        break;
+      case kBinLogDoubleArg:
+      case kBinLogLongDoubleArg: {
+        double double_value = 0;
+        memcpy(&double_value, &value, sizeof(double_value));
+        AppendBinLogText(text, spec.c_str(), double_value);
+      } break;
+      case kBinLogStrArg:
+        AppendBinLogText(text, spec.c_str(), str_value.c_str());
+        break;
+      case kBinLogPtrArg:
+        AppendBinLogText(text, spec.c_str(), reinterpret_cast<void *>((uintptr_t)value));
+        break;
+      default:
+        break;
+    }
+  }
+
+  AppendBinLogLiteral(format.format, literal_begin, format.format.size(), text);
+  text->append("\n");
+  return kOk;
+} /*}}}*/
+
+}  // namespace base
+
+#ifdef _BIN_LOG_MAIN_TEST_
+int main(int argc, char *argv[]) { /*{{{*/
+  using namespace base;
+
+  InitBinLog("./bin.log.%Y-%m-%d-%H", kInfoLevel);
+  BIN_LOG_ERR("err now, num:%d, str:%s", 10, "hello");
+  BIN_LOG_INFO("info now, %.2f%%", 99.5);
+  CloseBinLogStream();
+
+  return 0;
+} /*}}}*/
+#endif
@@ -0,0 +1,118 @@
+// Copyright (c) 2015 The CSUTIL Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BASE_BIN_LOG_H_
+#define BASE_BIN_LOG_H_
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "base/log.h"
+#include "base/status.h"
+
+namespace base {
+
+/**
+ * Binary structured log: instead of formatting text, only the raw arguments of one line are written.
+ * The stream is a list of records, every record is [var32 len][uint8 type][body]:
+ *   kBinLogFormatRecord: [var32 id][var32 level][var32 line_no][str file][str func][str format]
+ *   kBinLogDataRecord:   [var32 id][var64 second][var32 pid][var64 tid][args...]
+ * str is [var32 len][bytes]; args are zigzag var64 for signed, var64 for unsigned and pointer,
+ * fixed64 for double and str for %s. Format records of every call site are written at the beginning of
+ * every log file, so one file can be decoded alone by BinLogDecoder or "tools 13".
+ */
+const char kBinLogFormatRecord = 1;
+const char kBinLogDataRecord = 2;
+
+struct BinLogArg;
+
+// NOTE:htt, one call site of binary log, which is registered at first use and gets a static id
+struct BinLogSite {
+  uint32_t id;  // NOTE:htt, 0 means not registered
+  const char *file_path;
+  const char *func;
+  int line_no;
+  int log_level;
+  const char *format;
+  const BinLogArg *args;  // NOTE:htt, set when registered
+  uint32_t arg_num;
+};
+
+#define BIN_LOG_INTERNAL_(log_level, format, ...)                                                        \
+  do {                                                                                                   \
+    static base::BinLogSite bin_log_site_ = {0, __FILE__, __func__, __LINE__, log_level, format};        \
+    base::PrintBinLog(&bin_log_site_, ##__VA_ARGS__);                                                    \
+  } while (0)
+
+#define BIN_LOG_FATAL_ERR(format, ...) BIN_LOG_INTERNAL_(base::kFatalErrorLevel, format, ##__VA_ARGS__)
+#define BIN_LOG_ERR(format, ...) BIN_LOG_INTERNAL_(base::kErrorLevel, format, ##__VA_ARGS__)
+#define BIN_LOG_WARN(format, ...) BIN_LOG_INTERNAL_(base::kWarnLevel, format, ##__VA_ARGS__)
+#define BIN_LOG_INFO(format, ...) BIN_LOG_INTERNAL_(base::kInfoLevel, format, ##__VA_ARGS__)
+#define BIN_LOG_TRACE(format, ...) BIN_LOG_INTERNAL_(base::kTraceLevel, format, ##__VA_ARGS__)
+#define BIN_LOG_DEBUG(format, ...) BIN_LOG_INTERNAL_(base::kDebugLevel, format, ##__VA_ARGS__)
+
+void SetBinLogLevel(int level);
+void SetBinLogFmt(const char *log_path_fmt);
+void InitBinLog(const char *log_path_fmt, int level);
+void CloseBinLogStream();
+void PrintBinLog(BinLogSite *site, ...);
+
+enum BinLogArgType {
+  kBinLogStarArg = 0,  // NOTE:htt, '*' of width or precision, which is int
+  kBinLogIntArg,
+  kBinLogInt64Arg,
+  kBinLogUIntArg,
+  kBinLogUInt64Arg,
+  kBinLogDoubleArg,
+  kBinLogLongDoubleArg,
+  kBinLogStrArg,
+  kBinLogPtrArg,
+};
+
+struct BinLogArg {
+  int type;
+  uint32_t begin;  // NOTE:htt, [begin, end) of conversion in format, not used by kBinLogStarArg
+  uint32_t end;
+  int precision;  // NOTE:htt, -1 means no precision, -2 means given by the previous '*'
+};
+
+// NOTE:htt, parse printf format into arguments in order, %n is not supported
+Code ParseBinLogFormat(const char *format, std::vector<BinLogArg> *args);
+
+class BinLogDecoder { /*{{{*/
+ public:
+  BinLogDecoder();
+  ~BinLogDecoder();
+
+ public:
+  /**
+   * Decode complete records of data into text with the same layout of PrintLog,
+   * used_len is the size of decoded records, the rest should be passed again with more data
+   */
+  Code Decode(const char *data, uint32_t len, std::string *text, uint32_t *used_len);
+
+ private:
+  struct Format {
+    uint32_t log_level;
+    uint32_t line_no;
+    std::string file_name;
+    std::string func;
+    std::string format;
+    bool is_valid_format;
+    std::vector<BinLogArg> args;
+  };
+
+  Code DecodeFormatRecord(const char *pos, const char *end);
+  Code DecodeDataRecord(const char *pos, const char *end, std::string *text);
+
+ private:
+  std::map<uint32_t, Format> formats_;
+}; /*}}}*/
+
+}  // namespace base
+
+#endif
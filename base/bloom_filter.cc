@@ -166,4 +166,20 @@ Code BloomFilter::GetBytesStr(std::string *arr) { /*{{{*/
   return kOk;
 } /*}}}*/
 
+/**
+ * Load the bit array from a byte string
+ *
+ * The size is checked against bytes_size_ calculated by Init(), since bit
+ * positions depend on the size of the bit array, and a filter loaded with a
+ * different size would give false negatives.
+ */
+Code BloomFilter::SetBytesStr(const std::string &arr) { /*{{{*/
+  if (!is_init_) return kNotInit;
+  if (arr.size() != bytes_size_) return kInvalidLength;
+
+  memcpy(bytes_, arr.data(), bytes_size_);
+
+  return kOk;
+} /*}}}*/
+
 }  // namespace base
@@ -119,6 +119,20 @@ class BloomFilter {
    */
   Code GetBytesStr(std::string *arr);
 
+  /**
+   * Load the bit array from a byte string
+   *
+   * Restores the filter state saved by GetBytesStr(). The filter must be
+   * created with the same parameters and initialized before loading, so the
+   * size of the bit array is the same as the saved one.
+   *
+   * @param arr The bit array as a byte string, returned by GetBytesStr()
+   * @return base::kOk if the bit array is loaded
+   * @return base::kNotInit if Init() has not been called
+   * @return base::kInvalidLength if the size of arr differs from the bit array
+   */
+  Code SetBytesStr(const std::string &arr);
+
  private:
   uint32_t bits_per_key_;  ///< Number of bits allocated per key
   uint32_t keys_num_;      ///< Expected number of keys to be inserted
@@ -0,0 +1,216 @@
+// Copyright (c) 2015 The CSUTIL Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/buffer_pool.h"
+
+#include <stdlib.h>
+
+namespace base {
+
+/**
+ * NOTE:htt, idle chunks of one thread, which are flushed to the central list on thread exit;
+ * a chunk freed after that (ex: by destructors of other thread locals) goes to the central list directly
+ */
+struct PoolThreadCache { /*{{{*/
+  std::vector<void *> free_lists[kPoolClassNum];
+
+  ~PoolThreadCache();
+}; /*}}}*/
+
+static thread_local bool g_pool_thread_exited = false;
+
+static PoolThreadCache *GetPoolThreadCache() { /*{{{*/
+  if (g_pool_thread_exited) return NULL;
+
+  static thread_local PoolThreadCache cache;
+  return &cache;
+} /*}}}*/
+
+PoolThreadCache::~PoolThreadCache() { /*{{{*/
+  g_pool_thread_exited = true;
+  BufferPool::Instance()->FlushThreadCache(this);
+} /*}}}*/
+
+static uint32_t GetThreadCacheNum(int size_class) { /*{{{*/
+  uint32_t num = kPoolThreadCacheBytes / BufferPool::GetClassSize(size_class);
+  return num == 0 ? 1 : num;
+} /*}}}*/
+
+BufferPool *BufferPool::Instance() { /*{{{*/
+  // NOTE:htt, never deleted, chunks may be freed by static destructors when process exits
+  static BufferPool *pool = new BufferPool();
+  return pool;
+} /*}}}*/
+
+BufferPool::BufferPool()
+    : high_water_bytes_(kDefaultPoolHighWaterBytes),
+      hit_num_(0),
+      miss_num_(0),
+      release_num_(0),
+      resident_bytes_(0),
+      in_use_bytes_(0) { /*{{{*/
+} /*}}}*/
+
+int BufferPool::GetSizeClass(uint32_t size) { /*{{{*/
+  if (size > kMaxPoolClassSize) return -1;
+
+  int size_class = 0;
+  uint32_t class_size = kMinPoolClassSize;
+  while (class_size < size) {
+    class_size <<= 1;
+    ++size_class;
+  }
+
+  return size_class;
+} /*}}}*/
+
+uint32_t BufferPool::GetClassSize(int size_class) { /*{{{*/ return kMinPoolClassSize << size_class; } /*}}}*/
+
+void *BufferPool::Alloc(uint32_t size, uint32_t *real_size) { /*{{{*/
+  if (real_size == NULL) return NULL;
+
+  int size_class = GetSizeClass(size);
+  if (size_class < 0) {
+    void *ptr = malloc(size);
+    if (ptr == NULL) return NULL;
+
+    __atomic_add_fetch(&miss_num_, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&in_use_bytes_, size, __ATOMIC_RELAXED);
+    *real_size = size;
+    return ptr;
+  }
+
+  uint32_t class_size = GetClassSize(size_class);
+  void *ptr = NULL;
+  PoolThreadCache *cache = GetPoolThreadCache();
+  if (cache != NULL) {
+    std::vector<void *> &free_list = cache->free_lists[size_class];
+    if (free_list.empty()) FetchFromCentral(size_class, &free_list);
+    if (!free_list.empty()) {
+      ptr = free_list.back();
+      free_list.pop_back();
+    }
+  } else {
+    ptr = PopFromCentral(size_class);
+  }
+
+  if (ptr != NULL) {
+    __atomic_add_fetch(&hit_num_, 1, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&resident_bytes_, class_size, __ATOMIC_RELAXED);
+  } else {
+    ptr = malloc(class_size);
+    if (ptr == NULL) return NULL;
+    __atomic_add_fetch(&miss_num_, 1, __ATOMIC_RELAXED);
+  }
+
+  __atomic_add_fetch(&in_use_bytes_, class_size, __ATOMIC_RELAXED);
+  *real_size = class_size;
+  return ptr;
+} /*}}}*/
+
+void BufferPool::Free(void *ptr, uint32_t real_size) { /*{{{*/
+  if (ptr == NULL) return;
+
+  __atomic_sub_fetch(&in_use_bytes_, real_size, __ATOMIC_RELAXED);
+
+  // NOTE:htt, high water is checked without lock, so resident bytes may be a little above it by racing
+  int size_class = GetSizeClass(real_size);
+  if (size_class < 0 || GetClassSize(size_class) != real_size ||
+      __atomic_load_n(&resident_bytes_, __ATOMIC_RELAXED) + real_size >
+          __atomic_load_n(&high_water_bytes_, __ATOMIC_RELAXED)) {
+    free(ptr);
+    __atomic_add_fetch(&release_num_, 1, __ATOMIC_RELAXED);
+    return;
+  }
+
+  __atomic_add_fetch(&resident_bytes_, real_size, __ATOMIC_RELAXED);
+
+  PoolThreadCache *cache = GetPoolThreadCache();
+  if (cache == NULL) {
+    PushToCentral(size_class, ptr);
+    return;
+  }
+
+  std::vector<void *> &free_list = cache->free_lists[size_class];
+  free_list.push_back(ptr);
+  if (free_list.size() > GetThreadCacheNum(size_class)) {
+    ReleaseToCentral(size_class, free_list.size() / 2, &free_list);
+  }
+} /*}}}*/
+
+void BufferPool::SetHighWaterBytes(uint64_t high_water_bytes) { /*{{{*/
+  __atomic_store_n(&high_water_bytes_, high_water_bytes, __ATOMIC_RELAXED);
+} /*}}}*/
+
+uint64_t BufferPool::GetHighWaterBytes() const { /*{{{*/
+  return __atomic_load_n(&high_water_bytes_, __ATOMIC_RELAXED);
+} /*}}}*/
+
+void BufferPool::GetStat(BufferPoolStat *stat) const { /*{{{*/
+  if (stat == NULL) return;
+
+  stat->hit_num = __atomic_load_n(&hit_num_, __ATOMIC_RELAXED);
+  stat->miss_num = __atomic_load_n(&miss_num_, __ATOMIC_RELAXED);
+  stat->release_num = __atomic_load_n(&release_num_, __ATOMIC_RELAXED);
+  stat->resident_bytes = __atomic_load_n(&resident_bytes_, __ATOMIC_RELAXED);
+  stat->in_use_bytes = __atomic_load_n(&in_use_bytes_, __ATOMIC_RELAXED);
+} /*}}}*/
+
+void BufferPool::FlushThreadCache() { /*{{{*/
+  PoolThreadCache *cache = GetPoolThreadCache();
+  if (cache == NULL) return;
+
+  FlushThreadCache(cache);
+} /*}}}*/
+
+void BufferPool::FlushThreadCache(PoolThreadCache *cache) { /*{{{*/
+  for (int i = 0; i < kPoolClassNum; ++i) {
+    if (cache->free_lists[i].empty()) continue;
+    ReleaseToCentral(i, cache->free_lists[i].size(), &cache->free_lists[i]);
+  }
+} /*}}}*/
+
+void *BufferPool::PopFromCentral(int size_class) { /*{{{*/
+  CentralList &central = central_[size_class];
+  MutexLock ml(&central.mu);
+  if (central.free_list.empty()) return NULL;
+
+  void *ptr = central.free_list.back();
+  central.free_list.pop_back();
+  return ptr;
+} /*}}}*/
+
+void BufferPool::PushToCentral(int size_class, void *ptr) { /*{{{*/
+  CentralList &central = central_[size_class];
+  MutexLock ml(&central.mu);
+  central.free_list.push_back(ptr);
+} /*}}}*/
+
+void BufferPool::FetchFromCentral(int size_class, std::vector<void *> *free_list) { /*{{{*/
+  // NOTE:htt, borrow half of thread cache once, so lock is not taken for every chunk
+  uint32_t batch_num = GetThreadCacheNum(size_class) / 2;
+  if (batch_num == 0) batch_num = 1;
+
+  CentralList &central = central_[size_class];
+  MutexLock ml(&central.mu);
+  while (batch_num > 0 && !central.free_list.empty()) {
+    free_list->push_back(central.free_list.back());
+    central.free_list.pop_back();
+    --batch_num;
+  }
+} /*}}}*/
+
+void BufferPool::ReleaseToCentral(int size_class, uint32_t num, std::vector<void *> *free_list) { /*{{{*/
+  // NOTE:htt, the oldest chunks are released, and the recently freed ones are still warm in cache
+  if (num > free_list->size()) num = free_list->size();
+
+  CentralList &central = central_[size_class];
+  {
+    MutexLock ml(&central.mu);
+    central.free_list.insert(central.free_list.end(), free_list->begin(), free_list->begin() + num);
+  }
+  free_list->erase(free_list->begin(), free_list->begin() + num);
+} /*}}}*/
+
+}  // namespace base
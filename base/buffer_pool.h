@@ -0,0 +1,95 @@
+// Copyright (c) 2015 The CSUTIL Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BASE_BUFFER_POOL_H_
+#define BASE_BUFFER_POOL_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "base/mutex.h"
+#include "base/status.h"
+
+namespace base {
+
+const uint32_t kMinPoolClassSize = 4096;  // NOTE:htt, size classes are 4KB, 8KB, ..., 4MB
+const int kPoolClassNum = 11;
+const uint32_t kMaxPoolClassSize = kMinPoolClassSize << (kPoolClassNum - 1);
+const uint32_t kPoolThreadCacheBytes = 512 * 1024;  // NOTE:htt, idle bytes of one class kept by one thread
+const uint64_t kDefaultPoolHighWaterBytes = 256 * 1024 * 1024ULL;
+
+struct BufferPoolStat { /*{{{*/
+  uint64_t hit_num;         // NOTE:htt, served by thread cache or central list
+  uint64_t miss_num;        // NOTE:htt, served by malloc
+  uint64_t release_num;     // NOTE:htt, freed to system for above high water or larger than max class
+  uint64_t resident_bytes;  // NOTE:htt, idle bytes kept by pool
+  uint64_t in_use_bytes;    // NOTE:htt, bytes borrowed and not returned yet
+}; /*}}}*/
+
+struct PoolThreadCache;
+
+/**
+ * NOTE:htt, BufferPool is a process-wide pool of size-classed chunks for buffers;
+ * every thread keeps a small cache of every class without lock, and flushes half of it to the central
+ * list when it's full, so chunks freed by one thread could be borrowed by another one;
+ * chunks are freed to system when idle bytes are above high water mark
+ */
+class BufferPool {
+ public:
+  static BufferPool *Instance();
+
+  /**
+   * Note: size is rounded up to its class, and the real size should be passed back when Free;
+   * size larger than max class is malloced directly
+   */
+  void *Alloc(uint32_t size, uint32_t *real_size);
+  void Free(void *ptr, uint32_t real_size);
+
+  void SetHighWaterBytes(uint64_t high_water_bytes);
+  uint64_t GetHighWaterBytes() const;
+  void GetStat(BufferPoolStat *stat) const;
+
+  // NOTE: move idle chunks of current thread to the central list, which is done on thread exit too
+  void FlushThreadCache();
+
+  // NOTE: return -1 if size is larger than max class
+  static int GetSizeClass(uint32_t size);
+  static uint32_t GetClassSize(int size_class);
+
+ private:
+  BufferPool();
+  ~BufferPool() {}
+
+  BufferPool(const BufferPool &);
+  BufferPool &operator=(const BufferPool &);
+
+ private:
+  void *PopFromCentral(int size_class);
+  void PushToCentral(int size_class, void *ptr);
+  void FetchFromCentral(int size_class, std::vector<void *> *free_list);
+  void ReleaseToCentral(int size_class, uint32_t num, std::vector<void *> *free_list);
+  void FlushThreadCache(PoolThreadCache *cache);
+
+ private:
+  struct CentralList {
+    Mutex mu;
+    std::vector<void *> free_list;
+  };
+
+  CentralList central_[kPoolClassNum];
+  uint64_t high_water_bytes_;
+
+  uint64_t hit_num_;
+  uint64_t miss_num_;
+  uint64_t release_num_;
+  uint64_t resident_bytes_;
+  uint64_t in_use_bytes_;
+
+  friend struct PoolThreadCache;
+};
+
+}  // namespace base
+
+#endif
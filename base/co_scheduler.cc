@@ -0,0 +1,232 @@
+// Copyright (c) 2015 The CSUTIL Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/co_scheduler.h"
+
+#include <errno.h>
+#include <unistd.h>
+
+#include "base/common.h"
+
+namespace base {
+
+static thread_local CoScheduler *g_cur_scheduler = NULL;
+
+static void CoTaskAction(Dispatch *dispatch, void *param) { /*{{{*/
+  CoTask *task = static_cast<CoTask *>(param);
+  (*task)();
+  delete task;
+} /*}}}*/
+
+CoScheduler::CoScheduler() : loop_(), dispatch_(NULL), cur_coroutine_id_(kCoroutineDefaultId) { /*{{{*/
+} /*}}}*/
+
+CoScheduler::~CoScheduler() { /*{{{*/
+  if (dispatch_ != NULL) {
+    delete dispatch_;
+    dispatch_ = NULL;
+  }
+} /*}}}*/
+
+Code CoScheduler::Init(EventType evt_type, uint32_t stack_size) { /*{{{*/
+  if (dispatch_ != NULL) return kOk;
+
+  Code ret = loop_.Init(evt_type);
+  if (ret != kOk) return ret;
+
+  dispatch_ = new Dispatch(kPrivateStackMode, stack_size);
+  return kOk;
+} /*}}}*/
+
+CoScheduler *CoScheduler::Current() { /*{{{*/ return g_cur_scheduler; } /*}}}*/
+
+uint32_t CoScheduler::GetCoroutinesNum() { /*{{{*/
+  uint32_t num = 0;
+  if (dispatch_ != NULL) dispatch_->GetCoroutinesNum(&num);
+  return num;
+} /*}}}*/
+
+Code CoScheduler::Spawn(const CoTask &task) { /*{{{*/
+  if (dispatch_ == NULL) return kNotInit;
+
+  CoTask *param = new CoTask(task);
+  uint32_t coroutine_id = 0;
+  Code ret = dispatch_->CreateCoroutine(CoTaskAction, param, &coroutine_id);
+  if (ret != kOk) {
+    delete param;
+    return ret;
+  }
+
+  ready_ids_.push_back(coroutine_id);
+  return kOk;
+} /*}}}*/
+
+Code CoScheduler::Run() { /*{{{*/
+  Code ret = kOk;
+
+  while (true) {
+    ret = RunOnce(kDefaultWaitTimeMs);
+  }
+
+  return ret;
+} /*}}}*/
+
+Code CoScheduler::RunOnce(int time_out_ms) { /*{{{*/
+  if (dispatch_ == NULL) return kNotInit;
+
+  RunReady();
+  Code ret = loop_.RunOnce(ready_ids_.empty() ? time_out_ms : 0);
+  RunReady();
+
+  return ret;
+} /*}}}*/
+
+void CoScheduler::RunReady() { /*{{{*/
+  // NOTE:htt, coroutines woken up by this round are run in the next round, so Yield can not starve others
+  std::deque<uint32_t> ids;
+  ids.swap(ready_ids_);
+
+  CoScheduler *prev_scheduler = g_cur_scheduler;
+  g_cur_scheduler = this;
+  for (std::deque<uint32_t>::iterator it = ids.begin(); it != ids.end(); ++it) {
+    cur_coroutine_id_ = *it;
+    dispatch_->CoroutineResume(*it);
+  }
+  cur_coroutine_id_ = kCoroutineDefaultId;
+  g_cur_scheduler = prev_scheduler;
+} /*}}}*/
+
+Code CoScheduler::FdEventAction(int fd, int evt, void *param) { /*{{{*/
+  CoWaiter *waiter = static_cast<CoWaiter *>(param);
+  waiter->sched->WakeUp(waiter, evt);
+  return kOk;
+} /*}}}*/
+
+void CoScheduler::WakeUp(CoWaiter *waiter, int fired_evt) { /*{{{*/
+  // NOTE:htt, waiter is on the stack of the waiting coroutine, so it's cleared before the coroutine is run
+  if (waiter->fd >= 0) {
+    loop_.Del(waiter->fd);
+    fd_waiters_.erase(waiter->fd);
+  }
+  if (waiter->timer_id != 0 && fired_evt != 0) loop_.CancelTimer(waiter->timer_id);
+  waiter->timer_id = 0;
+  waiter->fired_evt = fired_evt;
+  ready_ids_.push_back(waiter->coroutine_id);
+} /*}}}*/
+
+Code CoScheduler::WaitWaiter(CoWaiter *waiter, int evt, int time_out_ms) { /*{{{*/
+  if (waiter->fd >= 0) {
+    if (fd_waiters_.find(waiter->fd) != fd_waiters_.end()) return kAlreadyExist;
+    Code ret = loop_.Add(waiter->fd, evt, FdEventAction, waiter);
+    if (ret != kOk) return ret;
+    fd_waiters_[waiter->fd] = waiter;
+  }
+
+  if (time_out_ms >= 0) {
+    Code ret = loop_.AddTimer(time_out_ms, [this, waiter]() { WakeUp(waiter, 0); }, &waiter->timer_id);
+    if (ret != kOk) {
+      if (waiter->fd >= 0) {
+        loop_.Del(waiter->fd);
+        fd_waiters_.erase(waiter->fd);
+      }
+      return ret;
+    }
+  }
+
+  uint32_t coroutine_id = cur_coroutine_id_;
+  Code ret = dispatch_->CoroutineYield();
+  cur_coroutine_id_ = coroutine_id;
+  return ret;
+} /*}}}*/
+
+Code CoScheduler::WaitFd(int fd, int evt, int time_out_ms, int *fired_evt) { /*{{{*/
+  if (g_cur_scheduler != this || cur_coroutine_id_ == kCoroutineDefaultId) return kNotInit;
+  if (fd < 0) return kInvalidParam;
+
+  CoWaiter waiter = {this, cur_coroutine_id_, fd, 0, 0};
+  Code ret = WaitWaiter(&waiter, evt, time_out_ms);
+  if (ret != kOk) return ret;
+
+  if (fired_evt != NULL) *fired_evt = waiter.fired_evt;
+  return waiter.fired_evt == 0 ? kTimeOut : kOk;
+} /*}}}*/
+
+Code CoScheduler::Sleep(uint32_t ms) { /*{{{*/
+  if (g_cur_scheduler != this || cur_coroutine_id_ == kCoroutineDefaultId) return kNotInit;
+
+  CoWaiter waiter = {this, cur_coroutine_id_, -1, 0, 0};
+  return WaitWaiter(&waiter, 0, ms);
+} /*}}}*/
+
+Code CoScheduler::Yield() { /*{{{*/
+  if (g_cur_scheduler != this || cur_coroutine_id_ == kCoroutineDefaultId) return kNotInit;
+
+  uint32_t coroutine_id = cur_coroutine_id_;
+  ready_ids_.push_back(coroutine_id);
+  Code ret = dispatch_->CoroutineYield();
+  cur_coroutine_id_ = coroutine_id;
+  return ret;
+} /*}}}*/
+
+Code CoScheduler::Read(int fd, void *buf, size_t len, int time_out_ms, ssize_t *read_len) { /*{{{*/
+  if (buf == NULL || read_len == NULL) return kInvalidParam;
+
+  while (true) {
+    ssize_t r = read(fd, buf, len);
+    if (r >= 0) {
+      *read_len = r;
+      return kOk;
+    }
+    if (errno == EINTR) continue;
+    if (errno != EAGAIN && errno != EWOULDBLOCK) return kReadError;
+
+    Code ret = WaitFd(fd, EV_IN, time_out_ms, NULL);
+    if (ret != kOk) return ret;
+  }
+} /*}}}*/
+
+Code CoScheduler::Write(int fd, const void *buf, size_t len, int time_out_ms) { /*{{{*/
+  if (buf == NULL) return kInvalidParam;
+
+  const char *pos = static_cast<const char *>(buf);
+  while (len > 0) {
+    ssize_t r = write(fd, pos, len);
+    if (r > 0) {
+      pos += r;
+      len -= r;
+      continue;
+    }
+    if (r == -1 && errno == EINTR) continue;
+    if (r == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) return kWriteError;
+
+    Code ret = WaitFd(fd, EV_OUT, time_out_ms, NULL);
+    if (ret != kOk) return ret;
+  }
+
+  return kOk;
+} /*}}}*/
+
+Code CoScheduler::Connect(int fd, const struct sockaddr *addr, socklen_t addr_len, int time_out_ms) { /*{{{*/
+  if (addr == NULL) return kInvalidParam;
+
+  int r = 0;
+  while (true) {
+    r = connect(fd, addr, addr_len);
+    if (r == -1 && errno == EINTR) continue;
+    break;
+  }
+  if (r == 0) return kOk;
+  if (errno != EINPROGRESS && errno != EAGAIN) return kConnectError;
+
+  Code ret = WaitFd(fd, EV_OUT, time_out_ms, NULL);
+  if (ret != kOk) return ret;
+
+  int sock_err = 0;
+  socklen_t sock_err_len = sizeof(sock_err);
+  if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &sock_err, &sock_err_len) == -1) return kSocketError;
+  if (sock_err != 0) return kConnectError;
+  return kOk;
+} /*}}}*/
+
+}  // namespace base
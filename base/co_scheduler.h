@@ -0,0 +1,112 @@
+// Copyright (c) 2015 The CSUTIL Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BASE_CO_SCHEDULER_H_
+#define BASE_CO_SCHEDULER_H_
+
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include <deque>
+#include <functional>
+#include <map>
+
+#include "base/coroutine.h"
+#include "base/event_loop.h"
+#include "base/status.h"
+
+namespace base {
+
+typedef std::function<void()> CoTask;
+
+class CoScheduler;
+
+struct CoWaiter { /*{{{*/
+  CoScheduler *sched;
+  uint32_t coroutine_id;
+  int fd;           // NOTE:htt, -1 if only timer is waited, ex: Sleep
+  int fired_evt;    // NOTE:htt, 0 if timeout
+  uint64_t timer_id;
+}; /*}}}*/
+
+/**
+ * NOTE:htt, CoScheduler runs coroutines on its EventLoop in one thread: a coroutine calling Read/Write/Connect/
+ * Sleep is yielded on EAGAIN and resumed by the event or timer of loop, so thousands of blocking-style calls
+ * wait together in one thread without blocking it.
+ *
+ * Coroutines are created with private stacks, see kPrivateStackMode of Dispatch; nothing is thread safe, so
+ * Spawn and the coroutine calls should be used in the loop thread only.
+ */
+class CoScheduler { /*{{{*/
+ public:
+  CoScheduler();
+  ~CoScheduler();
+
+  Code Init(EventType evt_type, uint32_t stack_size = kDefaultCoroutineStackSize);
+
+ public:
+  // NOTE:htt, task is run in a new coroutine by the next RunOnce, and the coroutine finishes when task returns
+  Code Spawn(const CoTask &task);
+
+  Code Run();
+
+  /**
+   * Note: run all ready coroutines, then wait events of loop once, which is shortened to 0 if any coroutine is
+   * ready; coroutines woken by the wait are run before return
+   */
+  Code RunOnce(int time_out_ms);
+
+  EventLoop *GetLoop() { return &loop_; }
+  uint32_t GetCoroutinesNum();
+
+ public:
+  /**
+   * Note: the following functions should be called in a coroutine of this scheduler, and kNotInit is returned
+   * otherwise; time_out_ms is -1 for waiting forever, and kTimeOut is returned if it expires
+   */
+
+  // NOTE:htt, wait evt of fd once, fired_evt may be NULL; only one coroutine can wait one fd at the same time
+  Code WaitFd(int fd, int evt, int time_out_ms, int *fired_evt);
+
+  // NOTE:htt, fd should be nonblocking; read at most len bytes, and *read_len is 0 if peer is closed
+  Code Read(int fd, void *buf, size_t len, int time_out_ms, ssize_t *read_len);
+
+  // NOTE:htt, fd should be nonblocking; all len bytes are written unless failed
+  Code Write(int fd, const void *buf, size_t len, int time_out_ms);
+
+  // NOTE:htt, fd should be nonblocking
+  Code Connect(int fd, const struct sockaddr *addr, socklen_t addr_len, int time_out_ms);
+
+  Code Sleep(uint32_t ms);
+
+  // NOTE:htt, let other ready coroutines run, and current one is resumed in the next round
+  Code Yield();
+
+  // NOTE:htt, the scheduler whose coroutine is running in current thread, NULL if not in a coroutine
+  static CoScheduler *Current();
+
+ private:
+  void RunReady();
+  Code WaitWaiter(CoWaiter *waiter, int evt, int time_out_ms);
+  void WakeUp(CoWaiter *waiter, int fired_evt);
+
+  static Code FdEventAction(int fd, int evt, void *param);
+
+ private:
+  CoScheduler(const CoScheduler &);
+  CoScheduler &operator=(const CoScheduler &);
+
+ private:
+  EventLoop loop_;
+  Dispatch *dispatch_;
+  uint32_t cur_coroutine_id_;  // NOTE:htt, kCoroutineDefaultId if no coroutine is running
+
+  std::deque<uint32_t> ready_ids_;
+  std::map<int, CoWaiter *> fd_waiters_;
+}; /*}}}*/
+
+}  // namespace base
+
+#endif
@@ -45,6 +45,11 @@ const int kMagicLen = 4;
 const int kFrameCodeLen = 4;
 const int kExtHeadLen = kMagicLen + kFrameCodeLen;  // Magic(4) + FrameCode(4) = 8
 const uint32_t kProtoMagic = 0xC5C5C5C5;
+
+// Multiplexed frame: [Head(4B)][Magic(4B)][FrameCode(4B)][ReqId(8B)][UserData(NB)], negotiated by magic
+const int kReqIdLen = 8;
+const int kMultiplexExtHeadLen = kExtHeadLen + kReqIdLen;  // Magic(4) + FrameCode(4) + ReqId(8) = 16
+const uint32_t kMultiplexProtoMagic = 0xC5C5C5C6;
 const int kIntMax = 0x7fffffff;
 
 // Frame error code range [700, 799]
@@ -91,6 +96,15 @@ const std::string kStatFileSizeKey = "stat_file_size";
 const std::string kStatDumpCirclekey = "stat_dump_circle";
 const std::string kFtpStoreDirKey = "directory";
 const std::string kBufLenKey = "buf_len";
+// NOTE:htt, "main": main thread accepts and passes fd to worker by pipe; "reuseport": every worker accepts by itself
+const std::string kAcceptModeKey = "accept_mode";
+const std::string kMainAcceptMode = "main";
+const std::string kReusePortAcceptMode = "reuseport";
+// NOTE:htt, "poll", "epoll" or "io_uring", and io_uring falls back to epoll if it's not available
+const std::string kEventTypeKey = "event_type";
+const std::string kPollEventType = "poll";
+const std::string kEPollEventType = "epoll";
+const std::string kIoUringEventType = "io_uring";
 
 const int kDefaultPort = 9090;
 
@@ -158,6 +172,18 @@ enum CoroutineStatus {
   kCoroutineSuspendingStatus = 3,
 };
 
+/**
+ * NOTE:htt, kSharedStackMode runs all coroutines on one stack, and copies the used part out and in by every switch;
+ * kPrivateStackMode gives every coroutine its own mmap stack with guard page, and switch only swaps registers
+ */
+enum CoroutineStackMode {
+  kSharedStackMode = 0,
+  kPrivateStackMode = 1,
+};
+
+const uint32_t kDefaultCoroutineStackSize = 128 * kKB;  // NOTE:htt, private stack size, guard page not included
+const uint32_t kMaxPooledCoroutineStacks = 1024;        // NOTE:htt, free stacks kept for new coroutines
+
 const uint32_t kConsistentHashSeed = 0x0523;
 
 const uint32_t kNumOfLowerCaseLetter = 26;
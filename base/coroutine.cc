@@ -6,6 +6,59 @@
 
 #include <assert.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) && defined(__linux__)
+#  define BASE_COROUTINE_FAST_SWITCH
+#endif
+
+#if defined(BASE_COROUTINE_FAST_SWITCH)
+/**
+ * NOTE:htt, save callee-saved registers on current stack, store the stack pointer to *from_sp, then switch to
+ * to_sp and restore its registers; caller-saved registers are saved by compiler around the call, and signal mask
+ * is not changed, so no syscall is needed like swapcontext
+ */
+extern "C" void BaseCoroutineSwap(void **from_sp, void *to_sp);
+
+// NOTE:htt, first return address of new coroutine, which calls r13(r12)
+extern "C" void BaseCoroutineEntry();
+
+asm(R"(
+  .text
+  .globl BaseCoroutineSwap
+  .hidden BaseCoroutineSwap
+  .type BaseCoroutineSwap, @function
+  .p2align 4
+BaseCoroutineSwap:
+  pushq %rbp
+  pushq %rbx
+  pushq %r12
+  pushq %r13
+  pushq %r14
+  pushq %r15
+  movq %rsp, (%rdi)
+  movq %rsi, %rsp
+  popq %r15
+  popq %r14
+  popq %r13
+  popq %r12
+  popq %rbx
+  popq %rbp
+  ret
+  .size BaseCoroutineSwap, .-BaseCoroutineSwap
+
+  .globl BaseCoroutineEntry
+  .hidden BaseCoroutineEntry
+  .type BaseCoroutineEntry, @function
+  .p2align 4
+BaseCoroutineEntry:
+  movq %r12, %rdi
+  callq *%r13
+  ud2
+  .size BaseCoroutineEntry, .-BaseCoroutineEntry
+)");
+#endif
 
 namespace base {
 
@@ -19,18 +72,53 @@ static void MainFunc(void *param) { /*{{{*/
   dispatch->DeleteCurCoroutine();
 } /*}}}*/
 
-Dispatch::Dispatch() { /*{{{*/
-  memset(stack_, '\0', sizeof(stack_));
+Dispatch::Dispatch() : Dispatch(kSharedStackMode) { /*{{{*/
+} /*}}}*/
+
+Dispatch::Dispatch(CoroutineStackMode mode, uint32_t stack_size) { /*{{{*/
+  mode_ = mode;
+  page_size_ = sysconf(_SC_PAGESIZE);
+  stack_ = NULL;
+  main_sp_ = NULL;
+  dead_stack_ = NULL;
   cur_coroutine_id_ = kCoroutineDefaultId;
+
+  if (mode_ == kSharedStackMode) {
+    stack_size_ = kMB;
+    stack_ = new char[stack_size_];
+    memset(stack_, '\0', stack_size_);
+  } else {
+    if (stack_size == 0) stack_size = kDefaultCoroutineStackSize;
+    stack_size_ = (stack_size + page_size_ - 1) / page_size_ * page_size_;
+  }
 } /*}}}*/
 
 Dispatch::~Dispatch() { /*{{{*/
   std::map<uint32_t, Coroutine *>::iterator it = coroutines_.begin();
   for (; it != coroutines_.end(); ++it) {
+    if (it->second->stack_ != NULL) munmap(it->second->stack_, page_size_ + stack_size_);
     delete it->second;
     it->second = NULL;
   }
   coroutines_.clear();
+
+  for (size_t i = 0; i < free_stacks_.size(); ++i) {
+    munmap(free_stacks_[i], page_size_ + stack_size_);
+  }
+  free_stacks_.clear();
+
+  if (stack_ != NULL) {
+    delete[] stack_;
+    stack_ = NULL;
+  }
+} /*}}}*/
+
+bool Dispatch::IsFastSwitch() { /*{{{*/
+#if defined(BASE_COROUTINE_FAST_SWITCH)
+  return true;
+#else
+  return false;
+#endif
 } /*}}}*/
 
 Code Dispatch::CreateCoroutine(CoroutineFunc func, void *param, uint32_t *coroutine_id) { /*{{{*/
@@ -55,6 +143,7 @@ Code Dispatch::CoroutineResume(uint32_t coroutine_id) { /*{{{*/
   Coroutine *cur_coroutine = NULL;
   Code ret = GetCoroutine(coroutine_id, &cur_coroutine);
   if (ret != kOk) return ret;
+  if (mode_ == kPrivateStackMode) return ResumePrivate(coroutine_id, cur_coroutine);
 
   int r = 0;
   switch (cur_coroutine->status_) {
@@ -64,14 +153,14 @@ Code Dispatch::CoroutineResume(uint32_t coroutine_id) { /*{{{*/
       cur_coroutine->status_ = kCoroutineRunningStatus;
       cur_coroutine_id_ = coroutine_id;
       cur_coroutine->context_.uc_stack.ss_sp = stack_;
-      cur_coroutine->context_.uc_stack.ss_size = sizeof(stack_);
+      cur_coroutine->context_.uc_stack.ss_size = stack_size_;
       cur_coroutine->context_.uc_link = NULL;
       makecontext(&(cur_coroutine->context_), (void (*)())MainFunc, 1, (void *)this);
       swapcontext(&main_context_, &(cur_coroutine->context_));
 
       break;
     case kCoroutineSuspendingStatus:
-      memcpy(stack_ + sizeof(stack_) - cur_coroutine->bak_stack_.size(), cur_coroutine->bak_stack_.data(),
+      memcpy(stack_ + stack_size_ - cur_coroutine->bak_stack_.size(), cur_coroutine->bak_stack_.data(),
              cur_coroutine->bak_stack_.size());  // NOTE: resume stack
       cur_coroutine->status_ = kCoroutineRunningStatus;
       cur_coroutine_id_ = coroutine_id;
@@ -84,18 +173,115 @@ Code Dispatch::CoroutineResume(uint32_t coroutine_id) { /*{{{*/
   return kOk;
 } /*}}}*/
 
+Code Dispatch::ResumePrivate(uint32_t coroutine_id, Coroutine *coroutine) { /*{{{*/
+  switch (coroutine->status_) {
+    case kCoroutinePreparingStatus: {
+      Code ret = AllocStack(&coroutine->stack_);
+      if (ret != kOk) return ret;
+      coroutine->status_ = kCoroutineRunningStatus;
+      cur_coroutine_id_ = coroutine_id;
+#if defined(BASE_COROUTINE_FAST_SWITCH)
+      // NOTE:htt, frame popped by BaseCoroutineSwap: r15, r14, r13, r12, rbx, rbp, return address
+      void **sp = reinterpret_cast<void **>(coroutine->stack_ + page_size_ + stack_size_);
+      *--sp = reinterpret_cast<void *>(BaseCoroutineEntry);
+      *--sp = NULL;                                   // rbp
+      *--sp = NULL;                                   // rbx
+      *--sp = this;                                   // r12, param of MainFunc
+      *--sp = reinterpret_cast<void *>(MainFunc);     // r13
+      *--sp = NULL;                                   // r14
+      *--sp = NULL;                                   // r15
+      coroutine->sp_ = sp;
+      BaseCoroutineSwap(&main_sp_, coroutine->sp_);
+#else
+      int r = getcontext(&(coroutine->context_));
+      if (r == -1) return kFailedGetContext;
+      coroutine->context_.uc_stack.ss_sp = coroutine->stack_ + page_size_;
+      coroutine->context_.uc_stack.ss_size = stack_size_;
+      coroutine->context_.uc_link = NULL;
+      makecontext(&(coroutine->context_), (void (*)())MainFunc, 1, (void *)this);
+      swapcontext(&main_context_, &(coroutine->context_));
+#endif
+      break;
+    }
+    case kCoroutineSuspendingStatus:
+      coroutine->status_ = kCoroutineRunningStatus;
+      cur_coroutine_id_ = coroutine_id;
+#if defined(BASE_COROUTINE_FAST_SWITCH)
+      BaseCoroutineSwap(&main_sp_, coroutine->sp_);
+#else
+      swapcontext(&main_context_, &(coroutine->context_));
+#endif
+      break;
+    default:
+      return kInvalidStatus;
+  }
+
+  ReleaseDeadStack();
+  return kOk;
+} /*}}}*/
+
+Code Dispatch::AllocStack(char **stack) { /*{{{*/
+  if (!free_stacks_.empty()) {
+    *stack = free_stacks_.back();
+    free_stacks_.pop_back();
+    return kOk;
+  }
+
+  int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#if defined(MAP_STACK)
+  flags |= MAP_STACK;
+#endif
+  void *addr = mmap(NULL, page_size_ + stack_size_, PROT_READ | PROT_WRITE, flags, -1, 0);
+  if (addr == MAP_FAILED) return kFailedAllocStack;
+
+  // NOTE:htt, stack grows down, so the lowest page is guard page
+  if (mprotect(addr, page_size_, PROT_NONE) != 0) {
+    munmap(addr, page_size_ + stack_size_);
+    return kFailedAllocStack;
+  }
+
+  *stack = static_cast<char *>(addr);
+  return kOk;
+} /*}}}*/
+
+void Dispatch::FreeStack(char *stack) { /*{{{*/
+  if (free_stacks_.size() < kMaxPooledCoroutineStacks) {
+    free_stacks_.push_back(stack);
+    return;
+  }
+  munmap(stack, page_size_ + stack_size_);
+} /*}}}*/
+
+void Dispatch::ReleaseDeadStack() { /*{{{*/
+  if (dead_stack_ == NULL) return;
+  FreeStack(dead_stack_);
+  dead_stack_ = NULL;
+} /*}}}*/
+
 Code Dispatch::CoroutineYield() { /*{{{*/
   Coroutine *cur_coroutine = NULL;
   Code ret = GetCurCoroutine(&cur_coroutine);
   if (ret != kOk) return ret;
 
+  if (mode_ == kPrivateStackMode) {
+    cur_coroutine->status_ = kCoroutineSuspendingStatus;
+    cur_coroutine_id_ = kCoroutineDefaultId;
+#if defined(BASE_COROUTINE_FAST_SWITCH)
+    BaseCoroutineSwap(&(cur_coroutine->sp_), main_sp_);
+#else
+    int r = swapcontext(&(cur_coroutine->context_), &main_context_);
+    if (r == -1) return kFailedSwapContext;
+#endif
+    return kOk;
+  }
+
   // fprintf(stderr, "&cur_coroutine:%p, stack_:%p, top:%p\n", (char*)&cur_coroutine, stack_,
-  // stack_+sizeof(stack_)); Note: the stack of current coroutine must be in [stack_,
-  // stack_+sizeof(stack_)]
-  assert(((char *)&cur_coroutine < stack_ + sizeof(stack_)) && ((char *)&cur_coroutine >= stack_));
+  // stack_+stack_size_); Note: the stack of current coroutine must be in [stack_,
+  // stack_+stack_size_]
+  assert(((char *)&cur_coroutine < stack_ + stack_size_) && ((char *)&cur_coroutine >= stack_));
 
   // Note: keeping current coroutine's stack
-  cur_coroutine->bak_stack_.assign((char *)(&cur_coroutine), stack_ + sizeof(stack_) - (char *)(&cur_coroutine));
+  cur_coroutine->bak_stack_.assign((char *)(&cur_coroutine), stack_ + stack_size_ - (char *)(&cur_coroutine));
   cur_coroutine->status_ = kCoroutineSuspendingStatus;
   cur_coroutine_id_ = kCoroutineDefaultId;
   int r = swapcontext(&(cur_coroutine->context_), &main_context_);
@@ -187,11 +373,19 @@ Code Dispatch::DeleteCurCoroutine() { /*{{{*/
   }
   Coroutine *cur_coroutine = cur_it->second;
 
+  // NOTE:htt, we are still running on the private stack, so it's released by resumer after switched out
+  dead_stack_ = cur_coroutine->stack_;
   delete cur_coroutine;
   coroutines_.erase(cur_it);
 
   cur_coroutine_id_ = kCoroutineDefaultId;
 
+#if defined(BASE_COROUTINE_FAST_SWITCH)
+  if (mode_ == kPrivateStackMode) {
+    void *sp = NULL;
+    BaseCoroutineSwap(&sp, main_sp_);
+  }
+#endif
   ucontext_t context;
   swapcontext(&context, &main_context_);
 
@@ -11,6 +11,7 @@
 #include <ucontext.h>
 #include <map>
 #include <string>
+#include <vector>
 
 #include "base/common.h"
 #include "base/status.h"
@@ -25,20 +26,31 @@ struct Coroutine {
   void *param_;
   ucontext_t context_;
   CoroutineStatus status_;
-  std::string bak_stack_;
+  std::string bak_stack_;  // NOTE:htt, only used in kSharedStackMode
+
+  char *stack_;  // NOTE:htt, only used in kPrivateStackMode, and the lowest page is guard page
+  void *sp_;     // NOTE:htt, saved stack pointer if switched by CoroutineSwap
 
   Coroutine() { /*{{{*/
     func_ = NULL;
     param_ = NULL;
     status_ = kCoroutineNotExistStatus;
+    stack_ = NULL;
+    sp_ = NULL;
   } /*}}}*/
 
   ~Coroutine() {}
 };
 
+/**
+ * NOTE:htt, in kPrivateStackMode, stacks are mmaped with one PROT_NONE page below, so overflow is a SIGSEGV
+ * instead of corrupting other memory; stacks of finished coroutines are kept in a free list and reused;
+ * on x86_64 linux the switch saves callee-saved registers only, without the sigprocmask syscall of swapcontext
+ */
 class Dispatch {
  public:
   Dispatch();
+  explicit Dispatch(CoroutineStackMode mode, uint32_t stack_size = kDefaultCoroutineStackSize);
   ~Dispatch();
 
  public:
@@ -54,14 +66,32 @@ class Dispatch {
   Code CheckCoroutineExist(uint32_t coroutine_id, bool *exist);
   Code DeleteCurCoroutine();
 
+  CoroutineStackMode GetStackMode() const { return mode_; }
+  uint32_t GetPooledStacksNum() const { return free_stacks_.size(); }
+
+  static bool IsFastSwitch();  // NOTE:htt, true if private stacks are switched by CoroutineSwap
+
  private:
   Code GetNewCoroutineId(uint32_t *coroutine_id);
 
+  Code AllocStack(char **stack);
+  void FreeStack(char *stack);
+  void ReleaseDeadStack();
+  Code ResumePrivate(uint32_t coroutine_id, Coroutine *coroutine);
+
  private:
-  char stack_[kMB];
+  CoroutineStackMode mode_;
+  char *stack_;  // NOTE:htt, the shared stack of kSharedStackMode
+  uint32_t stack_size_;
+  size_t page_size_;
+
   ucontext_t main_context_;
+  void *main_sp_;
   uint32_t cur_coroutine_id_;
   std::map<uint32_t, Coroutine *> coroutines_;
+
+  std::vector<char *> free_stacks_;
+  char *dead_stack_;  // NOTE:htt, stack of the finished coroutine, released after switched out of it
 };
 
 }  // namespace base
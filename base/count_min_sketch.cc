@@ -0,0 +1,95 @@
+// Copyright (c) 2015 The CSUTIL Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/count_min_sketch.h"
+
+#include "base/hash.h"
+
+namespace base {
+
+const uint32_t kCountMinSketchDepth = 4;
+const uint32_t kCountMinSketchMaxCounter = 15;
+const uint32_t kCountersPerWord = 16;
+const uint32_t kCountMinSketchSeeds[2] = {0x9747b28c, 0x85ebca6b};
+
+CountMinSketch::CountMinSketch() : table_(), row_mask_(0), sample_size_(0), size_(0), reset_num_(0) { /*{{{*/
+} /*}}}*/
+
+CountMinSketch::~CountMinSketch() { /*{{{*/ } /*}}}*/
+
+Code CountMinSketch::Init(uint32_t keys_num, uint32_t sample_factor /*=10*/) { /*{{{*/
+  if (keys_num == 0 || sample_factor == 0) return kInvalidParam;
+
+  uint64_t row_size = kCountersPerWord;
+  while (row_size < keys_num) {
+    row_size <<= 1;
+  }
+  row_mask_ = row_size - 1;
+  table_.assign(row_size * kCountMinSketchDepth / kCountersPerWord, 0);
+  sample_size_ = (uint64_t)keys_num * sample_factor;
+  size_ = 0;
+  reset_num_ = 0;
+
+  return kOk;
+} /*}}}*/
+
+/**
+ * Index of counter in every row is h1 + i * h2, which is as good as independent
+ * hash functions for count-min sketch, and only needs two hashes
+ */
+void CountMinSketch::GetIndexes(const std::string &key, uint64_t *indexes) const { /*{{{*/
+  uint32_t h1 = Murmur32(key, kCountMinSketchSeeds[0]);
+  uint32_t h2 = Murmur32(key, kCountMinSketchSeeds[1]) | 1;
+  for (uint32_t i = 0; i < kCountMinSketchDepth; ++i) {
+    indexes[i] = i * (row_mask_ + 1) + ((h1 + i * h2) & row_mask_);
+  }
+} /*}}}*/
+
+uint32_t CountMinSketch::GetCounter(uint64_t index) const { /*{{{*/
+  return (table_[index / kCountersPerWord] >> ((index % kCountersPerWord) * 4)) & 0xf;
+} /*}}}*/
+
+void CountMinSketch::Increment(const std::string &key) { /*{{{*/
+  if (table_.empty()) return;
+
+  uint64_t indexes[kCountMinSketchDepth];
+  GetIndexes(key, indexes);
+  bool is_added = false;
+  for (uint32_t i = 0; i < kCountMinSketchDepth; ++i) {
+    if (GetCounter(indexes[i]) >= kCountMinSketchMaxCounter) continue;
+    table_[indexes[i] / kCountersPerWord] += (uint64_t)1 << ((indexes[i] % kCountersPerWord) * 4);
+    is_added = true;
+  }
+  if (!is_added) return;
+
+  if (++size_ < sample_size_) return;
+
+  // Note: halve all counters of a word at once, and the mask drops bits shifted in from the next counter
+  for (size_t i = 0; i < table_.size(); ++i) {
+    table_[i] = (table_[i] >> 1) & 0x7777777777777777ULL;
+  }
+  size_ /= 2;
+  ++reset_num_;
+} /*}}}*/
+
+uint32_t CountMinSketch::Estimate(const std::string &key) const { /*{{{*/
+  if (table_.empty()) return 0;
+
+  uint64_t indexes[kCountMinSketchDepth];
+  GetIndexes(key, indexes);
+  uint32_t freq = kCountMinSketchMaxCounter;
+  for (uint32_t i = 0; i < kCountMinSketchDepth; ++i) {
+    uint32_t counter = GetCounter(indexes[i]);
+    if (counter < freq) freq = counter;
+  }
+
+  return freq;
+} /*}}}*/
+
+void CountMinSketch::Reset() { /*{{{*/
+  table_.assign(table_.size(), 0);
+  size_ = 0;
+} /*}}}*/
+
+}  // namespace base
@@ -0,0 +1,75 @@
+// Copyright (c) 2015 The CSUTIL Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BASE_COUNT_MIN_SKETCH_H_
+#define BASE_COUNT_MIN_SKETCH_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "base/status.h"
+
+namespace base {
+
+/**
+ * Count-Min Sketch for estimating access frequency of keys
+ *
+ * Every key is counted in one counter of every row, and the estimated
+ * frequency is the minimum of them, so it's never less than the real one.
+ * Counters are 4 bits and saturate at 15, which is enough to tell hot keys
+ * from cold ones with little memory.
+ *
+ * Aging: once the number of increments reaches the sample size, all counters
+ * are halved, so old popularity fades and the sketch follows the current load.
+ *
+ * Usage example:
+ *   CountMinSketch sketch;
+ *   sketch.Init(10000);      // about 10000 keys are tracked
+ *   sketch.Increment("key1");
+ *   uint32_t freq = sketch.Estimate("key1");  // freq is 1
+ */
+class CountMinSketch {
+ public:
+  CountMinSketch();
+  ~CountMinSketch();
+
+ public:
+  /**
+   * Initialize the sketch
+   *
+   * @param keys_num Expected number of distinct keys, the width of every row is the
+   *                 power of 2 not less than it
+   * @param sample_factor Counters are halved after keys_num * sample_factor increments
+   * @return base::kOk if the sketch is initialized
+   * @return base::kInvalidParam if keys_num or sample_factor is 0
+   */
+  Code Init(uint32_t keys_num, uint32_t sample_factor = 10);
+
+  // Note: count one access of key, which may halve all counters by aging
+  void Increment(const std::string &key);
+
+  // Note: estimated frequency of key, which is 0 before Init
+  uint32_t Estimate(const std::string &key) const;
+
+  void Reset();
+
+  uint64_t GetResetNum() const { return reset_num_; }
+
+ private:
+  void GetIndexes(const std::string &key, uint64_t *indexes) const;
+  uint32_t GetCounter(uint64_t index) const;
+
+ private:
+  std::vector<uint64_t> table_;  ///< Rows of 16 counters of 4 bits per uint64_t
+  uint64_t row_mask_;            ///< Counters of one row minus 1
+  uint64_t sample_size_;         ///< Increments before aging
+  uint64_t size_;                ///< Increments since the last aging, which is halved by aging too
+  uint64_t reset_num_;           ///< Times of aging
+};
+
+}  // namespace base
+
+#endif
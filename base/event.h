@@ -20,6 +20,7 @@ enum EventType { /*{{{*/
                  kSelect,
                  kPoll,
                  kEPoll,
+                 kIoUring,  // NOTE:htt, fall back to epoll at runtime if io_uring is not available
 }; /*}}}*/
 
 enum EV {                  /*{{{*/
@@ -39,6 +40,11 @@ enum EV {                  /*{{{*/
           EV_ET = (1 << 31),  // Set the Edge Triggered behavior for the fd
 }; /*}}}*/
 
+struct FiredEvent { /*{{{*/
+  int fd;
+  int evt;
+}; /*}}}*/
+
 class Event { /*{{{*/
  public:
   Event() {}
@@ -49,6 +55,12 @@ class Event { /*{{{*/
   virtual Code Wait(int time_out_ms) = 0;
   virtual Code GetEvents(int *fd, int *evt) = 0;
 
+  /**
+   * Note: return all events left of last Wait at once instead of one event per call, and evts is valid until
+   * next Wait; events returned are not returned by GetEvents again
+   */
+  virtual Code GetFiredEvents(const FiredEvent **evts, int *num) = 0;
+
   virtual Code Add(int fd, int evt) = 0;
   virtual Code Mod(int fd, int evt) = 0;
   virtual Code Del(int fd) = 0;
@@ -68,4 +80,6 @@ class Event { /*{{{*/
 #  include "base/event_epoll.h"
 #endif
 
+#include "base/event_io_uring.h"
+
 #endif
@@ -9,7 +9,8 @@
 
 namespace base {
 
-EventEpoll::EventEpoll() : epfd_(-1), evts_(NULL), max_evts_num_(0), cur_evts_pos_(0), evts_num_(0) {}
+EventEpoll::EventEpoll()
+    : epfd_(-1), evts_(NULL), fired_evts_(NULL), max_evts_num_(0), cur_evts_pos_(0), evts_num_(0) {}
 
 EventEpoll::~EventEpoll() { /*{{{*/
   if (epfd_ != -1) {
@@ -21,6 +22,11 @@ EventEpoll::~EventEpoll() { /*{{{*/
     delete[] evts_;
     evts_ = NULL;
   }
+
+  if (fired_evts_ != NULL) {
+    delete[] fired_evts_;
+    fired_evts_ = NULL;
+  }
 } /*}}}*/
 
 /**
@@ -42,6 +48,7 @@ Code EventEpoll::Create(int nfds) { /*{{{*/
     epfd_ = -1;
     return kEpollFailed;
   }
+  fired_evts_ = new struct FiredEvent[nfds];
   max_evts_num_ = nfds;
 
   return kOk;
@@ -91,6 +98,30 @@ Code EventEpoll::GetEvents(int *fd, int *evt) { /*{{{*/
   return kNotFound;
 } /*}}}*/
 
+/**
+ * @brief 一次获取 Wait() 后剩余的全部就绪事件
+ * @param evts 输出参数，返回就绪事件数组，在下次 Wait() 前有效
+ * @param num 输出参数，返回就绪事件个数
+ * @return kOk 成功；kNotFound 没有更多事件
+ *
+ * 注意：避免逐个事件调用 GetEvents() 的虚函数开销，返回的事件不会再被 GetEvents() 返回
+ */
+Code EventEpoll::GetFiredEvents(const FiredEvent **evts, int *num) { /*{{{*/
+  if (evts == NULL || num == NULL) return kInvalidParam;
+
+  int fired_num = 0;
+  for (; cur_evts_pos_ < evts_num_; ++cur_evts_pos_) {
+    fired_evts_[fired_num].fd = evts_[cur_evts_pos_].data.fd;
+    fired_evts_[fired_num].evt = evts_[cur_evts_pos_].events;
+    ++fired_num;
+  }
+  if (fired_num == 0) return kNotFound;
+
+  *evts = fired_evts_;
+  *num = fired_num;
+  return kOk;
+} /*}}}*/
+
 /**
  * @brief 向事件循环添加文件描述符
  * @param fd 文件描述符
@@ -21,6 +21,7 @@ class EventEpoll : public Event {
   virtual Code Create(int nfds);
   virtual Code Wait(int time_out_ms);
   virtual Code GetEvents(int *fd, int *evt);
+  virtual Code GetFiredEvents(const FiredEvent **evts, int *num);
 
   virtual Code Add(int fd, int evt);
   virtual Code Mod(int fd, int evt);
@@ -31,6 +32,7 @@ class EventEpoll : public Event {
  private:
   int epfd_;
   struct epoll_event *evts_;
+  FiredEvent *fired_evts_;
   int max_evts_num_;
   int cur_evts_pos_;
   int evts_num_;
@@ -0,0 +1,629 @@
+// Copyright (c) 2015 The CSUTIL Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/event_io_uring.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__linux__) && defined(__has_include)
+#  if __has_include(<linux/io_uring.h>)
+#    include <linux/io_uring.h>
+#    include <signal.h>
+#    include <sys/mman.h>
+#    include <sys/syscall.h>
+#    include <sys/utsname.h>
+#    if defined(__NR_io_uring_setup) && defined(IORING_FEAT_EXT_ARG)
+#      define BASE_HAVE_IO_URING
+#    endif
+#  endif
+#endif
+
+namespace base {
+
+EventIoUring::EventIoUring()
+    : ring_fd_(-1),
+      sq_ring_(NULL),
+      cq_ring_(NULL),
+      sqes_(NULL),
+      sq_ring_size_(0),
+      cq_ring_size_(0),
+      sqes_size_(0),
+      sq_head_(NULL),
+      sq_tail_(NULL),
+      sq_array_(NULL),
+      sq_mask_(0),
+      sq_entries_(0),
+      sq_local_tail_(0),
+      cq_head_(NULL),
+      cq_tail_(NULL),
+      cq_mask_(0),
+      cqes_(NULL),
+      polls_(),
+      rearm_fds_(),
+      fired_evts_(NULL),
+      max_evts_num_(0),
+      cur_evts_pos_(0),
+      evts_num_(0),
+      completions_(),
+      cur_completion_pos_(0),
+      is_multishot_accept_(false),
+      is_buffers_registered_(false),
+      enter_num_(0) { /*{{{*/
+} /*}}}*/
+
+#if defined(BASE_HAVE_IO_URING)
+
+static_assert(kIoCompletionFlagMore == IORING_CQE_F_MORE, "flag of IoCompletion should be the same as io_uring");
+
+// NOTE:htt, the highest two bits of user data: 0 is completion api, 2 is readiness poll, 3 is internal
+static const uint64_t kPollTag = 2ULL << 62;
+static const uint64_t kInternalTag = 3ULL << 62;
+static const uint32_t kPollGenMask = (1U << 30) - 1;
+
+static uint64_t MakePollData(int fd, uint32_t gen) { /*{{{*/
+  return kPollTag | ((uint64_t)(gen & kPollGenMask) << 32) | (uint32_t)fd;
+} /*}}}*/
+
+static bool IsKernelAtLeast(int major, int minor) { /*{{{*/
+  struct utsname name;
+  if (uname(&name) != 0) return false;
+
+  int cur_major = 0;
+  int cur_minor = 0;
+  if (sscanf(name.release, "%d.%d", &cur_major, &cur_minor) != 2) return false;
+
+  return cur_major > major || (cur_major == major && cur_minor >= minor);
+} /*}}}*/
+
+EventIoUring::~EventIoUring() { /*{{{*/
+  if (sqes_ != NULL) {
+    munmap(sqes_, sqes_size_);
+    sqes_ = NULL;
+  }
+
+  if (cq_ring_ != NULL && cq_ring_ != sq_ring_) munmap(cq_ring_, cq_ring_size_);
+  cq_ring_ = NULL;
+
+  if (sq_ring_ != NULL) {
+    munmap(sq_ring_, sq_ring_size_);
+    sq_ring_ = NULL;
+  }
+
+  if (ring_fd_ != -1) {
+    close(ring_fd_);
+    ring_fd_ = -1;
+  }
+
+  if (fired_evts_ != NULL) {
+    delete[] fired_evts_;
+    fired_evts_ = NULL;
+  }
+} /*}}}*/
+
+/**
+ * @brief 创建 io_uring 实例
+ * @param nfds 一次 Wait 返回的最大就绪事件数，提交队列长度取 nfds 与 kMaxIoUringEntries 的较小值
+ * @return kOk 成功；kInvalidParam 参数无效；kIoUringSetupFailed 内核不支持或被禁用
+ *
+ * 注意：要求内核支持 IORING_FEAT_EXT_ARG（5.11+）以便 Wait 带超时，否则返回失败，由调用者回退到 epoll
+ */
+Code EventIoUring::Create(int nfds) { /*{{{*/
+  if (nfds <= 0) return kInvalidParam;
+  if (ring_fd_ != -1) return kAlreadyExist;
+
+  uint32_t entries = (uint32_t)nfds > kMaxIoUringEntries ? kMaxIoUringEntries : nfds;
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP;
+  params.cq_entries = entries * 2;
+
+  int fd = syscall(__NR_io_uring_setup, entries, &params);
+  if (fd < 0) return kIoUringSetupFailed;
+  ring_fd_ = fd;
+  if (!(params.features & IORING_FEAT_EXT_ARG) || !(params.features & IORING_FEAT_NODROP)) {
+    return kIoUringSetupFailed;
+  }
+
+  sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+  cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  bool is_single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+  if (is_single_mmap) {
+    if (cq_ring_size_ > sq_ring_size_) sq_ring_size_ = cq_ring_size_;
+    cq_ring_size_ = sq_ring_size_;
+  }
+
+  void *ptr = mmap(NULL, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if (ptr == MAP_FAILED) return kIoUringSetupFailed;
+  sq_ring_ = ptr;
+
+  if (is_single_mmap) {
+    cq_ring_ = sq_ring_;
+  } else {
+    ptr = mmap(NULL, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    if (ptr == MAP_FAILED) return kIoUringSetupFailed;
+    cq_ring_ = ptr;
+  }
+
+  sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+  ptr = mmap(NULL, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  if (ptr == MAP_FAILED) return kIoUringSetupFailed;
+  sqes_ = ptr;
+
+  char *sq = static_cast<char *>(sq_ring_);
+  sq_head_ = reinterpret_cast<uint32_t *>(sq + params.sq_off.head);
+  sq_tail_ = reinterpret_cast<uint32_t *>(sq + params.sq_off.tail);
+  sq_array_ = reinterpret_cast<uint32_t *>(sq + params.sq_off.array);
+  sq_mask_ = *reinterpret_cast<uint32_t *>(sq + params.sq_off.ring_mask);
+  sq_entries_ = *reinterpret_cast<uint32_t *>(sq + params.sq_off.ring_entries);
+  sq_local_tail_ = *sq_tail_;
+
+  char *cq = static_cast<char *>(cq_ring_);
+  cq_head_ = reinterpret_cast<uint32_t *>(cq + params.cq_off.head);
+  cq_tail_ = reinterpret_cast<uint32_t *>(cq + params.cq_off.tail);
+  cq_mask_ = *reinterpret_cast<uint32_t *>(cq + params.cq_off.ring_mask);
+  cqes_ = cq + params.cq_off.cqes;
+
+  fired_evts_ = new FiredEvent[nfds];
+  max_evts_num_ = nfds;
+
+  // NOTE:htt, multishot accept is supported since 5.19, and it's not reported by features
+#if defined(IORING_ACCEPT_MULTISHOT)
+  is_multishot_accept_ = IsKernelAtLeast(5, 19);
+#endif
+
+  return kOk;
+} /*}}}*/
+
+/**
+ * @brief 提交所有待提交的 sqe，并按需等待完成事件
+ * @param is_wait 是否等待完成事件；time_out_ms 为 0 时只收割已完成的事件，-1 表示永久等待
+ * @return kOk 成功；kTimeOut 超时；kIoUringFailed 失败
+ *
+ * 注意：会自动重试 EINTR 错误（信号中断）
+ */
+Code EventIoUring::Submit(bool is_wait, int time_out_ms) { /*{{{*/
+  FlushSqe();
+  uint32_t to_submit = sq_local_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+  if (!is_wait && to_submit == 0) return kOk;
+
+  uint32_t min_complete = 0;
+  uint32_t flags = 0;
+  struct __kernel_timespec ts;
+  struct io_uring_getevents_arg arg;
+  void *arg_ptr = NULL;
+  size_t arg_size = 0;
+  if (is_wait) {
+    flags |= IORING_ENTER_GETEVENTS;
+    if (time_out_ms != 0) min_complete = 1;
+    if (time_out_ms > 0) {
+      ts.tv_sec = time_out_ms / 1000;
+      ts.tv_nsec = (time_out_ms % 1000) * 1000000LL;
+      memset(&arg, 0, sizeof(arg));
+      arg.ts = (uint64_t)(uintptr_t)&ts;
+      flags |= IORING_ENTER_EXT_ARG;
+      arg_ptr = &arg;
+      arg_size = sizeof(arg);
+    }
+  }
+
+  int ret = 0;
+  while (true) {
+    ++enter_num_;
+    ret = syscall(__NR_io_uring_enter, ring_fd_, to_submit, min_complete, flags, arg_ptr, arg_size);
+    if (ret == -1 && errno == EINTR) {
+      to_submit = sq_local_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+      continue;
+    }
+    break;
+  }
+
+  if (ret >= 0) return kOk;
+  if (errno == ETIME) return kTimeOut;
+  if (errno == EBUSY || errno == EAGAIN) return kOk;  // NOTE:htt, cq is overflowed, and it's reaped then
+
+  return kIoUringFailed;
+} /*}}}*/
+
+void *EventIoUring::GetSqe() { /*{{{*/
+  if (sq_local_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= sq_entries_) {
+    Submit(false, 0);  // NOTE:htt, ring is full, then submit to make room
+    if (sq_local_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= sq_entries_) return NULL;
+  }
+
+  uint32_t idx = sq_local_tail_ & sq_mask_;
+  struct io_uring_sqe *sqe = static_cast<struct io_uring_sqe *>(sqes_) + idx;
+  memset(sqe, 0, sizeof(*sqe));
+  sq_array_[idx] = idx;
+  ++sq_local_tail_;
+
+  return sqe;
+} /*}}}*/
+
+void EventIoUring::FlushSqe() { /*{{{*/ __atomic_store_n(sq_tail_, sq_local_tail_, __ATOMIC_RELEASE); } /*}}}*/
+
+Code EventIoUring::SubmitPoll(int fd) { /*{{{*/
+  struct io_uring_sqe *sqe = static_cast<struct io_uring_sqe *>(GetSqe());
+  if (sqe == NULL) return kFull;
+
+  // NOTE:htt, EV_* are the same as poll bits; edge triggered is multishot poll, which is not re-armed
+  PollState &state = polls_[fd];
+  uint32_t mask = state.evt & ~EV_ET;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  mask = (mask << 16) | (mask >> 16);
+#endif
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = fd;
+  sqe->poll32_events = mask;
+  if (state.evt & EV_ET) sqe->len = IORING_POLL_ADD_MULTI;
+  sqe->user_data = MakePollData(fd, state.gen);
+  state.is_armed = true;
+
+  return kOk;
+} /*}}}*/
+
+Code EventIoUring::SubmitPollRemove(int fd) { /*{{{*/
+  struct io_uring_sqe *sqe = static_cast<struct io_uring_sqe *>(GetSqe());
+  if (sqe == NULL) return kFull;
+
+  PollState &state = polls_[fd];
+  sqe->opcode = IORING_OP_POLL_REMOVE;
+  sqe->fd = -1;
+  sqe->addr = MakePollData(fd, state.gen);
+  sqe->user_data = kInternalTag;
+  state.is_armed = false;
+
+  return kOk;
+} /*}}}*/
+
+void EventIoUring::RearmPolls() { /*{{{*/
+  // NOTE:htt, poll is re-armed after its handler is called, so it's fired again only if fd is still ready
+  std::vector<int> fds;
+  fds.swap(rearm_fds_);
+  for (size_t i = 0; i < fds.size(); ++i) {
+    int fd = fds[i];
+    if (fd >= (int)polls_.size() || !polls_[fd].is_active || polls_[fd].is_armed) continue;
+    if (SubmitPoll(fd) != kOk) rearm_fds_.push_back(fd);
+  }
+} /*}}}*/
+
+void EventIoUring::ReapCompletions() { /*{{{*/
+  const struct io_uring_cqe *cqes = static_cast<const struct io_uring_cqe *>(cqes_);
+  uint32_t head = *cq_head_;
+  uint32_t tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+
+  for (; head != tail; ++head) {
+    const struct io_uring_cqe &cqe = cqes[head & cq_mask_];
+    uint64_t tag = cqe.user_data & kInternalTag;
+    if (tag == 0) {
+      IoCompletion completion = {cqe.user_data, cqe.res, cqe.flags};
+      completions_.push_back(completion);
+      continue;
+    }
+    if (tag != kPollTag) continue;
+
+    // NOTE:htt, fired events more than max_evts_num_ are left in cq, and fetched by next Wait
+    if (evts_num_ >= max_evts_num_) break;
+
+    int fd = (int)(uint32_t)cqe.user_data;
+    uint32_t gen = (uint32_t)(cqe.user_data >> 32) & kPollGenMask;
+    if (fd >= (int)polls_.size()) continue;
+    PollState &state = polls_[fd];
+    if (!state.is_active || state.gen != gen) continue;  // NOTE:htt, poll removed or modified
+
+    if (!(cqe.flags & IORING_CQE_F_MORE)) {
+      state.is_armed = false;
+      rearm_fds_.push_back(fd);
+    }
+
+    fired_evts_[evts_num_].fd = fd;
+    fired_evts_[evts_num_].evt = cqe.res < 0 ? EV_ERR : cqe.res;
+    ++evts_num_;
+  }
+
+  __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+} /*}}}*/
+
+/**
+ * @brief 提交所有待提交的操作并等待事件发生
+ * @param time_out_ms 超时时间（毫秒），-1 表示永久等待
+ * @return kOk 有就绪事件或完成事件；kTimeOut 超时；kIoUringFailed 失败
+ *
+ * 注意：add/mod/del、poll 重新挂载和 Submit* 提交的操作都在这一次 io_uring_enter 中提交
+ */
+Code EventIoUring::Wait(int time_out_ms) { /*{{{*/
+  if (sqes_ == NULL) return kNotInit;
+
+  evts_num_ = 0;
+  cur_evts_pos_ = 0;
+  completions_.clear();
+  cur_completion_pos_ = 0;
+
+  RearmPolls();
+
+  // NOTE:htt, events left in cq are fetched without syscall if nothing to submit
+  bool has_cqe = *cq_head_ != __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+  bool has_sqe = sq_local_tail_ != __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+  Code ret = kOk;
+  if (!has_cqe || has_sqe) ret = Submit(true, has_cqe ? 0 : time_out_ms);
+  if (ret != kOk && ret != kTimeOut) return ret;
+
+  ReapCompletions();
+  if (evts_num_ == 0 && completions_.empty()) return kTimeOut;
+
+  return kOk;
+} /*}}}*/
+
+Code EventIoUring::GetEvents(int *fd, int *evt) { /*{{{*/
+  if (fd == NULL || evt == NULL) return kInvalidParam;
+
+  if (cur_evts_pos_ < evts_num_) {
+    *fd = fired_evts_[cur_evts_pos_].fd;
+    *evt = fired_evts_[cur_evts_pos_].evt;
+    ++cur_evts_pos_;
+    return kOk;
+  }
+
+  return kNotFound;
+} /*}}}*/
+
+Code EventIoUring::GetFiredEvents(const FiredEvent **evts, int *num) { /*{{{*/
+  if (evts == NULL || num == NULL) return kInvalidParam;
+  if (cur_evts_pos_ >= evts_num_) return kNotFound;
+
+  *evts = fired_evts_ + cur_evts_pos_;
+  *num = evts_num_ - cur_evts_pos_;
+  cur_evts_pos_ = evts_num_;
+  return kOk;
+} /*}}}*/
+
+/**
+ * @brief 添加文件描述符的就绪事件
+ * @param fd 文件描述符
+ * @param evt 监听的事件类型（EV_IN/EV_OUT 等），带 EV_ET 时使用 multishot poll
+ * @return kOk 成功；kAlreadyExist fd 已存在；kFull 提交队列已满
+ *
+ * 注意：poll 在下次 Wait 时才提交到内核
+ */
+Code EventIoUring::Add(int fd, int evt) { /*{{{*/
+  if (fd < 0) return kInvalidParam;
+  if (sqes_ == NULL) return kNotInit;
+
+  if (fd >= (int)polls_.size()) {
+    PollState empty_state = {0, 0, false, false};
+    polls_.resize(fd + 1, empty_state);
+  }
+
+  PollState &state = polls_[fd];
+  if (state.is_active) return kAlreadyExist;
+
+  state.evt = evt;
+  state.gen = (state.gen + 1) & kPollGenMask;
+  state.is_active = true;
+  Code ret = SubmitPoll(fd);
+  if (ret != kOk) state.is_active = false;
+
+  return ret;
+} /*}}}*/
+
+Code EventIoUring::Mod(int fd, int evt) { /*{{{*/
+  if (fd < 0) return kInvalidParam;
+  if (fd >= (int)polls_.size() || !polls_[fd].is_active) return kNotFound;
+
+  PollState &state = polls_[fd];
+  if (state.is_armed) {
+    Code ret = SubmitPollRemove(fd);
+    if (ret != kOk) return ret;
+  }
+
+  state.evt = evt;
+  state.gen = (state.gen + 1) & kPollGenMask;
+  return SubmitPoll(fd);
+} /*}}}*/
+
+Code EventIoUring::Del(int fd) { /*{{{*/
+  if (fd < 0) return kInvalidParam;
+  if (fd >= (int)polls_.size() || !polls_[fd].is_active) return kNotFound;
+
+  PollState &state = polls_[fd];
+  if (state.is_armed) {
+    Code ret = SubmitPollRemove(fd);
+    if (ret != kOk) return ret;
+  }
+
+  state.gen = (state.gen + 1) & kPollGenMask;
+  state.is_active = false;
+  return kOk;
+} /*}}}*/
+
+void EventIoUring::Print() {}
+
+Code EventIoUring::SubmitRecv(int fd, void *buf, uint32_t len, uint64_t user_data) { /*{{{*/
+  if (fd < 0 || buf == NULL || user_data > kMaxIoUringUserData) return kInvalidParam;
+  if (sqes_ == NULL) return kNotInit;
+
+  struct io_uring_sqe *sqe = static_cast<struct io_uring_sqe *>(GetSqe());
+  if (sqe == NULL) return kFull;
+
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = fd;
+  sqe->addr = (uint64_t)(uintptr_t)buf;
+  sqe->len = len;
+  sqe->user_data = user_data;
+
+  return kOk;
+} /*}}}*/
+
+Code EventIoUring::SubmitSend(int fd, const void *buf, uint32_t len, uint64_t user_data) { /*{{{*/
+  if (fd < 0 || buf == NULL || user_data > kMaxIoUringUserData) return kInvalidParam;
+  if (sqes_ == NULL) return kNotInit;
+
+  struct io_uring_sqe *sqe = static_cast<struct io_uring_sqe *>(GetSqe());
+  if (sqe == NULL) return kFull;
+
+  sqe->opcode = IORING_OP_SEND;
+  sqe->fd = fd;
+  sqe->addr = (uint64_t)(uintptr_t)buf;
+  sqe->len = len;
+  sqe->msg_flags = MSG_NOSIGNAL;
+  sqe->user_data = user_data;
+
+  return kOk;
+} /*}}}*/
+
+Code EventIoUring::SubmitSendMsg(int fd, const struct msghdr *msg, uint64_t user_data) { /*{{{*/
+  if (fd < 0 || msg == NULL || user_data > kMaxIoUringUserData) return kInvalidParam;
+  if (sqes_ == NULL) return kNotInit;
+
+  struct io_uring_sqe *sqe = static_cast<struct io_uring_sqe *>(GetSqe());
+  if (sqe == NULL) return kFull;
+
+  sqe->opcode = IORING_OP_SENDMSG;
+  sqe->fd = fd;
+  sqe->addr = (uint64_t)(uintptr_t)msg;
+  sqe->len = 1;
+  sqe->msg_flags = MSG_NOSIGNAL;
+  sqe->user_data = user_data;
+
+  return kOk;
+} /*}}}*/
+
+Code EventIoUring::SubmitAccept(int listen_fd, uint64_t user_data) { /*{{{*/
+  if (listen_fd < 0 || user_data > kMaxIoUringUserData) return kInvalidParam;
+  if (sqes_ == NULL) return kNotInit;
+
+  struct io_uring_sqe *sqe = static_cast<struct io_uring_sqe *>(GetSqe());
+  if (sqe == NULL) return kFull;
+
+  // NOTE:htt, accepted fd is nonblocking already, and one sqe accepts all connections if multishot
+  sqe->opcode = IORING_OP_ACCEPT;
+  sqe->fd = listen_fd;
+  sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+#if defined(IORING_ACCEPT_MULTISHOT)
+  if (is_multishot_accept_) sqe->ioprio |= IORING_ACCEPT_MULTISHOT;
+#endif
+  sqe->user_data = user_data;
+
+  return kOk;
+} /*}}}*/
+
+Code EventIoUring::SubmitCancel(uint64_t user_data) { /*{{{*/
+  if (user_data > kMaxIoUringUserData) return kInvalidParam;
+  if (sqes_ == NULL) return kNotInit;
+
+  struct io_uring_sqe *sqe = static_cast<struct io_uring_sqe *>(GetSqe());
+  if (sqe == NULL) return kFull;
+
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->fd = -1;
+  sqe->addr = user_data;
+  sqe->user_data = kInternalTag;
+
+  return kOk;
+} /*}}}*/
+
+Code EventIoUring::RegisterBuffers(const struct iovec *iovs, int num) { /*{{{*/
+  if (iovs == NULL || num <= 0) return kInvalidParam;
+  if (sqes_ == NULL) return kNotInit;
+  if (is_buffers_registered_) return kAlreadyExist;
+
+  int ret = syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_BUFFERS, iovs, num);
+  if (ret != 0) return kIoUringFailed;
+
+  is_buffers_registered_ = true;
+  return kOk;
+} /*}}}*/
+
+Code EventIoUring::SubmitReadFixed(int fd, int buf_index, void *buf, uint32_t len, uint64_t user_data) { /*{{{*/
+  if (fd < 0 || buf_index < 0 || buf == NULL || user_data > kMaxIoUringUserData) return kInvalidParam;
+  if (!is_buffers_registered_) return kNotInit;
+
+  struct io_uring_sqe *sqe = static_cast<struct io_uring_sqe *>(GetSqe());
+  if (sqe == NULL) return kFull;
+
+  sqe->opcode = IORING_OP_READ_FIXED;
+  sqe->fd = fd;
+  sqe->addr = (uint64_t)(uintptr_t)buf;
+  sqe->len = len;
+  sqe->buf_index = buf_index;
+  sqe->user_data = user_data;
+
+  return kOk;
+} /*}}}*/
+
+Code EventIoUring::SubmitWriteFixed(int fd, int buf_index, const void *buf, uint32_t len, uint64_t user_data) { /*{{{*/
+  if (fd < 0 || buf_index < 0 || buf == NULL || user_data > kMaxIoUringUserData) return kInvalidParam;
+  if (!is_buffers_registered_) return kNotInit;
+
+  struct io_uring_sqe *sqe = static_cast<struct io_uring_sqe *>(GetSqe());
+  if (sqe == NULL) return kFull;
+
+  sqe->opcode = IORING_OP_WRITE_FIXED;
+  sqe->fd = fd;
+  sqe->addr = (uint64_t)(uintptr_t)buf;
+  sqe->len = len;
+  sqe->buf_index = buf_index;
+  sqe->user_data = user_data;
+
+  return kOk;
+} /*}}}*/
+
+Code EventIoUring::GetCompletions(const IoCompletion **cqes, int *num) { /*{{{*/
+  if (cqes == NULL || num == NULL) return kInvalidParam;
+  if (cur_completion_pos_ >= completions_.size()) return kNotFound;
+
+  *cqes = &completions_[cur_completion_pos_];
+  *num = completions_.size() - cur_completion_pos_;
+  cur_completion_pos_ = completions_.size();
+  return kOk;
+} /*}}}*/
+
+bool EventIoUring::IsSupported() { /*{{{*/
+  static int is_supported = -1;
+  if (is_supported == -1) {
+    EventIoUring ring;
+    is_supported = ring.Create(1) == kOk ? 1 : 0;
+  }
+
+  return is_supported == 1;
+} /*}}}*/
+
+#else
+
+EventIoUring::~EventIoUring() { /*{{{*/
+} /*}}}*/
+
+Code EventIoUring::Create(int nfds) { /*{{{*/ return kNotSupportOS; } /*}}}*/
+Code EventIoUring::Wait(int time_out_ms) { /*{{{*/ return kNotSupportOS; } /*}}}*/
+Code EventIoUring::GetEvents(int *fd, int *evt) { /*{{{*/ return kNotSupportOS; } /*}}}*/
+Code EventIoUring::GetFiredEvents(const FiredEvent **evts, int *num) { /*{{{*/ return kNotSupportOS; } /*}}}*/
+Code EventIoUring::Add(int fd, int evt) { /*{{{*/ return kNotSupportOS; } /*}}}*/
+Code EventIoUring::Mod(int fd, int evt) { /*{{{*/ return kNotSupportOS; } /*}}}*/
+Code EventIoUring::Del(int fd) { /*{{{*/ return kNotSupportOS; } /*}}}*/
+void EventIoUring::Print() {}
+
+Code EventIoUring::SubmitRecv(int fd, void *buf, uint32_t len, uint64_t user_data) { /*{{{*/ return kNotSupportOS; } /*}}}*/
+Code EventIoUring::SubmitSend(int fd, const void *buf, uint32_t len, uint64_t user_data) { /*{{{*/
+  return kNotSupportOS;
+} /*}}}*/
+Code EventIoUring::SubmitSendMsg(int fd, const struct msghdr *msg, uint64_t user_data) { /*{{{*/
+  return kNotSupportOS;
+} /*}}}*/
+Code EventIoUring::SubmitAccept(int listen_fd, uint64_t user_data) { /*{{{*/ return kNotSupportOS; } /*}}}*/
+Code EventIoUring::SubmitCancel(uint64_t user_data) { /*{{{*/ return kNotSupportOS; } /*}}}*/
+Code EventIoUring::RegisterBuffers(const struct iovec *iovs, int num) { /*{{{*/ return kNotSupportOS; } /*}}}*/
+Code EventIoUring::SubmitReadFixed(int fd, int buf_index, void *buf, uint32_t len, uint64_t user_data) { /*{{{*/
+  return kNotSupportOS;
+} /*}}}*/
+Code EventIoUring::SubmitWriteFixed(int fd, int buf_index, const void *buf, uint32_t len, uint64_t user_data) { /*{{{*/
+  return kNotSupportOS;
+} /*}}}*/
+Code EventIoUring::GetCompletions(const IoCompletion **cqes, int *num) { /*{{{*/ return kNotSupportOS; } /*}}}*/
+bool EventIoUring::IsSupported() { /*{{{*/ return false; } /*}}}*/
+
+#endif
+
+}  // namespace base
@@ -0,0 +1,154 @@
+// Copyright (c) 2015 The CSUTIL Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BASE_EVENT_IO_URING_H_
+#define BASE_EVENT_IO_URING_H_
+
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <vector>
+
+#include "base/event.h"
+#include "base/status.h"
+
+namespace base {
+
+const uint32_t kMaxIoUringEntries = 4096;  // NOTE:htt, submission queue entries at most, and cq is twice of it
+
+// NOTE:htt, user data of completion api should be less than it, the high bits are used by readiness events
+const uint64_t kMaxIoUringUserData = (1ULL << 62) - 1;
+
+// NOTE:htt, same as IORING_CQE_F_MORE, more completions are coming for the operation, ex: multishot accept
+const uint32_t kIoCompletionFlagMore = 1U << 1;
+
+struct IoCompletion { /*{{{*/
+  uint64_t user_data;
+  int res;         // NOTE:htt, result of the operation like syscall, and -errno if failed
+  uint32_t flags;  // NOTE:htt, kIoCompletionFlagMore is set if the operation is not finished
+}; /*}}}*/
+
+struct PollState { /*{{{*/
+  int evt;
+  uint32_t gen;  // NOTE:htt, changed by every add/mod/del, so completions of old polls are dropped
+  bool is_active;
+  bool is_armed;  // NOTE:htt, poll is in the ring and not fired
+}; /*}}}*/
+
+/**
+ * NOTE:htt, EventIoUring is a base::Event by io_uring, and it supports completion-based operations too:
+ * 1. readiness events are one-shot polls re-armed before next Wait, so they are level triggered like
+ *    EventEpoll, and add/mod/del and re-arms are all submitted in the io_uring_enter of Wait without epoll_ctl
+ * 2. recv/send/accept are submitted to the ring and also submitted by next Wait in batch, so one syscall is
+ *    cost by all operations of one loop; their results are fetched by GetCompletions after Wait
+ *
+ * Create fails if io_uring is not supported or disabled (kernel older than 5.11, seccomp, etc.),
+ * and the caller should fall back to EventEpoll, which is done by EventLoop::Init(kIoUring)
+ */
+class EventIoUring : public Event { /*{{{*/
+ public:
+  EventIoUring();
+  virtual ~EventIoUring();
+
+ public:
+  virtual Code Create(int nfds);
+  virtual Code Wait(int time_out_ms);
+  virtual Code GetEvents(int *fd, int *evt);
+  virtual Code GetFiredEvents(const FiredEvent **evts, int *num);
+
+  virtual Code Add(int fd, int evt);
+  virtual Code Mod(int fd, int evt);
+  virtual Code Del(int fd);
+
+  virtual void Print();
+
+ public:
+  /**
+   * Note: buffers should be kept until the completion is fetched, and operations of the same fd are not
+   * ordered unless the previous one is completed; kFull is returned if the ring is full even after submitting
+   */
+  Code SubmitRecv(int fd, void *buf, uint32_t len, uint64_t user_data);
+  Code SubmitSend(int fd, const void *buf, uint32_t len, uint64_t user_data);
+  Code SubmitSendMsg(int fd, const struct msghdr *msg, uint64_t user_data);
+
+  // NOTE:htt, accepted fd is res of completion, and it's multishot if IsMultishotAccept
+  Code SubmitAccept(int listen_fd, uint64_t user_data);
+
+  // NOTE:htt, the canceled operation is still completed with -ECANCELED or its result
+  Code SubmitCancel(uint64_t user_data);
+
+  /**
+   * Note: buffers are pinned in kernel, so data is not mapped for every read or write of fixed buffer;
+   * buf of Read/WriteFixed should be in the buffer of buf_index; it fails on RLIMIT_MEMLOCK, and
+   * Recv/Send should be used then
+   */
+  Code RegisterBuffers(const struct iovec *iovs, int num);
+  Code SubmitReadFixed(int fd, int buf_index, void *buf, uint32_t len, uint64_t user_data);
+  Code SubmitWriteFixed(int fd, int buf_index, const void *buf, uint32_t len, uint64_t user_data);
+
+  /**
+   * Note: return all completions fetched by last Wait at once, and cqes is valid until next Wait;
+   * completions returned are not returned again
+   */
+  Code GetCompletions(const IoCompletion **cqes, int *num);
+
+  bool IsMultishotAccept() const { return is_multishot_accept_; }
+  bool IsBuffersRegistered() const { return is_buffers_registered_; }
+
+  // NOTE:htt, number of io_uring_enter, which is all syscalls cost by wait and submit
+  uint64_t GetEnterNum() const { return enter_num_; }
+
+  static bool IsSupported();
+
+ private:
+  Code Submit(bool is_wait, int time_out_ms);
+  void *GetSqe();
+  void FlushSqe();
+  Code SubmitPoll(int fd);
+  Code SubmitPollRemove(int fd);
+  void RearmPolls();
+  void ReapCompletions();
+
+ private:
+  int ring_fd_;
+
+  void *sq_ring_;
+  void *cq_ring_;
+  void *sqes_;
+  uint32_t sq_ring_size_;
+  uint32_t cq_ring_size_;
+  uint32_t sqes_size_;
+
+  uint32_t *sq_head_;
+  uint32_t *sq_tail_;
+  uint32_t *sq_array_;
+  uint32_t sq_mask_;
+  uint32_t sq_entries_;
+  uint32_t sq_local_tail_;  // NOTE:htt, tail of sqes filled, which is published to kernel by FlushSqe
+
+  uint32_t *cq_head_;
+  uint32_t *cq_tail_;
+  uint32_t cq_mask_;
+  void *cqes_;
+
+  std::vector<PollState> polls_;  // NOTE:htt, indexed by fd
+  std::vector<int> rearm_fds_;
+
+  FiredEvent *fired_evts_;
+  int max_evts_num_;
+  int cur_evts_pos_;
+  int evts_num_;
+
+  std::vector<IoCompletion> completions_;
+  size_t cur_completion_pos_;
+
+  bool is_multishot_accept_;
+  bool is_buffers_registered_;
+  uint64_t enter_num_;
+}; /*}}}*/
+
+}  // namespace base
+
+#endif
@@ -4,9 +4,44 @@
 
 #include "base/event_loop.h"
 
+#include <time.h>
+
 namespace base {
 
-EventLoop::EventLoop() : actions_(), evt_(NULL) { /*{{{*/ } /*}}}*/
+static uint64_t GetMonotonicMs() { /*{{{*/
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+} /*}}}*/
+
+Code GetEventType(const std::string &name, EventType *event_type) { /*{{{*/
+  if (event_type == NULL) return kInvalidParam;
+
+  if (name == kPollEventType) {
+    *event_type = kPoll;
+  } else if (name == kEPollEventType) {
+    *event_type = kEPoll;
+  } else if (name == kIoUringEventType) {
+    *event_type = kIoUring;
+  } else {
+    return kInvalidParam;
+  }
+
+  return kOk;
+} /*}}}*/
+
+EventLoop::EventLoop()
+    : actions_(),
+      evt_(NULL),
+      io_uring_(NULL),
+      completion_func_(NULL),
+      completion_param_(NULL),
+      timers_(kEventLoopTimerWheelSize),
+      base_ms_(0),
+      now_ms_(0) { /*{{{*/
+  base_ms_ = GetMonotonicMs();
+  now_ms_ = base_ms_;
+} /*}}}*/
 
 EventLoop::~EventLoop() { /*{{{*/
   actions_.clear();
@@ -14,6 +49,7 @@ EventLoop::~EventLoop() { /*{{{*/
   if (evt_ != NULL) {
     delete evt_;
     evt_ = NULL;
+    io_uring_ = NULL;
   }
 } /*}}}*/
 
@@ -31,6 +67,24 @@ Code EventLoop::Init(EventType evt_type) { /*{{{*/
       evt_ = new EventEpoll();
 #else
       evt_ = new EventPoll();
+#endif
+      ret = evt_->Create(kDefaultSizeOfFds);
+      break;
+    case kIoUring:
+      io_uring_ = new EventIoUring();
+      ret = io_uring_->Create(kDefaultSizeOfFds);
+      if (ret == kOk) {
+        evt_ = io_uring_;
+        break;
+      }
+
+      // NOTE:htt, io_uring is not supported or disabled, then epoll is used
+      delete io_uring_;
+      io_uring_ = NULL;
+#if defined(__linux__)
+      evt_ = new EventEpoll();
+#else
+      evt_ = new EventPoll();
 #endif
       ret = evt_->Create(kDefaultSizeOfFds);
       break;
@@ -44,19 +98,25 @@ Code EventLoop::Init(EventType evt_type) { /*{{{*/
 } /*}}}*/
 
 Code EventLoop::Add(int fd, int evt, EventFunc func, void *param) { /*{{{*/
+  if (fd < 0 || func == NULL) return kInvalidParam;
+
   Code ret = evt_->Add(fd, evt);
   if (ret != kOk) return ret;
 
+  if (fd >= (int)actions_.size()) {
+    EventItem empty_item = {-1, 0, NULL, NULL};
+    actions_.resize(fd + 1, empty_item);
+  }
+
   EventItem item = {fd, evt, func, param};
-  actions_.insert(std::pair<int, EventItem>(fd, item));
+  actions_[fd] = item;
 
   return ret;
 } /*}}}*/
 
 Code EventLoop::Mod(int fd, int evt, EventFunc func, void *param) { /*{{{*/
   // 先检查 fd 是否存在于 actions_ 中
-  std::map<int, EventItem>::iterator it = actions_.find(fd);
-  if (it == actions_.end()) {
+  if (fd < 0 || fd >= (int)actions_.size() || actions_[fd].func == NULL) {
     return kNotFound;
   }
 
@@ -64,7 +124,7 @@ Code EventLoop::Mod(int fd, int evt, EventFunc func, void *param) { /*{{{*/
   if (ret != kOk) return ret;
 
   // 更新已存在的事件项
-  EventItem &item = it->second;
+  EventItem &item = actions_[fd];
   item.fd = fd;
   item.evt = evt;
   item.func = func;
@@ -79,7 +139,10 @@ Code EventLoop::Del(int fd) { /*{{{*/
   if (ret != kOk) return ret;
 
   // 成功后再从 actions_ 中删除
-  actions_.erase(fd);
+  if (fd < (int)actions_.size()) {
+    EventItem empty_item = {-1, 0, NULL, NULL};
+    actions_[fd] = empty_item;
+  }
 
   return ret;
 } /*}}}*/
@@ -88,33 +151,106 @@ Code EventLoop::Run() { /*{{{*/
   Code ret = kOk;
 
   while (true) {
-    ret = evt_->Wait(kDefaultWaitTimeMs);
-    if (ret != kOk) continue;
-
-    // 处理所有就绪的事件
-    while (true) {
-      int fd = -1;
-      int evt = 0;
-      ret = evt_->GetEvents(&fd, &evt);
-      if (ret != kOk) break;
-
-      typedef std::map<int, EventItem>::iterator Iter;
-      Iter it = actions_.find(fd);
-      if (it == actions_.end()) {
-        // fd 不在 actions_ 中，说明数据不一致
-        // 记录错误但继续处理其他事件
-        continue;
-      }
+    ret = RunOnce(kDefaultWaitTimeMs);
+  }
+
+  return ret;
+} /*}}}*/
+
+Code EventLoop::RunOnce(int time_out_ms) { /*{{{*/
+  // NOTE:htt, wake up for the next timer, and wait is shortened to its expiry
+  int64_t next_ticks = timers_.GetNextTimeout();
+  if (next_ticks >= 0) {
+    int64_t timer_ms = (int64_t)(base_ms_ + timers_.GetNowTick() + next_ticks) - (int64_t)now_ms_;
+    if (timer_ms < 0) timer_ms = 0;
+    if (time_out_ms < 0 || timer_ms < time_out_ms) time_out_ms = (int)timer_ms;
+  }
+
+  Code ret = evt_->Wait(time_out_ms);
+  UpdateNowMs();
+  if (ret != kOk) {
+    ExpireTimers();
+    return ret;
+  }
+
+  // 一次取出所有就绪的事件，只有完成事件时 num 为 0
+  const FiredEvent *evts = NULL;
+  int num = 0;
+  if (evt_->GetFiredEvents(&evts, &num) != kOk) num = 0;
 
-      // 执行事件回调函数
-      Code callback_ret = (it->second).func(fd, evt, (it->second).param);
-      // 可以根据回调返回值决定是否继续处理其他事件
-      // 如果回调返回错误，可以选择记录日志但继续处理
-      (void)callback_ret;  // 当前忽略回调返回值
+  for (int i = 0; i < num; ++i) {
+    int fd = evts[i].fd;
+    if (fd < 0 || fd >= (int)actions_.size() || actions_[fd].func == NULL) {
+      // fd 不在 actions_ 中（如已被本批次前面的回调删除），继续处理其他事件
+      continue;
     }
+
+    // NOTE:htt, copy item before callback, which may add fd and reallocate actions_
+    EventFunc func = actions_[fd].func;
+    void *param = actions_[fd].param;
+
+    // 执行事件回调函数，当前忽略回调返回值
+    Code callback_ret = func(fd, evts[i].evt, param);
+    (void)callback_ret;
   }
 
-  return ret;
+  if (io_uring_ != NULL) DispatchCompletions();
+
+  ExpireTimers();
+  return kOk;
+} /*}}}*/
+
+Code EventLoop::SetCompletionFunc(CompletionFunc func, void *param) { /*{{{*/
+  if (io_uring_ == NULL) return kNotInit;
+
+  completion_func_ = func;
+  completion_param_ = param;
+  return kOk;
+} /*}}}*/
+
+void EventLoop::DispatchCompletions() { /*{{{*/
+  const IoCompletion *cqes = NULL;
+  int num = 0;
+  if (io_uring_->GetCompletions(&cqes, &num) != kOk) return;
+  if (completion_func_ == NULL) return;
+
+  for (int i = 0; i < num; ++i) {
+    completion_func_(cqes[i], completion_param_);
+  }
+} /*}}}*/
+
+Code EventLoop::AddTimer(uint32_t timeout_ms, const TimerTask &task, uint64_t *timer_id) { /*{{{*/
+  if (!task) return kInvalidParam;
+
+  // NOTE:htt, timers_ may be behind now_ms_ until ExpireTimers, so timeout is counted from now_ms_
+  uint64_t expire_tick = now_ms_ - base_ms_ + timeout_ms;
+  uint64_t now_tick = timers_.GetNowTick();
+  uint64_t timeout_ticks = expire_tick > now_tick ? expire_tick - now_tick : 0;
+  if (timeout_ticks > UINT32_MAX) timeout_ticks = UINT32_MAX;
+
+  uint64_t id = timers_.AddTimer((uint32_t)timeout_ticks, task);
+  if (timer_id != NULL) *timer_id = id;
+
+  return kOk;
+} /*}}}*/
+
+Code EventLoop::CancelTimer(uint64_t timer_id) { /*{{{*/
+  if (!timers_.CancelTimer(timer_id)) return kNotFound;
+
+  return kOk;
+} /*}}}*/
+
+void EventLoop::UpdateNowMs() { /*{{{*/
+  uint64_t now_ms = GetMonotonicMs();
+  if (now_ms > now_ms_) now_ms_ = now_ms;
+} /*}}}*/
+
+void EventLoop::ExpireTimers() { /*{{{*/
+  // NOTE:htt, ticks up to now_ms_ are all processed, and tasks may add or cancel timers
+  uint64_t cur_tick = now_ms_ - base_ms_;
+  if (timers_.GetNowTick() <= cur_tick) {
+    timers_.Advance(cur_tick - timers_.GetNowTick() + 1);
+  }
 } /*}}}*/
 
 }  // namespace base
@@ -5,17 +5,29 @@
 #ifndef BASE_EVENT_LOOP_H_
 #define BASE_EVENT_LOOP_H_
 
-#include <map>
+#include <stdint.h>
 
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "base/algo.h"
 #include "base/common.h"
 #include "base/event.h"
 
 namespace base {
 
 typedef Code (*EventFunc)(int fd, int evt, void *p);
+typedef void (*CompletionFunc)(const IoCompletion &cqe, void *p);
+typedef std::function<void()> TimerTask;
+
+const uint32_t kEventLoopTimerWheelSize = 1024;  // NOTE:htt, one tick is 1ms
+
+// NOTE:htt, name is one of kPollEventType, kEPollEventType and kIoUringEventType
+Code GetEventType(const std::string &name, EventType *event_type);
 
 struct EventItem { /*{{{*/
-  int fd;
+  int fd;  // NOTE:htt, func is NULL if fd has not been added
   int evt;
   EventFunc func;
   void *param;
@@ -26,6 +38,9 @@ class EventLoop { /*{{{*/
   EventLoop();
   ~EventLoop();
 
+  /**
+   * Note: kIoUring falls back to kEPoll if io_uring is not available, and GetIoUring returns NULL then
+   */
   Code Init(EventType evt_type);
 
  public:
@@ -36,13 +51,52 @@ class EventLoop { /*{{{*/
  public:
   Code Run();
 
+  /**
+   * Note: wait once and dispatch all fired events in one batch, which returns kTimeOut if no event;
+   * Run is RunOnce in a loop
+   */
+  Code RunOnce(int time_out_ms);
+
+ public:
+  /**
+   * Note: task is called in the loop thread after timeout_ms, and the wait of loop is shortened to the
+   * next expiry; timers are not thread safe, so they should be added or canceled in the loop thread or
+   * before Run; kNotFound is returned by CancelTimer if the task has been called or canceled
+   */
+  Code AddTimer(uint32_t timeout_ms, const TimerTask &task, uint64_t *timer_id);
+  Code CancelTimer(uint64_t timer_id);
+
+  // NOTE:htt, monotonic milliseconds updated once every wait, which is cheaper than reading clock
+  uint64_t GetNowMs() const { return now_ms_; }
+
+ public:
+  /**
+   * Note: operations submitted to GetIoUring are completed in the loop, and func is called for every
+   * completion after events of the same wait are dispatched
+   */
+  EventIoUring *GetIoUring() { return io_uring_; }
+  Code SetCompletionFunc(CompletionFunc func, void *param);
+
+ private:
+  void UpdateNowMs();
+  void ExpireTimers();
+  void DispatchCompletions();
+
  private:
   EventLoop(const EventLoop &el);
   EventLoop &operator=(const EventLoop &el);
 
  private:
-  std::map<int, EventItem> actions_;
+  std::vector<EventItem> actions_;  // NOTE:htt, indexed by fd, so event is dispatched without searching
   Event *evt_;
+
+  EventIoUring *io_uring_;  // NOTE:htt, evt_ if io_uring is used, otherwise NULL
+  CompletionFunc completion_func_;
+  void *completion_param_;
+
+  TimerWheel timers_;
+  uint64_t base_ms_;  // NOTE:htt, monotonic milliseconds of tick 0 of timers_
+  uint64_t now_ms_;
 }; /*}}}*/
 
 }  // namespace base
@@ -15,6 +15,7 @@ namespace base {
 
 EventPoll::EventPoll() { /*{{{*/
   pfds_ = NULL;
+  fired_evts_ = NULL;
   all_num_of_pfds_ = 0;
   used_num_of_pfds_ = 0;
   del_num_of_pfds_ = 0;
@@ -28,6 +29,11 @@ EventPoll::~EventPoll() { /*{{{*/
     delete[] pfds_;
     pfds_ = NULL;
   }
+
+  if (fired_evts_ != NULL) {
+    delete[] fired_evts_;
+    fired_evts_ = NULL;
+  }
 } /*}}}*/
 
 Code EventPoll::Create(int nfds) { /*{{{*/
@@ -44,6 +50,9 @@ Code EventPoll::Create(int nfds) { /*{{{*/
   assert(pfds_ != NULL);
   memset(pfds_, -1, sizeof(struct pollfd) * nfds);
 
+  if (fired_evts_ != NULL) delete[] fired_evts_;
+  fired_evts_ = new struct FiredEvent[nfds];
+
   return kOk;
 } /*}}}*/
 
@@ -87,6 +96,28 @@ Code EventPoll::GetEvents(int *fd, int *evt) { /*{{{*/
   return kNotFound;
 } /*}}}*/
 
+Code EventPoll::GetFiredEvents(const FiredEvent **evts, int *num) { /*{{{*/
+  if (evts == NULL || num == NULL) return kInvalidParam;
+
+  if (evt_num_ <= 0) return kNotFound;
+
+  int fired_num = 0;
+  while (cur_idx_of_pfds_ < used_num_of_pfds_ && cur_evt_num_ < evt_num_) {
+    if (pfds_[cur_idx_of_pfds_].fd != -1 && pfds_[cur_idx_of_pfds_].revents != 0) {
+      fired_evts_[fired_num].fd = pfds_[cur_idx_of_pfds_].fd;
+      fired_evts_[fired_num].evt = pfds_[cur_idx_of_pfds_].revents;
+      ++fired_num;
+      ++cur_evt_num_;
+    }
+    ++cur_idx_of_pfds_;
+  }
+  if (fired_num == 0) return kNotFound;
+
+  *evts = fired_evts_;
+  *num = fired_num;
+  return kOk;
+} /*}}}*/
+
 Code EventPoll::Add(int fd, int evt) { /*{{{*/
   // 检查 fd 是否已经存在
   for (int i = 0; i < used_num_of_pfds_; ++i) {
@@ -21,6 +21,7 @@ class EventPoll : public Event { /*{{{*/
   virtual Code Create(int nfds);
   virtual Code Wait(int time_out_ms);
   virtual Code GetEvents(int *fd, int *evt);
+  virtual Code GetFiredEvents(const FiredEvent **evts, int *num);
 
   virtual Code Add(int fd, int evt);
   virtual Code Mod(int fd, int evt);
@@ -33,6 +34,7 @@ class EventPoll : public Event { /*{{{*/
 
  private:
   struct pollfd *pfds_;
+  FiredEvent *fired_evts_;
   int all_num_of_pfds_;
   int used_num_of_pfds_;
   int del_num_of_pfds_;
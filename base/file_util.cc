@@ -402,6 +402,39 @@ Code GetFileSize(int fd, uint64_t *file_size) { /*{{{*/
   return kOk;
 } /*}}}*/
 
+Code ReadAt(int fd, uint64_t pos, size_t len, char *buf) { /*{{{*/
+  if (buf == NULL && len > 0) return kInvalidParam;
+
+  size_t done = 0;
+  while (done < len) {
+    ssize_t r = pread(fd, buf + done, len - done, pos + done);
+    if (r == 0) return kFileIsEnd;
+    if (r < 0) {
+      if (errno == EINTR) continue;
+      return kReadError;
+    }
+    done += r;
+  }
+
+  return kOk;
+} /*}}}*/
+
+Code WriteAt(int fd, uint64_t pos, const char *buf, size_t len) { /*{{{*/
+  if (buf == NULL && len > 0) return kInvalidParam;
+
+  size_t done = 0;
+  while (done < len) {
+    ssize_t r = pwrite(fd, buf + done, len - done, pos + done);
+    if (r <= 0) {
+      if (r < 0 && errno == EINTR) continue;
+      return kWriteError;
+    }
+    done += r;
+  }
+
+  return kOk;
+} /*}}}*/
+
 Code GetFileSize(const std::string &file_path, uint64_t *file_size) { /*{{{*/
   if (file_size == NULL) return kInvalidParam;
 
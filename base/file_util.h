@@ -62,6 +62,11 @@ Code DumpWholeData(const std::string &path, const std::string &cnt_str);
 Code PumpWholeData(std::string *cnt_str, FILE *fp);
 Code PumpWholeData(const std::string &path, std::string *cnt_str);
 
+// NOTE: 1. pread/pwrite at pos, which do not move the file offset, so they can run at the same time on one fd
+//       2. kFileIsEnd is returned if file ends before len bytes are read
+Code ReadAt(int fd, uint64_t pos, size_t len, char *buf);
+Code WriteAt(int fd, uint64_t pos, const char *buf, size_t len);
+
 // NOTE: 1. replace pos start with 0
 Code ReplaceFileContent(const std::string &file_path, uint64_t replace_pos, uint64_t replace_len,
                         const std::string &replace_str);
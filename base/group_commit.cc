@@ -0,0 +1,55 @@
+// Copyright (c) 2015 The CSUTIL Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/group_commit.h"
+
+namespace base {
+
+GroupCommit::GroupCommit() : write_seq_(0), synced_seq_(0), is_syncing_(false), syncs_num_(0) { /*{{{*/
+} /*}}}*/
+
+GroupCommit::~GroupCommit() { /*{{{*/
+} /*}}}*/
+
+uint64_t GroupCommit::AddWrite() { /*{{{*/
+  MutexLock ml(&mu_);
+  return ++write_seq_;
+} /*}}}*/
+
+Code GroupCommit::WaitSynced(uint64_t seq, const SyncFunc &sync_func) { /*{{{*/
+  MutexLock ml(&mu_);
+  while (synced_seq_ < seq) {
+    if (is_syncing_) {
+      cond_.Wait(mu_);
+      continue;
+    }
+
+    // NOTE:htt, writes till target_seq are done before sync starts, so all of them are covered
+    is_syncing_ = true;
+    uint64_t target_seq = write_seq_;
+    mu_.UnLock();
+    Code ret = sync_func();
+    mu_.Lock();
+
+    is_syncing_ = false;
+    ++syncs_num_;
+    if (ret == kOk && target_seq > synced_seq_) synced_seq_ = target_seq;
+    cond_.BroadCast();
+    if (ret != kOk) return ret;
+  }
+
+  return kOk;
+} /*}}}*/
+
+uint64_t GroupCommit::GetWritesNum() { /*{{{*/
+  MutexLock ml(&mu_);
+  return write_seq_;
+} /*}}}*/
+
+uint64_t GroupCommit::GetSyncsNum() { /*{{{*/
+  MutexLock ml(&mu_);
+  return syncs_num_;
+} /*}}}*/
+
+}  // namespace base
@@ -0,0 +1,56 @@
+// Copyright (c) 2015 The CSUTIL Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BASE_GROUP_COMMIT_H_
+#define BASE_GROUP_COMMIT_H_
+
+#include <stdint.h>
+
+#include <functional>
+
+#include "base/mutex.h"
+#include "base/status.h"
+
+namespace base {
+
+typedef std::function<Code()> SyncFunc;
+
+/**
+ * NOTE:htt, GroupCommit lets writers waiting at the same time share one sync:
+ * 1. writer calls AddWrite after its write is done, and waits the returned sequence by WaitSynced
+ * 2. the first waiter becomes leader, and its sync covers all writes added before the sync starts
+ * 3. writes added while leader is syncing are covered by the next leader, which is one of their writers
+ *
+ * If sync of leader fails, the leader gets the error and the next waiter tries again as leader
+ */
+class GroupCommit { /*{{{*/
+ public:
+  GroupCommit();
+  ~GroupCommit();
+
+ public:
+  uint64_t AddWrite();
+
+  // NOTE:htt, sync_func is called without lock of GroupCommit, so writes are added while syncing
+  Code WaitSynced(uint64_t seq, const SyncFunc &sync_func);
+
+  uint64_t GetWritesNum();
+  uint64_t GetSyncsNum();
+
+ private:
+  GroupCommit(const GroupCommit &);
+  GroupCommit &operator=(const GroupCommit &);
+
+ private:
+  Mutex mu_;
+  Cond cond_;
+  uint64_t write_seq_;
+  uint64_t synced_seq_;
+  bool is_syncing_;
+  uint64_t syncs_num_;
+}; /*}}}*/
+
+}  // namespace base
+
+#endif
@@ -12,16 +12,20 @@
 #include <sys/stat.h>
 #include <sys/syscall.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <time.h>
 #include <unistd.h>
 
+#include <string>
+#include <vector>
+
 #include "base/mutex.h"
 #include "base/status.h"
 
 namespace base {
 
-static const char *GetLogLevel(int level);
 static Code CheckLog(const struct tm *cur_tm);
+static void WriteLogLine(time_t cur, const struct tm *cur_tm, const char *line, uint32_t line_len);
 
 static char g_log_path[kFilePathLen] = {0};
 static char g_log_path_fmt[kFilePathLen] = {0};
@@ -30,8 +34,65 @@ static FILE *g_log_fp = NULL;
 // static pthread_mutex_t g_log_mutex = PTHREAD_MUTEX_INITIALIZER;
 static Mutex g_log_mutex;
 
+static bool g_log_head_cache = true;
+static uint32_t g_log_fork_gen = 0;
+static pthread_once_t g_log_head_once = PTHREAD_ONCE_INIT;
+
 static const char *kTooLongMsg = "File name or content too long!";
 
+// NOTE:htt, head fields of one thread which are reused until the second changes
+struct LogHeadCache { /*{{{*/
+  LogHeadCache() : sec(0), cur_tm(), fork_gen(0), date_len(0), id_len(0) {}
+
+  time_t sec;
+  struct tm cur_tm;
+  uint32_t fork_gen;
+  char date[32];  // NOTE:htt, "YYYY/mm/dd HH:MM:SS - "
+  int date_len;
+  char id[64];  // NOTE:htt, "[pid:x][tid:y]"
+  int id_len;
+}; /*}}}*/
+
+/**
+ * NOTE:htt, staging buffer of one thread in async mode, which is a single-producer/single-consumer ring:
+ * only the owner thread moves head and only the flusher thread moves tail.
+ * Every record is [int64 second][uint32 len][line], and the second is used to rotate the log file.
+ */
+struct LogStage { /*{{{*/
+  char *buf;
+  uint32_t size;  // NOTE:htt, power of two
+  uint64_t head;
+  uint64_t tail;
+  bool is_exited;  // NOTE:htt, owner thread has exited, the stage is freed after drained
+}; /*}}}*/
+
+struct LogStageHolder { /*{{{*/
+  LogStageHolder() : stage(NULL) {}
+  ~LogStageHolder() {
+    if (stage != NULL) __atomic_store_n(&stage->is_exited, true, __ATOMIC_RELEASE);
+  }
+
+  LogStage *stage;
+}; /*}}}*/
+
+static const uint32_t kLogRecordHeadLen = sizeof(int64_t) + sizeof(uint32_t);
+static const int kLogIovMaxNum = 512;
+static const uint32_t kLogBlockWaitMs = 10;
+
+static bool g_async_running = false;
+static uint32_t g_async_flush_interval_ms = kDefaultLogFlushIntervalMs;
+static uint32_t g_async_flush_size = kDefaultLogFlushSize;
+static uint32_t g_async_thread_buf_size = kDefaultLogThreadBufSize;
+static int g_async_full_policy = kLogBlockWhenFull;
+static uint64_t g_async_dropped_num = 0;
+static uint32_t g_async_writer_num = 0;  // NOTE:htt, threads which may still append into stages
+static int64_t g_async_last_sec = -1;    // NOTE:htt, second of the current file, protected by g_log_mutex
+static pthread_t g_async_thread_id;
+static std::vector<LogStage *> g_log_stages;
+static Mutex g_async_mutex;  // NOTE:htt, protect g_log_stages and start/stop
+static Cond g_async_flush_cond;
+static Cond g_async_space_cond;
+
 void SetLogLevel(int level) { /*{{{*/
   if (level >= kDebugLevel || level <= kFatalErrorLevel) {
     g_log_level = level;
@@ -41,9 +102,12 @@ void SetLogLevel(int level) { /*{{{*/
 void SetLogFmt(const char *log_path_fmt) { /*{{{*/
   if (log_path_fmt != NULL && log_path_fmt[0] != '\0') {
     snprintf(g_log_path_fmt, sizeof(g_log_path_fmt), "%s", log_path_fmt);
+    g_async_last_sec = -1;
   }
 } /*}}}*/
 
+void SetLogHeadCache(bool is_enabled) { /*{{{*/ g_log_head_cache = is_enabled; } /*}}}*/
+
 void InitLog(const char *log_path_fmt, int level) { /*{{{*/
   SetLogFmt(log_path_fmt);
   SetLogLevel(level);
@@ -57,89 +121,470 @@ void CloseLogStream() { /*{{{*/
 } /*}}}*/
 
 void DestroyLog() { /*{{{*/
+  StopAsyncLog();
   CloseLogStream();
   //  pthread_mutex_destroy(&g_log_mutex);
 } /*}}}*/
 
+static int FormatLogInt(int64_t value, char *buf) { /*{{{*/
+  char tmp[24];
+  int len = 0;
+  uint64_t abs_value = (value < 0) ? (uint64_t)(-(value + 1)) + 1 : (uint64_t)value;
+  do {
+    tmp[len++] = '0' + (abs_value % 10);
+    abs_value /= 10;
+  } while (abs_value != 0);
+
+  int pos = 0;
+  if (value < 0) buf[pos++] = '-';
+  while (len > 0) buf[pos++] = tmp[--len];
+
+  return pos;
+} /*}}}*/
+
+static void FormatLogTwoDigits(int value, char *buf) { /*{{{*/
+  buf[0] = '0' + (value / 10) % 10;
+  buf[1] = '0' + value % 10;
+} /*}}}*/
+
+static void ForkLogHeadCache() { /*{{{*/ ++g_log_fork_gen; } /*}}}*/
+
+static void InitLogHeadCacheOnce() { /*{{{*/ pthread_atfork(NULL, NULL, ForkLogHeadCache); } /*}}}*/
+
+/**
+ * NOTE:htt, the date prefix is rebuilt only when the second changes, and "[pid:x][tid:y]" only when
+ * the thread is new or the process has forked
+ */
+static const LogHeadCache *GetLogHeadCache(time_t cur) { /*{{{*/
+  static thread_local LogHeadCache cache;
+
+  if (cache.id_len == 0 || cache.fork_gen != g_log_fork_gen) {
+    pthread_once(&g_log_head_once, InitLogHeadCacheOnce);
+    cache.fork_gen = g_log_fork_gen;
+
+    char *pos = cache.id;
+    memcpy(pos, "[pid:", 5);
+    pos += 5;
+    pos += FormatLogInt(getpid(), pos);
+    memcpy(pos, "][tid:", 6);
+    pos += 6;
+#if defined(__linux__)
+    pos += FormatLogInt(syscall(SYS_gettid), pos);
+#elif defined(__APPLE__)
+    uint64_t tid = 0;
+    pthread_threadid_np(NULL, &tid);
+    pos += FormatLogInt((int64_t)tid, pos);
+#endif
+    *pos++ = ']';
+    cache.id_len = pos - cache.id;
+  }
+
+  if (cache.date_len == 0 || cache.sec != cur) {
+    localtime_r(&cur, &cache.cur_tm);
+    cache.sec = cur;
+
+    // NOTE:htt, same as "%4d/%02d/%02d %02d:%02d:%02d - "
+    char *pos = cache.date;
+    int year = cache.cur_tm.tm_year + 1900;
+    if (year >= 1000 && year <= 9999) {
+      pos += FormatLogInt(year, pos);
+    } else {
+      pos += snprintf(pos, sizeof(cache.date) - 20, "%4d", year);
+    }
+    *pos++ = '/';
+    FormatLogTwoDigits(cache.cur_tm.tm_mon + 1, pos);
+    pos += 2;
+    *pos++ = '/';
+    FormatLogTwoDigits(cache.cur_tm.tm_mday, pos);
+    pos += 2;
+    *pos++ = ' ';
+    FormatLogTwoDigits(cache.cur_tm.tm_hour, pos);
+    pos += 2;
+    *pos++ = ':';
+    FormatLogTwoDigits(cache.cur_tm.tm_min, pos);
+    pos += 2;
+    *pos++ = ':';
+    FormatLogTwoDigits(cache.cur_tm.tm_sec, pos);
+    pos += 2;
+    memcpy(pos, " - ", 3);
+    pos += 3;
+    cache.date_len = pos - cache.date;
+  }
+
+  return &cache;
+} /*}}}*/
+
+/**
+ * NOTE:htt, build the same head as snprintf with "... - [pid:%d][tid:%d][%s][%s %s %d] - ";
+ * return -1 when buf is not enough, then the caller falls back to snprintf
+ */
+static int FormatCachedLogHead(const LogHeadCache *cache, int log_level, const char *file_name, const char *func,
+                               int line_no, char *buf, int buf_len) { /*{{{*/
+  const char *level = GetLogLevel(log_level);
+  int level_len = strlen(level);
+  int file_name_len = strlen(file_name);
+  int func_len = strlen(func);
+
+  // NOTE:htt, 5 brackets, 2 spaces, at most 11 digits of line_no and " - "
+  int need_len = cache->date_len + cache->id_len + level_len + file_name_len + func_len + 5 + 2 + 11 + 3;
+  if (need_len >= buf_len) return -1;
+
+  char *pos = buf;
+  memcpy(pos, cache->date, cache->date_len);
+  pos += cache->date_len;
+  memcpy(pos, cache->id, cache->id_len);
+  pos += cache->id_len;
+  *pos++ = '[';
+  memcpy(pos, level, level_len);
+  pos += level_len;
+  *pos++ = ']';
+  *pos++ = '[';
+  memcpy(pos, file_name, file_name_len);
+  pos += file_name_len;
+  *pos++ = ' ';
+  memcpy(pos, func, func_len);
+  pos += func_len;
+  *pos++ = ' ';
+  pos += FormatLogInt(line_no, pos);
+  *pos++ = ']';
+  memcpy(pos, " - ", 3);
+  pos += 3;
+
+  return pos - buf;
+} /*}}}*/
+
 void PrintLog(const char *file_path, const char *func, int line_no, int log_level, const char *format, ...) { /*{{{*/
   if (log_level < g_log_level || NULL == file_path || NULL == format) return;
 
-  int ret = kOk;
   time_t cur;
   struct tm cur_tm = {0};
   const char *file_name = NULL;
-  char log_buf[kMaxBufLen] = {0};
+  char log_buf[kMaxBufLen];  // NOTE:htt, no need to zero, only [0, n + real_len] is used
+  int n = -1;
 
   file_name = strrchr(file_path, '/');
   file_name = (file_name == NULL) ? file_path : (file_name + 1);
 
-  MutexLock mutex_lock(&g_log_mutex);
-  //  pthread_mutex_lock(&g_log_mutex);
-
   time(&cur);
-  localtime_r(&cur, &cur_tm);
-
-  ret = CheckLog(&cur_tm);
+  if (g_log_head_cache) {
+    const LogHeadCache *cache = GetLogHeadCache(cur);
+    cur_tm = cache->cur_tm;
+    n = FormatCachedLogHead(cache, log_level, file_name, func, line_no, log_buf, sizeof(log_buf) - 2);
+  }
 
-  if (kOk == ret) {
+  if (n < 0) {
+    localtime_r(&cur, &cur_tm);
 #if defined(__linux__)
     pid_t tid = syscall(SYS_gettid);
-    int n = snprintf(log_buf, sizeof(log_buf) - 2, "%4d/%02d/%02d %02d:%02d:%02d - [pid:%d][tid:%d][%s][%s %s %d] - ",
-                     cur_tm.tm_year + 1900, cur_tm.tm_mon + 1, cur_tm.tm_mday, cur_tm.tm_hour, cur_tm.tm_min,
-                     cur_tm.tm_sec, getpid(), tid, GetLogLevel(log_level), file_name, func, line_no);
+    n = snprintf(log_buf, sizeof(log_buf) - 2, "%4d/%02d/%02d %02d:%02d:%02d - [pid:%d][tid:%d][%s][%s %s %d] - ",
+                 cur_tm.tm_year + 1900, cur_tm.tm_mon + 1, cur_tm.tm_mday, cur_tm.tm_hour, cur_tm.tm_min,
+                 cur_tm.tm_sec, getpid(), tid, GetLogLevel(log_level), file_name, func, line_no);
 #elif defined(__APPLE__)
     uint64_t tid = 0;
     pthread_threadid_np(NULL, &tid);
-    int n = snprintf(log_buf, sizeof(log_buf) - 2, "%4d/%02d/%02d %02d:%02d:%02d - [pid:%d][tid:%lu][%s][%s %s %d] - ",
-                     cur_tm.tm_year + 1900, cur_tm.tm_mon + 1, cur_tm.tm_mday, cur_tm.tm_hour, cur_tm.tm_min,
-                     cur_tm.tm_sec, getpid(), (unsigned long)tid, GetLogLevel(log_level), file_name, func, line_no);
+    n = snprintf(log_buf, sizeof(log_buf) - 2, "%4d/%02d/%02d %02d:%02d:%02d - [pid:%d][tid:%lu][%s][%s %s %d] - ",
+                 cur_tm.tm_year + 1900, cur_tm.tm_mon + 1, cur_tm.tm_mday, cur_tm.tm_hour, cur_tm.tm_min,
+                 cur_tm.tm_sec, getpid(), (unsigned long)tid, GetLogLevel(log_level), file_name, func, line_no);
 #endif
+  }
 
-    if (n >= (sizeof(log_buf) - 2)) {
-      fwrite(log_buf, sizeof(char), sizeof(log_buf) - 2, g_log_fp);
-      std::string err_msg("; Error message:");
-      err_msg.append(kTooLongMsg);
-      err_msg.append("\n");
-      fwrite(err_msg.c_str(), sizeof(char), err_msg.size(), g_log_fp);
-      fflush(g_log_fp);
-      return;
-    }
+  if (n >= (int)(sizeof(log_buf) - 2)) {
+    std::string err_msg(log_buf, sizeof(log_buf) - 2);
+    err_msg.append("; Error message:");
+    err_msg.append(kTooLongMsg);
+    err_msg.append("\n");
+    WriteLogLine(cur, &cur_tm, err_msg.data(), err_msg.size());
+    return;
+  }
+
+  va_list arg_ptr;
+  va_start(arg_ptr, format);
+  int real_len = vsnprintf(log_buf + n, sizeof(log_buf) - n - 2, format, arg_ptr);
+  va_end(arg_ptr);
+  if (real_len < 0) return;
+
+  if (real_len >= (int)(sizeof(log_buf) - n - 2)) {
+    char *extend_buf = new char[n + real_len + 2];
+    memcpy(extend_buf, log_buf, n);
 
-    va_list arg_ptr;
     va_start(arg_ptr, format);
-    int real_len = vsnprintf(log_buf + n, sizeof(log_buf) - n - 2, format, arg_ptr);
+    vsnprintf(extend_buf + n, real_len + 1, format, arg_ptr);
     va_end(arg_ptr);
-    if (real_len >= (sizeof(log_buf) - n - 2)) {
-      char *extend_buf = new char[real_len + 2];
-      if (extend_buf == NULL) {  // NOTE:htt, just log content
-        strcat(log_buf, "\n");
-        fwrite(log_buf, sizeof(char), sizeof(log_buf) - 1, g_log_fp);
-        fflush(g_log_fp);
-        return;
-      }
 
-      va_list arg_ptr;
-      va_start(arg_ptr, format);
-      vsnprintf(extend_buf, real_len, format, arg_ptr);
-      va_end(arg_ptr);
+    extend_buf[n + real_len] = '\n';
+    WriteLogLine(cur, &cur_tm, extend_buf, n + real_len + 1);
 
-      fwrite(log_buf, sizeof(char), n, g_log_fp);
-      strcat(extend_buf, "\n");
-      fwrite(extend_buf, sizeof(char), real_len + 1, g_log_fp);
-      fflush(g_log_fp);
+    delete[] extend_buf;
+    return;
+  }
 
-      delete[] extend_buf;
-      return;
+  log_buf[n + real_len] = '\n';
+  WriteLogLine(cur, &cur_tm, log_buf, n + real_len + 1);
+} /*}}}*/
+
+static void CopyIntoLogStage(LogStage *stage, uint64_t pos, const void *data, uint32_t len) { /*{{{*/
+  uint32_t offset = pos & (stage->size - 1);
+  uint32_t first_len = (stage->size - offset) < len ? (stage->size - offset) : len;
+  memcpy(stage->buf + offset, data, first_len);
+  memcpy(stage->buf, (const char *)data + first_len, len - first_len);
+} /*}}}*/
+
+static void CopyFromLogStage(const LogStage *stage, uint64_t pos, void *data, uint32_t len) { /*{{{*/
+  uint32_t offset = pos & (stage->size - 1);
+  uint32_t first_len = (stage->size - offset) < len ? (stage->size - offset) : len;
+  memcpy(data, stage->buf + offset, first_len);
+  memcpy((char *)data + first_len, stage->buf, len - first_len);
+} /*}}}*/
+
+static LogStage *GetLogStage() { /*{{{*/
+  static thread_local LogStageHolder holder;
+  if (holder.stage != NULL) return holder.stage;
+
+  uint32_t size = 1;
+  while (size < g_async_thread_buf_size) size <<= 1;
+
+  LogStage *stage = new LogStage;
+  stage->buf = new char[size];
+  stage->size = size;
+  stage->head = 0;
+  stage->tail = 0;
+  stage->is_exited = false;
+
+  MutexLock mutex_lock(&g_async_mutex);
+  g_log_stages.push_back(stage);
+  holder.stage = stage;
+
+  return stage;
+} /*}}}*/
+
+/**
+ * NOTE:htt, append one line into staging buffer of current thread;
+ * return kOk when the line is queued or dropped, otherwise the caller writes it synchronously
+ */
+static Code AppendAsyncLog(time_t cur, const char *line, uint32_t line_len) { /*{{{*/
+  LogStage *stage = GetLogStage();
+
+  uint32_t need_len = kLogRecordHeadLen + line_len;
+  if (need_len > stage->size) return kInvalidSize;
+
+  uint64_t tail = __atomic_load_n(&stage->tail, __ATOMIC_ACQUIRE);
+  while (stage->head + need_len - tail > stage->size) {
+    if (g_async_full_policy == kLogDropWhenFull) {
+      FetchAndAdd(&g_async_dropped_num, (uint64_t)1);
+      return kOk;
+    }
+
+    MutexLock mutex_lock(&g_async_mutex);
+    if (!__atomic_load_n(&g_async_running, __ATOMIC_ACQUIRE)) return kNotInit;
+    g_async_flush_cond.Signal();
+    g_async_space_cond.TimeWait(g_async_mutex, kLogBlockWaitMs);
+    tail = __atomic_load_n(&stage->tail, __ATOMIC_ACQUIRE);
+  }
+
+  int64_t sec = cur;
+  uint64_t head = stage->head;
+  CopyIntoLogStage(stage, head, &sec, sizeof(sec));
+  CopyIntoLogStage(stage, head + sizeof(sec), &line_len, sizeof(line_len));
+  CopyIntoLogStage(stage, head + kLogRecordHeadLen, line, line_len);
+  __atomic_store_n(&stage->head, head + need_len, __ATOMIC_RELEASE);
+
+  // NOTE:htt, only wake up flusher when pending bytes cross flush_size, not on every line
+  if (head - tail < g_async_flush_size && head + need_len - tail >= g_async_flush_size) {
+    g_async_flush_cond.Signal();
+  }
+
+  return kOk;
+} /*}}}*/
+
+static void WriteLogLine(time_t cur, const struct tm *cur_tm, const char *line, uint32_t line_len) { /*{{{*/
+  if (__atomic_load_n(&g_async_running, __ATOMIC_ACQUIRE)) {
+    // NOTE:htt, count writer before checking running again, so StopAsyncLog() can wait the line in flight
+    __atomic_add_fetch(&g_async_writer_num, 1, __ATOMIC_SEQ_CST);
+    Code ret = kNotInit;
+    if (__atomic_load_n(&g_async_running, __ATOMIC_SEQ_CST)) {
+      ret = AppendAsyncLog(cur, line, line_len);
     }
+    __atomic_sub_fetch(&g_async_writer_num, 1, __ATOMIC_SEQ_CST);
+    if (ret == kOk) return;
+  }
 
-    strcat(log_buf, "\n");
-    fwrite(log_buf, sizeof(char), n + real_len + 1, g_log_fp);
+  MutexLock mutex_lock(&g_log_mutex);
+  //  pthread_mutex_lock(&g_log_mutex);
+
+  Code ret = CheckLog(cur_tm);
+  if (kOk == ret) {
+    fwrite(line, sizeof(char), line_len, g_log_fp);
     fflush(g_log_fp);
   }
 
   //  pthread_mutex_unlock(&g_log_mutex);
 } /*}}}*/
 
+static void WriteLogIov(struct iovec *iov, int iov_num) { /*{{{*/
+  if (g_log_fp == NULL) return;
+
+  int fd = fileno(g_log_fp);
+  while (iov_num > 0) {
+    ssize_t ret = writev(fd, iov, iov_num);
+    if (ret < 0) {
+      if (errno == EINTR) continue;
+      return;
+    }
+
+    // NOTE:htt, skip what has been written when writev is partial
+    while (iov_num > 0 && (size_t)ret >= iov->iov_len) {
+      ret -= iov->iov_len;
+      ++iov;
+      --iov_num;
+    }
+    if (iov_num > 0) {
+      iov->iov_base = (char *)iov->iov_base + ret;
+      iov->iov_len -= ret;
+    }
+  }
+} /*}}}*/
+
+/**
+ * NOTE:htt, write all records of one stage; records are grouped into one writev() until
+ * the second moves forward, when CheckLog() is called to rotate the file, or iov is full;
+ * older records of other stages go to the current file, the previous file is never reopened
+ */
+static void DrainLogStage(LogStage *stage) { /*{{{*/
+  struct iovec iov[kLogIovMaxNum];
+  int iov_num = 0;
+
+  uint64_t head = __atomic_load_n(&stage->head, __ATOMIC_ACQUIRE);
+  uint64_t pos = stage->tail;
+  while (pos < head) {
+    int64_t sec = 0;
+    uint32_t line_len = 0;
+    CopyFromLogStage(stage, pos, &sec, sizeof(sec));
+    CopyFromLogStage(stage, pos + sizeof(sec), &line_len, sizeof(line_len));
+
+    if (sec > g_async_last_sec || iov_num + 2 > kLogIovMaxNum) {
+      WriteLogIov(iov, iov_num);
+      iov_num = 0;
+      __atomic_store_n(&stage->tail, pos, __ATOMIC_RELEASE);
+
+      if (sec > g_async_last_sec) {
+        time_t cur = sec;
+        struct tm cur_tm = {0};
+        localtime_r(&cur, &cur_tm);
+        CheckLog(&cur_tm);
+        g_async_last_sec = sec;
+      }
+    }
+
+    uint32_t offset = (pos + kLogRecordHeadLen) & (stage->size - 1);
+    uint32_t first_len = (stage->size - offset) < line_len ? (stage->size - offset) : line_len;
+    iov[iov_num].iov_base = stage->buf + offset;
+    iov[iov_num].iov_len = first_len;
+    ++iov_num;
+    if (first_len < line_len) {
+      iov[iov_num].iov_base = stage->buf;
+      iov[iov_num].iov_len = line_len - first_len;
+      ++iov_num;
+    }
+
+    pos += kLogRecordHeadLen + line_len;
+  }
+
+  WriteLogIov(iov, iov_num);
+  __atomic_store_n(&stage->tail, pos, __ATOMIC_RELEASE);
+} /*}}}*/
+
+static void FlushLogStages() { /*{{{*/
+  std::vector<LogStage *> stages;
+  {
+    MutexLock mutex_lock(&g_async_mutex);
+    std::vector<LogStage *>::iterator it = g_log_stages.begin();
+    while (it != g_log_stages.end()) {
+      LogStage *stage = *it;
+      if (__atomic_load_n(&stage->is_exited, __ATOMIC_ACQUIRE) &&
+          __atomic_load_n(&stage->head, __ATOMIC_ACQUIRE) == stage->tail) {
+        delete[] stage->buf;
+        delete stage;
+        it = g_log_stages.erase(it);
+        continue;
+      }
+      stages.push_back(stage);
+      ++it;
+    }
+  }
+
+  MutexLock mutex_lock(&g_log_mutex);
+  for (size_t i = 0; i < stages.size(); ++i) {
+    DrainLogStage(stages[i]);
+  }
+} /*}}}*/
+
+static void *AsyncLogThreadAction(void *param) { /*{{{*/
+  while (true) {
+    bool is_running = __atomic_load_n(&g_async_running, __ATOMIC_ACQUIRE);
+
+    FlushLogStages();
+    g_async_space_cond.BroadCast();
+    if (!is_running) break;
+
+    MutexLock mutex_lock(&g_async_mutex);
+    if (__atomic_load_n(&g_async_running, __ATOMIC_ACQUIRE)) {
+      g_async_flush_cond.TimeWait(g_async_mutex, g_async_flush_interval_ms);
+    }
+  }
+
+  return NULL;
+} /*}}}*/
+
+Code StartAsyncLog(uint32_t flush_interval_ms, uint32_t flush_size, uint32_t thread_buf_size,
+                   int full_policy) { /*{{{*/
+  if (flush_interval_ms == 0 || thread_buf_size == 0 || thread_buf_size > (1u << 31)) return kInvalidParam;
+  if (full_policy != kLogDropWhenFull && full_policy != kLogBlockWhenFull) return kInvalidParam;
+
+  MutexLock mutex_lock(&g_async_mutex);
+  if (g_async_running) return kAlreadyExist;
+
+  g_async_flush_interval_ms = flush_interval_ms;
+  g_async_flush_size = flush_size;
+  g_async_thread_buf_size = thread_buf_size;
+  g_async_full_policy = full_policy;
+  {
+    MutexLock log_lock(&g_log_mutex);
+    g_async_last_sec = -1;
+  }
+
+  __atomic_store_n(&g_async_running, true, __ATOMIC_RELEASE);
+  int ret = pthread_create(&g_async_thread_id, NULL, AsyncLogThreadAction, NULL);
+  if (ret != 0) {
+    __atomic_store_n(&g_async_running, false, __ATOMIC_RELEASE);
+    return kPthreadCreateFailed;
+  }
+
+  return kOk;
+} /*}}}*/
+
+void StopAsyncLog() { /*{{{*/
+  {
+    MutexLock mutex_lock(&g_async_mutex);
+    if (!g_async_running) return;
+    __atomic_store_n(&g_async_running, false, __ATOMIC_SEQ_CST);
+    g_async_flush_cond.Signal();
+    g_async_space_cond.BroadCast();
+  }
+
+  // NOTE:htt, flusher drains all stages once more before exit
+  pthread_join(g_async_thread_id, NULL);
+
+  // NOTE:htt, writers which saw running before the store may append after the last drain of flusher,
+  // so wait them out and drain again; later writers see stopped and write synchronously
+  while (__atomic_load_n(&g_async_writer_num, __ATOMIC_SEQ_CST) != 0) {
+    usleep(kLogBlockWaitMs * 1000);
+  }
+  FlushLogStages();
+} /*}}}*/
+
+bool IsAsyncLog() { /*{{{*/ return __atomic_load_n(&g_async_running, __ATOMIC_ACQUIRE); } /*}}}*/
+
+uint64_t GetAsyncLogDroppedNum() { /*{{{*/ return __atomic_load_n(&g_async_dropped_num, __ATOMIC_ACQUIRE); } /*}}}*/
 static Code CheckLog(const struct tm *cur_tm) { /*{{{*/
   Code ret = kOk;
   size_t len = 0;
@@ -171,7 +616,7 @@ static Code CheckLog(const struct tm *cur_tm) { /*{{{*/
   return ret;
 } /*}}}*/
 
-static const char *GetLogLevel(int level) { /*{{{*/
+const char *GetLogLevel(int level) { /*{{{*/
   switch (level) {
     case kFatalErrorLevel:
       return "FATAL ERROR";
@@ -217,6 +662,11 @@ int main(int argc, char *argv[]) { /*{{{*/
   LOG_TRACE("trace now");
   LOG_DEBUG("debug now");
 
+  StartAsyncLog();
+  LOG_ERR("async err now");
+  LOG_INFO("async info now");
+  StopAsyncLog();
+
   DestroyLog();
 
   return 0;
@@ -5,11 +5,19 @@
 #ifndef BASE_LOG_H_
 #define BASE_LOG_H_
 
+#include <stdint.h>
+
+#include "base/status.h"
+
 namespace base {
 
 const int kFilePathLen = 2048;
 const int kMaxBufLen = 2048;
 
+const uint32_t kDefaultLogFlushIntervalMs = 100;
+const uint32_t kDefaultLogFlushSize = 64 * 1024;
+const uint32_t kDefaultLogThreadBufSize = 1024 * 1024;
+
 enum LogLevel {
   kDebugLevel = 0,
   kTraceLevel,
@@ -19,6 +27,12 @@ enum LogLevel {
   kFatalErrorLevel,
 };
 
+// NOTE:htt, what to do when the staging buffer of one thread is full in async mode
+enum LogFullPolicy {
+  kLogDropWhenFull = 0,
+  kLogBlockWhenFull,
+};
+
 #define LOG_FATAL_ERR(format, ...) PrintLog(__FILE__, __func__, __LINE__, base::kFatalErrorLevel, format, ##__VA_ARGS__)
 #define LOG_ERR(format, ...) PrintLog(__FILE__, __func__, __LINE__, base::kErrorLevel, format, ##__VA_ARGS__)
 #define LOG_WARN(format, ...) PrintLog(__FILE__, __func__, __LINE__, base::kWarnLevel, format, ##__VA_ARGS__)
@@ -28,10 +42,25 @@ enum LogLevel {
 
 void SetLogLevel(int level);
 void SetLogFmt(const char *log_path_fmt);
+// NOTE:htt, reuse date/pid/tid of log head in one thread until the second changes, enabled by default
+void SetLogHeadCache(bool is_enabled);
 void InitLog(const char *log_path_fmt, int level);
 void CloseLogStream();
 void DestroyLog();
 void PrintLog(const char *file_path, const char *func, int line_no, int log_level, const char *format, ...);
+const char *GetLogLevel(int level);
+
+/**
+ * Switch PrintLog to asynchronous mode: every thread appends lines into its own lock-free
+ * staging buffer, and one background thread batches them to the file with writev().
+ * The file is flushed every flush_interval_ms, or sooner when one thread has flush_size bytes pending;
+ * full_policy is one of LogFullPolicy. Rotation by the strftime format of SetLogFmt() is kept.
+ */
+Code StartAsyncLog(uint32_t flush_interval_ms = kDefaultLogFlushIntervalMs, uint32_t flush_size = kDefaultLogFlushSize,
+                   uint32_t thread_buf_size = kDefaultLogThreadBufSize, int full_policy = kLogBlockWhenFull);
+void StopAsyncLog();
+bool IsAsyncLog();
+uint64_t GetAsyncLogDroppedNum();
 
 }  // namespace base
 
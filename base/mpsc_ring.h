@@ -0,0 +1,128 @@
+// Copyright (c) 2015 The CSUTIL Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BASE_MPSC_RING_H_
+#define BASE_MPSC_RING_H_
+
+#include <stdint.h>
+
+#include <utility>
+
+#include "base/status.h"
+
+namespace base {
+
+/**
+ * Bounded lock-free ring of many producers and one consumer.
+ * Every slot has a sequence: producers claim a position by CAS on head_ and publish the slot by
+ * setting its sequence to pos + 1; the only consumer reads the slot when its sequence is tail_ + 1,
+ * then releases it to the producers of the next round by setting sequence to tail_ + capacity.
+ */
+template <class T>
+class MpscRing { /*{{{*/
+ public:
+  explicit MpscRing(uint32_t capacity);
+  ~MpscRing();
+
+ public:
+  // NOTE:htt, may be called by any thread, value is moved into ring; return kFull if no space
+  Code Push(T *value);
+
+  // NOTE:htt, only be called by the consumer thread; return kNotFound if empty
+  Code Pop(T *value);
+
+  uint32_t Capacity() const { return mask_ + 1; }
+
+  // NOTE:htt, approximate size, which is only used for statistic or dispatching
+  uint32_t Size() const;
+
+ private:
+  struct Slot {
+    uint64_t seq;
+    T value;
+  };
+
+  // NOTE:htt, padding keeps head_ and tail_ in different cache lines without over-aligned new
+  Slot *slots_;
+  uint32_t mask_;
+  char pad0_[64];
+  uint64_t head_;
+  char pad1_[64 - sizeof(uint64_t)];
+  uint64_t tail_;
+  char pad2_[64 - sizeof(uint64_t)];
+
+ private:
+  MpscRing(const MpscRing &);
+  MpscRing &operator=(const MpscRing &);
+}; /*}}}*/
+
+template <class T>
+MpscRing<T>::MpscRing(uint32_t capacity) : slots_(NULL), mask_(0), head_(0), tail_(0) { /*{{{*/
+  uint32_t real_capacity = 2;
+  while (real_capacity < capacity && real_capacity < (1u << 31)) real_capacity <<= 1;
+
+  slots_ = new Slot[real_capacity];
+  mask_ = real_capacity - 1;
+  for (uint32_t i = 0; i < real_capacity; ++i) {
+    slots_[i].seq = i;
+  }
+} /*}}}*/
+
+template <class T>
+MpscRing<T>::~MpscRing() { /*{{{*/
+  delete[] slots_;
+  slots_ = NULL;
+} /*}}}*/
+
+template <class T>
+Code MpscRing<T>::Push(T *value) { /*{{{*/
+  if (value == NULL) return kInvalidParam;
+
+  uint64_t pos = __atomic_load_n(&head_, __ATOMIC_RELAXED);
+  while (true) {
+    Slot *slot = slots_ + (pos & mask_);
+    uint64_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    int64_t diff = (int64_t)seq - (int64_t)pos;
+    if (diff == 0) {
+      if (__atomic_compare_exchange_n(&head_, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        slot->value = std::move(*value);
+        __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+        return kOk;
+      }
+      // NOTE:htt, pos has been reloaded by failed CAS
+    } else if (diff < 0) {
+      return kFull;  // NOTE:htt, slot of last round has not been consumed
+    } else {
+      pos = __atomic_load_n(&head_, __ATOMIC_RELAXED);
+    }
+  }
+
+  return kOk;
+} /*}}}*/
+
+template <class T>
+Code MpscRing<T>::Pop(T *value) { /*{{{*/
+  if (value == NULL) return kInvalidParam;
+
+  Slot *slot = slots_ + (tail_ & mask_);
+  uint64_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+  if (seq != tail_ + 1) return kNotFound;
+
+  *value = std::move(slot->value);
+  __atomic_store_n(&slot->seq, tail_ + mask_ + 1, __ATOMIC_RELEASE);
+  __atomic_store_n(&tail_, tail_ + 1, __ATOMIC_RELAXED);
+
+  return kOk;
+} /*}}}*/
+
+template <class T>
+uint32_t MpscRing<T>::Size() const { /*{{{*/
+  uint64_t head = __atomic_load_n(&head_, __ATOMIC_RELAXED);
+  uint64_t tail = __atomic_load_n(&tail_, __ATOMIC_RELAXED);
+  return head > tail ? (uint32_t)(head - tail) : 0;
+} /*}}}*/
+
+}  // namespace base
+
+#endif
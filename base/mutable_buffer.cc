@@ -8,21 +8,140 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <new>
+
+#include "base/buffer_pool.h"
+
 namespace base {
+
+BufferBlock *BufferBlock::New(uint32_t capacity) { /*{{{*/
+  BufferBlock *block = new (std::nothrow) BufferBlock();
+  if (block == NULL) return NULL;
+
+  uint32_t real_size = 0;
+  block->data_ = static_cast<char *>(BufferPool::Instance()->Alloc(capacity, &real_size));
+  if (block->data_ == NULL) {
+    delete block;
+    return NULL;
+  }
+  block->capacity_ = real_size;
+  return block;
+} /*}}}*/
+
+void BufferBlock::Ref() { /*{{{*/ __atomic_add_fetch(&ref_, 1, __ATOMIC_RELAXED); } /*}}}*/
+
+void BufferBlock::Unref() { /*{{{*/
+  if (__atomic_sub_fetch(&ref_, 1, __ATOMIC_ACQ_REL) == 0) {
+    BufferPool::Instance()->Free(data_, capacity_);
+    delete this;
+  }
+} /*}}}*/
+
+bool BufferBlock::IsShared() const { /*{{{*/ return __atomic_load_n(&ref_, __ATOMIC_ACQUIRE) > 1; } /*}}}*/
+
+BufferSlice::BufferSlice() : block_(NULL), offset_(0), len_(0) { /*{{{*/
+} /*}}}*/
+
+BufferSlice::BufferSlice(BufferBlock *block, uint32_t offset, uint32_t len)
+    : block_(block), offset_(offset), len_(len) { /*{{{*/
+  if (block_ != NULL) block_->Ref();
+} /*}}}*/
+
+BufferSlice::BufferSlice(const std::string &str) : block_(NULL), offset_(0), len_(0) { /*{{{*/
+  if (str.empty()) return;
+
+  block_ = BufferBlock::New(str.size());
+  if (block_ == NULL) return;
+  memcpy(block_->Data(), str.data(), str.size());
+  len_ = str.size();
+} /*}}}*/
+
+BufferSlice::~BufferSlice() { /*{{{*/ Reset(); } /*}}}*/
+
+BufferSlice::BufferSlice(const BufferSlice &other)
+    : block_(other.block_), offset_(other.offset_), len_(other.len_) { /*{{{*/
+  if (block_ != NULL) block_->Ref();
+} /*}}}*/
+
+BufferSlice &BufferSlice::operator=(const BufferSlice &other) { /*{{{*/
+  if (this == &other) return *this;
+
+  if (other.block_ != NULL) other.block_->Ref();
+  Reset();
+  block_ = other.block_;
+  offset_ = other.offset_;
+  len_ = other.len_;
+  return *this;
+} /*}}}*/
+
+BufferSlice::BufferSlice(BufferSlice &&other)
+    : block_(other.block_), offset_(other.offset_), len_(other.len_) { /*{{{*/
+  other.block_ = NULL;
+  other.offset_ = 0;
+  other.len_ = 0;
+} /*}}}*/
+
+BufferSlice &BufferSlice::operator=(BufferSlice &&other) { /*{{{*/
+  if (this == &other) return *this;
+
+  Reset();
+  block_ = other.block_;
+  offset_ = other.offset_;
+  len_ = other.len_;
+  other.block_ = NULL;
+  other.offset_ = 0;
+  other.len_ = 0;
+  return *this;
+} /*}}}*/
+
+Code BufferSlice::Alloc(uint32_t len, BufferSlice *slice) { /*{{{*/
+  if (slice == NULL) return kInvalidParam;
+  slice->Reset();
+  if (len == 0) return kOk;
+
+  BufferBlock *block = BufferBlock::New(len);
+  if (block == NULL) return kMallocFailed;
+
+  slice->block_ = block;  // NOTE: take the reference of New
+  slice->len_ = len;
+  return kOk;
+} /*}}}*/
+
+Code BufferSlice::Skip(uint32_t skip_len) { /*{{{*/
+  if (skip_len >= len_) {
+    Reset();
+    return kOk;
+  }
+
+  offset_ += skip_len;
+  len_ -= skip_len;
+  return kOk;
+} /*}}}*/
+
+void BufferSlice::Reset() { /*{{{*/
+  if (block_ != NULL) {
+    block_->Unref();
+    block_ = NULL;
+  }
+  offset_ = 0;
+  len_ = 0;
+} /*}}}*/
+
+std::string BufferSlice::ToString() const { /*{{{*/
+  if (len_ == 0) return std::string();
+  return std::string(Data(), len_);
+} /*}}}*/
+
 MutableBuffer::MutableBuffer(uint32_t min_buf_size, uint32_t max_buf_size)
     : min_buf_size_(min_buf_size), max_buf_size_(max_buf_size) { /*{{{*/
+  block_ = NULL;
   buf_ = NULL;
   buf_size_ = 0;
   cur_buf_size_ = 0;
   offset_ = 0;
 } /*}}}*/
 
-MutableBuffer::~MutableBuffer() { /*{{{*/
-  if (buf_ != NULL) {
-    free(buf_);
-    buf_ = NULL;
-  }
-} /*}}}*/
+MutableBuffer::~MutableBuffer() { /*{{{*/ ReleaseBlock(); } /*}}}*/
 
 /**
  * Note: when error code return, the caller should close current connection for losing some data for
@@ -31,63 +150,105 @@ MutableBuffer::~MutableBuffer() { /*{{{*/
  */
 Code MutableBuffer::Append(const char *data, uint32_t data_len) { /*{{{*/
   if (data == NULL) return kInvalidParam;
-  if (buf_size_ + data_len > max_buf_size_)
-    return kInvalidLength;  // Note: No space for current data, and the caller should close current
-                            // connection for losing some data
 
+  Code ret = Reserve(data_len);
+  if (ret != kOk) return ret;
+
+  memcpy(buf_ + offset_ + cur_buf_size_, data, data_len);
+  cur_buf_size_ += data_len;
+
+  return kOk;
+} /*}}}*/
+
+Code MutableBuffer::Reserve(uint32_t data_len) { /*{{{*/
   if (buf_ == NULL) {
+    if (data_len > max_buf_size_) return kInvalidLength;
+
     uint32_t alloc_size = data_len < min_buf_size_ ? min_buf_size_ : (min_buf_size_ + data_len);
-    buf_ = (char *)malloc(alloc_size);
-    if (buf_ == NULL) {
+    block_ = BufferBlock::New(alloc_size);
+    if (block_ == NULL) {
       return kMallocFailed;
     }
 
+    buf_ = block_->Data();
     buf_size_ = alloc_size;
     cur_buf_size_ = 0;
     offset_ = 0;
   }
 
   if ((buf_size_ - offset_ - cur_buf_size_) >= data_len) {
-    memcpy(buf_ + offset_ + cur_buf_size_, data, data_len);
-    cur_buf_size_ += data_len;
     return kOk;
   }
 
-  if ((buf_size_ - cur_buf_size_) >= data_len) {
+  // NOTE:htt, data before offset_ may be referenced by slices, so it's moved only when block is not shared
+  bool is_shared = block_->IsShared();
+  if (!is_shared && (buf_size_ - cur_buf_size_) >= data_len) {
     memmove(buf_, buf_ + offset_, cur_buf_size_);
-    memmove(buf_ + cur_buf_size_, data, data_len);
-    cur_buf_size_ += data_len;
     offset_ = 0;
 
     return kOk;
   }
 
-  uint32_t alloc_size = min_buf_size_ + buf_size_ + data_len;
-  char *tmp_buf = (char *)malloc(alloc_size);
-  if (tmp_buf == NULL) {
+  uint32_t alloc_size = 0;
+  if (is_shared) {
+    // NOTE:htt, only the data which has not been sliced is copied into a new block like the first allocation
+    if (cur_buf_size_ + data_len > max_buf_size_) return kInvalidLength;
+    uint32_t need_size = cur_buf_size_ + data_len;
+    alloc_size = need_size < min_buf_size_ ? min_buf_size_ : (min_buf_size_ + need_size);
+  } else {
+    uint64_t need_size = (uint64_t)cur_buf_size_ + data_len;
+    if (need_size > max_buf_size_)
+      return kInvalidLength;  // Note: No space for current data, and the caller should close current
+                              // connection for losing some data
+
+    // NOTE:htt, grow by double, so a large frame read by small chunks is copied O(n) bytes in total
+    uint64_t double_size = (uint64_t)buf_size_ * 2;
+    if (double_size > max_buf_size_) double_size = max_buf_size_;
+    alloc_size = (uint32_t)(double_size > need_size ? double_size : need_size);
+  }
+
+  BufferBlock *tmp_block = BufferBlock::New(alloc_size);
+  if (tmp_block == NULL) {
     return kMallocFailed;
   }
 
-  memcpy(tmp_buf, buf_ + offset_, cur_buf_size_);
-  memcpy(tmp_buf + cur_buf_size_, data, data_len);
+  memcpy(tmp_block->Data(), buf_ + offset_, cur_buf_size_);
 
-  free(buf_);
-  buf_ = tmp_buf;
+  block_->Unref();
+  block_ = tmp_block;
+  buf_ = block_->Data();
   buf_size_ = alloc_size;
-  cur_buf_size_ += data_len;
   offset_ = 0;
 
   return kOk;
 } /*}}}*/
 
+char *MutableBuffer::WritableDataPtr() { /*{{{*/
+  if (buf_ == NULL) return NULL;
+
+  return buf_ + offset_ + cur_buf_size_;
+} /*}}}*/
+
+uint32_t MutableBuffer::WritableSize() { /*{{{*/
+  if (buf_ == NULL) return 0;
+
+  return buf_size_ - offset_ - cur_buf_size_;
+} /*}}}*/
+
+Code MutableBuffer::Commit(uint32_t len) { /*{{{*/
+  if (len > WritableSize()) return kInvalidParam;
+
+  cur_buf_size_ += len;
+  return kOk;
+} /*}}}*/
+
 Code MutableBuffer::Skip(uint32_t skip_len) { /*{{{*/
   if (buf_ == NULL) return kOk;
 
   if (skip_len >= cur_buf_size_) {
-    if (buf_size_ > min_buf_size_) {
-      free(buf_);
-      buf_ = NULL;
-      buf_size_ = 0;
+    // NOTE:htt, shared block is released too, so sliced data would not be overwritten from the head
+    if (buf_size_ > min_buf_size_ || block_->IsShared()) {
+      ReleaseBlock();
     }
     cur_buf_size_ = 0;
     offset_ = 0;
@@ -101,6 +262,25 @@ Code MutableBuffer::Skip(uint32_t skip_len) { /*{{{*/
   return kOk;
 } /*}}}*/
 
+Code MutableBuffer::Cut(uint32_t len, BufferSlice *slice) { /*{{{*/
+  if (slice == NULL || len > cur_buf_size_) return kInvalidParam;
+  if (len == 0) {
+    slice->Reset();
+    return kOk;
+  }
+
+  *slice = BufferSlice(block_, offset_, len);
+  return Skip(len);
+} /*}}}*/
+
+Code MutableBuffer::Shrink() { /*{{{*/
+  if (buf_ == NULL || cur_buf_size_ != 0) return kOk;
+
+  ReleaseBlock();
+  offset_ = 0;
+  return kOk;
+} /*}}}*/
+
 const char *MutableBuffer::RealDataPtr() { /*{{{*/
   if (buf_ == NULL) return NULL;
 
@@ -109,4 +289,15 @@ const char *MutableBuffer::RealDataPtr() { /*{{{*/
 
 uint32_t MutableBuffer::RealDataSize() { /*{{{*/ return cur_buf_size_; } /*}}}*/
 
+Code MutableBuffer::ReleaseBlock() { /*{{{*/
+  if (block_ != NULL) {
+    block_->Unref();
+    block_ = NULL;
+  }
+  buf_ = NULL;
+  buf_size_ = 0;
+
+  return kOk;
+} /*}}}*/
+
 }  // namespace base
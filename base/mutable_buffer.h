@@ -7,10 +7,82 @@
 
 #include <stdint.h>
 
+#include <string>
+
 #include "base/status.h"
 
 namespace base {
 
+/**
+ * NOTE: BufferBlock is a ref-counted chunk borrowed from BufferPool, which is shared by MutableBuffer and
+ * BufferSlices; it goes back to the pool when the last reference is released, and reference counting is
+ * thread safe
+ */
+class BufferBlock {
+ public:
+  // NOTE: return one block whose reference is 1, or NULL if malloc failed; capacity is rounded up to size class
+  static BufferBlock *New(uint32_t capacity);
+
+  void Ref();
+  void Unref();
+
+  char *Data() { return data_; }
+  uint32_t Capacity() const { return capacity_; }
+
+  // NOTE: someone else holds the block, then data which has been sliced should not be moved
+  bool IsShared() const;
+
+ private:
+  BufferBlock() : ref_(1), capacity_(0), data_(NULL) {}
+  ~BufferBlock() {}
+
+  BufferBlock(const BufferBlock &);
+  BufferBlock &operator=(const BufferBlock &);
+
+ private:
+  uint32_t ref_;
+  uint32_t capacity_;
+  char *data_;  // NOTE: chunk of BufferPool, capacity_ is the real size of it
+};
+
+/**
+ * NOTE: BufferSlice is a read only view of [offset, offset + len) in one BufferBlock;
+ * copying a slice only adds a reference, so one frame could be passed between threads without copying
+ */
+class BufferSlice {
+ public:
+  BufferSlice();
+  BufferSlice(BufferBlock *block, uint32_t offset, uint32_t len);  // NOTE: add a reference of block
+  explicit BufferSlice(const std::string &str);                    // NOTE: copy str into a new block
+  ~BufferSlice();
+
+  BufferSlice(const BufferSlice &other);
+  BufferSlice &operator=(const BufferSlice &other);
+  BufferSlice(BufferSlice &&other);
+  BufferSlice &operator=(BufferSlice &&other);
+
+ public:
+  /**
+   * Note: allocate one slice of len bytes in a new block, which is written by MutableData before it is
+   * shared, so response could be serialized in place
+   */
+  static Code Alloc(uint32_t len, BufferSlice *slice);
+
+  const char *Data() const { return block_ == NULL ? NULL : block_->Data() + offset_; }
+  char *MutableData() { return block_ == NULL ? NULL : block_->Data() + offset_; }
+  uint32_t Size() const { return len_; }
+  bool Empty() const { return len_ == 0; }
+
+  Code Skip(uint32_t skip_len);
+  void Reset();
+  std::string ToString() const;
+
+ private:
+  BufferBlock *block_;
+  uint32_t offset_;
+  uint32_t len_;
+};
+
 /**
  * NOTE: MutableBuffer is used for socket connecting when receiving data;
  * The buffer would be free when it's empty and size is larger then safe size;
@@ -30,6 +102,27 @@ class MutableBuffer {
   const char *RealDataPtr();
   uint32_t RealDataSize();
 
+  /**
+   * Note: read from fd into buffer directly without a temporary buffer, usage:
+   *   Reserve(len) -> read(fd, WritableDataPtr(), WritableSize()) -> Commit(read_len)
+   */
+  Code Reserve(uint32_t len);
+  char *WritableDataPtr();
+  uint32_t WritableSize();
+  Code Commit(uint32_t len);
+
+  /**
+   * Note: the first len bytes are taken out as a slice without copying; after that, sliced data in the block
+   * is never moved or overwritten by buffer, and the block is freed when both buffer and slice release it
+   */
+  Code Cut(uint32_t len, BufferSlice *slice);
+
+  /**
+   * Note: return the block to pool if no data is left, so an idle connection holds no memory;
+   * the buffer borrows a block again lazily on next Append or Reserve
+   */
+  Code Shrink();
+
  private:
   MutableBuffer(const MutableBuffer &);
   MutableBuffer &operator=(const MutableBuffer &);
@@ -39,6 +132,10 @@ class MutableBuffer {
    * |----------        buf_size_     --------------|
    * |---offset_---|---cur_buf_size_---|--left_len--|
    */
+  Code ReleaseBlock();
+
+ private:
+  BufferBlock *block_;     // block: owner of buf_, maybe shared by slices
   char *buf_;              // buf:
   uint32_t buf_size_;      // the whole buf size
   uint32_t cur_buf_size_;  // real data size
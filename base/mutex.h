@@ -10,6 +10,7 @@
 #include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <time.h>
 
 #include "base/status.h"
 #include "base/time.h"
@@ -54,11 +55,77 @@ class MutexLock { /*{{{*/
   Mutex *mu_;
 }; /*}}}*/
 
+// NOTE:htt, readers share the lock, and writers are preferred so that appends are not starved by many readers
+class RWMutex { /*{{{*/
+ public:
+  RWMutex() {
+    pthread_rwlockattr_t attr;
+    pthread_rwlockattr_init(&attr);
+#if defined(__GLIBC__)
+    pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+    int ret = pthread_rwlock_init(&rwlock_, &attr);
+    assert(ret == 0);
+    pthread_rwlockattr_destroy(&attr);
+  }
+
+  ~RWMutex() { pthread_rwlock_destroy(&rwlock_); }
+
+ public:
+  void RLock() { /*{{{*/ pthread_rwlock_rdlock(&rwlock_); } /*}}}*/
+
+  void WLock() { /*{{{*/ pthread_rwlock_wrlock(&rwlock_); } /*}}}*/
+
+  void UnLock() { /*{{{*/ pthread_rwlock_unlock(&rwlock_); } /*}}}*/
+
+ private:
+  RWMutex(const RWMutex &);
+  RWMutex &operator=(const RWMutex &);
+
+ private:
+  pthread_rwlock_t rwlock_;
+}; /*}}}*/
+
+class ReadLock { /*{{{*/
+ public:
+  explicit ReadLock(RWMutex *mu) : mu_(mu) { mu_->RLock(); }
+
+  ~ReadLock() { mu_->UnLock(); }
+
+ private:
+  ReadLock(const ReadLock &);
+  ReadLock &operator=(const ReadLock &);
+
+ private:
+  RWMutex *mu_;
+}; /*}}}*/
+
+class WriteLock { /*{{{*/
+ public:
+  explicit WriteLock(RWMutex *mu) : mu_(mu) { mu_->WLock(); }
+
+  ~WriteLock() { mu_->UnLock(); }
+
+ private:
+  WriteLock(const WriteLock &);
+  WriteLock &operator=(const WriteLock &);
+
+ private:
+  RWMutex *mu_;
+}; /*}}}*/
+
 class Cond {
  public:
   Cond() {
-    int ret = pthread_cond_init(&cond_, NULL);
+    // NOTE:htt, Time::GetAbsTime() is based on CLOCK_MONOTONIC on linux, so is the cond
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+#if defined(__linux__)
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+#endif
+    int ret = pthread_cond_init(&cond_, &attr);
     assert(ret == 0);
+    pthread_condattr_destroy(&attr);
   }
 
   ~Cond() { pthread_cond_destroy(&cond_); }
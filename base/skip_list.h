@@ -47,6 +47,21 @@ class SkipList {
       return kOk;
     } /*}}}*/
 
+    // NOTE:htt, position at the first node whose key is not less than key, which is invalid if there is none
+    Code Seek(const KeyType &key) { /*{{{*/
+      if (skip_list_->head_ == NULL) return kNotInit;
+
+      Compare cmp = skip_list_->cmp_;  // NOTE:htt, copy since operator() of comparator may be non-const
+      SkipNode *cur = skip_list_->head_;
+      for (int level = skip_list_->max_height_ - 1; level >= 0; --level) {
+        while (cur->next[level] != NULL && cmp(cur->next[level]->key, key) < 0) {
+          cur = cur->next[level];
+        }
+      }
+      cur_node_ = cur->next[0];
+      return kOk;
+    } /*}}}*/
+
     Code GoNext() { /*{{{*/
       if (!Valid()) return kInvalidParam;
       cur_node_ = cur_node_->next[0];
@@ -59,6 +59,8 @@ enum Code { /*{{{*/
             kInconsistencyEventFd = 67,
             kWaitFailed = 68,
             kAlreadyExist = 69,
+            kIoUringSetupFailed = 70,
+            kIoUringFailed = 71,
 
             kCPUError = 91,
 
@@ -176,6 +178,7 @@ enum Code { /*{{{*/
             kFailedGetContext = 10103,
             kInvalidStatus = 10104,
             kFailedSwapContext = 10105,
+            kFailedAllocStack = 10106,
 
             kInvalidBitCaskFileName = 10201,
             kFilesNumIsFull = 10202,
@@ -183,6 +186,7 @@ enum Code { /*{{{*/
             kInvalidFileName = 10204,
             kKeySizeIsLarge = 10205,
             kTimeWrong = 10206,
+            kRemoveFileFailed = 10207,
 
             kRingEmpty = 10301,
 
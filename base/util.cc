@@ -11,6 +11,7 @@
 #include <string.h>
 #include <sys/resource.h>
 #include <sys/time.h>
+#include <unistd.h>
 
 #include <vector>
 
@@ -19,6 +20,42 @@
 
 namespace base {
 
+Code CreateListenFd(uint16_t port, bool is_reuse_port, int *listen_fd) { /*{{{*/
+  if (listen_fd == NULL) return kInvalidParam;
+
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd == -1) return kSocketError;
+
+  Code ret = SetFdReused(fd);
+  if (ret == kOk && is_reuse_port) ret = SetFdReusePort(fd);
+  if (ret == kOk) ret = SetFdNonblock(fd);
+  if (ret != kOk) {
+    close(fd);
+    return ret;
+  }
+
+  struct sockaddr_in serv_addr;
+  memset(&serv_addr, 0, sizeof(serv_addr));
+  serv_addr.sin_family = AF_INET;
+  serv_addr.sin_port = htons(port);
+  serv_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+
+  int r = bind(fd, (struct sockaddr *)(&serv_addr), sizeof(serv_addr));
+  if (r == -1) {
+    close(fd);
+    return kBindError;
+  }
+
+  r = listen(fd, kDefaultBacklog);
+  if (r == -1) {
+    close(fd);
+    return kListenError;
+  }
+
+  *listen_fd = fd;
+  return kOk;
+} /*}}}*/
+
 Code Trim(const std::string &in_cnt, char delim, std::string *out_cnt) { /*{{{*/
   std::string buf;
   Code ret = TrimLeft(in_cnt, delim, &buf);
@@ -6,6 +6,8 @@
 #define BASE_UTIL_H_
 
 #include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <stdint.h>
 #include <sys/socket.h>
 
@@ -19,8 +21,10 @@
 namespace base {
 
 inline Code SetFdNonblock(int fd) { /*{{{*/
-  int flags = fcntl(fd, F_GETFD);
-  int ret = fcntl(fd, F_SETFD, flags | O_NONBLOCK);
+  // NOTE:htt, O_NONBLOCK is a file status flag, which is set by F_SETFL instead of F_SETFD
+  int flags = fcntl(fd, F_GETFL);
+  if (flags == -1) return kFcntlFailed;
+  int ret = fcntl(fd, F_SETFL, flags | O_NONBLOCK);
   if (ret == -1) return kFcntlFailed;
 
   return kOk;
@@ -33,6 +37,32 @@ inline Code SetFdReused(int fd) { /*{{{*/
   return kOk;
 } /*}}}*/
 
+// NOTE:htt, disable Nagle, so small pipelined frames are not held until ack of the previous one
+inline Code SetFdNoDelay(int fd) { /*{{{*/
+  int opt = 1;
+  int ret = setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (void *)&opt, sizeof(int));
+  if (ret == -1) return kSetsockoptFailed;
+  return kOk;
+} /*}}}*/
+
+// NOTE:htt, several sockets bind the same port, and kernel spreads new connections over them
+inline Code SetFdReusePort(int fd) { /*{{{*/
+#if defined(SO_REUSEPORT)
+  int opt = 1;
+  int ret = setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, (void *)&opt, sizeof(int));
+  if (ret == -1) return kSetsockoptFailed;
+  return kOk;
+#else
+  return kNotSupportOS;
+#endif
+} /*}}}*/
+
+/**
+ * @brief create nonblock listening socket of INADDR_ANY:port
+ * @param is_reuse_port set SO_REUSEPORT, so every worker could listen the same port by its own socket
+ */
+Code CreateListenFd(uint16_t port, bool is_reuse_port, int *listen_fd);
+
 Code Trim(const std::string &in_cnt, char delim, std::string *out_cnt);
 Code Trim(const std::string &in_cnt, const std::string &delims, std::string *out_cnt);
 Code TrimLeft(const std::string &in_cnt, char delim, std::string *out_cnt);
@@ -0,0 +1,282 @@
+// Copyright (c) 2015 The CSUTIL Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/work_stealing_pool.h"
+
+#include <time.h>
+
+namespace base {
+
+// NOTE:htt, which pool and deque the current thread works for, so tasks submitted by tasks stay local
+static thread_local WorkStealingPool *g_cur_pool = NULL;
+static thread_local int g_cur_index = -1;
+static thread_local uint32_t g_steal_seed = 0;
+
+static uint64_t GetMonotonicUs() { /*{{{*/
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+} /*}}}*/
+
+static uint32_t NextStealRand() { /*{{{*/
+  // NOTE:htt, xorshift, which is enough to choose victims without lock
+  uint32_t x = g_steal_seed;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  g_steal_seed = x;
+  return x;
+} /*}}}*/
+
+WorkStealingPool::WorkStealingPool()
+    : core_threads_(0),
+      max_threads_(0),
+      keep_alive_ms_(kDefaultPoolKeepAliveMs),
+      workers_(),
+      pending_num_(0),
+      next_(0),
+      idle_num_(0),
+      threads_num_(0),
+      is_stop_(true) { /*{{{*/
+} /*}}}*/
+
+WorkStealingPool::~WorkStealingPool() { /*{{{*/
+  Stop();
+
+  for (size_t i = 0; i < workers_.size(); ++i) {
+    delete workers_[i];
+  }
+  workers_.clear();
+} /*}}}*/
+
+Code WorkStealingPool::Init(int core_threads, int max_threads, uint32_t keep_alive_ms) { /*{{{*/
+  if (core_threads <= 0) return kInvalidParam;
+  if (max_threads < core_threads) max_threads = core_threads;
+  if (!workers_.empty()) return kOk;
+
+  core_threads_ = core_threads;
+  max_threads_ = max_threads;
+  keep_alive_ms_ = keep_alive_ms;
+  for (int i = 0; i < max_threads_; ++i) {
+    workers_.push_back(new Worker());
+  }
+
+  MutexLock ml(&idle_mu_);
+  __atomic_store_n(&is_stop_, false, __ATOMIC_SEQ_CST);
+  for (int i = 0; i < core_threads_; ++i) {
+    Code ret = StartWorker(i);
+    if (ret != kOk) return ret;
+  }
+
+  return kOk;
+} /*}}}*/
+
+Code WorkStealingPool::StartWorker(int index) { /*{{{*/
+  WorkerParam *param = new WorkerParam();
+  param->pool = this;
+  param->index = index;
+
+  pthread_t tid;
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  int ret = pthread_create(&tid, &attr, WorkerThreadAction, param);
+  pthread_attr_destroy(&attr);
+  if (ret != 0) {
+    delete param;
+    return kPthreadCreateFailed;
+  }
+
+  workers_[index]->is_running = true;
+  __atomic_add_fetch(&threads_num_, 1, __ATOMIC_RELAXED);
+  return kOk;
+} /*}}}*/
+
+void *WorkStealingPool::WorkerThreadAction(void *param) { /*{{{*/
+  WorkerParam *worker_param = static_cast<WorkerParam *>(param);
+  WorkStealingPool *pool = worker_param->pool;
+  int index = worker_param->index;
+  delete worker_param;
+
+  g_cur_pool = pool;
+  g_cur_index = index;
+  g_steal_seed = (uint32_t)(GetMonotonicUs() ^ ((index + 1) * 2654435761u));
+  if (g_steal_seed == 0) g_steal_seed = 1;
+
+  pool->WorkerLoop(index);
+
+  g_cur_pool = NULL;
+  g_cur_index = -1;
+  return NULL;
+} /*}}}*/
+
+Code WorkStealingPool::Submit(const PoolTask &task) { /*{{{*/
+  if (workers_.empty()) return kNotInit;
+
+  // NOTE:htt, pending is reserved before stop is checked, and workers check stop before pending, so either
+  // Submit sees stop and the task is not queued, or every worker which sees stop waits the task to be executed
+  FetchAndAdd(&pending_num_, (uint32_t)1);
+  if (__atomic_load_n(&is_stop_, __ATOMIC_SEQ_CST)) {
+    FetchAndAdd(&pending_num_, (uint32_t)-1);
+    return kNotInit;
+  }
+
+  int index = 0;
+  if (g_cur_pool == this) {
+    index = g_cur_index;
+  } else {
+    index = FetchAndAdd(&next_, (uint32_t)1) % core_threads_;
+  }
+
+  PoolTaskItem item;
+  item.task = task;
+  item.enqueue_us = GetMonotonicUs();
+  {
+    Worker *worker = workers_[index];
+    MutexLock worker_ml(&worker->mu);
+    worker->tasks.push_back(std::move(item));
+  }
+
+  // NOTE:htt, idle_mu_ is only locked when some worker may sleep, which counts itself idle before checking pending
+  if (__atomic_load_n(&idle_num_, __ATOMIC_SEQ_CST) > 0) {
+    MutexLock ml(&idle_mu_);
+    idle_cond_.Signal();
+  }
+
+  // NOTE:htt, tasks piled up are more than threads, then add one more thread if allowed
+  int threads_num = __atomic_load_n(&threads_num_, __ATOMIC_RELAXED);
+  if (threads_num < max_threads_ && (int)GetPendingNum() > threads_num) {
+    MutexLock ml(&idle_mu_);
+    if (!is_stop_ && threads_num_ < max_threads_ && (int)GetPendingNum() > threads_num_) {
+      for (int i = core_threads_; i < max_threads_; ++i) {
+        if (workers_[i]->is_running) continue;
+        StartWorker(i);
+        break;
+      }
+    }
+  }
+  return kOk;
+} /*}}}*/
+
+bool WorkStealingPool::PopOrSteal(int index, PoolTaskItem *item, bool *is_stolen) { /*{{{*/
+  {
+    Worker *worker = workers_[index];
+    MutexLock ml(&worker->mu);
+    if (!worker->tasks.empty()) {
+      *item = std::move(worker->tasks.front());
+      worker->tasks.pop_front();
+      *is_stolen = false;
+      return true;
+    }
+  }
+
+  // NOTE:htt, start from a random victim, so thieves do not crowd on the same deque
+  int num = (int)workers_.size();
+  int start = NextStealRand() % num;
+  for (int i = 0; i < num; ++i) {
+    int victim = (start + i) % num;
+    if (victim == index) continue;
+
+    Worker *worker = workers_[victim];
+    MutexLock ml(&worker->mu);
+    if (worker->tasks.empty()) continue;
+    *item = std::move(worker->tasks.front());
+    worker->tasks.pop_front();
+    *is_stolen = true;
+    return true;
+  }
+
+  return false;
+} /*}}}*/
+
+void WorkStealingPool::RunTask(int index, PoolTaskItem *item, bool is_stolen) { /*{{{*/
+  FetchAndAdd(&pending_num_, (uint32_t)-1);
+
+  Worker *worker = workers_[index];
+  uint64_t queue_us = GetMonotonicUs() - item->enqueue_us;
+  __atomic_add_fetch(&worker->queue_us, queue_us, __ATOMIC_RELAXED);
+  if (queue_us > __atomic_load_n(&worker->max_queue_us, __ATOMIC_RELAXED)) {
+    __atomic_store_n(&worker->max_queue_us, queue_us, __ATOMIC_RELAXED);
+  }
+  if (is_stolen) __atomic_add_fetch(&worker->steal_num, 1, __ATOMIC_RELAXED);
+
+  item->task();
+  item->task = NULL;  // NOTE:htt, release captures in the worker thread
+  __atomic_add_fetch(&worker->exec_num, 1, __ATOMIC_RELAXED);
+} /*}}}*/
+
+void WorkStealingPool::WorkerLoop(int index) { /*{{{*/
+  while (true) {
+    PoolTaskItem item;
+    bool is_stolen = false;
+    if (PopOrSteal(index, &item, &is_stolen)) {
+      RunTask(index, &item, is_stolen);
+      continue;
+    }
+
+    MutexLock ml(&idle_mu_);
+    // NOTE:htt, idle is counted before pending is checked, and Submit increases pending before reading idle,
+    // so either the task is seen here or Submit signals under idle_mu_ after this thread waits
+    __atomic_add_fetch(&idle_num_, 1, __ATOMIC_SEQ_CST);
+    bool is_stop = __atomic_load_n(&is_stop_, __ATOMIC_SEQ_CST);
+    bool is_pending = __atomic_load_n(&pending_num_, __ATOMIC_SEQ_CST) > 0;
+    if (is_pending || is_stop) {
+      __atomic_sub_fetch(&idle_num_, 1, __ATOMIC_SEQ_CST);
+      if (is_pending) continue;
+      break;
+    }
+
+    Code ret = kOk;
+    if (index < core_threads_) {
+      ret = idle_cond_.Wait(idle_mu_);
+    } else {
+      ret = idle_cond_.TimeWait(idle_mu_, keep_alive_ms_);
+    }
+    __atomic_sub_fetch(&idle_num_, 1, __ATOMIC_SEQ_CST);
+
+    if (ret == kTimeOut && GetPendingNum() == 0) break;  // NOTE:htt, only threads above core wait with timeout
+  }
+
+  MutexLock ml(&idle_mu_);
+  workers_[index]->is_running = false;
+  if (__atomic_sub_fetch(&threads_num_, 1, __ATOMIC_RELAXED) == 0) exit_cond_.BroadCast();
+} /*}}}*/
+
+Code WorkStealingPool::Stop() { /*{{{*/
+  MutexLock ml(&idle_mu_);
+  __atomic_store_n(&is_stop_, true, __ATOMIC_SEQ_CST);
+  idle_cond_.BroadCast();
+  while (__atomic_load_n(&threads_num_, __ATOMIC_RELAXED) > 0) {
+    exit_cond_.Wait(idle_mu_);
+  }
+
+  return kOk;
+} /*}}}*/
+
+int WorkStealingPool::GetThreadsNum() { /*{{{*/
+  MutexLock ml(&idle_mu_);
+  return threads_num_;
+} /*}}}*/
+
+Code WorkStealingPool::GetWorkerStat(int index, PoolWorkerStat *stat) { /*{{{*/
+  if (stat == NULL) return kInvalidParam;
+  if (index < 0 || index >= (int)workers_.size()) return kInvalidParam;
+
+  Worker *worker = workers_[index];
+  stat->exec_num = __atomic_load_n(&worker->exec_num, __ATOMIC_RELAXED);
+  stat->steal_num = __atomic_load_n(&worker->steal_num, __ATOMIC_RELAXED);
+  stat->queue_us = __atomic_load_n(&worker->queue_us, __ATOMIC_RELAXED);
+  stat->max_queue_us = __atomic_exchange_n(&worker->max_queue_us, 0, __ATOMIC_RELAXED);
+  {
+    MutexLock ml(&worker->mu);
+    stat->depth = worker->tasks.size();
+  }
+  {
+    MutexLock ml(&idle_mu_);
+    stat->is_running = worker->is_running;
+  }
+  return kOk;
+} /*}}}*/
+
+}  // namespace base
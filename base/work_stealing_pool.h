@@ -0,0 +1,121 @@
+// Copyright (c) 2015 The CSUTIL Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BASE_WORK_STEALING_POOL_H_
+#define BASE_WORK_STEALING_POOL_H_
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include <deque>
+#include <functional>
+#include <vector>
+
+#include "base/mutex.h"
+#include "base/status.h"
+
+namespace base {
+
+typedef std::function<void()> PoolTask;
+
+const uint32_t kDefaultPoolKeepAliveMs = 60000;  // NOTE:htt, idle time before a thread above core threads exits
+
+struct PoolTaskItem { /*{{{*/
+  PoolTask task;
+  uint64_t enqueue_us;  // NOTE:htt, monotonic microseconds when submitted
+}; /*}}}*/
+
+// NOTE:htt, counters are accumulated since Init, except max_queue_us which is reset by every GetWorkerStat
+struct PoolWorkerStat { /*{{{*/
+  uint64_t exec_num;
+  uint64_t steal_num;     // NOTE:htt, tasks taken from other workers' deques
+  uint64_t queue_us;      // NOTE:htt, total time of tasks waiting in deques before executed
+  uint64_t max_queue_us;
+  uint32_t depth;         // NOTE:htt, tasks in the deque of this worker now
+  bool is_running;
+}; /*}}}*/
+
+/**
+ * NOTE:htt, WorkStealingPool runs tasks by threads which have their own deques:
+ * 1. task submitted by a worker thread is pushed into its own deque, and others are spread to core workers
+ * 2. worker takes tasks from its own deque first, then steals from random victims, so a slow task only
+ *    delays tasks of its deque until any idle worker steals them
+ * 3. core threads are started by Init and kept; if no thread is idle and tasks are piled up, threads are
+ *    added up to max_threads, and the added ones exit after idle for keep_alive_ms
+ *
+ * Deques are FIFO for both owner and thieves, since the oldest task should be served first for latency
+ */
+class WorkStealingPool { /*{{{*/
+ public:
+  WorkStealingPool();
+  ~WorkStealingPool();
+
+  Code Init(int core_threads, int max_threads, uint32_t keep_alive_ms = kDefaultPoolKeepAliveMs);
+
+  // NOTE:htt, thread safe, and kNotInit is returned after Stop, then the task is not queued or executed
+  Code Submit(const PoolTask &task);
+
+  // NOTE:htt, tasks submitted are all executed, then wait until all threads exit
+  Code Stop();
+
+ public:
+  int GetCoreThreadsNum() const { return core_threads_; }
+  int GetMaxThreadsNum() const { return max_threads_; }
+  int GetThreadsNum();
+  uint32_t GetPendingNum() const { return __atomic_load_n(&pending_num_, __ATOMIC_RELAXED); }
+
+  // NOTE:htt, index is in [0, GetMaxThreadsNum()), and workers above core threads may be not running
+  Code GetWorkerStat(int index, PoolWorkerStat *stat);
+
+ private:
+  struct Worker { /*{{{*/
+    Mutex mu;
+    std::deque<PoolTaskItem> tasks;
+    bool is_running;  // NOTE:htt, guarded by idle_mu_
+
+    uint64_t exec_num;
+    uint64_t steal_num;
+    uint64_t queue_us;
+    uint64_t max_queue_us;
+
+    Worker() : is_running(false), exec_num(0), steal_num(0), queue_us(0), max_queue_us(0) {}
+  }; /*}}}*/
+
+  struct WorkerParam { /*{{{*/
+    WorkStealingPool *pool;
+    int index;
+  }; /*}}}*/
+
+  static void *WorkerThreadAction(void *param);
+  void WorkerLoop(int index);
+  bool PopOrSteal(int index, PoolTaskItem *item, bool *is_stolen);
+  void RunTask(int index, PoolTaskItem *item, bool is_stolen);
+
+  // NOTE:htt, idle_mu_ should be held
+  Code StartWorker(int index);
+
+ private:
+  WorkStealingPool(const WorkStealingPool &);
+  WorkStealingPool &operator=(const WorkStealingPool &);
+
+ private:
+  int core_threads_;
+  int max_threads_;
+  uint32_t keep_alive_ms_;
+  std::vector<Worker *> workers_;
+
+  uint32_t pending_num_;  // NOTE:htt, tasks in all deques
+  uint32_t next_;         // NOTE:htt, round robin of core workers for tasks submitted outside
+
+  Mutex idle_mu_;
+  Cond idle_cond_;
+  Cond exit_cond_;
+  int idle_num_;     // NOTE:htt, changed under idle_mu_, and read atomically by Submit without the lock
+  int threads_num_;  // NOTE:htt, the same as idle_num_
+  bool is_stop_;     // NOTE:htt, changed under idle_mu_, and read atomically
+}; /*}}}*/
+
+}  // namespace base
+
+#endif
@@ -106,7 +106,7 @@ Code Client::Connect(const std::string &ip, uint16_t port)
     }
 
     int sock_err = 0;
-    socklen_t sock_err_len;
+    socklen_t sock_err_len = sizeof(sock_err);
     ret = getsockopt(client_fd_, SOL_SOCKET, SO_ERROR, (char*)&sock_err, &sock_err_len);
     if (ret == -1)
     {
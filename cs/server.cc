@@ -30,6 +30,7 @@ static void* WorkerThreadAction(void *param);
 static Code NotifyEventAction(int fd, int evt, void *param);
 static Code ClientEventAction(int fd, int evt, void *param);
 static Code AcceptEventAction(int fd, int evt, void *param);
+static Code WorkerAcceptEventAction(int fd, int evt, void *param);
 
 Code DefaultAction(const Config &conf, const std::string &in, std::string *out)
 {/*{{{*/
@@ -75,8 +76,15 @@ static Code AcceptEventAction(int fd, int evt, void *param)
     return ret;
 }
 
+static Code WorkerAcceptEventAction(int fd, int evt, void *param)
+{
+    Worker *worker = reinterpret_cast<Worker*>(param);
+    Code ret = worker->AcceptEventInternalAction(fd, evt);
+    return ret;
+}
+
 
-Worker::Worker(Server *server) : server_(server),
+Worker::Worker(Server *server) : server_(server), listen_fd_(-1),
     event_type_(server_->event_type_), worker_loop_(NULL), mu_(),
     flow_ctrl_(kDefaultFlowGridNum, kDefaultFlowUnitNum, server_->max_flow_)
 {/*{{{*/
@@ -96,6 +104,12 @@ Worker::~Worker()
         delete worker_loop_;
         worker_loop_ = NULL;
     }
+
+    if (listen_fd_ != -1)
+    {
+        close(listen_fd_);
+        listen_fd_ = -1;
+    }
 }/*}}}*/
 
 Code Worker::Init() 
@@ -114,6 +128,13 @@ Code Worker::Init()
     worker_loop_->Init(event_type_);
     worker_loop_->Add(notify_fds_[0], EV_IN, NotifyEventAction, this);
 
+    if (server_->is_reuse_port_)
+    {
+        r = CreateListenFd(server_->port_, true, &listen_fd_);
+        if (r != kOk) return r;
+        worker_loop_->Add(listen_fd_, EV_IN, WorkerAcceptEventAction, this);
+    }
+
     pthread_create(&worker_id_, NULL, WorkerThreadAction, this);
     return kOk;
 }/*}}}*/
@@ -131,7 +152,7 @@ Code Worker::AddClientFdAndNotify(int fd)
 
     char buf[1] = {'1'};
     int ret = write(notify_fds_[1], buf, sizeof(buf));
-    if (ret == -1) return kWriteError;
+    if (ret == -1 && errno != EAGAIN) return kWriteError; // NOTE:htt, all fds are taken per wakeup
 
     return kOk;
 }/*}}}*/
@@ -148,15 +169,8 @@ Code Worker::NotifyEventInternalAction(int fd)
     std::deque<int>::iterator it = cli_fds_.begin();
     while (it != cli_fds_.end())
     {
-        int client_fd = *it;
-        Conn *conn = new Conn;
-        conn->left_count = 0;
-        conn->fd = client_fd;
-        conn->conn_status = kConnCmd;
-        conns_.insert(std::make_pair(client_fd, conn));
-
-        worker_loop_->Add(client_fd, EV_IN, ClientEventAction, this);
-        
+        AddConn(*it);
+
         cli_fds_.pop_front();
         it = cli_fds_.begin();
     }
@@ -164,6 +178,51 @@ Code Worker::NotifyEventInternalAction(int fd)
     return kOk;
 }/*}}}*/
 
+/**
+ * Reuseport accept mode: the worker accepts on its own listening socket,
+ * so there is no hop of main thread; accept in bounded batch per wakeup
+ */
+Code Worker::AcceptEventInternalAction(int fd, int evt)
+{/*{{{*/
+    assert(fd == listen_fd_);
+    const int kMaxAcceptPerEvent = 64;
+
+    for (int i = 0; i < kMaxAcceptPerEvent; ++i)
+    {
+        struct sockaddr_in client_addr;
+        socklen_t client_addr_len = sizeof(client_addr);
+        int client_fd = accept(fd, (struct sockaddr*)(&client_addr), &client_addr_len);
+        if (client_fd == -1)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) break;
+            return kAcceptError;
+        }
+
+        Code r = SetFdReused(client_fd);
+        if (r == kOk) r = SetFdNonblock(client_fd);
+        if (r != kOk)
+        {
+            close(client_fd);
+            return r;
+        }
+
+        AddConn(client_fd);
+    }
+
+    return kOk;
+}/*}}}*/
+
+Code Worker::AddConn(int client_fd)
+{/*{{{*/
+    Conn *conn = new Conn;
+    conn->left_count = 0;
+    conn->fd = client_fd;
+    conn->conn_status = kConnCmd;
+    conns_.insert(std::make_pair(client_fd, conn));
+
+    return worker_loop_->Add(client_fd, EV_IN, ClientEventAction, this);
+}/*}}}*/
+
 Code Worker::ClientEventInternalAction(int fd, int evt)
 {/*{{{*/
     std::map<int, Conn*>::iterator it = conns_.find(fd);
@@ -410,6 +469,10 @@ Server::Server(const Config &conf, Action action) : conf_(conf), action_(action)
     serv_fd_ = -1;
     is_running_ = false;
 
+    std::string accept_mode;
+    ret = conf_.GetValue(kAcceptModeKey, &accept_mode);
+    is_reuse_port_ = (ret == kOk && accept_mode == kReusePortAcceptMode);
+
     ret = conf_.GetInt32Value(kThreadsNumKey, &workers_num_);
     if (ret != kOk) workers_num_ = kDefaultWorkersNum;
 
@@ -463,34 +526,26 @@ Code Server::Init()
 {/*{{{*/
     if (action_ == NULL) action_ = DefaultAction;
 
-    serv_fd_ = socket(AF_INET, SOCK_STREAM, 0);
-    if (serv_fd_ == -1) return kSocketError;
-
-    Code r = SetFdReused(serv_fd_);
-    if (r != kOk) return r;
-    r = SetFdNonblock(serv_fd_);
-    if (r != kOk) return r;
-
-    struct sockaddr_in serv_addr;
-    serv_addr.sin_family = AF_INET;
-    serv_addr.sin_port = htons(port_);
-    serv_addr.sin_addr.s_addr = htonl(INADDR_ANY);
-
-    int ret = bind(serv_fd_, (struct sockaddr*)(&serv_addr), sizeof(serv_addr));
-    if (ret == -1) return kBindError;
-
-    ret = listen(serv_fd_, kDefaultBacklog);
-
+    // In reuseport mode every worker listens by itself, and main loop is left idle
     main_loop_ = new EventLoop();
     main_loop_->Init(event_type_);
-    main_loop_->Add(serv_fd_, EV_IN, AcceptEventAction, this);
+    if (!is_reuse_port_)
+    {
+        Code r = CreateListenFd(port_, false, &serv_fd_);
+        if (r != kOk) return r;
+        main_loop_->Add(serv_fd_, EV_IN, AcceptEventAction, this);
+    }
 
     is_running_ = true;
     for (int i = 0; i < workers_num_; ++i)
     {
         Worker *worker = new Worker(this);
         Code r = worker->Init();
-        assert(r == kOk);
+        if (r != kOk)
+        {
+            delete worker;
+            return r;
+        }
         workers_.push_back(worker);
     }
 
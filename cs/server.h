@@ -65,9 +65,11 @@ class Worker
 
         Code AddClientFdAndNotify(int fd);
         Code NotifyEventInternalAction(int fd);
+        Code AcceptEventInternalAction(int fd, int evt);
         Code ClientEventInternalAction(int fd, int evt);
 
     private:
+        Code AddConn(int client_fd);
         Code CloseConn(Conn *conn);
 
     private:
@@ -78,6 +80,7 @@ class Worker
         Server *server_;
 
         int notify_fds_[2];
+        int listen_fd_;     // only used in reuseport accept mode
         EventType event_type_;
         EventLoop *worker_loop_;
 
@@ -114,6 +117,7 @@ class Server
         int serv_fd_;
 
         bool is_running_;
+        bool is_reuse_port_;    // see kAcceptModeKey
         int workers_num_;
         std::deque<Worker*> workers_;
 
@@ -0,0 +1,519 @@
+// Copyright (c) 2015 The CSUTIL Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sock/async_rpc_client.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "base/common.h"
+#include "base/log.h"
+#include "base/time.h"
+#include "base/util.h"
+
+namespace base {
+
+/****************************************
+ * RpcFuture: result of one async call
+ */
+RpcFuture::RpcFuture() : is_done_(false), ret_(kOk) { /*{{{*/
+} /*}}}*/
+
+RpcFuture::~RpcFuture() { /*{{{*/
+} /*}}}*/
+
+Code RpcFuture::Wait(std::string *user_response) { /*{{{*/
+  if (user_response == NULL) return kInvalidParam;
+
+  MutexLock ml(&mu_);
+  while (!is_done_) {
+    cond_.Wait(mu_);
+  }
+
+  user_response->swap(user_response_);
+  return ret_;
+} /*}}}*/
+
+Code RpcFuture::Wait(::google::protobuf::Message *response) { /*{{{*/
+  if (response == NULL) return kInvalidParam;
+
+  std::string user_response;
+  Code ret = Wait(&user_response);
+  if (ret != kOk) return ret;
+
+  if (!response->ParseFromString(user_response)) return kParseProtobufFailed;
+
+  return kOk;
+} /*}}}*/
+
+bool RpcFuture::IsDone() { /*{{{*/
+  MutexLock ml(&mu_);
+  return is_done_;
+} /*}}}*/
+
+void RpcFuture::Reset() { /*{{{*/
+  MutexLock ml(&mu_);
+  is_done_ = false;
+  ret_ = kOk;
+  user_response_.clear();
+} /*}}}*/
+
+void RpcFuture::DoneAction(Code ret, const std::string &user_response, void *param) { /*{{{*/
+  RpcFuture *future = static_cast<RpcFuture *>(param);
+
+  MutexLock ml(&future->mu_);
+  future->ret_ = ret;
+  future->user_response_ = user_response;
+  future->is_done_ = true;
+  future->cond_.Signal();
+} /*}}}*/
+
+/****************************************
+ * AsyncRpcClient: many outstanding calls on one connection
+ */
+AsyncRpcClient::AsyncRpcClient(const std::string &ip, uint16_t port)
+    : serv_ip_(ip),
+      serv_port_(port),
+      ev_(NULL),
+      max_wait_time_ms_(kDefaultMaxWaitTimeMs),
+      is_init_(false),
+      is_stop_(false),
+      client_fd_(-1),
+      client_evt_(0),
+      is_connecting_(false),
+      connect_deadline_ms_(0),
+      next_req_id_(1),
+      is_notified_(false) { /*{{{*/
+  notify_fds_[0] = -1;
+  notify_fds_[1] = -1;
+} /*}}}*/
+
+AsyncRpcClient::~AsyncRpcClient() { /*{{{*/
+  if (is_init_) {
+    __atomic_store_n(&is_stop_, true, __ATOMIC_RELEASE);
+    char buf[1] = {'1'};
+    write(notify_fds_[1], buf, sizeof(buf));
+    pthread_join(io_thread_id_, NULL);
+  }
+
+  // NOTE:htt, complete calls which are left, so no waiter of RpcFuture would hang
+  std::deque<DoneCall> done_calls;
+  CloseConnect(kConnError, &done_calls);
+  RunDoneCalls(&done_calls);
+
+  for (int i = 0; i < 2; ++i) {
+    if (notify_fds_[i] != -1) {
+      close(notify_fds_[i]);
+      notify_fds_[i] = -1;
+    }
+  }
+
+  if (ev_ != NULL) {
+    delete ev_;
+    ev_ = NULL;
+  }
+} /*}}}*/
+
+Code AsyncRpcClient::Init() { return Init(kEPoll); }
+
+Code AsyncRpcClient::Init(EventType evt_type) { /*{{{*/
+  if (is_init_) return kOk;
+  if (serv_ip_.empty() || serv_port_ == 0) return kIpOrPortNotInit;
+
+  switch (evt_type) {
+    case kEPoll:
+#if defined(__linux__)
+      ev_ = new EventEpoll();
+#else
+      ev_ = new EventPoll();
+#endif
+      break;
+    default:
+      ev_ = new EventPoll();
+      break;
+  }
+  Code ret = ev_->Create(kDefaultSizeOfFds);
+  if (ret != kOk) return ret;
+
+  int r = pipe(notify_fds_);
+  if (r != 0) return kPipeFailed;
+  ret = SetFdNonblock(notify_fds_[0]);
+  if (ret != kOk) return ret;
+  ret = SetFdNonblock(notify_fds_[1]);
+  if (ret != kOk) return ret;
+
+  ret = ev_->Add(notify_fds_[0], EV_IN);
+  if (ret != kOk) return ret;
+
+  ret = ConnectInternal();
+  if (ret != kOk) return ret;
+
+  r = pthread_create(&io_thread_id_, NULL, IoThreadAction, this);
+  if (r != 0) return kPthreadCreateFailed;
+
+  is_init_ = true;
+  return kOk;
+} /*}}}*/
+
+Code AsyncRpcClient::AsyncCall(const std::string &user_request, int timeout_ms, RpcDoneFunc done_func,
+                               void *param) { /*{{{*/
+  if (!is_init_) return kNotInit;
+  if (timeout_ms <= 0 || done_func == NULL) return kInvalidParam;
+
+  PendingCall call = {NowMs() + timeout_ms, done_func, param};
+  bool need_notify = false;
+  {
+    MutexLock ml(&mu_);
+    uint64_t req_id = next_req_id_++;
+    Code ret = FormatMultiplexUserData(req_id, user_request, &send_buf_);
+    if (ret != kOk) return ret;
+
+    pending_calls_.insert(std::make_pair(req_id, call));
+    deadlines_.insert(std::make_pair(call.deadline_ms, req_id));
+
+    // NOTE:htt, io thread takes the whole send_buf_ per wakeup, so only notify once before it wakes up
+    if (!is_notified_) {
+      is_notified_ = true;
+      need_notify = true;
+    }
+  }
+
+  if (need_notify) {
+    char buf[1] = {'1'};
+    int ret = write(notify_fds_[1], buf, sizeof(buf));
+    if (ret == -1 && errno != EAGAIN) {
+      LOG_ERR("Failed to notify io thread, errno:%d", errno);  // NOTE:htt, io thread still checks per wait time
+    }
+  }
+
+  return kOk;
+} /*}}}*/
+
+Code AsyncRpcClient::AsyncCall(const std::string &user_request, int timeout_ms, RpcFuture *future) { /*{{{*/
+  if (future == NULL) return kInvalidParam;
+
+  future->Reset();
+  return AsyncCall(user_request, timeout_ms, RpcFuture::DoneAction, future);
+} /*}}}*/
+
+Code AsyncRpcClient::AsyncCall(const ::google::protobuf::Message &request, int timeout_ms,
+                               RpcFuture *future) { /*{{{*/
+  std::string user_request;
+  if (!request.SerializeToString(&user_request)) return kSerializePBFailed;
+
+  return AsyncCall(user_request, timeout_ms, future);
+} /*}}}*/
+
+Code AsyncRpcClient::SendAndRecv(const std::string &user_request, std::string *user_response) { /*{{{*/
+  if (user_response == NULL) return kInvalidParam;
+
+  RpcFuture future;
+  Code ret = AsyncCall(user_request, max_wait_time_ms_, &future);
+  if (ret != kOk) return ret;
+
+  return future.Wait(user_response);
+} /*}}}*/
+
+Code AsyncRpcClient::SendAndRecv(const ::google::protobuf::Message &request,
+                                 ::google::protobuf::Message *response) { /*{{{*/
+  if (response == NULL) return kInvalidParam;
+
+  RpcFuture future;
+  Code ret = AsyncCall(request, max_wait_time_ms_, &future);
+  if (ret != kOk) return ret;
+
+  return future.Wait(response);
+} /*}}}*/
+
+Code AsyncRpcClient::SetMaxWaitTimeMs(int max_wait_time_ms) { /*{{{*/
+  if (max_wait_time_ms <= 0) return kInvalidParam;
+
+  max_wait_time_ms_ = max_wait_time_ms;
+  return kOk;
+} /*}}}*/
+
+uint32_t AsyncRpcClient::GetPendingNum() { /*{{{*/
+  MutexLock ml(&mu_);
+  return pending_calls_.size();
+} /*}}}*/
+
+void *AsyncRpcClient::IoThreadAction(void *arg) { /*{{{*/
+  AsyncRpcClient *client = static_cast<AsyncRpcClient *>(arg);
+  client->IoLoop();
+
+  return NULL;
+} /*}}}*/
+
+void AsyncRpcClient::IoLoop() { /*{{{*/
+  std::deque<DoneCall> done_calls;
+
+  while (!__atomic_load_n(&is_stop_, __ATOMIC_ACQUIRE)) {
+    Code ret = ev_->Wait(kDefaultWaitTimeMs);
+    while (ret == kOk) {
+      int fd = -1;
+      int evt = 0;
+      ret = ev_->GetEvents(&fd, &evt);
+      if (ret != kOk) break;
+
+      if (fd == notify_fds_[0]) {
+        char buf[kBufLen];
+        while (read(notify_fds_[0], buf, sizeof(buf)) > 0) {
+        }
+        continue;
+      }
+      if (fd != client_fd_) continue;
+
+      if (is_connecting_) {
+        Code r = FinishConnect();
+        if (r != kOk) CloseConnect(r, &done_calls);
+        continue;
+      }
+
+      // NOTE:htt, read before checking hup, so responses which have arrived are not lost
+      if (evt & EV_IN) {
+        Code r = ReadInternal(&done_calls);
+        if (r != kOk) CloseConnect(r, &done_calls);
+      } else if ((evt & EV_ERR) || (evt & EV_HUP)) {
+        CloseConnect(kSocketError, &done_calls);
+      }
+    }
+
+    {
+      MutexLock ml(&mu_);
+      is_notified_ = false;
+      if (out_buf_.empty()) {
+        out_buf_.swap(send_buf_);
+      } else {
+        out_buf_.append(send_buf_);
+        send_buf_.clear();
+      }
+    }
+
+    // NOTE:htt, data is kept in out_buf_ until connect is finished by EV_OUT
+    if (!out_buf_.empty()) {
+      Code r = kOk;
+      if (client_fd_ == -1) r = ConnectInternal();
+      if (r == kOk && !is_connecting_) r = WriteInternal();
+      if (r != kOk) CloseConnect(r, &done_calls);
+    }
+    if (is_connecting_ && NowMs() >= connect_deadline_ms_) CloseConnect(kTimeOut, &done_calls);
+
+    CheckDeadline(&done_calls);
+    RunDoneCalls(&done_calls);
+  }
+} /*}}}*/
+
+Code AsyncRpcClient::ConnectInternal() { /*{{{*/
+  struct sockaddr_in serv_addr;
+  memset(&serv_addr, 0, sizeof(serv_addr));
+  serv_addr.sin_family = AF_INET;
+  serv_addr.sin_port = htons(serv_port_);
+  int ret = inet_pton(AF_INET, serv_ip_.c_str(), &(serv_addr.sin_addr));
+  if (ret != 1) return kInvalidIp;
+
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd == -1) return kSocketError;
+  Code r = SetFdNonblock(fd);
+  if (r != kOk) {
+    close(fd);
+    return r;
+  }
+
+  r = SetFdNoDelay(fd);
+  if (r != kOk) {
+    close(fd);
+    return r;
+  }
+
+  do {
+    ret = connect(fd, (struct sockaddr *)(&serv_addr), sizeof(serv_addr));
+  } while (ret == -1 && errno == EINTR);
+
+  // NOTE:htt, connect in progress is finished by EV_OUT in IoLoop, so IO thread is never blocked by it
+  bool is_connecting = false;
+  if (ret == -1) {
+    if (errno != EINPROGRESS && errno != EAGAIN) {
+      close(fd);
+      return kConnectError;
+    }
+    is_connecting = true;
+  }
+
+  int evt = is_connecting ? EV_OUT : EV_IN;
+  r = ev_->Add(fd, evt);
+  if (r != kOk) {
+    close(fd);
+    return r;
+  }
+
+  client_fd_ = fd;
+  client_evt_ = evt;
+  is_connecting_ = is_connecting;
+  connect_deadline_ms_ = NowMs() + max_wait_time_ms_;
+  recv_buf_.clear();
+
+  return kOk;
+} /*}}}*/
+
+Code AsyncRpcClient::FinishConnect() { /*{{{*/
+  int sock_err = 0;
+  socklen_t sock_err_len = sizeof(sock_err);
+  int ret = getsockopt(client_fd_, SOL_SOCKET, SO_ERROR, &sock_err, &sock_err_len);
+  if (ret == -1 || sock_err != 0) return kConnectError;
+
+  // NOTE:htt, EV_OUT is added back by WriteInternal only when socket buffer is full
+  Code r = ev_->Mod(client_fd_, EV_IN);
+  if (r != kOk) return r;
+
+  client_evt_ = EV_IN;
+  is_connecting_ = false;
+  return kOk;
+} /*}}}*/
+
+Code AsyncRpcClient::WriteInternal() { /*{{{*/
+  size_t pos = 0;
+  while (pos < out_buf_.size()) {
+    int ret = write(client_fd_, out_buf_.data() + pos, out_buf_.size() - pos);
+    if (ret == -1 && errno == EINTR) continue;
+    if (ret == -1 && errno == EAGAIN) break;
+    if (ret <= 0) {
+      LOG_ERR("Failed to write fd:%d, ret:%d, errno:%d", client_fd_, ret, errno);
+      return kSocketError;
+    }
+    pos += ret;
+  }
+  out_buf_.erase(0, pos);
+
+  // NOTE:htt, only wait for EV_OUT when socket buffer is full
+  int evt = out_buf_.empty() ? EV_IN : (EV_IN | EV_OUT);
+  if (evt != client_evt_) {
+    Code r = ev_->Mod(client_fd_, evt);
+    if (r != kOk) return r;
+    client_evt_ = evt;
+  }
+
+  return kOk;
+} /*}}}*/
+
+Code AsyncRpcClient::ReadInternal(std::deque<DoneCall> *done_calls) { /*{{{*/
+  bool is_closed = false;
+  while (true) {
+    char buf[kBufLen];
+    int ret = read(client_fd_, buf, sizeof(buf));
+    if (ret == -1 && errno == EINTR) continue;
+    if (ret == -1 && errno == EAGAIN) break;
+    if (ret <= 0) {
+      is_closed = true;
+      break;
+    }
+    recv_buf_.append(buf, ret);
+  }
+
+  int pos = 0;
+  while (pos < static_cast<int>(recv_buf_.size())) {
+    int real_len = 0;
+    Code r = DefaultProtoFunc(recv_buf_.data() + pos, recv_buf_.size() - pos, &real_len);
+    if (r == kDataNotEnough) break;
+    if (r != kOk) return r;
+
+    r = DealWithResponse(recv_buf_.data() + pos, real_len, done_calls);
+    if (r != kOk) return r;
+    pos += real_len;
+  }
+  recv_buf_.erase(0, pos);
+
+  return is_closed ? kSocketError : kOk;
+} /*}}}*/
+
+Code AsyncRpcClient::DealWithResponse(const char *data, int len, std::deque<DoneCall> *done_calls) { /*{{{*/
+  // NOTE:htt, server which only knows old framing replies kFrameInvalidMagic without request id
+  if (!IsMultiplexFrame(data, len)) return kFrameInvalidMagic;
+
+  uint64_t req_id = 0;
+  std::string user_response;
+  Code ret = GetMultiplexUserData(data, len, &req_id, &user_response);
+  if (ret != kOk && !IsFrameError(static_cast<uint32_t>(ret))) return ret;
+
+  MutexLock ml(&mu_);
+  std::map<uint64_t, PendingCall>::iterator it = pending_calls_.find(req_id);
+  if (it == pending_calls_.end()) return kOk;  // NOTE:htt, call has been timeout
+
+  done_calls->push_back(DoneCall());
+  DoneCall &done_call = done_calls->back();
+  done_call.ret = ret;
+  done_call.user_response.swap(user_response);
+  done_call.done_func = it->second.done_func;
+  done_call.param = it->second.param;
+
+  deadlines_.erase(std::make_pair(it->second.deadline_ms, req_id));
+  pending_calls_.erase(it);
+
+  return kOk;
+} /*}}}*/
+
+void AsyncRpcClient::CloseConnect(Code ret, std::deque<DoneCall> *done_calls) { /*{{{*/
+  if (client_fd_ != -1) {
+    LOG_ERR("Close connection of %s:%u, fd:%d, ret:%d", serv_ip_.c_str(), serv_port_, client_fd_, ret);
+    ev_->Del(client_fd_);
+    close(client_fd_);
+    client_fd_ = -1;
+    client_evt_ = 0;
+  }
+  is_connecting_ = false;
+  out_buf_.clear();
+  recv_buf_.clear();
+
+  MutexLock ml(&mu_);
+  std::map<uint64_t, PendingCall>::iterator it = pending_calls_.begin();
+  for (; it != pending_calls_.end(); ++it) {
+    done_calls->push_back(DoneCall());
+    done_calls->back().ret = ret;
+    done_calls->back().done_func = it->second.done_func;
+    done_calls->back().param = it->second.param;
+  }
+  pending_calls_.clear();
+  deadlines_.clear();
+  send_buf_.clear();
+} /*}}}*/
+
+void AsyncRpcClient::CheckDeadline(std::deque<DoneCall> *done_calls) { /*{{{*/
+  uint64_t now_ms = NowMs();
+
+  MutexLock ml(&mu_);
+  while (!deadlines_.empty() && deadlines_.begin()->first <= now_ms) {
+    uint64_t req_id = deadlines_.begin()->second;
+    deadlines_.erase(deadlines_.begin());
+
+    std::map<uint64_t, PendingCall>::iterator it = pending_calls_.find(req_id);
+    if (it == pending_calls_.end()) continue;
+
+    done_calls->push_back(DoneCall());
+    done_calls->back().ret = kTimeOut;
+    done_calls->back().done_func = it->second.done_func;
+    done_calls->back().param = it->second.param;
+    pending_calls_.erase(it);
+  }
+} /*}}}*/
+
+void AsyncRpcClient::RunDoneCalls(std::deque<DoneCall> *done_calls) { /*{{{*/
+  while (!done_calls->empty()) {
+    DoneCall &done_call = done_calls->front();
+    done_call.done_func(done_call.ret, done_call.user_response, done_call.param);
+    done_calls->pop_front();
+  }
+} /*}}}*/
+
+uint64_t AsyncRpcClient::NowMs() { /*{{{*/
+  struct timeval tm;
+  Code ret = Time::GetTime(&tm);
+  if (ret != kOk) return 0;
+
+  return static_cast<uint64_t>(tm.tv_sec) * 1000 + static_cast<uint64_t>(tm.tv_usec) / 1000;
+} /*}}}*/
+
+}  // namespace base
@@ -0,0 +1,183 @@
+// Copyright (c) 2015 The CSUTIL Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SOCK_ASYNC_RPC_CLIENT_H_
+#define SOCK_ASYNC_RPC_CLIENT_H_
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include <google/protobuf/message.h>
+
+#include <deque>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+
+#include "base/event.h"
+#include "base/mutex.h"
+#include "base/status.h"
+#include "sock/rpc_proto.h"
+
+namespace base {
+
+/**
+ * @brief 异步调用完成回调，在 AsyncRpcClient 的 IO 线程中执行，不应阻塞
+ * @param ret kOk 成功；kTimeOut 超过截止时间；kSocketError 等连接错误；框架错误码(700-799)
+ * @param user_response 响应的用户数据，ret 非 kOk 时为空
+ * @param param 调用 AsyncCall 时传入的参数
+ */
+typedef void (*RpcDoneFunc)(Code ret, const std::string &user_response, void *param);
+
+/**
+ * @brief 异步调用的结果，AsyncCall 返回 kOk 后 IO 线程保证在截止时间内完成它
+ *        同一个 RpcFuture 在完成前不能被再次用于 AsyncCall，也不能被析构
+ */
+class RpcFuture { /*{{{*/
+ public:
+  RpcFuture();
+  ~RpcFuture();
+
+ public:
+  /**
+   * @brief 等待调用完成并获取响应
+   * @param user_response 输出参数，响应的用户数据
+   * @return 同 RpcDoneFunc 的 ret
+   */
+  Code Wait(std::string *user_response);
+
+  /**
+   * @brief 等待调用完成并反序列化响应
+   * @return 同 RpcDoneFunc 的 ret；kParseProtobufFailed 反序列化失败
+   */
+  Code Wait(::google::protobuf::Message *response);
+
+  bool IsDone();
+
+  // NOTE:htt, reset before being reused by AsyncCall
+  void Reset();
+
+ private:
+  static void DoneAction(Code ret, const std::string &user_response, void *param);
+
+ private:
+  Mutex mu_;
+  Cond cond_;
+  bool is_done_;
+  Code ret_;
+  std::string user_response_;
+
+ private:
+  RpcFuture(const RpcFuture &);
+  RpcFuture &operator=(const RpcFuture &);
+
+  friend class AsyncRpcClient;
+}; /*}}}*/
+
+/**
+ * @brief 多路复用异步 RPC 客户端：一条 TCP 连接上同时保持多个未完成调用
+ *
+ * 使用多路复用协议（见 IsMultiplexFrame），每个调用分配 64 位 ReqId，服务端乱序返回，按 ReqId 匹配；
+ * 调用方线程只负责封包入队，由内部 IO 线程负责连接、收发、截止时间检查和回调，
+ * 连接断开时所有未完成调用以错误码完成，下一次有数据待发送时自动重连。线程安全。
+ */
+class AsyncRpcClient { /*{{{*/
+ public:
+  AsyncRpcClient(const std::string &ip, uint16_t port);
+  ~AsyncRpcClient();
+
+  Code Init();
+  Code Init(EventType evt_type);
+
+  /**
+   * @brief 发起一次异步调用
+   * @param user_request 请求的用户数据
+   * @param timeout_ms 截止时间（毫秒），超过后以 kTimeOut 完成，须 > 0
+   * @param done_func 完成回调，每个调用恰好回调一次
+   * @param param 回调参数
+   * @return kOk 已入队；kNotInit 未初始化；kInvalidParam 参数无效
+   */
+  Code AsyncCall(const std::string &user_request, int timeout_ms, RpcDoneFunc done_func, void *param);
+  Code AsyncCall(const std::string &user_request, int timeout_ms, RpcFuture *future);
+  Code AsyncCall(const ::google::protobuf::Message &request, int timeout_ms, RpcFuture *future);
+
+  /**
+   * @brief 同步调用，截止时间为 max_wait_time_ms_，多个线程可共享同一条连接并发调用
+   */
+  Code SendAndRecv(const std::string &user_request, std::string *user_response);
+  Code SendAndRecv(const ::google::protobuf::Message &request, ::google::protobuf::Message *response);
+
+  /**
+   * @brief 设置同步调用的截止时间和建连超时时间（毫秒）
+   * @return kOk 成功；kInvalidParam 参数无效（<= 0）
+   */
+  Code SetMaxWaitTimeMs(int max_wait_time_ms);
+
+  // NOTE:htt, number of calls which are not completed
+  uint32_t GetPendingNum();
+
+ private:
+  struct PendingCall { /*{{{*/
+    uint64_t deadline_ms;
+    RpcDoneFunc done_func;
+    void *param;
+  }; /*}}}*/
+
+  struct DoneCall { /*{{{*/
+    Code ret;
+    std::string user_response;
+    RpcDoneFunc done_func;
+    void *param;
+  }; /*}}}*/
+
+  static void *IoThreadAction(void *arg);
+  void IoLoop();
+
+  // NOTE:htt, start connecting without blocking, and FinishConnect is called when the fd is writable
+  Code ConnectInternal();
+  Code FinishConnect();
+  Code WriteInternal();
+  Code ReadInternal(std::deque<DoneCall> *done_calls);
+  Code DealWithResponse(const char *data, int len, std::deque<DoneCall> *done_calls);
+
+  // NOTE:htt, close connection and complete all pending calls with ret
+  void CloseConnect(Code ret, std::deque<DoneCall> *done_calls);
+  void CheckDeadline(std::deque<DoneCall> *done_calls);
+  void RunDoneCalls(std::deque<DoneCall> *done_calls);
+
+  static uint64_t NowMs();
+
+ private:
+  std::string serv_ip_;
+  uint16_t serv_port_;
+  Event *ev_;
+  int notify_fds_[2];
+  int max_wait_time_ms_;
+  bool is_init_;
+  bool is_stop_;
+  pthread_t io_thread_id_;
+
+  // NOTE:htt, only used by io thread
+  int client_fd_;
+  int client_evt_;
+  bool is_connecting_;
+  uint64_t connect_deadline_ms_;  // NOTE:htt, calls fail with kTimeOut if connect is not finished before it
+  std::string out_buf_;
+  std::string recv_buf_;
+
+  Mutex mu_;  // NOTE:htt, guard members below
+  uint64_t next_req_id_;
+  std::string send_buf_;
+  bool is_notified_;
+  std::map<uint64_t, PendingCall> pending_calls_;
+  std::set<std::pair<uint64_t, uint64_t> > deadlines_;  // NOTE:htt, <deadline_ms, req_id>
+
+ private:
+  AsyncRpcClient(const AsyncRpcClient &);
+  AsyncRpcClient &operator=(const AsyncRpcClient &);
+}; /*}}}*/
+
+}  // namespace base
+#endif  // SOCK_ASYNC_RPC_CLIENT_H_
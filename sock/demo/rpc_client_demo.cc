@@ -9,27 +9,67 @@
 #include <stdlib.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <string>
+#include <vector>
 
+#include "base/common.h"
 #include "base/status.h"
+#include "sock/async_rpc_client.h"
 #include "sock/demo_multi/proto/demo_multi.pb.h"
 
 void Help(const std::string &program) { /*{{{*/
   fprintf(stderr,
           "Usage: %s [Option]\n"
-          "  [-i ip] [-p port] [-n count]\n\n",
+          "  [-i ip] [-p port] [-n count] [-a async_depth]\n\n",
           program.c_str());
 } /*}}}*/
 
+int AsyncCallDemo(const std::string &ip, uint16_t port, int32_t count, int32_t async_depth) { /*{{{*/
+  using namespace base;
+
+  AsyncRpcClient rpc_client(ip, port);
+  Code ret = rpc_client.Init();
+  assert(ret == kOk);
+
+  std::vector<RpcFuture> futures(async_depth);
+  for (int32_t begin = 0; begin < count; begin += async_depth) {
+    int32_t end = std::min(begin + async_depth, count);
+    for (int32_t i = begin; i < end; ++i) {
+      demo_multi::ClientReq req;
+      req.set_message("hello world " + std::to_string(i));
+      req.set_index(i);
+
+      ret = rpc_client.AsyncCall(req, kDefaultMaxWaitTimeMs, &futures[i - begin]);
+      assert(ret == kOk);
+    }
+
+    for (int32_t i = begin; i < end; ++i) {
+      demo_multi::ClientResp resp;
+      ret = futures[i - begin].Wait(&resp);
+      if (ret != kOk) {
+        fprintf(stderr, "[%d] AsyncCall failed, ret:%d\n", i, ret);
+        continue;
+      }
+
+      fprintf(stderr, "[%d] ret_code:%d, ret_msg:%s, message:%s\n", i, resp.base().ret_code(),
+              resp.base().ret_msg().c_str(), resp.message().c_str());
+    }
+  }
+
+  return 0;
+} /*}}}*/
+
 int main(int argc, char *argv[]) { /*{{{*/
   using namespace base;
 
   std::string ip("127.0.0.1");
   uint16_t port = 9090;
   int32_t count = 4;
+  int32_t async_depth = 0;  // NOTE:htt, > 0 means keeping async_depth outstanding calls on one connection
 
   int32_t opt = 0;
-  while ((opt = getopt(argc, argv, "i:p:n:h")) != -1) {
+  while ((opt = getopt(argc, argv, "i:p:n:a:h")) != -1) {
     switch (opt) {
       case 'i':
         ip = optarg;
@@ -40,6 +80,9 @@ int main(int argc, char *argv[]) { /*{{{*/
       case 'n':
         count = atoi(optarg);
         break;
+      case 'a':
+        async_depth = atoi(optarg);
+        break;
       case 'h':
         Help(argv[0]);
         return 0;
@@ -51,6 +94,8 @@ int main(int argc, char *argv[]) { /*{{{*/
 
   fprintf(stderr, "Start to connect ip:port <%s, %d>, count:%d\n", ip.c_str(), port, count);
 
+  if (async_depth > 0) return AsyncCallDemo(ip, port, count, async_depth);
+
   RpcClient rpc_client(ip, port);
   Code ret = rpc_client.Init();
   assert(ret == kOk);
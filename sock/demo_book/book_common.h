@@ -27,6 +27,7 @@ const char kDbPathKey[] = "db_path";
 // LRU Cache DAO 配置键名（cache_user_info.conf）
 const char kCacheMaxNumKey[] = "max_num";
 const char kCacheTimeIntervalKey[] = "time_interval";
+const char kCacheShardsNumKey[] = "shards_num";
 
 // 业务通用返回码（写入 BaseResp.ret_code）
 const int32_t kBookRetOk = 0;
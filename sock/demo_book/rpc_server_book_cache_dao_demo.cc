@@ -15,10 +15,10 @@
 #include "base/status.h"
 #include "sock/demo_book/book_common.h"
 #include "sock/demo_book/proto/book.pb.h"
-#include "store/cache/lru_cache/src/lru_cache.h"
+#include "store/cache/lru_cache/src/sharded_lru_cache.h"
 
-// LRU Cache DAO 进程内的全局缓存
-static store::LRUCache g_cache;
+// LRU Cache DAO 进程内的全局缓存，按 key 哈希分片，各分片独立加锁
+static store::ShardedLRUCache g_cache;
 
 void Help(const std::string &program) { /*{{{*/
   fprintf(stderr,
@@ -174,15 +174,18 @@ int main(int argc, char *argv[]) { /*{{{*/
 
   int max_num = 0;
   int time_interval = 0;
+  int shards_num = store::kDefaultLRUShardsNum;
   user_conf.GetInt32Value(book_mgr::kCacheMaxNumKey, &max_num);
   user_conf.GetInt32Value(book_mgr::kCacheTimeIntervalKey, &time_interval);
+  user_conf.GetInt32Value(book_mgr::kCacheShardsNumKey, &shards_num);
 
-  ret = g_cache.Init((uint32_t)max_num, (uint32_t)time_interval);
+  ret = g_cache.Init((uint32_t)max_num, (uint32_t)time_interval, (uint32_t)shards_num);
   if (ret != kOk) {
     LOG_ERR("Failed to init lru cache, ret:%d\n", ret);
     return ret;
   }
-  fprintf(stderr, "lru cache inited: max_num=%d, time_interval=%d\n", max_num, time_interval);
+  fprintf(stderr, "lru cache inited: max_num=%d, time_interval=%d, shards_num=%u\n", max_num, time_interval,
+          g_cache.GetShardsNum());
 
   book_mgr::BookReq req_prototype;
   book_mgr::BookResp resp_prototype;
@@ -6,6 +6,7 @@
 
 #include <map>
 
+#include "base/co_scheduler.h"
 #include "sock/rpc_conn_pool.h"
 
 namespace base {
@@ -20,6 +21,10 @@ RpcChannel::RpcChannel(const std::string &ip, uint16_t port)
 } /*}}}*/
 
 RpcChannel::~RpcChannel() { /*{{{*/
+  for (size_t i = 0; i < co_idle_clients_.size(); ++i) {
+    delete co_idle_clients_[i];
+  }
+  co_idle_clients_.clear();
 } /*}}}*/
 
 RpcChannel *RpcChannel::Get(const std::string &ip, uint16_t port) { /*{{{*/
@@ -40,6 +45,9 @@ Code RpcChannel::SendAndRecv(const ::google::protobuf::Message &req,
                              ::google::protobuf::Message *resp) { /*{{{*/
   if (resp == NULL) return kInvalidParam;
 
+  // 协程中：同线程的协程各自借用独占连接
+  if (CoScheduler::Current() != NULL) return SendInCoroutine(req, resp);
+
   // 方案B：从共享连接池借/还
   if (g_pool_mode) return SendViaPool(req, resp);
 
@@ -62,6 +70,32 @@ Code RpcChannel::SendViaPool(const ::google::protobuf::Message &req,
   return ret;
 } /*}}}*/
 
+Code RpcChannel::SendInCoroutine(const ::google::protobuf::Message &req,
+                                 ::google::protobuf::Message *resp) { /*{{{*/
+  RpcClient *client = NULL;
+  if (!co_idle_clients_.empty()) {
+    client = co_idle_clients_.back();
+    co_idle_clients_.pop_back();
+  } else {
+    client = new RpcClient(ip_, port_);
+    Code ret = client->Init();  // 在协程中 connect，等待时只挂起当前协程
+    if (ret != kOk && !IsConnError(ret)) {
+      delete client;
+      return ret;
+    }
+    if (timeout_ms_ != kTimeoutUnset) client->SetMaxWaitTimeMs(timeout_ms_);
+  }
+
+  bool broken = false;
+  Code ret = SendOnClient(client, req, resp, &broken);
+  if (broken) {
+    delete client;
+  } else {
+    co_idle_clients_.push_back(client);
+  }
+  return ret;
+} /*}}}*/
+
 Code RpcChannel::SendOnClient(RpcClient *client, const ::google::protobuf::Message &req,
                               ::google::protobuf::Message *resp, bool *broken) { /*{{{*/
   Code ret = client->SendAndRecv(req, resp);
@@ -95,6 +129,9 @@ Code RpcChannel::SetTimeoutMs(int ms) { /*{{{*/
   if (ms < -1) return kInvalidParam;
 
   timeout_ms_ = ms;
+  for (size_t i = 0; i < co_idle_clients_.size(); ++i) {
+    co_idle_clients_[i]->SetMaxWaitTimeMs(ms);
+  }
   if (inited_) return client_.SetMaxWaitTimeMs(ms);
   return kOk;
 } /*}}}*/
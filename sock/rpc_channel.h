@@ -10,6 +10,7 @@
 #include <google/protobuf/message.h>
 
 #include <string>
+#include <vector>
 
 #include "base/status.h"
 #include "sock/rpc_client.h"
@@ -23,6 +24,10 @@ namespace base {
  * 用完不关；当连接断开（对端关闭、超时、读写错误）时自动重连并重试一次。
  * 业务 handler 仅需调用 RpcChannel::Get(ip, port)->SendAndRecv(req, &resp)，
  * 无需感知连接建立/复用/重连等细节，避免 connect-per-request 导致的 TIME_WAIT 堆积。
+ *
+ * 在 CoScheduler 的协程中调用时，同一线程的多个协程会并发使用同一个通道，
+ * 因此每次调用从通道的空闲连接中借一条独占使用、用完归还（不够则新建），
+ * 等待网络时只挂起当前协程；此时不使用方案B连接池，避免池满等待阻塞整个线程。
  */
 class RpcChannel { /*{{{*/
  public:
@@ -44,7 +49,7 @@ class RpcChannel { /*{{{*/
 
   /**
    * @brief 设置收发超时时间（毫秒），-1 表示永久等待；不调用则沿用框架默认值
-   *        仅对方案A（线程局部长连接）模式生效
+   *        仅对方案A（线程局部长连接）及协程模式生效
    * @param ms 超时毫秒数
    * @return kOk 成功；kInvalidParam 参数无效
    */
@@ -101,12 +106,18 @@ class RpcChannel { /*{{{*/
   static Code SendOnClient(RpcClient *client, const ::google::protobuf::Message &req,
                            ::google::protobuf::Message *resp, bool *broken);
 
+  /**
+   * @brief 协程模式：借一条空闲连接完成一次收发，用完归还（坏连接直接释放）
+   */
+  Code SendInCoroutine(const ::google::protobuf::Message &req, ::google::protobuf::Message *resp);
+
  private:
   std::string ip_;
   uint16_t port_;
   int timeout_ms_;  // kTimeoutUnset 表示未设置，沿用框架默认
   bool inited_;
   RpcClient client_;
+  std::vector<RpcClient *> co_idle_clients_;  // 协程模式下的空闲连接
 }; /*}}}*/
 
 }  // namespace base
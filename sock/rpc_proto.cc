@@ -56,6 +56,21 @@ Code DefaultProtoFunc(const char *src_data, int src_data_len, int *real_len) { /
 Code DefaultGetUserDataFunc(const char *src_data, int src_data_len, std::string *user_data) { /*{{{*/
   if (src_data == NULL || src_data_len < 0 || user_data == NULL) return kInvalidParam;
 
+  int user_data_offset = 0;
+  Code r = DefaultGetUserDataOffset(src_data, src_data_len, &user_data_offset);
+  if (r != kOk) return r;
+
+  user_data->assign(src_data + user_data_offset, src_data_len - user_data_offset);
+
+  return kOk;
+} /*}}}*/
+
+/**
+ * @brief 校验完整包并返回用户数据在包内的偏移，用户数据为 [offset, src_data_len)，不拷贝
+ */
+Code DefaultGetUserDataOffset(const char *src_data, int src_data_len, int *user_data_offset) { /*{{{*/
+  if (src_data == NULL || src_data_len < 0 || user_data_offset == NULL) return kInvalidParam;
+
   if (src_data_len < (kHeadLen + kExtHeadLen)) return kInvalidData;
 
   // 解码 Head，获取 payload 长度
@@ -83,9 +98,7 @@ Code DefaultGetUserDataFunc(const char *src_data, int src_data_len, std::string
     return (Code)frame_code;
   }
 
-  // 提取 UserData
-  uint32_t user_data_len = len - kExtHeadLen;
-  user_data->assign(src_data + kHeadLen + kExtHeadLen, user_data_len);
+  *user_data_offset = kHeadLen + kExtHeadLen;
 
   return kOk;
 } /*}}}*/
@@ -105,8 +118,23 @@ Code DefaultGetUserDataFunc(const char *src_data, int src_data_len, std::string
 Code DefaultFormatUserDataFunc(const std::string user_data, std::string *real_data) { /*{{{*/
   if (real_data == NULL) return kInvalidParam;
 
+  Code r = FormatUserDataHead(user_data.size(), real_data);
+  if (r != kOk) return r;
+
+  // UserData
+  real_data->append(user_data);
+
+  return kOk;
+} /*}}}*/
+
+/**
+ * @brief 封装包头 [Head(4B)][Magic(4B)][FrameCode(4B)]，用户数据由调用方紧接着写入
+ */
+Code FormatUserDataHead(uint32_t user_data_len, std::string *real_data) { /*{{{*/
+  if (real_data == NULL) return kInvalidParam;
+
   // Head: payload 长度 = Magic(4) + FrameCode(4) + UserData(N)
-  Code r = EncodeFixed32(kExtHeadLen + user_data.size(), real_data);
+  Code r = EncodeFixed32(kExtHeadLen + user_data_len, real_data);
   if (r != kOk) return r;
 
   // Magic
@@ -117,9 +145,6 @@ Code DefaultFormatUserDataFunc(const std::string user_data, std::string *real_da
   r = EncodeFixed32(0, real_data);
   if (r != kOk) return r;
 
-  // UserData
-  real_data->append(user_data);
-
   return kOk;
 } /*}}}*/
 
@@ -161,4 +186,134 @@ Code FormatFrameErrorResp(uint32_t frame_code, std::string *real_data) { /*{{{*/
   return kOk;
 } /*}}}*/
 
+/**
+ * @brief 判断完整包是否为多路复用协议
+ *
+ * 协议格式: [Head(4B)][Magic(4B)][FrameCode(4B)][ReqId(8B)][UserData(NB)]
+ * 仅校验 Magic，长度等由 GetMultiplexUserData 校验
+ */
+bool IsMultiplexFrame(const char *src_data, int src_data_len) { /*{{{*/
+  if (src_data == NULL || src_data_len < (kHeadLen + kMagicLen)) return false;
+
+  uint32_t magic = 0;
+  Code r = DecodeFixed32(std::string(src_data + kHeadLen, kMagicLen), &magic);
+  if (r != kOk) return false;
+
+  return magic == kMultiplexProtoMagic;
+} /*}}}*/
+
+/**
+ * @brief 从多路复用协议的完整包中提取 ReqId 与用户数据
+ *
+ * 协议格式: [Head(4B)][Magic(4B)][FrameCode(4B)][ReqId(8B)][UserData(NB)]
+ * Head 中存储的 len = kMultiplexExtHeadLen + N
+ * 先解码 ReqId 再判断 FrameCode，使框架错误响应也能匹配到对应请求
+ */
+Code GetMultiplexUserData(const char *src_data, int src_data_len, uint64_t *req_id, std::string *user_data) { /*{{{*/
+  if (src_data == NULL || src_data_len < 0 || req_id == NULL || user_data == NULL) return kInvalidParam;
+
+  int user_data_offset = 0;
+  Code r = GetMultiplexUserDataOffset(src_data, src_data_len, req_id, &user_data_offset);
+  if (r != kOk) return r;
+
+  user_data->assign(src_data + user_data_offset, src_data_len - user_data_offset);
+
+  return kOk;
+} /*}}}*/
+
+Code GetMultiplexUserDataOffset(const char *src_data, int src_data_len, uint64_t *req_id,
+                                int *user_data_offset) { /*{{{*/
+  if (src_data == NULL || src_data_len < 0 || req_id == NULL || user_data_offset == NULL) return kInvalidParam;
+
+  if (src_data_len < (kHeadLen + kMultiplexExtHeadLen)) return kInvalidData;
+
+  uint32_t len = 0;
+  Code r = DecodeFixed32(std::string(src_data, kHeadLen), &len);
+  if (r != kOk) return r;
+  if (len >= static_cast<uint32_t>(kIntMax - kHeadLen)) return kInvalidSize;
+  if (len < static_cast<uint32_t>(kMultiplexExtHeadLen)) return kInvalidData;
+
+  if (src_data_len != static_cast<int>(kHeadLen + len)) return kInvalidData;
+
+  uint32_t magic = 0;
+  r = DecodeFixed32(std::string(src_data + kHeadLen, kMagicLen), &magic);
+  if (r != kOk) return r;
+  if (magic != kMultiplexProtoMagic) return kFrameInvalidMagic;
+
+  uint32_t frame_code = 0;
+  r = DecodeFixed32(std::string(src_data + kHeadLen + kMagicLen, kFrameCodeLen), &frame_code);
+  if (r != kOk) return r;
+
+  r = DecodeFixed64(std::string(src_data + kHeadLen + kExtHeadLen, kReqIdLen), req_id);
+  if (r != kOk) return r;
+
+  if (frame_code != 0) {
+    return (Code)frame_code;
+  }
+
+  *user_data_offset = kHeadLen + kMultiplexExtHeadLen;
+
+  return kOk;
+} /*}}}*/
+
+/**
+ * @brief 将用户数据按多路复用协议封装为完整的发送数据
+ *
+ * 协议格式: [Head(4B)][Magic(4B)][FrameCode(4B)][ReqId(8B)][UserData(NB)]
+ * Head = kMultiplexExtHeadLen + user_data.size()
+ */
+Code FormatMultiplexUserData(uint64_t req_id, const std::string &user_data, std::string *real_data) { /*{{{*/
+  if (real_data == NULL) return kInvalidParam;
+
+  Code r = FormatMultiplexUserDataHead(req_id, user_data.size(), real_data);
+  if (r != kOk) return r;
+
+  real_data->append(user_data);
+
+  return kOk;
+} /*}}}*/
+
+Code FormatMultiplexUserDataHead(uint64_t req_id, uint32_t user_data_len, std::string *real_data) { /*{{{*/
+  if (real_data == NULL) return kInvalidParam;
+
+  Code r = EncodeFixed32(kMultiplexExtHeadLen + user_data_len, real_data);
+  if (r != kOk) return r;
+
+  r = EncodeFixed32(kMultiplexProtoMagic, real_data);
+  if (r != kOk) return r;
+
+  r = EncodeFixed32(0, real_data);
+  if (r != kOk) return r;
+
+  r = EncodeFixed64(req_id, real_data);
+  if (r != kOk) return r;
+
+  return kOk;
+} /*}}}*/
+
+/**
+ * @brief 封装多路复用协议的框架错误响应
+ *
+ * 协议格式: [Head(4B)][Magic(4B)][FrameCode(4B)][ReqId(8B)]
+ * Head = kMultiplexExtHeadLen
+ */
+Code FormatMultiplexFrameErrorResp(uint32_t frame_code, uint64_t req_id, std::string *real_data) { /*{{{*/
+  if (real_data == NULL) return kInvalidParam;
+  if (!IsFrameError(frame_code)) return kInvalidParam;
+
+  Code r = EncodeFixed32(kMultiplexExtHeadLen, real_data);
+  if (r != kOk) return r;
+
+  r = EncodeFixed32(kMultiplexProtoMagic, real_data);
+  if (r != kOk) return r;
+
+  r = EncodeFixed32(frame_code, real_data);
+  if (r != kOk) return r;
+
+  r = EncodeFixed64(req_id, real_data);
+  if (r != kOk) return r;
+
+  return kOk;
+} /*}}}*/
+
 }  // namespace base
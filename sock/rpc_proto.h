@@ -33,6 +33,12 @@ typedef Code (*GetUserDataFunc)(const char *src_data, int src_data_len, std::str
 
 Code DefaultGetUserDataFunc(const char *src_data, int src_data_len, std::string *user_data);
 
+/**
+ * @brief 与 DefaultGetUserDataFunc 校验相同，但只返回用户数据在包内的起始偏移，不拷贝用户数据
+ * @param user_data_offset 输出参数，用户数据为 [user_data_offset, src_data_len)
+ */
+Code DefaultGetUserDataOffset(const char *src_data, int src_data_len, int *user_data_offset);
+
 /**
  * NOTE: format real data to stream
  */
@@ -40,6 +46,13 @@ typedef Code (*FormatUserDataFunc)(const std::string user_data, std::string *rea
 
 Code DefaultFormatUserDataFunc(const std::string user_data, std::string *real_data);
 
+/**
+ * @brief 只封装 DefaultFormatUserDataFunc 的包头，用户数据由调用方紧接着写入，用于原地序列化
+ * @param user_data_len 用户数据长度
+ * @param real_data 输出参数，包头追加到末尾
+ */
+Code FormatUserDataHead(uint32_t user_data_len, std::string *real_data);
+
 /**
  * @brief 判断错误码是否属于框架错误码范围 [700, 799]
  * @param frame_code 待判断的错误码
@@ -55,6 +68,57 @@ bool IsFrameError(uint32_t frame_code);
  */
 Code FormatFrameErrorResp(uint32_t frame_code, std::string *real_data);
 
+/**
+ * @brief 判断完整包是否为多路复用协议（Magic 为 kMultiplexProtoMagic）
+ *
+ * 多路复用协议格式: [Head(4B)][Magic(4B)][FrameCode(4B)][ReqId(8B)][UserData(NB)]
+ * 同一连接上可同时存在多个未完成请求，服务端按完成顺序乱序返回，客户端按 ReqId 匹配响应；
+ * 旧协议客户端使用 kProtoMagic，服务端按请求的 Magic 选择响应格式，因此新旧客户端可以共存。
+ *
+ * @param src_data 完整包的起始地址
+ * @param src_data_len 完整包的长度
+ * @return true 多路复用协议；false 其他协议
+ */
+bool IsMultiplexFrame(const char *src_data, int src_data_len);
+
+/**
+ * @brief 从多路复用协议的完整包中提取 ReqId 与用户数据
+ * @param src_data 完整包的起始地址
+ * @param src_data_len 完整包的长度
+ * @param req_id 输出参数，请求 id，FrameCode 非零时也会设置
+ * @param user_data 输出参数，提取出的用户业务数据
+ * @return kOk 成功；kFrameInvalidMagic Magic 校验失败；框架错误码(700-799) FrameCode 非零
+ */
+Code GetMultiplexUserData(const char *src_data, int src_data_len, uint64_t *req_id, std::string *user_data);
+
+/**
+ * @brief 与 GetMultiplexUserData 相同，但只返回用户数据在包内的起始偏移，不拷贝用户数据
+ */
+Code GetMultiplexUserDataOffset(const char *src_data, int src_data_len, uint64_t *req_id, int *user_data_offset);
+
+/**
+ * @brief 将用户数据按多路复用协议封装为完整的发送数据
+ * @param req_id 请求 id
+ * @param user_data 用户业务数据
+ * @param real_data 输出参数，编码后的数据追加到末尾
+ * @return kOk 成功；kInvalidParam 参数无效
+ */
+Code FormatMultiplexUserData(uint64_t req_id, const std::string &user_data, std::string *real_data);
+
+/**
+ * @brief 只封装多路复用协议的包头，用户数据由调用方紧接着写入
+ */
+Code FormatMultiplexUserDataHead(uint64_t req_id, uint32_t user_data_len, std::string *real_data);
+
+/**
+ * @brief 封装多路复用协议的框架错误响应，仅包含 Head + Magic + FrameCode + ReqId
+ * @param frame_code 框架错误码，取值范围 [700, 799]
+ * @param req_id 请求 id
+ * @param real_data 输出参数，编码后的完整响应数据
+ * @return kOk 成功；kInvalidParam 参数无效
+ */
+Code FormatMultiplexFrameErrorResp(uint32_t frame_code, uint64_t req_id, std::string *real_data);
+
 }  // namespace base
 
 #endif  // SOCK_RPC_PROTO_H_
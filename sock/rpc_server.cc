@@ -10,13 +10,20 @@
 #include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <time.h>
 #include <unistd.h>
 #include <random>
 
+#if defined(__linux__)
+#  include <sys/eventfd.h>
+#endif
+
+#include "base/buffer_pool.h"
 #include "base/coding.h"
 #include "base/ip.h"
 #include "base/log.h"
@@ -33,9 +40,12 @@ static Code RealWorkerNotifyEventAction(int fd, int evt, void *param);
 
 static void *ConnWorkerThreadAction(void *param);
 static Code ConnWorkerNotifyEventAction(int fd, int evt, void *param);
+static Code ConnWorkerAcceptEventAction(int fd, int evt, void *param);
 static Code ConnWorkerRespDataNotifyEventAction(int fd, int evt, void *param);
 static Code ClientEventAction(int fd, int evt, void *param);
 static Code AcceptEventAction(int fd, int evt, void *param);
+static void ConnWorkerCompletionAction(const IoCompletion &cqe, void *param);
+static void AcceptCompletionAction(const IoCompletion &cqe, void *param);
 
 static int ThreadSafeRand() { /*{{{*/
   static thread_local unsigned int seed = static_cast<unsigned int>(time(NULL));
@@ -62,19 +72,18 @@ static void *ConnWorkerThreadAction(void *param) {
   pthread_exit(NULL);
 }
 
-static void *StatThreadAction(void *param) {
-  RpcServer *serv = reinterpret_cast<RpcServer *>(param);
-  serv->DumpStatAction();
-
-  pthread_exit(NULL);
-}
-
 static Code ConnWorkerNotifyEventAction(int fd, int evt, void *param) {
   ConnWorker *worker = reinterpret_cast<ConnWorker *>(param);
   Code ret = worker->NotifyEventInternalAction(fd);
   return ret;
 }
 
+static Code ConnWorkerAcceptEventAction(int fd, int evt, void *param) {
+  ConnWorker *worker = reinterpret_cast<ConnWorker *>(param);
+  Code ret = worker->AcceptEventInternalAction(fd, evt);
+  return ret;
+}
+
 static Code ConnWorkerRespDataNotifyEventAction(int fd, int evt, void *param) {
   ConnWorker *worker = reinterpret_cast<ConnWorker *>(param);
   Code ret = worker->RespDataNotifyEventInternalAction(fd);
@@ -93,36 +102,64 @@ static Code AcceptEventAction(int fd, int evt, void *param) {
   return ret;
 }
 
+static void ConnWorkerCompletionAction(const IoCompletion &cqe, void *param) {
+  ConnWorker *worker = reinterpret_cast<ConnWorker *>(param);
+  worker->CompletionInternalAction(cqe);
+}
+
+static void AcceptCompletionAction(const IoCompletion &cqe, void *param) {
+  RpcServer *server = reinterpret_cast<RpcServer *>(param);
+  server->AcceptCompletionInternalAction(cqe);
+}
+
 /****************************************
- * RealWorker: deal with request
+ * DataBlockQueue: pass data blocks between workers
  */
-RealWorker::RealWorker(RpcServer *server)
-    : server_(server),
-      event_type_(server_->event_type_),
-      worker_loop_(NULL),
+DataBlockQueue::DataBlockQueue()
+    : is_ring_mode_(false),
+      ring_(NULL),
+      overflow_num_(0),
       mu_(),
-      flow_ctrl_(kDefaultFlowGridNum, kDefaultFlowUnitNum, server_->max_flow_),
-      data_proto_func_(server->GetDataProtoFunc()) { /*{{{*/
+      is_notified_(0),
+      notify_num_(0),
+      block_num_(0) { /*{{{*/
+  notify_fds_[0] = -1;
+  notify_fds_[1] = -1;
 } /*}}}*/
 
-RealWorker::~RealWorker() { /*{{{*/
-  if (worker_loop_ != NULL) {
-    delete worker_loop_;
-    worker_loop_ = NULL;
+DataBlockQueue::~DataBlockQueue() { /*{{{*/
+  if (ring_ != NULL) {
+    delete ring_;
+    ring_ = NULL;
   }
 
+  if (notify_fds_[1] == notify_fds_[0]) notify_fds_[1] = -1;  // NOTE:htt, eventfd
   CloseFdSafely(notify_fds_[0]);
   CloseFdSafely(notify_fds_[1]);
 } /*}}}*/
 
-void RealWorker::CloseFdSafely(int &fd) { /*{{{*/
+void DataBlockQueue::CloseFdSafely(int &fd) { /*{{{*/
   if (fd > 0) {
     close(fd);
     fd = -1;
   }
 } /*}}}*/
 
-Code RealWorker::Init() { /*{{{*/
+Code DataBlockQueue::Init(bool is_ring_mode, int ring_size) { /*{{{*/
+  is_ring_mode_ = is_ring_mode;
+  if (is_ring_mode_) {
+    if (ring_size <= 0) return kInvalidParam;
+    ring_ = new MpscRing<OneDataBlock>(ring_size);
+
+#if defined(__linux__)
+    int fd = eventfd(0, EFD_NONBLOCK);
+    if (fd == -1) return kPipeFailed;
+    notify_fds_[0] = fd;
+    notify_fds_[1] = fd;
+    return kOk;
+#endif
+  }
+
   int ret = pipe(notify_fds_);
   if (ret != 0) return kPipeFailed;
 
@@ -131,55 +168,310 @@ Code RealWorker::Init() { /*{{{*/
   r = SetFdNonblock(notify_fds_[1]);
   if (r != kOk) return r;
 
+  return kOk;
+} /*}}}*/
+
+Code DataBlockQueue::Notify() { /*{{{*/
+  FetchAndAdd(&notify_num_, (uint64_t)1);
+
+  int ret = 0;
+#if defined(__linux__)
+  if (is_ring_mode_) {
+    uint64_t value = 1;
+    ret = write(notify_fds_[1], &value, sizeof(value));
+    if (ret == -1) return kWriteError;
+    return kOk;
+  }
+#endif
+
+  // NOTE:htt, full pipe means consumer has not waked up yet, and it takes all blocks per wakeup
+  char buf[1] = {'1'};
+  ret = write(notify_fds_[1], buf, sizeof(buf));
+  if (ret == -1 && errno != EAGAIN) return kWriteError;
+
+  return kOk;
+} /*}}}*/
+
+Code DataBlockQueue::PushAndNotify(OneDataBlock *one_data_block) { /*{{{*/
+  if (one_data_block == NULL) return kInvalidParam;
+  FetchAndAdd(&block_num_, (uint64_t)1);
+
+  if (!is_ring_mode_) {
+    MutexLock ml(&mu_);
+    data_blocks_.push_back(std::move(*one_data_block));
+    return Notify();
+  }
+
+  if (ring_->Push(one_data_block) != kOk) {
+    MutexLock ml(&mu_);
+    data_blocks_.push_back(std::move(*one_data_block));
+    __atomic_add_fetch(&overflow_num_, 1, __ATOMIC_RELEASE);
+  }
+
+  // NOTE:htt, only the first block after consumer has waked up need to notify
+  if (__atomic_exchange_n(&is_notified_, 1, __ATOMIC_SEQ_CST) != 0) return kOk;
+
+  Code ret = Notify();
+  if (ret != kOk) __atomic_store_n(&is_notified_, 0, __ATOMIC_SEQ_CST);
+  return ret;
+} /*}}}*/
+
+Code DataBlockQueue::PopAll(std::deque<OneDataBlock> *data_blocks) { /*{{{*/
+  if (data_blocks == NULL) return kInvalidParam;
+
+  if (!is_ring_mode_) {
+    char buf[1];
+    int r = read(notify_fds_[0], buf, sizeof(buf));
+    if (r == -1 && errno == EAGAIN) return kOk;
+    if (r == -1 && errno != EAGAIN) return kReadError;
+
+    MutexLock ml(&mu_);
+    data_blocks->swap(data_blocks_);
+    return kOk;
+  }
+
+#if defined(__linux__)
+  uint64_t value = 0;
+  int r = read(notify_fds_[0], &value, sizeof(value));
+#else
+  char buf[64];
+  int r = 0;
+  while ((r = read(notify_fds_[0], buf, sizeof(buf))) > 0) {
+  }
+#endif
+  if (r == -1 && errno != EAGAIN) return kReadError;
+
+  // NOTE:htt, reset before draining, so block pushed during draining will notify again
+  __atomic_store_n(&is_notified_, 0, __ATOMIC_SEQ_CST);
+
+  uint32_t max_num = ring_->Capacity();
+  OneDataBlock one_data_block;
+  for (uint32_t i = 0; i < max_num && ring_->Pop(&one_data_block) == kOk; ++i) {
+    data_blocks->push_back(std::move(one_data_block));
+  }
+
+  if (__atomic_load_n(&overflow_num_, __ATOMIC_ACQUIRE) > 0) {
+    MutexLock ml(&mu_);
+    while (!data_blocks_.empty()) {
+      data_blocks->push_back(std::move(data_blocks_.front()));
+      data_blocks_.pop_front();
+    }
+    __atomic_store_n(&overflow_num_, 0, __ATOMIC_RELEASE);
+  }
+
+  // NOTE:htt, no more than one ring per wakeup, notify self if left
+  if (ring_->Size() > 0 && __atomic_exchange_n(&is_notified_, 1, __ATOMIC_SEQ_CST) == 0) {
+    Code ret = Notify();
+    if (ret != kOk) __atomic_store_n(&is_notified_, 0, __ATOMIC_SEQ_CST);
+  }
+
+  return kOk;
+} /*}}}*/
+
+uint32_t DataBlockQueue::GetApproximateSize() { /*{{{*/
+  if (is_ring_mode_) return ring_->Size() + __atomic_load_n(&overflow_num_, __ATOMIC_ACQUIRE);
+
+  MutexLock ml(&mu_);
+  return data_blocks_.size();
+} /*}}}*/
+
+/****************************************
+ * WorkerDispatcher: choose one worker by policy
+ */
+Code GetDispatchPolicy(const std::string &policy_name, DispatchPolicy *policy) { /*{{{*/
+  if (policy == NULL) return kInvalidParam;
+
+  if (policy_name == kRandomDispatch) {
+    *policy = kRandomPolicy;
+  } else if (policy_name == kRoundRobinDispatch) {
+    *policy = kRoundRobinPolicy;
+  } else if (policy_name == kLeastQueueDispatch) {
+    *policy = kLeastQueuePolicy;
+  } else if (policy_name == kPowerOfTwoDispatch) {
+    *policy = kPowerOfTwoPolicy;
+  } else if (policy_name == kAffinityDispatch) {
+    *policy = kAffinityPolicy;
+  } else {
+    return kInvalidParam;
+  }
+
+  return kOk;
+} /*}}}*/
+
+WorkerDispatcher::WorkerDispatcher() : policy_(kRandomPolicy), next_(0) { /*{{{*/
+} /*}}}*/
+
+WorkerDispatcher::~WorkerDispatcher() { /*{{{*/
+} /*}}}*/
+
+Code WorkerDispatcher::Init(DispatchPolicy policy, const std::vector<const uint32_t *> &depths) { /*{{{*/
+  if (depths.empty()) return kInvalidParam;
+  for (size_t i = 0; i < depths.size(); ++i) {
+    if (depths[i] == NULL) return kInvalidParam;
+  }
+
+  policy_ = policy;
+  depths_ = depths;
+  next_ = 0;
+
+  return kOk;
+} /*}}}*/
+
+int WorkerDispatcher::Select(uint64_t affinity_key) { /*{{{*/
+  uint32_t num = depths_.size();
+  if (num <= 1) return 0;
+
+  switch (policy_) {
+    case kRoundRobinPolicy:
+      return FetchAndAdd(&next_, (uint32_t)1) % num;
+
+    case kLeastQueuePolicy: {
+      // NOTE:htt, scan from a rotating start, so ties are spread instead of always choosing the first one
+      uint32_t start = FetchAndAdd(&next_, (uint32_t)1) % num;
+      uint32_t best = start;
+      uint32_t best_depth = GetDepth(start);
+      for (uint32_t i = 1; i < num && best_depth > 0; ++i) {
+        uint32_t index = (start + i) % num;
+        uint32_t depth = GetDepth(index);
+        if (depth < best_depth) {
+          best = index;
+          best_depth = depth;
+        }
+      }
+      return best;
+    }
+
+    case kPowerOfTwoPolicy: {
+      uint32_t first = ThreadSafeRand() % num;
+      uint32_t second = (first + 1 + ThreadSafeRand() % (num - 1)) % num;
+      return GetDepth(first) <= GetDepth(second) ? first : second;
+    }
+
+    case kAffinityPolicy:
+      // NOTE:htt, fibonacci hashing, so adjacent keys like fds are spread over workers
+      return ((affinity_key * 0x9E3779B97F4A7C15ULL) >> 32) % num;
+
+    default:
+      return ThreadSafeRand() % num;
+  }
+} /*}}}*/
+
+/****************************************
+ * RealWorker: deal with request
+ */
+RealWorker::RealWorker(RpcServer *server)
+    : queue_depth_(0),
+      server_(server),
+      event_type_(server_->event_type_),
+      worker_loop_(NULL),
+      co_sched_(NULL),
+      flow_ctrl_(kDefaultFlowGridNum, kDefaultFlowUnitNum, server_->max_flow_),
+      data_proto_func_(server->GetDataProtoFunc()) { /*{{{*/
+} /*}}}*/
+
+RealWorker::~RealWorker() { /*{{{*/
+  if (co_sched_ != NULL) {
+    delete co_sched_;
+    co_sched_ = NULL;
+  } else if (worker_loop_ != NULL) {
+    delete worker_loop_;
+  }
+  worker_loop_ = NULL;
+} /*}}}*/
+
+Code RealWorker::Init() { /*{{{*/
+  Code r = request_queue_.Init(server_->is_ring_queue_, server_->worker_ring_size_);
+  if (r != kOk) return r;
+
   r = flow_ctrl_.Init();
   if (r != kOk) return r;
 
   if (data_proto_func_ == NULL) return kInvalidParam;
 
-  worker_loop_ = new EventLoop();
-  worker_loop_->Init(event_type_);
-  worker_loop_->Add(notify_fds_[0], EV_IN, RealWorkerNotifyEventAction, this);
+  if (server_->is_real_coroutine_ && server_->real_pool_ == NULL) {
+    co_sched_ = new CoScheduler();
+    r = co_sched_->Init(event_type_, server_->real_coroutine_stack_kb_ * kKB);
+    if (r != kOk) return r;
+    worker_loop_ = co_sched_->GetLoop();
+  } else {
+    worker_loop_ = new EventLoop();
+    worker_loop_->Init(event_type_);
+  }
+  worker_loop_->Add(request_queue_.GetNotifyFd(), EV_IN, RealWorkerNotifyEventAction, this);
 
   pthread_create(&worker_id_, NULL, RealWorkerThreadAction, this);
   return kOk;
 } /*}}}*/
 
 Code RealWorker::Run() { /*{{{*/
+  if (co_sched_ != NULL) return co_sched_->Run();
   Code ret = worker_loop_->Run();
   return ret;
 } /*}}}*/
 
-Code RealWorker::AddOneDataBlockAndNotify(const OneDataBlock &one_data_block) { /*{{{*/
-  MutexLock ml(&mu_);
-  request_data_blocks_.push_back(one_data_block);
-  // LOG_ERR("try to add request id:%lu fd:%d to real worker!", (unsigned long)one_data_block.id, one_data_block.fd);
-
-  char buf[1] = {'1'};
-  int ret = write(notify_fds_[1], buf, sizeof(buf));
-  if (ret == -1) return kWriteError;
-
-  return kOk;
+Code RealWorker::AddOneDataBlockAndNotify(OneDataBlock *one_data_block) { /*{{{*/
+  // LOG_ERR("try to add request id:%lu fd:%d to real worker!", (unsigned long)one_data_block->id, one_data_block->fd);
+  // NOTE:htt, count it before pushing, so the depth never goes below zero when the block is popped at once
+  FetchAndAdd(&queue_depth_, (uint32_t)1);
+  Code ret = request_queue_.PushAndNotify(one_data_block);
+  if (ret == kInvalidParam) {
+    // NOTE:htt, rejected block is never popped, so give back its depth; it is still queued when only notify fails
+    FetchAndAdd(&queue_depth_, (uint32_t)-1);
+  }
+  return ret;
 } /*}}}*/
 
 Code RealWorker::NotifyEventInternalAction(int fd) { /*{{{*/
-  char buf[1];
-  assert(fd == notify_fds_[0]);
-  int r = read(notify_fds_[0], buf, sizeof(buf));
-  if (r == -1 && errno == EAGAIN) return kOk;
-  if (r == -1 && errno != EAGAIN) return kReadError;
-
+  assert(fd == request_queue_.GetNotifyFd());
   std::deque<OneDataBlock> tmp_data_blocks;
-  {
-    MutexLock ml(&mu_);
-    tmp_data_blocks = std::move(request_data_blocks_);
-  }
+  Code r = request_queue_.PopAll(&tmp_data_blocks);
+  if (r != kOk) return r;
 
   std::deque<OneDataBlock>::iterator it = tmp_data_blocks.begin();
   while (it != tmp_data_blocks.end()) {
+    // NOTE:htt, any idle thread of pool takes the request, so a slow request does not block the ones behind it
+    if (server_->real_pool_ != NULL) {
+      OneDataBlock one_data_block = *it;
+      Code ret = server_->real_pool_->Submit([this, one_data_block]() {
+        Code inner_ret = DealWithRequestOneDataBlock(one_data_block);
+        FetchAndAdd(&queue_depth_, (uint32_t)-1);
+        if (inner_ret != kOk) {
+          LOG_ERR("Failed to deal One Data Block! ret:%d real data size:%u, id:%" PRIu64 ", fd:%d\n", inner_ret,
+                  one_data_block.real_data.Size(), one_data_block.id, one_data_block.fd);
+        }
+      });
+      if (ret == kOk) {
+        tmp_data_blocks.pop_front();
+        it = tmp_data_blocks.begin();
+        continue;
+      }
+      LOG_ERR("Failed to submit to pool, ret:%d, and deal with request directly", ret);
+    }
+
+    // NOTE:htt, downstream calls of the handler only suspend its coroutine, and other requests go on
+    if (co_sched_ != NULL) {
+      OneDataBlock one_data_block = *it;
+      Code ret = co_sched_->Spawn([this, one_data_block]() {
+        Code inner_ret = DealWithRequestOneDataBlock(one_data_block);
+        FetchAndAdd(&queue_depth_, (uint32_t)-1);
+        if (inner_ret != kOk) {
+          LOG_ERR("Failed to deal One Data Block! ret:%d real data size:%u, id:%" PRIu64 ", fd:%d\n", inner_ret,
+                  one_data_block.real_data.Size(), one_data_block.id, one_data_block.fd);
+        }
+      });
+      if (ret == kOk) {
+        tmp_data_blocks.pop_front();
+        it = tmp_data_blocks.begin();
+        continue;
+      }
+      LOG_ERR("Failed to spawn coroutine, ret:%d, and deal with request directly", ret);
+    }
+
     Code ret = DealWithRequestOneDataBlock(*it);
+    FetchAndAdd(&queue_depth_, (uint32_t)-1);
     if (ret != kOk) {
-      LOG_ERR("Failed to deal One Data Block! ret:%d real data:%s, id:%" PRIu64 ", fd:%d\n", ret,
-              it->real_data.size(), it->id, it->fd);
+      LOG_ERR("Failed to deal One Data Block! ret:%d real data size:%u, id:%" PRIu64 ", fd:%d\n", ret,
+              it->real_data.Size(), it->id, it->fd);
     }
 
     tmp_data_blocks.pop_front();
@@ -191,20 +483,28 @@ Code RealWorker::NotifyEventInternalAction(int fd) { /*{{{*/
 
 Code RealWorker::DealWithRequestOneDataBlock(const OneDataBlock &one_data_block) { /*{{{*/
   Code ret = kOk;
-  std::string user_data;
-  ret = server_->get_user_data_func_(one_data_block.real_data.data(), one_data_block.real_data.size(), &user_data);
+  const char *frame_data = one_data_block.real_data.Data();
+  int frame_len = one_data_block.real_data.Size();
+
+  // NOTE:htt, framing of response follows magic of request, so old and multiplexed clients work together
+  uint64_t req_id = 0;
+  int user_data_offset = 0;
+  std::string user_data;  // NOTE:htt, only used by user defined GetUserDataFunc, which copies user data
+  bool is_multiplex = IsMultiplexFrame(frame_data, frame_len);
+  if (is_multiplex) {
+    ret = GetMultiplexUserDataOffset(frame_data, frame_len, &req_id, &user_data_offset);
+  } else if (server_->get_user_data_func_ == DefaultGetUserDataFunc) {
+    ret = DefaultGetUserDataOffset(frame_data, frame_len, &user_data_offset);
+  } else {
+    ret = server_->get_user_data_func_(frame_data, frame_len, &user_data);
+    frame_data = user_data.data();
+    frame_len = user_data.size();
+  }
   if (ret != kOk) {
     if (IsFrameError(static_cast<uint32_t>(ret))) {
-      std::string frame_err_resp;
-      Code fmt_ret = FormatFrameErrorResp(static_cast<uint32_t>(ret), &frame_err_resp);
-      if (fmt_ret == kOk) {
-        OneDataBlock resp_data_block;
-        resp_data_block.real_data = std::move(frame_err_resp);
-        resp_data_block.id = one_data_block.id;
-        resp_data_block.fd = one_data_block.fd;
-        resp_data_block.conn_worker = one_data_block.conn_worker;
-        one_data_block.conn_worker->AddResponseAndNotify(resp_data_block);
-      }
+      AddFrameErrorResponse(one_data_block, is_multiplex, req_id, ret);
+    } else {
+      AddEmptyResponse(one_data_block);
     }
     return ret;
   }
@@ -212,44 +512,33 @@ Code RealWorker::DealWithRequestOneDataBlock(const OneDataBlock &one_data_block)
   ::google::protobuf::Message *req = server_->req_prototype_->New();
   ::google::protobuf::Message *resp = server_->resp_prototype_->New();
 
-  if (!req->ParseFromString(user_data)) {
+  if (!req->ParseFromArray(frame_data + user_data_offset, frame_len - user_data_offset)) {
     delete req;
     delete resp;
+    AddEmptyResponse(one_data_block);
     return kParseProtobufFailed;
   }
 
   ret = server_->action_(server_->user_conf_, req, resp);
   if (ret != kOk) {
     if (IsFrameError(static_cast<uint32_t>(ret))) {
-      std::string frame_err_resp;
-      Code fmt_ret = FormatFrameErrorResp(static_cast<uint32_t>(ret), &frame_err_resp);
-      if (fmt_ret == kOk) {
-        OneDataBlock resp_data_block;
-        resp_data_block.real_data = std::move(frame_err_resp);
-        resp_data_block.id = one_data_block.id;
-        resp_data_block.fd = one_data_block.fd;
-        resp_data_block.conn_worker = one_data_block.conn_worker;
-        one_data_block.conn_worker->AddResponseAndNotify(resp_data_block);
-      }
+      AddFrameErrorResponse(one_data_block, is_multiplex, req_id, ret);
+    } else {
+      AddEmptyResponse(one_data_block);
     }
     delete req;
     delete resp;
     return ret;
   }
 
-  std::string out_data;
-  if (!resp->SerializeToString(&out_data)) {
-    delete req;
-    delete resp;
-    return kSerializePBFailed;
-  }
-
+  BufferSlice resp_data;
+  ret = FormatResponse(is_multiplex, req_id, *resp, &resp_data);
   delete req;
   delete resp;
-
-  std::string resp_data;
-  ret = server_->format_user_data_func_(out_data, &resp_data);
-  if (ret != kOk) return ret;
+  if (ret != kOk) {
+    AddEmptyResponse(one_data_block);
+    return ret;
+  }
 
   OneDataBlock resp_data_block;
   resp_data_block.real_data = std::move(resp_data);
@@ -257,29 +546,106 @@ Code RealWorker::DealWithRequestOneDataBlock(const OneDataBlock &one_data_block)
   resp_data_block.fd = one_data_block.fd;
   resp_data_block.conn_worker = one_data_block.conn_worker;
 
-  ret = one_data_block.conn_worker->AddResponseAndNotify(resp_data_block);
+  ret = one_data_block.conn_worker->AddResponseAndNotify(&resp_data_block);
   if (ret != kOk) return ret;
 
   return ret;
 } /*}}}*/
 
+Code RealWorker::AddFrameErrorResponse(const OneDataBlock &one_data_block, bool is_multiplex, uint64_t req_id,
+                                       Code frame_code) { /*{{{*/
+  std::string frame_err_resp;
+  Code ret = kOk;
+  if (is_multiplex) {
+    ret = FormatMultiplexFrameErrorResp(static_cast<uint32_t>(frame_code), req_id, &frame_err_resp);
+  } else {
+    ret = FormatFrameErrorResp(static_cast<uint32_t>(frame_code), &frame_err_resp);
+  }
+  if (ret != kOk) {
+    AddEmptyResponse(one_data_block);
+    return ret;
+  }
+
+  OneDataBlock resp_data_block;
+  resp_data_block.real_data = BufferSlice(frame_err_resp);
+  resp_data_block.id = one_data_block.id;
+  resp_data_block.fd = one_data_block.fd;
+  resp_data_block.conn_worker = one_data_block.conn_worker;
+  return one_data_block.conn_worker->AddResponseAndNotify(&resp_data_block);
+} /*}}}*/
+
+/**
+ * NOTE:htt, nothing is written to client for empty response, but ConnWorker knows the request is done,
+ * so the connection is not taken as busy forever by the idle timer
+ */
+Code RealWorker::AddEmptyResponse(const OneDataBlock &one_data_block) { /*{{{*/
+  OneDataBlock resp_data_block;
+  resp_data_block.id = one_data_block.id;
+  resp_data_block.fd = one_data_block.fd;
+  resp_data_block.conn_worker = one_data_block.conn_worker;
+  return one_data_block.conn_worker->AddResponseAndNotify(&resp_data_block);
+} /*}}}*/
+
+Code RealWorker::FormatResponse(bool is_multiplex, uint64_t req_id, const ::google::protobuf::Message &resp,
+                                BufferSlice *resp_data) { /*{{{*/
+  if (resp_data == NULL) return kInvalidParam;
+
+  if (!is_multiplex && server_->format_user_data_func_ != DefaultFormatUserDataFunc) {
+    std::string out_data;
+    if (!resp.SerializeToString(&out_data)) return kSerializePBFailed;
+
+    std::string real_data;
+    Code ret = server_->format_user_data_func_(out_data, &real_data);
+    if (ret != kOk) return ret;
+
+    *resp_data = BufferSlice(real_data);
+    return kOk;
+  }
+
+  size_t pb_size = resp.ByteSizeLong();
+  if (pb_size > kConnMaxBufSize) return kInvalidLength;
+
+  std::string head;
+  Code ret = kOk;
+  if (is_multiplex) {
+    ret = FormatMultiplexUserDataHead(req_id, pb_size, &head);
+  } else {
+    ret = FormatUserDataHead(pb_size, &head);
+  }
+  if (ret != kOk) return ret;
+
+  ret = BufferSlice::Alloc(head.size() + pb_size, resp_data);
+  if (ret != kOk) return ret;
+
+  memcpy(resp_data->MutableData(), head.data(), head.size());
+  resp.SerializeWithCachedSizesToArray(reinterpret_cast<uint8_t *>(resp_data->MutableData() + head.size()));
+
+  return kOk;
+} /*}}}*/
+
 /****************************************
  * ConnWorker: recv and send request
  */
 ConnWorker::ConnWorker(RpcServer *server)
-    : server_(server),
+    : conn_num_(0),
+      accept_num_(0),
+      server_(server),
+      listen_fd_(-1),
       event_type_(server_->event_type_),
       worker_loop_(NULL),
+      io_uring_(NULL),
       mu_(),
-      data_mu_(),
       flow_ctrl_(kDefaultFlowGridNum, kDefaultFlowUnitNum, server_->max_flow_),
       data_proto_func_(server->GetDataProtoFunc()),
       unique_id_(0) { /*{{{*/
 } /*}}}*/
 
 ConnWorker::~ConnWorker() { /*{{{*/
+  // NOTE:htt, completions of pending sends are not fetched any more, and they are freed after the ring is closed
+  std::vector<PendingSend *> pending_sends;
   std::map<int, TcpConn>::iterator it = conns_.begin();
   while (it != conns_.end()) {
+    if (it->second.pending_send != NULL) pending_sends.push_back(it->second.pending_send);
     CloseConn(it->second);
     it = conns_.begin();
   }
@@ -288,11 +654,13 @@ ConnWorker::~ConnWorker() { /*{{{*/
     delete worker_loop_;
     worker_loop_ = NULL;
   }
+  for (size_t i = 0; i < pending_sends.size(); ++i) {
+    delete pending_sends[i];
+  }
 
   CloseFdSafely(notify_fds_[0]);
   CloseFdSafely(notify_fds_[1]);
-  CloseFdSafely(data_notify_fds_[0]);
-  CloseFdSafely(data_notify_fds_[1]);
+  CloseFdSafely(listen_fd_);
 } /*}}}*/
 
 Code ConnWorker::Init() { /*{{{*/
@@ -304,11 +672,7 @@ Code ConnWorker::Init() { /*{{{*/
   r = SetFdNonblock(notify_fds_[1]);
   if (r != kOk) return r;
 
-  ret = pipe(data_notify_fds_);
-  if (ret != 0) return kPipeFailed;
-  r = SetFdNonblock(data_notify_fds_[0]);
-  if (r != kOk) return r;
-  r = SetFdNonblock(data_notify_fds_[1]);
+  r = resp_queue_.Init(server_->is_ring_queue_, server_->worker_ring_size_);
   if (r != kOk) return r;
 
   r = flow_ctrl_.Init();
@@ -319,7 +683,22 @@ Code ConnWorker::Init() { /*{{{*/
   worker_loop_ = new EventLoop();
   worker_loop_->Init(event_type_);
   worker_loop_->Add(notify_fds_[0], EV_IN, ConnWorkerNotifyEventAction, this);
-  worker_loop_->Add(data_notify_fds_[0], EV_IN, ConnWorkerRespDataNotifyEventAction, this);
+  worker_loop_->Add(resp_queue_.GetNotifyFd(), EV_IN, ConnWorkerRespDataNotifyEventAction, this);
+
+  // NOTE:htt, responses are sent by io_uring without waiting for writable, see SubmitSend
+  io_uring_ = worker_loop_->GetIoUring();
+  if (io_uring_ != NULL) worker_loop_->SetCompletionFunc(ConnWorkerCompletionAction, this);
+
+  if (server_->is_reuse_port_) {
+    r = CreateListenFd(server_->port_, true, &listen_fd_);
+    if (r != kOk) return r;
+    if (io_uring_ != NULL) {
+      r = io_uring_->SubmitAccept(listen_fd_, kAcceptUserData);
+    } else {
+      r = worker_loop_->Add(listen_fd_, EV_IN, ConnWorkerAcceptEventAction, this);
+    }
+    if (r != kOk) return r;
+  }
 
   pthread_create(&worker_id_, NULL, ConnWorkerThreadAction, this);
   return kOk;
@@ -333,10 +712,12 @@ Code ConnWorker::Run() { /*{{{*/
 Code ConnWorker::AddClientFdAndNotify(int fd) { /*{{{*/
   MutexLock ml(&mu_);
   cli_fds_.push_back(fd);
+  FetchAndAdd(&conn_num_, (uint32_t)1);
+  FetchAndAdd(&accept_num_, (uint64_t)1);
 
   char buf[1] = {'1'};
   int ret = write(notify_fds_[1], buf, sizeof(buf));
-  if (ret == -1) return kWriteError;
+  if (ret == -1 && errno != EAGAIN) return kWriteError;  // NOTE:htt, all fds are taken per wakeup
 
   return kOk;
 } /*}}}*/
@@ -352,13 +733,7 @@ Code ConnWorker::NotifyEventInternalAction(int fd) { /*{{{*/
 
   std::deque<int>::iterator it = cli_fds_.begin();
   while (it != cli_fds_.end()) {
-    int client_fd = *it;
-    TcpConn conn;
-    conn.fd = client_fd;
-    conn.id = GeneraterId();
-    conns_.insert(std::pair<int, TcpConn>(client_fd, conn));
-
-    worker_loop_->Add(client_fd, EV_IN, ClientEventAction, this);
+    AddConn(*it);
 
     cli_fds_.pop_front();
     it = cli_fds_.begin();
@@ -367,6 +742,93 @@ Code ConnWorker::NotifyEventInternalAction(int fd) { /*{{{*/
   return kOk;
 } /*}}}*/
 
+/**
+ * NOTE:htt, reuseport accept mode, connection is accepted by its own worker without hop of main thread;
+ * accept in batch, so a storm of connections costs less wakeups, and bound it to keep other fds served
+ */
+Code ConnWorker::AcceptEventInternalAction(int fd, int evt) { /*{{{*/
+  assert(fd == listen_fd_);
+  const int kMaxAcceptPerEvent = 64;
+
+  for (int i = 0; i < kMaxAcceptPerEvent; ++i) {
+    struct sockaddr_in client_addr;
+    socklen_t client_addr_len = sizeof(client_addr);
+    int client_fd = accept(fd, (struct sockaddr *)(&client_addr), &client_addr_len);
+    if (client_fd == -1) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) break;
+      return kAcceptError;
+    }
+
+    Code r = AcceptConn(client_fd);
+    if (r != kOk) return r;
+  }
+
+  return kOk;
+} /*}}}*/
+
+Code ConnWorker::AcceptConn(int client_fd) { /*{{{*/
+  Code r = SetFdReused(client_fd);
+  if (r == kOk) r = SetFdNonblock(client_fd);
+  if (r == kOk) r = SetFdNoDelay(client_fd);
+  if (r != kOk) {
+    close(client_fd);
+    return r;
+  }
+
+  FetchAndAdd(&conn_num_, (uint32_t)1);
+  FetchAndAdd(&accept_num_, (uint64_t)1);
+  return AddConn(client_fd);
+} /*}}}*/
+
+Code ConnWorker::AddConn(int client_fd) { /*{{{*/
+  TcpConn &conn = conns_[client_fd];  // NOTE:htt, TcpConn is not copyable for its buffer
+  conn.fd = client_fd;
+  conn.id = GeneraterId();
+  conn.last_active_ms = worker_loop_->GetNowMs();
+
+  Code ret = worker_loop_->Add(client_fd, EV_IN, ClientEventAction, this);
+  if (ret != kOk) return ret;
+
+  if (server_->conn_idle_timeout_ms_ > 0) {
+    ret = AddIdleTimer(&conn, server_->conn_idle_timeout_ms_);
+  }
+  return ret;
+} /*}}}*/
+
+/**
+ * NOTE:htt, idle timer is not reset by every read; the last active time is checked when it expires, and it's
+ * added again for the rest time, so one connection costs one timer in every idle timeout at most
+ */
+Code ConnWorker::AddIdleTimer(TcpConn *conn, uint32_t timeout_ms) { /*{{{*/
+  int fd = conn->fd;
+  uint64_t id = conn->id;
+  return worker_loop_->AddTimer(timeout_ms, [this, fd, id]() { IdleTimeoutAction(fd, id); }, &conn->idle_timer_id);
+} /*}}}*/
+
+Code ConnWorker::IdleTimeoutAction(int fd, uint64_t id) { /*{{{*/
+  std::map<int, TcpConn>::iterator it;
+  {
+    MutexLock ml(&mu_);
+    it = conns_.find(fd);
+    if (it == conns_.end() || it->second.id != id) return kNotFound;
+  }
+
+  TcpConn &conn = it->second;
+  conn.idle_timer_id = 0;
+
+  // NOTE:htt, connection which has requests in processing or responses not written is not idle
+  uint32_t timeout_ms = server_->conn_idle_timeout_ms_;
+  uint64_t idle_ms = worker_loop_->GetNowMs() - conn.last_active_ms;
+  if (conn.pending_num > 0 || !conn.rsp_slices.empty()) idle_ms = 0;
+  if (idle_ms < timeout_ms) {
+    return AddIdleTimer(&conn, timeout_ms - idle_ms);
+  }
+
+  LOG_ERR("Close idle connection, fd:%d, id:%" PRIu64 ", idle_ms:%" PRIu64, fd, id, idle_ms);
+  CloseConn(conn);
+  return kOk;
+} /*}}}*/
+
 Code ConnWorker::ClientEventInternalAction(int fd, int evt) { /*{{{*/
   // LOG_ERR("evt:%d, fd:%d", evt, fd);
 
@@ -405,9 +867,11 @@ Code ConnWorker::ClientEventInInternalAction(int fd, int evt) { /*{{{*/
   Code ret = kOk;
   bool have_read = false;
   while (true) {
-    char read_buf[kBufLen] = {0};
     int real_len = 0;
-    ret = data_proto_func_(conn.req_content.data(), conn.req_content.size(), &real_len);
+    ret = kDataNotEnough;
+    if (conn.req_buf.RealDataSize() > 0) {
+      ret = data_proto_func_(conn.req_buf.RealDataPtr(), conn.req_buf.RealDataSize(), &real_len);
+    }
     if (ret != kOk && ret != kDataNotEnough) {
       CloseConn(conn);
       return ret;
@@ -416,10 +880,19 @@ Code ConnWorker::ClientEventInInternalAction(int fd, int evt) { /*{{{*/
     if (ret == kDataNotEnough) { /*{{{*/
       if (have_read) {
         LOG_ERR("fd:%d has been read, no need read, ret:%d", fd);
-        return kOk;  // NOTE;htt, no need read again
+        conn.req_buf.Shrink();  // NOTE:htt, drained connection returns its buffer to pool
+        return kOk;             // NOTE;htt, no need read again
       }
 
-      int r = read(fd, read_buf, kBufLen);
+      // NOTE:htt, read into buffer directly, and frames are cut out of it without copying
+      ret = conn.req_buf.Reserve(kBufLen);
+      if (ret != kOk) {
+        LOG_ERR("Failed to reserve read buffer of fd:%d, size:%u, ret:%d", fd, conn.req_buf.RealDataSize(), ret);
+        CloseConn(conn);
+        return ret;
+      }
+
+      int r = read(fd, conn.req_buf.WritableDataPtr(), conn.req_buf.WritableSize());
       if (r == 0 || (r == -1 && errno != EAGAIN)) {
         LOG_ERR("Failed to read fd:%d, ret:%d", fd, r);
         CloseConn(conn);
@@ -427,33 +900,34 @@ Code ConnWorker::ClientEventInInternalAction(int fd, int evt) { /*{{{*/
       }
 
       if (r == -1 && errno == EAGAIN) {  // NOTE:htt, no data, then wait again
+        conn.req_buf.Shrink();
         return kOk;
       }
 
-      conn.req_content.append(read_buf, r);
+      conn.req_buf.Commit(r);
+      conn.last_active_ms = worker_loop_->GetNowMs();
       have_read = true;
       continue;
     } /*}}}*/
 
     // NOTE:htt, execute
-    if (real_len <= 0 || real_len > conn.req_content.size()) {
-      LOG_ERR("Invalid real_len%d, req content size:%zu", real_len, conn.req_content.size());
+    if (real_len <= 0 || (uint32_t)real_len > conn.req_buf.RealDataSize()) {
+      LOG_ERR("Invalid real_len%d, req content size:%u", real_len, conn.req_buf.RealDataSize());
       CloseConn(conn);
       return kDataDealFailed;
     }
 
-    ret = SendRequestToRealWorker(conn.req_content, real_len, conn.fd, conn.id);
+    // NOTE:htt, pending is decreased by the response of RealWorker, which may be empty if request failed
+    BufferSlice frame;
+    ++conn.pending_num;
+    ret = conn.req_buf.Cut(real_len, &frame);
+    if (ret == kOk) ret = SendRequestToRealWorker(&frame, conn.fd, conn.id);
     if (ret != kOk) {
+      --conn.pending_num;
       LOG_ERR("Failed to send request to real work! ret:%d, fd:%d, id:%lu", ret, conn.fd, conn.id);
       CloseConn(conn);
       return kDataDealFailed;
     }
-
-    if (real_len == conn.req_content.size()) {
-      conn.req_content.clear();
-    } else {
-      conn.req_content = conn.req_content.substr(real_len);
-    }
   }
 
   return kOk;
@@ -472,70 +946,79 @@ Code ConnWorker::ClientEventOutInternalAction(int fd, int evt) { /*{{{*/
   TcpConn &conn = it->second;
   assert(fd == conn.fd);
 
-  int left_len = conn.rsp_content.size();
-  while (left_len > 0) {
-    int r = write(fd, conn.rsp_content.data() + conn.rsp_content.size() - left_len, left_len);
+  if (conn.pending_send != NULL) {  // NOTE:htt, responses are being sent by io_uring, see SendCompletionAction
+    MutexLock ml(&mu_);
+    worker_loop_->Mod(fd, EV_IN, ClientEventAction, this);
+    return kOk;
+  }
+
+  std::deque<BufferSlice> &slices = conn.rsp_slices;
+  while (!slices.empty()) {
+    // NOTE:htt, queued responses are written together without being joined
+    struct iovec iov[kMaxWriteIovNum];
+    int iov_num = 0;
+    std::deque<BufferSlice>::iterator s_it = slices.begin();
+    for (; s_it != slices.end() && iov_num < kMaxWriteIovNum; ++s_it, ++iov_num) {
+      iov[iov_num].iov_base = const_cast<char *>(s_it->Data());
+      iov[iov_num].iov_len = s_it->Size();
+    }
+
+    ssize_t r = writev(fd, iov, iov_num);
     if (r == 0 || (r == -1 && errno != EAGAIN)) {
-      LOG_ERR("Failed to write fd:%d, ret:%d", fd, r);
+      LOG_ERR("Failed to write fd:%d, ret:%zd", fd, r);
       TcpConn tmp_conn;
       tmp_conn.fd = fd;
       CloseConn(tmp_conn);
       return kSocketError;
     }
     if (r == -1 && errno == EAGAIN) {  // NOTE:htt, no space, then wait again
-      conn.rsp_content = conn.rsp_content.substr(conn.rsp_content.size() - left_len);
       return kOk;
     }
-    left_len -= r;
+
+    size_t written_len = r;
+    while (written_len > 0) {
+      if (written_len < slices.front().Size()) {
+        slices.front().Skip(written_len);
+        break;
+      }
+      written_len -= slices.front().Size();
+      slices.pop_front();
+    }
   }
 
   MutexLock ml(&mu_);
-  conn.rsp_content.clear();
   worker_loop_->Mod(fd, EV_IN, ClientEventAction, this);  // NOTE:htt, just need read
 
   return kOk;
 } /*}}}*/
 
-Code ConnWorker::SendRequestToRealWorker(const std::string &req_content, int real_len, int fd, uint64_t id) { /*{{{*/
-  if (req_content.empty() || real_len <= 0 || real_len > req_content.size()) return kInvalidParam;
+Code ConnWorker::SendRequestToRealWorker(BufferSlice *frame, int fd, uint64_t id) { /*{{{*/
+  if (frame == NULL || frame->Empty()) return kInvalidParam;
   OneDataBlock request_data_block;
-  request_data_block.real_data.assign(req_content.data(), real_len);
+  request_data_block.real_data = std::move(*frame);
   request_data_block.id = id;
   request_data_block.fd = fd;
   request_data_block.conn_worker = this;
 
-  int n = ThreadSafeRand() % (server_->real_workers_.size());
+  int n = server_->real_dispatcher_.Select(fd);
   RealWorker *worker = server_->real_workers_[n];
-  Code ret = worker->AddOneDataBlockAndNotify(request_data_block);
+  Code ret = worker->AddOneDataBlockAndNotify(&request_data_block);
   if (ret != kOk) {
     LOG_ERR("Failed to Add one data block to real worker! ret:%d, fd:%d, id:%" PRIu64 "\n", ret, fd, id);
   }
-  return kOk;
+  return ret;
 } /*}}}*/
 
-Code ConnWorker::AddResponseAndNotify(const OneDataBlock &one_data_block) { /*{{{*/
-  MutexLock ml(&data_mu_);
-  resp_data_blocks_.push_back(one_data_block);
-  // LOG_ERR("try to add resp id:%lu fd:%d to conn worker!", (unsigned long)one_data_block.id, one_data_block.fd);
-
-  char buf[1] = {'1'};
-  int ret = write(data_notify_fds_[1], buf, sizeof(buf));
-  if (ret == -1) return kWriteError;
-
-  return kOk;
+Code ConnWorker::AddResponseAndNotify(OneDataBlock *one_data_block) { /*{{{*/
+  // LOG_ERR("try to add resp id:%lu fd:%d to conn worker!", (unsigned long)one_data_block->id, one_data_block->fd);
+  return resp_queue_.PushAndNotify(one_data_block);
 } /*}}}*/
 
 Code ConnWorker::RespDataNotifyEventInternalAction(int fd) { /*{{{*/
-  char buf[1];
-  assert(fd == data_notify_fds_[0]);
-  int ret = read(data_notify_fds_[0], buf, sizeof(buf));
-  if (ret == -1) return kReadError;
-
+  assert(fd == resp_queue_.GetNotifyFd());
   std::deque<OneDataBlock> tmp_data_blocks;
-  {
-    MutexLock ml(&data_mu_);
-    tmp_data_blocks = std::move(resp_data_blocks_);
-  }
+  Code ret = resp_queue_.PopAll(&tmp_data_blocks);
+  if (ret != kOk) return ret;
 
   std::deque<OneDataBlock>::iterator it = tmp_data_blocks.begin();
   while (it != tmp_data_blocks.end()) {
@@ -562,11 +1045,103 @@ Code ConnWorker::DealWithRespOneDataBlock(const OneDataBlock &one_data_block) {
     return kOk;
   }
 
-  it->second.rsp_content.append(one_data_block.real_data);
-  worker_loop_->Mod(one_data_block.fd, EV_IN | EV_OUT, ClientEventAction, this);
+  if (it->second.pending_num > 0) --it->second.pending_num;
+  it->second.last_active_ms = worker_loop_->GetNowMs();
+  if (one_data_block.real_data.Empty()) return kOk;
+
+  it->second.rsp_slices.push_back(one_data_block.real_data);
+  if (io_uring_ == NULL || SubmitSend(&it->second) != kOk) {
+    worker_loop_->Mod(one_data_block.fd, EV_IN | EV_OUT, ClientEventAction, this);
+  }
   return kOk;
 } /*}}}*/
 
+Code ConnWorker::CompletionInternalAction(const IoCompletion &cqe) { /*{{{*/
+  if (cqe.user_data == kAcceptUserData) {
+    if (cqe.res >= 0) {
+      Code r = AcceptConn(cqe.res);
+      if (r != kOk) LOG_ERR("Failed to accept conn:%d, ret:%d", cqe.res, r);
+    } else if (cqe.res != -EAGAIN && cqe.res != -EINTR) {
+      LOG_ERR("Failed to accept, listen fd:%d, res:%d", listen_fd_, cqe.res);
+    }
+    if ((cqe.flags & kIoCompletionFlagMore) == 0) return io_uring_->SubmitAccept(listen_fd_, kAcceptUserData);
+    return kOk;
+  }
+
+  return SendCompletionAction(reinterpret_cast<PendingSend *>(cqe.user_data), cqe.res);
+} /*}}}*/
+
+Code ConnWorker::SubmitSend(TcpConn *conn) { /*{{{*/
+  if (conn->pending_send != NULL) return kOk;  // NOTE:htt, new slices are sent after the pending one completed
+
+  // NOTE:htt, slices are referenced by PendingSend and kept in rsp_slices, until sent bytes are known
+  PendingSend *ps = new PendingSend();
+  ps->fd = conn->fd;
+  ps->id = conn->id;
+  std::deque<BufferSlice>::iterator s_it = conn->rsp_slices.begin();
+  for (int i = 0; s_it != conn->rsp_slices.end() && i < kMaxWriteIovNum; ++s_it, ++i) {
+    ps->slices.push_back(*s_it);
+    ps->iov[i].iov_base = const_cast<char *>(s_it->Data());
+    ps->iov[i].iov_len = s_it->Size();
+  }
+  memset(&ps->msg, 0, sizeof(ps->msg));
+  ps->msg.msg_iov = ps->iov;
+  ps->msg.msg_iovlen = ps->slices.size();
+
+  Code r = io_uring_->SubmitSendMsg(conn->fd, &ps->msg, (uint64_t)(uintptr_t)ps);
+  if (r != kOk) {
+    delete ps;
+    return r;
+  }
+  conn->pending_send = ps;
+  return kOk;
+} /*}}}*/
+
+Code ConnWorker::SendCompletionAction(PendingSend *ps, int res) { /*{{{*/
+  int fd = ps->fd;
+  {
+    MutexLock ml(&mu_);
+    std::map<int, TcpConn>::iterator it = conns_.find(fd);
+    if (it == conns_.end() || it->second.id != ps->id || it->second.pending_send != ps) {
+      delete ps;  // NOTE:htt, conn is closed, and the send is canceled or completed
+      return kNotFound;
+    }
+
+    TcpConn &conn = it->second;
+    conn.pending_send = NULL;
+    delete ps;
+
+    if (res == -EAGAIN || res == -EINTR) {  // NOTE:htt, wait for writable like writev
+      worker_loop_->Mod(fd, EV_IN | EV_OUT, ClientEventAction, this);
+      return kOk;
+    }
+
+    if (res > 0) {
+      std::deque<BufferSlice> &slices = conn.rsp_slices;
+      size_t written_len = res;
+      while (written_len > 0 && !slices.empty()) {
+        if (written_len < slices.front().Size()) {
+          slices.front().Skip(written_len);
+          break;
+        }
+        written_len -= slices.front().Size();
+        slices.pop_front();
+      }
+
+      if (!slices.empty() && SubmitSend(&conn) != kOk) {
+        worker_loop_->Mod(fd, EV_IN | EV_OUT, ClientEventAction, this);
+      }
+      return kOk;
+    }
+  }
+
+  LOG_ERR("Failed to send fd:%d, res:%d", fd, res);
+  TcpConn tmp_conn;
+  tmp_conn.fd = fd;
+  CloseConn(tmp_conn);
+  return kSocketError;
+} /*}}}*/
+
 uint64_t ConnWorker::GeneraterId() { /*{{{*/
   unique_id_++;
   return unique_id_;
@@ -574,9 +1149,17 @@ uint64_t ConnWorker::GeneraterId() { /*{{{*/
 
 Code ConnWorker::CloseConn(const TcpConn &conn) { /*{{{*/
   MutexLock ml(&mu_);
-  close(conn.fd);
-  conns_.erase(conn.fd);
-  Code ret = worker_loop_->Del(conn.fd);
+  int fd = conn.fd;  // NOTE:htt, conn may be the one in conns_, which is destroyed by erase
+  close(fd);
+  std::map<int, TcpConn>::iterator it = conns_.find(fd);
+  if (it != conns_.end()) {
+    if (it->second.idle_timer_id != 0) worker_loop_->CancelTimer(it->second.idle_timer_id);
+    // NOTE:htt, PendingSend is deleted by its completion, which is canceled or failed here
+    if (it->second.pending_send != NULL) io_uring_->SubmitCancel((uint64_t)(uintptr_t)it->second.pending_send);
+    conns_.erase(it);
+    FetchAndAdd(&conn_num_, (uint32_t)-1);
+  }
+  Code ret = worker_loop_->Del(fd);
 
   return ret;
 } /*}}}*/
@@ -610,8 +1193,20 @@ RpcServer::RpcServer(const Config &conf, const Config &user_conf, DataProtoFunc
 
   real_workers_num_ = 0;
 
+  is_reuse_port_ = false;
+
   conn_workers_num_ = 0;
 
+  is_ring_queue_ = false;
+  worker_ring_size_ = kDefaultWorkerRingSize;
+  last_pool_hit_num_ = 0;
+  last_pool_miss_num_ = 0;
+  last_pool_release_num_ = 0;
+  last_real_notify_num_ = 0;
+  last_real_block_num_ = 0;
+  last_resp_notify_num_ = 0;
+  last_resp_block_num_ = 0;
+
   event_type_ = kPoll;
 #if defined(__linux__)
   event_type_ = kEPoll;
@@ -623,10 +1218,20 @@ RpcServer::RpcServer(const Config &conf, const Config &user_conf, DataProtoFunc
   // stat_ 智能指针默认初始化为空
 
   stat_dump_circle_ = 0;
+  conn_idle_timeout_ms_ = kDefaultConnIdleTimeoutMs;
+  is_real_coroutine_ = false;
+  real_coroutine_stack_kb_ = kDefaultRealCoroutineStackKb;
+  real_pool_ = NULL;
 } /*}}}*/
 
 RpcServer::~RpcServer() { /*{{{*/
   is_running_ = false;
+  // NOTE:htt, tasks in pool refer to workers, so they are finished first
+  if (real_pool_ != NULL) {
+    delete real_pool_;
+    real_pool_ = NULL;
+  }
+
   std::deque<RealWorker *>::iterator real_it = real_workers_.begin();
   while (real_it != real_workers_.end()) {
     delete (*real_it);
@@ -652,9 +1257,6 @@ RpcServer::~RpcServer() { /*{{{*/
     close(serv_fd_);
     serv_fd_ = -1;
   }
-
-  // stat_id_ 线程join
-  pthread_join(stat_id_, NULL);
 } /*}}}*/
 
 Code RpcServer::Init() { /*{{{*/
@@ -671,6 +1273,74 @@ Code RpcServer::Init() { /*{{{*/
   if (ret != kOk) return ret;
   if (conn_workers_num_ <= 0) conn_workers_num_ = kDefaultConnWorkersNum;
 
+  std::string accept_mode;
+  ret = conf_.GetValue(kAcceptModeKey, kMainAcceptMode, &accept_mode);
+  if (ret != kOk) return ret;
+  if (accept_mode != kMainAcceptMode && accept_mode != kReusePortAcceptMode) return kInvalidParam;
+  is_reuse_port_ = (accept_mode == kReusePortAcceptMode);
+
+  std::string queue_mode;
+  ret = conf_.GetValue(kWorkerQueueModeKey, kWorkerQueuePipeMode, &queue_mode);
+  if (ret != kOk) return ret;
+  if (queue_mode != kWorkerQueuePipeMode && queue_mode != kWorkerQueueRingMode) return kInvalidParam;
+  is_ring_queue_ = (queue_mode == kWorkerQueueRingMode);
+
+  ret = conf_.GetInt32Value(kWorkerRingSizeKey, kDefaultWorkerRingSize, &worker_ring_size_);
+  if (ret != kOk) return ret;
+  if (worker_ring_size_ <= 0) worker_ring_size_ = kDefaultWorkerRingSize;
+
+  DispatchPolicy real_policy = kRandomPolicy;
+  std::string policy_name;
+  ret = conf_.GetValue(kRealDispatchPolicyKey, kRandomDispatch, &policy_name);
+  if (ret != kOk) return ret;
+  ret = GetDispatchPolicy(policy_name, &real_policy);
+  if (ret != kOk) return ret;
+
+  DispatchPolicy conn_policy = kRandomPolicy;
+  ret = conf_.GetValue(kConnDispatchPolicyKey, kRandomDispatch, &policy_name);
+  if (ret != kOk) return ret;
+  ret = GetDispatchPolicy(policy_name, &conn_policy);
+  if (ret != kOk) return ret;
+
+  int pool_high_water_mb = 0;
+  ret = conf_.GetInt32Value(kBufferPoolHighWaterKey, kDefaultBufferPoolHighWaterMb, &pool_high_water_mb);
+  if (ret != kOk) return ret;
+  if (pool_high_water_mb < 0) pool_high_water_mb = kDefaultBufferPoolHighWaterMb;
+  BufferPool::Instance()->SetHighWaterBytes(static_cast<uint64_t>(pool_high_water_mb) * 1024 * 1024);
+
+  ret = conf_.GetInt32Value(kConnIdleTimeoutKey, kDefaultConnIdleTimeoutMs, &conn_idle_timeout_ms_);
+  if (ret != kOk) return ret;
+  if (conn_idle_timeout_ms_ < 0) conn_idle_timeout_ms_ = kDefaultConnIdleTimeoutMs;
+
+  int is_real_coroutine = 0;
+  ret = conf_.GetInt32Value(kRealWorkerCoroutineKey, 0, &is_real_coroutine);
+  if (ret != kOk) return ret;
+  is_real_coroutine_ = (is_real_coroutine != 0);
+
+  ret = conf_.GetInt32Value(kRealCoroutineStackKey, kDefaultRealCoroutineStackKb, &real_coroutine_stack_kb_);
+  if (ret != kOk) return ret;
+  if (real_coroutine_stack_kb_ <= 0) real_coroutine_stack_kb_ = kDefaultRealCoroutineStackKb;
+
+  int pool_core_threads = 0;
+  ret = conf_.GetInt32Value(kRealPoolCoreThreadsKey, kDefaultRealPoolCoreThreads, &pool_core_threads);
+  if (ret != kOk) return ret;
+  int pool_max_threads = 0;
+  ret = conf_.GetInt32Value(kRealPoolMaxThreadsKey, pool_core_threads, &pool_max_threads);
+  if (ret != kOk) return ret;
+  int pool_keep_alive_ms = 0;
+  ret = conf_.GetInt32Value(kRealPoolKeepAliveKey, kDefaultPoolKeepAliveMs, &pool_keep_alive_ms);
+  if (ret != kOk) return ret;
+  if (pool_keep_alive_ms <= 0) pool_keep_alive_ms = kDefaultPoolKeepAliveMs;
+  if (pool_core_threads > 0) {
+    if (is_real_coroutine_) LOG_ERR("%s is ignored since pool is used", kRealWorkerCoroutineKey);
+    real_pool_ = new WorkStealingPool();
+    ret = real_pool_->Init(pool_core_threads, pool_max_threads, pool_keep_alive_ms);
+    if (ret != kOk) return ret;
+    last_real_pool_exec_nums_.assign(real_pool_->GetMaxThreadsNum(), 0);
+    last_real_pool_steal_nums_.assign(real_pool_->GetMaxThreadsNum(), 0);
+    last_real_pool_queue_us_.assign(real_pool_->GetMaxThreadsNum(), 0);
+  }
+
   ret = conf_.GetInt32Value(kFlowRestrictKey, kMaxFlowRestrict, &max_flow_);
   if (ret != kOk) return ret;
 
@@ -691,28 +1361,31 @@ Code RpcServer::Init() { /*{{{*/
 
   if (action_ == NULL || req_prototype_ == NULL || resp_prototype_ == NULL) return kInvalidParam;
 
-  serv_fd_ = socket(AF_INET, SOCK_STREAM, 0);
-  if (serv_fd_ == -1) return kSocketError;
-
-  ret = SetFdReused(serv_fd_);
+  std::string event_type_name;
+  ret = conf_.GetValue(kEventTypeKey, "", &event_type_name);
   if (ret != kOk) return ret;
-  ret = SetFdNonblock(serv_fd_);
-  if (ret != kOk) return ret;
-
-  struct sockaddr_in serv_addr;
-  serv_addr.sin_family = AF_INET;
-  serv_addr.sin_port = htons(port_);
-  serv_addr.sin_addr.s_addr = htonl(INADDR_ANY);
-
-  int r = bind(serv_fd_, (struct sockaddr *)(&serv_addr), sizeof(serv_addr));
-  if (r == -1) return kBindError;
-
-  r = listen(serv_fd_, kDefaultBacklog);
-  if (r == -1) return kListenError;
+  if (!event_type_name.empty()) {
+    ret = GetEventType(event_type_name, &event_type_);
+    if (ret != kOk) return ret;
+  }
 
+  // NOTE:htt, in reuseport mode every ConnWorker listens by itself, and main loop is left idle
   main_loop_ = new EventLoop();
   main_loop_->Init(event_type_);
-  main_loop_->Add(serv_fd_, EV_IN, AcceptEventAction, this);
+  if (event_type_ == kIoUring && main_loop_->GetIoUring() == NULL) {
+    LOG_ERR("io_uring is not supported, and fall back to epoll/poll");
+  }
+  if (!is_reuse_port_) {
+    ret = CreateListenFd(port_, false, &serv_fd_);
+    if (ret != kOk) return ret;
+    if (main_loop_->GetIoUring() != NULL) {
+      main_loop_->SetCompletionFunc(AcceptCompletionAction, this);
+      ret = main_loop_->GetIoUring()->SubmitAccept(serv_fd_, kAcceptUserData);
+    } else {
+      ret = main_loop_->Add(serv_fd_, EV_IN, AcceptEventAction, this);
+    }
+    if (ret != kOk) return ret;
+  }
 
   for (int i = 0; i < real_workers_num_; ++i) {
     RealWorker *worker = new RealWorker(this);
@@ -726,6 +1399,14 @@ Code RpcServer::Init() { /*{{{*/
   }
   if (real_workers_.size() == 0) return kInvalidParam;
 
+  std::vector<const uint32_t *> depths;
+  for (size_t i = 0; i < real_workers_.size(); ++i) {
+    depths.push_back(real_workers_[i]->GetQueueDepth());
+  }
+  ret = real_dispatcher_.Init(real_policy, depths);
+  if (ret != kOk) return ret;
+  last_real_dispatch_nums_.assign(real_workers_.size(), 0);
+
   for (int i = 0; i < conn_workers_num_; ++i) {
     ConnWorker *worker = new ConnWorker(this);
     Code inner_r = worker->Init();
@@ -738,8 +1419,20 @@ Code RpcServer::Init() { /*{{{*/
   }
   if (conn_workers_.size() == 0) return kInvalidParam;
 
+  depths.clear();
+  for (size_t i = 0; i < conn_workers_.size(); ++i) {
+    depths.push_back(conn_workers_[i]->GetQueueDepth());
+  }
+  ret = conn_dispatcher_.Init(conn_policy, depths);
+  if (ret != kOk) return ret;
+  last_conn_dispatch_nums_.assign(conn_workers_.size(), 0);
+
   is_running_ = true;
-  pthread_create(&stat_id_, NULL, StatThreadAction, this);
+
+  // NOTE:htt, stat is dumped by timer of main loop instead of a thread
+  if (stat_dump_circle_ <= 0) stat_dump_circle_ = kDefaultStatDumpCircle;
+  ret = main_loop_->AddTimer(stat_dump_circle_ * 1000, [this]() { DumpStatAction(); }, NULL);
+  if (ret != kOk) return ret;
 
   srand(time(nullptr));
   return kOk;
@@ -756,24 +1449,173 @@ Code RpcServer::AcceptEventInternalAction(int fd, int evt) { /*{{{*/
   int client_fd = accept(fd, (struct sockaddr *)(&client_addr), &client_addr_len);
   if (client_fd == -1) return kAcceptError;
 
+  return DispatchConn(client_fd, ntohl(client_addr.sin_addr.s_addr));
+} /*}}}*/
+
+Code RpcServer::AcceptCompletionInternalAction(const IoCompletion &cqe) { /*{{{*/
+  if (cqe.res >= 0) {
+    uint32_t client_ip = 0;
+    if (conn_dispatcher_.GetPolicy() == kAffinityPolicy) {  // NOTE:htt, only affinity needs ip of client
+      struct sockaddr_in client_addr;
+      socklen_t client_addr_len = sizeof(client_addr);
+      if (getpeername(cqe.res, (struct sockaddr *)(&client_addr), &client_addr_len) == 0) {
+        client_ip = ntohl(client_addr.sin_addr.s_addr);
+      }
+    }
+    Code r = DispatchConn(cqe.res, client_ip);
+    if (r != kOk) LOG_ERR("Failed to dispatch conn:%d, ret:%d", cqe.res, r);
+  } else if (cqe.res != -EAGAIN && cqe.res != -EINTR) {
+    LOG_ERR("Failed to accept, listen fd:%d, res:%d", serv_fd_, cqe.res);
+  }
+
+  if ((cqe.flags & kIoCompletionFlagMore) != 0) return kOk;
+  return main_loop_->GetIoUring()->SubmitAccept(serv_fd_, kAcceptUserData);
+} /*}}}*/
+
+Code RpcServer::DispatchConn(int client_fd, uint32_t client_ip) { /*{{{*/
   Code r = SetFdReused(client_fd);
-  if (r != kOk) return r;
-  r = SetFdNonblock(client_fd);
-  if (r != kOk) return r;
+  if (r == kOk) r = SetFdNonblock(client_fd);
+  if (r == kOk) r = SetFdNoDelay(client_fd);
+  if (r != kOk) {
+    close(client_fd);
+    return r;
+  }
 
   assert(conn_workers_.size() > 0);
-  int n = ThreadSafeRand() % (conn_workers_.size());
+  int n = conn_dispatcher_.Select(client_ip);
   ConnWorker *worker = conn_workers_[n];
-  r = worker->AddClientFdAndNotify(client_fd);
-
-  return r;
+  return worker->AddClientFdAndNotify(client_fd);
 } /*}}}*/
 
 Code RpcServer::DumpStatAction() { /*{{{*/
-  while (true) {
-    sleep(stat_dump_circle_);
-    stat_->DumpStat();
+  AddQueueStat();
+  AddDispatchStat();
+  AddBufferPoolStat();
+  AddRealPoolStat();
+  stat_->DumpStat();
+
+  return main_loop_->AddTimer(stat_dump_circle_ * 1000, [this]() { DumpStatAction(); }, NULL);
+} /*}}}*/
+
+/**
+ * NOTE:htt, count of blocks and notify writes between workers in this circle,
+ * which shows how many wakeup syscalls are saved by ring mode
+ */
+Code RpcServer::AddQueueStat() { /*{{{*/
+  uint64_t real_notify_num = 0;
+  uint64_t real_block_num = 0;
+  std::deque<RealWorker *>::iterator real_it = real_workers_.begin();
+  for (; real_it != real_workers_.end(); ++real_it) {
+    real_notify_num += (*real_it)->GetRequestQueue().GetNotifyNum();
+    real_block_num += (*real_it)->GetRequestQueue().GetBlockNum();
+  }
+
+  uint64_t resp_notify_num = 0;
+  uint64_t resp_block_num = 0;
+  std::deque<ConnWorker *>::iterator conn_it = conn_workers_.begin();
+  for (; conn_it != conn_workers_.end(); ++conn_it) {
+    resp_notify_num += (*conn_it)->GetRespQueue().GetNotifyNum();
+    resp_block_num += (*conn_it)->GetRespQueue().GetBlockNum();
+  }
+
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  const char *mode = is_ring_queue_ ? kWorkerQueueRingMode : kWorkerQueuePipeMode;
+  std::string prefix = std::string("queue_") + mode;
+  stat_->AddStat(prefix + "_request_block", kOk, now, now, 0, 0, real_block_num - last_real_block_num_);
+  stat_->AddStat(prefix + "_request_notify", kOk, now, now, 0, 0, real_notify_num - last_real_notify_num_);
+  stat_->AddStat(prefix + "_resp_block", kOk, now, now, 0, 0, resp_block_num - last_resp_block_num_);
+  stat_->AddStat(prefix + "_resp_notify", kOk, now, now, 0, 0, resp_notify_num - last_resp_notify_num_);
+
+  last_real_notify_num_ = real_notify_num;
+  last_real_block_num_ = real_block_num;
+  last_resp_notify_num_ = resp_notify_num;
+  last_resp_block_num_ = resp_block_num;
+
+  return kOk;
+} /*}}}*/
+
+Code RpcServer::AddDispatchStat() { /*{{{*/
+  struct timeval now;
+  gettimeofday(&now, NULL);
+
+  // NOTE:htt, *_dispatch is the number dispatched in this circle, *_depth is the queue depth at dumping
+  char model[kBufLen];
+  for (size_t i = 0; i < real_workers_.size() && i < last_real_dispatch_nums_.size(); ++i) {
+    uint64_t dispatch_num = real_workers_[i]->GetDispatchNum();
+    snprintf(model, sizeof(model), "real_worker_%zu_dispatch", i);
+    stat_->AddStat(model, kOk, now, now, 0, 0, dispatch_num - last_real_dispatch_nums_[i]);
+    snprintf(model, sizeof(model), "real_worker_%zu_depth", i);
+    stat_->AddStat(model, kOk, now, now, 0, 0, __atomic_load_n(real_workers_[i]->GetQueueDepth(), __ATOMIC_RELAXED));
+    last_real_dispatch_nums_[i] = dispatch_num;
+  }
+
+  for (size_t i = 0; i < conn_workers_.size() && i < last_conn_dispatch_nums_.size(); ++i) {
+    uint64_t dispatch_num = conn_workers_[i]->GetDispatchNum();
+    snprintf(model, sizeof(model), "conn_worker_%zu_dispatch", i);
+    stat_->AddStat(model, kOk, now, now, 0, 0, dispatch_num - last_conn_dispatch_nums_[i]);
+    snprintf(model, sizeof(model), "conn_worker_%zu_depth", i);
+    stat_->AddStat(model, kOk, now, now, 0, 0, __atomic_load_n(conn_workers_[i]->GetQueueDepth(), __ATOMIC_RELAXED));
+    last_conn_dispatch_nums_[i] = dispatch_num;
+  }
+
+  return kOk;
+} /*}}}*/
+
+/**
+ * NOTE:htt, hit/miss/release are counted in this circle, and resident/in_use are kilobytes at dumping;
+ * resident is the idle memory kept by pool, which is limited by kBufferPoolHighWaterKey
+ */
+Code RpcServer::AddBufferPoolStat() { /*{{{*/
+  BufferPoolStat pool_stat;
+  BufferPool::Instance()->GetStat(&pool_stat);
+
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  stat_->AddStat("buffer_pool_hit", kOk, now, now, 0, 0, pool_stat.hit_num - last_pool_hit_num_);
+  stat_->AddStat("buffer_pool_miss", kOk, now, now, 0, 0, pool_stat.miss_num - last_pool_miss_num_);
+  stat_->AddStat("buffer_pool_release", kOk, now, now, 0, 0, pool_stat.release_num - last_pool_release_num_);
+  stat_->AddStat("buffer_pool_resident_kb", kOk, now, now, 0, 0, pool_stat.resident_bytes / 1024);
+  stat_->AddStat("buffer_pool_in_use_kb", kOk, now, now, 0, 0, pool_stat.in_use_bytes / 1024);
+
+  last_pool_hit_num_ = pool_stat.hit_num;
+  last_pool_miss_num_ = pool_stat.miss_num;
+  last_pool_release_num_ = pool_stat.release_num;
+
+  return kOk;
+} /*}}}*/
+
+/**
+ * NOTE:htt, exec/steal are counted in this circle for every thread of pool, and steal shows how many requests
+ * are taken from other busy threads; queue_avg_us/queue_max_us are time of requests waiting in pool
+ */
+Code RpcServer::AddRealPoolStat() { /*{{{*/
+  if (real_pool_ == NULL) return kOk;
+
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  char model[kBufLen];
+  for (size_t i = 0; i < last_real_pool_exec_nums_.size(); ++i) {
+    PoolWorkerStat pool_stat;
+    Code ret = real_pool_->GetWorkerStat(i, &pool_stat);
+    if (ret != kOk) return ret;
+
+    uint64_t exec_num = pool_stat.exec_num - last_real_pool_exec_nums_[i];
+    uint64_t queue_us = pool_stat.queue_us - last_real_pool_queue_us_[i];
+    snprintf(model, sizeof(model), "real_pool_%zu_exec", i);
+    stat_->AddStat(model, kOk, now, now, 0, 0, exec_num);
+    snprintf(model, sizeof(model), "real_pool_%zu_steal", i);
+    stat_->AddStat(model, kOk, now, now, 0, 0, pool_stat.steal_num - last_real_pool_steal_nums_[i]);
+    snprintf(model, sizeof(model), "real_pool_%zu_queue_avg_us", i);
+    stat_->AddStat(model, kOk, now, now, 0, 0, exec_num == 0 ? 0 : queue_us / exec_num);
+    snprintf(model, sizeof(model), "real_pool_%zu_queue_max_us", i);
+    stat_->AddStat(model, kOk, now, now, 0, 0, pool_stat.max_queue_us);
+
+    last_real_pool_exec_nums_[i] = pool_stat.exec_num;
+    last_real_pool_steal_nums_[i] = pool_stat.steal_num;
+    last_real_pool_queue_us_[i] = pool_stat.queue_us;
   }
+  stat_->AddStat("real_pool_threads", kOk, now, now, 0, 0, real_pool_->GetThreadsNum());
 
   return kOk;
 } /*}}}*/
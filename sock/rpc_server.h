@@ -6,21 +6,28 @@
 #define SOCK_RPC_SERVER_H_
 
 #include <stdint.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 
 #include <google/protobuf/message.h>
 
 #include <deque>
 #include <map>
 #include <string>
+#include <vector>
 
 #include "base/config.h"
+#include "base/co_scheduler.h"
 #include "base/event_loop.h"
 #include "base/load_ctrl.h"
 #include "base/log.h"
+#include "base/mpsc_ring.h"
+#include "base/mutable_buffer.h"
 #include "base/mutex.h"
 #include "base/smart_ptr.h"
 #include "base/statistic.h"
 #include "base/status.h"
+#include "base/work_stealing_pool.h"
 #include "sock/base_server.h"
 #include "sock/rpc_proto.h"
 
@@ -29,8 +36,55 @@ namespace base {
 const char kRealWorkerThreadsNumKey[] = "real_worker_thread_num";
 const char kConnWorkerThreadsNumKey[] = "conn_worker_thread_num";
 
+const char kWorkerQueueModeKey[] = "worker_queue_mode";
+const char kWorkerRingSizeKey[] = "worker_ring_size";
+
+const char kWorkerQueuePipeMode[] = "pipe";  // NOTE:htt, mutex + deque, notify 1 byte by pipe per block
+const char kWorkerQueueRingMode[] = "ring";  // NOTE:htt, MPSC ring, notify eventfd once per batch
+
+const char kConnDispatchPolicyKey[] = "conn_dispatch_policy";  // NOTE:htt, choose ConnWorker for new connection
+const char kRealDispatchPolicyKey[] = "real_dispatch_policy";  // NOTE:htt, choose RealWorker for request
+
+const char kBufferPoolHighWaterKey[] = "buffer_pool_high_water_mb";  // NOTE:htt, max idle memory of BufferPool
+const char kConnIdleTimeoutKey[] = "conn_idle_timeout_ms";  // NOTE:htt, 0 means idle connection is never closed
+
+// NOTE:htt, 1 means every request is dealt with in a coroutine of RealWorker, see CoScheduler
+const char kRealWorkerCoroutineKey[] = "real_worker_coroutine";
+const char kRealCoroutineStackKey[] = "real_coroutine_stack_kb";  // NOTE:htt, private stack of one coroutine
+
+// NOTE:htt, >0 means requests are executed by WorkStealingPool, and RealWorker only dispatches them to pool
+const char kRealPoolCoreThreadsKey[] = "real_pool_core_threads";
+const char kRealPoolMaxThreadsKey[] = "real_pool_max_threads";  // NOTE:htt, threads above core exit after idle
+const char kRealPoolKeepAliveKey[] = "real_pool_keep_alive_ms";
+
+const char kRandomDispatch[] = "random";
+const char kRoundRobinDispatch[] = "round_robin";
+const char kLeastQueueDispatch[] = "least_queue";  // NOTE:htt, worker of the smallest queue depth in all workers
+const char kPowerOfTwoDispatch[] = "p2c";          // NOTE:htt, worker of the smaller queue depth in two random ones
+const char kAffinityDispatch[] = "affinity";       // NOTE:htt, hash of client ip for conn, hash of fd for request
+
+enum DispatchPolicy { /*{{{*/
+  kRandomPolicy = 0,
+  kRoundRobinPolicy,
+  kLeastQueuePolicy,
+  kPowerOfTwoPolicy,
+  kAffinityPolicy,
+}; /*}}}*/
+
+Code GetDispatchPolicy(const std::string &policy_name, DispatchPolicy *policy);
+
 const int kDefaultRealWorkersNum = 50;
 const int kDefaultConnWorkersNum = 10;
+const int kDefaultWorkerRingSize = 4096;
+const int kDefaultBufferPoolHighWaterMb = 256;
+const int kDefaultConnIdleTimeoutMs = 0;
+const int kDefaultRealCoroutineStackKb = 128;
+const int kDefaultRealPoolCoreThreads = 0;
+
+const uint32_t kConnMinBufSize = 16 * 1024;         // NOTE:htt, read buffer of one connection
+const uint32_t kConnMaxBufSize = 64 * 1024 * 1024;  // NOTE:htt, connection is closed if one frame is larger
+const int kMaxWriteIovNum = 64;
+const uint64_t kAcceptUserData = 1;  // NOTE:htt, user data of accept in io_uring, and sends use PendingSend pointers
 
 /**
  * @brief Protobuf 版本的 RPC 业务处理函数类型
@@ -46,17 +100,45 @@ class RpcServer;
 class ConnWorker;
 class RealWorker;
 
+/**
+ * NOTE:htt, one sendmsg submitted to io_uring, and slices are referenced until it's completed,
+ * so the memory is valid even if the connection is closed before
+ */
+struct PendingSend { /*{{{*/
+  int fd;
+  uint64_t id;
+  std::vector<BufferSlice> slices;
+  struct iovec iov[kMaxWriteIovNum];
+  struct msghdr msg;
+}; /*}}}*/
+
+/**
+ * NOTE:htt, request is read into req_buf directly and every frame is cut out as a slice without copying;
+ * responses are queued as slices and written together by writev, or by sendmsg of io_uring
+ */
 struct TcpConn { /*{{{*/
-  std::string req_content;
+  MutableBuffer req_buf;
   uint64_t id;
   int fd;
-  std::string rsp_content;
-
-  TcpConn() : id(0), fd(0) {}
+  std::deque<BufferSlice> rsp_slices;
+
+  uint64_t last_active_ms;  // NOTE:htt, time of last read or response, see EventLoop::GetNowMs
+  uint64_t idle_timer_id;   // NOTE:htt, 0 if no idle timer
+  uint32_t pending_num;     // NOTE:htt, requests sent to RealWorker and not responded
+  PendingSend *pending_send;  // NOTE:htt, sendmsg of io_uring not completed, NULL if none
+
+  TcpConn()
+      : req_buf(kConnMinBufSize, kConnMaxBufSize),
+        id(0),
+        fd(0),
+        last_active_ms(0),
+        idle_timer_id(0),
+        pending_num(0),
+        pending_send(NULL) {}
 }; /*}}}*/
 
 struct OneDataBlock { /*{{{*/
-  std::string real_data;
+  BufferSlice real_data;  // NOTE:htt, one whole frame
   uint64_t id;
   int fd;
   ConnWorker *conn_worker;
@@ -64,6 +146,83 @@ struct OneDataBlock { /*{{{*/
   OneDataBlock() : id(0), fd(0), conn_worker(NULL) {}
 }; /*}}}*/
 
+/**
+ * Queue of OneDataBlock from many threads to the thread of one worker.
+ * Pipe mode: blocks are pushed into deque under mutex, and every block writes 1 byte to the pipe;
+ * Ring mode: blocks are pushed into a bounded MPSC ring, and only the first block after the consumer
+ * has waked up writes the eventfd, so one wakeup serves a whole batch; the deque is kept for overflow
+ * when the ring is full, so no block is lost.
+ */
+class DataBlockQueue { /*{{{*/
+ public:
+  DataBlockQueue();
+  ~DataBlockQueue();
+
+ public:
+  Code Init(bool is_ring_mode, int ring_size);
+
+  // NOTE:htt, fd which should be added into EventLoop of consumer with EV_IN
+  int GetNotifyFd() const { return notify_fds_[0]; }
+
+  // NOTE:htt, kInvalidParam means the block is not queued; other errors mean notify failed, and the block is queued
+  Code PushAndNotify(OneDataBlock *one_data_block);
+
+  // NOTE:htt, called by consumer when notify fd is readable
+  Code PopAll(std::deque<OneDataBlock> *data_blocks);
+
+  uint64_t GetNotifyNum() const { return __atomic_load_n(&notify_num_, __ATOMIC_RELAXED); }
+  uint64_t GetBlockNum() const { return __atomic_load_n(&block_num_, __ATOMIC_RELAXED); }
+  uint32_t GetApproximateSize();
+
+ private:
+  Code Notify();
+  void CloseFdSafely(int &fd);
+
+ private:
+  bool is_ring_mode_;
+  MpscRing<OneDataBlock> *ring_;
+  std::deque<OneDataBlock> data_blocks_;
+  uint32_t overflow_num_;
+  Mutex mu_;
+
+  int notify_fds_[2];  // NOTE:htt, eventfd of ring mode is in both notify_fds_[0] and notify_fds_[1]
+  uint32_t is_notified_;
+
+  uint64_t notify_num_;  // NOTE:htt, times of writing notify fd
+  uint64_t block_num_;
+
+ private:
+  DataBlockQueue(const DataBlockQueue &);
+  DataBlockQueue &operator=(const DataBlockQueue &);
+}; /*}}}*/
+
+/**
+ * Choose one worker by policy. Queue depth of every worker is read from the registered counter,
+ * which is updated by the worker atomically, so choosing needs no lock.
+ */
+class WorkerDispatcher { /*{{{*/
+ public:
+  WorkerDispatcher();
+  ~WorkerDispatcher();
+
+ public:
+  // NOTE:htt, depths[i] points to queue depth of worker i
+  Code Init(DispatchPolicy policy, const std::vector<const uint32_t *> &depths);
+
+  // NOTE:htt, return index of the chosen worker, affinity_key is only used by kAffinityPolicy
+  int Select(uint64_t affinity_key);
+
+  DispatchPolicy GetPolicy() const { return policy_; }
+
+ private:
+  uint32_t GetDepth(uint32_t index) const { return __atomic_load_n(depths_[index], __ATOMIC_RELAXED); }
+
+ private:
+  DispatchPolicy policy_;
+  std::vector<const uint32_t *> depths_;
+  uint32_t next_;  // NOTE:htt, round robin index, also the start of scanning by kLeastQueuePolicy
+}; /*}}}*/
+
 class RealWorker { /*{{{*/
  public:
   explicit RealWorker(RpcServer *server);
@@ -73,29 +232,45 @@ class RealWorker { /*{{{*/
   Code Init();
   Code Run();
 
-  Code AddOneDataBlockAndNotify(const OneDataBlock &one_data_block);
+  // NOTE:htt, content of one_data_block is moved into queue
+  Code AddOneDataBlockAndNotify(OneDataBlock *one_data_block);
   Code NotifyEventInternalAction(int fd);
 
   Code DealWithRequestOneDataBlock(const OneDataBlock &one_data_block);
 
+  const DataBlockQueue &GetRequestQueue() const { return request_queue_; }
+
+  // NOTE:htt, requests which are queued or being dealt with
+  const uint32_t *GetQueueDepth() const { return &queue_depth_; }
+  uint64_t GetDispatchNum() const { return request_queue_.GetBlockNum(); }
+
+ private:
+  // NOTE:htt, response of frame error uses the same framing as request
+  Code AddFrameErrorResponse(const OneDataBlock &one_data_block, bool is_multiplex, uint64_t req_id,
+                             Code frame_code);
+  // NOTE:htt, failed request without response to client, which only decreases pending of connection
+  Code AddEmptyResponse(const OneDataBlock &one_data_block);
+
+  // NOTE:htt, head and response are serialized into one slice in place, except user defined FormatUserDataFunc
+  Code FormatResponse(bool is_multiplex, uint64_t req_id, const ::google::protobuf::Message &resp,
+                      BufferSlice *resp_data);
+
  private:
-  std::deque<OneDataBlock> request_data_blocks_;
+  DataBlockQueue request_queue_;
+  uint32_t queue_depth_;
   pthread_t worker_id_;
 
   RpcServer *server_;
 
-  int notify_fds_[2];
   EventType event_type_;
-  EventLoop *worker_loop_;
-
-  Mutex mu_;
+  EventLoop *worker_loop_;  // NOTE:htt, loop of co_sched_ in coroutine mode
+  CoScheduler *co_sched_;   // NOTE:htt, NULL if requests are not dealt with in coroutines, or pool is used
 
   LoadCtrl flow_ctrl_;
 
   DataProtoFunc data_proto_func_;  // NOTE:htt, get data from tcp
 
  private:
-  void CloseFdSafely(int &fd);
   RealWorker(const RealWorker &w);
   RealWorker &operator=(const RealWorker &w);
 }; /*}}}*/
@@ -111,38 +286,55 @@ class ConnWorker { /*{{{*/
 
   Code AddClientFdAndNotify(int fd);
   Code NotifyEventInternalAction(int fd);
+  Code AcceptEventInternalAction(int fd, int evt);
   Code RespDataNotifyEventInternalAction(int fd);
   Code ClientEventInternalAction(int fd, int evt);
   Code ClientEventInInternalAction(int fd, int evt);
   Code ClientEventOutInternalAction(int fd, int evt);
 
-  Code SendRequestToRealWorker(const std::string &content, int real_len, int fd, uint64_t id);
-  Code AddResponseAndNotify(const OneDataBlock &one_data_block);
+  // NOTE:htt, frame is moved to RealWorker
+  Code SendRequestToRealWorker(BufferSlice *frame, int fd, uint64_t id);
+  Code AddResponseAndNotify(OneDataBlock *one_data_block);
 
   Code DealWithRespOneDataBlock(const OneDataBlock &one_data_block);
+  Code IdleTimeoutAction(int fd, uint64_t id);
+  Code CompletionInternalAction(const IoCompletion &cqe);
+
+  const DataBlockQueue &GetRespQueue() const { return resp_queue_; }
+
+  // NOTE:htt, connections which are added and not closed
+  const uint32_t *GetQueueDepth() const { return &conn_num_; }
+  uint64_t GetDispatchNum() const { return __atomic_load_n(&accept_num_, __ATOMIC_RELAXED); }
 
  public:
   uint64_t GeneraterId();
 
  private:
+  Code AcceptConn(int client_fd);
+  Code AddConn(int client_fd);
+  Code AddIdleTimer(TcpConn *conn, uint32_t timeout_ms);
+  Code SubmitSend(TcpConn *conn);
+  Code SendCompletionAction(PendingSend *pending_send, int res);
   Code CloseConn(const TcpConn &conn);
   void CloseFdSafely(int &fd);
 
  private:
   std::deque<int> cli_fds_;
   std::map<int, TcpConn> conns_;
-  std::deque<OneDataBlock> resp_data_blocks_;
+  DataBlockQueue resp_queue_;
+  uint32_t conn_num_;
+  uint64_t accept_num_;
   pthread_t worker_id_;
 
   RpcServer *server_;
 
   int notify_fds_[2];
-  int data_notify_fds_[2];
+  int listen_fd_;  // NOTE:htt, only used in reuseport accept mode
   EventType event_type_;
   EventLoop *worker_loop_;
+  EventIoUring *io_uring_;  // NOTE:htt, NULL if io_uring is not used
 
   Mutex mu_;
-  Mutex data_mu_;
 
   LoadCtrl flow_ctrl_;
 
@@ -167,6 +359,15 @@ class RpcServer : public BaseServer { /*{{{*/
 
   Code DumpStatAction();
   Code AcceptEventInternalAction(int fd, int evt);
+  Code AcceptCompletionInternalAction(const IoCompletion &cqe);
+
+ private:
+  Code AddQueueStat();
+  Code AddDispatchStat();
+  Code AddBufferPoolStat();
+  Code AddRealPoolStat();
+
+  Code DispatchConn(int client_fd, uint32_t client_ip);
 
   DataProtoFunc GetDataProtoFunc() { return data_proto_func_; }
 
@@ -193,14 +394,37 @@ class RpcServer : public BaseServer { /*{{{*/
   int conn_workers_num_;
   std::deque<ConnWorker *> conn_workers_;
 
-  EventType event_type_;
+  bool is_reuse_port_;  // NOTE:htt, see kAcceptModeKey
+  bool is_ring_queue_;  // NOTE:htt, see kWorkerQueueModeKey
+  int worker_ring_size_;
+  uint64_t last_real_notify_num_;
+  uint64_t last_real_block_num_;
+  uint64_t last_resp_notify_num_;
+  uint64_t last_resp_block_num_;
+
+  WorkerDispatcher real_dispatcher_;  // NOTE:htt, see kRealDispatchPolicyKey
+  WorkerDispatcher conn_dispatcher_;  // NOTE:htt, see kConnDispatchPolicyKey
+  std::vector<uint64_t> last_real_dispatch_nums_;
+  std::vector<uint64_t> last_conn_dispatch_nums_;
+  uint64_t last_pool_hit_num_;
+  uint64_t last_pool_miss_num_;
+  uint64_t last_pool_release_num_;
+
+  EventType event_type_;  // NOTE:htt, see kEventTypeKey
   EventLoop *main_loop_;
 
   int max_flow_;
 
   SmartPtr<Statistic> stat_;
   int stat_dump_circle_;
-  pthread_t stat_id_;
+  int conn_idle_timeout_ms_;  // NOTE:htt, see kConnIdleTimeoutKey
+  bool is_real_coroutine_;    // NOTE:htt, see kRealWorkerCoroutineKey
+  int real_coroutine_stack_kb_;
+
+  WorkStealingPool *real_pool_;  // NOTE:htt, NULL if kRealPoolCoreThreadsKey is 0
+  std::vector<uint64_t> last_real_pool_exec_nums_;
+  std::vector<uint64_t> last_real_pool_steal_nums_;
+  std::vector<uint64_t> last_real_pool_queue_us_;
 
  private:
   friend class RealWorker;
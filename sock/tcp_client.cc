@@ -14,6 +14,7 @@
 #include <unistd.h>
 #include <fstream>
 
+#include "base/co_scheduler.h"
 #include "base/coding.h"
 #include "base/common.h"
 #include "base/log.h"
@@ -157,30 +158,16 @@ Code TcpClient::Connect(const std::string &ip, uint16_t port) { /*{{{*/
 
   if ((errno != EAGAIN) && (errno != EINPROGRESS)) return kConnectError;
 
-  int time_waits = 0;
-  while (true) {
-    r = ev_->Wait(kDefaultWaitTimeMs);
-    // fprintf(stderr, "(%s:%d) now time_waits:%d, r:%d\n", __FILE__, __LINE__, time_waits, r);
-    if (r == kOk) break;
-    if (r == kTimeOut) {
-      time_waits += kDefaultWaitTimeMs;
-      // max_wait_time_ms_ == -1 表示永久等待，不超时
-      // max_wait_time_ms_ >= 0 表示等待指定时间后超时
-      if (max_wait_time_ms_ >= 0 && time_waits >= max_wait_time_ms_) {
-        CloseConnect();
-        return kTimeOut;
-      }
-
-      continue;
-    }
-
-    // Note: Other error, then close
+  int event = 0;
+  r = WaitEvent(EV_OUT, &event);
+  if (r != kOk) {
+    // Note: timeout or other error, then close
     CloseConnect();
     return r;
   }
 
   int sock_err = 0;
-  socklen_t sock_err_len;
+  socklen_t sock_err_len = sizeof(sock_err);
   ret = getsockopt(client_fd_, SOL_SOCKET, SO_ERROR, reinterpret_cast<char *>(&sock_err), &sock_err_len);
   if (ret == -1) {
     CloseConnect();
@@ -219,27 +206,15 @@ Code TcpClient::SendNative(const std::string &data) { /*{{{*/
   Code r = ev_->Mod(client_fd_, EV_OUT | EV_ERR | EV_HUP);
 
   int32_t left_len = data.size();
-  int time_waits = 0;
   while (left_len > 0) {
-    r = ev_->Wait(kDefaultWaitTimeMs);
-    // fprintf(stderr, "(%s:%d) now time_waits:%d, r:%d\n", __FILE__, __LINE__, time_waits, r);
+    int event = 0;
+    r = WaitEvent(EV_OUT | EV_ERR | EV_HUP, &event);
     if (r == kTimeOut) {
-      time_waits += kDefaultWaitTimeMs;
-      // max_wait_time_ms_ == -1 表示永久等待，不超时
-      // max_wait_time_ms_ >= 0 表示等待指定时间后超时
-      if (max_wait_time_ms_ >= 0 && time_waits >= max_wait_time_ms_) {
-        CloseConnect();
-        return kTimeOut;
-      }
-
-      continue;
+      CloseConnect();
+      return kTimeOut;
     }
-    time_waits = 0;
 
     if (r == kOk) {
-      int fd, event;
-      r = ev_->GetEvents(&fd, &event);
-      assert(r == kOk && fd == client_fd_);
       if ((event & EV_ERR) || (event & EV_HUP)) goto err;
 
       int ret = write(client_fd_, data.data() + data.size() - left_len, left_len);
@@ -308,28 +283,16 @@ Code TcpClient::RecvInternal() { /*{{{*/
   if (end_pos_ == total_size_) return kDataBufFull;
 
   Code r = ev_->Mod(client_fd_, EV_IN);
-  int time_waits = 0;
   while (true) {
-    r = ev_->Wait(kDefaultWaitTimeMs);
-    // fprintf(stderr, "(%s:%d) now time_waits:%d, r:%d\n", __FILE__, __LINE__, time_waits, r);
+    int event = 0;
+    r = WaitEvent(EV_IN, &event);
     if (r == kTimeOut) {
-      time_waits += kDefaultWaitTimeMs;
-      // max_wait_time_ms_ == -1 表示永久等待，不超时
-      // max_wait_time_ms_ >= 0 表示等待指定时间后超时
-      if (max_wait_time_ms_ >= 0 && time_waits >= max_wait_time_ms_) {
-        CloseConnect();
-        return kTimeOut;
-      }
-
-      continue;
+      CloseConnect();
+      return kTimeOut;
     }
-    time_waits = 0;
 
     if (r != kOk) goto err;
 
-    int fd, event;
-    r = ev_->GetEvents(&fd, &event);
-    assert(r == kOk && fd == client_fd_);
     if ((event & EV_ERR) || (event & EV_HUP)) goto err;
 
     int ret = read(client_fd_, data_buf_ + end_pos_, total_size_ - end_pos_);
@@ -354,4 +317,30 @@ err:
   return kSocketError;
 } /*}}}*/
 
+Code TcpClient::WaitEvent(int evt, int *fired_evt) { /*{{{*/
+  // NOTE:htt, in a coroutine, only the coroutine waits and other coroutines of the thread go on
+  CoScheduler *sched = CoScheduler::Current();
+  if (sched != NULL) return sched->WaitFd(client_fd_, evt, max_wait_time_ms_, fired_evt);
+
+  int time_waits = 0;
+  while (true) {
+    Code r = ev_->Wait(kDefaultWaitTimeMs);
+    // fprintf(stderr, "(%s:%d) now time_waits:%d, r:%d\n", __FILE__, __LINE__, time_waits, r);
+    if (r == kTimeOut) {
+      time_waits += kDefaultWaitTimeMs;
+      // max_wait_time_ms_ == -1 表示永久等待，不超时
+      // max_wait_time_ms_ >= 0 表示等待指定时间后超时
+      if (max_wait_time_ms_ >= 0 && time_waits >= max_wait_time_ms_) return kTimeOut;
+
+      continue;
+    }
+    if (r != kOk) return r;
+
+    int fd = -1;
+    r = ev_->GetEvents(&fd, fired_evt);
+    assert(r == kOk && fd == client_fd_);
+    return r;
+  }
+} /*}}}*/
+
 }  // namespace base
@@ -56,6 +56,16 @@ class TcpClient : public BaseClient { /*{{{*/
  private:
   Code RecvInternal();
 
+  /**
+   * @brief 等待 client_fd_ 的事件，超时时间为 max_wait_time_ms_
+   *        在 CoScheduler 的协程中调用时只挂起当前协程，不阻塞线程
+   *
+   * @param evt 等待的事件
+   * @param fired_evt 触发的事件（输出）
+   * @return base::kOk 事件触发；base::kTimeOut 超时；其他为错误码
+   */
+  Code WaitEvent(int evt, int *fired_evt);
+
  private:
   Event *ev_;
   int client_fd_;
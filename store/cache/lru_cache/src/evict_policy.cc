@@ -0,0 +1,276 @@
+// Copyright (c) 2015 The CSUTIL Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "evict_policy.h"
+
+namespace store {
+
+const uint32_t kSLRUProtectedPercent = 80;
+const uint32_t kWTinyLFUWindowPercent = 1;
+
+void KeyList::PushFront(const std::string &key) { /*{{{*/
+  keys_.push_front(key);
+  index_[key] = keys_.begin();
+} /*}}}*/
+
+void KeyList::MoveToFront(const std::string &key) { /*{{{*/
+  std::unordered_map<std::string, std::list<std::string>::iterator>::iterator it = index_.find(key);
+  if (it == index_.end()) return;
+
+  keys_.splice(keys_.begin(), keys_, it->second);
+} /*}}}*/
+
+bool KeyList::Remove(const std::string &key) { /*{{{*/
+  std::unordered_map<std::string, std::list<std::string>::iterator>::iterator it = index_.find(key);
+  if (it == index_.end()) return false;
+
+  keys_.erase(it->second);
+  index_.erase(it);
+  return true;
+} /*}}}*/
+
+bool KeyList::PopBack(std::string *key) { /*{{{*/
+  if (keys_.empty()) return false;
+
+  key->swap(keys_.back());
+  index_.erase(*key);
+  keys_.pop_back();
+  return true;
+} /*}}}*/
+
+void KeyList::Clear() { /*{{{*/
+  keys_.clear();
+  index_.clear();
+} /*}}}*/
+
+EvictPolicy *NewEvictPolicy(EvictPolicyType type) { /*{{{*/
+  switch (type) {
+    case kEvictLRU:
+      return new LRUEvictPolicy();
+    case kEvictSLRU:
+      return new SLRUEvictPolicy();
+    case kEvictARC:
+      return new ARCEvictPolicy();
+    case kEvictWTinyLFU:
+      return new WTinyLFUEvictPolicy();
+    default:
+      return NULL;
+  }
+} /*}}}*/
+
+base::Code LRUEvictPolicy::Init(uint32_t capacity) { /*{{{*/
+  if (capacity == 0) return base::kInvalidParam;
+
+  capacity_ = capacity;
+  keys_.Clear();
+  return base::kOk;
+} /*}}}*/
+
+void LRUEvictPolicy::Touch(const std::string &key) { /*{{{*/ keys_.MoveToFront(key); } /*}}}*/
+
+void LRUEvictPolicy::Insert(const std::string &key, std::vector<std::string> *victims) { /*{{{*/
+  keys_.PushFront(key);
+
+  std::string victim;
+  while (keys_.Size() > capacity_ && keys_.PopBack(&victim)) {
+    victims->push_back(victim);
+  }
+} /*}}}*/
+
+void LRUEvictPolicy::Erase(const std::string &key) { /*{{{*/ keys_.Remove(key); } /*}}}*/
+
+base::Code SLRUEvictPolicy::Init(uint32_t capacity) { /*{{{*/
+  if (capacity == 0) return base::kInvalidParam;
+
+  capacity_ = capacity;
+  protected_capacity_ = (uint64_t)capacity * kSLRUProtectedPercent / 100;
+  probation_.Clear();
+  protected_.Clear();
+  return base::kOk;
+} /*}}}*/
+
+void SLRUEvictPolicy::Touch(const std::string &key) { /*{{{*/
+  if (protected_.Contains(key)) {
+    protected_.MoveToFront(key);
+    return;
+  }
+  if (!probation_.Remove(key)) return;
+
+  protected_.PushFront(key);
+  std::string demoted;
+  while (protected_.Size() > protected_capacity_ && protected_.PopBack(&demoted)) {
+    probation_.PushFront(demoted);
+  }
+} /*}}}*/
+
+void SLRUEvictPolicy::Insert(const std::string &key, std::vector<std::string> *victims) { /*{{{*/
+  probation_.PushFront(key);
+
+  std::string victim;
+  while (Size() > capacity_) {
+    if (!probation_.PopBack(&victim)) protected_.PopBack(&victim);
+    victims->push_back(victim);
+  }
+} /*}}}*/
+
+void SLRUEvictPolicy::Erase(const std::string &key) { /*{{{*/
+  if (!probation_.Remove(key)) protected_.Remove(key);
+} /*}}}*/
+
+bool SLRUEvictPolicy::GetVictim(std::string *key) const { /*{{{*/
+  if (probation_.Size() > 0) {
+    *key = probation_.Back();
+    return true;
+  }
+  if (protected_.Size() > 0) {
+    *key = protected_.Back();
+    return true;
+  }
+  return false;
+} /*}}}*/
+
+base::Code ARCEvictPolicy::Init(uint32_t capacity) { /*{{{*/
+  if (capacity == 0) return base::kInvalidParam;
+
+  capacity_ = capacity;
+  target_t1_ = 0;
+  t1_.Clear();
+  t2_.Clear();
+  b1_.Clear();
+  b2_.Clear();
+  return base::kOk;
+} /*}}}*/
+
+void ARCEvictPolicy::Touch(const std::string &key) { /*{{{*/
+  if (t1_.Remove(key)) {
+    t2_.PushFront(key);
+    return;
+  }
+  t2_.MoveToFront(key);
+} /*}}}*/
+
+/**
+ * NOTE: one key of t1 or t2 is evicted into its ghost list if cache is full
+ * 1. t1 is evicted if it's larger than target, or equal to target while the new key is a ghost of b2
+ * 2. otherwise t2 is evicted, and t1 is the fallback if t2 is empty
+ */
+void ARCEvictPolicy::Replace(bool is_in_b2, std::vector<std::string> *victims) { /*{{{*/
+  if (t1_.Size() + t2_.Size() < capacity_) return;
+
+  std::string victim;
+  bool is_evict_t1 = t1_.Size() > 0 && (t1_.Size() > target_t1_ || (is_in_b2 && t1_.Size() == target_t1_));
+  if (is_evict_t1 || t2_.Size() == 0) {
+    t1_.PopBack(&victim);
+    b1_.PushFront(victim);
+  } else {
+    t2_.PopBack(&victim);
+    b2_.PushFront(victim);
+  }
+  victims->push_back(victim);
+} /*}}}*/
+
+void ARCEvictPolicy::Insert(const std::string &key, std::vector<std::string> *victims) { /*{{{*/
+  if (b1_.Contains(key)) {
+    uint32_t delta = (b2_.Size() > b1_.Size()) ? b2_.Size() / b1_.Size() : 1;
+    target_t1_ = (target_t1_ + delta > capacity_) ? capacity_ : target_t1_ + delta;
+    b1_.Remove(key);
+    Replace(false, victims);
+    t2_.PushFront(key);
+    return;
+  }
+
+  if (b2_.Contains(key)) {
+    uint32_t delta = (b1_.Size() > b2_.Size()) ? b1_.Size() / b2_.Size() : 1;
+    target_t1_ = (target_t1_ > delta) ? target_t1_ - delta : 0;
+    b2_.Remove(key);
+    Replace(true, victims);
+    t2_.PushFront(key);
+    return;
+  }
+
+  std::string victim;
+  if (t1_.Size() + b1_.Size() >= capacity_) {
+    if (t1_.Size() < capacity_) {
+      b1_.PopBack(&victim);
+      Replace(false, victims);
+    } else {
+      // NOTE: t1 is the whole cache, so its key is evicted without ghost
+      t1_.PopBack(&victim);
+      victims->push_back(victim);
+    }
+  } else if (t1_.Size() + t2_.Size() + b1_.Size() + b2_.Size() >= capacity_) {
+    if (t1_.Size() + t2_.Size() + b1_.Size() + b2_.Size() >= 2 * capacity_) b2_.PopBack(&victim);
+    Replace(false, victims);
+  }
+  t1_.PushFront(key);
+} /*}}}*/
+
+void ARCEvictPolicy::Erase(const std::string &key) { /*{{{*/
+  if (!t1_.Remove(key)) t2_.Remove(key);
+} /*}}}*/
+
+base::Code WTinyLFUEvictPolicy::Init(uint32_t capacity) { /*{{{*/
+  if (capacity == 0) return base::kInvalidParam;
+
+  window_capacity_ = (uint64_t)capacity * kWTinyLFUWindowPercent / 100;
+  if (window_capacity_ == 0) window_capacity_ = 1;
+  main_capacity_ = capacity - window_capacity_;
+  window_.Clear();
+
+  base::Code ret = base::kOk;
+  if (main_capacity_ > 0) {
+    ret = main_.Init(main_capacity_);
+    if (ret != base::kOk) return ret;
+  }
+
+  return sketch_.Init(capacity);
+} /*}}}*/
+
+void WTinyLFUEvictPolicy::Touch(const std::string &key) { /*{{{*/
+  sketch_.Increment(key);
+  if (window_.Contains(key)) {
+    window_.MoveToFront(key);
+    return;
+  }
+  main_.Touch(key);
+} /*}}}*/
+
+void WTinyLFUEvictPolicy::Insert(const std::string &key, std::vector<std::string> *victims) { /*{{{*/
+  sketch_.Increment(key);
+  window_.PushFront(key);
+
+  std::string candidate;
+  while (window_.Size() > window_capacity_ && window_.PopBack(&candidate)) {
+    Admit(candidate, victims);
+  }
+} /*}}}*/
+
+// NOTE: ties are rejected, so keys of a scan, which are all read once, don't replace each other in main
+void WTinyLFUEvictPolicy::Admit(const std::string &candidate, std::vector<std::string> *victims) { /*{{{*/
+  if (main_capacity_ == 0) {
+    victims->push_back(candidate);
+    return;
+  }
+  if (main_.Size() < main_capacity_) {
+    main_.Insert(candidate, victims);
+    return;
+  }
+
+  std::string victim;
+  main_.GetVictim(&victim);
+  if (sketch_.Estimate(candidate) <= sketch_.Estimate(victim)) {
+    victims->push_back(candidate);
+    return;
+  }
+
+  main_.Erase(victim);
+  victims->push_back(victim);
+  main_.Insert(candidate, victims);
+} /*}}}*/
+
+void WTinyLFUEvictPolicy::Erase(const std::string &key) { /*{{{*/
+  if (!window_.Remove(key)) main_.Erase(key);
+} /*}}}*/
+
+}  // namespace store
@@ -0,0 +1,179 @@
+// Copyright (c) 2015 The CSUTIL Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef STORE_CACHE_EVICT_POLICY_H_
+#define STORE_CACHE_EVICT_POLICY_H_
+
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <stdint.h>
+
+#include "base/count_min_sketch.h"
+#include "base/status.h"
+
+namespace store {
+
+enum EvictPolicyType {
+  kEvictLRU = 0,
+  kEvictSLRU = 1,      // segmented lru, keys read again are protected from keys read once
+  kEvictARC = 2,       // adaptive replacement cache, which balances recency and frequency by ghost keys
+  kEvictWTinyLFU = 3,  // window lru and segmented lru with admission by frequency of count-min sketch
+};
+
+// NOTE: list of keys with hash index, the front is the most recent one
+class KeyList { /*{{{*/
+ public:
+  KeyList() : keys_(), index_() {}
+
+ public:
+  bool Contains(const std::string &key) const { return index_.find(key) != index_.end(); }
+  uint32_t Size() const { return index_.size(); }
+
+  void PushFront(const std::string &key);
+  void MoveToFront(const std::string &key);
+  bool Remove(const std::string &key);
+  bool PopBack(std::string *key);
+  const std::string &Back() const { return keys_.back(); }
+  void Clear();
+
+ private:
+  std::list<std::string> keys_;
+  std::unordered_map<std::string, std::list<std::string>::iterator> index_;
+}; /*}}}*/
+
+/**
+ * NOTE: EvictPolicy decides which keys to evict once cache is full, and it only keeps keys, not values
+ * 1. Touch is called when key in cache is read or written, Insert when a new key is added
+ * 2. Insert appends keys which should be evicted into victims, and the new key itself may be one of them
+ *    if the policy doesn't admit it
+ * 3. Erase is called when key is removed by Del or time expire
+ * 4. it's not thread safe, and it's protected by lock of cache
+ */
+class EvictPolicy { /*{{{*/
+ public:
+  EvictPolicy() {}
+  virtual ~EvictPolicy() {}
+
+ public:
+  virtual base::Code Init(uint32_t capacity) = 0;
+  virtual void Touch(const std::string &key) = 0;
+  virtual void Insert(const std::string &key, std::vector<std::string> *victims) = 0;
+  virtual void Erase(const std::string &key) = 0;
+  virtual const char *GetName() const = 0;
+
+ private:
+  EvictPolicy(const EvictPolicy &);
+  EvictPolicy &operator=(const EvictPolicy &);
+}; /*}}}*/
+
+// NOTE: new policy of type, which should be deleted by caller, and NULL for unknown type
+EvictPolicy *NewEvictPolicy(EvictPolicyType type);
+
+class LRUEvictPolicy : public EvictPolicy { /*{{{*/
+ public:
+  LRUEvictPolicy() : capacity_(0), keys_() {}
+
+ public:
+  virtual base::Code Init(uint32_t capacity);
+  virtual void Touch(const std::string &key);
+  virtual void Insert(const std::string &key, std::vector<std::string> *victims);
+  virtual void Erase(const std::string &key);
+  virtual const char *GetName() const { return "lru"; }
+
+ private:
+  uint32_t capacity_;
+  KeyList keys_;
+}; /*}}}*/
+
+/**
+ * NOTE: new keys are put into probation segment, and moved into protected segment once they're read again
+ * 1. keys are evicted from probation first, so a scan of keys read once doesn't flush protected keys
+ * 2. protected keys out of its capacity are moved back to the front of probation
+ */
+class SLRUEvictPolicy : public EvictPolicy { /*{{{*/
+ public:
+  SLRUEvictPolicy() : capacity_(0), protected_capacity_(0), probation_(), protected_() {}
+
+ public:
+  virtual base::Code Init(uint32_t capacity);
+  virtual void Touch(const std::string &key);
+  virtual void Insert(const std::string &key, std::vector<std::string> *victims);
+  virtual void Erase(const std::string &key);
+  virtual const char *GetName() const { return "slru"; }
+
+  uint32_t Size() const { return probation_.Size() + protected_.Size(); }
+
+  // NOTE: key which would be evicted next, and false if it's empty
+  bool GetVictim(std::string *key) const;
+
+ private:
+  uint32_t capacity_;
+  uint32_t protected_capacity_;
+  KeyList probation_;
+  KeyList protected_;
+}; /*}}}*/
+
+/**
+ * NOTE: ARC of Megiddo and Modha, t1 has keys read once and t2 keys read more than once
+ * 1. b1 and b2 are ghost keys evicted from t1 and t2, which are not in cache
+ * 2. miss on ghost key of b1 means t1 is too small, so target size of t1 grows, and b2 shrinks it
+ */
+class ARCEvictPolicy : public EvictPolicy { /*{{{*/
+ public:
+  ARCEvictPolicy() : capacity_(0), target_t1_(0), t1_(), t2_(), b1_(), b2_() {}
+
+ public:
+  virtual base::Code Init(uint32_t capacity);
+  virtual void Touch(const std::string &key);
+  virtual void Insert(const std::string &key, std::vector<std::string> *victims);
+  virtual void Erase(const std::string &key);
+  virtual const char *GetName() const { return "arc"; }
+
+ private:
+  void Replace(bool is_in_b2, std::vector<std::string> *victims);
+
+ private:
+  uint32_t capacity_;
+  uint32_t target_t1_;
+  KeyList t1_;
+  KeyList t2_;
+  KeyList b1_;
+  KeyList b2_;
+}; /*}}}*/
+
+/**
+ * NOTE: W-TinyLFU, new keys are put into a small lru window, and keys out of window go into a main SLRU
+ * 1. once main is full, key out of window replaces the victim of main only if it's accessed more often,
+ *    which is estimated by count-min sketch of all accesses
+ * 2. sketch is halved periodically, so keys hot long ago don't stay forever
+ * 3. window keeps bursts of new keys, which would be rejected by frequency at first
+ */
+class WTinyLFUEvictPolicy : public EvictPolicy { /*{{{*/
+ public:
+  WTinyLFUEvictPolicy() : window_capacity_(0), main_capacity_(0), window_(), main_(), sketch_() {}
+
+ public:
+  virtual base::Code Init(uint32_t capacity);
+  virtual void Touch(const std::string &key);
+  virtual void Insert(const std::string &key, std::vector<std::string> *victims);
+  virtual void Erase(const std::string &key);
+  virtual const char *GetName() const { return "w-tinylfu"; }
+
+ private:
+  void Admit(const std::string &candidate, std::vector<std::string> *victims);
+
+ private:
+  uint32_t window_capacity_;
+  uint32_t main_capacity_;
+  KeyList window_;
+  SLRUEvictPolicy main_;
+  base::CountMinSketch sketch_;
+}; /*}}}*/
+
+}  // namespace store
+
+#endif
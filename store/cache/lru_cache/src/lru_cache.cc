@@ -4,11 +4,13 @@
 
 #include <unistd.h>
 
+#include <vector>
+
 #include "lru_cache.h"
 
 namespace store {
 
-LRUCache::LRUCache() : max_num_(0), time_interval_(0), cur_list_() { /*{{{*/
+LRUCache::LRUCache() : max_num_(0), time_interval_(0), cur_list_(), policy_(NULL) { /*{{{*/
   cur_list_.next = &cur_list_;
   cur_list_.pre = &cur_list_;
 } /*}}}*/
@@ -23,6 +25,11 @@ LRUCache::~LRUCache() { /*{{{*/
     delete cur_node;
     cur_node = cur_list_.next;
   }
+
+  if (policy_ != NULL) {
+    delete policy_;
+    policy_ = NULL;
+  }
 } /*}}}*/
 
 base::Code LRUCache::Init(uint32_t max_num, uint32_t time_interval) { /*{{{*/
@@ -32,6 +39,26 @@ base::Code LRUCache::Init(uint32_t max_num, uint32_t time_interval) { /*{{{*/
   return base::kOk;
 } /*}}}*/
 
+base::Code LRUCache::Init(uint32_t max_num, uint32_t time_interval, EvictPolicyType policy_type) { /*{{{*/
+  if (max_num == 0) return base::kInvalidParam;
+
+  EvictPolicy *policy = NewEvictPolicy(policy_type);
+  if (policy == NULL) return base::kInvalidParam;
+  base::Code ret = policy->Init(max_num);
+  if (ret != base::kOk) {
+    delete policy;
+    return ret;
+  }
+
+  base::MutexLock ml(&mu_);
+  if (policy_ != NULL) delete policy_;
+  policy_ = policy;
+  max_num_ = max_num;
+  time_interval_ = time_interval;
+
+  return base::kOk;
+} /*}}}*/
+
 base::Code LRUCache::Put(const std::string &key, const std::string &value) { /*{{{*/
   base::MutexLock ml(&mu_);
 
@@ -42,6 +69,7 @@ base::Code LRUCache::Put(const std::string &key, const std::string &value) { /*{
 
     RemoveHandleNode(it->second);
     InsertHandleNode(it->second);
+    if (policy_ != NULL) policy_->Touch(key);
 
     return base::kOk;
   }
@@ -54,6 +82,19 @@ base::Code LRUCache::Put(const std::string &key, const std::string &value) { /*{
 
   caches_.insert(std::pair<std::string, HandleNode *>(key, cur_node));
 
+  // NOTE: victims of policy may have the new data, which is not admitted
+  if (policy_ != NULL) {
+    std::vector<std::string> victims;
+    policy_->Insert(key, &victims);
+    std::vector<std::string>::iterator victims_it = victims.begin();
+    for (; victims_it != victims.end(); ++victims_it) {
+      it = caches_.find(*victims_it);
+      if (it != caches_.end()) EraseHandleNode(it->second);
+    }
+
+    return base::kOk;
+  }
+
   // Check the length and remove older datas if max_num_ is set
   base::Code ret = RemoveExpiredNodes();
   if (ret != base::kOk) return ret;
@@ -75,6 +116,7 @@ base::Code LRUCache::Get(const std::string &key, std::string *value) { /*{{{*/
     uint64_t cur_time = (uint64_t)time(NULL);
     if (time_interval_ != 0) {
       if ((cur_time - it->second->access_time) > time_interval_) {
+        if (policy_ != NULL) policy_->Erase(key);
         RemoveHandleNode(it->second);
 
         delete it->second;
@@ -87,6 +129,7 @@ base::Code LRUCache::Get(const std::string &key, std::string *value) { /*{{{*/
     it->second->access_time = cur_time;
     RemoveHandleNode(it->second);
     InsertHandleNode(it->second);
+    if (policy_ != NULL) policy_->Touch(key);
 
     *value = it->second->value;
 
@@ -101,6 +144,7 @@ base::Code LRUCache::Del(const std::string &key) { /*{{{*/
 
   std::map<std::string, HandleNode *>::iterator it = caches_.find(key);
   if (it != caches_.end()) {
+    if (policy_ != NULL) policy_->Erase(key);
     RemoveHandleNode(it->second);
     delete it->second;
 
@@ -133,7 +177,19 @@ base::Code LRUCache::InsertHandleNode(HandleNode *cur_node) { /*{{{*/
   return base::kOk;
 } /*}}}*/
 
-base::Code LRUCache::RemoveExpiredNodes() {         /*{{{*/
+base::Code LRUCache::EraseHandleNode(HandleNode *cur_node) { /*{{{*/
+  if (cur_node == NULL) return base::kInvalidParam;
+
+  RemoveHandleNode(cur_node);
+  caches_.erase(cur_node->key);
+  delete cur_node;
+
+  return base::kOk;
+} /*}}}*/
+
+base::Code LRUCache::RemoveExpiredNodes() { /*{{{*/
+  if (policy_ != NULL) return base::kOk;  // NOTE: policy evicts data once it's put
+
   if (max_num_ != 0 && caches_.size() > max_num_) { /*{{{*/
     HandleNode *cur_node = cur_list_.pre;
     while (caches_.size() > max_num_) {
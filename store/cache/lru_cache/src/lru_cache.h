@@ -12,6 +12,7 @@
 
 #include "base/mutex.h"
 #include "base/status.h"
+#include "store/cache/lru_cache/src/evict_policy.h"
 
 namespace store {
 
@@ -29,6 +30,11 @@ namespace store {
  *  2) LRU by time
  *      It will be run when get one data, the time of data will be checked, if it's older than
  * current time - timer_interval, then current data will be deleted;
+ *
+ *  3) Evict by policy
+ *      If cache is inited with a policy type, the policy chooses data to delete instead of lru by number,
+ *      e.g. SLRU, ARC or W-TinyLFU, which keep the hot data when a scan of cold data is put;
+ *      W-TinyLFU may not admit the new data, then Put returns kOk but the data is not cached;
  */
 
 struct HandleNode {
@@ -51,6 +57,9 @@ class LRUCache {
 
   base::Code Init(uint32_t max_num, uint32_t time_interval);
 
+  // NOTE: max_num should not be 0, since the policy evicts by number
+  base::Code Init(uint32_t max_num, uint32_t time_interval, EvictPolicyType policy_type);
+
  public:
   base::Code Put(const std::string &key, const std::string &value);
   base::Code Get(const std::string &key, std::string *value);
@@ -60,6 +69,7 @@ class LRUCache {
   base::Code RemoveHandleNode(HandleNode *cur_node);
   base::Code InsertHandleNode(HandleNode *cur_node);
   base::Code RemoveExpiredNodes();
+  base::Code EraseHandleNode(HandleNode *cur_node);
 
  private:
   uint32_t max_num_;        // lru by number, if value is 0, it will not expire due to the number
@@ -67,6 +77,7 @@ class LRUCache {
 
   std::map<std::string, HandleNode *> caches_;
   HandleNode cur_list_;
+  EvictPolicy *policy_;  // NULL means lru by cur_list_
 
   base::Mutex mu_;  // lock when Put/Get/Del
 };
@@ -0,0 +1,212 @@
+// Copyright (c) 2015 The CSUTIL Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <time.h>
+
+#include "base/hash.h"
+
+#include "sharded_lru_cache.h"
+
+namespace store {
+
+const uint32_t kLRUShardHashSeed = 0x5bd1e995;
+
+LRUShard::LRUShard() : max_num_(0), time_interval_(0), caches_(), cur_list_(), stat_() { /*{{{*/
+  cur_list_.next = &cur_list_;
+  cur_list_.pre = &cur_list_;
+} /*}}}*/
+
+LRUShard::~LRUShard() { /*{{{*/
+  caches_.clear();
+
+  HandleNode *cur_node = cur_list_.next;
+  while (cur_node != &cur_list_) {
+    RemoveNode(cur_node);
+
+    delete cur_node;
+    cur_node = cur_list_.next;
+  }
+} /*}}}*/
+
+void LRUShard::Init(uint32_t max_num, uint32_t time_interval) { /*{{{*/
+  base::MutexLock ml(&mu_);
+  max_num_ = max_num;
+  time_interval_ = time_interval;
+
+  // NOTE: index doesn't rehash until it's full
+  if (max_num_ != 0) caches_.reserve(max_num_ + 1);
+} /*}}}*/
+
+base::Code LRUShard::Put(const std::string &key, const std::string &value) { /*{{{*/
+  uint64_t cur_time = (time_interval_ == 0) ? 0 : (uint64_t)time(NULL);
+
+  base::MutexLock ml(&mu_);
+  std::unordered_map<std::string, HandleNode *>::iterator it = caches_.find(key);
+  if (it != caches_.end()) {
+    it->second->value = value;
+    it->second->access_time = cur_time;
+
+    RemoveNode(it->second);
+    InsertNode(it->second);
+    return base::kOk;
+  }
+
+  HandleNode *cur_node = new HandleNode();
+  cur_node->key = key;
+  cur_node->value = value;
+  cur_node->access_time = cur_time;
+  InsertNode(cur_node);
+  caches_.insert(std::pair<std::string, HandleNode *>(key, cur_node));
+
+  while (max_num_ != 0 && caches_.size() > max_num_) {
+    EraseNode(cur_list_.pre);
+    ++stat_.evict_num;
+  }
+
+  return base::kOk;
+} /*}}}*/
+
+base::Code LRUShard::Get(const std::string &key, std::string *value) { /*{{{*/
+  uint64_t cur_time = (time_interval_ == 0) ? 0 : (uint64_t)time(NULL);
+
+  base::MutexLock ml(&mu_);
+  std::unordered_map<std::string, HandleNode *>::iterator it = caches_.find(key);
+  if (it == caches_.end()) {
+    ++stat_.miss_num;
+    return base::kNotFound;
+  }
+
+  HandleNode *cur_node = it->second;
+  if (time_interval_ != 0 && (cur_time - cur_node->access_time) > time_interval_) {
+    EraseNode(cur_node);
+    ++stat_.expire_num;
+    ++stat_.miss_num;
+    return base::kNotFound;
+  }
+
+  cur_node->access_time = cur_time;
+  RemoveNode(cur_node);
+  InsertNode(cur_node);
+  *value = cur_node->value;
+  ++stat_.hit_num;
+
+  return base::kOk;
+} /*}}}*/
+
+base::Code LRUShard::Del(const std::string &key) { /*{{{*/
+  base::MutexLock ml(&mu_);
+  std::unordered_map<std::string, HandleNode *>::iterator it = caches_.find(key);
+  if (it == caches_.end()) return base::kNotFound;
+
+  EraseNode(it->second);
+  return base::kOk;
+} /*}}}*/
+
+void LRUShard::GetStat(LRUShardStat *stat) { /*{{{*/
+  base::MutexLock ml(&mu_);
+  *stat = stat_;
+  stat->size = caches_.size();
+} /*}}}*/
+
+void LRUShard::RemoveNode(HandleNode *node) { /*{{{*/
+  node->pre->next = node->next;
+  node->next->pre = node->pre;
+} /*}}}*/
+
+void LRUShard::InsertNode(HandleNode *node) { /*{{{*/
+  node->next = cur_list_.next;
+  node->pre = &cur_list_;
+  cur_list_.next->pre = node;
+  cur_list_.next = node;
+} /*}}}*/
+
+void LRUShard::EraseNode(HandleNode *node) { /*{{{*/
+  RemoveNode(node);
+  caches_.erase(node->key);
+  delete node;
+} /*}}}*/
+
+ShardedLRUCache::ShardedLRUCache() : shards_(), mask_(0) { /*{{{*/
+} /*}}}*/
+
+ShardedLRUCache::~ShardedLRUCache() { /*{{{*/
+  std::vector<LRUShard *>::iterator shards_it = shards_.begin();
+  for (; shards_it != shards_.end(); ++shards_it) {
+    delete *shards_it;
+  }
+  shards_.clear();
+} /*}}}*/
+
+base::Code ShardedLRUCache::Init(uint32_t max_num, uint32_t time_interval,
+                                 uint32_t shards_num /*=kDefaultLRUShardsNum*/) { /*{{{*/
+  if (shards_num == 0 || shards_num > kMaxLRUShardsNum) return base::kInvalidParam;
+  if (!shards_.empty()) return base::kOk;
+
+  uint32_t real_shards_num = 1;
+  while (real_shards_num < shards_num) {
+    real_shards_num <<= 1;
+  }
+
+  // NOTE: every shard keeps at least one node, so max_num less than shards still works
+  uint32_t shard_max_num = 0;
+  if (max_num != 0) shard_max_num = (max_num + real_shards_num - 1) / real_shards_num;
+
+  for (uint32_t i = 0; i < real_shards_num; ++i) {
+    LRUShard *shard = new LRUShard();
+    shard->Init(shard_max_num, time_interval);
+    shards_.push_back(shard);
+  }
+  mask_ = real_shards_num - 1;
+
+  return base::kOk;
+} /*}}}*/
+
+base::Code ShardedLRUCache::Put(const std::string &key, const std::string &value) { /*{{{*/
+  if (shards_.empty()) return base::kNotInit;
+
+  return GetShard(key)->Put(key, value);
+} /*}}}*/
+
+base::Code ShardedLRUCache::Get(const std::string &key, std::string *value) { /*{{{*/
+  if (value == NULL) return base::kInvalidParam;
+  if (shards_.empty()) return base::kNotInit;
+
+  return GetShard(key)->Get(key, value);
+} /*}}}*/
+
+base::Code ShardedLRUCache::Del(const std::string &key) { /*{{{*/
+  if (shards_.empty()) return base::kNotInit;
+
+  return GetShard(key)->Del(key);
+} /*}}}*/
+
+base::Code ShardedLRUCache::GetShardStat(uint32_t index, LRUShardStat *stat) { /*{{{*/
+  if (stat == NULL || index >= shards_.size()) return base::kInvalidParam;
+
+  shards_[index]->GetStat(stat);
+  return base::kOk;
+} /*}}}*/
+
+base::Code ShardedLRUCache::GetStat(LRUShardStat *stat) { /*{{{*/
+  if (stat == NULL) return base::kInvalidParam;
+
+  *stat = LRUShardStat();
+  for (uint32_t i = 0; i < shards_.size(); ++i) {
+    LRUShardStat shard_stat;
+    shards_[i]->GetStat(&shard_stat);
+    stat->hit_num += shard_stat.hit_num;
+    stat->miss_num += shard_stat.miss_num;
+    stat->evict_num += shard_stat.evict_num;
+    stat->expire_num += shard_stat.expire_num;
+    stat->size += shard_stat.size;
+  }
+
+  return base::kOk;
+} /*}}}*/
+
+LRUShard *ShardedLRUCache::GetShard(const std::string &key) { /*{{{*/
+  return shards_[base::Murmur32(key, kLRUShardHashSeed) & mask_];
+} /*}}}*/
+
+}  // namespace store
@@ -0,0 +1,111 @@
+// Copyright (c) 2015 The CSUTIL Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef STORE_CACHE_SHARDED_LRU_CACHE_H_
+#define STORE_CACHE_SHARDED_LRU_CACHE_H_
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <stdint.h>
+
+#include "base/mutex.h"
+#include "base/status.h"
+#include "store/cache/lru_cache/src/lru_cache.h"
+
+namespace store {
+
+const uint32_t kDefaultLRUShardsNum = 16;
+const uint32_t kMaxLRUShardsNum = 1024;
+
+struct LRUShardStat { /*{{{*/
+  uint64_t hit_num;
+  uint64_t miss_num;
+  uint64_t evict_num;   // removed by max number
+  uint64_t expire_num;  // removed by time interval
+  uint32_t size;
+
+  LRUShardStat() : hit_num(0), miss_num(0), evict_num(0), expire_num(0), size(0) {}
+}; /*}}}*/
+
+/**
+ * NOTE: one shard of ShardedLRUCache, which is the same as LRUCache except the hash index
+ * 1. nodes are in an intrusive list, and the most recent one is after the head
+ * 2. stat is counted under lock of shard, so it costs nothing more than the lookup
+ */
+class LRUShard { /*{{{*/
+ public:
+  LRUShard();
+  ~LRUShard();
+
+ public:
+  void Init(uint32_t max_num, uint32_t time_interval);
+
+  base::Code Put(const std::string &key, const std::string &value);
+  base::Code Get(const std::string &key, std::string *value);
+  base::Code Del(const std::string &key);
+
+  void GetStat(LRUShardStat *stat);
+
+ private:
+  void RemoveNode(HandleNode *node);
+  void InsertNode(HandleNode *node);
+  void EraseNode(HandleNode *node);
+
+ private:
+  LRUShard(const LRUShard &);
+  LRUShard &operator=(const LRUShard &);
+
+ private:
+  uint32_t max_num_;
+  uint32_t time_interval_;
+
+  std::unordered_map<std::string, HandleNode *> caches_;
+  HandleNode cur_list_;
+  LRUShardStat stat_;
+
+  base::Mutex mu_;
+}; /*}}}*/
+
+/**
+ * NOTE: ShardedLRUCache has the same interface and lru policy as LRUCache, but keys are split into shards
+ * 1. shard of key is chosen by hash, and every shard has its own lock, index and lru list
+ * 2. max_num is divided into shards, so a hot shard may evict a bit earlier than one global list
+ * 3. Get and Put are O(1) by hash index, and threads of different shards don't wait for each other
+ */
+class ShardedLRUCache { /*{{{*/
+ public:
+  ShardedLRUCache();
+  ~ShardedLRUCache();
+
+  // NOTE: shards_num is rounded up to power of 2, and max_num 0 means no lru by number as LRUCache
+  base::Code Init(uint32_t max_num, uint32_t time_interval, uint32_t shards_num = kDefaultLRUShardsNum);
+
+ public:
+  base::Code Put(const std::string &key, const std::string &value);
+  base::Code Get(const std::string &key, std::string *value);
+  base::Code Del(const std::string &key);
+
+  uint32_t GetShardsNum() const { return shards_.size(); }
+  base::Code GetShardStat(uint32_t index, LRUShardStat *stat);
+
+  // NOTE: sum of all shards
+  base::Code GetStat(LRUShardStat *stat);
+
+ private:
+  LRUShard *GetShard(const std::string &key);
+
+ private:
+  ShardedLRUCache(const ShardedLRUCache &);
+  ShardedLRUCache &operator=(const ShardedLRUCache &);
+
+ private:
+  std::vector<LRUShard *> shards_;
+  uint32_t mask_;
+}; /*}}}*/
+
+}  // namespace store
+
+#endif
@@ -6,6 +6,7 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <sys/time.h>
 #include <unistd.h>
 
 #include "base/coding.h"
@@ -30,8 +31,23 @@ class FilesSort { /*{{{*/
   }
 }; /*}}}*/
 
-BitCaskDB::BitCaskDB() : dir_path_(""), cur_data_file_suffix_num_(0), cur_merge_data_file_suffix_num_(0) { /*{{{*/
+BitCaskDB::BitCaskDB()
+    : dir_path_(""),
+      cur_data_file_suffix_num_(0),
+      cur_merge_data_file_suffix_num_(0),
+      merge_out_fp_(NULL),
+      merge_read_file_id_(kInvalidFileId),
+      merge_out_pos_(0),
+      merge_tid_(),
+      is_merge_thread_running_(false),
+      is_stop_(false),
+      sync_policy_(kSyncEveryWrite),
+      sync_interval_ms_(kDefaultSyncIntervalMs),
+      is_dirty_(false),
+      sync_tid_(),
+      is_sync_thread_running_(false) { /*{{{*/
   memset((void *)(&info_), 0, sizeof(info_));
+  file_fps_.push_back(NULL);  // NOTE: id 0 is kInvalidFileId
   buf_ = new char[kMaxDataSize + kMaxKeySize];
   memset(buf_, 0, sizeof(kMaxDataSize));
 } /*}}}*/
@@ -52,27 +68,113 @@ base::Code BitCaskDB::Put(const std::string &key, const std::string &value, int6
 base::Code BitCaskDB::Get(const std::string &key, std::string *value, int64_t *version /*=NULL*/) { /*{{{*/
   if (value == NULL) return base::kInvalidParam;
 
-  base::Code ret = base::kOk;
-  std::map<std::string, Bucket>::iterator index_it = index_.find(key);
-  if (index_it == index_.end()) return base::kNotFound;
-
-  Bucket *cur_bucket = &(index_it->second);
+  // NOTE: record is read by pread into its own buffer, so Gets only share the read lock, which also keeps the
+  // file from being removed by merge
+  base::ReadLock rl(&mu_);
+  Bucket *cur_bucket = index_.Find(key);
+  if (cur_bucket == NULL) return base::kNotFound;
   if (cur_bucket->del_flag == kBCDelFlag) return base::kNotFound;
 
+  std::string record(GetRecordSize(*cur_bucket), '\0');
+  int cur_fd = fileno(file_fps_[cur_bucket->file_id]);
+  base::Code ret = base::ReadAt(cur_fd, cur_bucket->data_pos, record.size(), &record[0]);
+  if (ret != base::kOk) return ret;
+
+  return DecodeRecord(record.data(), *cur_bucket, value, version);
+} /*}}}*/
+
+base::Code BitCaskDB::DecodeRecord(const char *record, const Bucket &bucket, std::string *value,
+                                   int64_t *version) { /*{{{*/
   DataValue cur_data_value;
-  fseek(cur_bucket->fp, cur_bucket->data_pos, SEEK_SET);
-  ret = ReadData(&cur_data_value, cur_bucket->fp);
+  base::Code ret = DecodeDataValueHead(std::string(record, kDataValueHeadSize), &cur_data_value);
   if (ret != base::kOk) return ret;
-  *value = cur_data_value.value;
+  if (cur_data_value.key_size != bucket.key_size || cur_data_value.value_size != bucket.value_size) {
+    return base::kDataValueError;
+  }
+
+  const char *value_data = record + kDataValueHeadSize + cur_data_value.key_size;
+  if (base::CRC32(value_data, cur_data_value.value_size) != cur_data_value.crc) return base::kDataValueError;
+  value->assign(value_data, cur_data_value.value_size);
   if (version != NULL) *version = cur_data_value.version;
 
   return ret;
 } /*}}}*/
 
+base::Code BitCaskDB::MultiGet(const std::vector<std::string> &keys, std::vector<std::string> *values,
+                               std::vector<base::Code> *rets, std::vector<int64_t> *versions /*=NULL*/) { /*{{{*/
+  if (values == NULL || rets == NULL) return base::kInvalidParam;
+
+  values->assign(keys.size(), "");
+  rets->assign(keys.size(), base::kNotFound);
+  if (versions != NULL) versions->assign(keys.size(), 0);
+
+  // NOTE: the same as Get, read lock is held while reading, so files are not removed by merge
+  base::ReadLock rl(&mu_);
+  std::vector<ReadItem> items;
+  items.reserve(keys.size());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    Bucket *cur_bucket = index_.Find(keys[i]);
+    if (cur_bucket == NULL || cur_bucket->del_flag == kBCDelFlag) continue;
+
+    ReadItem item;
+    item.bucket = *cur_bucket;
+    item.index = i;
+    items.push_back(item);
+  }
+  std::sort(items.begin(), items.end());
+
+  std::string buf;
+  size_t start = 0;
+  while (start < items.size()) {
+    // NOTE: records after start are read together while they're in the same file, and the gap and the total
+    // size are small
+    const Bucket &start_bucket = items[start].bucket;
+    uint64_t read_pos = start_bucket.data_pos;
+    uint64_t read_end = read_pos + GetRecordSize(start_bucket);
+    size_t end = start + 1;
+    for (; end < items.size(); ++end) {
+      const Bucket &cur_bucket = items[end].bucket;
+      if (cur_bucket.file_id != start_bucket.file_id || cur_bucket.data_pos > read_end + kMultiGetMaxGapBytes) break;
+      uint64_t item_end = cur_bucket.data_pos + GetRecordSize(cur_bucket);
+      if (item_end > read_end) {
+        if (item_end - read_pos > kMultiGetMaxReadBytes) break;
+        read_end = item_end;
+      }
+    }
+
+    buf.resize(read_end - read_pos);
+    int cur_fd = fileno(file_fps_[start_bucket.file_id]);
+    base::Code ret = base::ReadAt(cur_fd, read_pos, buf.size(), &buf[0]);
+    for (; start < end; ++start) {
+      const ReadItem &item = items[start];
+      if (ret != base::kOk) {
+        (*rets)[item.index] = ret;
+        continue;
+      }
+
+      int64_t *cur_version = (versions == NULL) ? NULL : &((*versions)[item.index]);
+      (*rets)[item.index] = DecodeRecord(buf.data() + (item.bucket.data_pos - read_pos), item.bucket,
+                                         &((*values)[item.index]), cur_version);
+    }
+  }
+
+  return base::kOk;
+} /*}}}*/
+
 base::Code BitCaskDB::Del(const std::string &key, int64_t version /*=-1*/) { /*{{{*/
   return SetValue(key, "", kBCDelFlag, version);
 } /*}}}*/
 
+base::Code BitCaskDB::Write(const WriteBatch &batch) { /*{{{*/
+  if (batch.Count() == 0) return base::kOk;
+
+  uint64_t seq = 0;
+  base::Code ret = WriteBatchValues(batch, &seq);
+  if (ret != base::kOk || seq == 0) return ret;
+
+  return group_commit_.WaitSynced(seq, [this]() { return Sync(); });
+} /*}}}*/
+
 base::Code BitCaskDB::Init(const std::string &dir_path) { /*{{{*/
   if (dir_path.empty()) return base::kInvalidParam;
 
@@ -87,32 +189,76 @@ base::Code BitCaskDB::Init(const std::string &dir_path) { /*{{{*/
 
   std::sort(files_name.begin(), files_name.end(), FilesSort());
 
+  // NOTE: hint file which is not renamed is left by crash
+  std::vector<std::string>::iterator files_it = files_name.begin();
+  while (files_it != files_name.end()) {
+    if (files_it->compare(0, kTmpHintFilePrefix.size(), kTmpHintFilePrefix) == 0) {
+      unlink((dir_path_ + base::kSlashStr + *files_it).c_str());
+      files_it = files_name.erase(files_it);
+      continue;
+    }
+    ++files_it;
+  }
+
   ret = OpenAndReadFiles(files_name, kSourceDataFilePrefix, &cur_data_file_suffix_num_);
   if (ret != base::kOk) return ret;
 
   ret = OpenAndReadFiles(files_name, kMergeDataFilePrefix, &cur_merge_data_file_suffix_num_);
   if (ret != base::kOk) return ret;
 
+  is_stop_ = false;
+  if (merge_option_.interval_ms > 0 && !is_merge_thread_running_) {
+    int r = pthread_create(&merge_tid_, NULL, MergeThreadAction, this);
+    if (r != 0) return base::kPthreadCreateFailed;
+    is_merge_thread_running_ = true;
+  }
+
+  if (sync_policy_ == kSyncInterval && sync_interval_ms_ > 0 && !is_sync_thread_running_) {
+    int r = pthread_create(&sync_tid_, NULL, SyncThreadAction, this);
+    if (r != 0) return base::kPthreadCreateFailed;
+    is_sync_thread_running_ = true;
+  }
+
   return ret;
 } /*}}}*/
 
 base::Code BitCaskDB::GetStatus(DBStatusInfo *status_info) { /*{{{*/
   if (status_info == NULL) return base::kInvalidParam;
 
+  base::ReadLock rl(&mu_);
   status_info->max_num = info_.max_num;
   status_info->used_cnt = info_.used_cnt;
   status_info->trx_id = info_.trx_id;
 
+  status_info->live_bytes = 0;
+  status_info->dead_bytes = 0;
+  std::map<uint32_t, FileStat>::iterator stat_it = file_stats_.begin();
+  for (; stat_it != file_stats_.end(); ++stat_it) {
+    status_info->live_bytes += stat_it->second.live_bytes;
+    status_info->dead_bytes += stat_it->second.dead_bytes;
+  }
+
   return base::kOk;
 } /*}}}*/
 
 base::Code BitCaskDB::Destroy() { /*{{{*/
-  std::map<std::string, FILE *>::iterator file_it = files_.begin();
+  StopThreads();
+
+  // NOTE: writes of kSyncInterval and kSyncOnClose are synced at last
+  if (is_dirty_) {
+    base::Code ret = Sync();
+    if (ret != base::kOk) base::LOG_ERR("Failed to sync bit cask db, dir:%s, ret:%d", dir_path_.c_str(), ret);
+  }
+
+  std::map<std::string, uint32_t>::iterator file_it = files_.begin();
   for (; file_it != files_.end(); ++file_it) {
-    FILE *cur_fp = file_it->second;
-    fclose(cur_fp);
-    file_it->second = NULL;
+    fclose(file_fps_[file_it->second]);
+    file_fps_[file_it->second] = NULL;
   }
+  files_.clear();
+  file_fps_.resize(1);
+  file_stats_.clear();
+  index_.Clear();
 
   return base::kOk;
 } /*}}}*/
@@ -146,7 +292,9 @@ base::Code BitCaskDB::OpenAndReadFiles(const std::vector<std::string> &files_nam
         if (*cur_suffix_num <= file_suffix_num) return base::kInvalidBitCaskFileName;
       }
 
-      ret = OpenAndReadFile(cur_file_name, open_mode);
+      // NOTE: only the newest source data file is appended, and merge data files are all sealed
+      bool is_active = (prefix == kSourceDataFilePrefix && open_mode == "a+");
+      ret = OpenAndReadFile(cur_file_name, open_mode, is_active);
       if (ret != base::kOk) return ret;
     } /*}}}*/
   } /*}}}*/
@@ -160,55 +308,118 @@ base::Code BitCaskDB::OpenAndReadFiles(const std::vector<std::string> &files_nam
   return ret;
 } /*}}}*/
 
-base::Code BitCaskDB::OpenAndReadFile(const std::string &file_name, const std::string &mode) { /*{{{*/
+base::Code BitCaskDB::OpenAndReadFile(const std::string &file_name, const std::string &mode,
+                                      bool is_active) { /*{{{*/
   std::string file_path = dir_path_ + base::kSlashStr + file_name;
   FILE *cur_fp = fopen(file_path.c_str(), mode.c_str());
   if (cur_fp == NULL) return base::kOpenFileFailed;
 
-  files_.insert(std::pair<std::string, FILE *>(file_name, cur_fp));
+  uint32_t cur_file_id = kInvalidFileId;
+  base::Code ret = AddFile(file_name, cur_fp, &cur_file_id);
+  if (ret != base::kOk) return ret;
+
+  // NOTE: sealed file is loaded from its hint file without reading values, and scanned if the hint is bad
+  if (!is_active) {
+    ret = LoadHintFile(file_name, cur_file_id);
+    if (ret == base::kOk) return ret;
+    if (ret != base::kFileNotExist) {
+      base::LOG_ERR("Failed to load hint of bit cask file:%s, ret:%d, and scan it", file_name.c_str(), ret);
+    }
+  }
 
+  // NOTE: records of batch are kept until its last record is read, so a batch broken by crash is dropped
+  std::string hint;
+  std::vector<std::pair<std::string, Bucket> > batch_records;
+  uint64_t batch_pos = 0;
   uint64_t cur_pos = 0;
   fseek(cur_fp, cur_pos, SEEK_SET);
-  base::Code ret = base::kOk;
   while (true) {
     DataValue cur_data_value;
     ret = ReadData(&cur_data_value, cur_fp);
     if (ret == base::kFileIsEnd) {
-      return base::kOk;
+      break;
     } else if (ret != base::kOk) {
+      if (!batch_records.empty()) break;  // NOTE: the last record of batch is not written completely
       return ret;
     }
 
     Bucket cur_bucket;
-    cur_bucket.fp = cur_fp;
-    cur_bucket.del_flag = cur_data_value.del_flag;
+    cur_bucket.file_id = cur_file_id;
+    cur_bucket.del_flag = cur_data_value.del_flag & ~kBCBatchMoreFlag;
     cur_bucket.key_size = cur_data_value.key_size;
     cur_bucket.value_size = cur_data_value.value_size;
     cur_bucket.time_sec = cur_data_value.time_sec;
     cur_bucket.time_nsec = cur_data_value.time_nsec;
     cur_bucket.version = cur_data_value.version;
     cur_bucket.data_pos = cur_pos;
-    cur_pos += 6 * sizeof(uint32_t) + sizeof(uint64_t) + cur_data_value.key_size + cur_data_value.value_size;
+    cur_pos += GetRecordSize(cur_bucket);
 
-    std::map<std::string, Bucket>::iterator it = index_.find(cur_data_value.key);
-    if (it != index_.end()) {
-      bool is_new = false;
-      Bucket *old_bucket = &(it->second);
-      ret = CheckValueIsNew(cur_bucket, *old_bucket, &is_new);
+    if (batch_records.empty()) batch_pos = cur_bucket.data_pos;
+    batch_records.push_back(std::pair<std::string, Bucket>(cur_data_value.key, cur_bucket));
+    if ((cur_data_value.del_flag & kBCBatchMoreFlag) != 0) continue;
+
+    std::vector<std::pair<std::string, Bucket> >::iterator records_it = batch_records.begin();
+    for (; records_it != batch_records.end(); ++records_it) {
+      ret = AppendHintEntry(records_it->first, records_it->second, &hint);
+      if (ret != base::kOk) return ret;
+      ret = AddLoadedRecord(records_it->first, records_it->second);
       if (ret != base::kOk) return ret;
-      if (is_new) {
-        if (old_bucket->del_flag == kBCDelFlag && cur_bucket.del_flag == kBCExistFlag) info_.used_cnt++;
-        if (old_bucket->del_flag == kBCExistFlag && cur_bucket.del_flag == kBCDelFlag) info_.used_cnt--;
+    }
+    batch_records.clear();
+  }
 
-        *old_bucket = cur_bucket;
-      }
+  if (!batch_records.empty()) {
+    // NOTE: the broken batch is cut off, or it would be taken as complete with records appended after it
+    base::LOG_ERR("Drop broken batch of bit cask file:%s, pos:%llu, records:%zu", file_name.c_str(),
+                  (unsigned long long)batch_pos, batch_records.size());
+    if (is_active && ftruncate(fileno(cur_fp), batch_pos) != 0) return base::kWriteError;
+  }
+
+  if (is_active) {
+    active_hint_.swap(hint);
+    return base::kOk;
+  }
+
+  // NOTE: hint is rebuilt for the next start, and failure only makes the next start slow
+  ret = WriteHintFile(file_name, hint);
+  if (ret != base::kOk) base::LOG_ERR("Failed to write hint of bit cask file:%s, ret:%d", file_name.c_str(), ret);
+  return base::kOk;
+} /*}}}*/
+
+base::Code BitCaskDB::AddLoadedRecord(const std::string &key, const Bucket &bucket) { /*{{{*/
+  Bucket cur_bucket = bucket;
+  cur_bucket.records_num = 1;
+  uint64_t record_size = GetRecordSize(cur_bucket);
+
+  Bucket *old_bucket = index_.Find(key);
+  if (old_bucket != NULL) {
+    bool is_new = false;
+    base::Code ret = CheckValueIsNew(cur_bucket, *old_bucket, &is_new);
+    if (ret != base::kOk) return ret;
+    if (is_new) {
+      if (old_bucket->del_flag == kBCDelFlag && cur_bucket.del_flag == kBCExistFlag) info_.used_cnt++;
+      if (old_bucket->del_flag == kBCExistFlag && cur_bucket.del_flag == kBCDelFlag) info_.used_cnt--;
+
+      if (IsBucketLive(*old_bucket)) MoveBytes(old_bucket->file_id, GetRecordSize(*old_bucket), false);
+      cur_bucket.records_num = old_bucket->records_num + 1;
+      *old_bucket = cur_bucket;
+      AddLiveBytes(cur_bucket.file_id, record_size);
     } else {
-      index_.insert(std::pair<std::string, Bucket>(cur_data_value.key, cur_bucket));
-      if (cur_bucket.del_flag == kBCExistFlag) info_.used_cnt++;
+      AddDeadBytes(cur_bucket.file_id, record_size);
+      ChangeRecordsNum(old_bucket, 1);
+    }
+  } else {
+    base::Code ret = index_.Insert(key, cur_bucket);
+    if (ret != base::kOk) return ret;
+    if (cur_bucket.del_flag == kBCExistFlag) info_.used_cnt++;
+    if (IsBucketLive(cur_bucket)) {
+      AddLiveBytes(cur_bucket.file_id, record_size);
+    } else {
+      AddDeadBytes(cur_bucket.file_id, record_size);
     }
   }
 
-  return ret;
+  return base::kOk;
 } /*}}}*/
 
 base::Code BitCaskDB::OpenNextFile(const std::string &prefix, uint64_t cur_suffix_num) { /*{{{*/
@@ -219,7 +430,7 @@ base::Code BitCaskDB::OpenNextFile(const std::string &prefix, uint64_t cur_suffi
   base::Code ret = GetFileName(prefix, next_suffix_num, &next_file_name);
   if (ret != base::kOk) return ret;
 
-  ret = OpenAndReadFile(next_file_name, "a+");
+  ret = OpenAndReadFile(next_file_name, "a+", prefix == kSourceDataFilePrefix);
   if (ret != base::kOk) return ret;
 
   return ret;
@@ -255,31 +466,37 @@ base::Code BitCaskDB::GetFileName(const std::string &prefix, uint64_t cur_suffix
 } /*}}}*/
 
 base::Code BitCaskDB::SetValue(const std::string &key, const std::string &value, int flag, int64_t version) { /*{{{*/
+  uint64_t seq = 0;
+  base::Code ret = WriteValue(key, value, flag, version, &seq);
+  if (ret != base::kOk || seq == 0) return ret;
+
+  // NOTE: write_mu_ is unlocked, so other writers append while this one waits for group commit
+  return group_commit_.WaitSynced(seq, [this]() { return Sync(); });
+} /*}}}*/
+
+base::Code BitCaskDB::WriteValue(const std::string &key, const std::string &value, int flag, int64_t version,
+                                 uint64_t *seq) { /*{{{*/
   if (key.size() >= kMaxKeySize) return base::kKeySizeIsLarge;
 
+  // NOTE: writers are serialized by write_mu_, and data is appended and synced without mu_, which is only
+  // locked to read and update index, so Gets are not blocked by fsync; with kSyncGroupCommit the value is
+  // visible to Gets before it's synced, and Put returns after synced
+  base::MutexLock write_ml(&write_mu_);
   base::Code ret = base::kOk;
   DataValue cur_data_value;
   cur_data_value.Clear();
-  std::map<std::string, Bucket>::iterator index_it = index_.find(key);
+  Bucket old_bucket;
   Bucket *cur_bucket = NULL;
-  if (index_it == index_.end()) {
-    if (flag == kBCDelFlag) return base::kNotFound;
-
-    if (version != -1 && version != 0) return base::kCASFailed;
-    cur_data_value.version = 1;
-  } else {
-    cur_bucket = &(index_it->second);
-    if (cur_bucket->del_flag == kBCDelFlag) {
-      if (flag == kBCDelFlag) return base::kNotFound;
-
-      if (version != -1 && version != 0) return base::kCASFailed;
-      cur_data_value.version = 1;
-    } else {
-      if (version != -1 && version != (int64_t)cur_bucket->version) return base::kCASFailed;
-
-      cur_data_value.version = cur_bucket->version + 1;
+  {
+    base::ReadLock rl(&mu_);
+    Bucket *bucket = index_.Find(key);
+    if (bucket != NULL) {
+      old_bucket = *bucket;
+      cur_bucket = &old_bucket;
     }
   }
+  ret = GetNewVersion(cur_bucket, flag, version, &(cur_data_value.version));
+  if (ret != base::kOk) return ret;
 
   cur_data_value.crc = base::CRC32(value.data(), (int)value.size());
   cur_data_value.del_flag = flag;
@@ -299,10 +516,188 @@ base::Code BitCaskDB::SetValue(const std::string &key, const std::string &value,
   cur_data_value.key = key;
   cur_data_value.value = value;
 
+  uint32_t cur_file_id = kInvalidFileId;
+  int cur_fd = -1;
+  ret = GetActiveFile(&cur_file_id, &cur_fd);
+  if (ret != base::kOk) return ret;
+
+  uint64_t cur_pos = 0;
+  ret = WriteData(cur_data_value, &cur_pos, cur_fd);
+  if (ret != base::kOk) return ret;
+
+  Bucket new_bucket;
+  new_bucket.file_id = cur_file_id;
+  new_bucket.del_flag = cur_data_value.del_flag;
+  new_bucket.key_size = cur_data_value.key_size;
+  new_bucket.value_size = cur_data_value.value_size;
+  new_bucket.data_pos = cur_pos;
+  new_bucket.time_sec = cur_data_value.time_sec;
+  new_bucket.time_nsec = cur_data_value.time_nsec;
+  new_bucket.version = cur_data_value.version;
+  new_bucket.records_num = 1;
+  ret = AppendHintEntry(key, new_bucket, &active_hint_);
+  if (ret != base::kOk) return ret;
+
+  base::WriteLock wl(&mu_);
+  ret = UpdateIndex(key, new_bucket);
+  if (ret != base::kOk) return ret;
+  if (sync_policy_ == kSyncGroupCommit) *seq = group_commit_.AddWrite();
+
+  return ret;
+} /*}}}*/
+
+/**
+ * NOTE: batch is checked against index and the former operations of itself before anything is written
+ * 1. records are encoded into one buffer and appended by one write, then index is updated under one lock
+ * 2. kBCBatchMoreFlag is set on all records but the last one, so loading knows whether the batch is complete
+ * 3. records of the same key get increasing time, which decides the newest record when files are loaded
+ */
+base::Code BitCaskDB::WriteBatchValues(const WriteBatch &batch, uint64_t *seq) { /*{{{*/
+  const std::vector<WriteBatch::Op> &ops = batch.GetOps();
+  std::vector<WriteBatch::Op>::const_iterator ops_it = ops.begin();
+  for (; ops_it != ops.end(); ++ops_it) {
+    if (ops_it->key.size() >= kMaxKeySize) return base::kKeySizeIsLarge;
+  }
+
+  base::MutexLock write_ml(&write_mu_);
+  base::Code ret = base::kOk;
+  std::map<std::string, Bucket> batch_buckets;  // The newest bucket of key written by batch
+  std::vector<Bucket> new_buckets;
+  std::string dump_str;
+  uint32_t last_sec = 0;
+  uint32_t last_nsec = 0;
+  {
+    base::ReadLock rl(&mu_);
+    for (size_t i = 0; i < ops.size(); ++i) {
+      const WriteBatch::Op &op = ops[i];
+      int flag = (op.type == kBatchDel) ? kBCDelFlag : kBCExistFlag;
+      const std::string &value = (op.type == kBatchDel) ? std::string() : op.value;
+
+      Bucket *cur_bucket = NULL;
+      std::map<std::string, Bucket>::iterator batch_it = batch_buckets.find(op.key);
+      if (batch_it != batch_buckets.end()) {
+        cur_bucket = &(batch_it->second);
+      } else {
+        cur_bucket = index_.Find(op.key);
+      }
+
+      DataValue cur_data_value;
+      cur_data_value.Clear();
+      ret = GetNewVersion(cur_bucket, flag, op.version, &(cur_data_value.version));
+      if (ret != base::kOk) return ret;
+
+      ret = base::Time::GetTime(&(cur_data_value.time_sec), &(cur_data_value.time_nsec));
+      if (ret != base::kOk) return ret;
+      bool is_new = false;
+      ret = CheckValueIsNew(cur_data_value.time_sec, cur_data_value.time_nsec, last_sec, last_nsec, &is_new);
+      if (ret != base::kOk) return ret;
+      if (!is_new) {
+        cur_data_value.time_sec = last_sec;
+        cur_data_value.time_nsec = last_nsec + 1;
+        if (cur_data_value.time_nsec >= 1000000000) {
+          cur_data_value.time_sec++;
+          cur_data_value.time_nsec = 0;
+        }
+      }
+      if (cur_bucket != NULL) {
+        ret = CheckValueIsNew(cur_data_value.time_sec, cur_data_value.time_nsec, cur_bucket->time_sec,
+                              cur_bucket->time_nsec, &is_new);
+        if (ret != base::kOk) return ret;
+        if (!is_new) return base::kTimeWrong;
+      }
+      last_sec = cur_data_value.time_sec;
+      last_nsec = cur_data_value.time_nsec;
+
+      cur_data_value.crc = base::CRC32(value.data(), (int)value.size());
+      cur_data_value.del_flag = flag;
+      if (i + 1 < ops.size()) cur_data_value.del_flag |= kBCBatchMoreFlag;
+      cur_data_value.key_size = op.key.size();
+      cur_data_value.value_size = value.size();
+      cur_data_value.key = op.key;
+      cur_data_value.value = value;
+
+      std::string record;
+      ret = EncodeDataValue(cur_data_value, &record);
+      if (ret != base::kOk) return ret;
+
+      Bucket new_bucket;
+      new_bucket.del_flag = flag;
+      new_bucket.key_size = cur_data_value.key_size;
+      new_bucket.value_size = cur_data_value.value_size;
+      new_bucket.data_pos = dump_str.size();  // NOTE: position in batch, which is moved by position of file
+      new_bucket.time_sec = cur_data_value.time_sec;
+      new_bucket.time_nsec = cur_data_value.time_nsec;
+      new_bucket.version = cur_data_value.version;
+      new_bucket.records_num = 1;
+      new_buckets.push_back(new_bucket);
+      batch_buckets[op.key] = new_bucket;
+      dump_str.append(record);
+    }
+  }
+
+  uint32_t cur_file_id = kInvalidFileId;
+  int cur_fd = -1;
+  ret = GetActiveFile(&cur_file_id, &cur_fd);
+  if (ret != base::kOk) return ret;
+
+  uint64_t cur_pos = 0;
+  ret = AppendData(dump_str, &cur_pos, cur_fd);
+  if (ret != base::kOk) return ret;
+
+  for (size_t i = 0; i < new_buckets.size(); ++i) {
+    new_buckets[i].file_id = cur_file_id;
+    new_buckets[i].data_pos += cur_pos;
+    ret = AppendHintEntry(ops[i].key, new_buckets[i], &active_hint_);
+    if (ret != base::kOk) return ret;
+  }
+
+  base::WriteLock wl(&mu_);
+  for (size_t i = 0; i < new_buckets.size(); ++i) {
+    ret = UpdateIndex(ops[i].key, new_buckets[i]);
+    if (ret != base::kOk) return ret;
+  }
+  if (sync_policy_ == kSyncGroupCommit) *seq = group_commit_.AddWrite();
+
+  return ret;
+} /*}}}*/
+
+base::Code BitCaskDB::GetNewVersion(const Bucket *cur_bucket, int flag, int64_t version,
+                                    uint64_t *new_version) { /*{{{*/
+  if (cur_bucket == NULL || cur_bucket->del_flag == kBCDelFlag) {
+    if (flag == kBCDelFlag) return base::kNotFound;
+
+    if (version != -1 && version != 0) return base::kCASFailed;
+    *new_version = 1;
+    return base::kOk;
+  }
+
+  if (version != -1 && version != (int64_t)cur_bucket->version) return base::kCASFailed;
+  *new_version = cur_bucket->version + 1;
+
+  return base::kOk;
+} /*}}}*/
+
+base::Code BitCaskDB::GetActiveFile(uint32_t *file_id, int *fd) { /*{{{*/
   bool full = false;
-  ret = CheckIsFileFull(kSourceDataFilePrefix, cur_data_file_suffix_num_, &full);
+  base::Code ret = CheckIsFileFull(kSourceDataFilePrefix, cur_data_file_suffix_num_, &full);
   if (ret != base::kOk) return ret;
   if (full) {
+    // NOTE: Sync only syncs the active file, so writes of the full file are synced before it's sealed; it's
+    // done without checking dirty flag, which may be cleared by a Sync that has not synced the file yet
+    if (sync_policy_ != kSyncEveryWrite) {
+      ret = SyncDataFile(cur_data_file_suffix_num_);
+      if (ret != base::kOk) return ret;
+    }
+
+    std::string full_file_name;
+    ret = GetFileName(kSourceDataFilePrefix, cur_data_file_suffix_num_, &full_file_name);
+    if (ret != base::kOk) return ret;
+    ret = WriteHintFile(full_file_name, active_hint_);
+    if (ret != base::kOk) {
+      base::LOG_ERR("Failed to write hint of bit cask file:%s, ret:%d", full_file_name.c_str(), ret);
+    }
+
+    base::WriteLock wl(&mu_);
     ret = OpenNextFile(kSourceDataFilePrefix, cur_data_file_suffix_num_);
     if (ret != base::kOk) return ret;
 
@@ -312,40 +707,43 @@ base::Code BitCaskDB::SetValue(const std::string &key, const std::string &value,
   std::string cur_file_name;
   ret = GetFileName(kSourceDataFilePrefix, cur_data_file_suffix_num_, &cur_file_name);
   if (ret != base::kOk) return ret;
-  std::map<std::string, FILE *>::iterator files_it = files_.find(cur_file_name);
-  if (files_it == files_.end()) return base::kInvalidFileName;
 
-  FILE *cur_fp = files_it->second;
-  uint64_t cur_pos = 0;
-  ret = WriteData(cur_data_value, &cur_pos, cur_fp);
-  if (ret != base::kOk) return ret;
+  // NOTE: the active file is never merged, so its fd is kept after mu_ is unlocked
+  base::ReadLock rl(&mu_);
+  std::map<std::string, uint32_t>::iterator files_it = files_.find(cur_file_name);
+  if (files_it == files_.end()) return base::kInvalidFileName;
+  *file_id = files_it->second;
+  *fd = fileno(file_fps_[*file_id]);
 
-  Bucket new_bucket;
-  new_bucket.fp = cur_fp;
-  new_bucket.del_flag = cur_data_value.del_flag;
-  new_bucket.key_size = cur_data_value.key_size;
-  new_bucket.value_size = cur_data_value.value_size;
-  new_bucket.data_pos = cur_pos;
-  new_bucket.time_sec = cur_data_value.time_sec;
-  new_bucket.time_nsec = cur_data_value.time_nsec;
-  new_bucket.version = cur_data_value.version;
+  return base::kOk;
+} /*}}}*/
 
-  index_it = index_.find(key);
-  if (index_it == index_.end()) {
-    index_.insert(std::pair<std::string, Bucket>(key, new_bucket));
+base::Code BitCaskDB::UpdateIndex(const std::string &key, const Bucket &new_bucket) { /*{{{*/
+  Bucket cur_new_bucket = new_bucket;
+  Bucket *cur_bucket = index_.Find(key);
+  if (cur_bucket == NULL) {
+    base::Code ret = index_.Insert(key, cur_new_bucket);
+    if (ret != base::kOk) return ret;
 
-    if (flag == kBCExistFlag) ++info_.used_cnt;
+    if (cur_new_bucket.del_flag == kBCExistFlag) ++info_.used_cnt;
   } else {
-    Bucket *cur_bucket = &(index_it->second);
-    if (cur_bucket->del_flag == kBCDelFlag && flag == kBCExistFlag) ++info_.used_cnt;
-    *cur_bucket = new_bucket;
+    if (cur_bucket->del_flag == kBCDelFlag && cur_new_bucket.del_flag == kBCExistFlag) ++info_.used_cnt;
+    if (cur_bucket->del_flag == kBCExistFlag && cur_new_bucket.del_flag == kBCDelFlag) --info_.used_cnt;
+    if (IsBucketLive(*cur_bucket)) MoveBytes(cur_bucket->file_id, GetRecordSize(*cur_bucket), false);
+    cur_new_bucket.records_num = cur_bucket->records_num + 1;
+    *cur_bucket = cur_new_bucket;
   }
+  AddLiveBytes(cur_new_bucket.file_id, GetRecordSize(cur_new_bucket));
 
-  return ret;
+  return base::kOk;
 } /*}}}*/
 
 base::Code BitCaskDB::ReadData(DataValue *data_value, FILE *fp) { /*{{{*/
-  if (fp == NULL || data_value == NULL) return base::kInvalidParam;
+  return ReadData(data_value, fp, buf_);
+} /*}}}*/
+
+base::Code BitCaskDB::ReadData(DataValue *data_value, FILE *fp, char *buf) { /*{{{*/
+  if (fp == NULL || data_value == NULL || buf == NULL) return base::kInvalidParam;
 
   if (ferror(fp)) return base::kReadError;
   if (feof(fp)) return base::kFileIsEnd;
@@ -362,14 +760,14 @@ base::Code BitCaskDB::ReadData(DataValue *data_value, FILE *fp) { /*{{{*/
   if (ret != base::kOk) return ret;
 
   uint32_t data_len = data_value->key_size + data_value->value_size;
-  r = fread(buf_, sizeof(char), data_len, fp);
+  r = fread(buf, sizeof(char), data_len, fp);
   if (r != data_len) return base::kReadError;
 
   uint64_t start_pos = 0;
-  data_value->key.assign(buf_ + start_pos, data_value->key_size);
+  data_value->key.assign(buf + start_pos, data_value->key_size);
 
   start_pos += data_value->key_size;
-  data_value->value.assign(buf_ + start_pos, data_value->value_size);
+  data_value->value.assign(buf + start_pos, data_value->value_size);
 
   uint32_t tmp_crc = base::CRC32(data_value->value.data(), data_value->value_size);
   if (tmp_crc != data_value->crc) return base::kDataValueError;
@@ -377,24 +775,34 @@ base::Code BitCaskDB::ReadData(DataValue *data_value, FILE *fp) { /*{{{*/
   return ret;
 } /*}}}*/
 
-base::Code BitCaskDB::WriteData(const DataValue &data_value, uint64_t *cur_pos, FILE *fp) { /*{{{*/
-  if (cur_pos == NULL || fp == NULL) return base::kInvalidParam;
-
-  if (ferror(fp)) return base::kReadError;
+/**
+ * NOTE: active file is opened with "a+", so pwrite appends at its end, which is cur_pos since writers are
+ * serialized by write_mu_
+ */
+base::Code BitCaskDB::WriteData(const DataValue &data_value, uint64_t *cur_pos, int fd) { /*{{{*/
+  if (cur_pos == NULL || fd < 0) return base::kInvalidParam;
 
   std::string dump_str;
   base::Code ret = EncodeDataValue(data_value, &dump_str);
   if (ret != base::kOk) return ret;
 
-  int data_fd = fileno(fp);
-  ret = base::GetFileSize(data_fd, cur_pos);
+  return AppendData(dump_str, cur_pos, fd);
+} /*}}}*/
+
+base::Code BitCaskDB::AppendData(const std::string &dump_str, uint64_t *cur_pos, int fd) { /*{{{*/
+  if (cur_pos == NULL || fd < 0) return base::kInvalidParam;
+
+  base::Code ret = base::GetFileSize(fd, cur_pos);
   if (ret != base::kOk) return ret;
 
-  int r = fwrite(dump_str.data(), sizeof(char), dump_str.size(), fp);
-  if (r != (int)dump_str.size()) return base::kWriteError;
+  ret = base::WriteAt(fd, *cur_pos, dump_str.data(), dump_str.size());
+  if (ret != base::kOk) return ret;
 
-  fflush(fp);
-  fsync(data_fd);
+  if (sync_policy_ != kSyncEveryWrite) {
+    __atomic_store_n(&is_dirty_, true, __ATOMIC_SEQ_CST);
+    return ret;
+  }
+  if (fdatasync(fd) != 0) return base::kWriteError;
 
   return ret;
 } /*}}}*/
@@ -546,4 +954,569 @@ base::Code BitCaskDB::DecodeDataValue(const std::string &str, DataValue *data_va
   return ret;
 } /*}}}*/
 
+base::Code BitCaskDB::Merge() { /*{{{*/
+  base::MutexLock merge_ml(&merge_mu_);
+
+  std::vector<std::string> files_name;
+  base::Code ret = PickMergeFiles(&files_name);
+  if (ret != base::kOk) return ret;
+  if (files_name.empty()) return ret;
+
+  struct timeval start;
+  gettimeofday(&start, NULL);
+  uint64_t start_us = (uint64_t)start.tv_sec * 1000000 + start.tv_usec;
+  uint64_t done_bytes = 0;
+  char *buf = new char[kMaxDataSize + kMaxKeySize];
+
+  std::vector<std::string>::iterator files_it = files_name.begin();
+  for (; files_it != files_name.end(); ++files_it) {
+    {
+      base::MutexLock ml(&stop_mu_);
+      if (is_stop_) break;
+    }
+
+    ret = MergeFile(*files_it, buf, start_us, &done_bytes);
+    if (ret != base::kOk) break;
+  }
+  delete[] buf;
+
+  base::Code close_ret = CloseMergeOutFile();
+  if (ret != base::kOk) return ret;
+  return close_ret;
+} /*}}}*/
+
+void *BitCaskDB::MergeThreadAction(void *param) { /*{{{*/
+  BitCaskDB *db = static_cast<BitCaskDB *>(param);
+  db->MergeLoop();
+  return NULL;
+} /*}}}*/
+
+void BitCaskDB::MergeLoop() { /*{{{*/
+  while (true) {
+    {
+      base::MutexLock ml(&stop_mu_);
+      if (!is_stop_) stop_cond_.TimeWait(stop_mu_, merge_option_.interval_ms);
+      if (is_stop_) break;
+    }
+
+    base::Code ret = Merge();
+    if (ret != base::kOk) base::LOG_ERR("Failed to merge bit cask db, dir:%s, ret:%d", dir_path_.c_str(), ret);
+  }
+} /*}}}*/
+
+base::Code BitCaskDB::StopThreads() { /*{{{*/
+  {
+    base::MutexLock ml(&stop_mu_);
+    is_stop_ = true;
+    stop_cond_.BroadCast();
+  }
+
+  if (is_merge_thread_running_) {
+    pthread_join(merge_tid_, NULL);
+    is_merge_thread_running_ = false;
+  }
+
+  if (is_sync_thread_running_) {
+    pthread_join(sync_tid_, NULL);
+    is_sync_thread_running_ = false;
+  }
+
+  return base::kOk;
+} /*}}}*/
+
+/**
+ * NOTE: fd of the active file is duplicated under read lock, so it's synced without lock even if the file is
+ * sealed and removed by merge at the same time; dirty flag is cleared first, so writes done while syncing are
+ * synced by the next round
+ */
+base::Code BitCaskDB::Sync() { /*{{{*/
+  __atomic_store_n(&is_dirty_, false, __ATOMIC_SEQ_CST);
+
+  uint64_t suffix_num = 0;
+  {
+    base::ReadLock rl(&mu_);
+    suffix_num = cur_data_file_suffix_num_;
+  }
+
+  base::Code ret = SyncDataFile(suffix_num);
+  if (ret != base::kOk) __atomic_store_n(&is_dirty_, true, __ATOMIC_SEQ_CST);
+  return ret;
+} /*}}}*/
+
+base::Code BitCaskDB::SyncDataFile(uint64_t suffix_num) { /*{{{*/
+  int fd = -1;
+  {
+    base::ReadLock rl(&mu_);
+    std::string file_name;
+    base::Code ret = GetFileName(kSourceDataFilePrefix, suffix_num, &file_name);
+    if (ret != base::kOk) return ret;
+
+    std::map<std::string, uint32_t>::iterator files_it = files_.find(file_name);
+    if (files_it == files_.end()) return base::kInvalidFileName;
+    fd = dup(fileno(file_fps_[files_it->second]));
+    if (fd < 0) return base::kOpenFileFailed;
+  }
+
+  int r = fdatasync(fd);
+  close(fd);
+  if (r != 0) {
+    base::LOG_ERR("Failed to sync data file of bit cask db, dir:%s, suffix:%llu, errno:%d", dir_path_.c_str(),
+                  (unsigned long long)suffix_num, errno);
+    return base::kWriteError;
+  }
+
+  return base::kOk;
+} /*}}}*/
+
+void *BitCaskDB::SyncThreadAction(void *param) { /*{{{*/
+  BitCaskDB *db = static_cast<BitCaskDB *>(param);
+  db->SyncLoop();
+  return NULL;
+} /*}}}*/
+
+void BitCaskDB::SyncLoop() { /*{{{*/
+  while (true) {
+    {
+      base::MutexLock ml(&stop_mu_);
+      if (!is_stop_) stop_cond_.TimeWait(stop_mu_, sync_interval_ms_);
+      if (is_stop_) break;
+    }
+
+    if (!__atomic_load_n(&is_dirty_, __ATOMIC_SEQ_CST)) continue;
+    base::Code ret = Sync();
+    if (ret != base::kOk) base::LOG_ERR("Failed to sync bit cask db, dir:%s, ret:%d", dir_path_.c_str(), ret);
+  }
+} /*}}}*/
+
+base::Code BitCaskDB::PickMergeFiles(std::vector<std::string> *files_name) { /*{{{*/
+  if (files_name == NULL) return base::kInvalidParam;
+
+  base::ReadLock rl(&mu_);
+  std::string active_file_name;
+  base::Code ret = GetFileName(kSourceDataFilePrefix, cur_data_file_suffix_num_, &active_file_name);
+  if (ret != base::kOk) return ret;
+
+  std::map<uint32_t, FileStat>::iterator stat_it = file_stats_.begin();
+  for (; stat_it != file_stats_.end(); ++stat_it) {
+    const FileStat &file_stat = stat_it->second;
+    if (file_stat.name == active_file_name) continue;
+
+    uint64_t total_bytes = file_stat.live_bytes + file_stat.dead_bytes;
+    if (total_bytes == 0) continue;
+    if (file_stat.dead_bytes >= merge_option_.dead_ratio * total_bytes) files_name->push_back(file_stat.name);
+  }
+
+  return ret;
+} /*}}}*/
+
+/**
+ * NOTE: records are read by a private handle without lock, and only the check of index and the swap lock mu_,
+ * so Put/Get wait at most one record or one swap of file
+ */
+base::Code BitCaskDB::MergeFile(const std::string &file_name, char *buf, uint64_t start_us,
+                                uint64_t *done_bytes) { /*{{{*/
+  uint32_t old_file_id = kInvalidFileId;
+  {
+    base::ReadLock rl(&mu_);
+    std::map<std::string, uint32_t>::iterator files_it = files_.find(file_name);
+    if (files_it == files_.end()) return base::kInvalidFileName;
+    old_file_id = files_it->second;
+  }
+
+  std::string file_path = dir_path_ + base::kSlashStr + file_name;
+  FILE *in_fp = fopen(file_path.c_str(), "r");
+  if (in_fp == NULL) return base::kOpenFileFailed;
+
+  std::vector<MergeRecord> records;
+  uint64_t old_pos = 0;
+  base::Code ret = base::kOk;
+  while (true) {
+    DataValue cur_data_value;
+    ret = ReadData(&cur_data_value, in_fp, buf);
+    if (ret == base::kFileIsEnd) {
+      ret = base::kOk;
+      break;
+    }
+    if (ret != base::kOk) break;
+    cur_data_value.del_flag &= ~kBCBatchMoreFlag;  // NOTE: only live records of complete batch are copied
+
+    MergeRecord record;
+    record.key = cur_data_value.key;
+    record.old_pos = old_pos;
+    record.new_file_id = kInvalidFileId;
+    record.new_pos = 0;
+    record.size = kDataValueHeadSize + cur_data_value.key_size + cur_data_value.value_size;
+    record.is_copied = false;
+    old_pos += record.size;
+    *done_bytes += record.size;
+
+    bool is_live = false;
+    {
+      base::ReadLock rl(&mu_);
+      Bucket *cur_bucket = index_.Find(record.key);
+      is_live = (cur_bucket != NULL && cur_bucket->file_id == old_file_id && cur_bucket->data_pos == record.old_pos &&
+                 IsBucketLive(*cur_bucket));
+    }
+
+    if (is_live) {
+      if (merge_out_fp_ == NULL || merge_out_pos_ >= kSingleFileSize) {
+        ret = OpenMergeOutFile();
+        if (ret != base::kOk) break;
+      }
+
+      std::string dump_str;
+      ret = EncodeDataValue(cur_data_value, &dump_str);
+      if (ret != base::kOk) break;
+      size_t r = fwrite(dump_str.data(), sizeof(char), dump_str.size(), merge_out_fp_);
+      if (r != dump_str.size()) {
+        ret = base::kWriteError;
+        break;
+      }
+
+      record.new_file_id = merge_read_file_id_;
+      record.new_pos = merge_out_pos_;
+      record.is_copied = true;
+      merge_out_pos_ += dump_str.size();
+
+      Bucket new_bucket;
+      new_bucket.del_flag = cur_data_value.del_flag;
+      new_bucket.key_size = cur_data_value.key_size;
+      new_bucket.value_size = cur_data_value.value_size;
+      new_bucket.data_pos = record.new_pos;
+      new_bucket.time_sec = cur_data_value.time_sec;
+      new_bucket.time_nsec = cur_data_value.time_nsec;
+      new_bucket.version = cur_data_value.version;
+      ret = AppendHintEntry(record.key, new_bucket, &merge_hint_);
+      if (ret != base::kOk) break;
+      *done_bytes += record.size;
+    }
+    records.push_back(record);
+
+    ThrottleMerge(start_us, *done_bytes);
+  }
+  fclose(in_fp);
+
+  if (ret == base::kOk && merge_out_fp_ != NULL) {
+    if (fflush(merge_out_fp_) != 0 || fsync(fileno(merge_out_fp_)) != 0) ret = base::kWriteError;
+  }
+
+  if (ret != base::kOk) {
+    // NOTE: copies are not swapped into index, and they are only dead bytes of merge data file
+    base::WriteLock wl(&mu_);
+    std::vector<MergeRecord>::iterator records_it = records.begin();
+    for (; records_it != records.end(); ++records_it) {
+      if (records_it->is_copied) AddDeadBytes(records_it->new_file_id, records_it->size);
+    }
+    return ret;
+  }
+
+  return SwapMergeRecords(old_file_id, records);
+} /*}}}*/
+
+base::Code BitCaskDB::OpenMergeOutFile() { /*{{{*/
+  base::Code ret = CloseMergeOutFile();
+  if (ret != base::kOk) return ret;
+
+  uint64_t next_suffix_num = cur_merge_data_file_suffix_num_ + 1;
+  if (next_suffix_num >= kMaxFilesNum) return base::kFilesNumIsFull;
+
+  std::string file_name;
+  ret = GetFileName(kMergeDataFilePrefix, next_suffix_num, &file_name);
+  if (ret != base::kOk) return ret;
+
+  std::string file_path = dir_path_ + base::kSlashStr + file_name;
+  FILE *out_fp = fopen(file_path.c_str(), "a");
+  if (out_fp == NULL) return base::kOpenFileFailed;
+  FILE *read_fp = fopen(file_path.c_str(), "r");
+  if (read_fp == NULL) {
+    fclose(out_fp);
+    return base::kOpenFileFailed;
+  }
+
+  uint32_t read_file_id = kInvalidFileId;
+  {
+    base::WriteLock wl(&mu_);
+    ret = AddFile(file_name, read_fp, &read_file_id);
+    if (ret == base::kOk) cur_merge_data_file_suffix_num_ = next_suffix_num;
+  }
+  if (ret != base::kOk) {
+    fclose(out_fp);
+    fclose(read_fp);
+    return ret;
+  }
+
+  merge_out_fp_ = out_fp;
+  merge_read_file_id_ = read_file_id;
+  merge_out_pos_ = 0;
+  merge_out_name_ = file_name;
+  merge_hint_.clear();
+
+  return ret;
+} /*}}}*/
+
+base::Code BitCaskDB::CloseMergeOutFile() { /*{{{*/
+  if (merge_out_fp_ == NULL) return base::kOk;
+
+  base::Code ret = base::kOk;
+  if (fflush(merge_out_fp_) != 0 || fsync(fileno(merge_out_fp_)) != 0) ret = base::kWriteError;
+  fclose(merge_out_fp_);
+  if (ret == base::kOk) ret = WriteHintFile(merge_out_name_, merge_hint_);
+
+  merge_out_fp_ = NULL;
+  merge_read_file_id_ = kInvalidFileId;
+  merge_out_pos_ = 0;
+  merge_out_name_.clear();
+  merge_hint_.clear();
+
+  return ret;
+} /*}}}*/
+
+/**
+ * NOTE: copies are swapped into index only if index still points to the old records, otherwise the key is
+ * written again during merge and the copies are dead; then the old file is removed
+ */
+base::Code BitCaskDB::SwapMergeRecords(uint32_t old_file_id, const std::vector<MergeRecord> &records) { /*{{{*/
+  base::WriteLock wl(&mu_);
+
+  std::vector<MergeRecord>::const_iterator records_it = records.begin();
+  for (; records_it != records.end(); ++records_it) {
+    const MergeRecord &record = *records_it;
+    Bucket *cur_bucket = index_.Find(record.key);
+    bool is_newest =
+        (cur_bucket != NULL && cur_bucket->file_id == old_file_id && cur_bucket->data_pos == record.old_pos);
+
+    // NOTE: records num of key is not changed, since the old record is replaced by the copy
+    if (record.is_copied) {
+      if (is_newest) {
+        cur_bucket->file_id = record.new_file_id;
+        cur_bucket->data_pos = record.new_pos;
+        AddLiveBytes(record.new_file_id, record.size);
+      } else {
+        AddDeadBytes(record.new_file_id, record.size);
+      }
+      continue;
+    }
+
+    if (cur_bucket == NULL) continue;
+    if (is_newest) {
+      // NOTE: the delete record which has no other record of key
+      index_.Erase(record.key);
+      continue;
+    }
+    ChangeRecordsNum(cur_bucket, -1);
+  }
+
+  return RemoveDataFile(old_file_id);
+} /*}}}*/
+
+base::Code BitCaskDB::AddFile(const std::string &file_name, FILE *fp, uint32_t *file_id) { /*{{{*/
+  if (fp == NULL || file_id == NULL) return base::kInvalidParam;
+  if (file_fps_.size() > UINT32_MAX) return base::kFilesNumIsFull;
+
+  *file_id = file_fps_.size();
+  file_fps_.push_back(fp);
+  files_.insert(std::pair<std::string, uint32_t>(file_name, *file_id));
+
+  FileStat file_stat;
+  file_stat.name = file_name;
+  file_stat.live_bytes = 0;
+  file_stat.dead_bytes = 0;
+  file_stats_[*file_id] = file_stat;
+
+  return base::kOk;
+} /*}}}*/
+
+base::Code BitCaskDB::RemoveDataFile(uint32_t file_id) { /*{{{*/
+  std::map<uint32_t, FileStat>::iterator stat_it = file_stats_.find(file_id);
+  if (stat_it == file_stats_.end()) return base::kInvalidFileName;
+
+  std::string file_name = stat_it->second.name;
+  file_stats_.erase(stat_it);
+  files_.erase(file_name);
+  fclose(file_fps_[file_id]);
+  file_fps_[file_id] = NULL;
+
+  std::string hint_file_name;
+  base::Code ret = GetHintFileName(file_name, &hint_file_name);
+  if (ret != base::kOk) return ret;
+  std::string hint_file_path = dir_path_ + base::kSlashStr + hint_file_name;
+  if (unlink(hint_file_path.c_str()) != 0 && errno != ENOENT) return base::kRemoveFileFailed;
+
+  std::string file_path = dir_path_ + base::kSlashStr + file_name;
+  if (unlink(file_path.c_str()) != 0) return base::kRemoveFileFailed;
+
+  return base::kOk;
+} /*}}}*/
+
+base::Code BitCaskDB::GetHintFileName(const std::string &file_name, std::string *hint_file_name) { /*{{{*/
+  if (hint_file_name == NULL) return base::kInvalidParam;
+
+  *hint_file_name = kHintFilePrefix + file_name;
+  return base::kOk;
+} /*}}}*/
+
+base::Code BitCaskDB::AppendHintEntry(const std::string &key, const Bucket &bucket, std::string *hint) { /*{{{*/
+  if (hint == NULL) return base::kInvalidParam;
+
+  std::string entry;
+  base::Code ret = base::EncodeFixed32(bucket.del_flag, &entry);
+  if (ret != base::kOk) return ret;
+  ret = base::EncodeFixed32(bucket.time_sec, &entry);
+  if (ret != base::kOk) return ret;
+  ret = base::EncodeFixed32(bucket.time_nsec, &entry);
+  if (ret != base::kOk) return ret;
+  ret = base::EncodeFixed64(bucket.version, &entry);
+  if (ret != base::kOk) return ret;
+  ret = base::EncodeFixed32(bucket.key_size, &entry);
+  if (ret != base::kOk) return ret;
+  ret = base::EncodeFixed32(bucket.value_size, &entry);
+  if (ret != base::kOk) return ret;
+  ret = base::EncodeFixed64(bucket.data_pos, &entry);
+  if (ret != base::kOk) return ret;
+  entry.append(key);
+
+  ret = base::EncodeFixed32(base::CRC32(entry.data(), (int)entry.size()), hint);
+  if (ret != base::kOk) return ret;
+  hint->append(entry);
+
+  return ret;
+} /*}}}*/
+
+/**
+ * NOTE: hint is written into a temp file and renamed, so a hint file is either whole or absent
+ */
+base::Code BitCaskDB::WriteHintFile(const std::string &file_name, const std::string &hint) { /*{{{*/
+  std::string hint_file_name;
+  base::Code ret = GetHintFileName(file_name, &hint_file_name);
+  if (ret != base::kOk) return ret;
+
+  std::string hint_file_path = dir_path_ + base::kSlashStr + hint_file_name;
+  std::string tmp_file_path = dir_path_ + base::kSlashStr + kTmpHintFilePrefix + file_name;
+  FILE *fp = fopen(tmp_file_path.c_str(), "w");
+  if (fp == NULL) return base::kOpenFileFailed;
+
+  size_t r = fwrite(hint.data(), sizeof(char), hint.size(), fp);
+  if (r != hint.size() || fflush(fp) != 0 || fsync(fileno(fp)) != 0) ret = base::kWriteError;
+  fclose(fp);
+  if (ret != base::kOk) {
+    unlink(tmp_file_path.c_str());
+    return ret;
+  }
+
+  if (rename(tmp_file_path.c_str(), hint_file_path.c_str()) != 0) return base::kWriteError;
+  return ret;
+} /*}}}*/
+
+/**
+ * NOTE: all entries are checked before any of them is added into index, so a bad hint can fall back to scan
+ */
+base::Code BitCaskDB::LoadHintFile(const std::string &file_name, uint32_t file_id) { /*{{{*/
+  std::string hint_file_name;
+  base::Code ret = GetHintFileName(file_name, &hint_file_name);
+  if (ret != base::kOk) return ret;
+
+  std::string hint_file_path = dir_path_ + base::kSlashStr + hint_file_name;
+  bool is_exist = false;
+  ret = base::CheckFileExist(hint_file_path, &is_exist);
+  if (ret != base::kOk) return ret;
+  if (!is_exist) return base::kFileNotExist;
+
+  std::string hint;
+  ret = base::PumpWholeData(hint_file_path, &hint);
+  if (ret != base::kOk) return ret;
+
+  uint64_t data_file_size = 0;
+  ret = base::GetFileSize(fileno(file_fps_[file_id]), &data_file_size);
+  if (ret != base::kOk) return ret;
+
+  std::vector<std::pair<std::string, Bucket> > entries;
+  uint64_t pos = 0;
+  while (pos < hint.size()) {
+    if (hint.size() - pos < kHintEntryHeadSize) return base::kDataValueError;
+
+    uint32_t crc = 0;
+    uint32_t tmp_num = 0;
+    Bucket bucket;
+    bucket.file_id = file_id;
+    ret = base::DecodeFixed32(std::string(hint, pos, sizeof(uint32_t)), &crc);
+    if (ret != base::kOk) return ret;
+    ret = base::DecodeFixed32(std::string(hint, pos + 4, sizeof(uint32_t)), &tmp_num);
+    if (ret != base::kOk) return ret;
+    bucket.del_flag = tmp_num;
+    ret = base::DecodeFixed32(std::string(hint, pos + 8, sizeof(uint32_t)), &bucket.time_sec);
+    if (ret != base::kOk) return ret;
+    ret = base::DecodeFixed32(std::string(hint, pos + 12, sizeof(uint32_t)), &bucket.time_nsec);
+    if (ret != base::kOk) return ret;
+    uint64_t version = 0;
+    ret = base::DecodeFixed64(std::string(hint, pos + 16, sizeof(uint64_t)), &version);
+    if (ret != base::kOk) return ret;
+    bucket.version = version;
+    uint32_t key_size = 0;
+    ret = base::DecodeFixed32(std::string(hint, pos + 24, sizeof(uint32_t)), &key_size);
+    if (ret != base::kOk) return ret;
+    bucket.key_size = key_size;
+    ret = base::DecodeFixed32(std::string(hint, pos + 28, sizeof(uint32_t)), &bucket.value_size);
+    if (ret != base::kOk) return ret;
+    uint64_t data_pos = 0;
+    ret = base::DecodeFixed64(std::string(hint, pos + 32, sizeof(uint64_t)), &data_pos);
+    if (ret != base::kOk) return ret;
+    bucket.data_pos = data_pos;
+
+    uint64_t entry_size = kHintEntryHeadSize + key_size;
+    if (key_size >= kMaxKeySize || hint.size() - pos < entry_size) return base::kDataValueError;
+    if (base::CRC32(hint.data() + pos + sizeof(uint32_t), (int)(entry_size - sizeof(uint32_t))) != crc) {
+      return base::kDataValueError;
+    }
+    if (data_pos + GetRecordSize(bucket) > data_file_size) return base::kDataValueError;
+
+    entries.push_back(std::make_pair(std::string(hint, pos + kHintEntryHeadSize, bucket.key_size), bucket));
+    pos += entry_size;
+  }
+
+  std::vector<std::pair<std::string, Bucket> >::iterator entries_it = entries.begin();
+  for (; entries_it != entries.end(); ++entries_it) {
+    ret = AddLoadedRecord(entries_it->first, entries_it->second);
+    if (ret != base::kOk) return ret;
+  }
+
+  return base::kOk;
+} /*}}}*/
+
+void BitCaskDB::ThrottleMerge(uint64_t start_us, uint64_t done_bytes) { /*{{{*/
+  if (merge_option_.rate_bytes == 0) return;
+
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  uint64_t now_us = (uint64_t)now.tv_sec * 1000000 + now.tv_usec;
+  uint64_t expect_us = done_bytes * 1000000 / merge_option_.rate_bytes;
+  if (now_us - start_us < expect_us) usleep(expect_us - (now_us - start_us));
+} /*}}}*/
+
+void BitCaskDB::AddLiveBytes(uint32_t file_id, uint64_t size) { /*{{{*/
+  std::map<uint32_t, FileStat>::iterator stat_it = file_stats_.find(file_id);
+  if (stat_it != file_stats_.end()) stat_it->second.live_bytes += size;
+} /*}}}*/
+
+void BitCaskDB::AddDeadBytes(uint32_t file_id, uint64_t size) { /*{{{*/
+  std::map<uint32_t, FileStat>::iterator stat_it = file_stats_.find(file_id);
+  if (stat_it != file_stats_.end()) stat_it->second.dead_bytes += size;
+} /*}}}*/
+
+void BitCaskDB::MoveBytes(uint32_t file_id, uint64_t size, bool to_live) { /*{{{*/
+  std::map<uint32_t, FileStat>::iterator stat_it = file_stats_.find(file_id);
+  if (stat_it == file_stats_.end()) return;
+
+  uint64_t *from = to_live ? &(stat_it->second.dead_bytes) : &(stat_it->second.live_bytes);
+  uint64_t *to = to_live ? &(stat_it->second.live_bytes) : &(stat_it->second.dead_bytes);
+  *from -= std::min(*from, size);
+  *to += size;
+} /*}}}*/
+
+void BitCaskDB::ChangeRecordsNum(Bucket *bucket, int delta) { /*{{{*/
+  bool was_live = IsBucketLive(*bucket);
+  bucket->records_num += delta;
+  bool is_live = IsBucketLive(*bucket);
+  if (was_live != is_live) MoveBytes(bucket->file_id, GetRecordSize(*bucket), is_live);
+} /*}}}*/
+
 }  // namespace store
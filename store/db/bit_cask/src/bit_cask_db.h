@@ -10,12 +10,16 @@
 #include <vector>
 
 #include <math.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 
 #include "base/common.h"
+#include "base/group_commit.h"
+#include "base/mutex.h"
 #include "base/status.h"
+#include "store/db/bit_cask/src/key_dir.h"
 #include "store/db/include/db_base.h"
 
 namespace store {
@@ -33,11 +37,42 @@ const int kDataFileSuffixLen = 17;
 const uint64_t kMaxFilesNum = (uint64_t)pow(base::kTen, kDataFileSuffixLen) - 1;
 const uint32_t kFileNamePartsSize = 2;
 const uint32_t kInitSuffixNum = 1;
+const uint32_t kDataValueHeadSize = 6 * sizeof(uint32_t) + sizeof(uint64_t);
+
+// Note: hint file of data file is:       hint_data.00000000000000001
+//       hint file of merge data file is: hint_merge_data.00000000000000001
+//       and hint entry is: |crc|del_flag|time_sec|time_nsec|version|key_size|value_size|data_pos|key|
+const std::string kHintFilePrefix = "hint_";
+const std::string kTmpHintFilePrefix = "tmp_hint_";
+const uint32_t kHintEntryHeadSize = 6 * sizeof(uint32_t) + 2 * sizeof(uint64_t);
+
+const double kDefaultMergeDeadRatio = 0.5;
+const uint64_t kDefaultMergeRateBytes = 16 * 1024 * 1024;  // Bytes of merge reading and writing per second
+const uint32_t kDefaultMergeIntervalMs = 60 * 1000;
+
+const uint64_t kMultiGetMaxGapBytes = 4 * 1024;      // Records of MultiGet are read by one pread if gap is less
+const uint64_t kMultiGetMaxReadBytes = 1024 * 1024;  // Max size of one pread of MultiGet
+
+/**
+ * NOTE: merge rewrites live records of files whose dead bytes reach dead_ratio into new merge data files
+ * 1. the active data file is never merged
+ * 2. rate_bytes limits merge io per second so Put/Get are not starved, 0 means no limit
+ * 3. interval_ms is the check interval of background merge thread, 0 means no background merge
+ */
+struct MergeOption { /*{{{*/
+  double dead_ratio;
+  uint64_t rate_bytes;
+  uint32_t interval_ms;
+
+  MergeOption()
+      : dead_ratio(kDefaultMergeDeadRatio), rate_bytes(kDefaultMergeRateBytes), interval_ms(kDefaultMergeIntervalMs) {}
+}; /*}}}*/
 
 enum DataInfoFlag {
   kBCInvalidFlag = 0,
   kBCExistFlag = 1,
   kBCDelFlag = 2,
+  kBCBatchMoreFlag = 0x100,  // Set on records of a batch except the last one, see WriteBatchValues
 };
 
 class BitCaskDB : public DBBase {
@@ -71,9 +106,39 @@ class BitCaskDB : public DBBase {
    */
   virtual base::Code Del(const std::string &key, int64_t version = -1);
 
+  /**
+   * NOTE: "Write" operation will apply all operations of batch, or none of them if one fails
+   * 1. records of batch are appended by one write and synced once, and Put of batch is the same as Put
+   * 2. a batch which is not written completely by crash is dropped when the active file is loaded
+   */
+  virtual base::Code Write(const WriteBatch &batch);
+
+  /**
+   * NOTE: "MultiGet" operation will get values of keys together
+   * 1. records are sorted by file and position, and near records of the same file are read by one pread
+   */
+  virtual base::Code MultiGet(const std::vector<std::string> &keys, std::vector<std::string> *values,
+                              std::vector<base::Code> *rets, std::vector<int64_t> *versions = NULL);
+
  public:
   virtual base::Code Init(const std::string &dir_path);
 
+  // NOTE: should be called before Init
+  void SetMergeOption(const MergeOption &option) { merge_option_ = option; }
+
+  // NOTE: should be called before Init, and interval_ms is only used by kSyncInterval
+  void SetSyncPolicy(SyncPolicy policy, uint32_t interval_ms = kDefaultSyncIntervalMs) { /*{{{*/
+    sync_policy_ = policy;
+    sync_interval_ms_ = interval_ms;
+  } /*}}}*/
+
+  /**
+   * NOTE: "Merge" operation runs one merge round now, which is also run by background thread
+   * 1. index entries are swapped to the new merge data file only after it's synced, then old files are removed
+   * 2. delete records are dropped if no other record of the key is left in files
+   */
+  base::Code Merge();
+
  public:
 #pragma pack(push)
 #pragma pack(1)
@@ -84,65 +149,8 @@ class BitCaskDB : public DBBase {
     uint64_t trx_id;
   }; /*}}}*/
 
-  struct Bucket { /*{{{*/
-    FILE *fp;
-    uint32_t del_flag;
-    uint32_t key_size;
-    uint32_t value_size;
-    uint64_t data_pos;
-    uint32_t time_sec;   // create time of second
-    uint32_t time_nsec;  // create time of nanosecond
-    uint64_t version;
-
-    Bucket() { /*{{{*/
-      fp = NULL;
-      del_flag = kBCInvalidFlag;
-      key_size = 0;
-      value_size = 0;
-      data_pos = 0;
-      time_sec = 0;
-      time_nsec = 0;
-      version = 0;
-    } /*}}}*/
-
-    Bucket(const Bucket &bucket) { /*{{{*/
-      fp = bucket.fp;
-      del_flag = bucket.del_flag;
-      key_size = bucket.key_size;
-      value_size = bucket.value_size;
-      data_pos = bucket.data_pos;
-      time_sec = bucket.time_sec;
-      time_nsec = bucket.time_nsec;
-      version = bucket.version;
-    } /*}}}*/
-
-    Bucket &operator=(const Bucket &bucket) { /*{{{*/
-      fp = bucket.fp;
-      del_flag = bucket.del_flag;
-      key_size = bucket.key_size;
-      value_size = bucket.value_size;
-      data_pos = bucket.data_pos;
-      time_sec = bucket.time_sec;
-      time_nsec = bucket.time_nsec;
-      version = bucket.version;
-      return *this;
-    } /*}}}*/
-
-    ~Bucket() { /*{{{*/ PartClear(); } /*}}}*/
-
-    void PartClear() { /*{{{*/
-      if (fp != NULL) {
-        fp = NULL;  // Not fclose(fp), it should be done by files_;
-      }
-      del_flag = kBCInvalidFlag;
-      key_size = 0;
-      value_size = 0;
-      data_pos = 0;
-      time_sec = 0;
-      time_nsec = 0;
-      version = 0;
-    } /*}}}*/
-  }; /*}}}*/
+  // NOTE: index entry of key, which has file id instead of FILE * for memory, see KeyDirEntry
+  typedef KeyDirEntry Bucket;
 
   /**
    * NOTE: <key, value> format in data file:
@@ -178,21 +186,92 @@ class BitCaskDB : public DBBase {
  public:
   virtual base::Code GetStatus(DBStatusInfo *status_info);
 
+ private:
+  // NOTE: dead bytes are records overwritten or deleted, and delete records which have no older record left
+  struct FileStat { /*{{{*/
+    std::string name;
+    uint64_t live_bytes;
+    uint64_t dead_bytes;
+  }; /*}}}*/
+
+  // NOTE: record of file being merged, and live one is copied and swapped into index if it's still the newest
+  struct MergeRecord { /*{{{*/
+    std::string key;
+    uint64_t old_pos;
+    uint32_t new_file_id;
+    uint64_t new_pos;
+    uint64_t size;
+    bool is_copied;  // false for dead record, or delete record which is dropped
+  }; /*}}}*/
+
+  // NOTE: record to read by MultiGet, index is position in keys
+  struct ReadItem { /*{{{*/
+    Bucket bucket;
+    size_t index;
+
+    bool operator<(const ReadItem &item) const { /*{{{*/
+      if (bucket.file_id != item.bucket.file_id) return bucket.file_id < item.bucket.file_id;
+      return bucket.data_pos < item.bucket.data_pos;
+    } /*}}}*/
+  }; /*}}}*/
+
+  base::Code DecodeRecord(const char *record, const Bucket &bucket, std::string *value, int64_t *version);
+
+  static void *MergeThreadAction(void *param);
+  void MergeLoop();
+  base::Code StopThreads();
+  base::Code PickMergeFiles(std::vector<std::string> *files_name);
+  base::Code MergeFile(const std::string &file_name, char *buf, uint64_t start_us, uint64_t *done_bytes);
+  base::Code OpenMergeOutFile();
+  base::Code CloseMergeOutFile();
+  base::Code SwapMergeRecords(uint32_t old_file_id, const std::vector<MergeRecord> &records);
+  base::Code RemoveDataFile(uint32_t file_id);
+
+  // NOTE: hint file has entries of all records in a sealed file without values, and is loaded instead of scan
+  base::Code GetHintFileName(const std::string &file_name, std::string *hint_file_name);
+  base::Code AppendHintEntry(const std::string &key, const Bucket &bucket, std::string *hint);
+  base::Code WriteHintFile(const std::string &file_name, const std::string &hint);
+  base::Code LoadHintFile(const std::string &file_name, uint32_t file_id);
+  void ThrottleMerge(uint64_t start_us, uint64_t done_bytes);
+
+  uint64_t GetRecordSize(const Bucket &bucket) { return kDataValueHeadSize + bucket.key_size + bucket.value_size; }
+  bool IsBucketLive(const Bucket &bucket) { return bucket.del_flag != kBCDelFlag || bucket.records_num > 1; }
+  void AddLiveBytes(uint32_t file_id, uint64_t size);
+  void AddDeadBytes(uint32_t file_id, uint64_t size);
+  void MoveBytes(uint32_t file_id, uint64_t size, bool to_live);
+  void ChangeRecordsNum(Bucket *bucket, int delta);
+
  private:
   base::Code Destroy();
   base::Code OpenAndReadFiles(const std::vector<std::string> &files_name, const std::string &prefix,
                               uint64_t *cur_suffix_num);
-  base::Code OpenAndReadFile(const std::string &file_name, const std::string &mode);
+  base::Code OpenAndReadFile(const std::string &file_name, const std::string &mode, bool is_active);
+  base::Code AddFile(const std::string &file_name, FILE *fp, uint32_t *file_id);  // NOTE: mu_ should be held
+  base::Code AddLoadedRecord(const std::string &key, const Bucket &bucket);
   base::Code OpenNextFile(const std::string &prefix, uint64_t cur_suffix_num);
   base::Code CheckIsFileFull(const std::string &prefix, uint64_t cur_suffix_num, bool *full);
   base::Code ReadData(DataValue *data_value, FILE *fp);
-  base::Code WriteData(const DataValue &data_value, uint64_t *cur_pos, FILE *fp);
+  base::Code ReadData(DataValue *data_value, FILE *fp, char *buf);
+  base::Code WriteData(const DataValue &data_value, uint64_t *cur_pos, int fd);
+  base::Code AppendData(const std::string &dump_str, uint64_t *cur_pos, int fd);
   base::Code CheckValueIsNew(const Bucket &first_bucket, const Bucket &second_bucket, bool *is_new);
   base::Code CheckValueIsNew(uint32_t first_sec, uint32_t first_nsec, uint32_t second_sec, uint32_t second_nsec,
                              bool *is_new);
   base::Code GetFileName(const std::string &prefix, uint64_t cur_suffix_num, std::string *file_name);
 
   base::Code SetValue(const std::string &key, const std::string &value, int flag, int64_t version);
+  base::Code WriteValue(const std::string &key, const std::string &value, int flag, int64_t version,
+                        uint64_t *seq);  // NOTE: seq is set for kSyncGroupCommit, which should be waited
+  base::Code WriteBatchValues(const WriteBatch &batch, uint64_t *seq);
+  base::Code GetNewVersion(const Bucket *cur_bucket, int flag, int64_t version, uint64_t *new_version);
+  base::Code GetActiveFile(uint32_t *file_id, int *fd);                      // NOTE: write_mu_ should be held
+  base::Code UpdateIndex(const std::string &key, const Bucket &new_bucket);  // NOTE: mu_ should be held
+
+  // NOTE: only the active file is synced, since the full one is synced before the next file is opened
+  base::Code Sync();
+  base::Code SyncDataFile(uint64_t suffix_num);  // NOTE: fd is duplicated under mu_, and synced without lock
+  static void *SyncThreadAction(void *param);
+  void SyncLoop();
 
   base::Code EncodeDataValueHead(const DataValue &data_value, std::string *str);
   base::Code DecodeDataValueHead(const std::string &str, DataValue *data_value);
@@ -203,12 +282,38 @@ class BitCaskDB : public DBBase {
   // NOTE: files in directory: source data files and merge data files
   std::string dir_path_;
   Info info_;
-  std::map<std::string, Bucket> index_;
+  KeyDir index_;
   uint64_t cur_data_file_suffix_num_;
   uint64_t cur_merge_data_file_suffix_num_;
   char *buf_;
-  std::map<std::string, FILE *> files_;  // Data files and fp after fopen
-  std::string stat_path_;                // TODO: To write stat info to file
+  std::map<std::string, uint32_t> files_;  // Data files and file id
+  std::vector<FILE *> file_fps_;           // Fp of file id after fopen, and NULL for removed file
+  std::string stat_path_;                  // TODO: To write stat info to file
+  std::map<uint32_t, FileStat> file_stats_;
+  std::string active_hint_;  // Hint entries of the active data file, which is written when the file is full
+
+  base::RWMutex mu_;       // Protect index, files and stats, which are shared by Get, Put and merge
+  base::Mutex write_mu_;   // Only one Put or Del appends at the same time
+  base::Mutex merge_mu_;   // Only one merge round runs at the same time
+
+  MergeOption merge_option_;
+  FILE *merge_out_fp_;  // Write handle of current merge data file, and merge_read_file_id_ is in files_
+  uint32_t merge_read_file_id_;
+  uint64_t merge_out_pos_;
+  std::string merge_out_name_;
+  std::string merge_hint_;
+  pthread_t merge_tid_;
+  bool is_merge_thread_running_;
+  base::Mutex stop_mu_;
+  base::Cond stop_cond_;  // Merge and sync threads wait on it
+  bool is_stop_;
+
+  SyncPolicy sync_policy_;
+  uint32_t sync_interval_ms_;
+  bool is_dirty_;  // There are writes after the last sync
+  base::GroupCommit group_commit_;
+  pthread_t sync_tid_;
+  bool is_sync_thread_running_;
 };
 
 }  // namespace store
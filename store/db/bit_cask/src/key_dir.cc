@@ -0,0 +1,182 @@
+// Copyright (c) 2015 The CSUTIL Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <string.h>
+
+#include "base/hash.h"
+
+#include "key_dir.h"
+
+namespace store {
+
+const uint32_t kKeyDirHashSeed = 0x9747b28c;
+
+KeyDir::KeyDir()
+    : slots_(), mask_(0), size_(0), blocks_(), cur_block_pos_(0), arena_bytes_(0), erased_bytes_(0) { /*{{{*/
+} /*}}}*/
+
+KeyDir::~KeyDir() { /*{{{*/ Clear(); } /*}}}*/
+
+void KeyDir::Clear() { /*{{{*/
+  std::vector<char *>::iterator blocks_it = blocks_.begin();
+  for (; blocks_it != blocks_.end(); ++blocks_it) {
+    delete[] *blocks_it;
+  }
+  blocks_.clear();
+  std::vector<KeyDirSlot>().swap(slots_);
+
+  mask_ = 0;
+  size_ = 0;
+  cur_block_pos_ = 0;
+  arena_bytes_ = 0;
+  erased_bytes_ = 0;
+} /*}}}*/
+
+KeyDirEntry *KeyDir::Find(const std::string &key) { /*{{{*/
+  if (slots_.empty() || key.size() > kKeyDirMaxKeySize) return NULL;
+
+  bool found = false;
+  uint64_t index = FindSlot(key, base::Murmur32(key, kKeyDirHashSeed), &found);
+  if (!found) return NULL;
+
+  return &(slots_[index].entry);
+} /*}}}*/
+
+base::Code KeyDir::Insert(const std::string &key, const KeyDirEntry &entry) { /*{{{*/
+  // NOTE: longer key would be truncated in key_size of entry, then it is never found and corrupts rebuild
+  if (entry.file_id == kInvalidFileId || key.size() > kKeyDirMaxKeySize) return base::kInvalidParam;
+
+  // NOTE: load factor is kept under 3/4, so probe sequences stay short
+  if (slots_.empty()) {
+    Rebuild(kKeyDirInitSlotsNum);
+  } else if ((size_ + 1) * 4 > slots_.size() * 3) {
+    Rebuild(slots_.size() * 2);
+  }
+
+  uint32_t hash = base::Murmur32(key, kKeyDirHashSeed);
+  bool found = false;
+  uint64_t index = FindSlot(key, hash, &found);
+  if (found) return base::kAlreadyExist;
+
+  uint64_t key_ref = 0;
+  base::Code ret = AppendKey(key.data(), key.size(), &key_ref);
+  if (ret != base::kOk) return ret;
+
+  KeyDirSlot *slot = &(slots_[index]);
+  slot->hash = hash;
+  slot->key_ref = key_ref;
+  slot->entry = entry;
+  slot->entry.key_size = key.size();
+  ++size_;
+
+  return base::kOk;
+} /*}}}*/
+
+base::Code KeyDir::Erase(const std::string &key) { /*{{{*/
+  if (key.size() > kKeyDirMaxKeySize) return base::kInvalidParam;
+  if (slots_.empty()) return base::kNotFound;
+
+  bool found = false;
+  uint64_t index = FindSlot(key, base::Murmur32(key, kKeyDirHashSeed), &found);
+  if (!found) return base::kNotFound;
+  erased_bytes_ += slots_[index].entry.key_size;
+
+  // NOTE: slot after the hole is moved back if its home is not between the hole and itself
+  uint64_t hole = index;
+  uint64_t next = index;
+  while (true) {
+    next = (next + 1) & mask_;
+    const KeyDirSlot &next_slot = slots_[next];
+    if (next_slot.entry.file_id == kInvalidFileId) break;
+
+    uint64_t home = next_slot.hash & mask_;
+    bool is_between = (hole <= next) ? (hole < home && home <= next) : (hole < home || home <= next);
+    if (is_between) continue;
+
+    slots_[hole] = next_slot;
+    hole = next;
+  }
+  slots_[hole].hash = 0;
+  slots_[hole].key_ref = 0;
+  slots_[hole].entry.PartClear();
+  --size_;
+
+  if (erased_bytes_ > kKeyDirArenaBlockSize && erased_bytes_ * 2 > arena_bytes_) Rebuild(slots_.size());
+  return base::kOk;
+} /*}}}*/
+
+uint64_t KeyDir::GetMemoryBytes() const { /*{{{*/
+  return slots_.capacity() * sizeof(KeyDirSlot) + blocks_.size() * (uint64_t)kKeyDirArenaBlockSize +
+         blocks_.capacity() * sizeof(char *);
+} /*}}}*/
+
+uint64_t KeyDir::FindSlot(const std::string &key, uint32_t hash, bool *found) { /*{{{*/
+  *found = false;
+  uint64_t index = hash & mask_;
+  while (true) {
+    const KeyDirSlot &slot = slots_[index];
+    if (slot.entry.file_id == kInvalidFileId) return index;
+    if (slot.hash == hash && slot.entry.key_size == key.size() &&
+        memcmp(GetKey(slot.key_ref), key.data(), key.size()) == 0) {
+      *found = true;
+      return index;
+    }
+    index = (index + 1) & mask_;
+  }
+} /*}}}*/
+
+base::Code KeyDir::AppendKey(const char *key, uint32_t key_size, uint64_t *key_ref) { /*{{{*/
+  if (blocks_.empty() || cur_block_pos_ + key_size > kKeyDirArenaBlockSize) {
+    blocks_.push_back(new char[kKeyDirArenaBlockSize]);
+    cur_block_pos_ = 0;
+  }
+
+  memcpy(blocks_.back() + cur_block_pos_, key, key_size);
+  *key_ref = ((uint64_t)(blocks_.size() - 1) << 32) | cur_block_pos_;
+  cur_block_pos_ += key_size;
+  arena_bytes_ += key_size;
+
+  return base::kOk;
+} /*}}}*/
+
+const char *KeyDir::GetKey(uint64_t key_ref) const { /*{{{*/
+  return blocks_[key_ref >> 32] + (key_ref & 0xffffffff);
+} /*}}}*/
+
+/**
+ * NOTE: keys are copied into a new arena at the same time, so erased keys are dropped by growing too
+ */
+void KeyDir::Rebuild(uint64_t slots_num) { /*{{{*/
+  std::vector<KeyDirSlot> old_slots(slots_num);
+  old_slots.swap(slots_);
+  std::vector<char *> old_blocks;
+  old_blocks.swap(blocks_);
+  mask_ = slots_num - 1;
+  cur_block_pos_ = 0;
+  arena_bytes_ = 0;
+  erased_bytes_ = 0;
+
+  std::vector<KeyDirSlot>::iterator slots_it = old_slots.begin();
+  for (; slots_it != old_slots.end(); ++slots_it) {
+    if (slots_it->entry.file_id == kInvalidFileId) continue;
+
+    uint64_t index = slots_it->hash & mask_;
+    while (slots_[index].entry.file_id != kInvalidFileId) {
+      index = (index + 1) & mask_;
+    }
+
+    const char *old_key = old_blocks[slots_it->key_ref >> 32] + (slots_it->key_ref & 0xffffffff);
+    uint64_t key_ref = 0;
+    AppendKey(old_key, slots_it->entry.key_size, &key_ref);
+    slots_[index] = *slots_it;
+    slots_[index].key_ref = key_ref;
+  }
+
+  std::vector<char *>::iterator blocks_it = old_blocks.begin();
+  for (; blocks_it != old_blocks.end(); ++blocks_it) {
+    delete[] *blocks_it;
+  }
+} /*}}}*/
+
+}  // namespace store
@@ -0,0 +1,107 @@
+// Copyright (c) 2015 The CSUTIL Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef STORE_DB_BIT_CASK_KEY_DIR_H_
+#define STORE_DB_BIT_CASK_KEY_DIR_H_
+
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include "base/status.h"
+
+namespace store {
+
+const uint32_t kInvalidFileId = 0;
+const uint32_t kKeyDirInitSlotsNum = 1024;               // Should be power of 2
+const uint32_t kKeyDirArenaBlockSize = 4 * 1024 * 1024;  // Keys are stored in blocks of arena
+const uint32_t kKeyDirMaxKeySize = 0xFFFF;                // Limited by key_size of KeyDirEntry
+
+#pragma pack(push)
+#pragma pack(1)
+/**
+ * NOTE: index entry of a key, which is packed since there is one for every key
+ * 1. file_id is index of file table of BitCaskDB, and kInvalidFileId means the slot is empty
+ * 2. data_pos fits 32 bits, since a data file is sealed once it's larger than kSingleFileSize
+ */
+struct KeyDirEntry { /*{{{*/
+  uint32_t file_id;
+  uint32_t data_pos;
+  uint32_t value_size;
+  uint16_t key_size;
+  uint8_t del_flag;
+  uint32_t time_sec;   // create time of second
+  uint32_t time_nsec;  // create time of nanosecond
+  uint64_t version;
+  uint32_t records_num;  // Records of key in all files, the delete record can be dropped if it's the only one
+
+  KeyDirEntry() { /*{{{*/ PartClear(); } /*}}}*/
+
+  void PartClear() { /*{{{*/
+    file_id = kInvalidFileId;
+    data_pos = 0;
+    value_size = 0;
+    key_size = 0;
+    del_flag = 0;
+    time_sec = 0;
+    time_nsec = 0;
+    version = 0;
+    records_num = 0;
+  } /*}}}*/
+}; /*}}}*/
+
+struct KeyDirSlot { /*{{{*/
+  uint32_t hash;
+  uint64_t key_ref;  // Position of key in arena, block index is the high part
+  KeyDirEntry entry;
+}; /*}}}*/
+#pragma pack(pop)
+
+/**
+ * NOTE: KeyDir is the in-memory index of BitCaskDB, which is an open addressing hash table
+ * 1. slots are probed linearly, and erase shifts the following slots back, so there is no tombstone
+ * 2. keys are appended into blocks of arena, and the arena is rebuilt when erased keys are more than half
+ * 3. pointer returned by Find is valid until the next Insert or Erase
+ */
+class KeyDir { /*{{{*/
+ public:
+  KeyDir();
+  ~KeyDir();
+
+ public:
+  KeyDirEntry *Find(const std::string &key);
+  base::Code Insert(const std::string &key, const KeyDirEntry &entry);
+  base::Code Erase(const std::string &key);
+  void Clear();
+
+  uint64_t Size() const { return size_; }
+
+  // NOTE: bytes of slots and arena blocks, which are all memory of index
+  uint64_t GetMemoryBytes() const;
+
+ private:
+  uint64_t FindSlot(const std::string &key, uint32_t hash, bool *found);
+  base::Code AppendKey(const char *key, uint32_t key_size, uint64_t *key_ref);
+  const char *GetKey(uint64_t key_ref) const;
+  void Rebuild(uint64_t slots_num);
+
+ private:
+  KeyDir(const KeyDir &);
+  KeyDir &operator=(const KeyDir &);
+
+ private:
+  std::vector<KeyDirSlot> slots_;
+  uint64_t mask_;
+  uint64_t size_;
+
+  std::vector<char *> blocks_;
+  uint32_t cur_block_pos_;
+  uint64_t arena_bytes_;
+  uint64_t erased_bytes_;
+}; /*}}}*/
+
+}  // namespace store
+
+#endif
@@ -2,8 +2,13 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <algorithm>
+#include <map>
+
 #include <assert.h>
+#include <endian.h>
 #include <errno.h>
+#include <sys/mman.h>
 #include <unistd.h>
 
 #include "base/coding.h"
@@ -15,275 +20,121 @@
 
 namespace store {
 
-HashDB::HashDB() : index_fp_(NULL), data_fp_(NULL), index_(NULL) { /*{{{*/
-  buf_ = new char[kMaxDataSize];
-  memset(buf_, 0, sizeof(kMaxDataSize));
+HashDB::HashDB()
+    : index_fp_(NULL),
+      data_fp_(NULL),
+      option_(),
+      index_map_(NULL),
+      index_map_size_(0),
+      index_end_(0),
+      is_dirty_(false),
+      sync_tid_(),
+      is_sync_thread_running_(false),
+      is_stop_(false) { /*{{{*/
+  memset(&info_, 0, sizeof(info_));
 } /*}}}*/
 
-HashDB::~HashDB() { /*{{{*/
-  Destroy();
-
-  if (buf_ != NULL) {
-    delete[] buf_;
-    buf_ = NULL;
-  }
-} /*}}}*/
+HashDB::~HashDB() { /*{{{*/ Destroy(); } /*}}}*/
 
 base::Code HashDB::Put(const std::string &key, const std::string &value, int64_t version /*=-1*/) { /*{{{*/
-  if (value.size() >= kMaxDataSize) return base::kValueSizeIsLarger;
-  //    if (index_->info.max_num >= kMaxKeysNum) return base::kDBFull;
-
-  base::Code ret = base::kOk;
-  Bucket bkt;
-  DataValue data_value;
-  uint64_t hash_pos = 0;  // hash position in hash_dir
-  uint64_t next_pos = 0;  // bucket position in bucket
-  uint64_t cur_pos = 0;
-  bool is_exist = false;
-  char tmp_buf64[sizeof(uint64_t)] = {0};
-  char tmp_buf_bkt[sizeof(Bucket)] = {0};
+  uint64_t seq = 0;
+  base::Code ret = PutValue(key, value, version, &seq);
+  if (ret != base::kOk || seq == 0) return ret;
 
-  uint32_t crc_key = base::CRC32(key.data(), key.size());
-  hash_pos = (crc_key % (sizeof(index_->hash_dir) / sizeof(index_->hash_dir[0]))) * sizeof(uint64_t) + sizeof(Info);
+  return WaitSynced(seq);
+} /*}}}*/
 
-  fseek(index_fp_, hash_pos, SEEK_SET);
-  size_t r = fread(tmp_buf64, sizeof(char), sizeof(uint64_t), index_fp_);
-  if (r != sizeof(uint64_t)) {
-    base::LOG_ERR("Failed to hash_pos:%llu in index file, ret:%d, errno:%d", (unsigned long long)hash_pos, r, errno);
-    return base::kReadError;
-  }
+base::Code HashDB::PutValue(const std::string &key, const std::string &value, int64_t version, uint64_t *seq) { /*{{{*/
+  if (value.size() >= kMaxDataSize) return base::kValueSizeIsLarger;
 
-  ret = base::DecodeFixed64(std::string(tmp_buf64, sizeof(uint64_t)), &next_pos);
+  // NOTE: buckets are updated in place, so Put and Del hold the write lock, and wait group commit after unlocked
+  base::WriteLock wl(&mu_);
+  base::Code ret = RehashIfFull(1);
   if (ret != base::kOk) return ret;
 
-  while (next_pos != 0) { /*{{{*/
-    cur_pos = next_pos;
-
-    memset(&bkt, 0, sizeof(Bucket));
-    memset(tmp_buf_bkt, 0, sizeof(Bucket));
-
-    fseek(index_fp_, next_pos, SEEK_SET);
-    r = fread(tmp_buf_bkt, sizeof(char), sizeof(Bucket), index_fp_);
-    if (r != sizeof(Bucket)) {
-      base::LOG_ERR("Failed to bucket_pos:%llu in index file, ret:%d, errno:%d", (unsigned long long)next_pos, r,
-                    errno);
-      return base::kReadError;
-    }
-
-    ret = DecodeBucket(std::string(tmp_buf_bkt, sizeof(tmp_buf_bkt)), &bkt);
-    if (ret != base::kOk) return ret;
-
-    if (crc_key == bkt.key_hash && key.size() == bkt.key_size &&
-        memcmp(key.data(), bkt.pre_key, sizeof(bkt.pre_key) < key.size() ? sizeof(bkt.pre_key) : key.size()) ==
-            0) { /*{{{*/
-      uint32_t data_len = 4 * sizeof(uint32_t) + bkt.key_size + bkt.value_size + sizeof(uint64_t);
-      fseek(data_fp_, bkt.data_pos, SEEK_SET);
-      r = fread(buf_, sizeof(char), data_len, data_fp_);
-      if (r != data_len) {
-        base::LOG_ERR("Failed to read data_pos:%llu in data file, ret:%d, errno:%d", (unsigned long long)bkt.data_pos,
-                      r, errno);
-        return base::kReadError;
-      }
-
-      data_value.Clear();
-      ret = DecodeDataValue(std::string(buf_, data_len), &data_value);
-      if (ret != base::kOk) return ret;
-
-      uint32_t tmp_value_crc = base::CRC32(data_value.value.data(), data_value.value_size);
-      if (data_value.crc != tmp_value_crc) {
-        base::LOG_ERR("Failed to check data value crc");
-        return base::kDataValueError;
-      }
-
-      assert(bkt.key_size == data_value.key_size);
-      if (memcmp(key.data(), data_value.key.data(), key.size()) == 0) {
-        is_exist = true;
-        break;
-      }
-    } /*}}}*/
-
-    next_pos = bkt.next_pos;
-  } /*}}}*/
+  KeyPos key_pos;
+  ret = FindKey(key, &key_pos);
+  if (ret != base::kOk) return ret;
 
-  if (is_exist && version != -1 && version != (int64_t)bkt.version) {
+  if (key_pos.is_exist && version != -1 && version != (int64_t)key_pos.bkt.version) {
     return base::kCASFailed;
   }
 
-  if (!is_exist && version != -1 && version != 0) {
+  if (!key_pos.is_exist && version != -1 && version != 0) {
     return base::kCASFailed;
   }
 
   uint64_t data_file_size = 0;
   ret = base::GetFileSize(data_path_, &data_file_size);
   if (ret != base::kOk) return ret;
-  data_value.Clear();
-  data_value.key = key;
-  data_value.value = value;
-  data_value.key_size = key.size();
-  data_value.value_size = value.size();
-  data_value.total_size = sizeof(uint32_t) * 2 + data_value.key_size + data_value.value_size;
-
-  if (is_exist) { /*{{{*/
-    bkt.version++;
-    bkt.value_size = data_value.value_size;
-    bkt.data_pos = data_file_size;
-
-    // write new data
-    data_value.version = bkt.version;
-    data_value.crc = base::CRC32(data_value.value.data(), data_value.value_size);
-    std::string tmp_data_value;
-    ret = EncodeDataValue(data_value, &tmp_data_value);
-    if (ret != base::kOk) return ret;
-
-    fseek(data_fp_, data_file_size, SEEK_SET);
-    size_t r = fwrite(tmp_data_value.data(), sizeof(char), tmp_data_value.size(), data_fp_);
-    if (r != tmp_data_value.size()) return base::kWriteError;
-
-    // update bucket info
-    std::string tmp_bkt_value;
-    ret = EncodeBucket(bkt, &tmp_bkt_value);
-    if (ret != base::kOk) return ret;
-
-    fseek(index_fp_, cur_pos, SEEK_SET);
-    r = fwrite(tmp_bkt_value.data(), sizeof(char), tmp_bkt_value.size(), index_fp_);
-    if (r != tmp_bkt_value.size()) return base::kWriteError;
-  } /*}}}*/
-  else { /*{{{*/
-    uint64_t hash_file_size = 0;
-    ret = base::GetFileSize(index_path_, &hash_file_size);
-    if (ret != base::kOk) return ret;
-
-    Bucket new_bkt;
-    new_bkt.Clear();
-    new_bkt.version = 1;
-    new_bkt.next_pos = 0;
-    new_bkt.key_hash = crc_key;
-    memcpy(new_bkt.pre_key, key.data(), sizeof(new_bkt.pre_key) < key.size() ? sizeof(new_bkt.pre_key) : key.size());
-    new_bkt.key_size = key.size();
-    new_bkt.value_size = value.size();
-    new_bkt.data_pos = data_file_size;
-
-    // Write new data
-    data_value.version = new_bkt.version;
-    data_value.crc = base::CRC32(data_value.value.data(), data_value.value_size);
-    std::string tmp_data_value;
-    ret = EncodeDataValue(data_value, &tmp_data_value);
-    if (ret != base::kOk) return ret;
-
-    fseek(data_fp_, data_file_size, SEEK_SET);
-    size_t r = fwrite(tmp_data_value.data(), sizeof(char), tmp_data_value.size(), data_fp_);
-    if (r != tmp_data_value.size()) return base::kWriteError;
-
-    // Set new bucket info
-    std::string tmp_bkt_value;
-    ret = EncodeBucket(new_bkt, &tmp_bkt_value);
-    if (ret != base::kOk) return ret;
-
-    fseek(index_fp_, hash_file_size, SEEK_SET);
-    r = fwrite(tmp_bkt_value.data(), sizeof(char), tmp_bkt_value.size(), index_fp_);
-    if (r != tmp_bkt_value.size()) return base::kWriteError;
 
-    // Update prefix bucket info
-    std::string tmp_hash_file_size;
-    ret = base::EncodeFixed64(hash_file_size, &tmp_hash_file_size);
-    if (ret != base::kOk) return ret;
-
-    if (cur_pos == 0) {
-      fseek(index_fp_, hash_pos, SEEK_SET);
-      r = fwrite(tmp_hash_file_size.data(), sizeof(char), tmp_hash_file_size.size(), index_fp_);
-      if (r != tmp_hash_file_size.size()) return base::kWriteError;
-    } else {
-      bkt.next_pos = hash_file_size;
+  // Write new data
+  uint64_t new_version = key_pos.is_exist ? key_pos.bkt.version + 1 : 1;
+  std::string tmp_data_value;
+  ret = EncodeNewData(key, value, new_version, &tmp_data_value);
+  if (ret != base::kOk) return ret;
 
-      // Update prefix bucket info
-      tmp_bkt_value.clear();
-      ret = EncodeBucket(bkt, &tmp_bkt_value);
-      if (ret != base::kOk) return ret;
+  ret = base::WriteAt(fileno(data_fp_), data_file_size, tmp_data_value.data(), tmp_data_value.size());
+  if (ret != base::kOk) return ret;
 
-      fseek(index_fp_, cur_pos, SEEK_SET);
-      r = fwrite(tmp_bkt_value.data(), sizeof(char), tmp_bkt_value.size(), index_fp_);
-      if (r != tmp_bkt_value.size()) return base::kWriteError;
-    }
-  } /*}}}*/
+  ret = SetBucket(key, key_pos, value.size(), new_version, data_file_size);
+  if (ret != base::kOk) return ret;
 
-  if (!is_exist) {
-    index_->info.used_cnt++;
+  if (!key_pos.is_exist) {
+    info_.used_cnt++;
   }
-  index_->info.trx_id++;
-  std::string tmp_info;
-  ret = EncodeInfo(index_->info, &tmp_info);
-  if (ret != base::kOk) return ret;
+  info_.trx_id++;
 
   // Update info
-  fseek(index_fp_, 0, SEEK_SET);
-  r = fwrite(tmp_info.data(), sizeof(char), tmp_info.size(), index_fp_);
-  if (r != tmp_info.size()) return base::kWriteError;
-
-  fflush(data_fp_);
-  fflush(index_fp_);
-
-  int data_fd = fileno(data_fp_);
-  fsync(data_fd);
-  int index_fd = fileno(index_fp_);
-  fsync(index_fd);
+  ret = WriteInfo();
+  if (ret != base::kOk) return ret;
 
-  return base::kOk;
+  return SyncAfterWrite(seq);
 } /*}}}*/
 
 base::Code HashDB::Get(const std::string &key, std::string *value, int64_t *version /*=NULL*/) { /*{{{*/
   if (value == NULL) return base::kInvalidParam;
 
+  // NOTE: index and data are read by pread or from mapping into local buffers, so Gets run at the same time
+  base::ReadLock rl(&mu_);
   base::Code ret = base::kOk;
   Bucket bkt;
   uint64_t hash_pos = 0;  // hash position in hash_dir
   uint64_t next_pos = 0;  // bucket position in bucket
-  char tmp_buf64[sizeof(uint64_t)] = {0};
-  char tmp_buf_bkt[sizeof(Bucket)] = {0};
 
   uint32_t crc_key = base::CRC32(key.data(), key.size());
-  hash_pos = (crc_key % (sizeof(index_->hash_dir) / sizeof(index_->hash_dir[0]))) * sizeof(uint64_t) + sizeof(Info);
+  hash_pos = (crc_key % info_.max_num) * sizeof(uint64_t) + sizeof(Info);
 
-  fseek(index_fp_, hash_pos, SEEK_SET);
-  size_t r = fread(tmp_buf64, sizeof(char), sizeof(uint64_t), index_fp_);
-  if (r != sizeof(uint64_t)) {
-    base::LOG_ERR("Failed to hash_pos:%llu in index file, ret:%d, errno:%d", (unsigned long long)hash_pos, r, errno);
+  ret = ReadIndexPos(hash_pos, &next_pos);
+  if (ret != base::kOk) {
+    base::LOG_ERR("Failed to hash_pos:%llu in index file, ret:%d, errno:%d", (unsigned long long)hash_pos, ret, errno);
     return base::kReadError;
   }
-
-  ret = base::DecodeFixed64(std::string(tmp_buf64, sizeof(uint64_t)), &next_pos);
-  if (ret != base::kOk) return ret;
   if (next_pos == 0) return base::kNotFound;  // There is no such key
 
   DataValue data_value;
   while (next_pos != 0) { /*{{{*/
-    memset(&bkt, 0, sizeof(Bucket));
-    memset(tmp_buf_bkt, 0, sizeof(Bucket));
-
-    fseek(index_fp_, next_pos, SEEK_SET);
-    r = fread(tmp_buf_bkt, sizeof(char), sizeof(Bucket), index_fp_);
-    if (r != sizeof(Bucket)) {
+    ret = ReadBucket(next_pos, &bkt);
+    if (ret != base::kOk) {
       base::LOG_ERR("Failed to read data at_pos:%llu in index file, ret:%d, expect len:%zd, errno:%d",
-                    (unsigned long long)next_pos, r, sizeof(Bucket), errno);
+                    (unsigned long long)next_pos, ret, sizeof(Bucket), errno);
       return base::kReadError;
     }
 
-    ret = DecodeBucket(std::string(tmp_buf_bkt, sizeof(tmp_buf_bkt)), &bkt);
-    if (ret != base::kOk) return ret;
-
     if (crc_key == bkt.key_hash && key.size() == bkt.key_size &&
         memcmp(key.data(), bkt.pre_key, sizeof(bkt.pre_key) < key.size() ? sizeof(bkt.pre_key) : key.size()) ==
             0) { /*{{{*/
       uint32_t data_len = 4 * sizeof(uint32_t) + bkt.key_size + bkt.value_size + sizeof(uint64_t);
-      fseek(data_fp_, bkt.data_pos, SEEK_SET);
-      r = fread(buf_, sizeof(char), data_len, data_fp_);
-      if (r != data_len) {
+      std::string data_buf(data_len, '\0');
+      ret = base::ReadAt(fileno(data_fp_), bkt.data_pos, data_len, &data_buf[0]);
+      if (ret != base::kOk) {
         base::LOG_ERR("Failed to read data_pos:%llu in data file, ret:%d, errno:%d", (unsigned long long)bkt.data_pos,
-                      r, errno);
+                      ret, errno);
         return base::kReadError;
       }
 
       data_value.Clear();
-      ret = DecodeDataValue(std::string(buf_, data_len), &data_value);
+      ret = DecodeDataValue(data_buf, &data_value);
       if (ret != base::kOk) return ret;
 
       uint32_t tmp_value_crc = base::CRC32(data_value.value.data(), data_value.value_size);
@@ -308,138 +159,223 @@ base::Code HashDB::Get(const std::string &key, std::string *value, int64_t *vers
 } /*}}}*/
 
 base::Code HashDB::Del(const std::string &key, int64_t version /*=-1*/) { /*{{{*/
-  base::Code ret = base::kOk;
-  Bucket bkt;
-  Bucket pre_bkt;
-  DataValue data_value;
-  uint64_t hash_pos = 0;  // hash position in hash_dir
-  uint64_t next_pos = 0;  // bucket position in bucket
-  uint64_t cur_pos = 0;
-  uint64_t pre_pos = 0;
-  bool is_exist = false;
-  char tmp_buf64[sizeof(uint64_t)] = {0};
-  char tmp_buf_bkt[sizeof(Bucket)] = {0};
+  uint64_t seq = 0;
+  base::Code ret = DelValue(key, version, &seq);
+  if (ret != base::kOk || seq == 0) return ret;
 
-  uint32_t crc_key = base::CRC32(key.data(), key.size());
-  hash_pos = (crc_key % (sizeof(index_->hash_dir) / sizeof(index_->hash_dir[0]))) * sizeof(uint64_t) + sizeof(Info);
+  return WaitSynced(seq);
+} /*}}}*/
 
-  fseek(index_fp_, hash_pos, SEEK_SET);
-  size_t r = fread(tmp_buf64, sizeof(char), sizeof(uint64_t), index_fp_);
-  if (r != sizeof(uint64_t)) {
-    base::LOG_ERR("Failed to hash_pos:%llu in index file, ret:%d, errno:%d", (unsigned long long)hash_pos, r, errno);
-    return base::kReadError;
+base::Code HashDB::DelValue(const std::string &key, int64_t version, uint64_t *seq) { /*{{{*/
+  base::WriteLock wl(&mu_);
+  KeyPos key_pos;
+  base::Code ret = FindKey(key, &key_pos);
+  if (ret != base::kOk) return ret;
+
+  if (!key_pos.is_exist) return base::kNotFound;
+
+  if (version != -1 && version != (int64_t)key_pos.bkt.version) {
+    return base::kCASFailed;
   }
 
-  ret = base::DecodeFixed64(std::string(tmp_buf64, sizeof(uint64_t)), &next_pos);
+  ret = UnlinkBucket(key_pos);
   if (ret != base::kOk) return ret;
 
-  bkt.Clear();
-  while (next_pos != 0) { /*{{{*/
-    pre_pos = cur_pos;
-    pre_bkt = bkt;
-
-    cur_pos = next_pos;
+  info_.used_cnt--;
+  info_.trx_id++;
 
-    memset(&bkt, 0, sizeof(Bucket));
-    memset(tmp_buf_bkt, 0, sizeof(Bucket));
+  // Update info
+  ret = WriteInfo();
+  if (ret != base::kOk) return ret;
 
-    fseek(index_fp_, next_pos, SEEK_SET);
-    r = fread(tmp_buf_bkt, sizeof(char), sizeof(Bucket), index_fp_);
-    if (r != sizeof(Bucket)) {
-      base::LOG_ERR("Failed to bucket_pos:%llu in index file, ret:%d, errno:%d", (unsigned long long)next_pos, r,
-                    errno);
-      return base::kReadError;
-    }
+  return SyncAfterWrite(seq);
+} /*}}}*/
 
-    ret = DecodeBucket(std::string(tmp_buf_bkt, sizeof(tmp_buf_bkt)), &bkt);
-    if (ret != base::kOk) return ret;
+base::Code HashDB::Write(const WriteBatch &batch) { /*{{{*/
+  if (batch.Count() == 0) return base::kOk;
 
-    if (crc_key == bkt.key_hash && key.size() == bkt.key_size &&
-        memcmp(key.data(), bkt.pre_key, sizeof(bkt.pre_key) < key.size() ? sizeof(bkt.pre_key) : key.size()) ==
-            0) { /*{{{*/
-      uint32_t data_len = 4 * sizeof(uint32_t) + bkt.key_size + bkt.value_size + sizeof(uint64_t);
-      fseek(data_fp_, bkt.data_pos, SEEK_SET);
-      r = fread(buf_, sizeof(char), data_len, data_fp_);
-      if (r != data_len) {
-        base::LOG_ERR("Failed to read data_pos:%llu in data file, ret:%d, errno:%d", (unsigned long long)bkt.data_pos,
-                      r, errno);
-        return base::kReadError;
-      }
+  uint64_t seq = 0;
+  base::Code ret = WriteBatchValues(batch, &seq);
+  if (ret != base::kOk || seq == 0) return ret;
 
-      data_value.Clear();
-      ret = DecodeDataValue(std::string(buf_, data_len), &data_value);
-      if (ret != base::kOk) return ret;
+  return WaitSynced(seq);
+} /*}}}*/
 
-      uint32_t tmp_value_crc = base::CRC32(data_value.value.data(), data_value.value_size);
-      if (data_value.crc != tmp_value_crc) {
-        base::LOG_ERR("Failed to check data value crc");
-        return base::kDataValueError;
-      }
+/**
+ * NOTE: batch is checked against index and the former operations of itself first, so nothing is written if one
+ * fails; then data of all puts is appended by one write, and buckets are updated one by one under the write lock
+ */
+base::Code HashDB::WriteBatchValues(const WriteBatch &batch, uint64_t *seq) { /*{{{*/
+  const std::vector<WriteBatch::Op> &ops = batch.GetOps();
+  uint32_t puts_num = 0;
+  std::vector<WriteBatch::Op>::const_iterator ops_it = ops.begin();
+  for (; ops_it != ops.end(); ++ops_it) {
+    if (ops_it->type != kBatchPut) continue;
+    if (ops_it->value.size() >= kMaxDataSize) return base::kValueSizeIsLarger;
+    ++puts_num;
+  }
 
-      assert(bkt.key_size == data_value.key_size);
-      if (memcmp(key.data(), data_value.key.data(), key.size()) == 0) {
-        is_exist = true;
-        break;
-      }
-    } /*}}}*/
+  base::WriteLock wl(&mu_);
+  base::Code ret = RehashIfFull(puts_num);
+  if (ret != base::kOk) return ret;
 
-    next_pos = bkt.next_pos;
-  } /*}}}*/
+  // NOTE: version of key after the former operations of batch, and 0 means key doesn't exist
+  std::map<std::string, uint64_t> batch_versions;
+  std::vector<uint64_t> new_versions(ops.size(), 0);
+  for (size_t i = 0; i < ops.size(); ++i) {
+    const WriteBatch::Op &op = ops[i];
+    uint64_t cur_version = 0;
+    std::map<std::string, uint64_t>::iterator versions_it = batch_versions.find(op.key);
+    if (versions_it != batch_versions.end()) {
+      cur_version = versions_it->second;
+    } else {
+      KeyPos key_pos;
+      ret = FindKey(op.key, &key_pos);
+      if (ret != base::kOk) return ret;
+      if (key_pos.is_exist) cur_version = key_pos.bkt.version;
+    }
 
-  if (!is_exist) return base::kNotFound;
+    if (op.type == kBatchDel && cur_version == 0) return base::kNotFound;
+    if (op.version != -1 && op.version != (int64_t)cur_version) return base::kCASFailed;
 
-  if (is_exist && version != -1 && version != (int64_t)bkt.version) {
-    return base::kCASFailed;
+    new_versions[i] = (op.type == kBatchDel) ? 0 : cur_version + 1;
+    batch_versions[op.key] = new_versions[i];
   }
 
-  next_pos = bkt.next_pos;
+  uint64_t data_file_size = 0;
+  ret = base::GetFileSize(data_path_, &data_file_size);
+  if (ret != base::kOk) return ret;
 
-  if (pre_pos == 0) {
-    // Update prefix bucket info
-    std::string tmp_hash_file_size;
-    ret = base::EncodeFixed64(next_pos, &tmp_hash_file_size);
+  std::string batch_data;
+  std::vector<uint64_t> data_poses(ops.size(), 0);
+  for (size_t i = 0; i < ops.size(); ++i) {
+    if (ops[i].type != kBatchPut) continue;
+
+    std::string tmp_data_value;
+    ret = EncodeNewData(ops[i].key, ops[i].value, new_versions[i], &tmp_data_value);
     if (ret != base::kOk) return ret;
+    data_poses[i] = data_file_size + batch_data.size();
+    batch_data.append(tmp_data_value);
+  }
 
-    fseek(index_fp_, hash_pos, SEEK_SET);
-    r = fwrite(tmp_hash_file_size.data(), sizeof(char), tmp_hash_file_size.size(), index_fp_);
-    if (r != tmp_hash_file_size.size()) return base::kWriteError;
-  } else {
-    pre_bkt.next_pos = next_pos;
+  if (!batch_data.empty()) {
+    ret = base::WriteAt(fileno(data_fp_), data_file_size, batch_data.data(), batch_data.size());
+    if (ret != base::kOk) return ret;
+  }
 
-    // Update prefix bucket info
-    std::string tmp_bkt_value;
-    ret = EncodeBucket(pre_bkt, &tmp_bkt_value);
+  for (size_t i = 0; i < ops.size(); ++i) {
+    KeyPos key_pos;
+    ret = FindKey(ops[i].key, &key_pos);
     if (ret != base::kOk) return ret;
 
-    fseek(index_fp_, pre_pos, SEEK_SET);
-    r = fwrite(tmp_bkt_value.data(), sizeof(char), tmp_bkt_value.size(), index_fp_);
-    if (r != tmp_bkt_value.size()) return base::kWriteError;
+    if (ops[i].type == kBatchPut) {
+      ret = SetBucket(ops[i].key, key_pos, ops[i].value.size(), new_versions[i], data_poses[i]);
+      if (ret != base::kOk) return ret;
+      if (!key_pos.is_exist) info_.used_cnt++;
+    } else {
+      ret = UnlinkBucket(key_pos);
+      if (ret != base::kOk) return ret;
+      info_.used_cnt--;
+    }
+    info_.trx_id++;
   }
 
-  index_->info.used_cnt--;
-  index_->info.trx_id++;
-  std::string tmp_info;
-  ret = EncodeInfo(index_->info, &tmp_info);
+  // Update info
+  ret = WriteInfo();
   if (ret != base::kOk) return ret;
 
-  // Update info
-  fseek(index_fp_, 0, SEEK_SET);
-  r = fwrite(tmp_info.data(), sizeof(char), tmp_info.size(), index_fp_);
-  if (r != tmp_info.size()) return base::kWriteError;
+  return SyncAfterWrite(seq);
+} /*}}}*/
+
+base::Code HashDB::MultiGet(const std::vector<std::string> &keys, std::vector<std::string> *values,
+                            std::vector<base::Code> *rets, std::vector<int64_t> *versions /*=NULL*/) { /*{{{*/
+  if (values == NULL || rets == NULL) return base::kInvalidParam;
+
+  values->assign(keys.size(), "");
+  rets->assign(keys.size(), base::kNotFound);
+  if (versions != NULL) versions->assign(keys.size(), 0);
+
+  // NOTE: buckets matching hash and prefix of key are collected first, and full key is checked after data read
+  base::ReadLock rl(&mu_);
+  std::vector<ReadItem> items;
+  items.reserve(keys.size());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    const std::string &key = keys[i];
+    uint32_t crc_key = base::CRC32(key.data(), key.size());
+    uint64_t hash_pos = (crc_key % info_.max_num) * sizeof(uint64_t) + sizeof(Info);
+    uint64_t next_pos = 0;
+    base::Code ret = ReadIndexPos(hash_pos, &next_pos);
+    while (ret == base::kOk && next_pos != 0) {
+      Bucket bkt;
+      ret = ReadBucket(next_pos, &bkt);
+      if (ret != base::kOk) break;
+
+      if (crc_key == bkt.key_hash && key.size() == bkt.key_size &&
+          memcmp(key.data(), bkt.pre_key, sizeof(bkt.pre_key) < key.size() ? sizeof(bkt.pre_key) : key.size()) ==
+              0) {
+        ReadItem item;
+        item.data_pos = bkt.data_pos;
+        item.data_len = 4 * sizeof(uint32_t) + bkt.key_size + bkt.value_size + sizeof(uint64_t);
+        item.index = i;
+        items.push_back(item);
+      }
+      next_pos = bkt.next_pos;
+    }
+    if (ret != base::kOk) (*rets)[i] = base::kReadError;
+  }
+  std::sort(items.begin(), items.end());
+
+  std::string buf;
+  size_t start = 0;
+  while (start < items.size()) {
+    uint64_t read_pos = items[start].data_pos;
+    uint64_t read_end = read_pos + items[start].data_len;
+    size_t end = start + 1;
+    for (; end < items.size(); ++end) {
+      const ReadItem &item = items[end];
+      if (item.data_pos > read_end + kMultiGetMaxGapBytes) break;
+      uint64_t item_end = item.data_pos + item.data_len;
+      if (item_end > read_end) {
+        if (item_end - read_pos > kMultiGetMaxReadBytes) break;
+        read_end = item_end;
+      }
+    }
 
-  fflush(data_fp_);
-  fflush(index_fp_);
+    buf.resize(read_end - read_pos);
+    base::Code ret = base::ReadAt(fileno(data_fp_), read_pos, buf.size(), &buf[0]);
+    for (; start < end; ++start) {
+      const ReadItem &item = items[start];
+      base::Code *cur_ret = &((*rets)[item.index]);
+      if (*cur_ret == base::kOk) continue;
+      if (ret != base::kOk) {
+        *cur_ret = base::kReadError;
+        continue;
+      }
 
-  int data_fd = fileno(data_fp_);
-  fsync(data_fd);
-  int index_fd = fileno(index_fp_);
-  fsync(index_fd);
+      DataValue data_value;
+      base::Code decode_ret = DecodeDataValue(buf.substr(item.data_pos - read_pos, item.data_len), &data_value);
+      if (decode_ret == base::kOk && data_value.crc != base::CRC32(data_value.value.data(), data_value.value_size)) {
+        decode_ret = base::kDataValueError;
+      }
+      if (decode_ret != base::kOk) {
+        *cur_ret = decode_ret;
+        continue;
+      }
+
+      const std::string &key = keys[item.index];
+      if (data_value.key_size != key.size() || memcmp(key.data(), data_value.key.data(), key.size()) != 0) continue;
+      (*values)[item.index].swap(data_value.value);
+      if (versions != NULL) (*versions)[item.index] = (int64_t)data_value.version;
+      *cur_ret = base::kOk;
+    }
+  }
 
   return base::kOk;
 } /*}}}*/
 
 base::Code HashDB::Init(const std::string &dir_path) { /*{{{*/
   if (dir_path.empty()) return base::kInvalidParam;
+  if (option_.init_dir_num == 0 || option_.init_dir_num > kMaxDirNum) return base::kInvalidParam;
 
   dir_path_ = dir_path;
   base::Code ret = base::CreateDir(dir_path);
@@ -450,8 +386,7 @@ base::Code HashDB::Init(const std::string &dir_path) { /*{{{*/
   std::string op_type;
   bool is_first = false;
 
-  index_ = new Index();
-  memset(index_, 0, sizeof(Index));
+  memset(&info_, 0, sizeof(info_));
 
   bool is_exist = false;
   ret = base::CheckFileExist(index_path_, &is_exist);
@@ -464,6 +399,9 @@ base::Code HashDB::Init(const std::string &dir_path) { /*{{{*/
     op_type = "w+";
   }
 
+  // NOTE: rehash was interrupted before rename, so the tmp index is dropped
+  unlink((index_path_ + kTmpFileSuffix).c_str());
+
   // Open index file
   index_fp_ = fopen(index_path_.c_str(), op_type.c_str());
   if (index_fp_ == NULL) {
@@ -480,7 +418,7 @@ base::Code HashDB::Init(const std::string &dir_path) { /*{{{*/
 
   // Open data file
   ret = base::CheckFileExist(data_path_, &is_exist);
-  if (ret != base::kOk) return ret;
+  if (ret != base::kOk) goto data_err;
   if (is_exist) {
     op_type = "r+";
   } else {
@@ -494,57 +432,63 @@ base::Code HashDB::Init(const std::string &dir_path) { /*{{{*/
     goto data_err;
   }
 
+  if (option_.sync_policy == kSyncInterval && option_.sync_interval_ms > 0 && !is_sync_thread_running_) {
+    is_stop_ = false;
+    int r = pthread_create(&sync_tid_, NULL, SyncThreadAction, this);
+    if (r != 0) {
+      ret = base::kPthreadCreateFailed;
+      goto data_err;
+    }
+    is_sync_thread_running_ = true;
+  }
+
   return base::kOk;
 
 data_err:
   Destroy();
 index_err:
+  // NOTE: index is not inited, so it's closed without the sync and truncate of Destroy, then Init can be retried
+  UnmapIndex();
+  if (index_fp_ != NULL) {
+    fclose(index_fp_);
+    index_fp_ = NULL;
+  }
   return ret;
 } /*}}}*/
 
 base::Code HashDB::GetStatus(DBStatusInfo *status_info) { /*{{{*/
   if (status_info == NULL) return base::kInvalidParam;
 
-  status_info->max_num = index_->info.max_num;
-  status_info->used_cnt = index_->info.used_cnt;
-  status_info->trx_id = index_->info.trx_id;
+  base::ReadLock rl(&mu_);
+  status_info->max_num = info_.max_num;
+  status_info->used_cnt = info_.used_cnt;
+  status_info->trx_id = info_.trx_id;
 
   Bucket bkt;
   uint64_t next_pos = 0;
   base::Code ret = base::kOk;
-  char tmp_buf64[sizeof(uint64_t)] = {0};
-  char tmp_buf_bkt[sizeof(Bucket)] = {0};
 
-  for (uint32_t i = 0; i < sizeof(index_->hash_dir) / sizeof(index_->hash_dir[0]); ++i) { /*{{{*/
+  for (uint32_t i = 0; i < info_.max_num; ++i) { /*{{{*/
     uint64_t hash_pos = i * sizeof(uint64_t) + sizeof(Info);
 
-    fseek(index_fp_, hash_pos, SEEK_SET);
-    size_t r = fread(tmp_buf64, sizeof(char), sizeof(uint64_t), index_fp_);
-    if (r != sizeof(uint64_t)) {
-      base::LOG_ERR("Failed to hash_pos:%llu in index file, ret:%d, errno:%d", (unsigned long long)hash_pos, r, errno);
+    ret = ReadIndexPos(hash_pos, &next_pos);
+    if (ret != base::kOk) {
+      base::LOG_ERR("Failed to hash_pos:%llu in index file, ret:%d, errno:%d", (unsigned long long)hash_pos, ret,
+                    errno);
       return base::kReadError;
     }
 
-    ret = base::DecodeFixed64(std::string(tmp_buf64, sizeof(uint64_t)), &next_pos);
-    if (ret != base::kOk) return ret;
-
     uint32_t same_hash_num = 0;
     while (next_pos != 0) { /*{{{*/
       ++same_hash_num;
-      bkt.Clear();
-      memset(tmp_buf_bkt, 0, sizeof(Bucket));
-
-      fseek(index_fp_, next_pos, SEEK_SET);
-      r = fread(tmp_buf_bkt, sizeof(char), sizeof(Bucket), index_fp_);
-      if (r != sizeof(Bucket)) {
-        base::LOG_ERR("Failed to read bucket_pos:%llu in index file, ret:%d, errno:%d", (unsigned long long)next_pos, r,
-                      errno);
+
+      ret = ReadBucket(next_pos, &bkt);
+      if (ret != base::kOk) {
+        base::LOG_ERR("Failed to read bucket_pos:%llu in index file, ret:%d, errno:%d", (unsigned long long)next_pos,
+                      ret, errno);
         return base::kReadError;
       }
 
-      ret = DecodeBucket(std::string(tmp_buf_bkt, sizeof(tmp_buf_bkt)), &bkt);
-      if (ret != base::kOk) return ret;
-
       next_pos = bkt.next_pos;
     } /*}}}*/
 
@@ -561,6 +505,23 @@ base::Code HashDB::GetStatus(DBStatusInfo *status_info) { /*{{{*/
 } /*}}}*/
 
 base::Code HashDB::Destroy() { /*{{{*/
+  StopSync();
+
+  // NOTE: writes of kSyncInterval and kSyncOnClose are synced at last
+  if (index_fp_ != NULL && data_fp_ != NULL && is_dirty_) {
+    base::Code ret = Sync();
+    if (ret != base::kOk) base::LOG_ERR("Failed to sync hash db, dir:%s, ret:%d", dir_path_.c_str(), ret);
+  }
+
+  if (index_map_ != NULL) {
+    UnmapIndex();
+
+    // NOTE: zero tail of mapping is cut, so index file is the same as the one written by pwrite
+    if (ftruncate(fileno(index_fp_), index_end_) != 0) {
+      base::LOG_ERR("Failed to truncate index file:%s, errno:%d", index_path_.c_str(), errno);
+    }
+  }
+
   if (index_fp_ != NULL) {
     fclose(index_fp_);
     index_fp_ = NULL;
@@ -571,11 +532,6 @@ base::Code HashDB::Destroy() { /*{{{*/
     data_fp_ = NULL;
   }
 
-  if (index_ != NULL) {
-    delete index_;
-    index_ = NULL;
-  }
-
   return base::kOk;
 } /*}}}*/
 
@@ -583,12 +539,12 @@ base::Code HashDB::InitIndex(bool is_first) { /*{{{*/
   base::Code ret = base::kOtherFailed;
 
   if (is_first) { /*{{{*/
-    index_->info.max_num = kMaxKeysNum;
-    index_->info.used_cnt = 0;
-    index_->info.trx_id = 0;
+    info_.max_num = option_.init_dir_num;
+    info_.used_cnt = 0;
+    info_.trx_id = 0;
 
     std::string info_tmp_str;
-    base::Code ret = EncodeInfo(index_->info, &info_tmp_str);
+    ret = EncodeInfo(info_, &info_tmp_str);
     if (ret != base::kOk) return ret;
 
     size_t r = fwrite(info_tmp_str.data(), sizeof(char), info_tmp_str.size(), index_fp_);
@@ -596,16 +552,14 @@ base::Code HashDB::InitIndex(bool is_first) { /*{{{*/
       base::LOG_ERR("Failed to write info to index file!");
       return base::kWriteError;
     }
+    fflush(index_fp_);
 
-    r = fwrite(index_->hash_dir, sizeof(uint64_t), kMaxKeysNum, index_fp_);
-    if (r != kMaxKeysNum) {
+    // NOTE: hash_dir is all zero, so it's set by extending file
+    index_end_ = sizeof(Info) + (uint64_t)info_.max_num * sizeof(uint64_t);
+    if (ftruncate(fileno(index_fp_), index_end_) != 0) {
       base::LOG_ERR("Failed to write hash_dir to index file!");
       return base::kWriteError;
     }
-
-    fflush(index_fp_);
-
-    return base::kOk;
   } /*}}}*/
   else { /*{{{*/
     char buf[sizeof(Info)] = {0};
@@ -614,15 +568,23 @@ base::Code HashDB::InitIndex(bool is_first) { /*{{{*/
       base::LOG_ERR("Failed to read info from index file!");
       return base::kReadError;
     }
-    base::Code ret = DecodeInfo(std::string(buf, sizeof(buf)), &(index_->info));
+    ret = DecodeInfo(std::string(buf, sizeof(buf)), &info_);
     if (ret != base::kOk) return ret;
 
-    assert(index_->info.max_num > 0);
+    if (info_.max_num == 0) return base::kDataIsNotConsistent;
 
-    return base::kOk;
+    ret = base::GetFileSize(fileno(index_fp_), &index_end_);
+    if (ret != base::kOk) return ret;
+    if (index_end_ < sizeof(Info) + (uint64_t)info_.max_num * sizeof(uint64_t)) return base::kDataIsNotConsistent;
   } /*}}}*/
 
-  return ret;
+  if (!option_.use_mmap_index) return base::kOk;
+
+  ret = MapIndex(index_end_);
+  if (ret != base::kOk) return ret;
+
+  // NOTE: index file may keep zero tail of mapping if it's not closed normally, so end is got from buckets
+  return GetIndexEnd(&index_end_);
 } /*}}}*/
 
 base::Code HashDB::EncodeInfo(const Info &info, std::string *str) { /*{{{*/
@@ -836,4 +798,473 @@ base::Code HashDB::DecodeDataValue(const std::string &str, DataValue *data_value
   return ret;
 } /*}}}*/
 
+base::Code HashDB::FindKey(const std::string &key, KeyPos *key_pos) { /*{{{*/
+  key_pos->key_hash = base::CRC32(key.data(), key.size());
+  key_pos->hash_pos = (key_pos->key_hash % info_.max_num) * sizeof(uint64_t) + sizeof(Info);
+  key_pos->pre_pos = 0;
+  key_pos->pre_bkt.Clear();
+  key_pos->cur_pos = 0;
+  key_pos->bkt.Clear();
+  key_pos->is_exist = false;
+
+  uint64_t next_pos = 0;  // bucket position in bucket
+  base::Code ret = ReadIndexPos(key_pos->hash_pos, &next_pos);
+  if (ret != base::kOk) {
+    base::LOG_ERR("Failed to hash_pos:%llu in index file, ret:%d, errno:%d", (unsigned long long)key_pos->hash_pos,
+                  ret, errno);
+    return base::kReadError;
+  }
+
+  while (next_pos != 0) { /*{{{*/
+    if (key_pos->cur_pos != 0) {
+      key_pos->pre_pos = key_pos->cur_pos;
+      key_pos->pre_bkt = key_pos->bkt;
+    }
+    key_pos->cur_pos = next_pos;
+
+    Bucket &bkt = key_pos->bkt;
+    ret = ReadBucket(next_pos, &bkt);
+    if (ret != base::kOk) {
+      base::LOG_ERR("Failed to bucket_pos:%llu in index file, ret:%d, errno:%d", (unsigned long long)next_pos, ret,
+                    errno);
+      return base::kReadError;
+    }
+
+    if (key_pos->key_hash == bkt.key_hash && key.size() == bkt.key_size &&
+        memcmp(key.data(), bkt.pre_key, sizeof(bkt.pre_key) < key.size() ? sizeof(bkt.pre_key) : key.size()) ==
+            0) { /*{{{*/
+      DataValue data_value;
+      ret = ReadDataValue(bkt, &data_value);
+      if (ret != base::kOk) return ret;
+
+      assert(bkt.key_size == data_value.key_size);
+      if (memcmp(key.data(), data_value.key.data(), key.size()) == 0) {
+        key_pos->is_exist = true;
+        return base::kOk;
+      }
+    } /*}}}*/
+
+    next_pos = bkt.next_pos;
+  } /*}}}*/
+
+  return base::kOk;
+} /*}}}*/
+
+base::Code HashDB::ReadDataValue(const Bucket &bkt, DataValue *data_value) { /*{{{*/
+  uint32_t data_len = 4 * sizeof(uint32_t) + bkt.key_size + bkt.value_size + sizeof(uint64_t);
+  std::string data_buf(data_len, '\0');
+  base::Code ret = base::ReadAt(fileno(data_fp_), bkt.data_pos, data_len, &data_buf[0]);
+  if (ret != base::kOk) {
+    base::LOG_ERR("Failed to read data_pos:%llu in data file, ret:%d, errno:%d", (unsigned long long)bkt.data_pos,
+                  ret, errno);
+    return base::kReadError;
+  }
+
+  data_value->Clear();
+  ret = DecodeDataValue(data_buf, data_value);
+  if (ret != base::kOk) return ret;
+
+  uint32_t tmp_value_crc = base::CRC32(data_value->value.data(), data_value->value_size);
+  if (data_value->crc != tmp_value_crc) {
+    base::LOG_ERR("Failed to check data value crc");
+    return base::kDataValueError;
+  }
+
+  return base::kOk;
+} /*}}}*/
+
+base::Code HashDB::EncodeNewData(const std::string &key, const std::string &value, uint64_t version,
+                                 std::string *str) { /*{{{*/
+  DataValue data_value;
+  data_value.Clear();
+  data_value.key = key;
+  data_value.value = value;
+  data_value.key_size = key.size();
+  data_value.value_size = value.size();
+  data_value.total_size = sizeof(uint32_t) * 2 + data_value.key_size + data_value.value_size;
+  data_value.version = version;
+  data_value.crc = base::CRC32(data_value.value.data(), data_value.value_size);
+
+  return EncodeDataValue(data_value, str);
+} /*}}}*/
+
+base::Code HashDB::SetBucket(const std::string &key, const KeyPos &key_pos, uint32_t value_size, uint64_t version,
+                             uint64_t data_pos) { /*{{{*/
+  if (key_pos.is_exist) {
+    // update bucket info
+    Bucket bkt = key_pos.bkt;
+    bkt.version = version;
+    bkt.value_size = value_size;
+    bkt.data_pos = data_pos;
+    return WriteBucket(key_pos.cur_pos, bkt);
+  }
+
+  uint64_t new_pos = index_end_;
+
+  Bucket new_bkt;
+  new_bkt.Clear();
+  new_bkt.version = version;
+  new_bkt.next_pos = 0;
+  new_bkt.key_hash = key_pos.key_hash;
+  memcpy(new_bkt.pre_key, key.data(), sizeof(new_bkt.pre_key) < key.size() ? sizeof(new_bkt.pre_key) : key.size());
+  new_bkt.key_size = key.size();
+  new_bkt.value_size = value_size;
+  new_bkt.data_pos = data_pos;
+
+  // Set new bucket info
+  base::Code ret = WriteBucket(new_pos, new_bkt);
+  if (ret != base::kOk) return ret;
+  index_end_ = new_pos + sizeof(Bucket);
+
+  // Update prefix bucket info
+  if (key_pos.cur_pos == 0) return WriteIndexPos(key_pos.hash_pos, new_pos);
+
+  Bucket bkt = key_pos.bkt;
+  bkt.next_pos = new_pos;
+  return WriteBucket(key_pos.cur_pos, bkt);
+} /*}}}*/
+
+base::Code HashDB::UnlinkBucket(const KeyPos &key_pos) { /*{{{*/
+  // Update prefix bucket info
+  if (key_pos.pre_pos == 0) return WriteIndexPos(key_pos.hash_pos, key_pos.bkt.next_pos);
+
+  Bucket pre_bkt = key_pos.pre_bkt;
+  pre_bkt.next_pos = key_pos.bkt.next_pos;
+  return WriteBucket(key_pos.pre_pos, pre_bkt);
+} /*}}}*/
+
+/**
+ * NOTE: hash position depends on dir num, so dir is doubled before looking up keys, until new keys are less
+ */
+base::Code HashDB::RehashIfFull(uint32_t new_keys_num) { /*{{{*/
+  uint32_t dir_num = info_.max_num;
+  while ((uint64_t)info_.used_cnt + new_keys_num > dir_num && dir_num < kMaxDirNum) {
+    dir_num *= 2;
+  }
+  if (dir_num == info_.max_num) return base::kOk;
+
+  base::Code ret = Rehash(dir_num);
+  if (ret != base::kOk) {
+    base::LOG_ERR("Failed to rehash index to dir num:%u, ret:%d", (unsigned int)dir_num, ret);
+  }
+  return ret;
+} /*}}}*/
+
+base::Code HashDB::ReadIndexPos(uint64_t pos, uint64_t *value) { /*{{{*/
+  if (value == NULL) return base::kInvalidParam;
+
+  if (index_map_ == NULL) {
+    char buf[sizeof(uint64_t)] = {0};
+    base::Code ret = base::ReadAt(fileno(index_fp_), pos, sizeof(buf), buf);
+    if (ret != base::kOk) return ret;
+
+    return base::DecodeFixed64(std::string(buf, sizeof(buf)), value);
+  }
+
+  if (pos + sizeof(uint64_t) > index_map_size_) return base::kInvalidParam;
+#if (BYTE_ORDER == LITTLE_ENDIAN)
+  memcpy(value, index_map_ + pos, sizeof(uint64_t));
+  return base::kOk;
+#else
+  return base::DecodeFixed64(std::string(index_map_ + pos, sizeof(uint64_t)), value);
+#endif
+} /*}}}*/
+
+base::Code HashDB::WriteIndexPos(uint64_t pos, uint64_t value) { /*{{{*/
+  if (index_map_ == NULL || pos + sizeof(uint64_t) > index_map_size_) {
+    std::string tmp_str;
+    base::Code ret = base::EncodeFixed64(value, &tmp_str);
+    if (ret != base::kOk) return ret;
+
+    if (index_map_ != NULL) return base::kInvalidParam;
+    return base::WriteAt(fileno(index_fp_), pos, tmp_str.data(), tmp_str.size());
+  }
+
+#if (BYTE_ORDER == LITTLE_ENDIAN)
+  memcpy(index_map_ + pos, &value, sizeof(uint64_t));
+#else
+  std::string tmp_str;
+  base::EncodeFixed64(value, &tmp_str);
+  memcpy(index_map_ + pos, tmp_str.data(), tmp_str.size());
+#endif
+  return base::kOk;
+} /*}}}*/
+
+base::Code HashDB::ReadBucket(uint64_t pos, Bucket *bucket) { /*{{{*/
+  if (bucket == NULL) return base::kInvalidParam;
+
+  if (index_map_ == NULL) {
+    char buf[sizeof(Bucket)] = {0};
+    base::Code ret = base::ReadAt(fileno(index_fp_), pos, sizeof(buf), buf);
+    if (ret != base::kOk) return ret;
+
+    return DecodeBucket(std::string(buf, sizeof(buf)), bucket);
+  }
+
+  if (pos + sizeof(Bucket) > index_map_size_) return base::kInvalidParam;
+#if (BYTE_ORDER == LITTLE_ENDIAN)
+  memcpy(bucket, index_map_ + pos, sizeof(Bucket));
+  return base::kOk;
+#else
+  return DecodeBucket(std::string(index_map_ + pos, sizeof(Bucket)), bucket);
+#endif
+} /*}}}*/
+
+base::Code HashDB::WriteBucket(uint64_t pos, const Bucket &bucket) { /*{{{*/
+  if (index_map_ != NULL && pos + sizeof(Bucket) > index_map_size_) {
+    uint64_t grow_size = index_map_size_ / 2 > kIndexMapGrowSize ? index_map_size_ / 2 : kIndexMapGrowSize;
+    uint64_t map_size = index_map_size_ + grow_size;
+    if (map_size < pos + sizeof(Bucket)) map_size = pos + sizeof(Bucket);
+
+    // NOTE: buckets are only updated under write lock, and file_mu_ keeps Sync out, so no one uses old mapping
+    base::MutexLock fl(&file_mu_);
+    UnmapIndex();
+    base::Code ret = MapIndex(map_size);
+    if (ret != base::kOk) {
+      base::LOG_ERR("Failed to extend mapping of index file to %llu, ret:%d, use pwrite instead",
+                    (unsigned long long)map_size, ret);
+    }
+  }
+
+  if (index_map_ == NULL) {
+    std::string tmp_str;
+    base::Code ret = EncodeBucket(bucket, &tmp_str);
+    if (ret != base::kOk) return ret;
+
+    return base::WriteAt(fileno(index_fp_), pos, tmp_str.data(), tmp_str.size());
+  }
+
+#if (BYTE_ORDER == LITTLE_ENDIAN)
+  memcpy(index_map_ + pos, &bucket, sizeof(Bucket));
+#else
+  std::string tmp_str;
+  EncodeBucket(bucket, &tmp_str);
+  memcpy(index_map_ + pos, tmp_str.data(), tmp_str.size());
+#endif
+  return base::kOk;
+} /*}}}*/
+
+base::Code HashDB::WriteInfo() { /*{{{*/
+  std::string tmp_info;
+  base::Code ret = EncodeInfo(info_, &tmp_info);
+  if (ret != base::kOk) return ret;
+
+  if (index_map_ == NULL) return base::WriteAt(fileno(index_fp_), 0, tmp_info.data(), tmp_info.size());
+
+  memcpy(index_map_, tmp_info.data(), tmp_info.size());
+  return base::kOk;
+} /*}}}*/
+
+base::Code HashDB::MapIndex(uint64_t map_size) { /*{{{*/
+  int fd = fileno(index_fp_);
+  uint64_t file_size = 0;
+  base::Code ret = base::GetFileSize(fd, &file_size);
+  if (ret != base::kOk) return ret;
+
+  // NOTE: store beyond end of file is SIGBUS, so file is extended to size of mapping first
+  if (file_size < map_size && ftruncate(fd, map_size) != 0) {
+    base::LOG_ERR("Failed to extend index file:%s to %llu, errno:%d", index_path_.c_str(),
+                  (unsigned long long)map_size, errno);
+    return base::kWriteError;
+  }
+
+  void *addr = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (addr == MAP_FAILED) {
+    base::LOG_ERR("Failed to mmap index file:%s, size:%llu, errno:%d", index_path_.c_str(),
+                  (unsigned long long)map_size, errno);
+    return base::kIOError;
+  }
+
+  index_map_ = static_cast<char *>(addr);
+  index_map_size_ = map_size;
+  return base::kOk;
+} /*}}}*/
+
+void HashDB::UnmapIndex() { /*{{{*/
+  if (index_map_ == NULL) return;
+
+  munmap(index_map_, index_map_size_);
+  index_map_ = NULL;
+  index_map_size_ = 0;
+} /*}}}*/
+
+base::Code HashDB::GetIndexEnd(uint64_t *index_end) { /*{{{*/
+  if (index_end == NULL) return base::kInvalidParam;
+
+  uint64_t dir_end = sizeof(Info) + (uint64_t)info_.max_num * sizeof(uint64_t);
+  uint64_t max_buckets_num = (index_map_size_ - dir_end) / sizeof(Bucket);
+  uint64_t buckets_num = 0;
+  *index_end = dir_end;
+
+  Bucket bkt;
+  for (uint32_t i = 0; i < info_.max_num; ++i) { /*{{{*/
+    uint64_t next_pos = 0;
+    base::Code ret = ReadIndexPos(i * sizeof(uint64_t) + sizeof(Info), &next_pos);
+    if (ret != base::kOk) return ret;
+
+    while (next_pos != 0) {
+      // NOTE: chain of broken index may be a loop
+      if (next_pos < dir_end || ++buckets_num > max_buckets_num) return base::kDataIsNotConsistent;
+
+      ret = ReadBucket(next_pos, &bkt);
+      if (ret != base::kOk) return ret;
+      if (next_pos + sizeof(Bucket) > *index_end) *index_end = next_pos + sizeof(Bucket);
+
+      next_pos = bkt.next_pos;
+    }
+  } /*}}}*/
+
+  return base::kOk;
+} /*}}}*/
+
+/**
+ * NOTE: new index is written into tmp file and renamed, so the old one is still complete if it's interrupted
+ * 1. buckets are read along chains, so buckets of deleted keys are dropped at the same time
+ * 2. data file is synced first, since the new index is synced and refers to all data
+ */
+base::Code HashDB::Rehash(uint32_t dir_num) { /*{{{*/
+  uint64_t dir_end = sizeof(Info) + (uint64_t)dir_num * sizeof(uint64_t);
+  std::string new_index(dir_end, '\0');
+  new_index.reserve(dir_end + (uint64_t)info_.used_cnt * sizeof(Bucket));
+
+  Bucket bkt;
+  std::string tmp_str;
+  base::Code ret = base::kOk;
+  for (uint32_t i = 0; i < info_.max_num; ++i) { /*{{{*/
+    uint64_t next_pos = 0;
+    ret = ReadIndexPos(i * sizeof(uint64_t) + sizeof(Info), &next_pos);
+    if (ret != base::kOk) return ret;
+
+    while (next_pos != 0) {
+      ret = ReadBucket(next_pos, &bkt);
+      if (ret != base::kOk) return ret;
+      next_pos = bkt.next_pos;
+
+      // NOTE: bucket is put at head of the new chain
+      uint64_t hash_pos = (bkt.key_hash % dir_num) * sizeof(uint64_t) + sizeof(Info);
+      ret = base::DecodeFixed64(std::string(new_index, hash_pos, sizeof(uint64_t)), &bkt.next_pos);
+      if (ret != base::kOk) return ret;
+
+      tmp_str.clear();
+      ret = base::EncodeFixed64(new_index.size(), &tmp_str);
+      if (ret != base::kOk) return ret;
+      new_index.replace(hash_pos, tmp_str.size(), tmp_str);
+
+      ret = EncodeBucket(bkt, &tmp_str);
+      if (ret != base::kOk) return ret;
+      new_index.append(tmp_str);
+    }
+  } /*}}}*/
+
+  Info new_info = info_;
+  new_info.max_num = dir_num;
+  ret = EncodeInfo(new_info, &tmp_str);
+  if (ret != base::kOk) return ret;
+  new_index.replace(0, tmp_str.size(), tmp_str);
+
+  std::string tmp_path = index_path_ + kTmpFileSuffix;
+  FILE *tmp_fp = fopen(tmp_path.c_str(), "w+");
+  if (tmp_fp == NULL) {
+    base::LOG_ERR("Failed to open tmp index file:%s, errno:%d", tmp_path.c_str(), errno);
+    return base::kOpenFileFailed;
+  }
+
+  ret = base::WriteAt(fileno(tmp_fp), 0, new_index.data(), new_index.size());
+  if (ret == base::kOk && (fsync(fileno(tmp_fp)) != 0 || fsync(fileno(data_fp_)) != 0)) ret = base::kWriteError;
+  if (ret == base::kOk && rename(tmp_path.c_str(), index_path_.c_str()) != 0) ret = base::kRenameFailed;
+  if (ret != base::kOk) {
+    base::LOG_ERR("Failed to write tmp index file:%s, ret:%d, errno:%d", tmp_path.c_str(), ret, errno);
+    fclose(tmp_fp);
+    unlink(tmp_path.c_str());
+    return ret;
+  }
+
+  // NOTE: handle of tmp file is the new index after rename
+  base::MutexLock fl(&file_mu_);
+  UnmapIndex();
+  fclose(index_fp_);
+  index_fp_ = tmp_fp;
+  info_ = new_info;
+  index_end_ = new_index.size();
+  __atomic_store_n(&is_dirty_, false, __ATOMIC_SEQ_CST);
+
+  if (!option_.use_mmap_index) return base::kOk;
+  ret = MapIndex(index_end_);
+  if (ret != base::kOk) base::LOG_ERR("Failed to mmap new index, ret:%d, use pread and pwrite instead", ret);
+
+  return base::kOk;
+} /*}}}*/
+
+/**
+ * NOTE: Sync only holds file_mu_, so Put and Get go on while syncing, except the one changing index handle
+ * 1. dirty flag is cleared first, so writes done while syncing are synced by the next round
+ * 2. data file is synced before index, so synced index never refers to lost data
+ */
+base::Code HashDB::Sync() { /*{{{*/
+  __atomic_store_n(&is_dirty_, false, __ATOMIC_SEQ_CST);
+
+  base::MutexLock fl(&file_mu_);
+  base::Code ret = base::kOk;
+  if (fdatasync(fileno(data_fp_)) != 0) {
+    base::LOG_ERR("Failed to sync data file:%s, errno:%d", data_path_.c_str(), errno);
+    ret = base::kWriteError;
+  } else if (index_map_ != NULL && msync(index_map_, index_map_size_, MS_SYNC) != 0) {
+    base::LOG_ERR("Failed to msync index file:%s, errno:%d", index_path_.c_str(), errno);
+    ret = base::kWriteError;
+  } else if (fdatasync(fileno(index_fp_)) != 0) {
+    base::LOG_ERR("Failed to sync index file:%s, errno:%d", index_path_.c_str(), errno);
+    ret = base::kWriteError;
+  }
+
+  if (ret != base::kOk) __atomic_store_n(&is_dirty_, true, __ATOMIC_SEQ_CST);
+  return ret;
+} /*}}}*/
+
+base::Code HashDB::SyncAfterWrite(uint64_t *seq) { /*{{{*/
+  if (option_.sync_policy == kSyncEveryWrite) return Sync();
+
+  __atomic_store_n(&is_dirty_, true, __ATOMIC_SEQ_CST);
+  if (option_.sync_policy == kSyncGroupCommit) *seq = group_commit_.AddWrite();
+  return base::kOk;
+} /*}}}*/
+
+base::Code HashDB::WaitSynced(uint64_t seq) { /*{{{*/
+  return group_commit_.WaitSynced(seq, [this]() { return Sync(); });
+} /*}}}*/
+
+void *HashDB::SyncThreadAction(void *param) { /*{{{*/
+  HashDB *db = static_cast<HashDB *>(param);
+  db->SyncLoop();
+  return NULL;
+} /*}}}*/
+
+void HashDB::SyncLoop() { /*{{{*/
+  while (true) {
+    {
+      base::MutexLock ml(&stop_mu_);
+      if (!is_stop_) stop_cond_.TimeWait(stop_mu_, option_.sync_interval_ms);
+      if (is_stop_) break;
+    }
+
+    if (!__atomic_load_n(&is_dirty_, __ATOMIC_SEQ_CST)) continue;
+
+    base::Code ret = Sync();
+    if (ret != base::kOk) base::LOG_ERR("Failed to sync hash db, dir:%s, ret:%d", dir_path_.c_str(), ret);
+  }
+} /*}}}*/
+
+base::Code HashDB::StopSync() { /*{{{*/
+  if (!is_sync_thread_running_) return base::kOk;
+
+  {
+    base::MutexLock ml(&stop_mu_);
+    is_stop_ = true;
+    stop_cond_.Signal();
+  }
+  pthread_join(sync_tid_, NULL);
+  is_sync_thread_running_ = false;
+
+  return base::kOk;
+} /*}}}*/
+
 }  // namespace store
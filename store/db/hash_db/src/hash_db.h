@@ -6,10 +6,14 @@
 #define STORE_DB_HASH_DB_H_
 
 #include <string>
+#include <vector>
 
+#include <pthread.h>
 #include <stdint.h>
 #include <string.h>
 
+#include "base/group_commit.h"
+#include "base/mutex.h"
 #include "base/status.h"
 #include "store/db/include/db_base.h"
 
@@ -17,13 +21,37 @@ namespace store {
 
 const uint32_t kPreKeySize = 8;
 
-// Num of keys should be less than kMaxKeysNum, or the possibility of conflicting is larger
-const uint32_t kMaxKeysNum = 1024 * 1024;
+// Num of keys should be less than hash dir num, or the index is rehashed into a dir of double size
+const uint32_t kMaxKeysNum = 1024 * 1024;  // Default hash dir num of new index file
+const uint32_t kMaxDirNum = 1U << 31;
 const uint32_t kMaxDataSize = 8 * 1024 * 1024;
+const uint64_t kIndexMapGrowSize = 4 * 1024 * 1024;  // Mapping of index file is extended by this at least
+const uint64_t kMultiGetMaxGapBytes = 4 * 1024;      // Data of MultiGet are read by one pread if gap is less
+const uint64_t kMultiGetMaxReadBytes = 1024 * 1024;  // Max size of one pread of MultiGet
 
 const char kHashDBPrefix[] = "_hashdb";
 const char kIndexFileSuffix[] = ".idx";
 const char kDataFileSuffix[] = ".dat";
+const char kTmpFileSuffix[] = ".tmp";
+
+/**
+ * NOTE: options of HashDB, which should be set before Init
+ * 1. use_mmap_index maps index file, so buckets and hash dir are updated by store into the mapping
+ * 2. sync_policy decides when data and index are synced, and sync_interval_ms is only for kSyncInterval
+ * 3. init_dir_num is hash dir num of new index file, and the existing index keeps its own
+ */
+struct HashDBOption { /*{{{*/
+  bool use_mmap_index;
+  SyncPolicy sync_policy;
+  uint32_t sync_interval_ms;
+  uint32_t init_dir_num;
+
+  HashDBOption()
+      : use_mmap_index(false),
+        sync_policy(kSyncEveryWrite),
+        sync_interval_ms(kDefaultSyncIntervalMs),
+        init_dir_num(kMaxKeysNum) {}
+}; /*}}}*/
 
 class HashDB : public DBBase {
  public:
@@ -56,9 +84,26 @@ class HashDB : public DBBase {
    */
   virtual base::Code Del(const std::string &key, int64_t version = -1);
 
+  /**
+   * NOTE: "Write" operation will apply all operations of batch, or none of them if one fails
+   * 1. operations are checked before anything is written, data of puts is appended by one write, and synced once
+   * 2. buckets are updated in place, so a batch may be applied partly if system crashes while applying it
+   */
+  virtual base::Code Write(const WriteBatch &batch);
+
+  /**
+   * NOTE: "MultiGet" operation will get values of keys together
+   * 1. data are sorted by position, and near data are read by one pread
+   */
+  virtual base::Code MultiGet(const std::vector<std::string> &keys, std::vector<std::string> *values,
+                              std::vector<base::Code> *rets, std::vector<int64_t> *versions = NULL);
+
  public:
   virtual base::Code Init(const std::string &path);
 
+  // NOTE: should be called before Init
+  void SetOption(const HashDBOption &option) { option_ = option; }
+
  public:
 #pragma pack(push)
 #pragma pack(1)
@@ -92,12 +137,8 @@ class HashDB : public DBBase {
    * NOTE: index file format:
    *      | Info  |start_pos|...|start_pos|bucket|...|bucket|
    *      \ info / \      hash_dir       / \     buckets    /
+   *      num of start_pos in hash_dir is info.max_num, and buckets are appended
    */
-  struct Index { /*{{{*/
-    Info info;
-    uint64_t hash_dir[kMaxKeysNum];
-    Bucket buckets[kMaxKeysNum];
-  }; /*}}}*/
 
   /**
    * NOTE: <key, value> format in data file:
@@ -131,6 +172,38 @@ class HashDB : public DBBase {
   virtual base::Code GetStatus(DBStatusInfo *status_info);
 
  private:
+  /**
+   * NOTE: position of key in index
+   * 1. if key exists, bkt is its bucket at cur_pos, and pre_bkt is the former one at pre_pos, 0 for the first
+   * 2. if key doesn't exist, bkt is the last bucket of hash dir at cur_pos, 0 for empty hash dir
+   */
+  struct KeyPos { /*{{{*/
+    uint32_t key_hash;
+    uint64_t hash_pos;
+    uint64_t pre_pos;
+    Bucket pre_bkt;
+    uint64_t cur_pos;
+    Bucket bkt;
+    bool is_exist;
+  }; /*}}}*/
+
+  // NOTE: data to read by MultiGet, which is the bucket of keys[index] if key is the same
+  struct ReadItem { /*{{{*/
+    uint64_t data_pos;
+    uint32_t data_len;
+    size_t index;
+
+    bool operator<(const ReadItem &item) const { return data_pos < item.data_pos; }
+  }; /*}}}*/
+
+  base::Code FindKey(const std::string &key, KeyPos *key_pos);
+  base::Code ReadDataValue(const Bucket &bkt, DataValue *data_value);
+  base::Code EncodeNewData(const std::string &key, const std::string &value, uint64_t version, std::string *str);
+  base::Code SetBucket(const std::string &key, const KeyPos &key_pos, uint32_t value_size, uint64_t version,
+                       uint64_t data_pos);
+  base::Code UnlinkBucket(const KeyPos &key_pos);
+  base::Code RehashIfFull(uint32_t new_keys_num);
+
   base::Code Destroy();
   base::Code InitIndex(bool is_first);
   base::Code EncodeInfo(const Info &info, std::string *str);
@@ -140,6 +213,28 @@ class HashDB : public DBBase {
   base::Code EncodeDataValue(const DataValue &data_value, std::string *str);
   base::Code DecodeDataValue(const std::string &str, DataValue *data_value);
 
+  base::Code ReadIndexPos(uint64_t pos, uint64_t *value);
+  base::Code WriteIndexPos(uint64_t pos, uint64_t value);
+  base::Code ReadBucket(uint64_t pos, Bucket *bucket);
+  base::Code WriteBucket(uint64_t pos, const Bucket &bucket);
+  base::Code WriteInfo();
+
+  base::Code MapIndex(uint64_t map_size);
+  void UnmapIndex();
+  base::Code GetIndexEnd(uint64_t *index_end);
+  base::Code Rehash(uint32_t dir_num);
+
+  base::Code PutValue(const std::string &key, const std::string &value, int64_t version, uint64_t *seq);
+  base::Code DelValue(const std::string &key, int64_t version, uint64_t *seq);
+  base::Code WriteBatchValues(const WriteBatch &batch, uint64_t *seq);
+
+  base::Code Sync();
+  base::Code SyncAfterWrite(uint64_t *seq);  // NOTE: seq is set for kSyncGroupCommit, which should be waited
+  base::Code WaitSynced(uint64_t seq);
+  static void *SyncThreadAction(void *param);
+  void SyncLoop();
+  base::Code StopSync();
+
  private:
   // NOTE: index file path: dir_path_ + ".idx"
   //       data file path:  dir_path_ + ".dat"
@@ -148,9 +243,23 @@ class HashDB : public DBBase {
   std::string data_path_;
   FILE *index_fp_;
   FILE *data_fp_;
-  Index *index_;
-  char *buf_;
+  Info info_;
   std::string stat_path_;
+  base::RWMutex mu_;  // Gets share it, and Put or Del holds it alone
+
+  HashDBOption option_;
+  char *index_map_;  // Mapping of index file in mmap mode, which may be larger than index_end_
+  uint64_t index_map_size_;
+  uint64_t index_end_;  // Position of the next new bucket
+  bool is_dirty_;       // There are writes after the last sync
+  base::Mutex file_mu_;  // Sync holds it, and index handle or mapping is only changed under it
+  base::GroupCommit group_commit_;
+
+  pthread_t sync_tid_;
+  bool is_sync_thread_running_;
+  base::Mutex stop_mu_;
+  base::Cond stop_cond_;
+  bool is_stop_;
 };
 
 }  // namespace store
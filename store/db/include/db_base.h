@@ -7,6 +7,7 @@
 
 #include <map>
 #include <string>
+#include <vector>
 
 #include <stdio.h>
 #include <stdint.h>
@@ -17,11 +18,28 @@
 namespace store
 {
 
+const uint32_t kDefaultSyncIntervalMs = 100;
+
+/**
+ * NOTE: when writes are synced to disk, and writes after the last sync may be lost if system crashes
+ * 1. kSyncGroupCommit returns after synced like kSyncEveryWrite, but writers waiting at the same time share one sync
+ * 2. kSyncInterval is synced by background thread every interval, and kSyncOnClose is only synced by closing db
+ */
+enum SyncPolicy
+{
+    kSyncEveryWrite = 0,
+    kSyncInterval = 1,
+    kSyncOnClose = 2,
+    kSyncGroupCommit = 3,
+};
+
 struct DBStatusInfo
 {/*{{{*/
     uint32_t max_num;
     uint32_t used_cnt;
     uint64_t trx_id;
+    uint64_t live_bytes;    // bytes of newest records in data files, only for BitCaskDB
+    uint64_t dead_bytes;    // bytes of records overwritten or deleted, which are removed by merge
     std::map<uint32_t, uint32_t> same_hash_status;
 
     void Clear()
@@ -29,6 +47,8 @@ struct DBStatusInfo
         max_num = 0;
         used_cnt = 0;
         trx_id = 0;
+        live_bytes = 0;
+        dead_bytes = 0;
         same_hash_status.clear();
     }/*}}}*/
 
@@ -47,6 +67,12 @@ struct DBStatusInfo
         snprintf(buf, sizeof(buf)-1, "%llu\n", (unsigned long long)trx_id);
         *info += std::string("trx_id:") + buf;
 
+        snprintf(buf, sizeof(buf)-1, "%llu\n", (unsigned long long)live_bytes);
+        *info += std::string("live_bytes:") + buf;
+
+        snprintf(buf, sizeof(buf)-1, "%llu\n", (unsigned long long)dead_bytes);
+        *info += std::string("dead_bytes:") + buf;
+
         *info += std::string("num of same hash : num of num of same hash \n");
         std::map<uint32_t, uint32_t>::iterator it;
         for (it = same_hash_status.begin(); it != same_hash_status.end(); ++it)
@@ -60,6 +86,62 @@ struct DBStatusInfo
     }/*}}}*/
 };/*}}}*/
 
+enum WriteBatchOpType
+{
+    kBatchPut = 0,
+    kBatchDel = 1,
+};
+
+/**
+ * NOTE: WriteBatch keeps Put and Del operations, which are applied by DBBase::Write together
+ * 1. operations are applied in the order they are added, and version has the same meaning as Put and Del
+ * 2. if any operation fails, e.g. CAS failed or key not found for Del, none of them is applied
+ */
+class WriteBatch
+{/*{{{*/
+    public:
+        struct Op
+        {/*{{{*/
+            WriteBatchOpType type;
+            std::string key;
+            std::string value;
+            int64_t version;
+        };/*}}}*/
+
+    public:
+        WriteBatch() {}
+        ~WriteBatch() {}
+
+    public:
+        void Put(const std::string &key, const std::string &value, int64_t version=-1)
+        {/*{{{*/
+            Op op;
+            op.type = kBatchPut;
+            op.key = key;
+            op.value = value;
+            op.version = version;
+            ops_.push_back(op);
+        }/*}}}*/
+
+        void Del(const std::string &key, int64_t version=-1)
+        {/*{{{*/
+            Op op;
+            op.type = kBatchDel;
+            op.key = key;
+            op.version = version;
+            ops_.push_back(op);
+        }/*}}}*/
+
+        void Clear() { ops_.clear(); }
+
+        size_t Count() const { return ops_.size(); }
+
+        const std::vector<Op>& GetOps() const { return ops_; }
+
+    private:
+        std::vector<Op> ops_;
+};/*}}}*/
+
 /**
  * NOTE: This is database basic operation
  */
@@ -94,6 +176,22 @@ class DBBase
          */
         virtual base::Code Del(const std::string &key, int64_t version=-1) = 0;
 
+        /**
+         * NOTE: "Write" operation will apply all operations of batch, or none of them if one fails
+         * 1. writes of batch are synced once by sync policy, instead of once for every operation
+         * 2. other Gets see the batch after all operations are applied
+         */
+        virtual base::Code Write(const WriteBatch &batch) = 0;
+
+        /**
+         * NOTE: "MultiGet" operation will get values of keys together, and reads are sorted by position in files
+         * 1. values and rets are resized to the size of keys, and rets[i] is the same as Get of keys[i]
+         * 2. if versions is not NULL, it will be resized and returned at the same time
+         * 3. return code is not kOk only if params are invalid
+         */
+        virtual base::Code MultiGet(const std::vector<std::string> &keys, std::vector<std::string> *values,
+                                    std::vector<base::Code> *rets, std::vector<int64_t> *versions=NULL) = 0;
+
     public:
         virtual base::Code Init(const std::string &dir_path) = 0;
 
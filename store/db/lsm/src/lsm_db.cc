@@ -0,0 +1,1235 @@
+// Copyright (c) 2015 The CSUTIL Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <algorithm>
+#include <map>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+
+#include "base/coding.h"
+#include "base/common.h"
+#include "base/file_util.h"
+#include "base/hash.h"
+#include "base/log.h"
+
+#include "lsm_db.h"
+
+namespace store {
+
+const uint32_t kLSMLevelTimes = 10;  // Max bytes of level n+1 is ten times of level n
+const uint32_t kLSMBatchHeadSize = sizeof(uint64_t) + sizeof(uint32_t);
+const uint32_t kLSMBatchOpHeadSize = sizeof(uint8_t) + 2 * sizeof(uint32_t);
+
+static bool TableLessByFileNum(const SSTablePtr &first, const SSTablePtr &second) { /*{{{*/
+  return first->GetMeta().file_num < second->GetMeta().file_num;
+} /*}}}*/
+
+static bool TableLessBySmallest(const SSTablePtr &first, const SSTablePtr &second) { /*{{{*/
+  return first->GetMeta().smallest.compare(second->GetMeta().smallest) < 0;
+} /*}}}*/
+
+static bool TableLessThanKey(const SSTablePtr &table, const std::string &key) { /*{{{*/
+  return table->GetMeta().largest.compare(key) < 0;
+} /*}}}*/
+
+// NOTE: whether table has keys in [start, end), and empty end means no upper bound
+static bool IsTableInRange(const SSTablePtr &table, const std::string &start, const std::string &end) { /*{{{*/
+  const LSMTableMeta &meta = table->GetMeta();
+  if (meta.largest.compare(start) < 0) return false;
+  if (!end.empty() && meta.smallest.compare(end) >= 0) return false;
+  return true;
+} /*}}}*/
+
+// NOTE: the smallest key larger than all keys with prefix, and empty if there is none, e.g. prefix of all 0xff
+static std::string GetPrefixEnd(const std::string &prefix) { /*{{{*/
+  std::string end = prefix;
+  while (!end.empty()) {
+    uint8_t last = (uint8_t)end[end.size() - 1];
+    if (last != 0xff) {
+      end[end.size() - 1] = (char)(last + 1);
+      return end;
+    }
+    end.resize(end.size() - 1);
+  }
+
+  return end;
+} /*}}}*/
+
+LSMDB::LSMDB()
+    : dir_path_(""),
+      option_(),
+      mem_(NULL),
+      imm_(NULL),
+      wal_(NULL),
+      log_num_(0),
+      imm_log_num_(0),
+      manifest_log_num_(0),
+      last_seq_(0),
+      next_file_num_(1),
+      levels_(kLSMLevelsNum),
+      compact_pointers_(kLSMLevelsNum),
+      bg_error_(base::kOk),
+      is_stop_(false),
+      bg_tid_(),
+      is_bg_thread_running_(false),
+      sync_policy_(kSyncEveryWrite),
+      sync_interval_ms_(kDefaultSyncIntervalMs),
+      is_dirty_(false),
+      sync_tid_(),
+      is_sync_thread_running_(false) { /*{{{*/
+} /*}}}*/
+
+LSMDB::~LSMDB() { /*{{{*/ Destroy(); } /*}}}*/
+
+base::Code LSMDB::Put(const std::string &key, const std::string &value, int64_t version /*=-1*/) { /*{{{*/
+  WriteBatch batch;
+  batch.Put(key, value, version);
+  return Write(batch);
+} /*}}}*/
+
+base::Code LSMDB::Get(const std::string &key, std::string *value, int64_t *version /*=NULL*/) { /*{{{*/
+  if (value == NULL) return base::kInvalidParam;
+
+  LSMEntry entry;
+  {
+    base::ReadLock rl(&mu_);
+    if (mem_ == NULL) return base::kNotInit;
+    base::Code ret = LookUp(key, &entry);
+    if (ret != base::kOk) return ret;
+  }
+  if (entry.type == kLSMDelType) return base::kNotFound;
+
+  value->swap(entry.value);
+  if (version != NULL) *version = (int64_t)entry.seq;
+  return base::kOk;
+} /*}}}*/
+
+/**
+ * NOTE: key is looked up from the newest data to the oldest, and the first entry found is the newest one
+ * 1. memtable, then the immutable memtable, then level 0 tables from the newest file
+ * 2. tables of level 1 and deeper don't overlap, so there is at most one table to read in every level
+ */
+base::Code LSMDB::LookUp(const std::string &key, LSMEntry *entry) { /*{{{*/
+  base::Code ret = mem_->Get(key, entry);
+  if (ret != base::kNotFound) return ret;
+
+  if (imm_ != NULL) {
+    ret = imm_->Get(key, entry);
+    if (ret != base::kNotFound) return ret;
+  }
+
+  const std::vector<SSTablePtr> &level0 = levels_[0];
+  std::vector<SSTablePtr>::const_reverse_iterator level0_it = level0.rbegin();
+  for (; level0_it != level0.rend(); ++level0_it) {
+    ret = (*level0_it)->Get(key, entry);
+    if (ret != base::kNotFound) return ret;
+  }
+
+  for (uint32_t level = 1; level < kLSMLevelsNum; ++level) {
+    const std::vector<SSTablePtr> &tables = levels_[level];
+    std::vector<SSTablePtr>::const_iterator tables_it =
+        std::lower_bound(tables.begin(), tables.end(), key, TableLessThanKey);
+    if (tables_it == tables.end()) continue;
+
+    ret = (*tables_it)->Get(key, entry);
+    if (ret != base::kNotFound) return ret;
+  }
+
+  return base::kNotFound;
+} /*}}}*/
+
+base::Code LSMDB::Del(const std::string &key, int64_t version /*=-1*/) { /*{{{*/
+  WriteBatch batch;
+  batch.Del(key, version);
+  return Write(batch);
+} /*}}}*/
+
+base::Code LSMDB::Write(const WriteBatch &batch) { /*{{{*/
+  if (batch.Count() == 0) return base::kOk;
+
+  uint64_t seq = 0;
+  base::Code ret = WriteBatchValues(batch, &seq);
+  if (ret != base::kOk || seq == 0) return ret;
+
+  // NOTE: write_mu_ is unlocked, so other writers append while this one waits for group commit
+  return group_commit_.WaitSynced(seq, [this]() { return Sync(); });
+} /*}}}*/
+
+/**
+ * NOTE: batch is checked against db and the former operations of itself before anything is written
+ * 1. only Del and CAS need the current entry, so Put with version -1 doesn't read tables
+ * 2. wal is appended without mu_, which is only locked to put entries into memtable, so Gets are not blocked
+ */
+base::Code LSMDB::WriteBatchValues(const WriteBatch &batch, uint64_t *seq) { /*{{{*/
+  const std::vector<WriteBatch::Op> &ops = batch.GetOps();
+  std::vector<WriteBatch::Op>::const_iterator ops_it = ops.begin();
+  for (; ops_it != ops.end(); ++ops_it) {
+    if (ops_it->key.size() > kLSMMaxKeySize) return base::kKeySizeIsLarge;
+    if (ops_it->value.size() > kLSMMaxValueSize) return base::kValueSizeIsLarger;
+  }
+
+  base::MutexLock write_ml(&write_mu_);
+  if (mem_ == NULL) return base::kNotInit;
+  base::Code ret = MakeRoomForWrite(false);
+  if (ret != base::kOk) return ret;
+
+  // NOTE: sequence of key after the former operations of batch, and 0 means key doesn't exist
+  uint64_t first_seq = last_seq_ + 1;
+  std::map<std::string, uint64_t> batch_seqs;
+  for (size_t i = 0; i < ops.size(); ++i) {
+    const WriteBatch::Op &op = ops[i];
+    if (op.type == kBatchPut && op.version == -1) {
+      batch_seqs[op.key] = first_seq + i;
+      continue;
+    }
+
+    uint64_t cur_seq = 0;
+    std::map<std::string, uint64_t>::iterator seqs_it = batch_seqs.find(op.key);
+    if (seqs_it != batch_seqs.end()) {
+      cur_seq = seqs_it->second;
+    } else {
+      LSMEntry entry;
+      base::ReadLock rl(&mu_);
+      ret = LookUp(op.key, &entry);
+      if (ret != base::kOk && ret != base::kNotFound) return ret;
+      if (ret == base::kOk && entry.type == kLSMPutType) cur_seq = entry.seq;
+    }
+
+    if (op.type == kBatchDel && cur_seq == 0) return base::kNotFound;
+    if (op.version != -1 && op.version != (int64_t)cur_seq) return base::kCASFailed;
+    batch_seqs[op.key] = (op.type == kBatchDel) ? 0 : first_seq + i;
+  }
+
+  std::string payload;
+  ret = EncodeBatch(batch, first_seq, &payload);
+  if (ret != base::kOk) return ret;
+
+  ret = wal_->Append(payload, sync_policy_ == kSyncEveryWrite);
+  if (ret != base::kOk) return ret;
+  if (sync_policy_ != kSyncEveryWrite) __atomic_store_n(&is_dirty_, true, __ATOMIC_SEQ_CST);
+
+  base::WriteLock wl(&mu_);
+  for (size_t i = 0; i < ops.size(); ++i) {
+    LSMEntry entry;
+    entry.seq = first_seq + i;
+    entry.type = (ops[i].type == kBatchDel) ? kLSMDelType : kLSMPutType;
+    entry.value = ops[i].value;
+    ret = mem_->Put(ops[i].key, entry);
+    if (ret != base::kOk) return ret;
+  }
+  last_seq_ = first_seq + ops.size() - 1;
+  if (sync_policy_ == kSyncGroupCommit) *seq = group_commit_.AddWrite();
+
+  return base::kOk;
+} /*}}}*/
+
+// NOTE: payload of wal record is |first_seq|count|op|...|, and op is |type|key_size|value_size|key|value|
+base::Code LSMDB::EncodeBatch(const WriteBatch &batch, uint64_t first_seq, std::string *payload) { /*{{{*/
+  const std::vector<WriteBatch::Op> &ops = batch.GetOps();
+  size_t size = kLSMBatchHeadSize;
+  std::vector<WriteBatch::Op>::const_iterator ops_it = ops.begin();
+  for (; ops_it != ops.end(); ++ops_it) {
+    size += kLSMBatchOpHeadSize + ops_it->key.size() + ops_it->value.size();
+  }
+
+  payload->clear();
+  payload->reserve(size);
+  base::EncodeFixed64(first_seq, payload);
+  base::EncodeFixed32(ops.size(), payload);
+  for (ops_it = ops.begin(); ops_it != ops.end(); ++ops_it) {
+    payload->append(1, (char)((ops_it->type == kBatchDel) ? kLSMDelType : kLSMPutType));
+    base::EncodeFixed32(ops_it->key.size(), payload);
+    base::EncodeFixed32(ops_it->value.size(), payload);
+    payload->append(ops_it->key);
+    payload->append(ops_it->value);
+  }
+
+  return base::kOk;
+} /*}}}*/
+
+/**
+ * NOTE: memtable is switched to immutable once it's full, and writes wait if
+ * 1. the former immutable memtable is not flushed yet
+ * 2. level 0 has too many tables, which makes Get slow, so compaction catches up first
+ */
+base::Code LSMDB::MakeRoomForWrite(bool force) { /*{{{*/
+  base::MutexLock ml(&bg_mu_);
+  while (true) {
+    if (bg_error_ != base::kOk) return bg_error_;
+    if (is_stop_) return base::kNotInit;
+
+    if (!force && mem_->GetBytes() < option_.write_buffer_size) break;
+    if (force && mem_->GetCount() == 0) break;
+
+    if (imm_ != NULL || levels_[0].size() >= option_.l0_stop_writes_trigger) {
+      bg_cond_.Wait(bg_mu_);
+      continue;
+    }
+
+    base::Code ret = SwitchMemTable();
+    if (ret != base::kOk) return ret;
+    force = false;
+  }
+
+  return base::kOk;
+} /*}}}*/
+
+base::Code LSMDB::SwitchMemTable() { /*{{{*/
+  // NOTE: Sync only syncs the current wal, so the old one is synced before it's replaced
+  base::Code ret = base::kOk;
+  if (sync_policy_ != kSyncEveryWrite) {
+    ret = wal_->Sync();
+    if (ret != base::kOk) return ret;
+  }
+
+  uint64_t new_log_num = next_file_num_++;  // NOTE: bg_mu_ is held by MakeRoomForWrite
+  WALWriter *new_wal = new WALWriter();
+  ret = new_wal->Open(GetFilePath(new_log_num, kLSMLogFileSuffix));
+  if (ret != base::kOk) {
+    delete new_wal;
+    return ret;
+  }
+
+  MemTable *new_mem = new MemTable();
+  ret = new_mem->Init();
+  if (ret != base::kOk) {
+    delete new_wal;
+    delete new_mem;
+    return ret;
+  }
+
+  WALWriter *old_wal = NULL;
+  {
+    base::WriteLock wl(&mu_);
+    imm_ = mem_;
+    imm_log_num_ = log_num_;
+    mem_ = new_mem;
+    old_wal = wal_;
+    wal_ = new_wal;
+    log_num_ = new_log_num;
+  }
+  delete old_wal;
+
+  bg_cond_.BroadCast();
+  return base::kOk;
+} /*}}}*/
+
+base::Code LSMDB::MultiGet(const std::vector<std::string> &keys, std::vector<std::string> *values,
+                           std::vector<base::Code> *rets, std::vector<int64_t> *versions /*=NULL*/) { /*{{{*/
+  if (values == NULL || rets == NULL) return base::kInvalidParam;
+
+  values->assign(keys.size(), "");
+  rets->assign(keys.size(), base::kNotFound);
+  if (versions != NULL) versions->assign(keys.size(), 0);
+
+  std::vector<std::pair<std::string, size_t> > sorted_keys;
+  sorted_keys.reserve(keys.size());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    sorted_keys.push_back(std::pair<std::string, size_t>(keys[i], i));
+  }
+  std::sort(sorted_keys.begin(), sorted_keys.end());
+
+  base::ReadLock rl(&mu_);
+  if (mem_ == NULL) return base::kNotInit;
+  for (size_t i = 0; i < sorted_keys.size(); ++i) {
+    size_t index = sorted_keys[i].second;
+    LSMEntry entry;
+    base::Code ret = LookUp(sorted_keys[i].first, &entry);
+    if (ret == base::kOk && entry.type == kLSMDelType) ret = base::kNotFound;
+    (*rets)[index] = ret;
+    if (ret != base::kOk) continue;
+
+    (*values)[index].swap(entry.value);
+    if (versions != NULL) (*versions)[index] = (int64_t)entry.seq;
+  }
+
+  return base::kOk;
+} /*}}}*/
+
+base::Code LSMDB::NewIterator(const std::string &start, const std::string &end, LSMIterator **iter) { /*{{{*/
+  if (iter == NULL) return base::kInvalidParam;
+
+  std::vector<LSMInternalIterator *> children;
+  {
+    base::ReadLock rl(&mu_);
+    if (mem_ == NULL) return base::kNotInit;
+
+    std::vector<LSMRecord> records;
+    base::Code ret = mem_->GetRange(start, end, &records);
+    if (ret != base::kOk) return ret;
+    children.push_back(new LSMVectorIterator(&records));
+    if (imm_ != NULL) {
+      ret = imm_->GetRange(start, end, &records);
+      if (ret != base::kOk) {
+        delete children[0];
+        return ret;
+      }
+      children.push_back(new LSMVectorIterator(&records));
+    }
+
+    std::vector<SSTablePtr>::iterator tables_it = levels_[0].begin();
+    for (; tables_it != levels_[0].end(); ++tables_it) {
+      if (IsTableInRange(*tables_it, start, end)) children.push_back(new SSTableIterator(*tables_it));
+    }
+
+    for (uint32_t level = 1; level < kLSMLevelsNum; ++level) {
+      std::vector<SSTablePtr> tables;
+      for (tables_it = levels_[level].begin(); tables_it != levels_[level].end(); ++tables_it) {
+        if (IsTableInRange(*tables_it, start, end)) tables.push_back(*tables_it);
+      }
+      if (!tables.empty()) children.push_back(new LSMLevelIterator(tables));
+    }
+  }
+
+  *iter = new LSMIterator(new LSMMergeIterator(children), start, end);
+  return base::kOk;
+} /*}}}*/
+
+base::Code LSMDB::NewPrefixIterator(const std::string &prefix, LSMIterator **iter) { /*{{{*/
+  return NewIterator(prefix, GetPrefixEnd(prefix), iter);
+} /*}}}*/
+
+base::Code LSMDB::Flush() { /*{{{*/
+  {
+    base::MutexLock write_ml(&write_mu_);
+    if (mem_ == NULL) return base::kNotInit;
+    base::Code ret = MakeRoomForWrite(true);
+    if (ret != base::kOk) return ret;
+  }
+
+  base::MutexLock ml(&bg_mu_);
+  while (imm_ != NULL && bg_error_ == base::kOk && !is_stop_) {
+    bg_cond_.Wait(bg_mu_);
+  }
+
+  return bg_error_;
+} /*}}}*/
+
+bool LSMDB::NeedCompaction() { /*{{{*/
+  base::MutexLock ml(&bg_mu_);
+  uint32_t level = 0;
+  return imm_ != NULL || GetCompactionScore(&level) >= 1;
+} /*}}}*/
+
+uint32_t LSMDB::GetLevelFilesNum(uint32_t level) { /*{{{*/
+  if (level >= kLSMLevelsNum) return 0;
+
+  base::ReadLock rl(&mu_);
+  return levels_[level].size();
+} /*}}}*/
+
+base::Code LSMDB::Init(const std::string &dir_path) { /*{{{*/
+  if (dir_path.empty()) return base::kInvalidParam;
+  if (mem_ != NULL) return base::kOk;
+  if (option_.write_buffer_size == 0 || option_.target_file_size == 0 || option_.block_size == 0 ||
+      option_.l0_compaction_trigger == 0 || option_.l0_stop_writes_trigger < option_.l0_compaction_trigger) {
+    return base::kInvalidParam;
+  }
+
+  dir_path_ = dir_path;
+  base::Code ret = base::CreateDir(dir_path);
+  if (ret != base::kOk) return ret;
+
+  // NOTE: mem_ means db is inited, so half recovered db is dropped by Destroy, then Init can be called again
+  ret = Open();
+  if (ret != base::kOk) Destroy();
+  return ret;
+} /*}}}*/
+
+base::Code LSMDB::Open() { /*{{{*/
+  mem_ = new MemTable();
+  base::Code ret = mem_->Init();
+  if (ret != base::kOk) return ret;
+
+  ret = Recover();
+  if (ret != base::kOk) return ret;
+
+  is_stop_ = false;
+  int r = pthread_create(&bg_tid_, NULL, BGThreadAction, this);
+  if (r != 0) return base::kPthreadCreateFailed;
+  is_bg_thread_running_ = true;
+
+  if (sync_policy_ == kSyncInterval && sync_interval_ms_ > 0) {
+    r = pthread_create(&sync_tid_, NULL, SyncThreadAction, this);
+    if (r != 0) return base::kPthreadCreateFailed;
+    is_sync_thread_running_ = true;
+  }
+
+  return base::kOk;
+} /*}}}*/
+
+/**
+ * NOTE: db is recovered from manifest and wals, and threads are not started yet
+ * 1. wals not older than log number of manifest are replayed into memtable, which is flushed into level 0
+ * 2. then a new wal is opened and manifest is written, so old wals and tables not in manifest are removed
+ */
+base::Code LSMDB::Recover() { /*{{{*/
+  bool is_exist = false;
+  base::Code ret = base::CheckFileExist(dir_path_ + base::kSlashStr + kLSMManifestFileName, &is_exist);
+  if (ret != base::kOk) return ret;
+  if (is_exist) {
+    ret = ReadManifest();
+    if (ret != base::kOk) return ret;
+  }
+
+  std::vector<std::string> files_name;
+  ret = base::GetNormalFilesName(dir_path_, &files_name);
+  if (ret != base::kOk) return ret;
+
+  std::vector<std::string> logs_path;
+  std::vector<std::string>::iterator files_it = files_name.begin();
+  for (; files_it != files_name.end(); ++files_it) {
+    uint64_t file_num = 0;
+    std::string suffix;
+    if (!ParseFileName(*files_it, &file_num, &suffix)) continue;
+    if (file_num >= next_file_num_) next_file_num_ = file_num + 1;
+    if (suffix != kLSMLogFileSuffix || file_num < manifest_log_num_) continue;
+    logs_path.push_back(GetFilePath(file_num, suffix));
+  }
+
+  // NOTE: files are sorted by name, and file numbers have the same width, so wals are replayed in order
+  std::vector<std::string>::iterator logs_it = logs_path.begin();
+  for (; logs_it != logs_path.end(); ++logs_it) {
+    ret = ReplayWAL(*logs_it);
+    if (ret != base::kOk) return ret;
+  }
+
+  if (mem_->GetCount() > 0) {
+    SSTablePtr table;
+    ret = WriteLevel0Table(mem_, &table);
+    if (ret != base::kOk) return ret;
+    levels_[0].push_back(table);
+
+    delete mem_;
+    mem_ = new MemTable();
+    ret = mem_->Init();
+    if (ret != base::kOk) return ret;
+  }
+
+  log_num_ = NewFileNum();
+  wal_ = new WALWriter();
+  ret = wal_->Open(GetFilePath(log_num_, kLSMLogFileSuffix));
+  if (ret != base::kOk) return ret;
+
+  ret = WriteManifest(levels_, log_num_);
+  if (ret != base::kOk) return ret;
+  manifest_log_num_ = log_num_;
+
+  return RemoveObsoleteFiles(files_name);
+} /*}}}*/
+
+base::Code LSMDB::ReplayWAL(const std::string &path) { /*{{{*/
+  std::vector<std::string> payloads;
+  base::Code ret = ReadWALRecords(path, &payloads);
+  if (ret != base::kOk) return ret;
+
+  std::vector<std::string>::iterator payloads_it = payloads.begin();
+  for (; payloads_it != payloads.end(); ++payloads_it) {
+    const std::string &payload = *payloads_it;
+    if (payload.size() < kLSMBatchHeadSize) return base::kDataValueError;
+
+    uint64_t first_seq = 0;
+    uint32_t count = 0;
+    base::DecodeFixed64(payload.substr(0, sizeof(uint64_t)), &first_seq);
+    base::DecodeFixed32(payload.substr(sizeof(uint64_t), sizeof(uint32_t)), &count);
+
+    size_t pos = kLSMBatchHeadSize;
+    for (uint32_t i = 0; i < count; ++i) {
+      if (pos + kLSMBatchOpHeadSize > payload.size()) return base::kDataValueError;
+      LSMEntry entry;
+      entry.seq = first_seq + i;
+      entry.type = (uint8_t)payload[pos];
+      uint32_t key_size = 0;
+      uint32_t value_size = 0;
+      base::DecodeFixed32(payload.substr(pos + sizeof(uint8_t), sizeof(uint32_t)), &key_size);
+      base::DecodeFixed32(payload.substr(pos + sizeof(uint8_t) + sizeof(uint32_t), sizeof(uint32_t)), &value_size);
+      pos += kLSMBatchOpHeadSize;
+      if (pos + (uint64_t)key_size + value_size > payload.size()) return base::kDataValueError;
+
+      std::string key = payload.substr(pos, key_size);
+      entry.value.assign(payload, pos + key_size, value_size);
+      pos += key_size + value_size;
+      ret = mem_->Put(key, entry);
+      if (ret != base::kOk) return ret;
+    }
+    if (count > 0 && first_seq + count - 1 > last_seq_) last_seq_ = first_seq + count - 1;
+  }
+
+  return base::kOk;
+} /*}}}*/
+
+// NOTE: files left by crash, which are wals already flushed, tables not in manifest and tmp files
+base::Code LSMDB::RemoveObsoleteFiles(const std::vector<std::string> &files_name) { /*{{{*/
+  std::map<uint64_t, bool> live_tables;
+  for (uint32_t level = 0; level < kLSMLevelsNum; ++level) {
+    std::vector<SSTablePtr>::iterator tables_it = levels_[level].begin();
+    for (; tables_it != levels_[level].end(); ++tables_it) {
+      live_tables[(*tables_it)->GetMeta().file_num] = true;
+    }
+  }
+
+  std::vector<std::string>::const_iterator files_it = files_name.begin();
+  for (; files_it != files_name.end(); ++files_it) {
+    uint64_t file_num = 0;
+    std::string suffix;
+    bool is_obsolete = false;
+    if (ParseFileName(*files_it, &file_num, &suffix)) {
+      if (suffix == kLSMLogFileSuffix) is_obsolete = (file_num < log_num_);
+      if (suffix == kLSMTableFileSuffix) is_obsolete = (live_tables.find(file_num) == live_tables.end());
+    } else if (files_it->size() > kLSMTmpFileSuffix.size() &&
+               files_it->compare(files_it->size() - kLSMTmpFileSuffix.size(), kLSMTmpFileSuffix.size(),
+                                 kLSMTmpFileSuffix) == 0) {
+      is_obsolete = true;
+    }
+    if (!is_obsolete) continue;
+
+    if (unlink((dir_path_ + base::kSlashStr + *files_it).c_str()) != 0) {
+      base::LOG_ERR("Failed to remove obsolete file of lsm db, file:%s, errno:%d", files_it->c_str(), errno);
+    }
+  }
+
+  return base::kOk;
+} /*}}}*/
+
+base::Code LSMDB::ReadManifest() { /*{{{*/
+  std::string path = dir_path_ + base::kSlashStr + kLSMManifestFileName;
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) return base::kOpenFileFailed;
+
+  uint64_t file_size = 0;
+  base::Code ret = base::GetFileSize(fd, &file_size);
+  std::string data(file_size, '\0');
+  if (ret == base::kOk && file_size > 0) ret = base::ReadAt(fd, 0, file_size, &data[0]);
+  close(fd);
+  if (ret != base::kOk) return ret;
+  if (data.size() < kLSMManifestHeadSize) return base::kDataValueError;
+
+  uint32_t crc = 0;
+  uint32_t size = 0;
+  base::DecodeFixed32(data.substr(0, sizeof(uint32_t)), &crc);
+  base::DecodeFixed32(data.substr(sizeof(uint32_t), sizeof(uint32_t)), &size);
+  if (kLSMManifestHeadSize + (uint64_t)size != data.size()) return base::kDataValueError;
+  std::string payload = data.substr(kLSMManifestHeadSize);
+  if (base::CRC32(payload.data(), (int)payload.size()) != crc) return base::kDataValueError;
+
+  size_t pos = 0;
+  uint32_t tables_num = 0;
+  if (payload.size() < 3 * sizeof(uint64_t) + sizeof(uint32_t)) return base::kDataValueError;
+  base::DecodeFixed64(payload.substr(pos, sizeof(uint64_t)), &next_file_num_);
+  pos += sizeof(uint64_t);
+  base::DecodeFixed64(payload.substr(pos, sizeof(uint64_t)), &last_seq_);
+  pos += sizeof(uint64_t);
+  base::DecodeFixed64(payload.substr(pos, sizeof(uint64_t)), &manifest_log_num_);
+  pos += sizeof(uint64_t);
+  base::DecodeFixed32(payload.substr(pos, sizeof(uint32_t)), &tables_num);
+  pos += sizeof(uint32_t);
+
+  for (uint32_t i = 0; i < tables_num; ++i) {
+    uint32_t level = 0;
+    LSMTableMeta meta;
+    if (pos + sizeof(uint32_t) + 3 * sizeof(uint64_t) > payload.size()) return base::kDataValueError;
+    base::DecodeFixed32(payload.substr(pos, sizeof(uint32_t)), &level);
+    pos += sizeof(uint32_t);
+    base::DecodeFixed64(payload.substr(pos, sizeof(uint64_t)), &(meta.file_num));
+    pos += sizeof(uint64_t);
+    base::DecodeFixed64(payload.substr(pos, sizeof(uint64_t)), &(meta.file_size));
+    pos += sizeof(uint64_t);
+    base::DecodeFixed64(payload.substr(pos, sizeof(uint64_t)), &(meta.entries_num));
+    pos += sizeof(uint64_t);
+
+    std::string *keys[2] = {&(meta.smallest), &(meta.largest)};
+    for (int j = 0; j < 2; ++j) {
+      uint32_t key_size = 0;
+      if (pos + sizeof(uint32_t) > payload.size()) return base::kDataValueError;
+      base::DecodeFixed32(payload.substr(pos, sizeof(uint32_t)), &key_size);
+      pos += sizeof(uint32_t);
+      if (pos + key_size > payload.size()) return base::kDataValueError;
+      keys[j]->assign(payload, pos, key_size);
+      pos += key_size;
+    }
+    if (level >= kLSMLevelsNum) return base::kDataValueError;
+
+    SSTablePtr table(new SSTable());
+    ret = table->Open(GetFilePath(meta.file_num, kLSMTableFileSuffix), meta, option_);
+    if (ret != base::kOk) {
+      base::LOG_ERR("Failed to open table of lsm db, dir:%s, file num:%llu, ret:%d", dir_path_.c_str(),
+                    (unsigned long long)meta.file_num, ret);
+      return ret;
+    }
+    levels_[level].push_back(table);
+  }
+
+  std::sort(levels_[0].begin(), levels_[0].end(), TableLessByFileNum);
+  for (uint32_t level = 1; level < kLSMLevelsNum; ++level) {
+    std::sort(levels_[level].begin(), levels_[level].end(), TableLessBySmallest);
+  }
+
+  return base::kOk;
+} /*}}}*/
+
+/**
+ * NOTE: manifest is written into tmp file and renamed, so it's the old one or the new one after crash
+ */
+base::Code LSMDB::WriteManifest(const std::vector<std::vector<SSTablePtr> > &levels, uint64_t log_num) { /*{{{*/
+  uint64_t last_seq = 0;
+  {
+    base::ReadLock rl(&mu_);
+    last_seq = last_seq_;
+  }
+  uint64_t next_file_num = 0;
+  {
+    base::MutexLock ml(&bg_mu_);
+    next_file_num = next_file_num_;
+  }
+
+  std::string payload;
+  uint32_t tables_num = 0;
+  for (uint32_t level = 0; level < levels.size(); ++level) {
+    tables_num += levels[level].size();
+  }
+  base::EncodeFixed64(next_file_num, &payload);
+  base::EncodeFixed64(last_seq, &payload);
+  base::EncodeFixed64(log_num, &payload);
+  base::EncodeFixed32(tables_num, &payload);
+  for (uint32_t level = 0; level < levels.size(); ++level) {
+    std::vector<SSTablePtr>::const_iterator tables_it = levels[level].begin();
+    for (; tables_it != levels[level].end(); ++tables_it) {
+      const LSMTableMeta &meta = (*tables_it)->GetMeta();
+      base::EncodeFixed32(level, &payload);
+      base::EncodeFixed64(meta.file_num, &payload);
+      base::EncodeFixed64(meta.file_size, &payload);
+      base::EncodeFixed64(meta.entries_num, &payload);
+      base::EncodeFixed32(meta.smallest.size(), &payload);
+      payload.append(meta.smallest);
+      base::EncodeFixed32(meta.largest.size(), &payload);
+      payload.append(meta.largest);
+    }
+  }
+
+  std::string data;
+  base::EncodeFixed32(base::CRC32(payload.data(), (int)payload.size()), &data);
+  base::EncodeFixed32(payload.size(), &data);
+  data.append(payload);
+
+  std::string path = dir_path_ + base::kSlashStr + kLSMManifestFileName;
+  std::string tmp_path = path + kLSMTmpFileSuffix;
+  int fd = open(tmp_path.c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0644);
+  if (fd < 0) return base::kOpenFileFailed;
+  base::Code ret = base::WriteAt(fd, 0, data.data(), data.size());
+  if (ret == base::kOk && fdatasync(fd) != 0) ret = base::kWriteError;
+  close(fd);
+  if (ret != base::kOk) return ret;
+
+  return base::MoveFile(tmp_path, path);
+} /*}}}*/
+
+std::string LSMDB::GetFilePath(uint64_t file_num, const std::string &suffix) { /*{{{*/
+  char buf[base::kSmallBufLen] = {0};
+  snprintf(buf, sizeof(buf) - 1, "%0*llu", kLSMFileNumLen, (unsigned long long)file_num);
+  return dir_path_ + base::kSlashStr + buf + suffix;
+} /*}}}*/
+
+bool LSMDB::ParseFileName(const std::string &file_name, uint64_t *file_num, std::string *suffix) { /*{{{*/
+  if (file_name.size() <= (size_t)kLSMFileNumLen) return false;
+
+  *suffix = file_name.substr(kLSMFileNumLen);
+  if (*suffix != kLSMLogFileSuffix && *suffix != kLSMTableFileSuffix) return false;
+
+  *file_num = 0;
+  for (int i = 0; i < kLSMFileNumLen; ++i) {
+    if (file_name[i] < '0' || file_name[i] > '9') return false;
+    *file_num = *file_num * 10 + (file_name[i] - '0');
+  }
+
+  return true;
+} /*}}}*/
+
+uint64_t LSMDB::NewFileNum() { /*{{{*/
+  // NOTE: bg_mu_ is not recursive, so it's locked here only after Init, when background thread is running
+  if (!is_bg_thread_running_) return next_file_num_++;
+
+  base::MutexLock ml(&bg_mu_);
+  return next_file_num_++;
+} /*}}}*/
+
+base::Code LSMDB::GetStatus(DBStatusInfo *status_info) { /*{{{*/
+  if (status_info == NULL) return base::kInvalidParam;
+  status_info->Clear();
+
+  base::ReadLock rl(&mu_);
+  if (mem_ == NULL) return base::kNotInit;
+
+  // NOTE: used_cnt is records of memtables and tables, which counts the same key of different tables more times
+  uint64_t records_num = mem_->GetCount() + ((imm_ == NULL) ? 0 : imm_->GetCount());
+  for (uint32_t level = 0; level < kLSMLevelsNum; ++level) {
+    std::vector<SSTablePtr>::iterator tables_it = levels_[level].begin();
+    for (; tables_it != levels_[level].end(); ++tables_it) {
+      records_num += (*tables_it)->GetMeta().entries_num;
+      status_info->live_bytes += (*tables_it)->GetMeta().file_size;
+    }
+  }
+  status_info->max_num = UINT_MAX;
+  status_info->used_cnt = (records_num > UINT_MAX) ? UINT_MAX : (uint32_t)records_num;
+  status_info->trx_id = last_seq_;
+
+  return base::kOk;
+} /*}}}*/
+
+base::Code LSMDB::Destroy() { /*{{{*/
+  StopThreads();
+
+  // NOTE: writes of kSyncInterval and kSyncOnClose are synced at last, and memtable is replayed from wal by Init
+  if (wal_ != NULL && is_dirty_) {
+    base::Code ret = wal_->Sync();
+    if (ret != base::kOk) base::LOG_ERR("Failed to sync wal of lsm db, dir:%s, ret:%d", dir_path_.c_str(), ret);
+  }
+
+  base::WriteLock wl(&mu_);
+  if (wal_ != NULL) {
+    delete wal_;
+    wal_ = NULL;
+  }
+  if (mem_ != NULL) {
+    delete mem_;
+    mem_ = NULL;
+  }
+  if (imm_ != NULL) {
+    delete imm_;
+    imm_ = NULL;
+  }
+  for (uint32_t level = 0; level < kLSMLevelsNum; ++level) {
+    levels_[level].clear();
+    compact_pointers_[level].clear();
+  }
+
+  // NOTE: version is read from manifest again by the next Init
+  log_num_ = 0;
+  imm_log_num_ = 0;
+  manifest_log_num_ = 0;
+  last_seq_ = 0;
+  next_file_num_ = 1;
+  bg_error_ = base::kOk;
+  is_dirty_ = false;
+
+  return base::kOk;
+} /*}}}*/
+
+base::Code LSMDB::StopThreads() { /*{{{*/
+  {
+    base::MutexLock ml(&bg_mu_);
+    is_stop_ = true;
+    bg_cond_.BroadCast();
+  }
+
+  if (is_bg_thread_running_) {
+    pthread_join(bg_tid_, NULL);
+    is_bg_thread_running_ = false;
+  }
+
+  if (is_sync_thread_running_) {
+    pthread_join(sync_tid_, NULL);
+    is_sync_thread_running_ = false;
+  }
+
+  return base::kOk;
+} /*}}}*/
+
+/**
+ * NOTE: fd of the current wal is duplicated under read lock, so it's synced without lock even if memtable is
+ * switched at the same time; dirty flag is cleared first, so writes done while syncing are synced by the next round
+ */
+base::Code LSMDB::Sync() { /*{{{*/
+  __atomic_store_n(&is_dirty_, false, __ATOMIC_SEQ_CST);
+
+  int fd = -1;
+  {
+    base::ReadLock rl(&mu_);
+    if (wal_ == NULL) return base::kNotInit;
+    fd = dup(wal_->GetFd());
+    if (fd < 0) return base::kOpenFileFailed;
+  }
+
+  int r = fdatasync(fd);
+  close(fd);
+  if (r != 0) {
+    base::LOG_ERR("Failed to sync wal of lsm db, dir:%s, errno:%d", dir_path_.c_str(), errno);
+    __atomic_store_n(&is_dirty_, true, __ATOMIC_SEQ_CST);
+    return base::kWriteError;
+  }
+
+  return base::kOk;
+} /*}}}*/
+
+void *LSMDB::SyncThreadAction(void *param) { /*{{{*/
+  LSMDB *db = static_cast<LSMDB *>(param);
+  db->SyncLoop();
+  return NULL;
+} /*}}}*/
+
+void LSMDB::SyncLoop() { /*{{{*/
+  while (true) {
+    {
+      base::MutexLock ml(&bg_mu_);
+      if (!is_stop_) bg_cond_.TimeWait(bg_mu_, sync_interval_ms_);
+      if (is_stop_) break;
+    }
+
+    if (!__atomic_load_n(&is_dirty_, __ATOMIC_SEQ_CST)) continue;
+    base::Code ret = Sync();
+    if (ret != base::kOk) base::LOG_ERR("Failed to sync lsm db, dir:%s, ret:%d", dir_path_.c_str(), ret);
+  }
+} /*}}}*/
+
+void *LSMDB::BGThreadAction(void *param) { /*{{{*/
+  LSMDB *db = static_cast<LSMDB *>(param);
+  db->BGLoop();
+  return NULL;
+} /*}}}*/
+
+// NOTE: immutable memtable is flushed before any compaction, since writes may be waiting for it
+void LSMDB::BGLoop() { /*{{{*/
+  while (true) {
+    bool has_imm = false;
+    {
+      base::MutexLock ml(&bg_mu_);
+      uint32_t level = 0;
+      while (!is_stop_ && imm_ == NULL && GetCompactionScore(&level) < 1) {
+        bg_cond_.Wait(bg_mu_);
+      }
+      if (is_stop_) break;
+      has_imm = (imm_ != NULL);
+    }
+
+    base::Code ret = has_imm ? FlushImmTable() : Compact();
+    if (ret != base::kOk) {
+      base::LOG_ERR("Failed to %s lsm db, dir:%s, ret:%d", has_imm ? "flush" : "compact", dir_path_.c_str(), ret);
+      base::MutexLock ml(&bg_mu_);
+      bg_error_ = ret;
+      bg_cond_.BroadCast();
+      break;
+    }
+  }
+} /*}}}*/
+
+bool LSMDB::IsStopping() { /*{{{*/
+  base::MutexLock ml(&bg_mu_);
+  return is_stop_;
+} /*}}}*/
+
+/**
+ * NOTE: score of level 0 is number of tables to the trigger, since every table is read by Get, and score of
+ * deeper levels is bytes to the max bytes of level; the last level is never compacted
+ */
+double LSMDB::GetCompactionScore(uint32_t *level) { /*{{{*/
+  *level = 0;
+  double best_score = (double)levels_[0].size() / option_.l0_compaction_trigger;
+  for (uint32_t i = 1; i + 1 < kLSMLevelsNum; ++i) {
+    uint64_t level_bytes = 0;
+    std::vector<SSTablePtr>::iterator tables_it = levels_[i].begin();
+    for (; tables_it != levels_[i].end(); ++tables_it) {
+      level_bytes += (*tables_it)->GetMeta().file_size;
+    }
+
+    double score = (double)level_bytes / GetMaxBytesForLevel(i);
+    if (score > best_score) {
+      best_score = score;
+      *level = i;
+    }
+  }
+
+  return best_score;
+} /*}}}*/
+
+uint64_t LSMDB::GetMaxBytesForLevel(uint32_t level) { /*{{{*/
+  uint64_t max_bytes = option_.max_bytes_for_level_base;
+  for (uint32_t i = 1; i < level; ++i) {
+    max_bytes *= kLSMLevelTimes;
+  }
+
+  return max_bytes;
+} /*}}}*/
+
+base::Code LSMDB::WriteLevel0Table(MemTable *mem, SSTablePtr *table) { /*{{{*/
+  std::vector<LSMRecord> records;
+  base::Code ret = mem->GetRange("", "", &records);
+  if (ret != base::kOk) return ret;
+
+  uint64_t file_num = NewFileNum();
+  std::string path = GetFilePath(file_num, kLSMTableFileSuffix);
+  SSTableBuilder builder(option_, kSSTCompressBlock);
+  ret = builder.Open(path, file_num);
+  if (ret != base::kOk) return ret;
+
+  std::vector<LSMRecord>::iterator records_it = records.begin();
+  for (; records_it != records.end(); ++records_it) {
+    ret = builder.Add(records_it->key, records_it->entry);
+    if (ret != base::kOk) return ret;
+  }
+
+  LSMTableMeta meta;
+  ret = builder.Finish(&meta);
+  if (ret != base::kOk) return ret;
+
+  table->reset(new SSTable());
+  return (*table)->Open(path, meta, option_);
+} /*}}}*/
+
+/**
+ * NOTE: wal of immutable memtable is removed after manifest with the new log number is written, so the
+ * memtable is in level 0 table or in wal after crash
+ */
+base::Code LSMDB::FlushImmTable() { /*{{{*/
+  MemTable *imm = NULL;
+  uint64_t imm_log_num = 0;
+  {
+    base::MutexLock ml(&bg_mu_);
+    imm = imm_;
+    imm_log_num = imm_log_num_;
+  }
+  if (imm == NULL) return base::kOk;
+
+  // NOTE: imm_ is not changed, so it's read without lock
+  SSTablePtr table;
+  base::Code ret = WriteLevel0Table(imm, &table);
+  if (ret != base::kOk) return ret;
+
+  uint64_t log_num = 0;
+  {
+    base::ReadLock rl(&mu_);
+    log_num = log_num_;
+  }
+  std::vector<std::vector<SSTablePtr> > new_levels = levels_;
+  new_levels[0].push_back(table);
+  ret = WriteManifest(new_levels, log_num);
+  if (ret != base::kOk) return ret;
+
+  {
+    base::MutexLock ml(&bg_mu_);
+    {
+      base::WriteLock wl(&mu_);
+      levels_.swap(new_levels);
+      imm_ = NULL;
+    }
+    manifest_log_num_ = log_num;
+    bg_cond_.BroadCast();
+  }
+  delete imm;
+
+  std::string log_path = GetFilePath(imm_log_num, kLSMLogFileSuffix);
+  if (unlink(log_path.c_str()) != 0) {
+    base::LOG_ERR("Failed to remove wal of lsm db, path:%s, errno:%d", log_path.c_str(), errno);
+  }
+
+  return base::kOk;
+} /*}}}*/
+
+/**
+ * NOTE: one compaction merges tables of level into level+1, and only background thread changes levels, so
+ * levels are read without lock here
+ * 1. level 0 compaction takes all level 0 tables, since they may overlap; deeper level takes one table after
+ *    compact pointer of level round robin, so all keys of level are compacted in turn
+ * 2. tables of level+1 which overlap the input tables are merged together, and the newest entry of key is kept
+ * 3. a table overlapping nothing of level+1 is moved without being rewritten
+ * 4. immutable memtable is flushed between output tables, so writes don't wait for a long compaction
+ */
+base::Code LSMDB::Compact() { /*{{{*/
+  uint32_t level = 0;
+  {
+    base::MutexLock ml(&bg_mu_);
+    if (GetCompactionScore(&level) < 1) return base::kOk;
+  }
+
+  std::vector<SSTablePtr> inputs;
+  std::string smallest;
+  std::string largest;
+  if (level == 0) {
+    inputs = levels_[0];
+    std::vector<SSTablePtr>::iterator inputs_it = inputs.begin();
+    for (; inputs_it != inputs.end(); ++inputs_it) {
+      const LSMTableMeta &meta = (*inputs_it)->GetMeta();
+      if (inputs_it == inputs.begin() || meta.smallest.compare(smallest) < 0) smallest = meta.smallest;
+      if (inputs_it == inputs.begin() || meta.largest.compare(largest) > 0) largest = meta.largest;
+    }
+  } else {
+    std::vector<SSTablePtr> &tables = levels_[level];
+    SSTablePtr picked = tables.front();
+    std::vector<SSTablePtr>::iterator tables_it = tables.begin();
+    for (; tables_it != tables.end(); ++tables_it) {
+      if ((*tables_it)->GetMeta().smallest.compare(compact_pointers_[level]) > 0) {
+        picked = *tables_it;
+        break;
+      }
+    }
+    inputs.push_back(picked);
+    smallest = picked->GetMeta().smallest;
+    largest = picked->GetMeta().largest;
+    compact_pointers_[level] = largest;
+  }
+
+  std::vector<SSTablePtr> next_inputs;
+  GetOverlappingTables(level + 1, smallest, largest, &next_inputs);
+  if (inputs.size() == 1 && next_inputs.empty()) {
+    std::vector<SSTablePtr> outputs(inputs);
+    return InstallCompaction(level, inputs, outputs);
+  }
+
+  std::vector<LSMInternalIterator *> children;
+  std::vector<SSTablePtr>::iterator inputs_it = inputs.begin();
+  for (; inputs_it != inputs.end(); ++inputs_it) {
+    children.push_back(new SSTableIterator(*inputs_it));
+  }
+  for (inputs_it = next_inputs.begin(); inputs_it != next_inputs.end(); ++inputs_it) {
+    children.push_back(new SSTableIterator(*inputs_it));
+    inputs.push_back(*inputs_it);
+  }
+  LSMMergeIterator merge_iter(children);
+
+  uint32_t output_level = level + 1;
+  SSTBlockFlag compress_flag = (output_level >= 2) ? kSSTDeepCompressBlock : kSSTCompressBlock;
+  std::vector<SSTablePtr> outputs;
+  SSTableBuilder *builder = NULL;
+  base::Code ret = merge_iter.SetFirst();
+  while (ret == base::kOk && merge_iter.Valid()) {
+    const std::string &key = merge_iter.GetKey();
+    const LSMEntry &entry = merge_iter.GetEntry();
+    if (entry.type == kLSMDelType && IsBaseLevelForKey(key, output_level)) {
+      ret = merge_iter.GoNext();
+      continue;
+    }
+
+    if (builder == NULL) {
+      uint64_t file_num = NewFileNum();
+      builder = new SSTableBuilder(option_, compress_flag);
+      ret = builder->Open(GetFilePath(file_num, kLSMTableFileSuffix), file_num);
+      if (ret != base::kOk) break;
+    }
+    ret = builder->Add(key, entry);
+    if (ret != base::kOk) break;
+
+    if (builder->GetFileSize() >= option_.target_file_size) {
+      ret = FinishTable(builder, &outputs);
+      delete builder;
+      builder = NULL;
+      if (ret != base::kOk) break;
+
+      if (IsStopping()) {
+        ret = base::kNotInit;
+        break;
+      }
+      ret = FlushImmTable();
+      if (ret != base::kOk) break;
+    }
+    ret = merge_iter.GoNext();
+  }
+
+  if (ret == base::kOk && builder != NULL) ret = FinishTable(builder, &outputs);
+  if (builder != NULL) delete builder;
+  if (ret == base::kOk) return InstallCompaction(level, inputs, outputs);
+
+  // NOTE: outputs are not in manifest, and they are removed now or by the next Init
+  std::vector<SSTablePtr>::iterator outputs_it = outputs.begin();
+  for (; outputs_it != outputs.end(); ++outputs_it) {
+    unlink(GetFilePath((*outputs_it)->GetMeta().file_num, kLSMTableFileSuffix).c_str());
+  }
+  if (ret == base::kNotInit && IsStopping()) return base::kOk;
+
+  return ret;
+} /*}}}*/
+
+base::Code LSMDB::FinishTable(SSTableBuilder *builder, std::vector<SSTablePtr> *outputs) { /*{{{*/
+  LSMTableMeta meta;
+  base::Code ret = builder->Finish(&meta);
+  if (ret != base::kOk) return ret;
+
+  SSTablePtr table(new SSTable());
+  ret = table->Open(GetFilePath(meta.file_num, kLSMTableFileSuffix), meta, option_);
+  if (ret != base::kOk) return ret;
+
+  outputs->push_back(table);
+  return base::kOk;
+} /*}}}*/
+
+/**
+ * NOTE: inputs of level and level+1 are replaced by outputs in level+1, and input files are removed after the
+ * new manifest is written; iterators still reading them keep their fds, so removing doesn't break them
+ */
+base::Code LSMDB::InstallCompaction(uint32_t level, const std::vector<SSTablePtr> &inputs,
+                                    const std::vector<SSTablePtr> &outputs) { /*{{{*/
+  std::map<uint64_t, bool> input_nums;
+  std::vector<SSTablePtr>::const_iterator tables_it = inputs.begin();
+  for (; tables_it != inputs.end(); ++tables_it) {
+    input_nums[(*tables_it)->GetMeta().file_num] = true;
+  }
+  std::map<uint64_t, bool> output_nums;
+  for (tables_it = outputs.begin(); tables_it != outputs.end(); ++tables_it) {
+    output_nums[(*tables_it)->GetMeta().file_num] = true;
+  }
+
+  // NOTE: level 0 may have new tables flushed during compaction, so levels are copied from the current ones
+  std::vector<std::vector<SSTablePtr> > new_levels(kLSMLevelsNum);
+  for (uint32_t i = 0; i < kLSMLevelsNum; ++i) {
+    for (tables_it = levels_[i].begin(); tables_it != levels_[i].end(); ++tables_it) {
+      if ((i == level || i == level + 1) && input_nums.find((*tables_it)->GetMeta().file_num) != input_nums.end()) {
+        continue;
+      }
+      new_levels[i].push_back(*tables_it);
+    }
+  }
+  new_levels[level + 1].insert(new_levels[level + 1].end(), outputs.begin(), outputs.end());
+  std::sort(new_levels[level + 1].begin(), new_levels[level + 1].end(), TableLessBySmallest);
+
+  base::Code ret = WriteManifest(new_levels, manifest_log_num_);
+  if (ret != base::kOk) return ret;
+
+  {
+    base::MutexLock ml(&bg_mu_);
+    {
+      base::WriteLock wl(&mu_);
+      levels_.swap(new_levels);
+    }
+    bg_cond_.BroadCast();
+  }
+
+  for (tables_it = inputs.begin(); tables_it != inputs.end(); ++tables_it) {
+    uint64_t file_num = (*tables_it)->GetMeta().file_num;
+    if (output_nums.find(file_num) != output_nums.end()) continue;
+
+    std::string path = GetFilePath(file_num, kLSMTableFileSuffix);
+    if (unlink(path.c_str()) != 0) {
+      base::LOG_ERR("Failed to remove table of lsm db, path:%s, errno:%d", path.c_str(), errno);
+    }
+  }
+
+  return base::kOk;
+} /*}}}*/
+
+void LSMDB::GetOverlappingTables(uint32_t level, const std::string &smallest, const std::string &largest,
+                                 std::vector<SSTablePtr> *tables) { /*{{{*/
+  tables->clear();
+  if (level >= kLSMLevelsNum) return;
+
+  std::vector<SSTablePtr>::iterator tables_it = levels_[level].begin();
+  for (; tables_it != levels_[level].end(); ++tables_it) {
+    const LSMTableMeta &meta = (*tables_it)->GetMeta();
+    if (meta.largest.compare(smallest) < 0 || meta.smallest.compare(largest) > 0) continue;
+    tables->push_back(*tables_it);
+  }
+} /*}}}*/
+
+// NOTE: delete record can be dropped if no level deeper than level has the key
+bool LSMDB::IsBaseLevelForKey(const std::string &key, uint32_t level) { /*{{{*/
+  for (uint32_t i = level + 1; i < kLSMLevelsNum; ++i) {
+    const std::vector<SSTablePtr> &tables = levels_[i];
+    std::vector<SSTablePtr>::const_iterator tables_it =
+        std::lower_bound(tables.begin(), tables.end(), key, TableLessThanKey);
+    if (tables_it != tables.end() && (*tables_it)->GetMeta().smallest.compare(key) <= 0) return false;
+  }
+
+  return true;
+} /*}}}*/
+
+}  // namespace store
@@ -0,0 +1,190 @@
+// Copyright (c) 2015 The CSUTIL Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef STORE_DB_LSM_LSM_DB_H_
+#define STORE_DB_LSM_LSM_DB_H_
+
+#include <string>
+#include <vector>
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "base/group_commit.h"
+#include "base/mutex.h"
+#include "base/status.h"
+#include "store/db/include/db_base.h"
+#include "store/db/lsm/src/lsm_iterator.h"
+#include "store/db/lsm/src/mem_table.h"
+#include "store/db/lsm/src/sst_table.h"
+#include "store/db/lsm/src/wal.h"
+
+namespace store {
+
+const uint32_t kLSMLevelsNum = 7;
+const uint32_t kLSMMaxKeySize = 64 * 1024;
+const uint32_t kLSMMaxValueSize = 10 * 1024 * 1024;
+
+// Note: files in directory: MANIFEST, 00000000000000001.wal, 00000000000000002.sst, ...
+//       and number of wal and sstable files is allocated from the same counter
+const std::string kLSMManifestFileName = "MANIFEST";
+const std::string kLSMTmpFileSuffix = ".tmp";
+const std::string kLSMLogFileSuffix = ".wal";
+const std::string kLSMTableFileSuffix = ".sst";
+const int kLSMFileNumLen = 17;
+
+// Note: manifest is |crc|size|payload|, and payload is |next_file_num|last_seq|log_num|tables_num|table|...|,
+//       table is |level|file_num|file_size|entries_num|smallest_size|smallest|largest_size|largest|
+const uint32_t kLSMManifestHeadSize = 2 * sizeof(uint32_t);
+
+/**
+ * NOTE: LSMDB is an ordered db of memtable, wal and leveled sstables, so keys are also read by range
+ * 1. writes are appended to wal and put into memtable, which is flushed into a level 0 table once it's full
+ * 2. level 0 tables may overlap, and tables of deeper levels don't; background thread compacts level 0 into
+ *    level 1 by number of tables, and level n into level n+1 by bytes, which is ten times for every level
+ * 3. sstable has block index and bloom filter, so Get of a key not in table reads no block mostly
+ * 4. manifest has tables of levels, and it's rewritten and renamed once tables are changed
+ */
+class LSMDB : public DBBase {
+ public:
+  LSMDB();
+  virtual ~LSMDB();
+
+ public:
+  /**
+   * NOTE: "Put" operation will set <key, value> into data base
+   * 1. version of key is the sequence of its last write, which is larger than versions of all former writes
+   * 2. if version is not -1, value is only set if it equals the current version, and 0 means key doesn't exist
+   * 3. Put with version -1 doesn't read the old value, which is the fast path
+   */
+  virtual base::Code Put(const std::string &key, const std::string &value, int64_t version = -1);
+
+  virtual base::Code Get(const std::string &key, std::string *value, int64_t *version = NULL);
+
+  /**
+   * NOTE: "Del" operation writes a delete record of key, and kNotFound is returned if key doesn't exist
+   * 1. if version is not -1, key is only deleted if it equals the current version
+   * 2. delete record is dropped by compaction once no deeper level has the key
+   */
+  virtual base::Code Del(const std::string &key, int64_t version = -1);
+
+  /**
+   * NOTE: "Write" operation applies operations of batch together
+   * 1. batch is one wal record, so it's replayed completely or not at all after crash
+   * 2. operations of batch get increasing sequences, and Gets see all of them after Write returns
+   */
+  virtual base::Code Write(const WriteBatch &batch);
+
+  // NOTE: keys are looked up in order of key under one read lock, so blocks of the same table are near
+  virtual base::Code MultiGet(const std::vector<std::string> &keys, std::vector<std::string> *values,
+                              std::vector<base::Code> *rets, std::vector<int64_t> *versions = NULL);
+
+ public:
+  virtual base::Code Init(const std::string &dir_path);
+
+  virtual base::Code GetStatus(DBStatusInfo *status_info);
+
+  // NOTE: should be called before Init
+  void SetOption(const LSMOption &option) { option_ = option; }
+
+  // NOTE: should be called before Init, and interval_ms is only used by kSyncInterval
+  void SetSyncPolicy(SyncPolicy policy, uint32_t interval_ms = kDefaultSyncIntervalMs) { /*{{{*/
+    sync_policy_ = policy;
+    sync_interval_ms_ = interval_ms;
+  } /*}}}*/
+
+  /**
+   * NOTE: iterator of keys in [start, end), and empty end means no upper bound
+   * 1. it's a snapshot: records of memtable in range are copied, and tables are kept until it's deleted
+   * 2. SetFirst or Seek should be called before reading it, and it should be deleted by caller
+   */
+  base::Code NewIterator(const std::string &start, const std::string &end, LSMIterator **iter);
+
+  // NOTE: iterator of keys starting with prefix
+  base::Code NewPrefixIterator(const std::string &prefix, LSMIterator **iter);
+
+  // NOTE: memtable is flushed into a level 0 table, and it returns after the table is written
+  base::Code Flush();
+
+  // NOTE: whether any level needs compaction, which is done by background thread
+  bool NeedCompaction();
+
+  uint32_t GetLevelFilesNum(uint32_t level);
+
+ private:
+  base::Code Destroy();
+  base::Code StopThreads();
+
+  base::Code Open();  // NOTE: memtable, recovery and threads of Init, and Init drops all of them if it fails
+  base::Code Recover();
+  base::Code ReadManifest();
+  base::Code WriteManifest(const std::vector<std::vector<SSTablePtr> > &levels, uint64_t log_num);
+  base::Code ReplayWAL(const std::string &path);
+  base::Code RemoveObsoleteFiles(const std::vector<std::string> &files_name);
+
+  std::string GetFilePath(uint64_t file_num, const std::string &suffix);
+  bool ParseFileName(const std::string &file_name, uint64_t *file_num, std::string *suffix);
+  uint64_t NewFileNum();
+
+  base::Code WriteBatchValues(const WriteBatch &batch, uint64_t *seq);
+  base::Code EncodeBatch(const WriteBatch &batch, uint64_t first_seq, std::string *payload);
+  base::Code MakeRoomForWrite(bool force);    // NOTE: write_mu_ should be held
+  base::Code SwitchMemTable();                // NOTE: write_mu_ and bg_mu_ should be held
+  base::Code LookUp(const std::string &key, LSMEntry *entry);  // NOTE: mu_ should be held
+
+  // NOTE: only wal is synced, since sstables and manifest are synced once they're written
+  base::Code Sync();
+  static void *SyncThreadAction(void *param);
+  void SyncLoop();
+
+  static void *BGThreadAction(void *param);
+  void BGLoop();
+  bool IsStopping();
+  double GetCompactionScore(uint32_t *level);  // NOTE: bg_mu_ should be held, or called by background thread
+  uint64_t GetMaxBytesForLevel(uint32_t level);
+  base::Code FlushImmTable();
+  base::Code WriteLevel0Table(MemTable *mem, SSTablePtr *table);
+  base::Code Compact();
+  base::Code FinishTable(SSTableBuilder *builder, std::vector<SSTablePtr> *outputs);
+  base::Code InstallCompaction(uint32_t level, const std::vector<SSTablePtr> &inputs,
+                               const std::vector<SSTablePtr> &outputs);
+  void GetOverlappingTables(uint32_t level, const std::string &smallest, const std::string &largest,
+                            std::vector<SSTablePtr> *tables);
+  bool IsBaseLevelForKey(const std::string &key, uint32_t level);
+
+ private:
+  std::string dir_path_;
+  LSMOption option_;
+
+  MemTable *mem_;
+  MemTable *imm_;  // Memtable being flushed, only one at the same time
+  WALWriter *wal_;
+  uint64_t log_num_;       // Number of wal of mem_
+  uint64_t imm_log_num_;   // Number of wal of imm_, which is removed once imm_ is flushed
+  uint64_t manifest_log_num_;  // Wals from it are replayed by Init, which is only changed by flush
+  uint64_t last_seq_;
+  uint64_t next_file_num_;
+  std::vector<std::vector<SSTablePtr> > levels_;  // Level 0 is sorted by file number, others by key
+  std::vector<std::string> compact_pointers_;     // Largest key of the last compacted table of every level
+
+  base::RWMutex mu_;      // Protect memtables, wal and levels, which are read by Get and iterators
+  base::Mutex write_mu_;  // Only one Write appends wal at the same time
+  base::Mutex bg_mu_;     // Protect imm_, changes of levels, next_file_num_, bg_error_ and is_stop_
+  base::Cond bg_cond_;    // Background thread waits for work, and writers wait for flush and compaction
+  base::Code bg_error_;   // Error of background thread, and writes fail after it
+  bool is_stop_;
+  pthread_t bg_tid_;
+  bool is_bg_thread_running_;
+
+  SyncPolicy sync_policy_;
+  uint32_t sync_interval_ms_;
+  bool is_dirty_;  // There are writes after the last sync
+  base::GroupCommit group_commit_;
+  pthread_t sync_tid_;
+  bool is_sync_thread_running_;
+};
+
+}  // namespace store
+
+#endif
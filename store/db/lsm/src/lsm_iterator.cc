@@ -0,0 +1,168 @@
+// Copyright (c) 2015 The CSUTIL Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <algorithm>
+
+#include "lsm_iterator.h"
+
+namespace store {
+
+static bool RecordLessThanKey(const LSMRecord &record, const std::string &key) { /*{{{*/
+  return record.key.compare(key) < 0;
+} /*}}}*/
+
+LSMVectorIterator::LSMVectorIterator(std::vector<LSMRecord> *records) : records_(), pos_(0) { /*{{{*/
+  if (records != NULL) records_.swap(*records);
+  pos_ = records_.size();
+} /*}}}*/
+
+base::Code LSMVectorIterator::SetFirst() { /*{{{*/
+  pos_ = 0;
+  return base::kOk;
+} /*}}}*/
+
+base::Code LSMVectorIterator::Seek(const std::string &key) { /*{{{*/
+  pos_ = std::lower_bound(records_.begin(), records_.end(), key, RecordLessThanKey) - records_.begin();
+  return base::kOk;
+} /*}}}*/
+
+base::Code LSMVectorIterator::GoNext() { /*{{{*/
+  if (!Valid()) return base::kInvalidParam;
+  ++pos_;
+  return base::kOk;
+} /*}}}*/
+
+LSMMergeIterator::LSMMergeIterator(const std::vector<LSMInternalIterator *> &children)
+    : children_(children), cur_(NULL) { /*{{{*/
+} /*}}}*/
+
+LSMMergeIterator::~LSMMergeIterator() { /*{{{*/
+  std::vector<LSMInternalIterator *>::iterator it = children_.begin();
+  for (; it != children_.end(); ++it) {
+    delete *it;
+  }
+  children_.clear();
+} /*}}}*/
+
+base::Code LSMMergeIterator::SetFirst() { /*{{{*/
+  cur_ = NULL;
+  std::vector<LSMInternalIterator *>::iterator it = children_.begin();
+  for (; it != children_.end(); ++it) {
+    base::Code ret = (*it)->SetFirst();
+    if (ret != base::kOk) return ret;
+  }
+
+  FindCurrent();
+  return base::kOk;
+} /*}}}*/
+
+base::Code LSMMergeIterator::Seek(const std::string &key) { /*{{{*/
+  cur_ = NULL;
+  std::vector<LSMInternalIterator *>::iterator it = children_.begin();
+  for (; it != children_.end(); ++it) {
+    base::Code ret = (*it)->Seek(key);
+    if (ret != base::kOk) return ret;
+  }
+
+  FindCurrent();
+  return base::kOk;
+} /*}}}*/
+
+base::Code LSMMergeIterator::GoNext() { /*{{{*/
+  if (!Valid()) return base::kInvalidParam;
+
+  // NOTE: older entries of the same key in other children are skipped together
+  std::string cur_key = cur_->GetKey();
+  cur_ = NULL;
+  std::vector<LSMInternalIterator *>::iterator it = children_.begin();
+  for (; it != children_.end(); ++it) {
+    if (!(*it)->Valid() || (*it)->GetKey() != cur_key) continue;
+    base::Code ret = (*it)->GoNext();
+    if (ret != base::kOk) return ret;
+  }
+
+  FindCurrent();
+  return base::kOk;
+} /*}}}*/
+
+void LSMMergeIterator::FindCurrent() { /*{{{*/
+  cur_ = NULL;
+  std::vector<LSMInternalIterator *>::iterator it = children_.begin();
+  for (; it != children_.end(); ++it) {
+    if (!(*it)->Valid()) continue;
+    if (cur_ == NULL) {
+      cur_ = *it;
+      continue;
+    }
+
+    int r = (*it)->GetKey().compare(cur_->GetKey());
+    if (r < 0 || (r == 0 && (*it)->GetEntry().seq > cur_->GetEntry().seq)) cur_ = *it;
+  }
+} /*}}}*/
+
+LSMIterator::LSMIterator(LSMInternalIterator *iter, const std::string &start, const std::string &end)
+    : iter_(iter), start_(start), end_(end) { /*{{{*/
+} /*}}}*/
+
+LSMIterator::~LSMIterator() { /*{{{*/
+  if (iter_ != NULL) {
+    delete iter_;
+    iter_ = NULL;
+  }
+} /*}}}*/
+
+base::Code LSMIterator::SetFirst() { /*{{{*/ return Seek(start_); } /*}}}*/
+
+base::Code LSMIterator::Seek(const std::string &key) { /*{{{*/
+  if (iter_ == NULL) return base::kNotInit;
+
+  base::Code ret = iter_->Seek(key.compare(start_) < 0 ? start_ : key);
+  if (ret != base::kOk) return ret;
+
+  return SkipDeleted();
+} /*}}}*/
+
+base::Code LSMIterator::GoNext() { /*{{{*/
+  if (!Valid()) return base::kInvalidParam;
+
+  base::Code ret = iter_->GoNext();
+  if (ret != base::kOk) return ret;
+
+  return SkipDeleted();
+} /*}}}*/
+
+bool LSMIterator::Valid() { /*{{{*/
+  if (iter_ == NULL || !iter_->Valid()) return false;
+  if (!end_.empty() && iter_->GetKey().compare(end_) >= 0) return false;
+  return true;
+} /*}}}*/
+
+base::Code LSMIterator::GetKey(std::string *key) { /*{{{*/
+  if (key == NULL || !Valid()) return base::kInvalidParam;
+  *key = iter_->GetKey();
+  return base::kOk;
+} /*}}}*/
+
+base::Code LSMIterator::GetValue(std::string *value) { /*{{{*/
+  if (value == NULL || !Valid()) return base::kInvalidParam;
+  *value = iter_->GetEntry().value;
+  return base::kOk;
+} /*}}}*/
+
+base::Code LSMIterator::GetVersion(int64_t *version) { /*{{{*/
+  if (version == NULL || !Valid()) return base::kInvalidParam;
+  *version = (int64_t)iter_->GetEntry().seq;
+  return base::kOk;
+} /*}}}*/
+
+base::Code LSMIterator::SkipDeleted() { /*{{{*/
+  while (Valid() && iter_->GetEntry().type == kLSMDelType) {
+    base::Code ret = iter_->GoNext();
+    if (ret != base::kOk) return ret;
+  }
+
+  return base::kOk;
+} /*}}}*/
+
+}  // namespace store
@@ -0,0 +1,128 @@
+// Copyright (c) 2015 The CSUTIL Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef STORE_DB_LSM_LSM_ITERATOR_H_
+#define STORE_DB_LSM_LSM_ITERATOR_H_
+
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include "base/status.h"
+#include "store/db/lsm/src/mem_table.h"
+
+namespace store {
+
+/**
+ * NOTE: LSMInternalIterator walks records of one source by key, including delete records
+ * 1. Seek positions at the first record whose key is not less than key
+ * 2. if reading fails, Seek or GoNext returns the error and the iterator becomes invalid
+ * 3. GetKey and GetEntry should only be called while Valid
+ */
+class LSMInternalIterator { /*{{{*/
+ public:
+  LSMInternalIterator() {}
+  virtual ~LSMInternalIterator() {}
+
+ public:
+  virtual base::Code SetFirst() = 0;
+  virtual base::Code Seek(const std::string &key) = 0;
+  virtual base::Code GoNext() = 0;
+  virtual bool Valid() = 0;
+  virtual const std::string &GetKey() = 0;
+  virtual const LSMEntry &GetEntry() = 0;
+
+ private:
+  LSMInternalIterator(const LSMInternalIterator &);
+  LSMInternalIterator &operator=(const LSMInternalIterator &);
+}; /*}}}*/
+
+// NOTE: iterator of records copied from memtable, so it's not changed by later writes
+class LSMVectorIterator : public LSMInternalIterator { /*{{{*/
+ public:
+  // NOTE: records are swapped into the iterator
+  explicit LSMVectorIterator(std::vector<LSMRecord> *records);
+  virtual ~LSMVectorIterator() {}
+
+ public:
+  virtual base::Code SetFirst();
+  virtual base::Code Seek(const std::string &key);
+  virtual base::Code GoNext();
+  virtual bool Valid() { return pos_ < records_.size(); }
+  virtual const std::string &GetKey() { return records_[pos_].key; }
+  virtual const LSMEntry &GetEntry() { return records_[pos_].entry; }
+
+ private:
+  std::vector<LSMRecord> records_;
+  size_t pos_;
+}; /*}}}*/
+
+/**
+ * NOTE: LSMMergeIterator merges children into one sorted sequence, and children are owned by it
+ * 1. if more than one child has the same key, only the entry with the largest seq is returned
+ * 2. children are compared one by one, which is fast enough for the number of tables of a compaction or a read
+ */
+class LSMMergeIterator : public LSMInternalIterator { /*{{{*/
+ public:
+  explicit LSMMergeIterator(const std::vector<LSMInternalIterator *> &children);
+  virtual ~LSMMergeIterator();
+
+ public:
+  virtual base::Code SetFirst();
+  virtual base::Code Seek(const std::string &key);
+  virtual base::Code GoNext();
+  virtual bool Valid() { return cur_ != NULL; }
+  virtual const std::string &GetKey() { return cur_->GetKey(); }
+  virtual const LSMEntry &GetEntry() { return cur_->GetEntry(); }
+
+ private:
+  void FindCurrent();
+
+ private:
+  std::vector<LSMInternalIterator *> children_;
+  LSMInternalIterator *cur_;
+}; /*}}}*/
+
+/**
+ * NOTE: LSMIterator is the iterator returned by LSMDB, which walks keys in [start, end)
+ * 1. empty end means no upper bound, and delete records are skipped
+ * 2. it's a snapshot of db when it's created, and tables it reads are kept until it's deleted
+ * 3. it's not thread safe, and should be deleted by caller
+ */
+class LSMIterator { /*{{{*/
+ public:
+  // NOTE: iter is owned by LSMIterator
+  LSMIterator(LSMInternalIterator *iter, const std::string &start, const std::string &end);
+  ~LSMIterator();
+
+ public:
+  // NOTE: same as Seek(start)
+  base::Code SetFirst();
+
+  // NOTE: key less than start is the same as start
+  base::Code Seek(const std::string &key);
+  base::Code GoNext();
+  bool Valid();
+
+  base::Code GetKey(std::string *key);
+  base::Code GetValue(std::string *value);
+  base::Code GetVersion(int64_t *version);
+
+ private:
+  base::Code SkipDeleted();
+
+ private:
+  LSMIterator(const LSMIterator &);
+  LSMIterator &operator=(const LSMIterator &);
+
+ private:
+  LSMInternalIterator *iter_;
+  std::string start_;
+  std::string end_;
+}; /*}}}*/
+
+}  // namespace store
+
+#endif
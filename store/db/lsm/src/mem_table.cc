@@ -0,0 +1,59 @@
+// Copyright (c) 2015 The CSUTIL Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "mem_table.h"
+
+namespace store {
+
+const uint32_t kMemTableNodeBytes = 64;  // Approximate bytes of skip list node and entry besides key and value
+
+MemTable::MemTable() : table_(), bytes_(0), count_(0) { /*{{{*/ } /*}}}*/
+
+MemTable::~MemTable() { /*{{{*/ } /*}}}*/
+
+base::Code MemTable::Init() { /*{{{*/ return table_.Init(); } /*}}}*/
+
+base::Code MemTable::Put(const std::string &key, const LSMEntry &entry) { /*{{{*/
+  base::Code ret = table_.Put(key, entry);
+  if (ret == base::kExist) {
+    // NOTE: skip list doesn't replace value, so the old node is removed first
+    ret = table_.Del(key);
+    if (ret != base::kOk) return ret;
+    ret = table_.Put(key, entry);
+  } else if (ret == base::kOk) {
+    ++count_;
+  }
+  if (ret != base::kOk) return ret;
+
+  bytes_ += key.size() + entry.value.size() + kMemTableNodeBytes;
+  return base::kOk;
+} /*}}}*/
+
+base::Code MemTable::Get(const std::string &key, LSMEntry *entry) { /*{{{*/
+  if (entry == NULL) return base::kInvalidParam;
+
+  return table_.Get(key, entry);
+} /*}}}*/
+
+base::Code MemTable::GetRange(const std::string &start, const std::string &end,
+                              std::vector<LSMRecord> *records) { /*{{{*/
+  if (records == NULL) return base::kInvalidParam;
+  records->clear();
+
+  Table::Iterator iter(&table_);
+  base::Code ret = iter.Seek(start);
+  if (ret != base::kOk) return ret;
+
+  for (; iter.Valid(); iter.GoNext()) {
+    LSMRecord record;
+    iter.GetKey(&(record.key));
+    if (!end.empty() && record.key.compare(end) >= 0) break;
+    iter.GetValue(&(record.entry));
+    records->push_back(record);
+  }
+
+  return base::kOk;
+} /*}}}*/
+
+}  // namespace store
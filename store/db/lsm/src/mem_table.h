@@ -0,0 +1,85 @@
+// Copyright (c) 2015 The CSUTIL Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef STORE_DB_LSM_MEM_TABLE_H_
+#define STORE_DB_LSM_MEM_TABLE_H_
+
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include "base/skip_list.h"
+#include "base/status.h"
+
+namespace store {
+
+enum LSMEntryType {
+  kLSMPutType = 1,
+  kLSMDelType = 2,  // Delete record, which hides records of the key in older tables
+};
+
+/**
+ * NOTE: value of a key in memtable and sstable
+ * 1. seq is the sequence of the write, which is also returned as version of the key
+ * 2. the record with the larger seq is the newer one if the same key is in more than one table
+ */
+struct LSMEntry { /*{{{*/
+  uint64_t seq;
+  uint8_t type;
+  std::string value;
+
+  LSMEntry() : seq(0), type(kLSMPutType), value() {}
+}; /*}}}*/
+
+struct LSMRecord { /*{{{*/
+  std::string key;
+  LSMEntry entry;
+}; /*}}}*/
+
+class LSMKeyCompare { /*{{{*/
+ public:
+  int operator()(const std::string &first, const std::string &second) { return first.compare(second); }
+}; /*}}}*/
+
+/**
+ * NOTE: MemTable keeps the newest entry of keys written after the last flush, which is sorted by key
+ * 1. it's not thread safe, writes of the active memtable are protected by lock of LSMDB
+ * 2. once it's full it becomes immutable, and is only read until it's flushed into a level 0 table
+ */
+class MemTable { /*{{{*/
+ public:
+  typedef base::SkipList<std::string, LSMEntry, LSMKeyCompare> Table;
+
+ public:
+  MemTable();
+  ~MemTable();
+
+ public:
+  base::Code Init();
+
+  // NOTE: entry of the key is replaced if it exists
+  base::Code Put(const std::string &key, const LSMEntry &entry);
+  base::Code Get(const std::string &key, LSMEntry *entry);
+
+  // NOTE: records in [start, end), and empty end means no upper bound
+  base::Code GetRange(const std::string &start, const std::string &end, std::vector<LSMRecord> *records);
+
+  // NOTE: bytes of all entries put, including the replaced ones which are freed, same as memory of arena
+  uint64_t GetBytes() const { return bytes_; }
+  uint64_t GetCount() const { return count_; }
+
+ private:
+  MemTable(const MemTable &);
+  MemTable &operator=(const MemTable &);
+
+ private:
+  Table table_;
+  uint64_t bytes_;
+  uint64_t count_;
+}; /*}}}*/
+
+}  // namespace store
+
+#endif
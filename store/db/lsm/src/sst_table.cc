@@ -0,0 +1,516 @@
+// Copyright (c) 2015 The CSUTIL Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "base/coding.h"
+#include "base/file_util.h"
+#include "base/hash.h"
+
+#include "sst_table.h"
+
+namespace store {
+
+const uint32_t kSSTMaxBloomHashNum = 30;
+
+static void EncodeEntry(const std::string &key, const LSMEntry &entry, std::string *out) { /*{{{*/
+  base::EncodeFixed32(key.size(), out);
+  base::EncodeFixed32(entry.value.size(), out);
+  base::EncodeFixed64(entry.seq, out);
+  out->append(1, (char)entry.type);
+  out->append(key);
+  out->append(entry.value);
+} /*}}}*/
+
+/**
+ * NOTE: entry at pos of block is decoded, and pos is moved to the next entry
+ * 1. key is compared before value is copied, so Get doesn't copy values of other keys
+ */
+static base::Code DecodeEntryHead(const std::string &block, size_t pos, uint32_t *key_size, uint32_t *value_size,
+                                  uint64_t *seq, uint8_t *type) { /*{{{*/
+  if (pos + kSSTEntryHeadSize > block.size()) return base::kDataValueError;
+
+  base::DecodeFixed32(block.substr(pos, sizeof(uint32_t)), key_size);
+  pos += sizeof(uint32_t);
+  base::DecodeFixed32(block.substr(pos, sizeof(uint32_t)), value_size);
+  pos += sizeof(uint32_t);
+  base::DecodeFixed64(block.substr(pos, sizeof(uint64_t)), seq);
+  pos += sizeof(uint64_t);
+  *type = (uint8_t)block[pos];
+  pos += sizeof(uint8_t);
+
+  if (pos + (uint64_t)*key_size + *value_size > block.size()) return base::kDataValueError;
+  if (*type != kLSMPutType && *type != kLSMDelType) return base::kDataValueError;
+
+  return base::kOk;
+} /*}}}*/
+
+static bool HandleLessThanKey(const SSTBlockHandle &handle, const std::string &key) { /*{{{*/
+  return handle.last_key.compare(key) < 0;
+} /*}}}*/
+
+static bool RecordLessThanKey(const LSMRecord &record, const std::string &key) { /*{{{*/
+  return record.key.compare(key) < 0;
+} /*}}}*/
+
+static bool TableLessThanKey(const SSTablePtr &table, const std::string &key) { /*{{{*/
+  return table->GetMeta().largest.compare(key) < 0;
+} /*}}}*/
+
+SSTableBuilder::SSTableBuilder(const LSMOption &option, SSTBlockFlag compress_flag)
+    : option_(option),
+      compress_flag_(compress_flag),
+      path_(),
+      fd_(-1),
+      offset_(0),
+      block_(),
+      index_(),
+      keys_(),
+      meta_(),
+      is_finished_(false) { /*{{{*/
+} /*}}}*/
+
+SSTableBuilder::~SSTableBuilder() { /*{{{*/
+  if (fd_ >= 0) {
+    close(fd_);
+    fd_ = -1;
+  }
+
+  if (!is_finished_ && !path_.empty()) unlink(path_.c_str());
+} /*}}}*/
+
+base::Code SSTableBuilder::Open(const std::string &path, uint64_t file_num) { /*{{{*/
+  if (path.empty() || fd_ >= 0) return base::kInvalidParam;
+
+  fd_ = open(path.c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0644);
+  if (fd_ < 0) return base::kOpenFileFailed;
+  path_ = path;
+  meta_.file_num = file_num;
+
+  return base::kOk;
+} /*}}}*/
+
+base::Code SSTableBuilder::Add(const std::string &key, const LSMEntry &entry) { /*{{{*/
+  if (fd_ < 0 || is_finished_) return base::kNotInit;
+  if (meta_.entries_num > 0 && key.compare(meta_.largest) <= 0) return base::kInvalidParam;
+
+  EncodeEntry(key, entry, &block_);
+  keys_.push_back(key);
+  if (meta_.entries_num == 0) meta_.smallest = key;
+  meta_.largest = key;
+  ++meta_.entries_num;
+
+  if (block_.size() >= option_.block_size) return FlushBlock();
+  return base::kOk;
+} /*}}}*/
+
+base::Code SSTableBuilder::FlushBlock() { /*{{{*/
+  if (block_.empty()) return base::kOk;
+
+  SSTBlockHandle handle;
+  handle.last_key = meta_.largest;
+  handle.offset = offset_;
+  base::Code ret = WriteBlock(block_, compress_flag_, &(handle.size));
+  if (ret != base::kOk) return ret;
+
+  index_.push_back(handle);
+  block_.clear();
+  return base::kOk;
+} /*}}}*/
+
+base::Code SSTableBuilder::WriteBlock(const std::string &payload, SSTBlockFlag flag, uint64_t *size) { /*{{{*/
+  base::BaseCompress *compress = NULL;
+  if (flag == kSSTCompressBlock) compress = option_.compress;
+  if (flag == kSSTDeepCompressBlock) compress = option_.deep_compress;
+
+  std::string block;
+  uint8_t block_flag = kSSTRawBlock;
+  if (compress != NULL && compress->Compress(payload, &block) == base::kOk && block.size() < payload.size()) {
+    block_flag = flag;
+  } else {
+    block = payload;
+  }
+  uint32_t crc = base::CRC32(block.data(), (int)block.size());
+  block.append(1, (char)block_flag);
+  base::EncodeFixed32(crc, &block);
+
+  base::Code ret = base::WriteAt(fd_, offset_, block.data(), block.size());
+  if (ret != base::kOk) return ret;
+  offset_ += block.size();
+  *size = block.size();
+
+  return base::kOk;
+} /*}}}*/
+
+/**
+ * NOTE: bloom filter is built here since the number of keys is known now, and hash number is bits_per_key * ln2,
+ * which has the lowest false positive rate; bloom_bits_per_key of 0 means no filter
+ */
+base::Code SSTableBuilder::Finish(LSMTableMeta *meta) { /*{{{*/
+  if (meta == NULL) return base::kInvalidParam;
+  if (fd_ < 0 || is_finished_) return base::kNotInit;
+  if (meta_.entries_num == 0) return base::kInvalidParam;
+
+  base::Code ret = FlushBlock();
+  if (ret != base::kOk) return ret;
+
+  std::string filter;
+  uint32_t bits_per_key = option_.bloom_bits_per_key;
+  uint32_t keys_num = (bits_per_key == 0) ? 0 : (uint32_t)keys_.size();
+  uint32_t hash_num = bits_per_key * 69 / 100;
+  if (hash_num < 1) hash_num = 1;
+  if (hash_num > kSSTMaxBloomHashNum) hash_num = kSSTMaxBloomHashNum;
+  base::EncodeFixed32(bits_per_key, &filter);
+  base::EncodeFixed32(keys_num, &filter);
+  base::EncodeFixed32(hash_num, &filter);
+  if (keys_num > 0) {
+    base::BloomFilter bloom(bits_per_key, keys_num, hash_num);
+    ret = bloom.Init();
+    if (ret != base::kOk) return ret;
+    std::vector<std::string>::iterator keys_it = keys_.begin();
+    for (; keys_it != keys_.end(); ++keys_it) {
+      bloom.Put(*keys_it);
+    }
+    std::string bloom_bytes;
+    ret = bloom.GetBytesStr(&bloom_bytes);
+    if (ret != base::kOk) return ret;
+    filter.append(bloom_bytes);
+  }
+  std::vector<std::string>().swap(keys_);
+
+  uint64_t filter_offset = offset_;
+  uint64_t filter_size = 0;
+  ret = WriteBlock(filter, kSSTRawBlock, &filter_size);
+  if (ret != base::kOk) return ret;
+
+  std::string index;
+  std::vector<SSTBlockHandle>::iterator index_it = index_.begin();
+  for (; index_it != index_.end(); ++index_it) {
+    base::EncodeFixed32(index_it->last_key.size(), &index);
+    index.append(index_it->last_key);
+    base::EncodeFixed64(index_it->offset, &index);
+    base::EncodeFixed64(index_it->size, &index);
+  }
+  uint64_t index_offset = offset_;
+  uint64_t index_size = 0;
+  ret = WriteBlock(index, kSSTRawBlock, &index_size);
+  if (ret != base::kOk) return ret;
+
+  std::string footer;
+  base::EncodeFixed64(filter_offset, &footer);
+  base::EncodeFixed64(filter_size, &footer);
+  base::EncodeFixed64(index_offset, &footer);
+  base::EncodeFixed64(index_size, &footer);
+  base::EncodeFixed64(kSSTMagicNum, &footer);
+  ret = base::WriteAt(fd_, offset_, footer.data(), footer.size());
+  if (ret != base::kOk) return ret;
+  offset_ += footer.size();
+
+  if (fdatasync(fd_) != 0) return base::kWriteError;
+  close(fd_);
+  fd_ = -1;
+
+  meta_.file_size = offset_;
+  *meta = meta_;
+  is_finished_ = true;
+  return base::kOk;
+} /*}}}*/
+
+SSTable::SSTable()
+    : path_(), fd_(-1), meta_(), index_(), bloom_(NULL), compress_(NULL), deep_compress_(NULL) { /*{{{*/
+} /*}}}*/
+
+SSTable::~SSTable() { /*{{{*/
+  if (fd_ >= 0) {
+    close(fd_);
+    fd_ = -1;
+  }
+
+  if (bloom_ != NULL) {
+    delete bloom_;
+    bloom_ = NULL;
+  }
+} /*}}}*/
+
+base::Code SSTable::Open(const std::string &path, const LSMTableMeta &meta, const LSMOption &option) { /*{{{*/
+  if (path.empty() || fd_ >= 0) return base::kInvalidParam;
+
+  fd_ = open(path.c_str(), O_RDONLY);
+  if (fd_ < 0) return base::kOpenFileFailed;
+  path_ = path;
+  meta_ = meta;
+  compress_ = option.compress;
+  deep_compress_ = option.deep_compress;
+
+  uint64_t file_size = 0;
+  base::Code ret = base::GetFileSize(fd_, &file_size);
+  if (ret != base::kOk) return ret;
+  if (file_size < kSSTFooterSize || file_size != meta.file_size) return base::kDataValueError;
+
+  std::string footer(kSSTFooterSize, '\0');
+  ret = base::ReadAt(fd_, file_size - kSSTFooterSize, footer.size(), &footer[0]);
+  if (ret != base::kOk) return ret;
+
+  uint64_t nums[5] = {0};
+  for (int i = 0; i < 5; ++i) {
+    base::DecodeFixed64(footer.substr(i * sizeof(uint64_t), sizeof(uint64_t)), &(nums[i]));
+  }
+  if (nums[4] != kSSTMagicNum) return base::kDataValueError;
+
+  ret = LoadFilter(nums[0], nums[1]);
+  if (ret != base::kOk) return ret;
+
+  return LoadIndex(nums[2], nums[3]);
+} /*}}}*/
+
+base::Code SSTable::LoadFilter(uint64_t offset, uint64_t size) { /*{{{*/
+  std::string filter;
+  base::Code ret = ReadBlockData(offset, size, &filter);
+  if (ret != base::kOk) return ret;
+  if (filter.size() < 3 * sizeof(uint32_t)) return base::kDataValueError;
+
+  uint32_t bits_per_key = 0;
+  uint32_t keys_num = 0;
+  uint32_t hash_num = 0;
+  base::DecodeFixed32(filter.substr(0, sizeof(uint32_t)), &bits_per_key);
+  base::DecodeFixed32(filter.substr(sizeof(uint32_t), sizeof(uint32_t)), &keys_num);
+  base::DecodeFixed32(filter.substr(2 * sizeof(uint32_t), sizeof(uint32_t)), &hash_num);
+  if (keys_num == 0) return base::kOk;
+
+  bloom_ = new base::BloomFilter(bits_per_key, keys_num, hash_num);
+  ret = bloom_->Init();
+  if (ret != base::kOk) return ret;
+
+  return bloom_->SetBytesStr(filter.substr(3 * sizeof(uint32_t)));
+} /*}}}*/
+
+base::Code SSTable::LoadIndex(uint64_t offset, uint64_t size) { /*{{{*/
+  std::string index;
+  base::Code ret = ReadBlockData(offset, size, &index);
+  if (ret != base::kOk) return ret;
+
+  size_t pos = 0;
+  while (pos < index.size()) {
+    uint32_t key_size = 0;
+    base::DecodeFixed32(index.substr(pos, sizeof(uint32_t)), &key_size);
+    pos += sizeof(uint32_t);
+    if (pos + (uint64_t)key_size + 2 * sizeof(uint64_t) > index.size()) return base::kDataValueError;
+
+    SSTBlockHandle handle;
+    handle.last_key = index.substr(pos, key_size);
+    pos += key_size;
+    base::DecodeFixed64(index.substr(pos, sizeof(uint64_t)), &(handle.offset));
+    pos += sizeof(uint64_t);
+    base::DecodeFixed64(index.substr(pos, sizeof(uint64_t)), &(handle.size));
+    pos += sizeof(uint64_t);
+    index_.push_back(handle);
+  }
+
+  return base::kOk;
+} /*}}}*/
+
+base::Code SSTable::ReadBlockData(uint64_t offset, uint64_t size, std::string *payload) { /*{{{*/
+  if (size < kSSTBlockTrailerSize || offset + size > meta_.file_size) return base::kDataValueError;
+
+  std::string block(size, '\0');
+  base::Code ret = base::ReadAt(fd_, offset, size, &block[0]);
+  if (ret != base::kOk) return ret;
+
+  uint64_t data_size = size - kSSTBlockTrailerSize;
+  uint8_t flag = (uint8_t)block[data_size];
+  uint32_t crc = 0;
+  base::DecodeFixed32(block.substr(data_size + sizeof(uint8_t)), &crc);
+  if (base::CRC32(block.data(), (int)data_size) != crc) return base::kDataValueError;
+  block.resize(data_size);
+
+  if (flag == kSSTRawBlock) {
+    payload->swap(block);
+    return base::kOk;
+  }
+
+  base::BaseCompress *compress = (flag == kSSTCompressBlock) ? compress_ : deep_compress_;
+  if (flag > kSSTDeepCompressBlock || compress == NULL) return base::kDataValueError;
+
+  return compress->Uncompress(block, payload);
+} /*}}}*/
+
+base::Code SSTable::Get(const std::string &key, LSMEntry *entry) { /*{{{*/
+  if (entry == NULL) return base::kInvalidParam;
+  if (key.compare(meta_.smallest) < 0 || key.compare(meta_.largest) > 0) return base::kNotFound;
+
+  if (bloom_ != NULL) {
+    bool exist = false;
+    base::Code ret = bloom_->CheckExist(key, &exist);
+    if (ret != base::kOk) return ret;
+    if (!exist) return base::kNotFound;
+  }
+
+  size_t block_index = FindBlock(key);
+  if (block_index >= index_.size()) return base::kNotFound;
+
+  std::string block;
+  base::Code ret = ReadBlockData(index_[block_index].offset, index_[block_index].size, &block);
+  if (ret != base::kOk) return ret;
+
+  size_t pos = 0;
+  while (pos < block.size()) {
+    uint32_t key_size = 0;
+    uint32_t value_size = 0;
+    uint64_t seq = 0;
+    uint8_t type = 0;
+    ret = DecodeEntryHead(block, pos, &key_size, &value_size, &seq, &type);
+    if (ret != base::kOk) return ret;
+    pos += kSSTEntryHeadSize;
+
+    int r = block.compare(pos, key_size, key);
+    if (r > 0) break;
+    if (r == 0) {
+      entry->seq = seq;
+      entry->type = type;
+      entry->value.assign(block, pos + key_size, value_size);
+      return base::kOk;
+    }
+    pos += key_size + value_size;
+  }
+
+  return base::kNotFound;
+} /*}}}*/
+
+base::Code SSTable::ReadBlock(size_t index, std::vector<LSMRecord> *records) { /*{{{*/
+  if (records == NULL || index >= index_.size()) return base::kInvalidParam;
+  records->clear();
+
+  std::string block;
+  base::Code ret = ReadBlockData(index_[index].offset, index_[index].size, &block);
+  if (ret != base::kOk) return ret;
+
+  size_t pos = 0;
+  while (pos < block.size()) {
+    uint32_t key_size = 0;
+    uint32_t value_size = 0;
+    LSMRecord record;
+    ret = DecodeEntryHead(block, pos, &key_size, &value_size, &(record.entry.seq), &(record.entry.type));
+    if (ret != base::kOk) return ret;
+    pos += kSSTEntryHeadSize;
+
+    record.key.assign(block, pos, key_size);
+    pos += key_size;
+    record.entry.value.assign(block, pos, value_size);
+    pos += value_size;
+    records->push_back(record);
+  }
+
+  return base::kOk;
+} /*}}}*/
+
+size_t SSTable::FindBlock(const std::string &key) const { /*{{{*/
+  return std::lower_bound(index_.begin(), index_.end(), key, HandleLessThanKey) - index_.begin();
+} /*}}}*/
+
+SSTableIterator::SSTableIterator(const SSTablePtr &table)
+    : table_(table), block_index_(0), records_(), pos_(0) { /*{{{*/
+} /*}}}*/
+
+base::Code SSTableIterator::SetFirst() { /*{{{*/ return LoadBlock(0); } /*}}}*/
+
+base::Code SSTableIterator::Seek(const std::string &key) { /*{{{*/
+  base::Code ret = LoadBlock(table_->FindBlock(key));
+  if (ret != base::kOk) return ret;
+
+  pos_ = std::lower_bound(records_.begin(), records_.end(), key, RecordLessThanKey) - records_.begin();
+  if (pos_ < records_.size()) return base::kOk;
+
+  return LoadBlock(block_index_ + 1);
+} /*}}}*/
+
+base::Code SSTableIterator::GoNext() { /*{{{*/
+  if (!Valid()) return base::kInvalidParam;
+
+  ++pos_;
+  if (pos_ < records_.size()) return base::kOk;
+
+  return LoadBlock(block_index_ + 1);
+} /*}}}*/
+
+base::Code SSTableIterator::LoadBlock(size_t block_index) { /*{{{*/
+  records_.clear();
+  pos_ = 0;
+  for (block_index_ = block_index; block_index_ < table_->GetBlocksNum(); ++block_index_) {
+    base::Code ret = table_->ReadBlock(block_index_, &records_);
+    if (ret != base::kOk) {
+      records_.clear();
+      return ret;
+    }
+    if (!records_.empty()) break;
+  }
+
+  return base::kOk;
+} /*}}}*/
+
+LSMLevelIterator::LSMLevelIterator(const std::vector<SSTablePtr> &tables)
+    : tables_(tables), table_index_(0), iter_(NULL) { /*{{{*/
+} /*}}}*/
+
+LSMLevelIterator::~LSMLevelIterator() { /*{{{*/
+  if (iter_ != NULL) {
+    delete iter_;
+    iter_ = NULL;
+  }
+} /*}}}*/
+
+base::Code LSMLevelIterator::SetFirst() { /*{{{*/
+  OpenTable(0);
+  if (iter_ == NULL) return base::kOk;
+
+  base::Code ret = iter_->SetFirst();
+  if (ret != base::kOk) return ret;
+
+  return SkipEmptyTables();
+} /*}}}*/
+
+base::Code LSMLevelIterator::Seek(const std::string &key) { /*{{{*/
+  OpenTable(std::lower_bound(tables_.begin(), tables_.end(), key, TableLessThanKey) - tables_.begin());
+  if (iter_ == NULL) return base::kOk;
+
+  base::Code ret = iter_->Seek(key);
+  if (ret != base::kOk) return ret;
+
+  return SkipEmptyTables();
+} /*}}}*/
+
+base::Code LSMLevelIterator::GoNext() { /*{{{*/
+  if (!Valid()) return base::kInvalidParam;
+
+  base::Code ret = iter_->GoNext();
+  if (ret != base::kOk) return ret;
+
+  return SkipEmptyTables();
+} /*}}}*/
+
+base::Code LSMLevelIterator::SkipEmptyTables() { /*{{{*/
+  while (iter_ != NULL && !iter_->Valid()) {
+    OpenTable(table_index_ + 1);
+    if (iter_ == NULL) break;
+
+    base::Code ret = iter_->SetFirst();
+    if (ret != base::kOk) return ret;
+  }
+
+  return base::kOk;
+} /*}}}*/
+
+void LSMLevelIterator::OpenTable(size_t table_index) { /*{{{*/
+  if (iter_ != NULL) {
+    delete iter_;
+    iter_ = NULL;
+  }
+
+  table_index_ = table_index;
+  if (table_index_ < tables_.size()) iter_ = new SSTableIterator(tables_[table_index_]);
+} /*}}}*/
+
+}  // namespace store
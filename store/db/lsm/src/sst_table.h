@@ -0,0 +1,236 @@
+// Copyright (c) 2015 The CSUTIL Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef STORE_DB_LSM_SST_TABLE_H_
+#define STORE_DB_LSM_SST_TABLE_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include "base/bloom_filter.h"
+#include "base/compress.h"
+#include "base/status.h"
+#include "store/db/lsm/src/lsm_iterator.h"
+#include "store/db/lsm/src/mem_table.h"
+
+namespace store {
+
+const uint32_t kDefaultLSMWriteBufferSize = 4 * 1024 * 1024;
+const uint64_t kDefaultLSMTargetFileSize = 2 * 1024 * 1024;
+const uint64_t kDefaultLSMMaxBytesForLevelBase = 10 * 1024 * 1024;
+const uint32_t kDefaultLSMLevel0CompactionTrigger = 4;
+const uint32_t kDefaultLSMLevel0StopWritesTrigger = 12;
+const uint32_t kDefaultLSMBlockSize = 4 * 1024;
+const uint32_t kDefaultLSMBloomBitsPerKey = 10;
+
+/**
+ * NOTE: options of LSMDB, which should be set before Init
+ * 1. write_buffer_size: memtable is flushed into a level 0 table once its bytes reach it
+ * 2. max_bytes_for_level_base: max bytes of level 1, and it's ten times for every deeper level
+ * 3. level 0 is compacted once it has l0_compaction_trigger tables, and writes wait at l0_stop_writes_trigger
+ * 4. compress is used by blocks of level 0 and 1, deep_compress is used by deeper levels, which is usually
+ *    slower but smaller; they are not owned by db, and NULL means no compression
+ */
+struct LSMOption { /*{{{*/
+  uint32_t write_buffer_size;
+  uint64_t target_file_size;
+  uint64_t max_bytes_for_level_base;
+  uint32_t l0_compaction_trigger;
+  uint32_t l0_stop_writes_trigger;
+  uint32_t block_size;
+  uint32_t bloom_bits_per_key;
+  base::BaseCompress *compress;
+  base::BaseCompress *deep_compress;
+
+  LSMOption()
+      : write_buffer_size(kDefaultLSMWriteBufferSize),
+        target_file_size(kDefaultLSMTargetFileSize),
+        max_bytes_for_level_base(kDefaultLSMMaxBytesForLevelBase),
+        l0_compaction_trigger(kDefaultLSMLevel0CompactionTrigger),
+        l0_stop_writes_trigger(kDefaultLSMLevel0StopWritesTrigger),
+        block_size(kDefaultLSMBlockSize),
+        bloom_bits_per_key(kDefaultLSMBloomBitsPerKey),
+        compress(NULL),
+        deep_compress(NULL) {}
+}; /*}}}*/
+
+// NOTE: a block is kept raw if compressed one is not smaller
+enum SSTBlockFlag {
+  kSSTRawBlock = 0,
+  kSSTCompressBlock = 1,      // Compressed by LSMOption::compress
+  kSSTDeepCompressBlock = 2,  // Compressed by LSMOption::deep_compress
+};
+
+/**
+ * NOTE: sstable file format:
+ *      |data block|...|data block|filter block|index block|footer|
+ *      block:        |payload|flag|crc|, crc is of payload, and payload may be compressed by flag
+ *      data block:   |entry|...|entry|, and entry is |key_size|value_size|seq|type|key|value|
+ *      filter block: |bits_per_key|keys_num|hash_num|bytes of bloom filter|
+ *      index block:  |last_key_size|last_key|offset|size|..., one for every data block
+ *      footer:       |filter_offset|filter_size|index_offset|index_size|magic|
+ */
+const uint32_t kSSTBlockTrailerSize = sizeof(uint8_t) + sizeof(uint32_t);
+const uint32_t kSSTEntryHeadSize = 2 * sizeof(uint32_t) + sizeof(uint64_t) + sizeof(uint8_t);
+const uint32_t kSSTFooterSize = 5 * sizeof(uint64_t);
+const uint64_t kSSTMagicNum = 0x4c534d5353544142ull;
+
+// NOTE: table info kept by manifest, smallest and largest are keys of the first and last entries
+struct LSMTableMeta { /*{{{*/
+  uint64_t file_num;
+  uint64_t file_size;
+  uint64_t entries_num;
+  std::string smallest;
+  std::string largest;
+
+  LSMTableMeta() : file_num(0), file_size(0), entries_num(0), smallest(), largest() {}
+}; /*}}}*/
+
+struct SSTBlockHandle { /*{{{*/
+  std::string last_key;
+  uint64_t offset;
+  uint64_t size;  // Size of block with trailer
+}; /*}}}*/
+
+/**
+ * NOTE: SSTableBuilder writes sorted entries into a new sstable file
+ * 1. keys should be added in increasing order, and each key only once
+ * 2. file is synced and closed by Finish, and it's removed if builder is deleted before Finish
+ */
+class SSTableBuilder { /*{{{*/
+ public:
+  SSTableBuilder(const LSMOption &option, SSTBlockFlag compress_flag);
+  ~SSTableBuilder();
+
+ public:
+  base::Code Open(const std::string &path, uint64_t file_num);
+  base::Code Add(const std::string &key, const LSMEntry &entry);
+  base::Code Finish(LSMTableMeta *meta);
+
+  uint64_t GetFileSize() const { return offset_ + block_.size(); }
+  uint64_t GetEntriesNum() const { return meta_.entries_num; }
+
+ private:
+  base::Code FlushBlock();
+  base::Code WriteBlock(const std::string &payload, SSTBlockFlag flag, uint64_t *size);
+
+ private:
+  SSTableBuilder(const SSTableBuilder &);
+  SSTableBuilder &operator=(const SSTableBuilder &);
+
+ private:
+  const LSMOption &option_;
+  SSTBlockFlag compress_flag_;
+  std::string path_;
+  int fd_;
+  uint64_t offset_;
+  std::string block_;
+  std::vector<SSTBlockHandle> index_;
+  std::vector<std::string> keys_;  // Keys of table, which are put into bloom filter by Finish
+  LSMTableMeta meta_;
+  bool is_finished_;
+}; /*}}}*/
+
+/**
+ * NOTE: SSTable is the reader of a sstable file, and it's immutable after Open
+ * 1. index and bloom filter are kept in memory, and data blocks are read by pread, so it's read by threads
+ *    at the same time
+ * 2. it's shared by LSMDB and iterators, so the file is readable until the last one releases it, even if the
+ *    file is removed by compaction
+ */
+class SSTable { /*{{{*/
+ public:
+  SSTable();
+  ~SSTable();
+
+ public:
+  base::Code Open(const std::string &path, const LSMTableMeta &meta, const LSMOption &option);
+
+  // NOTE: kNotFound is returned if key is not in table, and entry may be a delete record
+  base::Code Get(const std::string &key, LSMEntry *entry);
+
+  base::Code ReadBlock(size_t index, std::vector<LSMRecord> *records);
+
+  // NOTE: index of the first block whose last key is not less than key, and GetBlocksNum() if there is none
+  size_t FindBlock(const std::string &key) const;
+  size_t GetBlocksNum() const { return index_.size(); }
+  const LSMTableMeta &GetMeta() const { return meta_; }
+
+ private:
+  base::Code ReadBlockData(uint64_t offset, uint64_t size, std::string *payload);
+  base::Code LoadFilter(uint64_t offset, uint64_t size);
+  base::Code LoadIndex(uint64_t offset, uint64_t size);
+
+ private:
+  SSTable(const SSTable &);
+  SSTable &operator=(const SSTable &);
+
+ private:
+  std::string path_;
+  int fd_;
+  LSMTableMeta meta_;
+  std::vector<SSTBlockHandle> index_;
+  base::BloomFilter *bloom_;
+  base::BaseCompress *compress_;
+  base::BaseCompress *deep_compress_;
+}; /*}}}*/
+
+typedef std::shared_ptr<SSTable> SSTablePtr;
+
+class SSTableIterator : public LSMInternalIterator { /*{{{*/
+ public:
+  explicit SSTableIterator(const SSTablePtr &table);
+  virtual ~SSTableIterator() {}
+
+ public:
+  virtual base::Code SetFirst();
+  virtual base::Code Seek(const std::string &key);
+  virtual base::Code GoNext();
+  virtual bool Valid() { return pos_ < records_.size(); }
+  virtual const std::string &GetKey() { return records_[pos_].key; }
+  virtual const LSMEntry &GetEntry() { return records_[pos_].entry; }
+
+ private:
+  base::Code LoadBlock(size_t block_index);
+
+ private:
+  SSTablePtr table_;
+  size_t block_index_;
+  std::vector<LSMRecord> records_;  // Records of the current block
+  size_t pos_;
+}; /*}}}*/
+
+/**
+ * NOTE: LSMLevelIterator walks tables of level 1 or deeper, which are sorted and not overlapped, so only one
+ * table is opened at the same time
+ */
+class LSMLevelIterator : public LSMInternalIterator { /*{{{*/
+ public:
+  explicit LSMLevelIterator(const std::vector<SSTablePtr> &tables);
+  virtual ~LSMLevelIterator();
+
+ public:
+  virtual base::Code SetFirst();
+  virtual base::Code Seek(const std::string &key);
+  virtual base::Code GoNext();
+  virtual bool Valid() { return iter_ != NULL && iter_->Valid(); }
+  virtual const std::string &GetKey() { return iter_->GetKey(); }
+  virtual const LSMEntry &GetEntry() { return iter_->GetEntry(); }
+
+ private:
+  base::Code SkipEmptyTables();
+  void OpenTable(size_t table_index);
+
+ private:
+  std::vector<SSTablePtr> tables_;
+  size_t table_index_;
+  SSTableIterator *iter_;
+}; /*}}}*/
+
+}  // namespace store
+
+#endif
@@ -0,0 +1,99 @@
+// Copyright (c) 2015 The CSUTIL Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "base/coding.h"
+#include "base/file_util.h"
+#include "base/hash.h"
+#include "base/log.h"
+
+#include "wal.h"
+
+namespace store {
+
+WALWriter::WALWriter() : fd_(-1), pos_(0) { /*{{{*/ } /*}}}*/
+
+WALWriter::~WALWriter() { /*{{{*/ Close(); } /*}}}*/
+
+base::Code WALWriter::Open(const std::string &path) { /*{{{*/
+  if (path.empty() || fd_ >= 0) return base::kInvalidParam;
+
+  fd_ = open(path.c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0644);
+  if (fd_ < 0) return base::kOpenFileFailed;
+  pos_ = 0;
+
+  return base::kOk;
+} /*}}}*/
+
+base::Code WALWriter::Append(const std::string &payload, bool is_sync) { /*{{{*/
+  if (fd_ < 0) return base::kNotInit;
+
+  std::string record;
+  record.reserve(kWALRecordHeadSize + payload.size());
+  base::EncodeFixed32(base::CRC32(payload.data(), (int)payload.size()), &record);
+  base::EncodeFixed32(payload.size(), &record);
+  record.append(payload);
+
+  base::Code ret = base::WriteAt(fd_, pos_, record.data(), record.size());
+  if (ret != base::kOk) return ret;
+  pos_ += record.size();
+
+  if (is_sync) return Sync();
+  return base::kOk;
+} /*}}}*/
+
+base::Code WALWriter::Sync() { /*{{{*/
+  if (fd_ < 0) return base::kNotInit;
+  if (fdatasync(fd_) != 0) return base::kWriteError;
+
+  return base::kOk;
+} /*}}}*/
+
+base::Code WALWriter::Close() { /*{{{*/
+  if (fd_ < 0) return base::kOk;
+
+  close(fd_);
+  fd_ = -1;
+  return base::kOk;
+} /*}}}*/
+
+base::Code ReadWALRecords(const std::string &path, std::vector<std::string> *payloads) { /*{{{*/
+  if (payloads == NULL) return base::kInvalidParam;
+  payloads->clear();
+
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) return base::kOpenFileFailed;
+
+  uint64_t file_size = 0;
+  base::Code ret = base::GetFileSize(fd, &file_size);
+  std::string data(file_size, '\0');
+  if (ret == base::kOk && file_size > 0) ret = base::ReadAt(fd, 0, file_size, &data[0]);
+  close(fd);
+  if (ret != base::kOk) return ret;
+
+  uint64_t pos = 0;
+  while (pos + kWALRecordHeadSize <= data.size()) {
+    uint32_t crc = 0;
+    uint32_t size = 0;
+    base::DecodeFixed32(data.substr(pos, sizeof(uint32_t)), &crc);
+    base::DecodeFixed32(data.substr(pos + sizeof(uint32_t), sizeof(uint32_t)), &size);
+    if (pos + kWALRecordHeadSize + size > data.size()) break;
+
+    const char *payload = data.data() + pos + kWALRecordHeadSize;
+    if (base::CRC32(payload, (int)size) != crc) break;
+    payloads->push_back(std::string(payload, size));
+    pos += kWALRecordHeadSize + size;
+  }
+
+  if (pos != data.size()) {
+    base::LOG_ERR("Broken tail of wal file is dropped, path:%s, valid size:%llu, file size:%llu", path.c_str(),
+                  (unsigned long long)pos, (unsigned long long)data.size());
+  }
+
+  return base::kOk;
+} /*}}}*/
+
+}  // namespace store
@@ -0,0 +1,55 @@
+// Copyright (c) 2015 The CSUTIL Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef STORE_DB_LSM_WAL_H_
+#define STORE_DB_LSM_WAL_H_
+
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include "base/status.h"
+
+namespace store {
+
+// NOTE: record of wal file is |crc|size|payload|, and crc is of payload
+const uint32_t kWALRecordHeadSize = 2 * sizeof(uint32_t);
+
+/**
+ * NOTE: WALWriter appends records of writes before they're put into memtable
+ * 1. one record is one Put, Del or WriteBatch, so a batch is replayed completely or not at all
+ * 2. it's not thread safe, and writers are serialized by LSMDB
+ */
+class WALWriter { /*{{{*/
+ public:
+  WALWriter();
+  ~WALWriter();
+
+ public:
+  base::Code Open(const std::string &path);
+  base::Code Append(const std::string &payload, bool is_sync);
+  base::Code Sync();
+  base::Code Close();
+
+  int GetFd() const { return fd_; }
+
+ private:
+  WALWriter(const WALWriter &);
+  WALWriter &operator=(const WALWriter &);
+
+ private:
+  int fd_;
+  uint64_t pos_;
+}; /*}}}*/
+
+/**
+ * NOTE: payloads of records in wal file are read in order, and reading stops at the first broken record,
+ * which is the tail not written completely when system crashed
+ */
+base::Code ReadWALRecords(const std::string &path, std::vector<std::string> *payloads);
+
+}  // namespace store
+
+#endif
@@ -266,6 +266,66 @@ TEST_D(TimerWheel, Test_Normal_TimerWheel, "时间轮功能验证") { /*{{{*/
   }
 } /*}}}*/
 
+TEST(TimerWheel, Test_Normal_Cancel_And_Cascade) { /*{{{*/
+  using namespace base;
+
+  TimerWheel tw(1000, 3);
+  std::vector<int> fired;
+  uint64_t id1 = tw.AddTimer(5, [&fired]() { fired.push_back(5); });
+  uint64_t id2 = tw.AddTimer(2500, [&fired]() { fired.push_back(2500); });     // NOTE:htt, in level 1
+  uint64_t id3 = tw.AddTimer(1500000, [&fired]() { fired.push_back(1500000); });  // NOTE:htt, in level 2
+  uint64_t id4 = tw.AddTimer(7, [&fired]() { fired.push_back(7); });
+  EXPECT_EQ(4u, tw.Size());
+  EXPECT_EQ(5, tw.GetNextTimeout());
+
+  EXPECT_TRUE(tw.CancelTimer(id4));
+  EXPECT_FALSE(tw.CancelTimer(id4));
+  EXPECT_EQ(3u, tw.Size());
+
+  tw.Advance(6);
+  EXPECT_EQ(1u, fired.size());
+  EXPECT_FALSE(tw.CancelTimer(id1));
+
+  tw.Advance(2500 - 6);
+  EXPECT_EQ(1u, fired.size());
+  tw.Tick();
+  EXPECT_EQ(2u, fired.size());
+  EXPECT_EQ(2500, fired[1]);
+  EXPECT_FALSE(tw.CancelTimer(id2));
+
+  tw.Advance(1500000 - 2501);
+  EXPECT_EQ(2u, fired.size());
+  tw.Tick();
+  EXPECT_EQ(3u, fired.size());
+  EXPECT_EQ(1500000, fired[2]);
+  EXPECT_FALSE(tw.CancelTimer(id3));
+  EXPECT_EQ(0u, tw.Size());
+  EXPECT_EQ(-1, tw.GetNextTimeout());
+} /*}}}*/
+
+TEST(TimerWheel, Test_Normal_Beyond_Top_Level) { /*{{{*/
+  using namespace base;
+
+  // NOTE:htt, 2 levels of 1000 slots cover 1000000 ticks, and a longer timer is placed again by cascade
+  TimerWheel tw(1000, 2);
+  int fired_num = 0;
+  tw.AddTimer(2500000, [&fired_num]() { ++fired_num; });
+  tw.AddTimer(0, [&tw, &fired_num]() {
+    ++fired_num;
+    tw.AddTimer(0, [&fired_num]() { ++fired_num; });  // NOTE:htt, added by task, run in the next tick
+  });
+
+  tw.Tick();
+  EXPECT_EQ(1, fired_num);
+  tw.Tick();
+  EXPECT_EQ(2, fired_num);
+
+  tw.Advance(2500000 - 2);
+  EXPECT_EQ(2, fired_num);
+  tw.Tick();
+  EXPECT_EQ(3, fired_num);
+} /*}}}*/
+
 TEST_D(RunLengthEncoding, Test_Normal_RLE, "Run-Length Encoding(RLE) 验证") { /*{{{*/
   using namespace base;
 
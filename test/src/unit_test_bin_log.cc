@@ -0,0 +1,176 @@
+// Copyright (c) 2015 The CSUTIL Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "base/bin_log.h"
+#include "base/file_util.h"
+#include "base/log.h"
+#include "base/status.h"
+
+#include "test_base/include/test_base.h"
+
+static std::string DecodeBinLogCnt(const std::string &bin_cnt) { /*{{{*/
+  base::BinLogDecoder decoder;
+  std::string text;
+  uint32_t used_len = 0;
+  base::Code ret = decoder.Decode(bin_cnt.data(), bin_cnt.size(), &text, &used_len);
+  if (ret != base::kOk || used_len != bin_cnt.size()) return "";
+  return text;
+} /*}}}*/
+
+// NOTE:htt, message after "] - " of one text line
+static std::string GetLogMsg(const std::string &line) { /*{{{*/
+  size_t pos = line.find("] - ");
+  if (pos == std::string::npos) return "";
+  return line.substr(pos + 4);
+} /*}}}*/
+
+TEST(BinLog, Test_Normal_Parse_Format) { /*{{{*/
+  using namespace base;
+
+  std::vector<BinLogArg> args;
+  Code ret = ParseBinLogFormat("int:%d, uint64:%llu, str:%-10.*s, double:%.2f, 100%%, ptr:%p", &args);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ(6, args.size());
+  EXPECT_EQ(kBinLogIntArg, args[0].type);
+  EXPECT_EQ(kBinLogUInt64Arg, args[1].type);
+  EXPECT_EQ(kBinLogStarArg, args[2].type);
+  EXPECT_EQ(kBinLogStrArg, args[3].type);
+  EXPECT_EQ(-2, args[3].precision);
+  EXPECT_EQ(kBinLogDoubleArg, args[4].type);
+  EXPECT_EQ(kBinLogPtrArg, args[5].type);
+
+  ret = ParseBinLogFormat("no args", &args);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ(0, args.size());
+} /*}}}*/
+
+TEST(BinLog, Test_Exception_Parse_Format) { /*{{{*/
+  using namespace base;
+
+  std::vector<BinLogArg> args;
+  Code ret = ParseBinLogFormat("count:%n", &args);
+  EXPECT_EQ(kInvalidParam, ret);
+
+  ret = ParseBinLogFormat("end with %", &args);
+  EXPECT_EQ(kInvalidParam, ret);
+} /*}}}*/
+
+TEST(BinLog, Test_Normal_Encode_Decode) { /*{{{*/
+  using namespace base;
+
+  std::string log_path = "./test_bin.log";
+  unlink(log_path.c_str());
+  InitBinLog(log_path.c_str(), kInfoLevel);
+
+  int64_t big_num = -1234567890123LL;
+  BIN_LOG_ERR("int:%d, uint:%u, int64:%lld, hex:%#x, char:%c", -10, 4000000000u, (long long)big_num, 255, 'a');
+  BIN_LOG_INFO("str:%s, width:[%-8s], precision:%.*s, null:%s", "hello", "ab", 3, "abcdef", (const char *)NULL);
+  BIN_LOG_WARN("double:%.3f, exp:%e, 100%% done, size:%zu", 3.14159, 12345.678, (size_t)1024);
+  BIN_LOG_DEBUG("debug is not written:%d", 1);
+  CloseBinLogStream();
+
+  std::string bin_cnt;
+  Code ret = PumpWholeData(log_path, &bin_cnt);
+  EXPECT_EQ(kOk, ret);
+
+  std::string text = DecodeBinLogCnt(bin_cnt);
+  std::vector<std::string> lines;
+  size_t begin = 0;
+  size_t end = 0;
+  while ((end = text.find('\n', begin)) != std::string::npos) {
+    lines.push_back(text.substr(begin, end - begin));
+    begin = end + 1;
+  }
+  EXPECT_EQ(3, lines.size());
+  if (lines.size() == 3) {
+    char expect[1024];
+    snprintf(expect, sizeof(expect), "int:%d, uint:%u, int64:%lld, hex:%#x, char:%c", -10, 4000000000u,
+             (long long)big_num, 255, 'a');
+    EXPECT_EQ(std::string(expect), GetLogMsg(lines[0]));
+    EXPECT_NEQ(std::string::npos, lines[0].find("[ERROR][unit_test_bin_log.cc ExecBody "));
+
+    snprintf(expect, sizeof(expect), "str:%s, width:[%-8s], precision:%.*s, null:%s", "hello", "ab", 3, "abcdef",
+             "(null)");
+    EXPECT_EQ(std::string(expect), GetLogMsg(lines[1]));
+
+    snprintf(expect, sizeof(expect), "double:%.3f, exp:%e, 100%% done, size:%zu", 3.14159, 12345.678, (size_t)1024);
+    EXPECT_EQ(std::string(expect), GetLogMsg(lines[2]));
+    EXPECT_NEQ(std::string::npos, lines[2].find("[WARNING]"));
+  }
+
+  unlink(log_path.c_str());
+} /*}}}*/
+
+TEST(BinLog, Test_Normal_Decode_Partial_Data) { /*{{{*/
+  using namespace base;
+
+  std::string log_path = "./test_bin_partial.log";
+  unlink(log_path.c_str());
+  InitBinLog(log_path.c_str(), kInfoLevel);
+  for (int i = 0; i < 10; ++i) {
+    BIN_LOG_INFO("index:%d", i);
+  }
+  CloseBinLogStream();
+
+  std::string bin_cnt;
+  Code ret = PumpWholeData(log_path, &bin_cnt);
+  EXPECT_EQ(kOk, ret);
+
+  // NOTE:htt, feed data byte by byte, decoder should keep incomplete record
+  BinLogDecoder decoder;
+  std::string text;
+  std::string pending;
+  for (size_t i = 0; i < bin_cnt.size(); ++i) {
+    pending.append(1, bin_cnt[i]);
+    uint32_t used_len = 0;
+    ret = decoder.Decode(pending.data(), pending.size(), &text, &used_len);
+    EXPECT_EQ(kOk, ret);
+    pending.erase(0, used_len);
+  }
+  EXPECT_TRUE(pending.empty());
+  EXPECT_EQ(10, std::count(text.begin(), text.end(), '\n'));
+  EXPECT_NEQ(std::string::npos, text.find("] - index:9\n"));
+
+  unlink(log_path.c_str());
+} /*}}}*/
+
+TEST(BinLog, Test_Press_Bin_Log_And_Text_Log) { /*{{{*/
+  using namespace base;
+
+  std::string bin_log_path = "./test_bin_press.log";
+  std::string text_log_path = "./test_text_press.log";
+  unlink(bin_log_path.c_str());
+  unlink(text_log_path.c_str());
+  InitBinLog(bin_log_path.c_str(), kInfoLevel);
+  InitLog(text_log_path.c_str(), kInfoLevel);
+
+  for (int i = 0; i < 100000; ++i) {
+    BIN_LOG_INFO("rpc call, service:%s, method:%s, cost_us:%d, ret:%d", "BookService", "GetBook", i, 0);
+  }
+  for (int i = 0; i < 100000; ++i) {
+    LOG_INFO("rpc call, service:%s, method:%s, cost_us:%d, ret:%d", "BookService", "GetBook", i, 0);
+  }
+  CloseBinLogStream();
+  DestroyLog();
+
+  uint64_t bin_size = 0;
+  uint64_t text_size = 0;
+  GetFileSize(bin_log_path, &bin_size);
+  GetFileSize(text_log_path, &text_size);
+  fprintf(stderr, "binary log size:%llu, text log size:%llu\n", (unsigned long long)bin_size,
+          (unsigned long long)text_size);
+  EXPECT_GT(text_size, bin_size);
+
+  unlink(bin_log_path.c_str());
+  unlink(text_log_path.c_str());
+} /*}}}*/
@@ -2,13 +2,18 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <algorithm>
 #include <string>
+#include <vector>
 
+#include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/time.h>
 #include <unistd.h>
 
+#include "base/file_util.h"
 #include "base/status.h"
 
 #include "test_base/include/test_base.h"
@@ -178,3 +183,772 @@ TEST(BitCaskDB, BigDataForGet) { /*{{{*/
 
   delete db;
 } /*}}}*/
+
+static base::Code ClearDir(const std::string &dir_path) { /*{{{*/
+  base::Code ret = base::CreateDir(dir_path);
+  if (ret != base::kOk) return ret;
+
+  std::vector<std::string> files_path;
+  ret = base::GetNormalFilesPath(dir_path, &files_path);
+  if (ret != base::kOk) return ret;
+  for (size_t i = 0; i < files_path.size(); ++i) {
+    if (unlink(files_path[i].c_str()) != 0) return base::kRemoveFileFailed;
+  }
+  return base::kOk;
+} /*}}}*/
+
+// NOTE: values are large, so records of one round fill more than one data file
+static base::Code PutRound(store::BitCaskDB *db, uint32_t keys_num, uint32_t round) { /*{{{*/
+  char buf[32] = "\0";
+  for (uint32_t i = 0; i < keys_num; ++i) {
+    snprintf(buf, sizeof(buf), "%u", (unsigned int)i);
+    std::string key = std::string("key_") + buf;
+    snprintf(buf, sizeof(buf), "%u_%u", (unsigned int)round, (unsigned int)i);
+    std::string value = std::string(6000, 'v') + buf;
+
+    base::Code ret = db->Put(key, value);
+    if (ret != base::kOk) return ret;
+  }
+  return base::kOk;
+} /*}}}*/
+
+static base::Code CheckRound(store::BitCaskDB *db, uint32_t keys_num, uint32_t round) { /*{{{*/
+  char buf[32] = "\0";
+  for (uint32_t i = 0; i < keys_num; ++i) {
+    snprintf(buf, sizeof(buf), "%u", (unsigned int)i);
+    std::string key = std::string("key_") + buf;
+    snprintf(buf, sizeof(buf), "%u_%u", (unsigned int)round, (unsigned int)i);
+    std::string value = std::string(6000, 'v') + buf;
+
+    std::string tmp_value;
+    base::Code ret = db->Get(key, &tmp_value);
+    if (ret != base::kOk) return ret;
+    if (tmp_value != value) return base::kDataIsNotConsistent;
+  }
+  return base::kOk;
+} /*}}}*/
+
+TEST(BitCaskDB, NormalMergeOverwriteAndDel) { /*{{{*/
+  using namespace base;
+  using namespace store;
+
+  std::string dir_path = "../data/bit_cask_merge_db";
+  Code ret = ClearDir(dir_path);
+  EXPECT_EQ(kOk, ret);
+
+  MergeOption option;
+  option.interval_ms = 0;
+  option.rate_bytes = 0;
+  BitCaskDB *db = new BitCaskDB();
+  db->SetMergeOption(option);
+  ret = db->Init(dir_path);
+  EXPECT_EQ(kOk, ret);
+
+  uint32_t keys_num = 2000;
+  ret = PutRound(db, keys_num, 1);
+  EXPECT_EQ(kOk, ret);
+  ret = PutRound(db, keys_num, 2);
+  EXPECT_EQ(kOk, ret);
+
+  DBStatusInfo before_info;
+  before_info.Clear();
+  ret = db->GetStatus(&before_info);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ(keys_num, before_info.used_cnt);
+  EXPECT_GT(before_info.dead_bytes, before_info.live_bytes / 2);
+
+  ret = db->Merge();
+  EXPECT_EQ(kOk, ret);
+  ret = CheckRound(db, keys_num, 2);
+  EXPECT_EQ(kOk, ret);
+
+  DBStatusInfo after_info;
+  after_info.Clear();
+  ret = db->GetStatus(&after_info);
+  EXPECT_EQ(kOk, ret);
+  std::string tmp_info;
+  after_info.ToString(&tmp_info);
+  fprintf(stderr, "%s", tmp_info.c_str());
+  EXPECT_EQ(before_info.live_bytes, after_info.live_bytes);
+  EXPECT_LT(after_info.dead_bytes, before_info.dead_bytes);
+
+  // NOTE: records in old files are all dead after delete, so delete records are dropped by the next merge
+  for (uint32_t i = 0; i < keys_num; ++i) {
+    char buf[32] = "\0";
+    snprintf(buf, sizeof(buf), "%u", (unsigned int)i);
+    ret = db->Del(std::string("key_") + buf);
+    EXPECT_EQ(kOk, ret);
+  }
+  ret = db->Merge();
+  EXPECT_EQ(kOk, ret);
+  after_info.Clear();
+  ret = db->GetStatus(&after_info);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ(0u, after_info.used_cnt);
+
+  std::string tmp_value;
+  ret = db->Get("key_1", &tmp_value);
+  EXPECT_EQ(kNotFound, ret);
+  ret = db->Put("key_1", "value_1", 0);
+  EXPECT_EQ(kOk, ret);
+  delete db;
+
+  // NOTE: deleted keys are not back after reopen
+  db = new BitCaskDB();
+  db->SetMergeOption(option);
+  ret = db->Init(dir_path);
+  EXPECT_EQ(kOk, ret);
+  ret = db->Get("key_1", &tmp_value);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ("value_1", tmp_value);
+  ret = db->Get("key_2", &tmp_value);
+  EXPECT_EQ(kNotFound, ret);
+  delete db;
+} /*}}}*/
+
+TEST(BitCaskDB, NormalMergeReopen) { /*{{{*/
+  using namespace base;
+  using namespace store;
+
+  std::string dir_path = "../data/bit_cask_merge_db";
+  Code ret = ClearDir(dir_path);
+  EXPECT_EQ(kOk, ret);
+
+  MergeOption option;
+  option.interval_ms = 0;
+  option.rate_bytes = 0;
+  BitCaskDB *db = new BitCaskDB();
+  db->SetMergeOption(option);
+  ret = db->Init(dir_path);
+  EXPECT_EQ(kOk, ret);
+
+  uint32_t keys_num = 2000;
+  ret = PutRound(db, keys_num, 1);
+  EXPECT_EQ(kOk, ret);
+  ret = PutRound(db, keys_num, 2);
+  EXPECT_EQ(kOk, ret);
+  ret = db->Merge();
+  EXPECT_EQ(kOk, ret);
+
+  DBStatusInfo merged_info;
+  merged_info.Clear();
+  ret = db->GetStatus(&merged_info);
+  EXPECT_EQ(kOk, ret);
+  delete db;
+
+  db = new BitCaskDB();
+  db->SetMergeOption(option);
+  ret = db->Init(dir_path);
+  EXPECT_EQ(kOk, ret);
+  ret = CheckRound(db, keys_num, 2);
+  EXPECT_EQ(kOk, ret);
+
+  DBStatusInfo reopen_info;
+  reopen_info.Clear();
+  ret = db->GetStatus(&reopen_info);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ(merged_info.used_cnt, reopen_info.used_cnt);
+  EXPECT_EQ(merged_info.live_bytes, reopen_info.live_bytes);
+  EXPECT_EQ(merged_info.dead_bytes, reopen_info.dead_bytes);
+  delete db;
+} /*}}}*/
+
+TEST(BitCaskDB, NormalBackgroundMergeWithRate) { /*{{{*/
+  using namespace base;
+  using namespace store;
+
+  std::string dir_path = "../data/bit_cask_merge_db";
+  Code ret = ClearDir(dir_path);
+  EXPECT_EQ(kOk, ret);
+
+  MergeOption option;
+  option.interval_ms = 50;
+  option.rate_bytes = 40 * 1024 * 1024;
+  BitCaskDB *db = new BitCaskDB();
+  db->SetMergeOption(option);
+  ret = db->Init(dir_path);
+  EXPECT_EQ(kOk, ret);
+
+  uint32_t keys_num = 2000;
+  ret = PutRound(db, keys_num, 1);
+  EXPECT_EQ(kOk, ret);
+  ret = PutRound(db, keys_num, 2);
+  EXPECT_EQ(kOk, ret);
+
+  // NOTE: foreground Get goes on while the background thread merges
+  DBStatusInfo status_info;
+  uint32_t max_get_us = 0;
+  for (int i = 0; i < 500; ++i) {
+    struct timeval start;
+    gettimeofday(&start, NULL);
+    ret = CheckRound(db, 100, 2);
+    EXPECT_EQ(kOk, ret);
+    struct timeval end;
+    gettimeofday(&end, NULL);
+    uint32_t cost_us = (end.tv_sec - start.tv_sec) * 1000000 + end.tv_usec - start.tv_usec;
+    if (cost_us > max_get_us) max_get_us = cost_us;
+
+    status_info.Clear();
+    db->GetStatus(&status_info);
+    if (status_info.dead_bytes < status_info.live_bytes / 2) break;
+    usleep(10000);
+  }
+  fprintf(stderr, "live_bytes:%llu, dead_bytes:%llu, max cost of 100 gets:%u us\n",
+          (unsigned long long)status_info.live_bytes, (unsigned long long)status_info.dead_bytes, max_get_us);
+  EXPECT_LT(status_info.dead_bytes, status_info.live_bytes / 2);
+
+  ret = CheckRound(db, keys_num, 2);
+  EXPECT_EQ(kOk, ret);
+  delete db;
+} /*}}}*/
+
+static base::Code GetHintFilesPath(const std::string &dir_path, std::vector<std::string> *hint_files_path) { /*{{{*/
+  std::vector<std::string> files_path;
+  base::Code ret = base::GetNormalFilesPath(dir_path, &files_path);
+  if (ret != base::kOk) return ret;
+
+  std::string hint_prefix = dir_path + "/" + store::kHintFilePrefix;
+  for (size_t i = 0; i < files_path.size(); ++i) {
+    if (files_path[i].compare(0, hint_prefix.size(), hint_prefix) == 0) hint_files_path->push_back(files_path[i]);
+  }
+  return base::kOk;
+} /*}}}*/
+
+static base::Code TimeInit(const std::string &dir_path, uint32_t *cost_us, store::DBStatusInfo *info) { /*{{{*/
+  store::MergeOption option;
+  option.interval_ms = 0;
+  store::BitCaskDB *db = new store::BitCaskDB();
+  db->SetMergeOption(option);
+
+  struct timeval start;
+  gettimeofday(&start, NULL);
+  base::Code ret = db->Init(dir_path);
+  struct timeval end;
+  gettimeofday(&end, NULL);
+  *cost_us = (end.tv_sec - start.tv_sec) * 1000000 + end.tv_usec - start.tv_usec;
+
+  if (ret == base::kOk) ret = CheckRound(db, 2000, 2);
+  if (ret == base::kOk) {
+    info->Clear();
+    ret = db->GetStatus(info);
+  }
+  delete db;
+  return ret;
+} /*}}}*/
+
+TEST(BitCaskDB, NormalHintReopen) { /*{{{*/
+  using namespace base;
+  using namespace store;
+
+  std::string dir_path = "../data/bit_cask_hint_db";
+  Code ret = ClearDir(dir_path);
+  EXPECT_EQ(kOk, ret);
+
+  MergeOption option;
+  option.interval_ms = 0;
+  BitCaskDB *db = new BitCaskDB();
+  db->SetMergeOption(option);
+  ret = db->Init(dir_path);
+  EXPECT_EQ(kOk, ret);
+  uint32_t keys_num = 2000;
+  ret = PutRound(db, keys_num, 1);
+  EXPECT_EQ(kOk, ret);
+  ret = PutRound(db, keys_num, 2);
+  EXPECT_EQ(kOk, ret);
+  delete db;
+
+  std::vector<std::string> hint_files_path;
+  ret = GetHintFilesPath(dir_path, &hint_files_path);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_GT(hint_files_path.size(), 0u);
+
+  uint32_t hint_cost_us = 0;
+  DBStatusInfo hint_info;
+  ret = TimeInit(dir_path, &hint_cost_us, &hint_info);
+  EXPECT_EQ(kOk, ret);
+
+  // NOTE: without hint files, all data files are scanned, and hint files are written again
+  for (size_t i = 0; i < hint_files_path.size(); ++i) {
+    unlink(hint_files_path[i].c_str());
+  }
+  uint32_t scan_cost_us = 0;
+  DBStatusInfo scan_info;
+  ret = TimeInit(dir_path, &scan_cost_us, &scan_info);
+  EXPECT_EQ(kOk, ret);
+  fprintf(stderr, "init with hint:%u us, init with scan:%u us\n", hint_cost_us, scan_cost_us);
+  EXPECT_LT(hint_cost_us, scan_cost_us);
+  EXPECT_EQ(scan_info.used_cnt, hint_info.used_cnt);
+  EXPECT_EQ(scan_info.live_bytes, hint_info.live_bytes);
+  EXPECT_EQ(scan_info.dead_bytes, hint_info.dead_bytes);
+
+  std::vector<std::string> new_hint_files_path;
+  ret = GetHintFilesPath(dir_path, &new_hint_files_path);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ(hint_files_path.size(), new_hint_files_path.size());
+} /*}}}*/
+
+TEST(BitCaskDB, ExceptionCorruptHint) { /*{{{*/
+  using namespace base;
+  using namespace store;
+
+  std::string dir_path = "../data/bit_cask_hint_db";
+  std::vector<std::string> hint_files_path;
+  Code ret = GetHintFilesPath(dir_path, &hint_files_path);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_GT(hint_files_path.size(), 0u);
+
+  // NOTE: a flipped byte fails crc, and a cut one is not whole, then data files are scanned instead
+  std::string hint;
+  ret = PumpWholeData(hint_files_path[0], &hint);
+  EXPECT_EQ(kOk, ret);
+  uint64_t hint_size = hint.size();
+  hint[hint.size() / 2] ^= 0xff;
+  ret = DumpWholeData(hint_files_path[0], hint);
+  EXPECT_EQ(kOk, ret);
+  if (hint_files_path.size() > 1) truncate(hint_files_path[1].c_str(), 7);
+
+  uint32_t cost_us = 0;
+  DBStatusInfo info;
+  ret = TimeInit(dir_path, &cost_us, &info);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ(2000u, info.used_cnt);
+
+  hint.clear();
+  ret = PumpWholeData(hint_files_path[0], &hint);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ(hint_size, hint.size());
+} /*}}}*/
+
+struct PressGetParam { /*{{{*/
+  store::BitCaskDB *db;
+  uint32_t keys_num;
+  uint32_t gets_num;
+  uint32_t seed;
+  uint32_t failed_num;
+  uint32_t max_get_us;
+}; /*}}}*/
+
+static void *PressGetAction(void *param) { /*{{{*/
+  PressGetParam *get_param = static_cast<PressGetParam *>(param);
+  char buf[32] = "\0";
+  for (uint32_t i = 0; i < get_param->gets_num; ++i) {
+    uint32_t index = rand_r(&get_param->seed) % get_param->keys_num;
+    snprintf(buf, sizeof(buf), "%u", (unsigned int)index);
+
+    struct timeval start;
+    gettimeofday(&start, NULL);
+    std::string tmp_value;
+    base::Code ret = get_param->db->Get(std::string("key_") + buf, &tmp_value);
+    if (ret != base::kOk || tmp_value.size() < 6000) ++get_param->failed_num;
+    struct timeval end;
+    gettimeofday(&end, NULL);
+
+    uint32_t cost_us = (end.tv_sec - start.tv_sec) * 1000000 + end.tv_usec - start.tv_usec;
+    if (cost_us > get_param->max_get_us) get_param->max_get_us = cost_us;
+  }
+  return NULL;
+} /*}}}*/
+
+static void *PressPutAction(void *param) { /*{{{*/
+  PressGetParam *put_param = static_cast<PressGetParam *>(param);
+  for (uint32_t round = 2; round < 2 + put_param->gets_num; ++round) {
+    if (PutRound(put_param->db, 50, round) != base::kOk) ++put_param->failed_num;
+  }
+  return NULL;
+} /*}}}*/
+
+static base::Code RunPressGet(store::BitCaskDB *db, uint32_t threads_num, bool with_put, uint32_t *failed_num,
+                              uint32_t *max_get_us, uint64_t *gets_per_sec) { /*{{{*/
+  const uint32_t kGetsNum = 40000;
+  std::vector<PressGetParam> params(threads_num + 1);
+  std::vector<pthread_t> tids(threads_num + 1);
+
+  struct timeval start;
+  gettimeofday(&start, NULL);
+  for (uint32_t i = 0; i <= threads_num; ++i) {
+    PressGetParam &param = params[i];
+    param.db = db;
+    param.keys_num = 2000;
+    param.gets_num = (i < threads_num) ? kGetsNum / threads_num : 3;
+    param.seed = i + 1;
+    param.failed_num = 0;
+    param.max_get_us = 0;
+    if (i == threads_num && !with_put) break;
+
+    void *(*action)(void *) = (i < threads_num) ? PressGetAction : PressPutAction;
+    if (pthread_create(&tids[i], NULL, action, &param) != 0) return base::kPthreadCreateFailed;
+  }
+  for (uint32_t i = 0; i < threads_num; ++i) {
+    pthread_join(tids[i], NULL);
+  }
+  struct timeval end;
+  gettimeofday(&end, NULL);
+  if (with_put) pthread_join(tids[threads_num], NULL);
+
+  *failed_num = 0;
+  *max_get_us = 0;
+  for (uint32_t i = 0; i <= threads_num; ++i) {
+    *failed_num += params[i].failed_num;
+    if (params[i].max_get_us > *max_get_us) *max_get_us = params[i].max_get_us;
+  }
+  uint64_t cost_us = (end.tv_sec - start.tv_sec) * 1000000 + end.tv_usec - start.tv_usec;
+  *gets_per_sec = (uint64_t)kGetsNum * 1000000 / (cost_us == 0 ? 1 : cost_us);
+  return base::kOk;
+} /*}}}*/
+
+TEST(BitCaskDB, PressConcurrentGet) { /*{{{*/
+  using namespace base;
+  using namespace store;
+
+  std::string dir_path = "../data/bit_cask_press_db";
+  Code ret = ClearDir(dir_path);
+  EXPECT_EQ(kOk, ret);
+
+  MergeOption option;
+  option.interval_ms = 0;
+  BitCaskDB *db = new BitCaskDB();
+  db->SetMergeOption(option);
+  ret = db->Init(dir_path);
+  EXPECT_EQ(kOk, ret);
+  ret = PutRound(db, 2000, 1);
+  EXPECT_EQ(kOk, ret);
+
+  // NOTE: Gets share the read lock and pread, and a Put only locks index after its data is synced
+  fprintf(stderr, "cpus:%ld\n", sysconf(_SC_NPROCESSORS_ONLN));
+  uint32_t threads_nums[] = {1, 2, 4, 8};
+  for (size_t i = 0; i < sizeof(threads_nums) / sizeof(threads_nums[0]); ++i) {
+    for (int with_put = 0; with_put < 2; ++with_put) {
+      uint32_t failed_num = 0;
+      uint32_t max_get_us = 0;
+      uint64_t gets_per_sec = 0;
+      ret = RunPressGet(db, threads_nums[i], with_put == 1, &failed_num, &max_get_us, &gets_per_sec);
+      EXPECT_EQ(kOk, ret);
+      EXPECT_EQ(0u, failed_num);
+      fprintf(stderr, "threads:%u, with put:%d, gets per second:%llu, max get us:%u\n", threads_nums[i], with_put,
+              (unsigned long long)gets_per_sec, max_get_us);
+    }
+  }
+  delete db;
+} /*}}}*/
+
+struct GroupPutParam { /*{{{*/
+  store::BitCaskDB *db;
+  uint32_t begin;
+  uint32_t end;
+  uint32_t failed_num;
+}; /*}}}*/
+
+static void *GroupPutAction(void *param) { /*{{{*/
+  GroupPutParam *put_param = static_cast<GroupPutParam *>(param);
+  char buf[32] = "\0";
+  for (uint32_t i = put_param->begin; i < put_param->end; ++i) {
+    snprintf(buf, sizeof(buf), "%u", (unsigned int)i);
+    base::Code ret = put_param->db->Put(std::string("group_key_") + buf, std::string(100, 'v') + buf);
+    if (ret != base::kOk) ++put_param->failed_num;
+  }
+  return NULL;
+} /*}}}*/
+
+// NOTE: db is reopened after writers finish, so writes synced on close are checked too
+static base::Code RunGroupPut(store::SyncPolicy sync_policy, uint32_t writers_num, uint32_t keys_num,
+                              uint64_t *cost_us) { /*{{{*/
+  std::string dir_path = "../data/bit_cask_group";
+  base::Code ret = ClearDir(dir_path);
+  if (ret != base::kOk) return ret;
+
+  store::BitCaskDB *db = new store::BitCaskDB();
+  db->SetSyncPolicy(sync_policy);
+  ret = db->Init(dir_path);
+  if (ret != base::kOk) return ret;
+
+  std::vector<GroupPutParam> params(writers_num);
+  std::vector<pthread_t> tids(writers_num);
+  struct timeval start;
+  gettimeofday(&start, NULL);
+  for (uint32_t i = 0; i < writers_num; ++i) {
+    params[i].db = db;
+    params[i].begin = keys_num / writers_num * i;
+    params[i].end = keys_num / writers_num * (i + 1);
+    params[i].failed_num = 0;
+    if (pthread_create(&tids[i], NULL, GroupPutAction, &params[i]) != 0) return base::kPthreadCreateFailed;
+  }
+  uint32_t failed_num = 0;
+  for (uint32_t i = 0; i < writers_num; ++i) {
+    pthread_join(tids[i], NULL);
+    failed_num += params[i].failed_num;
+  }
+  struct timeval end;
+  gettimeofday(&end, NULL);
+  *cost_us = (end.tv_sec - start.tv_sec) * 1000000 + end.tv_usec - start.tv_usec;
+  delete db;
+  if (failed_num != 0) return base::kWriteError;
+
+  db = new store::BitCaskDB();
+  ret = db->Init(dir_path);
+  char buf[32] = "\0";
+  for (uint32_t i = 0; i < keys_num && ret == base::kOk; ++i) {
+    snprintf(buf, sizeof(buf), "%u", (unsigned int)i);
+    std::string tmp_value;
+    ret = db->Get(std::string("group_key_") + buf, &tmp_value);
+    if (ret == base::kOk && tmp_value != std::string(100, 'v') + buf) ret = base::kDataIsNotConsistent;
+  }
+  delete db;
+
+  return ret;
+} /*}}}*/
+
+TEST(BitCaskDB, PressGroupCommitPut) { /*{{{*/
+  using namespace base;
+  using namespace store;
+
+  // NOTE: writers waiting at the same time share one fdatasync with group commit
+  const uint32_t kKeysNum = 1600;
+  uint32_t writers_nums[] = {1, 2, 4, 8, 16};
+  uint64_t every_write_cost_us = 0;
+  uint64_t group_commit_cost_us = 0;
+  for (size_t i = 0; i < sizeof(writers_nums) / sizeof(writers_nums[0]); ++i) {
+    Code ret = RunGroupPut(kSyncEveryWrite, writers_nums[i], kKeysNum, &every_write_cost_us);
+    EXPECT_EQ(kOk, ret);
+    ret = RunGroupPut(kSyncGroupCommit, writers_nums[i], kKeysNum, &group_commit_cost_us);
+    EXPECT_EQ(kOk, ret);
+
+    fprintf(stderr, "writers:%u, puts per second, sync every write:%llu, group commit:%llu\n", writers_nums[i],
+            (unsigned long long)kKeysNum * 1000000 / (every_write_cost_us + 1),
+            (unsigned long long)kKeysNum * 1000000 / (group_commit_cost_us + 1));
+  }
+  EXPECT_LT(group_commit_cost_us, every_write_cost_us);
+
+  uint64_t interval_cost_us = 0;
+  Code ret = RunGroupPut(kSyncInterval, 16, kKeysNum, &interval_cost_us);
+  EXPECT_EQ(kOk, ret);
+  uint64_t on_close_cost_us = 0;
+  ret = RunGroupPut(kSyncOnClose, 16, kKeysNum, &on_close_cost_us);
+  EXPECT_EQ(kOk, ret);
+  fprintf(stderr, "writers:16, puts per second, sync every %ums:%llu, sync on close:%llu\n",
+          (unsigned int)kDefaultSyncIntervalMs, (unsigned long long)kKeysNum * 1000000 / (interval_cost_us + 1),
+          (unsigned long long)kKeysNum * 1000000 / (on_close_cost_us + 1));
+} /*}}}*/
+
+TEST(BitCaskDB, NormalWriteBatchAndMultiGet) { /*{{{*/
+  using namespace base;
+  using namespace store;
+
+  std::string dir_path = "../data/bit_cask_batch";
+  Code ret = ClearDir(dir_path);
+  EXPECT_EQ(kOk, ret);
+
+  BitCaskDB *db = new BitCaskDB();
+  ret = db->Init(dir_path);
+  EXPECT_EQ(kOk, ret);
+  ret = db->Put("batch_a", "a1");
+  EXPECT_EQ(kOk, ret);
+
+  // NOTE: later operations of batch see the former ones, and version goes on for the same key
+  WriteBatch batch;
+  ret = db->Write(batch);
+  EXPECT_EQ(kOk, ret);
+  batch.Put("batch_b", "b1", 0);
+  batch.Put("batch_a", "a2", 1);
+  batch.Put("batch_c", "c1");
+  batch.Del("batch_b", 1);
+  batch.Put("batch_a", "a3", 2);
+  EXPECT_EQ(5u, batch.Count());
+  ret = db->Write(batch);
+  EXPECT_EQ(kOk, ret);
+
+  // NOTE: none of operations is applied if one fails
+  batch.Clear();
+  batch.Put("batch_d", "d1");
+  batch.Put("batch_a", "a4", 1);
+  ret = db->Write(batch);
+  EXPECT_EQ(kCASFailed, ret);
+  batch.Clear();
+  batch.Put("batch_d", "d1");
+  batch.Del("batch_b");
+  ret = db->Write(batch);
+  EXPECT_EQ(kNotFound, ret);
+
+  std::vector<std::string> keys;
+  keys.push_back("batch_a");
+  keys.push_back("batch_b");
+  keys.push_back("batch_c");
+  keys.push_back("batch_d");
+  keys.push_back("batch_a");
+  for (int i = 0; i < 2; ++i) {
+    std::vector<std::string> values;
+    std::vector<Code> rets;
+    std::vector<int64_t> versions;
+    ret = db->MultiGet(keys, &values, &rets, &versions);
+    EXPECT_EQ(kOk, ret);
+    EXPECT_EQ(keys.size(), rets.size());
+    EXPECT_EQ(kOk, rets[0]);
+    EXPECT_EQ("a3", values[0]);
+    EXPECT_EQ(3, versions[0]);
+    EXPECT_EQ(kNotFound, rets[1]);
+    EXPECT_EQ(kOk, rets[2]);
+    EXPECT_EQ("c1", values[2]);
+    EXPECT_EQ(1, versions[2]);
+    EXPECT_EQ(kNotFound, rets[3]);
+    EXPECT_EQ(kOk, rets[4]);
+    EXPECT_EQ("a3", values[4]);
+
+    DBStatusInfo status_info;
+    ret = db->GetStatus(&status_info);
+    EXPECT_EQ(kOk, ret);
+    EXPECT_EQ(2u, status_info.used_cnt);
+
+    // NOTE: records of batch are loaded from the active file, which are the same as records of Put
+    delete db;
+    db = new BitCaskDB();
+    ret = db->Init(dir_path);
+    EXPECT_EQ(kOk, ret);
+  }
+
+  ret = db->MultiGet(keys, NULL, NULL);
+  EXPECT_EQ(kInvalidParam, ret);
+  delete db;
+} /*}}}*/
+
+// NOTE: batch of 3 keys is written after key "broken_base", then cut_size bytes are cut off from the data file
+static base::Code RunBrokenBatch(uint64_t cut_size) { /*{{{*/
+  std::string dir_path = "../data/bit_cask_broken";
+  base::Code ret = ClearDir(dir_path);
+  if (ret != base::kOk) return ret;
+
+  store::BitCaskDB *db = new store::BitCaskDB();
+  ret = db->Init(dir_path);
+  if (ret == base::kOk) ret = db->Put("broken_base", "base");
+  store::WriteBatch batch;
+  batch.Put("broken_1", std::string(100, '1'));
+  batch.Put("broken_base", "base_2");
+  batch.Put("broken_3", std::string(100, '3'));
+  if (ret == base::kOk) ret = db->Write(batch);
+  delete db;
+  if (ret != base::kOk) return ret;
+
+  std::string file_path = dir_path + "/" + store::kSourceDataFilePrefix + ".00000000000000001";
+  uint64_t file_size = 0;
+  ret = base::GetFileSize(file_path, &file_size);
+  if (ret != base::kOk) return ret;
+  if (truncate(file_path.c_str(), file_size - cut_size) != 0) return base::kWriteError;
+
+  // NOTE: the broken batch is dropped, and records written after it are not taken as part of it
+  for (int i = 0; i < 2 && ret == base::kOk; ++i) {
+    db = new store::BitCaskDB();
+    ret = db->Init(dir_path);
+    std::string tmp_value;
+    if (ret == base::kOk) ret = db->Get("broken_base", &tmp_value);
+    if (ret == base::kOk && tmp_value != "base") ret = base::kDataIsNotConsistent;
+    if (ret == base::kOk && db->Get("broken_1", &tmp_value) != base::kNotFound) ret = base::kDataIsNotConsistent;
+    if (ret == base::kOk && db->Get("broken_3", &tmp_value) != base::kNotFound) ret = base::kDataIsNotConsistent;
+    if (ret == base::kOk && i == 0) ret = db->Put("broken_after", "after");
+    if (ret == base::kOk && i == 1) ret = db->Get("broken_after", &tmp_value);
+    delete db;
+  }
+  return ret;
+} /*}}}*/
+
+TEST(BitCaskDB, ExceptionBrokenBatch) { /*{{{*/
+  using namespace base;
+  using namespace store;
+
+  // NOTE: the last record is cut in the middle, or cut off completely
+  Code ret = RunBrokenBatch(50);
+  EXPECT_EQ(kOk, ret);
+  ret = RunBrokenBatch(kDataValueHeadSize + strlen("broken_3") + 100);
+  EXPECT_EQ(kOk, ret);
+} /*}}}*/
+
+// NOTE: keys are written by Put or batches of batch_size, and read by Get or MultiGet of batch_size in random order
+static base::Code RunPressBatch(uint32_t batch_size, uint32_t keys_num, uint64_t *write_cost_us,
+                                uint64_t *read_cost_us) { /*{{{*/
+  std::string dir_path = "../data/bit_cask_press";
+  base::Code ret = ClearDir(dir_path);
+  if (ret != base::kOk) return ret;
+
+  store::BitCaskDB db;
+  ret = db.Init(dir_path);
+  if (ret != base::kOk) return ret;
+
+  char buf[32] = "\0";
+  struct timeval start;
+  gettimeofday(&start, NULL);
+  store::WriteBatch batch;
+  for (uint32_t i = 0; i < keys_num; ++i) {
+    snprintf(buf, sizeof(buf), "%u", (unsigned int)i);
+    if (batch_size == 1) {
+      ret = db.Put(std::string("press_key_") + buf, std::string(100, 'v') + buf);
+      if (ret != base::kOk) return ret;
+      continue;
+    }
+
+    batch.Put(std::string("press_key_") + buf, std::string(100, 'v') + buf);
+    if (batch.Count() < batch_size && i + 1 < keys_num) continue;
+    ret = db.Write(batch);
+    if (ret != base::kOk) return ret;
+    batch.Clear();
+  }
+  struct timeval end;
+  gettimeofday(&end, NULL);
+  *write_cost_us = (end.tv_sec - start.tv_sec) * 1000000 + end.tv_usec - start.tv_usec;
+
+  std::vector<uint32_t> ids(keys_num);
+  for (uint32_t i = 0; i < keys_num; ++i) {
+    ids[i] = i;
+  }
+  srand(1);
+  for (uint32_t i = keys_num - 1; i > 0; --i) {
+    std::swap(ids[i], ids[rand() % (i + 1)]);
+  }
+
+  gettimeofday(&start, NULL);
+  for (uint32_t i = 0; i < keys_num; i += batch_size) {
+    std::vector<std::string> keys;
+    for (uint32_t j = i; j < i + batch_size && j < keys_num; ++j) {
+      snprintf(buf, sizeof(buf), "%u", (unsigned int)ids[j]);
+      keys.push_back(std::string("press_key_") + buf);
+    }
+    std::vector<std::string> values(keys.size());
+    std::vector<base::Code> rets(keys.size(), base::kOk);
+    if (batch_size == 1) {
+      rets[0] = db.Get(keys[0], &values[0]);
+    } else {
+      ret = db.MultiGet(keys, &values, &rets);
+      if (ret != base::kOk) return ret;
+    }
+
+    for (uint32_t j = 0; j < keys.size(); ++j) {
+      if (rets[j] != base::kOk) return rets[j];
+      snprintf(buf, sizeof(buf), "%u", (unsigned int)ids[i + j]);
+      if (values[j] != std::string(100, 'v') + buf) return base::kDataIsNotConsistent;
+    }
+  }
+  gettimeofday(&end, NULL);
+  *read_cost_us = (end.tv_sec - start.tv_sec) * 1000000 + end.tv_usec - start.tv_usec;
+
+  return base::kOk;
+} /*}}}*/
+
+TEST(BitCaskDB, PressWriteBatchAndMultiGet) { /*{{{*/
+  using namespace base;
+  using namespace store;
+
+  // NOTE: every Put is synced, and a batch is synced once
+  const uint32_t kKeysNum = 2000;
+  uint64_t put_cost_us = 0;
+  uint64_t get_cost_us = 0;
+  Code ret = RunPressBatch(1, kKeysNum, &put_cost_us, &get_cost_us);
+  EXPECT_EQ(kOk, ret);
+  uint64_t batch_cost_us = 0;
+  uint64_t multi_get_cost_us = 0;
+  ret = RunPressBatch(100, kKeysNum, &batch_cost_us, &multi_get_cost_us);
+  EXPECT_EQ(kOk, ret);
+
+  fprintf(stderr, "keys per second, put:%llu, write batch of 100:%llu\n",
+          (unsigned long long)kKeysNum * 1000000 / (put_cost_us + 1),
+          (unsigned long long)kKeysNum * 1000000 / (batch_cost_us + 1));
+  fprintf(stderr, "keys per second, get:%llu, multi get of 100:%llu\n",
+          (unsigned long long)kKeysNum * 1000000 / (get_cost_us + 1),
+          (unsigned long long)kKeysNum * 1000000 / (multi_get_cost_us + 1));
+  EXPECT_LT(batch_cost_us, put_cost_us);
+} /*}}}*/
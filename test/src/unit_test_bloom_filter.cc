@@ -76,6 +76,50 @@ TEST(BloomFilter, Test_Exception_Check) { /*{{{*/
 
 } /*}}}*/
 
+TEST(BloomFilter, Test_Normal_Set_Bytes_Str) { /*{{{*/
+  using namespace base;
+
+  uint32_t bits_per_key = 10;
+  uint32_t keys_num = 100;
+  uint32_t hash_num = 7;
+
+  BloomFilter bloom(bits_per_key, keys_num, hash_num);
+  Code ret = bloom.Init();
+  EXPECT_EQ(kOk, ret);
+
+  char buf[16] = "\0";
+  for (uint32_t i = 0; i < keys_num; ++i) {
+    snprintf(buf, sizeof(buf), "%u", (unsigned int)i);
+    ret = bloom.Put(std::string("key") + buf);
+    EXPECT_EQ(kOk, ret);
+  }
+  std::string bloom_arr;
+  ret = bloom.GetBytesStr(&bloom_arr);
+  EXPECT_EQ(kOk, ret);
+
+  BloomFilter loaded_bloom(bits_per_key, keys_num, hash_num);
+  ret = loaded_bloom.SetBytesStr(bloom_arr);
+  EXPECT_EQ(kNotInit, ret);
+  ret = loaded_bloom.Init();
+  EXPECT_EQ(kOk, ret);
+  ret = loaded_bloom.SetBytesStr(bloom_arr + "x");
+  EXPECT_EQ(kInvalidLength, ret);
+  ret = loaded_bloom.SetBytesStr(bloom_arr);
+  EXPECT_EQ(kOk, ret);
+
+  for (uint32_t i = 0; i < keys_num * 2; ++i) {
+    snprintf(buf, sizeof(buf), "%u", (unsigned int)i);
+    bool exist = false;
+    bool loaded_exist = false;
+    ret = bloom.CheckExist(std::string("key") + buf, &exist);
+    EXPECT_EQ(kOk, ret);
+    ret = loaded_bloom.CheckExist(std::string("key") + buf, &loaded_exist);
+    EXPECT_EQ(kOk, ret);
+    EXPECT_EQ(exist, loaded_exist);
+    if (i < keys_num) EXPECT_EQ(true, loaded_exist);
+  }
+} /*}}}*/
+
 TEST(BloomFilter, Test_Press_MillonKeys) { /*{{{*/
   using namespace base;
 
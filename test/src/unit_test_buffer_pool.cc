@@ -0,0 +1,162 @@
+// Copyright (c) 2015 The CSUTIL Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "base/buffer_pool.h"
+#include "base/mutable_buffer.h"
+#include "base/status.h"
+
+#include "test_base/include/test_base.h"
+
+TEST(BufferPool, Test_Normal_Size_Class) { /*{{{*/
+  using namespace base;
+  EXPECT_EQ(0, BufferPool::GetSizeClass(1));
+  EXPECT_EQ(0, BufferPool::GetSizeClass(kMinPoolClassSize));
+  EXPECT_EQ(1, BufferPool::GetSizeClass(kMinPoolClassSize + 1));
+  EXPECT_EQ(kPoolClassNum - 1, BufferPool::GetSizeClass(kMaxPoolClassSize));
+  EXPECT_EQ(-1, BufferPool::GetSizeClass(kMaxPoolClassSize + 1));
+  EXPECT_EQ(kMinPoolClassSize * 4, BufferPool::GetClassSize(2));
+} /*}}}*/
+
+TEST(BufferPool, Test_Normal_Hit_After_Free) { /*{{{*/
+  using namespace base;
+  BufferPool *pool = BufferPool::Instance();
+
+  uint32_t real_size = 0;
+  void *ptr1 = pool->Alloc(10000, &real_size);
+  EXPECT_NEQ((void *)NULL, ptr1);
+  EXPECT_EQ(kMinPoolClassSize * 4, real_size);
+  memset(ptr1, 'a', real_size);
+
+  BufferPoolStat stat1;
+  pool->GetStat(&stat1);
+  pool->Free(ptr1, real_size);
+
+  BufferPoolStat stat2;
+  pool->GetStat(&stat2);
+  EXPECT_EQ(stat1.resident_bytes + real_size, stat2.resident_bytes);
+  EXPECT_EQ(stat1.in_use_bytes - real_size, stat2.in_use_bytes);
+
+  // NOTE:htt, the chunk just freed is borrowed again from thread cache
+  void *ptr2 = pool->Alloc(real_size, &real_size);
+  EXPECT_EQ(ptr1, ptr2);
+
+  BufferPoolStat stat3;
+  pool->GetStat(&stat3);
+  EXPECT_EQ(stat2.hit_num + 1, stat3.hit_num);
+  EXPECT_EQ(stat2.miss_num, stat3.miss_num);
+  EXPECT_EQ(stat1.resident_bytes, stat3.resident_bytes);
+
+  pool->Free(ptr2, real_size);
+} /*}}}*/
+
+TEST(BufferPool, Test_Normal_High_Water) { /*{{{*/
+  using namespace base;
+  BufferPool *pool = BufferPool::Instance();
+  uint64_t old_high_water = pool->GetHighWaterBytes();
+
+  BufferPoolStat stat1;
+  pool->GetStat(&stat1);
+  pool->SetHighWaterBytes(stat1.resident_bytes);
+
+  uint32_t real_size = 0;
+  void *ptr = pool->Alloc(kMaxPoolClassSize, &real_size);
+  EXPECT_NEQ((void *)NULL, ptr);
+  pool->Free(ptr, real_size);
+
+  // NOTE:htt, resident bytes would be above high water, so chunk is freed to system
+  BufferPoolStat stat2;
+  pool->GetStat(&stat2);
+  EXPECT_EQ(stat1.release_num + 1, stat2.release_num);
+  EXPECT_EQ(stat1.resident_bytes, stat2.resident_bytes);
+
+  pool->SetHighWaterBytes(old_high_water);
+} /*}}}*/
+
+TEST(BufferPool, Test_Normal_Larger_Than_Max_Class) { /*{{{*/
+  using namespace base;
+  BufferPool *pool = BufferPool::Instance();
+
+  BufferPoolStat stat1;
+  pool->GetStat(&stat1);
+
+  uint32_t real_size = 0;
+  void *ptr = pool->Alloc(kMaxPoolClassSize + 1, &real_size);
+  EXPECT_NEQ((void *)NULL, ptr);
+  EXPECT_EQ(kMaxPoolClassSize + 1, real_size);
+  pool->Free(ptr, real_size);
+
+  BufferPoolStat stat2;
+  pool->GetStat(&stat2);
+  EXPECT_EQ(stat1.miss_num + 1, stat2.miss_num);
+  EXPECT_EQ(stat1.release_num + 1, stat2.release_num);
+  EXPECT_EQ(stat1.resident_bytes, stat2.resident_bytes);
+} /*}}}*/
+
+static void *FreeInOtherThread(void *arg) { /*{{{*/
+  base::BufferSlice *slice = static_cast<base::BufferSlice *>(arg);
+  slice->Reset();
+  return NULL;
+} /*}}}*/
+
+TEST(BufferPool, Test_Normal_Free_In_Other_Thread) { /*{{{*/
+  using namespace base;
+  BufferPool *pool = BufferPool::Instance();
+  pool->FlushThreadCache();
+
+  BufferSlice slice;
+  Code ret = BufferSlice::Alloc(100, &slice);
+  EXPECT_EQ(kOk, ret);
+
+  BufferPoolStat stat1;
+  pool->GetStat(&stat1);
+
+  // NOTE:htt, chunk is cached by the other thread, and flushed to central list when it exits
+  pthread_t tid;
+  pthread_create(&tid, NULL, FreeInOtherThread, &slice);
+  pthread_join(tid, NULL);
+
+  BufferPoolStat stat2;
+  pool->GetStat(&stat2);
+  EXPECT_EQ(stat1.resident_bytes + kMinPoolClassSize, stat2.resident_bytes);
+
+  ret = BufferSlice::Alloc(100, &slice);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_NEQ((const char *)NULL, slice.Data());
+
+  BufferPoolStat stat3;
+  pool->GetStat(&stat3);
+  EXPECT_EQ(stat2.hit_num + 1, stat3.hit_num);
+  EXPECT_EQ(stat2.miss_num, stat3.miss_num);
+} /*}}}*/
+
+TEST(BufferPool, Test_Normal_Buffer_Shrink) { /*{{{*/
+  using namespace base;
+  MutableBuffer buf(8);
+
+  Code ret = buf.Append("abcd", 4);
+  EXPECT_EQ(kOk, ret);
+
+  // NOTE:htt, buffer keeps its block when data is left
+  ret = buf.Shrink();
+  EXPECT_EQ(kOk, ret);
+  EXPECT_NEQ((const char *)NULL, buf.RealDataPtr());
+
+  ret = buf.Skip(4);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_NEQ((const char *)NULL, buf.RealDataPtr());
+
+  ret = buf.Shrink();
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ((const char *)NULL, buf.RealDataPtr());
+  EXPECT_EQ(0u, buf.RealDataSize());
+
+  ret = buf.Append("efgh", 4);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ(0, memcmp("efgh", buf.RealDataPtr(), 4));
+} /*}}}*/
@@ -0,0 +1,306 @@
+// Copyright (c) 2015 The CSUTIL Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "base/co_scheduler.h"
+#include "base/status.h"
+#include "base/util.h"
+#include "sock/tcp_client.h"
+
+#include "test_base/include/test_base.h"
+
+#ifdef __linux__
+
+static base::Code RunUntilDone(base::CoScheduler *sched, int max_rounds) { /*{{{*/
+  for (int i = 0; i < max_rounds && sched->GetCoroutinesNum() > 0; ++i) {
+    sched->RunOnce(10);
+  }
+  return sched->GetCoroutinesNum() == 0 ? base::kOk : base::kTimeOut;
+} /*}}}*/
+
+TEST(CoScheduler, Test_Normal_Sleep) { /*{{{*/
+  using namespace base;
+  CoScheduler sched;
+  Code ret = sched.Init(kEPoll);
+  EXPECT_EQ(kOk, ret);
+
+  std::vector<int> order;
+  int delays[] = {30, 10, 20};
+  for (int i = 0; i < 3; ++i) {
+    int delay = delays[i];
+    ret = sched.Spawn([&sched, &order, delay]() {
+      sched.Sleep(delay);
+      order.push_back(delay);
+    });
+    EXPECT_EQ(kOk, ret);
+  }
+
+  // NOTE:htt, not in a coroutine
+  ret = sched.Sleep(1);
+  EXPECT_EQ(kNotInit, ret);
+
+  ret = RunUntilDone(&sched, 100);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ(3u, order.size());
+  EXPECT_EQ(10, order[0]);
+  EXPECT_EQ(20, order[1]);
+  EXPECT_EQ(30, order[2]);
+  EXPECT_TRUE(CoScheduler::Current() == NULL);
+} /*}}}*/
+
+TEST(CoScheduler, Test_Normal_Read_Write) { /*{{{*/
+  using namespace base;
+  CoScheduler sched;
+  Code ret = sched.Init(kEPoll);
+  EXPECT_EQ(kOk, ret);
+
+  int fds[2];
+  EXPECT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  SetFdNonblock(fds[0]);
+  SetFdNonblock(fds[1]);
+
+  // NOTE:htt, reader waits first, and it's resumed by the writer after the writer sleeps
+  std::string received;
+  Code read_ret = kOtherFailed;
+  ret = sched.Spawn([&]() {
+    char buf[64];
+    while (received.size() < 10) {
+      ssize_t n = 0;
+      read_ret = sched.Read(fds[0], buf, sizeof(buf), 1000, &n);
+      if (read_ret != kOk || n == 0) break;
+      received.append(buf, n);
+    }
+  });
+  EXPECT_EQ(kOk, ret);
+
+  Code write_ret = kOtherFailed;
+  ret = sched.Spawn([&]() {
+    sched.Sleep(5);
+    write_ret = sched.Write(fds[1], "hello", 5, 1000);
+    sched.Yield();
+    if (write_ret == kOk) write_ret = sched.Write(fds[1], "world", 5, 1000);
+  });
+  EXPECT_EQ(kOk, ret);
+
+  ret = RunUntilDone(&sched, 100);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ(kOk, read_ret);
+  EXPECT_EQ(kOk, write_ret);
+  EXPECT_EQ("helloworld", received);
+
+  // NOTE:htt, nothing to read, then time out
+  Code timeout_ret = kOk;
+  ret = sched.Spawn([&]() {
+    char buf[8];
+    ssize_t n = 0;
+    timeout_ret = sched.Read(fds[0], buf, sizeof(buf), 20, &n);
+  });
+  ret = RunUntilDone(&sched, 100);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ(kTimeOut, timeout_ret);
+
+  close(fds[0]);
+  close(fds[1]);
+} /*}}}*/
+
+TEST(CoScheduler, Test_Normal_Connect) { /*{{{*/
+  using namespace base;
+  CoScheduler sched;
+  Code ret = sched.Init(kEPoll);
+  EXPECT_EQ(kOk, ret);
+
+  int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = 0;
+  EXPECT_EQ(0, bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)));
+  EXPECT_EQ(0, listen(listen_fd, 16));
+  socklen_t addr_len = sizeof(addr);
+  EXPECT_EQ(0, getsockname(listen_fd, (struct sockaddr *)&addr, &addr_len));
+  SetFdNonblock(listen_fd);
+
+  // NOTE:htt, server accepts in one coroutine, and client connects in another one of the same thread
+  std::string echoed;
+  ret = sched.Spawn([&]() {
+    if (sched.WaitFd(listen_fd, EV_IN, 1000, NULL) != kOk) return;
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd == -1) return;
+    SetFdNonblock(fd);
+    char buf[16];
+    ssize_t n = 0;
+    if (sched.Read(fd, buf, sizeof(buf), 1000, &n) == kOk && n > 0) sched.Write(fd, buf, n, 1000);
+    close(fd);
+  });
+  EXPECT_EQ(kOk, ret);
+
+  Code connect_ret = kOtherFailed;
+  ret = sched.Spawn([&]() {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    SetFdNonblock(fd);
+    connect_ret = sched.Connect(fd, (struct sockaddr *)&addr, sizeof(addr), 1000);
+    if (connect_ret == kOk && sched.Write(fd, "ping", 4, 1000) == kOk) {
+      char buf[16];
+      ssize_t n = 0;
+      if (sched.Read(fd, buf, sizeof(buf), 1000, &n) == kOk) echoed.assign(buf, n);
+    }
+    close(fd);
+  });
+  EXPECT_EQ(kOk, ret);
+
+  ret = RunUntilDone(&sched, 200);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ(kOk, connect_ret);
+  EXPECT_EQ("ping", echoed);
+
+  close(listen_fd);
+} /*}}}*/
+
+static base::Code FixedLenProtoFunc(const char *src_data, int src_data_len, int *real_len) { /*{{{*/
+  if (src_data_len < 4) return base::kDataNotEnough;
+  *real_len = 4;
+  return base::kOk;
+} /*}}}*/
+
+// NOTE:htt, blocking style TcpClient in coroutine only suspends the coroutine, and server runs in the same thread
+TEST(CoScheduler, Test_Normal_Tcp_Client) { /*{{{*/
+  using namespace base;
+  CoScheduler sched;
+  Code ret = sched.Init(kEPoll);
+  EXPECT_EQ(kOk, ret);
+
+  int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = 0;
+  EXPECT_EQ(0, bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)));
+  EXPECT_EQ(0, listen(listen_fd, 128));
+  socklen_t addr_len = sizeof(addr);
+  EXPECT_EQ(0, getsockname(listen_fd, (struct sockaddr *)&addr, &addr_len));
+  SetFdNonblock(listen_fd);
+
+  const int clients_num = 50;
+  ret = sched.Spawn([&]() {
+    for (int i = 0; i < clients_num; ++i) {
+      if (sched.WaitFd(listen_fd, EV_IN, 1000, NULL) != kOk) return;
+      int fd = accept(listen_fd, NULL, NULL);
+      if (fd == -1) return;
+      SetFdNonblock(fd);
+      sched.Spawn([&sched, fd]() {
+        char buf[4];
+        ssize_t n = 0;
+        if (sched.Read(fd, buf, sizeof(buf), 1000, &n) == kOk && n == 4) {
+          sched.Sleep(10);  // NOTE:htt, all clients wait at the same time
+          sched.Write(fd, buf, n, 1000);
+        }
+        close(fd);
+      });
+    }
+  });
+  EXPECT_EQ(kOk, ret);
+
+  int ok_num = 0;
+  for (int i = 0; i < clients_num; ++i) {
+    ret = sched.Spawn([&sched, &addr, &ok_num, i]() {
+      TcpClient client;
+      if (client.Init(kEPoll, FixedLenProtoFunc) != kOk) return;
+      if (client.Connect("127.0.0.1", ntohs(addr.sin_port)) != kOk) return;
+      char req[5];
+      snprintf(req, sizeof(req), "%04d", i);
+      if (client.SendNative(std::string(req, 4)) != kOk) return;
+      std::string resp;
+      if (client.Recv(&resp) == kOk && resp == std::string(req, 4)) ++ok_num;
+    });
+    EXPECT_EQ(kOk, ret);
+  }
+
+  struct timeval start, end;
+  gettimeofday(&start, NULL);
+  ret = RunUntilDone(&sched, 500);
+  gettimeofday(&end, NULL);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ(clients_num, ok_num);
+
+  // NOTE:htt, 50 waits of 10ms overlap in one thread
+  double cost_ms = (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_usec - start.tv_usec) / 1000.0;
+  EXPECT_TRUE(cost_ms < clients_num * 10);
+  fprintf(stderr, "clients:%d, cost:%.1fms\n", clients_num, cost_ms);
+
+  close(listen_fd);
+} /*}}}*/
+
+static const int kPressPairsNum = 1000;
+static const int kPressRoundsNum = 20;
+
+/**
+ * NOTE:htt, 1000 coroutines in one thread, each of them does request-response by socketpair, while a responder
+ * coroutine per pair echoes after a short sleep, which is like a handler waiting for its downstream
+ */
+TEST(CoScheduler, Test_Press_Concurrent_Waits) { /*{{{*/
+  using namespace base;
+  CoScheduler sched;
+  Code ret = sched.Init(kEPoll);
+  EXPECT_EQ(kOk, ret);
+
+  std::vector<int> fds(kPressPairsNum * 2, -1);
+  for (int i = 0; i < kPressPairsNum; ++i) {
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, &fds[i * 2]) != 0) break;
+    SetFdNonblock(fds[i * 2]);
+    SetFdNonblock(fds[i * 2 + 1]);
+  }
+
+  uint64_t done_num = 0;
+  for (int i = 0; i < kPressPairsNum; ++i) {
+    int client_fd = fds[i * 2];
+    int server_fd = fds[i * 2 + 1];
+    sched.Spawn([&sched, &done_num, client_fd]() {
+      for (int r = 0; r < kPressRoundsNum; ++r) {
+        char buf[8];
+        ssize_t n = 0;
+        if (sched.Write(client_fd, "12345678", 8, 1000) != kOk) return;
+        if (sched.Read(client_fd, buf, sizeof(buf), 1000, &n) != kOk || n != 8) return;
+        ++done_num;
+      }
+    });
+    sched.Spawn([&sched, server_fd]() {
+      for (int r = 0; r < kPressRoundsNum; ++r) {
+        char buf[8];
+        ssize_t n = 0;
+        if (sched.Read(server_fd, buf, sizeof(buf), 1000, &n) != kOk || n != 8) return;
+        sched.Sleep(1);
+        if (sched.Write(server_fd, buf, n, 1000) != kOk) return;
+      }
+    });
+  }
+
+  struct timeval start, end;
+  gettimeofday(&start, NULL);
+  ret = RunUntilDone(&sched, 10000);
+  gettimeofday(&end, NULL);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ((uint64_t)kPressPairsNum * kPressRoundsNum, done_num);
+
+  double cost_ms = (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_usec - start.tv_usec) / 1000.0;
+  fprintf(stderr, "coroutines:%d, requests:%lu, cost:%.1fms, requests/sec:%.0f\n", kPressPairsNum * 2, done_num,
+          cost_ms, done_num * 1000.0 / (cost_ms > 0 ? cost_ms : 1));
+
+  for (size_t i = 0; i < fds.size(); ++i) {
+    if (fds[i] != -1) close(fds[i]);
+  }
+} /*}}}*/
+
+#endif
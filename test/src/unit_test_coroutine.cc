@@ -3,6 +3,10 @@
 // found in the LICENSE file.
 
 #include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <vector>
 
 #include "base/coroutine.h"
 #include "base/status.h"
@@ -169,6 +173,167 @@ TEST(Disptach, Test_Exception_Yield_Twice) { /*{{{*/
   dispatch = NULL;
 } /*}}}*/
 
+struct StackCheckParam {
+  int rounds;
+  int seed;
+  int bad_num;
+};
+
+// NOTE:htt, locals should be kept by every yield, whatever other coroutines write on their stacks
+void CoroutineFuncStackCheck(base::Dispatch *dispatch, void *param) { /*{{{*/
+  StackCheckParam *check = (StackCheckParam *)(param);
+  char buf[4096];
+  for (int i = 0; i < check->rounds; ++i) {
+    memset(buf, (char)(check->seed + i), sizeof(buf));
+    dispatch->CoroutineYield();
+    for (size_t j = 0; j < sizeof(buf); ++j) {
+      if (buf[j] != (char)(check->seed + i)) {
+        ++check->bad_num;
+        break;
+      }
+    }
+  }
+} /*}}}*/
+
+static base::Code RunAll(base::Dispatch *dispatch, const std::vector<uint32_t> &ids) { /*{{{*/
+  using namespace base;
+  uint32_t coroutines_num = 0;
+  while (dispatch->GetCoroutinesNum(&coroutines_num) == kOk && coroutines_num > 0) {
+    for (size_t i = 0; i < ids.size(); ++i) {
+      bool exist = false;
+      Code ret = dispatch->CheckCoroutineExist(ids[i], &exist);
+      if (ret != kOk) return ret;
+      if (!exist) continue;
+      ret = dispatch->CoroutineResume(ids[i]);
+      if (ret != kOk) return ret;
+    }
+  }
+  return kOk;
+} /*}}}*/
+
+TEST(Disptach, Test_Normal_Private_Stack) { /*{{{*/
+  using namespace base;
+  Dispatch dispatch(kPrivateStackMode);
+  EXPECT_EQ(kPrivateStackMode, dispatch.GetStackMode());
+  fprintf(stderr, "fast switch:%d\n", Dispatch::IsFastSwitch());
+
+  StackCheckParam params[8];
+  std::vector<uint32_t> ids;
+  for (int i = 0; i < 8; ++i) {
+    params[i].rounds = 10;
+    params[i].seed = i * 16;
+    params[i].bad_num = 0;
+    uint32_t id = 0;
+    Code ret = dispatch.CreateCoroutine(CoroutineFuncStackCheck, &params[i], &id);
+    EXPECT_EQ(kOk, ret);
+    ids.push_back(id);
+  }
+
+  Code ret = RunAll(&dispatch, ids);
+  EXPECT_EQ(kOk, ret);
+  for (int i = 0; i < 8; ++i) {
+    EXPECT_EQ(0, params[i].bad_num);
+  }
+
+  // NOTE:htt, stacks of finished coroutines are pooled, and reused by new ones
+  EXPECT_EQ(8u, dispatch.GetPooledStacksNum());
+  ids.clear();
+  for (int i = 0; i < 3; ++i) {
+    uint32_t id = 0;
+    ret = dispatch.CreateCoroutine(CoroutineFuncStackCheck, &params[i], &id);
+    EXPECT_EQ(kOk, ret);
+    ids.push_back(id);
+    ret = dispatch.CoroutineResume(id);
+    EXPECT_EQ(kOk, ret);
+  }
+  EXPECT_EQ(5u, dispatch.GetPooledStacksNum());
+  ret = RunAll(&dispatch, ids);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ(8u, dispatch.GetPooledStacksNum());
+
+  ret = dispatch.CoroutineResume(ids[0]);
+  EXPECT_EQ(kInvalidCoroutineId, ret);
+} /*}}}*/
+
+TEST(Disptach, Test_Normal_Shared_Stack_Mode) { /*{{{*/
+  using namespace base;
+  Dispatch dispatch(kSharedStackMode);
+  StackCheckParam params[4];
+  std::vector<uint32_t> ids;
+  for (int i = 0; i < 4; ++i) {
+    params[i].rounds = 10;
+    params[i].seed = i * 16;
+    params[i].bad_num = 0;
+    uint32_t id = 0;
+    Code ret = dispatch.CreateCoroutine(CoroutineFuncStackCheck, &params[i], &id);
+    EXPECT_EQ(kOk, ret);
+    ids.push_back(id);
+  }
+  Code ret = RunAll(&dispatch, ids);
+  EXPECT_EQ(kOk, ret);
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_EQ(0, params[i].bad_num);
+  }
+  EXPECT_EQ(0u, dispatch.GetPooledStacksNum());
+} /*}}}*/
+
+static const int kPressCoroutinesNum = 100;
+static const int kPressSwitchRounds = 2000;
+
+struct SwitchParam {
+  int rounds;
+  int stack_used;  // NOTE:htt, bytes of stack live during yield, which is copied by shared stack mode
+};
+
+void CoroutineFuncSwitch(base::Dispatch *dispatch, void *param) { /*{{{*/
+  SwitchParam *sp = (SwitchParam *)(param);
+  char *buf = (char *)alloca(sp->stack_used);
+  memset(buf, 0, sp->stack_used);
+  for (int i = 0; i < sp->rounds; ++i) {
+    buf[i % sp->stack_used] = (char)i;
+    dispatch->CoroutineYield();
+  }
+} /*}}}*/
+
+static base::Code PressSwitch(base::CoroutineStackMode mode, int stack_used, double *ns_per_switch) { /*{{{*/
+  using namespace base;
+  Dispatch dispatch(mode);
+  SwitchParam param = {kPressSwitchRounds, stack_used};
+  std::vector<uint32_t> ids;
+  for (int i = 0; i < kPressCoroutinesNum; ++i) {
+    uint32_t id = 0;
+    Code ret = dispatch.CreateCoroutine(CoroutineFuncSwitch, &param, &id);
+    if (ret != kOk) return ret;
+    ids.push_back(id);
+  }
+
+  struct timeval start, end;
+  gettimeofday(&start, NULL);
+  Code ret = RunAll(&dispatch, ids);
+  gettimeofday(&end, NULL);
+  if (ret != kOk) return ret;
+
+  double cost_ns = ((end.tv_sec - start.tv_sec) * 1000000.0 + (end.tv_usec - start.tv_usec)) * 1000;
+  uint64_t switch_num = (uint64_t)kPressCoroutinesNum * (kPressSwitchRounds + 1) * 2;  // NOTE:htt, resume + yield
+  *ns_per_switch = cost_ns / switch_num;
+  return kOk;
+} /*}}}*/
+
+TEST(Disptach, Test_Press_Switch) { /*{{{*/
+  using namespace base;
+  int stack_useds[] = {256, 4096, 32768};
+  for (size_t i = 0; i < sizeof(stack_useds) / sizeof(stack_useds[0]); ++i) {
+    double shared_ns = 0;
+    double private_ns = 0;
+    Code ret = PressSwitch(kSharedStackMode, stack_useds[i], &shared_ns);
+    EXPECT_EQ(kOk, ret);
+    ret = PressSwitch(kPrivateStackMode, stack_useds[i], &private_ns);
+    EXPECT_EQ(kOk, ret);
+    fprintf(stderr, "stack used:%d, shared stack ns/switch:%.1f, private stack ns/switch:%.1f\n", stack_useds[i],
+            shared_ns, private_ns);
+  }
+} /*}}}*/
+
 #elif __APPLE__
 // getcontext/makecontext is deprecated: first deprecated in macOS 10.6
 // 则通过getcontext等实现协程则在mac下不再支持
@@ -0,0 +1,95 @@
+// Copyright (c) 2015 The CSUTIL Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <string>
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "base/count_min_sketch.h"
+#include "base/status.h"
+
+#include "test_base/include/test_base.h"
+
+static std::string GetKey(uint32_t i) { /*{{{*/
+  char buf[32] = "\0";
+  snprintf(buf, sizeof(buf), "key%u", (unsigned int)i);
+  return buf;
+} /*}}}*/
+
+TEST(CountMinSketch, Test_Normal_Estimate) { /*{{{*/
+  using namespace base;
+
+  CountMinSketch sketch;
+  EXPECT_EQ(0u, sketch.Estimate("key1"));
+  Code ret = sketch.Init(0);
+  EXPECT_EQ(kInvalidParam, ret);
+  ret = sketch.Init(1000);
+  EXPECT_EQ(kOk, ret);
+
+  for (uint32_t i = 0; i < 5; ++i) {
+    sketch.Increment("key1");
+  }
+  sketch.Increment("key2");
+  EXPECT_EQ(5u, sketch.Estimate("key1"));
+  EXPECT_EQ(1u, sketch.Estimate("key2"));
+  EXPECT_EQ(0u, sketch.Estimate("key3"));
+
+  // NOTE: counters saturate at 15
+  for (uint32_t i = 0; i < 100; ++i) {
+    sketch.Increment("key1");
+  }
+  EXPECT_EQ(15u, sketch.Estimate("key1"));
+
+  sketch.Reset();
+  EXPECT_EQ(0u, sketch.Estimate("key1"));
+} /*}}}*/
+
+TEST(CountMinSketch, Test_Normal_Hot_Keys) { /*{{{*/
+  using namespace base;
+
+  // NOTE: estimation is never less than the real count, and collisions of cold keys are small
+  CountMinSketch sketch;
+  Code ret = sketch.Init(10000, 1000);
+  EXPECT_EQ(kOk, ret);
+  for (uint32_t i = 0; i < 10000; ++i) {
+    sketch.Increment(GetKey(i));
+    if (i % 100 == 0) {
+      for (uint32_t j = 0; j < 8; ++j) sketch.Increment(GetKey(i));
+    }
+  }
+
+  uint32_t wrong_num = 0;
+  for (uint32_t i = 0; i < 10000; ++i) {
+    uint32_t freq = sketch.Estimate(GetKey(i));
+    if (i % 100 == 0) {
+      EXPECT_EQ(true, freq >= 9u);
+    } else {
+      EXPECT_EQ(true, freq >= 1u);
+      if (freq > 2) ++wrong_num;
+    }
+  }
+  fprintf(stderr, "cold keys estimated more than 2:%u\n", wrong_num);
+  EXPECT_LT(wrong_num, 100u);
+} /*}}}*/
+
+TEST(CountMinSketch, Test_Normal_Aging) { /*{{{*/
+  using namespace base;
+
+  // NOTE: sample size is 16 * 10, so counters are halved after 160 increments
+  CountMinSketch sketch;
+  Code ret = sketch.Init(16, 10);
+  EXPECT_EQ(kOk, ret);
+  for (uint32_t i = 0; i < 8; ++i) {
+    sketch.Increment("hot");
+  }
+  EXPECT_EQ(8u, sketch.Estimate("hot"));
+
+  for (uint32_t i = 0; sketch.GetResetNum() == 0 && i < 1000; ++i) {
+    sketch.Increment(GetKey(i % 1000));
+  }
+  EXPECT_EQ(1u, sketch.GetResetNum());
+  EXPECT_LT(sketch.Estimate("hot"), 8u);
+  EXPECT_GT(sketch.Estimate("hot"), 3u);
+} /*}}}*/
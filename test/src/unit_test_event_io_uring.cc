@@ -0,0 +1,397 @@
+// Copyright (c) 2015 The CSUTIL Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "base/event_loop.h"
+#include "base/status.h"
+
+#include "test_base/include/test_base.h"
+
+static base::Code CountEventAction(int fd, int evt, void *param) { /*{{{*/
+  ++*static_cast<uint64_t *>(param);
+  return base::kOk;
+} /*}}}*/
+
+TEST(EventIoUring, Test_Normal_Level_Triggered) { /*{{{*/
+  using namespace base;
+  EventLoop loop;
+  Code ret = loop.Init(kIoUring);
+  EXPECT_EQ(kOk, ret);
+
+  int fds[2];
+  EXPECT_EQ(0, pipe(fds));
+  EXPECT_EQ(1, write(fds[1], "a", 1));
+
+  // NOTE:htt, data is not read, so the re-armed poll is fired in every wait like epoll
+  uint64_t num1 = 0;
+  ret = loop.Add(fds[0], EV_IN, CountEventAction, &num1);
+  EXPECT_EQ(kOk, ret);
+  for (int i = 0; i < 3; ++i) {
+    ret = loop.RunOnce(100);
+    EXPECT_EQ(kOk, ret);
+  }
+  EXPECT_EQ(3u, num1);
+
+  uint64_t num2 = 0;
+  ret = loop.Mod(fds[0], EV_IN, CountEventAction, &num2);
+  EXPECT_EQ(kOk, ret);
+  ret = loop.RunOnce(100);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ(3u, num1);
+  EXPECT_EQ(1u, num2);
+
+  ret = loop.Del(fds[0]);
+  EXPECT_EQ(kOk, ret);
+  ret = loop.RunOnce(0);
+  EXPECT_EQ(kTimeOut, ret);
+  EXPECT_EQ(1u, num2);
+
+  ret = loop.Add(fds[0], EV_IN, CountEventAction, &num2);
+  EXPECT_EQ(kOk, ret);
+  ret = loop.RunOnce(100);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ(2u, num2);
+
+  close(fds[0]);
+  close(fds[1]);
+} /*}}}*/
+
+TEST(EventIoUring, Test_Normal_Recv_Send) { /*{{{*/
+  using namespace base;
+  if (!EventIoUring::IsSupported()) {
+    fprintf(stderr, "io_uring is not supported, skip\n");
+    return;
+  }
+
+  EventIoUring ring;
+  Code ret = ring.Create(64);
+  EXPECT_EQ(kOk, ret);
+
+  int fds[2];
+  EXPECT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+
+  // NOTE:htt, recv is submitted before data comes, and both are completed in one wait
+  char buf[16] = {0};
+  ret = ring.SubmitRecv(fds[1], buf, sizeof(buf), 1);
+  EXPECT_EQ(kOk, ret);
+  ret = ring.SubmitSend(fds[0], "hello", 5, 2);
+  EXPECT_EQ(kOk, ret);
+  ret = ring.SubmitSend(fds[0], "hello", 5, kMaxIoUringUserData + 1);
+  EXPECT_EQ(kInvalidParam, ret);
+
+  int recv_res = 0;
+  int send_res = 0;
+  for (int i = 0; i < 10 && (recv_res == 0 || send_res == 0); ++i) {
+    ret = ring.Wait(100);
+    const IoCompletion *cqes = NULL;
+    int num = 0;
+    if (ring.GetCompletions(&cqes, &num) != kOk) continue;
+    for (int j = 0; j < num; ++j) {
+      if (cqes[j].user_data == 1) recv_res = cqes[j].res;
+      if (cqes[j].user_data == 2) send_res = cqes[j].res;
+    }
+  }
+  EXPECT_EQ(5, recv_res);
+  EXPECT_EQ(5, send_res);
+  EXPECT_EQ(0, memcmp("hello", buf, 5));
+
+  close(fds[0]);
+  close(fds[1]);
+} /*}}}*/
+
+TEST(EventIoUring, Test_Normal_Registered_Buffers) { /*{{{*/
+  using namespace base;
+  if (!EventIoUring::IsSupported()) return;
+
+  EventIoUring ring;
+  Code ret = ring.Create(64);
+  EXPECT_EQ(kOk, ret);
+
+  static char buf[4096];
+  struct iovec iov = {buf, sizeof(buf)};
+  ret = ring.RegisterBuffers(&iov, 1);
+  if (ret != kOk) {
+    fprintf(stderr, "Failed to register buffers, ret:%d, skip\n", ret);
+    return;
+  }
+  EXPECT_TRUE(ring.IsBuffersRegistered());
+
+  int fds[2];
+  EXPECT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+
+  memcpy(buf, "world", 5);
+  ret = ring.SubmitReadFixed(fds[1], 0, buf + 2048, 16, 1);
+  EXPECT_EQ(kOk, ret);
+  ret = ring.SubmitWriteFixed(fds[0], 0, buf, 5, 2);
+  EXPECT_EQ(kOk, ret);
+
+  int done_num = 0;
+  for (int i = 0; i < 10 && done_num < 2; ++i) {
+    ring.Wait(100);
+    const IoCompletion *cqes = NULL;
+    int num = 0;
+    if (ring.GetCompletions(&cqes, &num) != kOk) continue;
+    for (int j = 0; j < num; ++j) {
+      EXPECT_EQ(5, cqes[j].res);
+      ++done_num;
+    }
+  }
+  EXPECT_EQ(2, done_num);
+  EXPECT_EQ(0, memcmp("world", buf + 2048, 5));
+
+  close(fds[0]);
+  close(fds[1]);
+} /*}}}*/
+
+TEST(EventIoUring, Test_Normal_Accept) { /*{{{*/
+  using namespace base;
+  if (!EventIoUring::IsSupported()) return;
+
+  EventIoUring ring;
+  Code ret = ring.Create(64);
+  EXPECT_EQ(kOk, ret);
+
+  int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = 0;
+  EXPECT_EQ(0, bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)));
+  EXPECT_EQ(0, listen(listen_fd, 16));
+  socklen_t addr_len = sizeof(addr);
+  EXPECT_EQ(0, getsockname(listen_fd, (struct sockaddr *)&addr, &addr_len));
+
+  ret = ring.SubmitAccept(listen_fd, 7);
+  EXPECT_EQ(kOk, ret);
+
+  const int kClientNum = 3;
+  std::vector<int> client_fds;
+  for (int i = 0; i < kClientNum; ++i) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    EXPECT_EQ(0, connect(fd, (struct sockaddr *)&addr, sizeof(addr)));
+    client_fds.push_back(fd);
+  }
+
+  // NOTE:htt, one sqe accepts all clients if multishot, otherwise accept is submitted again
+  std::vector<int> accepted_fds;
+  for (int i = 0; i < 20 && (int)accepted_fds.size() < kClientNum; ++i) {
+    ring.Wait(100);
+    const IoCompletion *cqes = NULL;
+    int num = 0;
+    if (ring.GetCompletions(&cqes, &num) != kOk) continue;
+    for (int j = 0; j < num; ++j) {
+      EXPECT_EQ(7u, cqes[j].user_data);
+      EXPECT_TRUE(cqes[j].res >= 0);
+      if (cqes[j].res >= 0) accepted_fds.push_back(cqes[j].res);
+      if (!ring.IsMultishotAccept()) ring.SubmitAccept(listen_fd, 7);
+    }
+  }
+  EXPECT_EQ(kClientNum, (int)accepted_fds.size());
+  for (size_t i = 0; i < accepted_fds.size(); ++i) {
+    EXPECT_TRUE((fcntl(accepted_fds[i], F_GETFL) & O_NONBLOCK) != 0);
+    close(accepted_fds[i]);
+  }
+
+  for (size_t i = 0; i < client_fds.size(); ++i) {
+    close(client_fds[i]);
+  }
+  ring.SubmitCancel(7);
+  ring.Wait(0);
+  close(listen_fd);
+} /*}}}*/
+
+#if defined(__linux__)
+static const int kEchoConnNum = 256;
+static const int kEchoRoundNum = 200;
+static const int kEchoMsgSize = 64;
+
+struct EchoStat { /*{{{*/
+  uint64_t syscall_num;
+  uint64_t request_num;
+  double cost_us;
+}; /*}}}*/
+
+static void PrintEchoStat(const char *name, const EchoStat &stat) { /*{{{*/
+  fprintf(stderr, "%s, requests:%lu, syscalls:%lu, syscalls/request:%.3f, requests/sec:%.0f\n", name,
+          stat.request_num, stat.syscall_num, (double)stat.syscall_num / stat.request_num,
+          stat.request_num * 1000000.0 / (stat.cost_us > 0 ? stat.cost_us : 1));
+} /*}}}*/
+
+static double GetCostUs(const timeval &start, const timeval &end) { /*{{{*/
+  return (end.tv_sec - start.tv_sec) * 1000000.0 + (end.tv_usec - start.tv_usec);
+} /*}}}*/
+
+static base::Code SendOrRecvEcho(const std::vector<int> &client_fds, bool is_send) { /*{{{*/
+  char msg[kEchoMsgSize];
+  memset(msg, 'e', sizeof(msg));
+  for (size_t i = 0; i < client_fds.size(); ++i) {
+    int r = is_send ? write(client_fds[i], msg, sizeof(msg)) : read(client_fds[i], msg, sizeof(msg));
+    if (r != kEchoMsgSize) return base::kIOError;
+  }
+
+  return base::kOk;
+} /*}}}*/
+
+// NOTE:htt, server is woken up by epoll, and reads and writes every request by itself
+static base::Code EchoByEpoll(const std::vector<int> &server_fds, const std::vector<int> &client_fds,
+                              EchoStat *stat) { /*{{{*/
+  using namespace base;
+  EventEpoll ev;
+  Code ret = ev.Create(kDefaultSizeOfFds);
+  if (ret != kOk) return ret;
+  for (size_t i = 0; i < server_fds.size(); ++i) {
+    ret = ev.Add(server_fds[i], EV_IN);
+    if (ret != kOk) return ret;
+  }
+
+  memset(stat, 0, sizeof(*stat));
+  struct timeval start, end;
+  gettimeofday(&start, NULL);
+  for (int round = 0; round < kEchoRoundNum; ++round) {
+    ret = SendOrRecvEcho(client_fds, true);
+    if (ret != kOk) return ret;
+
+    size_t echo_num = 0;
+    while (echo_num < server_fds.size()) {
+      ++stat->syscall_num;
+      if (ev.Wait(-1) != kOk) continue;
+
+      const FiredEvent *evts = NULL;
+      int num = 0;
+      if (ev.GetFiredEvents(&evts, &num) != kOk) continue;
+      for (int i = 0; i < num; ++i) {
+        char buf[kEchoMsgSize];
+        ++stat->syscall_num;
+        int r = read(evts[i].fd, buf, sizeof(buf));
+        if (r <= 0) continue;
+        ++stat->syscall_num;
+        if (write(evts[i].fd, buf, r) != r) return kWriteError;
+        ++echo_num;
+      }
+    }
+
+    ret = SendOrRecvEcho(client_fds, false);
+    if (ret != kOk) return ret;
+  }
+  gettimeofday(&end, NULL);
+  stat->request_num = (uint64_t)kEchoRoundNum * server_fds.size();
+  stat->cost_us = GetCostUs(start, end);
+
+  return kOk;
+} /*}}}*/
+
+/**
+ * NOTE:htt, recv is submitted before request comes, and send is submitted on its completion;
+ * all of them are submitted in io_uring_enter of Wait, and registered buffers are used if possible
+ */
+static base::Code EchoByIoUring(const std::vector<int> &server_fds, const std::vector<int> &client_fds,
+                                EchoStat *stat) { /*{{{*/
+  using namespace base;
+  std::vector<char> bufs(server_fds.size() * kEchoMsgSize);  // NOTE:htt, kept until ring is destroyed
+  EventIoUring ring;
+  Code ret = ring.Create(server_fds.size() * 2);
+  if (ret != kOk) return ret;
+
+  struct iovec iov = {&bufs[0], bufs.size()};
+  bool is_fixed = ring.RegisterBuffers(&iov, 1) == kOk;
+  fprintf(stderr, "io_uring registered buffers:%d\n", is_fixed);
+
+  // NOTE:htt, user data is index * 2 for recv, and index * 2 + 1 for send
+  for (size_t i = 0; i < server_fds.size(); ++i) {
+    char *buf = &bufs[i * kEchoMsgSize];
+    ret = is_fixed ? ring.SubmitReadFixed(server_fds[i], 0, buf, kEchoMsgSize, i * 2)
+                   : ring.SubmitRecv(server_fds[i], buf, kEchoMsgSize, i * 2);
+    if (ret != kOk) return ret;
+  }
+
+  memset(stat, 0, sizeof(*stat));
+  uint64_t start_enter_num = ring.GetEnterNum();
+  struct timeval start, end;
+  gettimeofday(&start, NULL);
+  for (int round = 0; round < kEchoRoundNum; ++round) {
+    ret = SendOrRecvEcho(client_fds, true);
+    if (ret != kOk) return ret;
+
+    size_t echo_num = 0;
+    while (echo_num < server_fds.size()) {
+      if (ring.Wait(-1) != kOk) continue;
+
+      const IoCompletion *cqes = NULL;
+      int num = 0;
+      if (ring.GetCompletions(&cqes, &num) != kOk) continue;
+      for (int i = 0; i < num; ++i) {
+        if (cqes[i].res <= 0) return kIOError;
+        size_t idx = cqes[i].user_data / 2;
+        int fd = server_fds[idx];
+        char *buf = &bufs[idx * kEchoMsgSize];
+
+        if (cqes[i].user_data % 2 == 0) {
+          ret = is_fixed ? ring.SubmitWriteFixed(fd, 0, buf, cqes[i].res, idx * 2 + 1)
+                         : ring.SubmitSend(fd, buf, cqes[i].res, idx * 2 + 1);
+        } else {
+          ++echo_num;
+          ret = is_fixed ? ring.SubmitReadFixed(fd, 0, buf, kEchoMsgSize, idx * 2)
+                         : ring.SubmitRecv(fd, buf, kEchoMsgSize, idx * 2);
+        }
+        if (ret != kOk) return ret;
+      }
+    }
+
+    ret = SendOrRecvEcho(client_fds, false);
+    if (ret != kOk) return ret;
+  }
+  gettimeofday(&end, NULL);
+  stat->syscall_num = ring.GetEnterNum() - start_enter_num;
+  stat->request_num = (uint64_t)kEchoRoundNum * server_fds.size();
+  stat->cost_us = GetCostUs(start, end);
+
+  return kOk;
+} /*}}}*/
+
+TEST(EventIoUring, Test_Press_Echo) { /*{{{*/
+  using namespace base;
+  if (!EventIoUring::IsSupported()) return;
+
+  std::vector<int> server_fds;
+  std::vector<int> client_fds;
+  for (int i = 0; i < kEchoConnNum; ++i) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) break;
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+    server_fds.push_back(fds[0]);
+    client_fds.push_back(fds[1]);
+  }
+  EXPECT_EQ(kEchoConnNum, (int)server_fds.size());
+
+  // NOTE:htt, syscalls of server are counted, and the ones of clients are not
+  EchoStat epoll_stat;
+  Code ret = EchoByEpoll(server_fds, client_fds, &epoll_stat);
+  EXPECT_EQ(kOk, ret);
+  PrintEchoStat("epoll echo", epoll_stat);
+
+  EchoStat io_uring_stat;
+  ret = EchoByIoUring(server_fds, client_fds, &io_uring_stat);
+  EXPECT_EQ(kOk, ret);
+  PrintEchoStat("io_uring echo", io_uring_stat);
+
+  EXPECT_TRUE(io_uring_stat.syscall_num < epoll_stat.syscall_num);
+
+  for (size_t i = 0; i < server_fds.size(); ++i) {
+    close(server_fds[i]);
+    close(client_fds[i]);
+  }
+} /*}}}*/
+#endif
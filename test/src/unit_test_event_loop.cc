@@ -0,0 +1,192 @@
+// Copyright (c) 2015 The CSUTIL Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <map>
+#include <vector>
+
+#if defined(__linux__)
+#  include <sys/eventfd.h>
+#endif
+
+#include "base/event_loop.h"
+#include "base/status.h"
+
+#include "test_base/include/test_base.h"
+
+static base::Code CountEventAction(int fd, int evt, void *param) { /*{{{*/
+  ++*static_cast<uint64_t *>(param);
+  return base::kOk;
+} /*}}}*/
+
+TEST(EventLoop, Test_Normal_Add_Mod_Del) { /*{{{*/
+  using namespace base;
+  EventLoop loop;
+  Code ret = loop.Init(kPoll);
+  EXPECT_EQ(kOk, ret);
+
+  int fds[2];
+  EXPECT_EQ(0, pipe(fds));
+  EXPECT_EQ(1, write(fds[1], "a", 1));
+
+  uint64_t num1 = 0;
+  ret = loop.Add(fds[0], EV_IN, CountEventAction, &num1);
+  EXPECT_EQ(kOk, ret);
+  ret = loop.RunOnce(0);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ(1u, num1);
+
+  uint64_t num2 = 0;
+  ret = loop.Mod(fds[0], EV_IN, CountEventAction, &num2);
+  EXPECT_EQ(kOk, ret);
+  ret = loop.RunOnce(0);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ(1u, num1);
+  EXPECT_EQ(1u, num2);
+
+  ret = loop.Del(fds[0]);
+  EXPECT_EQ(kOk, ret);
+  ret = loop.RunOnce(0);
+  EXPECT_EQ(kTimeOut, ret);
+  EXPECT_EQ(1u, num2);
+
+  ret = loop.Mod(fds[0], EV_IN, CountEventAction, &num2);
+  EXPECT_EQ(kNotFound, ret);
+  ret = loop.Mod(fds[0] + 10000, EV_IN, CountEventAction, &num2);
+  EXPECT_EQ(kNotFound, ret);
+
+  close(fds[0]);
+  close(fds[1]);
+} /*}}}*/
+
+static uint64_t GetNowMs() { /*{{{*/
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return (uint64_t)now.tv_sec * 1000 + now.tv_usec / 1000;
+} /*}}}*/
+
+TEST(EventLoop, Test_Normal_Timer) { /*{{{*/
+  using namespace base;
+  EventLoop loop;
+  Code ret = loop.Init(kPoll);
+  EXPECT_EQ(kOk, ret);
+
+  uint64_t fired_ms = 0;
+  uint64_t canceled_num = 0;
+  uint64_t timer_id = 0;
+  ret = loop.AddTimer(30, [&fired_ms]() { fired_ms = GetNowMs(); }, &timer_id);
+  EXPECT_EQ(kOk, ret);
+  ret = loop.AddTimer(10, [&canceled_num]() { ++canceled_num; }, &timer_id);
+  EXPECT_EQ(kOk, ret);
+  ret = loop.CancelTimer(timer_id);
+  EXPECT_EQ(kOk, ret);
+  ret = loop.CancelTimer(timer_id);
+  EXPECT_EQ(kNotFound, ret);
+
+  // NOTE:htt, wait of loop is shortened by the timer, so it's waked up in time without any event
+  uint64_t start_ms = GetNowMs();
+  int wait_num = 0;
+  while (fired_ms == 0 && wait_num < 100) {
+    loop.RunOnce(1000);
+    ++wait_num;
+  }
+  EXPECT_NEQ(0u, fired_ms);
+  EXPECT_EQ(0u, canceled_num);
+  EXPECT_TRUE(fired_ms - start_ms >= 29);  // NOTE:htt, gettimeofday and monotonic clock are not aligned
+  EXPECT_TRUE(fired_ms - start_ms < 500);
+} /*}}}*/
+
+#if defined(__linux__)
+static const int kPressFdsNum = 10000;
+static const int kPressRoundNum = 100;
+
+static double GetEventsPerSecond(uint64_t events_num, const timeval &start, const timeval &end) { /*{{{*/
+  double cost_us = (end.tv_sec - start.tv_sec) * 1000000.0 + (end.tv_usec - start.tv_usec);
+  if (cost_us <= 0) cost_us = 1;
+  return events_num * 1000000.0 / cost_us;
+} /*}}}*/
+
+/**
+ * NOTE:htt, 10k eventfds are always readable, so every Wait returns 10k events;
+ * compare one GetEvents call and one map lookup per event with batched dispatch of EventLoop
+ */
+TEST(EventLoop, Test_Press_Ten_Thousand_Fds) { /*{{{*/
+  using namespace base;
+  std::vector<int> fds;
+  for (int i = 0; i < kPressFdsNum; ++i) {
+    int fd = eventfd(1, EFD_NONBLOCK);
+    if (fd == -1) break;
+    fds.push_back(fd);
+  }
+  EXPECT_EQ(kPressFdsNum, (int)fds.size());
+
+  // 1. one event per GetEvents call, and handler is found in map
+  uint64_t map_num = 0;
+  {
+    EventEpoll ev;
+    Code ret = ev.Create(kDefaultSizeOfFds);
+    EXPECT_EQ(kOk, ret);
+
+    std::map<int, EventItem> actions;
+    for (size_t i = 0; i < fds.size(); ++i) {
+      ret = ev.Add(fds[i], EV_IN);
+      EXPECT_EQ(kOk, ret);
+      EventItem item = {fds[i], EV_IN, CountEventAction, &map_num};
+      actions.insert(std::pair<int, EventItem>(fds[i], item));
+    }
+
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
+    for (int i = 0; i < kPressRoundNum; ++i) {
+      ret = ev.Wait(0);
+      EXPECT_EQ(kOk, ret);
+
+      Event *evt = &ev;
+      int fd = -1;
+      int event = 0;
+      while (evt->GetEvents(&fd, &event) == kOk) {
+        std::map<int, EventItem>::iterator it = actions.find(fd);
+        if (it == actions.end()) continue;
+        it->second.func(fd, event, it->second.param);
+      }
+    }
+    gettimeofday(&end, NULL);
+    fprintf(stderr, "map and GetEvents, events:%lu, events/sec:%.0f\n", map_num,
+            GetEventsPerSecond(map_num, start, end));
+  }
+
+  // 2. all events in one batch, and handler is indexed by fd
+  uint64_t batch_num = 0;
+  {
+    EventLoop loop;
+    Code ret = loop.Init(kEPoll);
+    EXPECT_EQ(kOk, ret);
+    for (size_t i = 0; i < fds.size(); ++i) {
+      ret = loop.Add(fds[i], EV_IN, CountEventAction, &batch_num);
+      EXPECT_EQ(kOk, ret);
+    }
+
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
+    for (int i = 0; i < kPressRoundNum; ++i) {
+      ret = loop.RunOnce(0);
+      EXPECT_EQ(kOk, ret);
+    }
+    gettimeofday(&end, NULL);
+    fprintf(stderr, "EventLoop batch, events:%lu, events/sec:%.0f\n", batch_num,
+            GetEventsPerSecond(batch_num, start, end));
+  }
+
+  EXPECT_EQ((uint64_t)kPressFdsNum * kPressRoundNum, map_num);
+  EXPECT_EQ(map_num, batch_num);
+
+  for (size_t i = 0; i < fds.size(); ++i) {
+    close(fds[i]);
+  }
+} /*}}}*/
+#endif
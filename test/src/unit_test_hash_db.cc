@@ -2,13 +2,20 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <algorithm>
 #include <string>
+#include <vector>
 
+#include <dirent.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/time.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
+#include "base/file_util.h"
 #include "base/status.h"
 
 #include "test_base/include/test_base.h"
@@ -175,3 +182,594 @@ TEST(HashDB, BigDataForGet) { /*{{{*/
 
   delete db;
 } /*}}}*/
+
+struct PressGetParam { /*{{{*/
+  store::HashDB *db;
+  uint32_t keys_num;
+  uint32_t gets_num;
+  uint32_t seed;
+  uint32_t failed_num;
+}; /*}}}*/
+
+static void *PressGetAction(void *param) { /*{{{*/
+  PressGetParam *get_param = static_cast<PressGetParam *>(param);
+  char buf[32] = "\0";
+  for (uint32_t i = 0; i < get_param->gets_num; ++i) {
+    uint32_t index = rand_r(&get_param->seed) % get_param->keys_num;
+    snprintf(buf, sizeof(buf), "%u", (unsigned int)index);
+
+    std::string tmp_value;
+    base::Code ret = get_param->db->Get(std::string("press_key_") + buf, &tmp_value);
+    if (ret != base::kOk || tmp_value != std::string(1000, 'v') + buf) ++get_param->failed_num;
+  }
+  return NULL;
+} /*}}}*/
+
+TEST(HashDB, PressConcurrentGet) { /*{{{*/
+  using namespace base;
+  using namespace store;
+
+  std::string pre_path = "../data/hash_db";
+  HashDB *db = new HashDB();
+  Code ret = db->Init(pre_path);
+  EXPECT_EQ(kOk, ret);
+
+  const uint32_t kKeysNum = 2000;
+  char buf[32] = "\0";
+  for (uint32_t i = 0; i < kKeysNum; ++i) {
+    snprintf(buf, sizeof(buf), "%u", (unsigned int)i);
+    ret = db->Put(std::string("press_key_") + buf, std::string(1000, 'v') + buf);
+    EXPECT_EQ(kOk, ret);
+  }
+
+  // NOTE: Gets share the read lock, and read index and data by pread into their own buffers
+  const uint32_t kGetsNum = 40000;
+  uint32_t threads_nums[] = {1, 2, 4, 8};
+  for (size_t i = 0; i < sizeof(threads_nums) / sizeof(threads_nums[0]); ++i) {
+    uint32_t threads_num = threads_nums[i];
+    std::vector<PressGetParam> params(threads_num);
+    std::vector<pthread_t> tids(threads_num);
+
+    struct timeval start;
+    gettimeofday(&start, NULL);
+    for (uint32_t j = 0; j < threads_num; ++j) {
+      params[j].db = db;
+      params[j].keys_num = kKeysNum;
+      params[j].gets_num = kGetsNum / threads_num;
+      params[j].seed = j + 1;
+      params[j].failed_num = 0;
+      int r = pthread_create(&tids[j], NULL, PressGetAction, &params[j]);
+      EXPECT_EQ(0, r);
+    }
+    uint32_t failed_num = 0;
+    for (uint32_t j = 0; j < threads_num; ++j) {
+      pthread_join(tids[j], NULL);
+      failed_num += params[j].failed_num;
+    }
+    struct timeval end;
+    gettimeofday(&end, NULL);
+
+    uint64_t cost_us = (end.tv_sec - start.tv_sec) * 1000000 + end.tv_usec - start.tv_usec;
+    fprintf(stderr, "threads:%u, gets per second:%llu\n", threads_num,
+            (unsigned long long)kGetsNum * 1000000 / (cost_us == 0 ? 1 : cost_us));
+    EXPECT_EQ(0u, failed_num);
+  }
+
+  for (uint32_t i = 0; i < kKeysNum; ++i) {
+    snprintf(buf, sizeof(buf), "%u", (unsigned int)i);
+    ret = db->Del(std::string("press_key_") + buf);
+    EXPECT_EQ(kOk, ret);
+  }
+  delete db;
+} /*}}}*/
+
+static base::Code ClearDir(const std::string &dir_path) { /*{{{*/
+  base::Code ret = base::CreateDir(dir_path);
+  if (ret != base::kOk) return ret;
+
+  std::vector<std::string> files_path;
+  ret = base::GetNormalFilesPath(dir_path, &files_path);
+  if (ret != base::kOk) return ret;
+  for (size_t i = 0; i < files_path.size(); ++i) {
+    if (unlink(files_path[i].c_str()) != 0) return base::kRemoveFileFailed;
+  }
+  return base::kOk;
+} /*}}}*/
+
+static std::string GetRoundValue(uint32_t round, uint32_t i) { /*{{{*/
+  char buf[32] = "\0";
+  snprintf(buf, sizeof(buf), "%u_%u", (unsigned int)round, (unsigned int)i);
+  return std::string("value_") + buf;
+} /*}}}*/
+
+static std::string GetRoundKey(uint32_t i) { /*{{{*/
+  char buf[32] = "\0";
+  snprintf(buf, sizeof(buf), "%u", (unsigned int)i);
+  return std::string("key_") + buf;
+} /*}}}*/
+
+// NOTE: keys whose index is multiple of 3 are deleted after put
+static base::Code PutRound(store::HashDB *db, uint32_t begin, uint32_t end, uint32_t round) { /*{{{*/
+  for (uint32_t i = begin; i < end; ++i) {
+    base::Code ret = db->Put(GetRoundKey(i), GetRoundValue(round, i));
+    if (ret != base::kOk) return ret;
+  }
+  for (uint32_t i = begin; i < end; ++i) {
+    if (i % 3 != 0) continue;
+    base::Code ret = db->Del(GetRoundKey(i));
+    if (ret != base::kOk) return ret;
+  }
+  return base::kOk;
+} /*}}}*/
+
+static base::Code CheckRound(store::HashDB *db, uint32_t begin, uint32_t end, uint32_t round) { /*{{{*/
+  for (uint32_t i = begin; i < end; ++i) {
+    std::string tmp_value;
+    base::Code ret = db->Get(GetRoundKey(i), &tmp_value);
+    if (i % 3 == 0) {
+      if (ret != base::kNotFound) return base::kDataIsNotConsistent;
+      continue;
+    }
+    if (ret != base::kOk) return ret;
+    if (tmp_value != GetRoundValue(round, i)) return base::kDataIsNotConsistent;
+  }
+  return base::kOk;
+} /*}}}*/
+
+TEST(HashDB, NormalMmapIndexGrowAndReopen) { /*{{{*/
+  using namespace base;
+  using namespace store;
+
+  std::string pre_path = "../data/hash_db_mmap";
+  Code ret = ClearDir(pre_path);
+  EXPECT_EQ(kOk, ret);
+
+  HashDBOption option;
+  option.use_mmap_index = true;
+  option.sync_policy = kSyncOnClose;
+  option.init_dir_num = 64;
+  HashDB *db = new HashDB();
+  db->SetOption(option);
+  ret = db->Init(pre_path);
+  EXPECT_EQ(kOk, ret);
+
+  // NOTE: dir is doubled from 64 whenever keys reach dir num
+  ret = PutRound(db, 0, 5000, 1);
+  EXPECT_EQ(kOk, ret);
+  ret = PutRound(db, 0, 5000, 2);
+  EXPECT_EQ(kOk, ret);
+  ret = CheckRound(db, 0, 5000, 2);
+  EXPECT_EQ(kOk, ret);
+
+  DBStatusInfo status_info;
+  ret = db->GetStatus(&status_info);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ(8192u, status_info.max_num);
+  EXPECT_EQ(3333u, status_info.used_cnt);
+  delete db;
+
+  // NOTE: index written into mapping is read by pread, since file format is the same
+  db = new HashDB();
+  ret = db->Init(pre_path);
+  EXPECT_EQ(kOk, ret);
+  ret = CheckRound(db, 0, 5000, 2);
+  EXPECT_EQ(kOk, ret);
+  status_info.Clear();
+  ret = db->GetStatus(&status_info);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ(8192u, status_info.max_num);
+  EXPECT_EQ(3333u, status_info.used_cnt);
+  delete db;
+
+  db = new HashDB();
+  db->SetOption(option);
+  ret = db->Init(pre_path);
+  EXPECT_EQ(kOk, ret);
+  ret = PutRound(db, 5000, 6000, 3);
+  EXPECT_EQ(kOk, ret);
+  ret = CheckRound(db, 0, 5000, 2);
+  EXPECT_EQ(kOk, ret);
+  ret = CheckRound(db, 5000, 6000, 3);
+  EXPECT_EQ(kOk, ret);
+  delete db;
+} /*}}}*/
+
+TEST(HashDB, ExceptionMmapIndexNotClosed) { /*{{{*/
+  using namespace base;
+  using namespace store;
+
+  std::string pre_path = "../data/hash_db_mmap";
+  Code ret = ClearDir(pre_path);
+  EXPECT_EQ(kOk, ret);
+
+  HashDBOption option;
+  option.use_mmap_index = true;
+  option.sync_policy = kSyncOnClose;
+  option.init_dir_num = 64;
+
+  // NOTE: child exits without closing db, so index file keeps zero tail of mapping
+  pid_t pid = fork();
+  if (pid == 0) {
+    HashDB *db = new HashDB();
+    db->SetOption(option);
+    ret = db->Init(pre_path);
+    if (ret == kOk) ret = PutRound(db, 0, 3000, 1);
+    _exit(ret == kOk ? 0 : 1);
+  }
+  int status = -1;
+  waitpid(pid, &status, 0);
+  EXPECT_EQ(true, WIFEXITED(status));
+  EXPECT_EQ(0, WEXITSTATUS(status));
+
+  HashDB *db = new HashDB();
+  db->SetOption(option);
+  ret = db->Init(pre_path);
+  EXPECT_EQ(kOk, ret);
+  ret = CheckRound(db, 0, 3000, 1);
+  EXPECT_EQ(kOk, ret);
+  ret = PutRound(db, 3000, 4000, 2);
+  EXPECT_EQ(kOk, ret);
+  ret = CheckRound(db, 0, 3000, 1);
+  EXPECT_EQ(kOk, ret);
+  ret = CheckRound(db, 3000, 4000, 2);
+  EXPECT_EQ(kOk, ret);
+  delete db;
+
+  db = new HashDB();
+  ret = db->Init(pre_path);
+  EXPECT_EQ(kOk, ret);
+  ret = CheckRound(db, 3000, 4000, 2);
+  EXPECT_EQ(kOk, ret);
+  delete db;
+} /*}}}*/
+
+static base::Code RunPressPut(const store::HashDBOption &option, uint32_t keys_num, uint64_t *cost_us) { /*{{{*/
+  std::string pre_path = "../data/hash_db_press";
+  base::Code ret = ClearDir(pre_path);
+  if (ret != base::kOk) return ret;
+
+  store::HashDB db;
+  db.SetOption(option);
+  ret = db.Init(pre_path);
+  if (ret != base::kOk) return ret;
+
+  struct timeval start;
+  gettimeofday(&start, NULL);
+  for (uint32_t i = 0; i < keys_num; ++i) {
+    ret = db.Put(GetRoundKey(i), std::string(100, 'v'));
+    if (ret != base::kOk) return ret;
+  }
+  struct timeval end;
+  gettimeofday(&end, NULL);
+  *cost_us = (end.tv_sec - start.tv_sec) * 1000000 + end.tv_usec - start.tv_usec;
+
+  std::string tmp_value;
+  ret = db.Get(GetRoundKey(keys_num - 1), &tmp_value);
+  if (ret != base::kOk) return ret;
+  return tmp_value == std::string(100, 'v') ? base::kOk : base::kDataIsNotConsistent;
+} /*}}}*/
+
+static uint32_t GetOpenFdsNum() { /*{{{*/
+  uint32_t num = 0;
+  DIR *dir = opendir("/proc/self/fd");
+  if (dir == NULL) return 0;
+  while (readdir(dir) != NULL) ++num;
+  closedir(dir);
+  return num;
+} /*}}}*/
+
+TEST(HashDB, ExceptionInitFailedWithoutFdLeak) { /*{{{*/
+  using namespace base;
+  using namespace store;
+
+  std::string pre_path = "../data/hash_db_init_failed";
+  Code ret = ClearDir(pre_path);
+  EXPECT_EQ(kOk, ret);
+
+  // NOTE: max_num of info is 0, so index is opened but fails to be inited
+  std::string index_path = pre_path + "/" + kHashDBPrefix + kIndexFileSuffix;
+  FILE *fp = fopen(index_path.c_str(), "w");
+  EXPECT_NEQ(NULL, fp);
+  char zero_buf[64] = {0};
+  fwrite(zero_buf, 1, sizeof(zero_buf), fp);
+  fclose(fp);
+
+  uint32_t fds_num = GetOpenFdsNum();
+  HashDB *db = new HashDB();
+  for (int i = 0; i < 3; ++i) {
+    ret = db->Init(pre_path);
+    EXPECT_EQ(kDataIsNotConsistent, ret);
+    EXPECT_EQ(fds_num, GetOpenFdsNum());
+  }
+
+  // NOTE: data file is a dir, so it fails to be opened after index is inited
+  ret = ClearDir(pre_path);
+  EXPECT_EQ(kOk, ret);
+  ret = CreateDir(pre_path + "/" + kHashDBPrefix + kDataFileSuffix);
+  EXPECT_EQ(kOk, ret);
+  for (int i = 0; i < 3; ++i) {
+    ret = db->Init(pre_path);
+    EXPECT_EQ(kOpenFileFailed, ret);
+    EXPECT_EQ(fds_num, GetOpenFdsNum());
+  }
+  delete db;
+  rmdir((pre_path + "/" + kHashDBPrefix + kDataFileSuffix).c_str());
+} /*}}}*/
+
+TEST(HashDB, PressMmapIndexPut) { /*{{{*/
+  using namespace base;
+  using namespace store;
+
+  const uint32_t kKeysNum = 2000;
+  HashDBOption option;
+  uint64_t pwrite_cost_us = 0;
+  Code ret = RunPressPut(option, kKeysNum, &pwrite_cost_us);
+  EXPECT_EQ(kOk, ret);
+
+  option.use_mmap_index = true;
+  uint64_t mmap_cost_us = 0;
+  ret = RunPressPut(option, kKeysNum, &mmap_cost_us);
+  EXPECT_EQ(kOk, ret);
+
+  option.sync_policy = kSyncInterval;
+  uint64_t mmap_interval_cost_us = 0;
+  ret = RunPressPut(option, kKeysNum, &mmap_interval_cost_us);
+  EXPECT_EQ(kOk, ret);
+
+  fprintf(stderr, "puts per second, pwrite and sync every write:%llu, mmap and sync every write:%llu\n",
+          (unsigned long long)kKeysNum * 1000000 / (pwrite_cost_us + 1),
+          (unsigned long long)kKeysNum * 1000000 / (mmap_cost_us + 1));
+  fprintf(stderr, "puts per second, mmap and sync every %ums:%llu\n", (unsigned int)kDefaultSyncIntervalMs,
+          (unsigned long long)kKeysNum * 1000000 / (mmap_interval_cost_us + 1));
+  EXPECT_LT(mmap_interval_cost_us, pwrite_cost_us);
+} /*}}}*/
+
+struct PressPutParam { /*{{{*/
+  store::HashDB *db;
+  uint32_t begin;
+  uint32_t end;
+  uint32_t failed_num;
+}; /*}}}*/
+
+static void *PressPutAction(void *param) { /*{{{*/
+  PressPutParam *put_param = static_cast<PressPutParam *>(param);
+  for (uint32_t i = put_param->begin; i < put_param->end; ++i) {
+    base::Code ret = put_param->db->Put(GetRoundKey(i), GetRoundValue(1, i));
+    if (ret != base::kOk) ++put_param->failed_num;
+  }
+  return NULL;
+} /*}}}*/
+
+static base::Code RunConcurrentPut(store::SyncPolicy sync_policy, uint32_t writers_num, uint32_t keys_num,
+                                   uint64_t *cost_us) { /*{{{*/
+  std::string pre_path = "../data/hash_db_press";
+  base::Code ret = ClearDir(pre_path);
+  if (ret != base::kOk) return ret;
+
+  store::HashDBOption option;
+  option.sync_policy = sync_policy;
+  store::HashDB db;
+  db.SetOption(option);
+  ret = db.Init(pre_path);
+  if (ret != base::kOk) return ret;
+
+  std::vector<PressPutParam> params(writers_num);
+  std::vector<pthread_t> tids(writers_num);
+  struct timeval start;
+  gettimeofday(&start, NULL);
+  for (uint32_t i = 0; i < writers_num; ++i) {
+    params[i].db = &db;
+    params[i].begin = keys_num / writers_num * i;
+    params[i].end = keys_num / writers_num * (i + 1);
+    params[i].failed_num = 0;
+    if (pthread_create(&tids[i], NULL, PressPutAction, &params[i]) != 0) return base::kPthreadCreateFailed;
+  }
+  uint32_t failed_num = 0;
+  for (uint32_t i = 0; i < writers_num; ++i) {
+    pthread_join(tids[i], NULL);
+    failed_num += params[i].failed_num;
+  }
+  struct timeval end;
+  gettimeofday(&end, NULL);
+  *cost_us = (end.tv_sec - start.tv_sec) * 1000000 + end.tv_usec - start.tv_usec;
+  if (failed_num != 0) return base::kWriteError;
+
+  for (uint32_t i = 0; i < keys_num; ++i) {
+    std::string tmp_value;
+    ret = db.Get(GetRoundKey(i), &tmp_value);
+    if (ret != base::kOk) return ret;
+    if (tmp_value != GetRoundValue(1, i)) return base::kDataIsNotConsistent;
+  }
+  return base::kOk;
+} /*}}}*/
+
+TEST(HashDB, PressGroupCommitPut) { /*{{{*/
+  using namespace base;
+  using namespace store;
+
+  // NOTE: writers waiting at the same time share one sync with group commit, and sync every write does not
+  const uint32_t kKeysNum = 1600;
+  uint32_t writers_nums[] = {1, 2, 4, 8, 16};
+  uint64_t every_write_cost_us = 0;
+  uint64_t group_commit_cost_us = 0;
+  for (size_t i = 0; i < sizeof(writers_nums) / sizeof(writers_nums[0]); ++i) {
+    Code ret = RunConcurrentPut(kSyncEveryWrite, writers_nums[i], kKeysNum, &every_write_cost_us);
+    EXPECT_EQ(kOk, ret);
+    ret = RunConcurrentPut(kSyncGroupCommit, writers_nums[i], kKeysNum, &group_commit_cost_us);
+    EXPECT_EQ(kOk, ret);
+
+    fprintf(stderr, "writers:%u, puts per second, sync every write:%llu, group commit:%llu\n", writers_nums[i],
+            (unsigned long long)kKeysNum * 1000000 / (every_write_cost_us + 1),
+            (unsigned long long)kKeysNum * 1000000 / (group_commit_cost_us + 1));
+  }
+  EXPECT_LT(group_commit_cost_us, every_write_cost_us);
+} /*}}}*/
+
+TEST(HashDB, NormalWriteBatchAndMultiGet) { /*{{{*/
+  using namespace base;
+  using namespace store;
+
+  std::string pre_path = "../data/hash_db_batch";
+  Code ret = ClearDir(pre_path);
+  EXPECT_EQ(kOk, ret);
+
+  HashDB *db = new HashDB();
+  ret = db->Init(pre_path);
+  EXPECT_EQ(kOk, ret);
+  ret = db->Put("batch_a", "a1");
+  EXPECT_EQ(kOk, ret);
+
+  // NOTE: later operations of batch see the former ones, and version goes on for the same key
+  WriteBatch batch;
+  ret = db->Write(batch);
+  EXPECT_EQ(kOk, ret);
+  batch.Put("batch_b", "b1", 0);
+  batch.Put("batch_a", "a2", 1);
+  batch.Put("batch_c", "c1");
+  batch.Del("batch_b", 1);
+  batch.Put("batch_a", "a3", 2);
+  EXPECT_EQ(5u, batch.Count());
+  ret = db->Write(batch);
+  EXPECT_EQ(kOk, ret);
+
+  // NOTE: none of operations is applied if one fails
+  batch.Clear();
+  batch.Put("batch_d", "d1");
+  batch.Put("batch_a", "a4", 1);
+  ret = db->Write(batch);
+  EXPECT_EQ(kCASFailed, ret);
+  batch.Clear();
+  batch.Put("batch_d", "d1");
+  batch.Del("batch_b");
+  ret = db->Write(batch);
+  EXPECT_EQ(kNotFound, ret);
+
+  std::vector<std::string> keys;
+  keys.push_back("batch_a");
+  keys.push_back("batch_b");
+  keys.push_back("batch_c");
+  keys.push_back("batch_d");
+  keys.push_back("batch_a");
+  for (int i = 0; i < 2; ++i) {
+    std::vector<std::string> values;
+    std::vector<Code> rets;
+    std::vector<int64_t> versions;
+    ret = db->MultiGet(keys, &values, &rets, &versions);
+    EXPECT_EQ(kOk, ret);
+    EXPECT_EQ(keys.size(), rets.size());
+    EXPECT_EQ(kOk, rets[0]);
+    EXPECT_EQ("a3", values[0]);
+    EXPECT_EQ(3, versions[0]);
+    EXPECT_EQ(kNotFound, rets[1]);
+    EXPECT_EQ(kOk, rets[2]);
+    EXPECT_EQ("c1", values[2]);
+    EXPECT_EQ(1, versions[2]);
+    EXPECT_EQ(kNotFound, rets[3]);
+    EXPECT_EQ(kOk, rets[4]);
+    EXPECT_EQ("a3", values[4]);
+
+    DBStatusInfo status_info;
+    ret = db->GetStatus(&status_info);
+    EXPECT_EQ(kOk, ret);
+    EXPECT_EQ(2u, status_info.used_cnt);
+
+    delete db;
+    db = new HashDB();
+    ret = db->Init(pre_path);
+    EXPECT_EQ(kOk, ret);
+  }
+
+  ret = db->MultiGet(keys, NULL, NULL);
+  EXPECT_EQ(kInvalidParam, ret);
+  delete db;
+} /*}}}*/
+
+// NOTE: keys are written by Put or batches of batch_size, and read by Get or MultiGet of batch_size in random order
+static base::Code RunPressBatch(uint32_t batch_size, uint32_t keys_num, uint64_t *write_cost_us,
+                                uint64_t *read_cost_us) { /*{{{*/
+  std::string pre_path = "../data/hash_db_press";
+  base::Code ret = ClearDir(pre_path);
+  if (ret != base::kOk) return ret;
+
+  store::HashDB db;
+  ret = db.Init(pre_path);
+  if (ret != base::kOk) return ret;
+
+  struct timeval start;
+  gettimeofday(&start, NULL);
+  store::WriteBatch batch;
+  for (uint32_t i = 0; i < keys_num; ++i) {
+    if (batch_size == 1) {
+      ret = db.Put(GetRoundKey(i), GetRoundValue(1, i));
+      if (ret != base::kOk) return ret;
+      continue;
+    }
+
+    batch.Put(GetRoundKey(i), GetRoundValue(1, i));
+    if (batch.Count() < batch_size && i + 1 < keys_num) continue;
+    ret = db.Write(batch);
+    if (ret != base::kOk) return ret;
+    batch.Clear();
+  }
+  struct timeval end;
+  gettimeofday(&end, NULL);
+  *write_cost_us = (end.tv_sec - start.tv_sec) * 1000000 + end.tv_usec - start.tv_usec;
+
+  std::vector<uint32_t> ids(keys_num);
+  for (uint32_t i = 0; i < keys_num; ++i) {
+    ids[i] = i;
+  }
+  srand(1);
+  for (uint32_t i = keys_num - 1; i > 0; --i) {
+    std::swap(ids[i], ids[rand() % (i + 1)]);
+  }
+
+  gettimeofday(&start, NULL);
+  for (uint32_t i = 0; i < keys_num; i += batch_size) {
+    std::vector<std::string> keys;
+    for (uint32_t j = i; j < i + batch_size && j < keys_num; ++j) {
+      keys.push_back(GetRoundKey(ids[j]));
+    }
+    std::vector<std::string> values(keys.size());
+    std::vector<base::Code> rets(keys.size(), base::kOk);
+    if (batch_size == 1) {
+      rets[0] = db.Get(keys[0], &values[0]);
+    } else {
+      ret = db.MultiGet(keys, &values, &rets);
+      if (ret != base::kOk) return ret;
+    }
+
+    for (uint32_t j = 0; j < keys.size(); ++j) {
+      if (rets[j] != base::kOk) return rets[j];
+      if (values[j] != GetRoundValue(1, ids[i + j])) return base::kDataIsNotConsistent;
+    }
+  }
+  gettimeofday(&end, NULL);
+  *read_cost_us = (end.tv_sec - start.tv_sec) * 1000000 + end.tv_usec - start.tv_usec;
+
+  return base::kOk;
+} /*}}}*/
+
+TEST(HashDB, PressWriteBatchAndMultiGet) { /*{{{*/
+  using namespace base;
+  using namespace store;
+
+  // NOTE: every Put is synced, and a batch is synced once
+  const uint32_t kKeysNum = 2000;
+  uint64_t put_cost_us = 0;
+  uint64_t get_cost_us = 0;
+  Code ret = RunPressBatch(1, kKeysNum, &put_cost_us, &get_cost_us);
+  EXPECT_EQ(kOk, ret);
+  uint64_t batch_cost_us = 0;
+  uint64_t multi_get_cost_us = 0;
+  ret = RunPressBatch(100, kKeysNum, &batch_cost_us, &multi_get_cost_us);
+  EXPECT_EQ(kOk, ret);
+
+  fprintf(stderr, "keys per second, put:%llu, write batch of 100:%llu\n",
+          (unsigned long long)kKeysNum * 1000000 / (put_cost_us + 1),
+          (unsigned long long)kKeysNum * 1000000 / (batch_cost_us + 1));
+  fprintf(stderr, "keys per second, get:%llu, multi get of 100:%llu\n",
+          (unsigned long long)kKeysNum * 1000000 / (get_cost_us + 1),
+          (unsigned long long)kKeysNum * 1000000 / (multi_get_cost_us + 1));
+  EXPECT_LT(batch_cost_us, put_cost_us);
+} /*}}}*/
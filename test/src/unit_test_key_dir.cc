@@ -0,0 +1,255 @@
+// Copyright (c) 2015 The CSUTIL Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "base/status.h"
+
+#include "test_base/include/test_base.h"
+
+#include "store/db/bit_cask/src/key_dir.h"
+
+static uint64_t GetNowUs() { /*{{{*/
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return (uint64_t)now.tv_sec * 1000000 + now.tv_usec;
+} /*}}}*/
+
+static uint64_t GetRssBytes() { /*{{{*/
+  FILE *fp = fopen("/proc/self/statm", "r");
+  if (fp == NULL) return 0;
+  unsigned long long size = 0;
+  unsigned long long resident = 0;
+  int r = fscanf(fp, "%llu %llu", &size, &resident);
+  fclose(fp);
+  if (r != 2) return 0;
+  return resident * sysconf(_SC_PAGESIZE);
+} /*}}}*/
+
+static std::string GetKey(uint32_t i) { /*{{{*/
+  char buf[32] = "\0";
+  snprintf(buf, sizeof(buf), "user_key_%012u", (unsigned int)i);
+  return buf;
+} /*}}}*/
+
+static store::KeyDirEntry GetEntry(uint32_t i) { /*{{{*/
+  store::KeyDirEntry entry;
+  entry.file_id = i % 100 + 1;
+  entry.data_pos = i;
+  entry.value_size = i % 1000;
+  entry.version = i;
+  entry.records_num = 1;
+  return entry;
+} /*}}}*/
+
+TEST(KeyDir, NormalInsertFindErase) { /*{{{*/
+  using namespace base;
+  using namespace store;
+
+  KeyDir key_dir;
+  EXPECT_EQ(NULL, key_dir.Find("key_1"));
+  Code ret = key_dir.Erase("key_1");
+  EXPECT_EQ(kNotFound, ret);
+
+  ret = key_dir.Insert("key_1", KeyDirEntry());
+  EXPECT_EQ(kInvalidParam, ret);
+  ret = key_dir.Insert("key_1", GetEntry(1));
+  EXPECT_EQ(kOk, ret);
+  ret = key_dir.Insert("key_1", GetEntry(2));
+  EXPECT_EQ(kAlreadyExist, ret);
+  ret = key_dir.Insert("", GetEntry(3));
+  EXPECT_EQ(kOk, ret);
+
+  KeyDirEntry *entry = key_dir.Find("key_1");
+  EXPECT_NEQ(NULL, entry);
+  EXPECT_EQ(1u, entry->data_pos);
+  EXPECT_EQ(5u, entry->key_size);
+  entry->data_pos = 10;
+  EXPECT_EQ(10u, key_dir.Find("key_1")->data_pos);
+  EXPECT_EQ(3u, key_dir.Find("")->data_pos);
+  EXPECT_EQ(2u, key_dir.Size());
+
+  ret = key_dir.Erase("key_1");
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ(NULL, key_dir.Find("key_1"));
+  EXPECT_EQ(1u, key_dir.Size());
+} /*}}}*/
+
+TEST(KeyDir, ExceptionKeyTooLong) { /*{{{*/
+  using namespace base;
+  using namespace store;
+
+  KeyDir key_dir;
+  std::string max_key(kKeyDirMaxKeySize, 'a');
+  std::string long_key(kKeyDirMaxKeySize + 1, 'a');
+  Code ret = key_dir.Insert(long_key, GetEntry(1));
+  EXPECT_EQ(kInvalidParam, ret);
+  EXPECT_EQ(0u, key_dir.Size());
+
+  ret = key_dir.Insert(max_key, GetEntry(2));
+  EXPECT_EQ(kOk, ret);
+  KeyDirEntry *entry = key_dir.Find(max_key);
+  EXPECT_NEQ(NULL, entry);
+  EXPECT_EQ(kKeyDirMaxKeySize, entry->key_size);
+
+  // NOTE: key which only differs in the byte beyond max size is not taken as the stored one
+  EXPECT_EQ(NULL, key_dir.Find(long_key));
+  ret = key_dir.Erase(long_key);
+  EXPECT_EQ(kInvalidParam, ret);
+  EXPECT_EQ(1u, key_dir.Size());
+
+  ret = key_dir.Erase(max_key);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ(0u, key_dir.Size());
+} /*}}}*/
+
+static base::Code CheckSame(store::KeyDir *key_dir, const std::map<std::string, uint32_t> &keys, uint32_t max) { /*{{{*/
+  if (key_dir->Size() != keys.size()) return base::kDataIsNotConsistent;
+
+  for (uint32_t i = 0; i < max; ++i) {
+    std::string key = GetKey(i);
+    store::KeyDirEntry *entry = key_dir->Find(key);
+    std::map<std::string, uint32_t>::const_iterator it = keys.find(key);
+    if (it == keys.end()) {
+      if (entry != NULL) return base::kDataIsNotConsistent;
+      continue;
+    }
+    if (entry == NULL || entry->data_pos != it->second) return base::kDataIsNotConsistent;
+  }
+  return base::kOk;
+} /*}}}*/
+
+TEST(KeyDir, NormalRandomOpsWithMap) { /*{{{*/
+  using namespace base;
+  using namespace store;
+
+  // NOTE: erase shifts slots back and arena is rebuilt, so keys are checked with map after random ops
+  KeyDir key_dir;
+  std::map<std::string, uint32_t> keys;
+  const uint32_t kMaxKey = 50000;
+  srand(1);
+  for (uint32_t round = 0; round < 400000; ++round) {
+    uint32_t i = rand() % kMaxKey;
+    std::string key = GetKey(i);
+    if (rand() % 3 == 0) {
+      Code ret = key_dir.Erase(key);
+      EXPECT_EQ(keys.erase(key) == 1 ? kOk : kNotFound, ret);
+      continue;
+    }
+
+    KeyDirEntry *entry = key_dir.Find(key);
+    if (entry != NULL) {
+      entry->data_pos = round;
+    } else {
+      KeyDirEntry new_entry = GetEntry(i);
+      new_entry.data_pos = round;
+      Code ret = key_dir.Insert(key, new_entry);
+      EXPECT_EQ(kOk, ret);
+    }
+    keys[key] = round;
+  }
+
+  Code ret = CheckSame(&key_dir, keys, kMaxKey);
+  EXPECT_EQ(kOk, ret);
+
+  for (uint32_t i = 0; i < kMaxKey; ++i) {
+    std::string key = GetKey(i);
+    key_dir.Erase(key);
+    keys.erase(key);
+  }
+  EXPECT_EQ(0u, key_dir.Size());
+  ret = CheckSame(&key_dir, keys, kMaxKey);
+  EXPECT_EQ(kOk, ret);
+} /*}}}*/
+
+#pragma pack(push)
+#pragma pack(1)
+// NOTE: the same as the Bucket of std::map index before KeyDir
+struct MapBucket { /*{{{*/
+  FILE *fp;
+  uint32_t del_flag;
+  uint32_t key_size;
+  uint32_t value_size;
+  uint64_t data_pos;
+  uint32_t time_sec;
+  uint32_t time_nsec;
+  uint64_t version;
+  uint32_t records_num;
+}; /*}}}*/
+#pragma pack(pop)
+
+TEST(KeyDir, PressMemoryAndLookupWithMap) { /*{{{*/
+  using namespace base;
+  using namespace store;
+
+  const uint32_t kKeysNum = 10 * 1000 * 1000;
+  const uint32_t kLookupKeysNum = 1000 * 1000;
+  const uint32_t kLookupNum = 10 * 1000 * 1000;
+  std::vector<std::string> lookup_keys;
+  srand(1);
+  for (uint32_t i = 0; i < kLookupKeysNum; ++i) {
+    lookup_keys.push_back(GetKey(rand() % kKeysNum));
+  }
+
+  // NOTE: KeyDir is measured first, since its memory is given back to system after destroyed
+  uint64_t key_dir_bytes = 0;
+  uint64_t key_dir_rss_bytes = 0;
+  uint64_t key_dir_cost_us = 0;
+  uint64_t found_num = 0;
+  {
+    uint64_t start_rss = GetRssBytes();
+    KeyDir key_dir;
+    for (uint32_t i = 0; i < kKeysNum; ++i) {
+      key_dir.Insert(GetKey(i), GetEntry(i));
+    }
+    key_dir_bytes = key_dir.GetMemoryBytes();
+    key_dir_rss_bytes = GetRssBytes() - start_rss;
+
+    uint64_t start_us = GetNowUs();
+    for (uint32_t i = 0; i < kLookupNum; ++i) {
+      if (key_dir.Find(lookup_keys[i % kLookupKeysNum]) != NULL) ++found_num;
+    }
+    key_dir_cost_us = GetNowUs() - start_us;
+  }
+  EXPECT_EQ(kLookupNum, found_num);
+
+  uint64_t map_rss_bytes = 0;
+  uint64_t map_cost_us = 0;
+  found_num = 0;
+  {
+    uint64_t start_rss = GetRssBytes();
+    std::map<std::string, MapBucket> index;
+    for (uint32_t i = 0; i < kKeysNum; ++i) {
+      MapBucket bucket;
+      memset(&bucket, 0, sizeof(bucket));
+      bucket.data_pos = i;
+      index.insert(std::pair<std::string, MapBucket>(GetKey(i), bucket));
+    }
+    map_rss_bytes = GetRssBytes() - start_rss;
+
+    uint64_t start_us = GetNowUs();
+    for (uint32_t i = 0; i < kLookupNum; ++i) {
+      if (index.find(lookup_keys[i % kLookupKeysNum]) != index.end()) ++found_num;
+    }
+    map_cost_us = GetNowUs() - start_us;
+  }
+  EXPECT_EQ(kLookupNum, found_num);
+
+  fprintf(stderr, "keys:%u, key size:%zu\n", kKeysNum, GetKey(0).size());
+  fprintf(stderr, "key dir, bytes per key:%.1f (rss:%.1f), lookups per second:%.0f\n",
+          (double)key_dir_bytes / kKeysNum, (double)key_dir_rss_bytes / kKeysNum,
+          (double)kLookupNum * 1000000 / key_dir_cost_us);
+  fprintf(stderr, "std::map, bytes per key(rss):%.1f, lookups per second:%.0f\n", (double)map_rss_bytes / kKeysNum,
+          (double)kLookupNum * 1000000 / map_cost_us);
+  EXPECT_LT(key_dir_rss_bytes, map_rss_bytes);
+  EXPECT_LT(key_dir_cost_us, map_cost_us);
+} /*}}}*/
@@ -2,11 +2,15 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <algorithm>
 #include <string>
 
+#include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/time.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "base/file_util.h"
@@ -32,3 +36,213 @@ TEST(LOG, Normal_LogInfo) { /*{{{*/
   EXPECT_EQ(ret, kOk);
   LOG_INFO("very long log:%s\n", info_log.c_str());
 } /*}}}*/
+
+static void *AsyncLogFunc(void *param) { /*{{{*/
+  for (int i = 0; i < 1000; ++i) {
+    LOG_INFO("async log, index:%d", i);
+  }
+  return NULL;
+} /*}}}*/
+
+TEST(LOG, Normal_AsyncLogInfo) { /*{{{*/
+  using namespace base;
+
+  std::string log_path = "./test_async.log";
+  unlink(log_path.c_str());
+  InitLog(log_path.c_str(), kInfoLevel);
+
+  Code ret = StartAsyncLog(10, 4096, 64 * 1024, kLogBlockWhenFull);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_TRUE(IsAsyncLog());
+  ret = StartAsyncLog();
+  EXPECT_EQ(kAlreadyExist, ret);
+
+  const int kThreadNum = 4;
+  pthread_t ids[kThreadNum];
+  for (int i = 0; i < kThreadNum; ++i) {
+    pthread_create(ids + i, NULL, AsyncLogFunc, NULL);
+  }
+  for (int i = 0; i < kThreadNum; ++i) {
+    pthread_join(ids[i], NULL);
+  }
+
+  std::string info_log;
+  ret = GetRandStr(1024 * 10, &info_log);
+  EXPECT_EQ(ret, kOk);
+  LOG_INFO("very long log:%s", info_log.c_str());
+
+  StopAsyncLog();
+  EXPECT_FALSE(IsAsyncLog());
+  EXPECT_EQ(0, GetAsyncLogDroppedNum());
+
+  std::string log_cnt;
+  ret = PumpWholeData(log_path, &log_cnt);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ(kThreadNum * 1000 + 1, std::count(log_cnt.begin(), log_cnt.end(), '\n'));
+  EXPECT_NEQ(std::string::npos, log_cnt.find(info_log + "\n"));
+
+  DestroyLog();
+  unlink(log_path.c_str());
+} /*}}}*/
+
+TEST(LOG, Normal_AsyncLogDropWhenFull) { /*{{{*/
+  using namespace base;
+
+  std::string log_path = "./test_async_drop.log";
+  unlink(log_path.c_str());
+  InitLog(log_path.c_str(), kInfoLevel);
+
+  // NOTE:htt, flusher sleeps long enough, so 1KB staging buffer of the new thread must be full
+  Code ret = StartAsyncLog(10 * 1000, 64 * 1024, 1024, kLogDropWhenFull);
+  EXPECT_EQ(kOk, ret);
+  pthread_t id;
+  pthread_create(&id, NULL, AsyncLogFunc, NULL);
+  pthread_join(id, NULL);
+  EXPECT_LT(0, GetAsyncLogDroppedNum());
+  StopAsyncLog();
+
+  DestroyLog();
+  unlink(log_path.c_str());
+} /*}}}*/
+
+static time_t g_rotate_sec = 0;
+
+static void *RotateLogFunc(void *param) { /*{{{*/
+  LOG_INFO("rotate log, before second changes");
+  while (time(NULL) <= g_rotate_sec) {
+    usleep(1000);
+  }
+  LOG_INFO("rotate log, after second changes");
+  return NULL;
+} /*}}}*/
+
+static std::string GetRotateLogPath(time_t sec) { /*{{{*/
+  char path[64] = {0};
+  struct tm sec_tm;
+  localtime_r(&sec, &sec_tm);
+  strftime(path, sizeof(path), "./test_async_rotate.log.%S", &sec_tm);
+  return path;
+} /*}}}*/
+
+TEST(LOG, Normal_AsyncLogRotateByTwoThreads) { /*{{{*/
+  using namespace base;
+
+  // NOTE:htt, start at the beginning of one second, so both threads write their first line in it
+  time_t begin = time(NULL);
+  while (time(NULL) == begin) {
+    usleep(1000);
+  }
+  g_rotate_sec = time(NULL);
+  std::string old_path = GetRotateLogPath(g_rotate_sec);
+  std::string new_path = GetRotateLogPath(g_rotate_sec + 1);
+  unlink(old_path.c_str());
+  unlink(new_path.c_str());
+  InitLog("./test_async_rotate.log.%S", kInfoLevel);
+
+  // NOTE:htt, flusher never wakes up before stop, so both stages hold lines of two seconds in one drain
+  Code ret = StartAsyncLog(60 * 1000, 1u << 30, 64 * 1024, kLogBlockWhenFull);
+  EXPECT_EQ(kOk, ret);
+
+  const int kThreadNum = 2;
+  pthread_t ids[kThreadNum];
+  for (int i = 0; i < kThreadNum; ++i) {
+    pthread_create(ids + i, NULL, RotateLogFunc, NULL);
+  }
+  for (int i = 0; i < kThreadNum; ++i) {
+    pthread_join(ids[i], NULL);
+  }
+  StopAsyncLog();
+
+  // NOTE:htt, old line of the second stage goes to the new file, instead of reopening the old one
+  std::string old_cnt;
+  ret = PumpWholeData(old_path, &old_cnt);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ(1, std::count(old_cnt.begin(), old_cnt.end(), '\n'));
+
+  std::string new_cnt;
+  ret = PumpWholeData(new_path, &new_cnt);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ(kThreadNum * 2 - 1, std::count(new_cnt.begin(), new_cnt.end(), '\n'));
+
+  DestroyLog();
+  unlink(old_path.c_str());
+  unlink(new_path.c_str());
+} /*}}}*/
+
+static void PrintSameLog(const char *msg) { /*{{{*/ LOG_ERR("%s", msg); } /*}}}*/
+
+TEST(LOG, Normal_LogHeadCacheSameAsSnprintf) { /*{{{*/
+  using namespace base;
+
+  std::string log_path = "./test_head_cache.log";
+  for (int i = 0; i < 3; ++i) {
+    unlink(log_path.c_str());
+    InitLog(log_path.c_str(), kInfoLevel);
+
+    SetLogHeadCache(true);
+    PrintSameLog("same log");
+    SetLogHeadCache(false);
+    PrintSameLog("same log");
+    SetLogHeadCache(true);
+
+    std::string log_cnt;
+    Code ret = PumpWholeData(log_path, &log_cnt);
+    EXPECT_EQ(kOk, ret);
+
+    std::string first_line = log_cnt.substr(0, log_cnt.find('\n') + 1);
+    std::string second_line = log_cnt.substr(first_line.size());
+    if (first_line.substr(0, 19) != second_line.substr(0, 19)) continue;  // NOTE:htt, second changed, retry
+
+    EXPECT_EQ(first_line, second_line);
+    break;
+  }
+
+  DestroyLog();
+  unlink(log_path.c_str());
+} /*}}}*/
+
+static void *PressLogFunc(void *param) { /*{{{*/
+  int num = *reinterpret_cast<int *>(param);
+  for (int i = 0; i < num; ++i) {
+    LOG_ERR("press log, index:%d, msg:%s", i, "this is a message of normal length");
+  }
+  return NULL;
+} /*}}}*/
+
+static uint64_t PressLogNsPerLine(int thread_num, int line_num_per_thread) { /*{{{*/
+  pthread_t *ids = new pthread_t[thread_num];
+
+  struct timeval begin;
+  struct timeval end;
+  gettimeofday(&begin, NULL);
+  for (int i = 0; i < thread_num; ++i) {
+    pthread_create(ids + i, NULL, PressLogFunc, &line_num_per_thread);
+  }
+  for (int i = 0; i < thread_num; ++i) {
+    pthread_join(ids[i], NULL);
+  }
+  gettimeofday(&end, NULL);
+  delete[] ids;
+
+  uint64_t diff_ns = ((end.tv_sec - begin.tv_sec) * 1000000ULL + end.tv_usec - begin.tv_usec) * 1000;
+  return diff_ns / ((uint64_t)thread_num * line_num_per_thread);
+} /*}}}*/
+
+TEST(LOG, Test_Press_LogHeadCache_1_8_32_Threads) { /*{{{*/
+  using namespace base;
+
+  InitLog("/dev/null", kInfoLevel);
+
+  int thread_nums[] = {1, 8, 32};
+  for (size_t i = 0; i < sizeof(thread_nums) / sizeof(thread_nums[0]); ++i) {
+    SetLogHeadCache(false);
+    uint64_t snprintf_ns = PressLogNsPerLine(thread_nums[i], 20000);
+    SetLogHeadCache(true);
+    uint64_t cache_ns = PressLogNsPerLine(thread_nums[i], 20000);
+
+    fprintf(stderr, "threads:%d, snprintf head:%llu ns/line, cached head:%llu ns/line\n", thread_nums[i],
+            (unsigned long long)snprintf_ns, (unsigned long long)cache_ns);
+  }
+
+  DestroyLog();
+} /*}}}*/
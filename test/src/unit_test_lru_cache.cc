@@ -195,3 +195,124 @@ TEST(LruCache, BigDataGetOutForMaxNum) { /*{{{*/
     }
   } /*}}}*/
 } /*}}}*/
+
+static std::string GetKey(const std::string &prefix, uint32_t i) { /*{{{*/
+  char buf[16] = "\0";
+  snprintf(buf, sizeof(buf), "%u", (unsigned int)i);
+  return prefix + buf;
+} /*}}}*/
+
+static base::Code CheckPolicyPutGetDel(store::EvictPolicyType policy_type) { /*{{{*/
+  const uint32_t kMaxNum = 100;
+  store::LRUCache lru_cache;
+  base::Code ret = lru_cache.Init(kMaxNum, 0, policy_type);
+  if (ret != base::kOk) return ret;
+
+  for (uint32_t i = 0; i < kMaxNum * 3; ++i) {
+    ret = lru_cache.Put(GetKey("key", i), GetKey("value", i));
+    if (ret != base::kOk) return ret;
+    std::string value;
+    if (i % 2 == 0) lru_cache.Get(GetKey("key", i / 2), &value);
+  }
+
+  // NOTE: cached data should never be more than max num, and the value should be the last one put
+  uint32_t found_num = 0;
+  for (uint32_t i = 0; i < kMaxNum * 3; ++i) {
+    std::string value;
+    ret = lru_cache.Get(GetKey("key", i), &value);
+    if (ret == base::kNotFound) continue;
+    if (ret != base::kOk || value != GetKey("value", i)) return base::kDataIsNotConsistent;
+    ++found_num;
+  }
+  if (found_num == 0 || found_num > kMaxNum) return base::kDataIsNotConsistent;
+
+  ret = lru_cache.Put("key", "value1");
+  if (ret != base::kOk) return ret;
+  ret = lru_cache.Put("key", "value2");
+  if (ret != base::kOk) return ret;
+  std::string value;
+  ret = lru_cache.Get("key", &value);
+  if (ret == base::kOk && value != "value2") return base::kDataIsNotConsistent;
+  lru_cache.Del("key");
+  ret = lru_cache.Get("key", &value);
+  if (ret != base::kNotFound) return base::kDataIsNotConsistent;
+
+  return base::kOk;
+} /*}}}*/
+
+TEST(LruCache, NormalEvictPolicyPutGetDel) { /*{{{*/
+  using namespace base;
+  using namespace store;
+
+  LRUCache lru_cache;
+  Code ret = lru_cache.Init(0, 0, kEvictSLRU);
+  EXPECT_EQ(kInvalidParam, ret);
+  ret = lru_cache.Init(100, 0, (EvictPolicyType)100);
+  EXPECT_EQ(kInvalidParam, ret);
+
+  ret = CheckPolicyPutGetDel(kEvictLRU);
+  EXPECT_EQ(kOk, ret);
+  ret = CheckPolicyPutGetDel(kEvictSLRU);
+  EXPECT_EQ(kOk, ret);
+  ret = CheckPolicyPutGetDel(kEvictARC);
+  EXPECT_EQ(kOk, ret);
+  ret = CheckPolicyPutGetDel(kEvictWTinyLFU);
+  EXPECT_EQ(kOk, ret);
+} /*}}}*/
+
+/**
+ * NOTE: hot keys are read a few times, then a one pass scan of cold keys comes, which is read on miss and put;
+ * hit ratio of hot keys after the scan is returned
+ */
+static base::Code RunScan(store::EvictPolicyType policy_type, double *hot_hit_ratio) { /*{{{*/
+  const uint32_t kMaxNum = 200;
+  const uint32_t kHotNum = 100;
+  const uint32_t kScanNum = 10000;
+  store::LRUCache lru_cache;
+  base::Code ret = lru_cache.Init(kMaxNum, 0, policy_type);
+  if (ret != base::kOk) return ret;
+
+  std::string value;
+  for (uint32_t round = 0; round < 4; ++round) {
+    for (uint32_t i = 0; i < kHotNum; ++i) {
+      std::string key = GetKey("hot", i);
+      if (lru_cache.Get(key, &value) == base::kNotFound) lru_cache.Put(key, key);
+    }
+  }
+  for (uint32_t i = 0; i < kScanNum; ++i) {
+    std::string key = GetKey("cold", i);
+    if (lru_cache.Get(key, &value) == base::kNotFound) lru_cache.Put(key, key);
+  }
+
+  uint32_t hit_num = 0;
+  for (uint32_t i = 0; i < kHotNum; ++i) {
+    if (lru_cache.Get(GetKey("hot", i), &value) == base::kOk) ++hit_num;
+  }
+  *hot_hit_ratio = (double)hit_num / kHotNum;
+  return base::kOk;
+} /*}}}*/
+
+TEST(LruCache, NormalEvictPolicyScanResistance) { /*{{{*/
+  using namespace base;
+  using namespace store;
+
+  double lru_ratio = 0;
+  Code ret = RunScan(kEvictLRU, &lru_ratio);
+  EXPECT_EQ(kOk, ret);
+  double slru_ratio = 0;
+  ret = RunScan(kEvictSLRU, &slru_ratio);
+  EXPECT_EQ(kOk, ret);
+  double arc_ratio = 0;
+  ret = RunScan(kEvictARC, &arc_ratio);
+  EXPECT_EQ(kOk, ret);
+  double tiny_lfu_ratio = 0;
+  ret = RunScan(kEvictWTinyLFU, &tiny_lfu_ratio);
+  EXPECT_EQ(kOk, ret);
+
+  fprintf(stderr, "hot hit ratio after scan, lru:%.2f, slru:%.2f, arc:%.2f, w-tinylfu:%.2f\n", lru_ratio, slru_ratio,
+          arc_ratio, tiny_lfu_ratio);
+  EXPECT_LT(lru_ratio, 0.01);
+  EXPECT_GT(slru_ratio, 0.9);
+  EXPECT_GT(arc_ratio, 0.9);
+  EXPECT_GT(tiny_lfu_ratio, 0.9);
+} /*}}}*/
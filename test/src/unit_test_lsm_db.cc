@@ -0,0 +1,587 @@
+// Copyright (c) 2015 The CSUTIL Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "base/compress.h"
+#include "base/file_util.h"
+#include "base/status.h"
+
+#include "test_base/include/test_base.h"
+
+#include "store/db/lsm/src/lsm_db.h"
+
+static uint64_t GetNowUs() { /*{{{*/
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return (uint64_t)now.tv_sec * 1000000 + now.tv_usec;
+} /*}}}*/
+
+static base::Code ClearDir(const std::string &dir_path) { /*{{{*/
+  base::Code ret = base::CreateDir(dir_path);
+  if (ret != base::kOk) return ret;
+
+  std::vector<std::string> files_path;
+  ret = base::GetNormalFilesPath(dir_path, &files_path);
+  if (ret != base::kOk) return ret;
+  for (size_t i = 0; i < files_path.size(); ++i) {
+    if (unlink(files_path[i].c_str()) != 0) return base::kRemoveFileFailed;
+  }
+  return base::kOk;
+} /*}}}*/
+
+static std::string GetKey(uint32_t i) { /*{{{*/
+  char buf[32] = "\0";
+  snprintf(buf, sizeof(buf), "lsm_key_%08u", (unsigned int)i);
+  return buf;
+} /*}}}*/
+
+// NOTE: small option, so memtable is flushed and levels are compacted by a few thousand keys
+static store::LSMOption GetSmallOption() { /*{{{*/
+  store::LSMOption option;
+  option.write_buffer_size = 64 * 1024;
+  option.target_file_size = 32 * 1024;
+  option.max_bytes_for_level_base = 128 * 1024;
+  option.l0_compaction_trigger = 2;
+  option.l0_stop_writes_trigger = 6;
+  option.block_size = 1024;
+  return option;
+} /*}}}*/
+
+static base::Code WaitCompaction(store::LSMDB *db) { /*{{{*/
+  base::Code ret = db->Flush();
+  if (ret != base::kOk) return ret;
+  for (int i = 0; i < 5000 && db->NeedCompaction(); ++i) {
+    usleep(1000);
+  }
+  return db->NeedCompaction() ? base::kTimeOut : base::kOk;
+} /*}}}*/
+
+static base::Code CheckSame(store::LSMDB *db, const std::map<std::string, std::string> &kvs, uint32_t max) { /*{{{*/
+  for (uint32_t i = 0; i < max; ++i) {
+    std::string key = GetKey(i);
+    std::string value;
+    base::Code ret = db->Get(key, &value);
+    std::map<std::string, std::string>::const_iterator it = kvs.find(key);
+    if (it == kvs.end()) {
+      if (ret != base::kNotFound) return base::kDataIsNotConsistent;
+      continue;
+    }
+    if (ret != base::kOk) return ret;
+    if (value != it->second) return base::kDataIsNotConsistent;
+  }
+
+  // NOTE: all keys are walked by iterator too, which merges memtables and all levels
+  store::LSMIterator *iter = NULL;
+  base::Code ret = db->NewIterator("", "", &iter);
+  if (ret != base::kOk) return ret;
+  std::map<std::string, std::string>::const_iterator kvs_it = kvs.begin();
+  for (ret = iter->SetFirst(); ret == base::kOk && iter->Valid(); ret = iter->GoNext(), ++kvs_it) {
+    std::string key;
+    std::string value;
+    iter->GetKey(&key);
+    iter->GetValue(&value);
+    if (kvs_it == kvs.end() || key != kvs_it->first || value != kvs_it->second) {
+      ret = base::kDataIsNotConsistent;
+      break;
+    }
+  }
+  delete iter;
+  if (ret != base::kOk) return ret;
+  return kvs_it == kvs.end() ? base::kOk : base::kDataIsNotConsistent;
+} /*}}}*/
+
+TEST(LSMDB, NormalPutGetDel) { /*{{{*/
+  using namespace base;
+  using namespace store;
+
+  std::string pre_path = "../data/lsm_db";
+  Code ret = ClearDir(pre_path);
+  EXPECT_EQ(kOk, ret);
+
+  DBBase *db = new LSMDB();
+  std::string tmp_value;
+  ret = db->Get("key1", &tmp_value);
+  EXPECT_EQ(kNotInit, ret);
+  ret = db->Init(pre_path);
+  EXPECT_EQ(kOk, ret);
+
+  int64_t version = 0;
+  ret = db->Get("key1", &tmp_value, &version);
+  EXPECT_EQ(kNotFound, ret);
+  ret = db->Del("key1");
+  EXPECT_EQ(kNotFound, ret);
+
+  // NOTE: version is sequence of the last write, and 0 means key doesn't exist for CAS
+  ret = db->Put("key1", "value1", 1);
+  EXPECT_EQ(kCASFailed, ret);
+  ret = db->Put("key1", "value1", 0);
+  EXPECT_EQ(kOk, ret);
+  ret = db->Get("key1", &tmp_value, &version);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ("value1", tmp_value);
+  EXPECT_EQ(1, version);
+
+  ret = db->Put("key1", "value2", 0);
+  EXPECT_EQ(kCASFailed, ret);
+  ret = db->Put("key1", "value2", version);
+  EXPECT_EQ(kOk, ret);
+  ret = db->Put("key2", "value3");
+  EXPECT_EQ(kOk, ret);
+  ret = db->Get("key1", &tmp_value, &version);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ("value2", tmp_value);
+  EXPECT_EQ(2, version);
+
+  ret = db->Del("key1", 1);
+  EXPECT_EQ(kCASFailed, ret);
+  ret = db->Del("key1", 2);
+  EXPECT_EQ(kOk, ret);
+  ret = db->Get("key1", &tmp_value);
+  EXPECT_EQ(kNotFound, ret);
+  ret = db->Del("key1");
+  EXPECT_EQ(kNotFound, ret);
+
+  ret = db->Put(std::string(kLSMMaxKeySize + 1, 'k'), "value");
+  EXPECT_EQ(kKeySizeIsLarge, ret);
+
+  // NOTE: none of operations is applied if one fails
+  WriteBatch batch;
+  batch.Put("key3", "value4");
+  batch.Del("key3");
+  batch.Put("key2", "value5", 1);
+  ret = db->Write(batch);
+  EXPECT_EQ(kCASFailed, ret);
+  ret = db->Get("key3", &tmp_value);
+  EXPECT_EQ(kNotFound, ret);
+
+  batch.Clear();
+  batch.Put("key3", "value4");
+  batch.Del("key3");
+  batch.Put("key2", "value5", 3);
+  ret = db->Write(batch);
+  EXPECT_EQ(kOk, ret);
+
+  std::vector<std::string> keys;
+  keys.push_back("key3");
+  keys.push_back("key2");
+  keys.push_back("key1");
+  std::vector<std::string> values;
+  std::vector<Code> rets;
+  std::vector<int64_t> versions;
+  ret = db->MultiGet(keys, &values, &rets, &versions);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ(kNotFound, rets[0]);
+  EXPECT_EQ(kOk, rets[1]);
+  EXPECT_EQ("value5", values[1]);
+  EXPECT_EQ(7, versions[1]);
+  EXPECT_EQ(kNotFound, rets[2]);
+
+  DBStatusInfo status_info;
+  ret = db->GetStatus(&status_info);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ(7u, status_info.trx_id);
+
+  delete db;
+} /*}}}*/
+
+TEST(LSMDB, NormalReopenWithWAL) { /*{{{*/
+  using namespace base;
+  using namespace store;
+
+  std::string pre_path = "../data/lsm_db_wal";
+  Code ret = ClearDir(pre_path);
+  EXPECT_EQ(kOk, ret);
+
+  LSMDB *db = new LSMDB();
+  ret = db->Init(pre_path);
+  EXPECT_EQ(kOk, ret);
+  std::map<std::string, std::string> kvs;
+  for (uint32_t i = 0; i < 1000; ++i) {
+    ret = db->Put(GetKey(i), GetKey(i * 2));
+    EXPECT_EQ(kOk, ret);
+    kvs[GetKey(i)] = GetKey(i * 2);
+  }
+  for (uint32_t i = 0; i < 1000; i += 3) {
+    ret = db->Del(GetKey(i));
+    EXPECT_EQ(kOk, ret);
+    kvs.erase(GetKey(i));
+  }
+  delete db;
+
+  // NOTE: memtable is replayed from wal and flushed into level 0 by Init
+  db = new LSMDB();
+  ret = db->Init(pre_path);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ(1u, db->GetLevelFilesNum(0));
+  ret = CheckSame(db, kvs, 1000);
+  EXPECT_EQ(kOk, ret);
+  int64_t version = 0;
+  std::string tmp_value;
+  ret = db->Get(GetKey(1), &tmp_value, &version);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ(2, version);
+  ret = db->Put(GetKey(1), "new_value");
+  EXPECT_EQ(kOk, ret);
+  ret = db->Get(GetKey(1), &tmp_value, &version);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ(1000 + 334 + 1, version);
+  kvs[GetKey(1)] = "new_value";
+  delete db;
+
+  // NOTE: torn record at the tail of wal is dropped, and records before it are replayed
+  std::vector<std::string> files_path;
+  ret = GetNormalFilesPath(pre_path, &files_path);
+  EXPECT_EQ(kOk, ret);
+  std::string wal_path;
+  for (size_t i = 0; i < files_path.size(); ++i) {
+    if (files_path[i].find(kLSMLogFileSuffix) != std::string::npos) wal_path = files_path[i];
+  }
+  int fd = open(wal_path.c_str(), O_WRONLY | O_APPEND);
+  EXPECT_EQ(true, fd >= 0);
+  EXPECT_EQ(5, write(fd, "\x12\x34\x56\x78\x9a", 5));
+  close(fd);
+
+  db = new LSMDB();
+  ret = db->Init(pre_path);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ(2u, db->GetLevelFilesNum(0));
+  ret = CheckSame(db, kvs, 1000);
+  EXPECT_EQ(kOk, ret);
+  delete db;
+} /*}}}*/
+
+TEST(LSMDB, ExceptionInitWithBrokenManifest) { /*{{{*/
+  using namespace base;
+  using namespace store;
+
+  std::string pre_path = "../data/lsm_db_broken_manifest";
+  Code ret = ClearDir(pre_path);
+  EXPECT_EQ(kOk, ret);
+
+  LSMDB *db = new LSMDB();
+  ret = db->Init(pre_path);
+  EXPECT_EQ(kOk, ret);
+  for (uint32_t i = 0; i < 100; ++i) {
+    ret = db->Put(GetKey(i), GetKey(i));
+    EXPECT_EQ(kOk, ret);
+  }
+  ret = db->Flush();
+  EXPECT_EQ(kOk, ret);
+  delete db;
+
+  std::string manifest_path = pre_path + "/" + kLSMManifestFileName;
+  std::string manifest;
+  FILE *fp = fopen(manifest_path.c_str(), "rb");
+  EXPECT_NEQ(NULL, fp);
+  char buf[4096];
+  size_t read_len = 0;
+  while ((read_len = fread(buf, 1, sizeof(buf), fp)) > 0) manifest.append(buf, read_len);
+  fclose(fp);
+
+  fp = fopen(manifest_path.c_str(), "wb");
+  fwrite("broken", 1, 6, fp);
+  fclose(fp);
+
+  // NOTE: failed Init leaves nothing behind, so it fails again instead of returning a half recovered db
+  db = new LSMDB();
+  ret = db->Init(pre_path);
+  EXPECT_NEQ(kOk, ret);
+  std::string value;
+  ret = db->Get(GetKey(1), &value);
+  EXPECT_EQ(kNotInit, ret);
+  ret = db->Init(pre_path);
+  EXPECT_NEQ(kOk, ret);
+
+  fp = fopen(manifest_path.c_str(), "wb");
+  fwrite(manifest.data(), 1, manifest.size(), fp);
+  fclose(fp);
+  ret = db->Init(pre_path);
+  EXPECT_EQ(kOk, ret);
+  std::map<std::string, std::string> kvs;
+  for (uint32_t i = 0; i < 100; ++i) {
+    kvs[GetKey(i)] = GetKey(i);
+  }
+  ret = CheckSame(db, kvs, 100);
+  EXPECT_EQ(kOk, ret);
+  delete db;
+} /*}}}*/
+
+TEST(LSMDB, NormalFlushAndCompaction) { /*{{{*/
+  using namespace base;
+  using namespace store;
+
+  std::string pre_path = "../data/lsm_db_compaction";
+  Code ret = ClearDir(pre_path);
+  EXPECT_EQ(kOk, ret);
+
+  LSMDB *db = new LSMDB();
+  db->SetOption(GetSmallOption());
+  db->SetSyncPolicy(kSyncOnClose);
+  ret = db->Init(pre_path);
+  EXPECT_EQ(kOk, ret);
+
+  // NOTE: random puts and deletes are checked with map, while tables are flushed and compacted
+  const uint32_t kMaxKey = 20000;
+  std::map<std::string, std::string> kvs;
+  srand(1);
+  for (uint32_t round = 0; round < 100000; ++round) {
+    uint32_t i = rand() % kMaxKey;
+    std::string key = GetKey(i);
+    if (rand() % 4 == 0) {
+      ret = db->Del(key);
+      EXPECT_EQ(kvs.erase(key) == 1 ? kOk : kNotFound, ret);
+      continue;
+    }
+
+    char value[64] = "\0";
+    snprintf(value, sizeof(value), "value_%u_%u", (unsigned int)round, (unsigned int)i);
+    ret = db->Put(key, value);
+    EXPECT_EQ(kOk, ret);
+    kvs[key] = value;
+  }
+
+  ret = WaitCompaction(db);
+  EXPECT_EQ(kOk, ret);
+  uint32_t deep_files_num = 0;
+  for (uint32_t level = 1; level < kLSMLevelsNum; ++level) {
+    deep_files_num += db->GetLevelFilesNum(level);
+  }
+  EXPECT_LT(db->GetLevelFilesNum(0), 2u);
+  EXPECT_GT(deep_files_num, 1u);
+  EXPECT_GT(db->GetLevelFilesNum(2), 0u);
+  ret = CheckSame(db, kvs, kMaxKey);
+  EXPECT_EQ(kOk, ret);
+  delete db;
+
+  db = new LSMDB();
+  db->SetOption(GetSmallOption());
+  ret = db->Init(pre_path);
+  EXPECT_EQ(kOk, ret);
+  ret = CheckSame(db, kvs, kMaxKey);
+  EXPECT_EQ(kOk, ret);
+
+  // NOTE: all keys are deleted, so delete records are dropped by compaction into the base level
+  for (uint32_t i = 0; i < kMaxKey; ++i) {
+    ret = db->Del(GetKey(i));
+    EXPECT_EQ(kvs.erase(GetKey(i)) == 1 ? kOk : kNotFound, ret);
+  }
+  ret = WaitCompaction(db);
+  EXPECT_EQ(kOk, ret);
+  ret = CheckSame(db, kvs, kMaxKey);
+  EXPECT_EQ(kOk, ret);
+  delete db;
+} /*}}}*/
+
+TEST(LSMDB, NormalIterator) { /*{{{*/
+  using namespace base;
+  using namespace store;
+
+  std::string pre_path = "../data/lsm_db_iter";
+  Code ret = ClearDir(pre_path);
+  EXPECT_EQ(kOk, ret);
+
+  LSMDB *db = new LSMDB();
+  db->SetOption(GetSmallOption());
+  ret = db->Init(pre_path);
+  EXPECT_EQ(kOk, ret);
+  const char *users[] = {"user_1", "user_2", "user_3"};
+  for (int i = 0; i < 3; ++i) {
+    for (uint32_t j = 0; j < 1000; ++j) {
+      ret = db->Put(std::string(users[i]) + "/" + GetKey(j), GetKey(j));
+      EXPECT_EQ(kOk, ret);
+    }
+  }
+  ret = db->Flush();
+  EXPECT_EQ(kOk, ret);
+  ret = db->Del(std::string(users[1]) + "/" + GetKey(0));
+  EXPECT_EQ(kOk, ret);
+  ret = db->Put(std::string(users[1]) + "/" + GetKey(1), "new_value");
+  EXPECT_EQ(kOk, ret);
+  ret = db->Put(std::string("\xff\xff", 2), "max_value");
+  EXPECT_EQ(kOk, ret);
+
+  // NOTE: iterator is a snapshot, so writes after it's created are not seen
+  LSMIterator *iter = NULL;
+  ret = db->NewPrefixIterator("user_2/", &iter);
+  EXPECT_EQ(kOk, ret);
+  ret = db->Del(std::string(users[1]) + "/" + GetKey(2));
+  EXPECT_EQ(kOk, ret);
+
+  uint32_t num = 0;
+  std::string key;
+  std::string value;
+  for (ret = iter->SetFirst(); ret == kOk && iter->Valid(); ret = iter->GoNext()) {
+    iter->GetKey(&key);
+    iter->GetValue(&value);
+    EXPECT_EQ(std::string("user_2/") + GetKey(num + 1), key);
+    EXPECT_EQ(num == 0 ? std::string("new_value") : GetKey(num + 1), value);
+    ++num;
+  }
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ(999u, num);
+
+  ret = iter->Seek(std::string(users[1]) + "/" + GetKey(500));
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ(true, iter->Valid());
+  iter->GetKey(&key);
+  EXPECT_EQ(std::string("user_2/") + GetKey(500), key);
+  ret = iter->Seek("user_1");
+  EXPECT_EQ(kOk, ret);
+  iter->GetKey(&key);
+  EXPECT_EQ(std::string("user_2/") + GetKey(1), key);
+  ret = iter->Seek("user_3");
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ(false, iter->Valid());
+  delete iter;
+
+  // NOTE: prefix of all 0xff has no upper bound
+  ret = db->NewPrefixIterator(std::string("\xff", 1), &iter);
+  EXPECT_EQ(kOk, ret);
+  num = 0;
+  for (ret = iter->SetFirst(); ret == kOk && iter->Valid(); ret = iter->GoNext()) {
+    ++num;
+  }
+  EXPECT_EQ(1u, num);
+  delete iter;
+
+  ret = db->NewIterator(std::string(users[0]) + "/" + GetKey(990), std::string(users[1]) + "/" + GetKey(10), &iter);
+  EXPECT_EQ(kOk, ret);
+  num = 0;
+  for (ret = iter->SetFirst(); ret == kOk && iter->Valid(); ret = iter->GoNext()) {
+    ++num;
+  }
+  // NOTE: 10 keys of user_1, and keys of user_2 before key 10 except the 2 deleted ones
+  EXPECT_EQ(10u + 8u, num);
+  delete iter;
+
+  delete db;
+} /*}}}*/
+
+// NOTE: run length compress, which is enough to check that blocks are compressed by option
+class RunLengthCompress : public base::BaseCompress { /*{{{*/
+ public:
+  virtual base::Code Compress(const std::string &uncompressed, std::string *compressed) { /*{{{*/
+    compressed->clear();
+    for (size_t i = 0; i < uncompressed.size();) {
+      size_t len = 1;
+      while (i + len < uncompressed.size() && len < 255 && uncompressed[i + len] == uncompressed[i]) ++len;
+      compressed->append(1, (char)len);
+      compressed->append(1, uncompressed[i]);
+      i += len;
+    }
+    return base::kOk;
+  } /*}}}*/
+
+  virtual base::Code Uncompress(const std::string &compressed, std::string *uncompressed) { /*{{{*/
+    if (compressed.size() % 2 != 0) return base::kDataValueError;
+    uncompressed->clear();
+    for (size_t i = 0; i < compressed.size(); i += 2) {
+      uncompressed->append((uint8_t)compressed[i], compressed[i + 1]);
+    }
+    return base::kOk;
+  } /*}}}*/
+}; /*}}}*/
+
+static base::Code PutCompressValues(const store::LSMOption &option, const std::string &pre_path,
+                                    uint64_t *live_bytes) { /*{{{*/
+  base::Code ret = ClearDir(pre_path);
+  if (ret != base::kOk) return ret;
+
+  store::LSMDB db;
+  db.SetOption(option);
+  db.SetSyncPolicy(store::kSyncOnClose);
+  ret = db.Init(pre_path);
+  if (ret != base::kOk) return ret;
+  for (uint32_t i = 0; i < 5000; ++i) {
+    ret = db.Put(GetKey(i), std::string(100, 'a' + i % 26));
+    if (ret != base::kOk) return ret;
+  }
+  ret = WaitCompaction(&db);
+  if (ret != base::kOk) return ret;
+
+  for (uint32_t i = 0; i < 5000; ++i) {
+    std::string value;
+    ret = db.Get(GetKey(i), &value);
+    if (ret != base::kOk) return ret;
+    if (value != std::string(100, 'a' + i % 26)) return base::kDataIsNotConsistent;
+  }
+
+  store::DBStatusInfo status_info;
+  ret = db.GetStatus(&status_info);
+  *live_bytes = status_info.live_bytes;
+  return ret;
+} /*}}}*/
+
+TEST(LSMDB, NormalCompress) { /*{{{*/
+  using namespace base;
+  using namespace store;
+
+  RunLengthCompress compress;
+  LSMOption option = GetSmallOption();
+  uint64_t raw_bytes = 0;
+  Code ret = PutCompressValues(option, "../data/lsm_db_compress", &raw_bytes);
+  EXPECT_EQ(kOk, ret);
+
+  option.compress = &compress;
+  option.deep_compress = &compress;
+  uint64_t compress_bytes = 0;
+  ret = PutCompressValues(option, "../data/lsm_db_compress", &compress_bytes);
+  EXPECT_EQ(kOk, ret);
+
+  fprintf(stderr, "raw bytes:%llu, compress bytes:%llu\n", (unsigned long long)raw_bytes,
+          (unsigned long long)compress_bytes);
+  EXPECT_GT(raw_bytes, 0u);
+  EXPECT_LT(compress_bytes * 2, raw_bytes);
+} /*}}}*/
+
+TEST(LSMDB, PressPutAndGet) { /*{{{*/
+  using namespace base;
+  using namespace store;
+
+  std::string pre_path = "../data/lsm_db_press";
+  Code ret = ClearDir(pre_path);
+  EXPECT_EQ(kOk, ret);
+
+  LSMDB *db = new LSMDB();
+  db->SetSyncPolicy(kSyncOnClose);
+  ret = db->Init(pre_path);
+  EXPECT_EQ(kOk, ret);
+
+  const uint32_t kKeysNum = 200000;
+  std::string value(100, 'v');
+  uint64_t start_us = GetNowUs();
+  for (uint32_t i = 0; i < kKeysNum; ++i) {
+    ret = db->Put(GetKey((i * 7919) % kKeysNum), value);
+    EXPECT_EQ(kOk, ret);
+  }
+  uint64_t put_cost_us = GetNowUs() - start_us;
+  ret = WaitCompaction(db);
+  EXPECT_EQ(kOk, ret);
+
+  start_us = GetNowUs();
+  uint32_t found_num = 0;
+  for (uint32_t i = 0; i < kKeysNum; ++i) {
+    std::string tmp_value;
+    if (db->Get(GetKey(i), &tmp_value) == kOk) ++found_num;
+    if (db->Get(GetKey(i + kKeysNum), &tmp_value) == kOk) ++found_num;
+  }
+  uint64_t get_cost_us = GetNowUs() - start_us;
+  EXPECT_EQ(kKeysNum, found_num);
+
+  fprintf(stderr, "keys:%u, puts per second:%llu, gets per second:%llu, level0:%u, level1:%u, level2:%u\n",
+          kKeysNum, (unsigned long long)kKeysNum * 1000000 / (put_cost_us + 1),
+          (unsigned long long)kKeysNum * 2 * 1000000 / (get_cost_us + 1), db->GetLevelFilesNum(0),
+          db->GetLevelFilesNum(1), db->GetLevelFilesNum(2));
+  delete db;
+} /*}}}*/
@@ -0,0 +1,126 @@
+// Copyright (c) 2015 The CSUTIL Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <string>
+#include <vector>
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "base/mpsc_ring.h"
+#include "base/status.h"
+
+#include "test_base/include/test_base.h"
+
+TEST(MpscRing, Test_Normal_Push_Pop) { /*{{{*/
+  using namespace base;
+
+  MpscRing<std::string> ring(3);
+  EXPECT_EQ(4, ring.Capacity());
+
+  std::string value;
+  Code ret = ring.Pop(&value);
+  EXPECT_EQ(kNotFound, ret);
+
+  for (int i = 0; i < 4; ++i) {
+    value = "value" + std::to_string(i);
+    ret = ring.Push(&value);
+    EXPECT_EQ(kOk, ret);
+  }
+  EXPECT_EQ(4, ring.Size());
+
+  value = "overflow";
+  ret = ring.Push(&value);
+  EXPECT_EQ(kFull, ret);
+  EXPECT_EQ("overflow", value);
+
+  for (int i = 0; i < 4; ++i) {
+    ret = ring.Pop(&value);
+    EXPECT_EQ(kOk, ret);
+    EXPECT_EQ("value" + std::to_string(i), value);
+  }
+  ret = ring.Pop(&value);
+  EXPECT_EQ(kNotFound, ret);
+  EXPECT_EQ(0, ring.Size());
+
+  // NOTE:htt, the second round of slots
+  value = "again";
+  ret = ring.Push(&value);
+  EXPECT_EQ(kOk, ret);
+  ret = ring.Pop(&value);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ("again", value);
+} /*}}}*/
+
+TEST(MpscRing, Test_Exception_Invalid_Param) { /*{{{*/
+  using namespace base;
+
+  MpscRing<int> ring(8);
+  Code ret = ring.Push(NULL);
+  EXPECT_EQ(kInvalidParam, ret);
+  ret = ring.Pop(NULL);
+  EXPECT_EQ(kInvalidParam, ret);
+} /*}}}*/
+
+struct MpscRingParam {
+  base::MpscRing<uint64_t> *ring;
+  uint64_t begin;
+  uint64_t num;
+};
+
+static void *MpscRingProduce(void *param) { /*{{{*/
+  MpscRingParam *ring_param = reinterpret_cast<MpscRingParam *>(param);
+  for (uint64_t i = 0; i < ring_param->num; ++i) {
+    uint64_t value = ring_param->begin + i;
+    while (ring_param->ring->Push(&value) != base::kOk) {
+      sched_yield();
+    }
+  }
+  return NULL;
+} /*}}}*/
+
+TEST(MpscRing, Test_Normal_Multi_Producers) { /*{{{*/
+  using namespace base;
+
+  const int kThreadNum = 4;
+  const uint64_t kNumPerThread = 100000;
+  MpscRing<uint64_t> ring(1024);
+
+  pthread_t ids[kThreadNum];
+  MpscRingParam params[kThreadNum];
+  for (int i = 0; i < kThreadNum; ++i) {
+    params[i].ring = &ring;
+    params[i].begin = i * kNumPerThread;
+    params[i].num = kNumPerThread;
+    pthread_create(ids + i, NULL, MpscRingProduce, params + i);
+  }
+
+  // NOTE:htt, values of one producer must be popped in order
+  std::vector<uint64_t> last_values(kThreadNum, 0);
+  std::vector<uint64_t> counts(kThreadNum, 0);
+  uint64_t total = 0;
+  uint64_t sum = 0;
+  bool is_in_order = true;
+  while (total < kThreadNum * kNumPerThread) {
+    uint64_t value = 0;
+    if (ring.Pop(&value) != kOk) continue;
+
+    int index = value / kNumPerThread;
+    if (counts[index] > 0 && value <= last_values[index]) is_in_order = false;
+    last_values[index] = value;
+    ++counts[index];
+    sum += value;
+    ++total;
+  }
+
+  for (int i = 0; i < kThreadNum; ++i) {
+    pthread_join(ids[i], NULL);
+  }
+
+  uint64_t expect_num = kThreadNum * kNumPerThread;
+  EXPECT_TRUE(is_in_order);
+  EXPECT_EQ(expect_num * (expect_num - 1) / 2, sum);
+} /*}}}*/
@@ -244,3 +244,112 @@ TEST(MutableBuffer, Test_Exception_Extend_Max) { /*{{{*/
   Code ret = buf.Append(tmp_str.data(), tmp_str.size());
   EXPECT_EQ(kInvalidLength, ret);
 } /*}}}*/
+
+TEST(MutableBuffer, Test_Normal_Cut_Slice) { /*{{{*/
+  using namespace base;
+  MutableBuffer buf(8);
+
+  Code ret = buf.Append("abcdefgh", 8);
+  EXPECT_EQ(kOk, ret);
+  const char* data1 = buf.RealDataPtr();
+
+  // 1. Cut "abcd" without copying
+  BufferSlice slice;
+  ret = buf.Cut(4, &slice);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ(4, slice.Size());
+  EXPECT_EQ(data1, slice.Data());
+  EXPECT_EQ("abcd", slice.ToString());
+  EXPECT_EQ(4, buf.RealDataSize());
+
+  // 2. Append "ijkl", sliced data should not be moved by buffer
+  ret = buf.Append("ijkl", 4);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ("abcd", slice.ToString());
+  EXPECT_EQ(8, buf.RealDataSize());
+  EXPECT_EQ(0, memcmp("efghijkl", buf.RealDataPtr(), 8));
+
+  // 3. Cut all, buffer releases the block, and slice keeps it
+  BufferSlice slice2;
+  ret = buf.Cut(8, &slice2);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ(0, buf.RealDataSize());
+  EXPECT_EQ(NULL, buf.RealDataPtr());
+  EXPECT_EQ("efghijkl", slice2.ToString());
+
+  ret = buf.Cut(1, &slice2);
+  EXPECT_EQ(kInvalidParam, ret);
+} /*}}}*/
+
+TEST(MutableBuffer, Test_Normal_Reserve_Commit) { /*{{{*/
+  using namespace base;
+  MutableBuffer buf(8);
+  EXPECT_EQ(0, buf.WritableSize());
+
+  Code ret = buf.Reserve(4);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ(8, buf.WritableSize());
+
+  memcpy(buf.WritableDataPtr(), "abcd", 4);
+  ret = buf.Commit(4);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ(4, buf.RealDataSize());
+  EXPECT_EQ(4, buf.WritableSize());
+  EXPECT_EQ(0, memcmp("abcd", buf.RealDataPtr(), 4));
+
+  ret = buf.Commit(5);
+  EXPECT_EQ(kInvalidParam, ret);
+} /*}}}*/
+
+TEST(MutableBuffer, Test_Normal_Reserve_Large_Frame) { /*{{{*/
+  using namespace base;
+  // NOTE: the same as request buffer of connection, which reads 4KB once, then a large frame is read by chunks
+  MutableBuffer buf(16 * 1024, 64 * 1024 * 1024);
+  const uint32_t kFrameSize = 8 * 1024 * 1024;
+  const uint32_t kReadSize = 4 * 1024;
+
+  uint32_t realloc_num = 0;
+  const char *last_ptr = NULL;
+  for (uint32_t i = 0; i < kFrameSize / kReadSize; ++i) {
+    Code ret = buf.Reserve(kReadSize);
+    EXPECT_EQ(kOk, ret);
+    memset(buf.WritableDataPtr(), 'a' + i % 26, kReadSize);
+    ret = buf.Commit(kReadSize);
+    EXPECT_EQ(kOk, ret);
+
+    // NOTE: nothing is skipped, so data is moved only when it's copied into a new block
+    if (buf.RealDataPtr() != last_ptr) {
+      if (last_ptr != NULL) ++realloc_num;
+      last_ptr = buf.RealDataPtr();
+    }
+  }
+  EXPECT_EQ(kFrameSize, buf.RealDataSize());
+  EXPECT_EQ('a', buf.RealDataPtr()[0]);
+  EXPECT_EQ('a' + (kFrameSize / kReadSize - 1) % 26, buf.RealDataPtr()[kFrameSize - 1]);
+
+  fprintf(stderr, "realloc num of %u bytes frame:%u\n", kFrameSize, realloc_num);
+  EXPECT_LT(realloc_num, 12u);
+} /*}}}*/
+
+TEST(MutableBuffer, Test_Normal_Slice_Copy) { /*{{{*/
+  using namespace base;
+  BufferSlice slice(std::string("hello"));
+  EXPECT_EQ("hello", slice.ToString());
+
+  BufferSlice copy_slice(slice);
+  EXPECT_EQ(slice.Data(), copy_slice.Data());
+
+  BufferSlice move_slice(std::move(copy_slice));
+  EXPECT_TRUE(copy_slice.Empty());
+  EXPECT_EQ(slice.Data(), move_slice.Data());
+
+  move_slice.Skip(2);
+  EXPECT_EQ("llo", move_slice.ToString());
+  EXPECT_EQ("hello", slice.ToString());
+
+  BufferSlice alloc_slice;
+  Code ret = BufferSlice::Alloc(3, &alloc_slice);
+  EXPECT_EQ(kOk, ret);
+  memcpy(alloc_slice.MutableData(), "xyz", 3);
+  EXPECT_EQ("xyz", alloc_slice.ToString());
+} /*}}}*/
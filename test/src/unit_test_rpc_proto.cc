@@ -0,0 +1,95 @@
+// Copyright (c) 2015 The CSUTIL Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string>
+
+#include "base/common.h"
+#include "base/status.h"
+#include "sock/rpc_proto.h"
+
+#include "test_base/include/test_base.h"
+
+TEST(RpcProto, Test_Normal_Multiplex_Frame) { /*{{{*/
+  using namespace base;
+  std::string real_data;
+  Code ret = FormatMultiplexUserData(0x1122334455667788ULL, "hello", &real_data);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ((size_t)(kHeadLen + kMultiplexExtHeadLen + 5), real_data.size());
+  EXPECT_TRUE(IsMultiplexFrame(real_data.data(), real_data.size()));
+
+  int real_len = 0;
+  ret = DefaultProtoFunc(real_data.data(), real_data.size(), &real_len);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ((int)real_data.size(), real_len);
+
+  ret = DefaultProtoFunc(real_data.data(), real_data.size() - 1, &real_len);
+  EXPECT_EQ(kDataNotEnough, ret);
+
+  uint64_t req_id = 0;
+  std::string user_data;
+  ret = GetMultiplexUserData(real_data.data(), real_data.size(), &req_id, &user_data);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ(0x1122334455667788ULL, req_id);
+  EXPECT_EQ("hello", user_data);
+} /*}}}*/
+
+TEST(RpcProto, Test_Normal_Multiplex_Frame_Error) { /*{{{*/
+  using namespace base;
+  std::string real_data;
+  Code ret = FormatMultiplexFrameErrorResp(kFrameInternalError, 7, &real_data);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ((size_t)(kHeadLen + kMultiplexExtHeadLen), real_data.size());
+
+  uint64_t req_id = 0;
+  std::string user_data;
+  ret = GetMultiplexUserData(real_data.data(), real_data.size(), &req_id, &user_data);
+  EXPECT_EQ(kFrameInternalError, ret);
+  EXPECT_EQ(7u, req_id);
+
+  real_data.clear();
+  ret = FormatMultiplexFrameErrorResp(kInvalidParam, 7, &real_data);
+  EXPECT_EQ(kInvalidParam, ret);
+} /*}}}*/
+
+TEST(RpcProto, Test_Normal_Negotiate_By_Magic) { /*{{{*/
+  using namespace base;
+  std::string old_data;
+  Code ret = DefaultFormatUserDataFunc("hello", &old_data);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_FALSE(IsMultiplexFrame(old_data.data(), old_data.size()));
+
+  uint64_t req_id = 0;
+  std::string user_data;
+  ret = GetMultiplexUserData(old_data.data(), old_data.size(), &req_id, &user_data);
+  EXPECT_NEQ(kOk, ret);
+
+  std::string new_data;
+  ret = FormatMultiplexUserData(1, "hello", &new_data);
+  EXPECT_EQ(kOk, ret);
+  ret = DefaultGetUserDataFunc(new_data.data(), new_data.size(), &user_data);
+  EXPECT_EQ(kFrameInvalidMagic, ret);
+} /*}}}*/
+
+TEST(RpcProto, Test_Exception_Invalid_Multiplex_Frame) { /*{{{*/
+  using namespace base;
+  std::string real_data;
+  Code ret = FormatMultiplexUserData(1, "hello", &real_data);
+  EXPECT_EQ(kOk, ret);
+
+  uint64_t req_id = 0;
+  std::string user_data;
+  ret = GetMultiplexUserData(real_data.data(), real_data.size() - 1, &req_id, &user_data);
+  EXPECT_EQ(kInvalidData, ret);
+
+  ret = GetMultiplexUserData(real_data.data(), kHeadLen + kExtHeadLen, &req_id, &user_data);
+  EXPECT_EQ(kInvalidData, ret);
+
+  ret = GetMultiplexUserData(NULL, real_data.size(), &req_id, &user_data);
+  EXPECT_EQ(kInvalidParam, ret);
+
+  EXPECT_FALSE(IsMultiplexFrame(real_data.data(), kHeadLen));
+} /*}}}*/
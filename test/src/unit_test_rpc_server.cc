@@ -0,0 +1,324 @@
+// Copyright (c) 2015 The CSUTIL Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <string>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <google/protobuf/wrappers.pb.h>
+
+#include "base/config.h"
+#include "base/status.h"
+#include "sock/rpc_proto.h"
+#include "sock/rpc_server.h"
+
+#include "test_base/include/test_base.h"
+
+static const int kTestPort = 19527;
+static const int kTestIdleTimeoutMs = 200;
+static const char kTestConfPath[] = "../data/unit_test_rpc_server.conf";
+
+static base::Code EchoAction(const base::Config &conf, const ::google::protobuf::Message *req,
+                             ::google::protobuf::Message *resp) { /*{{{*/
+  resp->CopyFrom(*req);
+  return base::kOk;
+} /*}}}*/
+
+static void *RunServer(void *param) { /*{{{*/
+  base::RpcServer *server = static_cast<base::RpcServer *>(param);
+  server->Run();
+  return NULL;
+} /*}}}*/
+
+static uint64_t GetNowMs() { /*{{{*/
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return (uint64_t)now.tv_sec * 1000 + now.tv_usec / 1000;
+} /*}}}*/
+
+// NOTE: server is started once, and it runs until the test process exits
+static base::Code StartServer() { /*{{{*/
+  static base::RpcServer *server = NULL;
+  if (server != NULL) return base::kOk;
+
+  FILE *fp = fopen(kTestConfPath, "w");
+  if (fp == NULL) return base::kOpenFileFailed;
+  fprintf(fp, "port = %d\nreal_worker_thread_num = 1\nconn_worker_thread_num = 1\nconn_idle_timeout_ms = %d\n"
+          "stat_path = ../data/unit_test_rpc_server_stat\n",
+          kTestPort, kTestIdleTimeoutMs);
+  fclose(fp);
+
+  base::Config conf;
+  base::Code ret = conf.LoadFile(kTestConfPath);
+  if (ret != base::kOk) return ret;
+
+  static base::Config user_conf;
+  static ::google::protobuf::StringValue req_prototype;
+  static ::google::protobuf::StringValue resp_prototype;
+  server = new base::RpcServer(conf, user_conf, base::DefaultProtoFunc, base::DefaultGetUserDataFunc,
+                               base::DefaultFormatUserDataFunc, EchoAction, &req_prototype, &resp_prototype);
+  ret = server->Init();
+  if (ret != base::kOk) return ret;
+
+  pthread_t tid;
+  if (pthread_create(&tid, NULL, RunServer, server) != 0) return base::kPthreadCreateFailed;
+  pthread_detach(tid);
+  return base::kOk;
+} /*}}}*/
+
+static base::Code Connect(int *fd) { /*{{{*/
+  *fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (*fd == -1) return base::kSocketError;
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(kTestPort);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (connect(*fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+    close(*fd);
+    return base::kConnectError;
+  }
+  return base::kOk;
+} /*}}}*/
+
+static base::Code SendFrame(int fd, const std::string &user_data) { /*{{{*/
+  std::string frame;
+  base::Code ret = base::DefaultFormatUserDataFunc(user_data, &frame);
+  if (ret != base::kOk) return ret;
+  if (write(fd, frame.data(), frame.size()) != (ssize_t)frame.size()) return base::kWriteError;
+  return base::kOk;
+} /*}}}*/
+
+// NOTE: responses are read and dropped, until server closes the connection or max_ms passes
+static base::Code WaitClosed(int fd, uint32_t max_ms, uint32_t *resp_bytes) { /*{{{*/
+  *resp_bytes = 0;
+  uint64_t end_ms = GetNowMs() + max_ms;
+  char buf[1024];
+  while (GetNowMs() < end_ms) {
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    if (poll(&pfd, 1, 10) <= 0) continue;
+
+    ssize_t r = read(fd, buf, sizeof(buf));
+    if (r <= 0) return base::kOk;
+    *resp_bytes += r;
+  }
+  return base::kTimeOut;
+} /*}}}*/
+
+TEST(RpcServer, Test_Normal_Idle_Close_After_Response) { /*{{{*/
+  using namespace base;
+  Code ret = StartServer();
+  EXPECT_EQ(kOk, ret);
+
+  int fd = -1;
+  ret = Connect(&fd);
+  EXPECT_EQ(kOk, ret);
+
+  ::google::protobuf::StringValue req;
+  req.set_value("hello");
+  ret = SendFrame(fd, req.SerializeAsString());
+  EXPECT_EQ(kOk, ret);
+
+  uint32_t resp_bytes = 0;
+  ret = WaitClosed(fd, kTestIdleTimeoutMs * 10, &resp_bytes);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_GT(resp_bytes, 0u);
+  close(fd);
+} /*}}}*/
+
+TEST(RpcServer, Test_Exception_Idle_Close_After_Malformed_Request) { /*{{{*/
+  using namespace base;
+  Code ret = StartServer();
+  EXPECT_EQ(kOk, ret);
+
+  int fd = -1;
+  ret = Connect(&fd);
+  EXPECT_EQ(kOk, ret);
+
+  // NOTE: protobuf fails to parse, and nothing is responded, but the request should not be pending forever
+  ret = SendFrame(fd, std::string("\xff\xff\xff\xff", 4));
+  EXPECT_EQ(kOk, ret);
+
+  uint32_t resp_bytes = 0;
+  ret = WaitClosed(fd, kTestIdleTimeoutMs * 10, &resp_bytes);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ(0u, resp_bytes);
+  close(fd);
+} /*}}}*/
+
+TEST(WorkerDispatcher, Test_Normal_Get_Dispatch_Policy) { /*{{{*/
+  using namespace base;
+  DispatchPolicy policy = kRandomPolicy;
+  EXPECT_EQ(kOk, GetDispatchPolicy(kRoundRobinDispatch, &policy));
+  EXPECT_EQ(kRoundRobinPolicy, policy);
+  EXPECT_EQ(kOk, GetDispatchPolicy(kLeastQueueDispatch, &policy));
+  EXPECT_EQ(kLeastQueuePolicy, policy);
+  EXPECT_EQ(kOk, GetDispatchPolicy(kPowerOfTwoDispatch, &policy));
+  EXPECT_EQ(kPowerOfTwoPolicy, policy);
+  EXPECT_EQ(kOk, GetDispatchPolicy(kAffinityDispatch, &policy));
+  EXPECT_EQ(kAffinityPolicy, policy);
+  EXPECT_EQ(kOk, GetDispatchPolicy(kRandomDispatch, &policy));
+  EXPECT_EQ(kRandomPolicy, policy);
+
+  EXPECT_EQ(kInvalidParam, GetDispatchPolicy("unknown", &policy));
+  EXPECT_EQ(kInvalidParam, GetDispatchPolicy(kRandomDispatch, NULL));
+} /*}}}*/
+
+TEST(WorkerDispatcher, Test_Exception_Init) { /*{{{*/
+  using namespace base;
+  WorkerDispatcher dispatcher;
+  std::vector<const uint32_t *> depths;
+  EXPECT_EQ(kInvalidParam, dispatcher.Init(kRandomPolicy, depths));
+
+  uint32_t depth = 0;
+  depths.push_back(&depth);
+  depths.push_back(NULL);
+  EXPECT_EQ(kInvalidParam, dispatcher.Init(kRandomPolicy, depths));
+} /*}}}*/
+
+static const int kTestWorkerNum = 4;
+static const int kTestSelectNum = 1000;
+
+static base::Code InitDispatcher(base::DispatchPolicy policy, uint32_t *depths, base::WorkerDispatcher *dispatcher) { /*{{{*/
+  std::vector<const uint32_t *> depth_ptrs;
+  for (int i = 0; i < kTestWorkerNum; ++i) {
+    depth_ptrs.push_back(depths + i);
+  }
+  return dispatcher->Init(policy, depth_ptrs);
+} /*}}}*/
+
+TEST(WorkerDispatcher, Test_Normal_Random_And_Round_Robin) { /*{{{*/
+  using namespace base;
+  uint32_t depths[kTestWorkerNum] = {0};
+
+  WorkerDispatcher random_dispatcher;
+  EXPECT_EQ(kOk, InitDispatcher(kRandomPolicy, depths, &random_dispatcher));
+  int select_nums[kTestWorkerNum] = {0};
+  for (int i = 0; i < kTestSelectNum; ++i) {
+    int n = random_dispatcher.Select(0);
+    EXPECT_EQ(true, n >= 0 && n < kTestWorkerNum);
+    ++select_nums[n];
+  }
+  for (int i = 0; i < kTestWorkerNum; ++i) {
+    EXPECT_GT(select_nums[i], 0);
+  }
+
+  WorkerDispatcher rr_dispatcher;
+  EXPECT_EQ(kOk, InitDispatcher(kRoundRobinPolicy, depths, &rr_dispatcher));
+  for (int i = 0; i < kTestSelectNum; ++i) {
+    EXPECT_EQ(i % kTestWorkerNum, rr_dispatcher.Select(0));
+  }
+} /*}}}*/
+
+TEST(WorkerDispatcher, Test_Normal_Least_Queue_Choose_Shallowest) { /*{{{*/
+  using namespace base;
+  uint32_t depths[kTestWorkerNum] = {5, 7, 1, 3};
+  WorkerDispatcher dispatcher;
+  EXPECT_EQ(kOk, InitDispatcher(kLeastQueuePolicy, depths, &dispatcher));
+  for (int i = 0; i < kTestSelectNum; ++i) {
+    EXPECT_EQ(2, dispatcher.Select(0));
+  }
+
+  // NOTE: depth is read on every select
+  depths[3] = 0;
+  EXPECT_EQ(3, dispatcher.Select(0));
+
+  // NOTE: ties are spread over workers
+  for (int i = 0; i < kTestWorkerNum; ++i) {
+    depths[i] = 0;
+  }
+  int select_nums[kTestWorkerNum] = {0};
+  for (int i = 0; i < kTestSelectNum; ++i) {
+    ++select_nums[dispatcher.Select(0)];
+  }
+  for (int i = 0; i < kTestWorkerNum; ++i) {
+    EXPECT_GT(select_nums[i], 0);
+  }
+} /*}}}*/
+
+TEST(WorkerDispatcher, Test_Normal_P2C_Choose_Shallower) { /*{{{*/
+  using namespace base;
+  // NOTE: the deepest one always loses to the other candidate, and the shallowest one always wins
+  uint32_t depths[kTestWorkerNum] = {2, 9, 0, 4};
+  WorkerDispatcher dispatcher;
+  EXPECT_EQ(kOk, InitDispatcher(kPowerOfTwoPolicy, depths, &dispatcher));
+  int select_nums[kTestWorkerNum] = {0};
+  for (int i = 0; i < kTestSelectNum; ++i) {
+    ++select_nums[dispatcher.Select(0)];
+  }
+  EXPECT_EQ(0, select_nums[1]);
+  EXPECT_GT(select_nums[2], select_nums[0]);
+  EXPECT_GT(select_nums[2], select_nums[3]);
+  EXPECT_GT(select_nums[0], 0);
+
+  // NOTE: two candidates of two workers are both of them, so the shallower one is always chosen
+  std::vector<const uint32_t *> two_depths;
+  two_depths.push_back(depths + 0);
+  two_depths.push_back(depths + 1);
+  EXPECT_EQ(kOk, dispatcher.Init(kPowerOfTwoPolicy, two_depths));
+  for (int i = 0; i < kTestSelectNum; ++i) {
+    EXPECT_EQ(0, dispatcher.Select(0));
+  }
+} /*}}}*/
+
+TEST(WorkerDispatcher, Test_Normal_Affinity_Stable) { /*{{{*/
+  using namespace base;
+  uint32_t depths[kTestWorkerNum] = {0};
+  WorkerDispatcher dispatcher;
+  EXPECT_EQ(kOk, InitDispatcher(kAffinityPolicy, depths, &dispatcher));
+
+  int select_nums[kTestWorkerNum] = {0};
+  for (uint64_t key = 0; key < 100; ++key) {
+    int n = dispatcher.Select(key);
+    ++select_nums[n];
+
+    // NOTE: the same key always goes to the same worker, whatever the depths are
+    depths[n] += 10;
+    EXPECT_EQ(n, dispatcher.Select(key));
+  }
+  for (int i = 0; i < kTestWorkerNum; ++i) {
+    EXPECT_GT(select_nums[i], 0);
+  }
+} /*}}}*/
+
+TEST(WorkerDispatcher, Test_Normal_Single_Worker) { /*{{{*/
+  using namespace base;
+  uint32_t depth = 3;
+  std::vector<const uint32_t *> depths(1, &depth);
+  WorkerDispatcher dispatcher;
+  EXPECT_EQ(kOk, dispatcher.Init(kPowerOfTwoPolicy, depths));
+  EXPECT_EQ(0, dispatcher.Select(12345));
+} /*}}}*/
+
+TEST(RealWorker, Test_Exception_Rejected_Block_Not_Counted) { /*{{{*/
+  using namespace base;
+  Code ret = StartServer();  // NOTE: conf file is written by it
+  EXPECT_EQ(kOk, ret);
+
+  Config conf;
+  ret = conf.LoadFile(kTestConfPath);
+  EXPECT_EQ(kOk, ret);
+
+  Config user_conf;
+  ::google::protobuf::StringValue req_prototype;
+  ::google::protobuf::StringValue resp_prototype;
+  RpcServer server(conf, user_conf, DefaultProtoFunc, DefaultGetUserDataFunc, DefaultFormatUserDataFunc, EchoAction,
+                   &req_prototype, &resp_prototype);
+  RealWorker worker(&server);
+  ret = worker.AddOneDataBlockAndNotify(NULL);
+  EXPECT_EQ(kInvalidParam, ret);
+  EXPECT_EQ(0u, *worker.GetQueueDepth());
+} /*}}}*/
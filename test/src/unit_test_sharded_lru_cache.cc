@@ -0,0 +1,255 @@
+// Copyright (c) 2015 The CSUTIL Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <string>
+#include <vector>
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "base/status.h"
+
+#include "test_base/include/test_base.h"
+
+#include "store/cache/lru_cache/src/lru_cache.h"
+#include "store/cache/lru_cache/src/sharded_lru_cache.h"
+
+static uint64_t GetNowUs() { /*{{{*/
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return (uint64_t)now.tv_sec * 1000000 + now.tv_usec;
+} /*}}}*/
+
+static std::string GetKey(uint32_t i) { /*{{{*/
+  char buf[32] = "\0";
+  snprintf(buf, sizeof(buf), "key%u", (unsigned int)i);
+  return buf;
+} /*}}}*/
+
+TEST(ShardedLRUCache, NormalPutGetDel) { /*{{{*/
+  using namespace base;
+  using namespace store;
+
+  ShardedLRUCache cache;
+  std::string tmp_value;
+  Code ret = cache.Put("key1", "value1");
+  EXPECT_EQ(kNotInit, ret);
+  ret = cache.Init(0, 0, 0);
+  EXPECT_EQ(kInvalidParam, ret);
+  ret = cache.Init(0, 0, 10);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ(16u, cache.GetShardsNum());
+
+  ret = cache.Put("key1", "value1");
+  EXPECT_EQ(kOk, ret);
+  ret = cache.Put("key2", "value2");
+  EXPECT_EQ(kOk, ret);
+  ret = cache.Put("key1", "value3");
+  EXPECT_EQ(kOk, ret);
+  ret = cache.Get("key1", &tmp_value);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ("value3", tmp_value);
+  ret = cache.Get("key2", &tmp_value);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ("value2", tmp_value);
+
+  ret = cache.Del("key1");
+  EXPECT_EQ(kOk, ret);
+  ret = cache.Del("key1");
+  EXPECT_EQ(kNotFound, ret);
+  ret = cache.Get("key1", &tmp_value);
+  EXPECT_EQ(kNotFound, ret);
+
+  LRUShardStat stat;
+  ret = cache.GetStat(&stat);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ(2u, stat.hit_num);
+  EXPECT_EQ(1u, stat.miss_num);
+  EXPECT_EQ(1u, stat.size);
+  ret = cache.GetShardStat(16, &stat);
+  EXPECT_EQ(kInvalidParam, ret);
+} /*}}}*/
+
+TEST(ShardedLRUCache, NormalGetOutForMaxNum) { /*{{{*/
+  using namespace base;
+  using namespace store;
+
+  // NOTE: one shard is the same as LRUCache, so the least recent key is evicted
+  ShardedLRUCache cache;
+  Code ret = cache.Init(2, 0, 1);
+  EXPECT_EQ(kOk, ret);
+  cache.Put("key1", "value1");
+  cache.Put("key2", "value2");
+  std::string tmp_value;
+  ret = cache.Get("key1", &tmp_value);
+  EXPECT_EQ(kOk, ret);
+  cache.Put("key3", "value3");
+  ret = cache.Get("key2", &tmp_value);
+  EXPECT_EQ(kNotFound, ret);
+  ret = cache.Get("key1", &tmp_value);
+  EXPECT_EQ(kOk, ret);
+  ret = cache.Get("key3", &tmp_value);
+  EXPECT_EQ(kOk, ret);
+
+  LRUShardStat stat;
+  cache.GetShardStat(0, &stat);
+  EXPECT_EQ(1u, stat.evict_num);
+  EXPECT_EQ(2u, stat.size);
+} /*}}}*/
+
+TEST(ShardedLRUCache, BigDataGetOutForMaxNum) { /*{{{*/
+  using namespace base;
+  using namespace store;
+
+  const uint32_t kMaxNum = 100000;
+  ShardedLRUCache cache;
+  Code ret = cache.Init(kMaxNum, 0);
+  EXPECT_EQ(kOk, ret);
+  for (uint32_t i = 0; i < kMaxNum * 2; ++i) {
+    ret = cache.Put(GetKey(i), GetKey(i));
+    EXPECT_EQ(kOk, ret);
+  }
+
+  // NOTE: every shard keeps the recent keys of its own, so old keys are all evicted
+  uint32_t found_num = 0;
+  for (uint32_t i = 0; i < kMaxNum * 2; ++i) {
+    std::string tmp_value;
+    ret = cache.Get(GetKey(i), &tmp_value);
+    if (ret != kOk) continue;
+    ++found_num;
+    EXPECT_EQ(GetKey(i), tmp_value);
+  }
+  EXPECT_LT(found_num, kMaxNum + 1);
+  EXPECT_GT(found_num, kMaxNum * 9 / 10);
+
+  uint64_t evict_num = 0;
+  for (uint32_t i = 0; i < cache.GetShardsNum(); ++i) {
+    LRUShardStat stat;
+    cache.GetShardStat(i, &stat);
+    EXPECT_LT(stat.size, kMaxNum / cache.GetShardsNum() + 1);
+    evict_num += stat.evict_num;
+  }
+  EXPECT_EQ((uint64_t)kMaxNum * 2 - found_num, evict_num);
+} /*}}}*/
+
+TEST(ShardedLRUCache, NormalGetOutForTimeInterval) { /*{{{*/
+  using namespace base;
+  using namespace store;
+
+  ShardedLRUCache cache;
+  Code ret = cache.Init(0, 1);
+  EXPECT_EQ(kOk, ret);
+  cache.Put("key1", "value1");
+  std::string tmp_value;
+  ret = cache.Get("key1", &tmp_value);
+  EXPECT_EQ(kOk, ret);
+
+  sleep(2);
+  ret = cache.Get("key1", &tmp_value);
+  EXPECT_EQ(kNotFound, ret);
+  LRUShardStat stat;
+  cache.GetStat(&stat);
+  EXPECT_EQ(1u, stat.expire_num);
+  EXPECT_EQ(0u, stat.size);
+} /*}}}*/
+
+struct PressParam { /*{{{*/
+  store::LRUCache *cache;
+  store::ShardedLRUCache *sharded_cache;
+  uint32_t seed;
+  uint32_t ops_num;
+  uint32_t keys_num;
+}; /*}}}*/
+
+// NOTE: 90% Get and 10% Put, which is the read mostly load of cache dao
+static void *PressThreadAction(void *arg) { /*{{{*/
+  PressParam *param = static_cast<PressParam *>(arg);
+  std::string value(100, 'v');
+  std::string tmp_value;
+  for (uint32_t i = 0; i < param->ops_num; ++i) {
+    std::string key = GetKey(rand_r(&param->seed) % param->keys_num);
+    bool is_put = (rand_r(&param->seed) % 10 == 0);
+    if (param->sharded_cache != NULL) {
+      if (is_put) {
+        param->sharded_cache->Put(key, value);
+      } else {
+        param->sharded_cache->Get(key, &tmp_value);
+      }
+    } else {
+      if (is_put) {
+        param->cache->Put(key, value);
+      } else {
+        param->cache->Get(key, &tmp_value);
+      }
+    }
+  }
+  return NULL;
+} /*}}}*/
+
+static uint64_t RunPress(store::LRUCache *cache, store::ShardedLRUCache *sharded_cache, uint32_t threads_num,
+                         uint32_t ops_num, uint32_t keys_num) { /*{{{*/
+  std::vector<pthread_t> tids(threads_num);
+  std::vector<PressParam> params(threads_num);
+  uint64_t start_us = GetNowUs();
+  for (uint32_t i = 0; i < threads_num; ++i) {
+    params[i].cache = cache;
+    params[i].sharded_cache = sharded_cache;
+    params[i].seed = i + 1;
+    params[i].ops_num = ops_num / threads_num;
+    params[i].keys_num = keys_num;
+    pthread_create(&tids[i], NULL, PressThreadAction, &params[i]);
+  }
+  for (uint32_t i = 0; i < threads_num; ++i) {
+    pthread_join(tids[i], NULL);
+  }
+  uint64_t cost_us = GetNowUs() - start_us;
+
+  return (uint64_t)ops_num * 1000000 / (cost_us + 1);
+} /*}}}*/
+
+TEST(ShardedLRUCache, PressMultiThreadsWithLRUCache) { /*{{{*/
+  using namespace base;
+  using namespace store;
+
+  const uint32_t kKeysNum = 200000;
+  const uint32_t kMaxNum = 100000;
+  const uint32_t kOpsNum = 1000000;
+  uint32_t cpus_num = (uint32_t)sysconf(_SC_NPROCESSORS_ONLN);
+  fprintf(stderr, "cpus:%u, keys:%u, max num:%u, ops:%u, 90%% get\n", cpus_num, kKeysNum, kMaxNum, kOpsNum);
+
+  // NOTE: ops per second by threads; sharded cache scales with cores, while LRUCache waits for one lock
+  uint32_t threads_nums[] = {1, 2, 4, 8};
+  uint64_t sharded_qps_1 = 0;
+  uint64_t lru_qps_1 = 0;
+  for (size_t i = 0; i < sizeof(threads_nums) / sizeof(threads_nums[0]); ++i) {
+    // NOTE: caches are full before press, so Puts of missed keys evict as a warm cache does
+    LRUCache cache;
+    cache.Init(kMaxNum, 0);
+    ShardedLRUCache sharded_cache;
+    sharded_cache.Init(kMaxNum, 0);
+    for (uint32_t j = 0; j < kMaxNum; ++j) {
+      cache.Put(GetKey(j), GetKey(j));
+      sharded_cache.Put(GetKey(j), GetKey(j));
+    }
+
+    uint64_t lru_qps = RunPress(&cache, NULL, threads_nums[i], kOpsNum, kKeysNum);
+    uint64_t sharded_qps = RunPress(NULL, &sharded_cache, threads_nums[i], kOpsNum, kKeysNum);
+    if (i == 0) {
+      lru_qps_1 = lru_qps;
+      sharded_qps_1 = sharded_qps;
+    }
+
+    LRUShardStat stat;
+    sharded_cache.GetStat(&stat);
+    fprintf(stderr, "threads:%u, lru cache qps:%llu, sharded lru cache qps:%llu, hit ratio:%.3f, evict:%llu\n",
+            threads_nums[i], (unsigned long long)lru_qps, (unsigned long long)sharded_qps,
+            (double)stat.hit_num / (stat.hit_num + stat.miss_num + 1), (unsigned long long)stat.evict_num);
+  }
+
+  EXPECT_GT(sharded_qps_1, lru_qps_1);
+} /*}}}*/
@@ -134,6 +134,68 @@ TEST(SkipLit, Test_Normal_Del_String) { /*{{{*/
 
 } /*}}}*/
 
+TEST(SkipLit, Test_Normal_Seek_String) { /*{{{*/
+  using namespace base;
+
+  SkipList<std::string, std::string, CompareString> skip_list;
+  SkipList<std::string, std::string, CompareString>::Iterator iter(&skip_list);
+  Code ret = iter.Seek("key");
+  EXPECT_EQ(kNotInit, ret);
+
+  ret = skip_list.Init();
+  EXPECT_EQ(kOk, ret);
+  ret = iter.Seek("key");
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ(false, iter.Valid());
+
+  // NOTE: only even keys are put, so odd keys are seeked to the next even one
+  std::map<std::string, std::string> maps;
+  char buf[8] = "\0";
+  for (uint32_t i = 0; i < 1000; i += 2) {
+    snprintf(buf, sizeof(buf), "%04u", (unsigned int)i);
+    std::string key = std::string("key") + buf;
+    ret = skip_list.Put(key, std::string("value") + buf);
+    EXPECT_EQ(kOk, ret);
+    maps[key] = std::string("value") + buf;
+  }
+
+  for (uint32_t i = 0; i < 1001; ++i) {
+    snprintf(buf, sizeof(buf), "%04u", (unsigned int)i);
+    std::string key = std::string("key") + buf;
+    std::map<std::string, std::string>::iterator it = maps.lower_bound(key);
+
+    ret = iter.Seek(key);
+    EXPECT_EQ(kOk, ret);
+    if (it == maps.end()) {
+      EXPECT_EQ(false, iter.Valid());
+      continue;
+    }
+
+    std::string cur_key;
+    std::string cur_value;
+    ret = iter.GetKey(&cur_key);
+    EXPECT_EQ(kOk, ret);
+    ret = iter.GetValue(&cur_value);
+    EXPECT_EQ(kOk, ret);
+    EXPECT_EQ(it->first, cur_key);
+    EXPECT_EQ(it->second, cur_value);
+
+    // NOTE: iterating from the seeked node is the same as map
+    for (uint32_t j = 0; j < 3 && it != maps.end(); ++j, ++it) {
+      EXPECT_EQ(true, iter.Valid());
+      iter.GetKey(&cur_key);
+      EXPECT_EQ(it->first, cur_key);
+      iter.GoNext();
+    }
+  }
+
+  ret = iter.Seek("");
+  EXPECT_EQ(kOk, ret);
+  std::string first_key;
+  iter.GetKey(&first_key);
+  EXPECT_EQ(maps.begin()->first, first_key);
+} /*}}}*/
+
 TEST(SkipLit, Test_Normal_Get_Int) { /*{{{*/
   using namespace base;
 
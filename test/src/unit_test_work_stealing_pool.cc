@@ -0,0 +1,266 @@
+// Copyright (c) 2015 The CSUTIL Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <pthread.h>
+#include <stdio.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "base/mutex.h"
+#include "base/status.h"
+#include "base/work_stealing_pool.h"
+
+#include "test_base/include/test_base.h"
+
+static uint64_t GetNowUs() { /*{{{*/
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return (uint64_t)now.tv_sec * 1000000 + now.tv_usec;
+} /*}}}*/
+
+static base::Code WaitPending(base::WorkStealingPool *pool, uint32_t max_ms) { /*{{{*/
+  for (uint32_t i = 0; i < max_ms && pool->GetPendingNum() > 0; ++i) {
+    usleep(1000);
+  }
+  return pool->GetPendingNum() == 0 ? base::kOk : base::kTimeOut;
+} /*}}}*/
+
+TEST(WorkStealingPool, Test_Normal_Submit) { /*{{{*/
+  using namespace base;
+  WorkStealingPool pool;
+  Code ret = pool.Submit([]() {});
+  EXPECT_EQ(kNotInit, ret);
+
+  ret = pool.Init(4, 4);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ(4, pool.GetThreadsNum());
+
+  uint32_t sum = 0;
+  const uint32_t kTaskNum = 10000;
+  for (uint32_t i = 0; i < kTaskNum; ++i) {
+    ret = pool.Submit([&sum]() { FetchAndAdd(&sum, (uint32_t)1); });
+    EXPECT_EQ(kOk, ret);
+  }
+
+  ret = pool.Stop();
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ(kTaskNum, sum);
+  EXPECT_EQ(0, pool.GetThreadsNum());
+  EXPECT_EQ(0u, pool.GetPendingNum());
+
+  uint64_t exec_num = 0;
+  for (int i = 0; i < pool.GetMaxThreadsNum(); ++i) {
+    PoolWorkerStat stat;
+    ret = pool.GetWorkerStat(i, &stat);
+    EXPECT_EQ(kOk, ret);
+    exec_num += stat.exec_num;
+  }
+  EXPECT_EQ((uint64_t)kTaskNum, exec_num);
+
+  // NOTE:htt, task rejected after Stop is not queued, so it is never executed and not counted as pending
+  ret = pool.Submit([&sum]() { FetchAndAdd(&sum, (uint32_t)1); });
+  EXPECT_EQ(kNotInit, ret);
+  EXPECT_EQ(0u, pool.GetPendingNum());
+  EXPECT_EQ(kTaskNum, sum);
+} /*}}}*/
+
+TEST(WorkStealingPool, Test_Exception_Invalid_Param) { /*{{{*/
+  using namespace base;
+  WorkStealingPool pool;
+  Code ret = pool.Init(0, 4);
+  EXPECT_EQ(kInvalidParam, ret);
+
+  ret = pool.Init(2, 1);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ(2, pool.GetMaxThreadsNum());
+
+  ret = pool.GetWorkerStat(2, NULL);
+  EXPECT_EQ(kInvalidParam, ret);
+  PoolWorkerStat stat;
+  ret = pool.GetWorkerStat(2, &stat);
+  EXPECT_EQ(kInvalidParam, ret);
+} /*}}}*/
+
+TEST(WorkStealingPool, Test_Normal_Steal) { /*{{{*/
+  using namespace base;
+  WorkStealingPool pool;
+  Code ret = pool.Init(4, 4);
+  EXPECT_EQ(kOk, ret);
+
+  // NOTE:htt, sub tasks are pushed into the deque of the submitting worker, then stolen by the idle ones
+  uint32_t sum = 0;
+  const uint32_t kSubTaskNum = 200;
+  ret = pool.Submit([&pool, &sum, kSubTaskNum]() {
+    for (uint32_t i = 0; i < kSubTaskNum; ++i) {
+      pool.Submit([&sum]() {
+        usleep(500);
+        FetchAndAdd(&sum, (uint32_t)1);
+      });
+    }
+  });
+  EXPECT_EQ(kOk, ret);
+
+  ret = WaitPending(&pool, 5000);
+  EXPECT_EQ(kOk, ret);
+  pool.Stop();
+  EXPECT_EQ(kSubTaskNum, sum);
+
+  uint64_t steal_num = 0;
+  int exec_workers = 0;
+  for (int i = 0; i < pool.GetMaxThreadsNum(); ++i) {
+    PoolWorkerStat stat;
+    pool.GetWorkerStat(i, &stat);
+    steal_num += stat.steal_num;
+    if (stat.exec_num > 0) ++exec_workers;
+  }
+  fprintf(stderr, "steal_num:%llu, exec_workers:%d\n", (unsigned long long)steal_num, exec_workers);
+  EXPECT_GT(steal_num, 0u);
+  EXPECT_GT(exec_workers, 1);
+} /*}}}*/
+
+TEST(WorkStealingPool, Test_Normal_Grow_And_Shrink) { /*{{{*/
+  using namespace base;
+  WorkStealingPool pool;
+  Code ret = pool.Init(1, 4, 50);
+  EXPECT_EQ(kOk, ret);
+  EXPECT_EQ(1, pool.GetThreadsNum());
+
+  // NOTE:htt, blocked tasks pile up, so threads are added up to max
+  uint32_t sum = 0;
+  for (int i = 0; i < 8; ++i) {
+    ret = pool.Submit([&sum]() {
+      usleep(20000);
+      FetchAndAdd(&sum, (uint32_t)1);
+    });
+    EXPECT_EQ(kOk, ret);
+  }
+  EXPECT_EQ(4, pool.GetThreadsNum());
+
+  ret = WaitPending(&pool, 2000);
+  EXPECT_EQ(kOk, ret);
+
+  // NOTE:htt, threads above core exit after idle for keep alive time
+  for (int i = 0; i < 200 && pool.GetThreadsNum() > 1; ++i) {
+    usleep(5000);
+  }
+  EXPECT_EQ(1, pool.GetThreadsNum());
+  EXPECT_EQ(8u, sum);
+
+  ret = pool.Submit([&sum]() { FetchAndAdd(&sum, (uint32_t)1); });
+  EXPECT_EQ(kOk, ret);
+  pool.Stop();
+  EXPECT_EQ(9u, sum);
+} /*}}}*/
+
+struct SubmitParam { /*{{{*/
+  base::WorkStealingPool *pool;
+  uint32_t *exec_num;
+  uint32_t ok_num;
+}; /*}}}*/
+
+static void *SubmitUntilStop(void *arg) { /*{{{*/
+  SubmitParam *param = static_cast<SubmitParam *>(arg);
+  uint32_t *exec_num = param->exec_num;
+  while (param->pool->Submit([exec_num]() { base::FetchAndAdd(exec_num, (uint32_t)1); }) == base::kOk) {
+    ++param->ok_num;
+  }
+  return NULL;
+} /*}}}*/
+
+TEST(WorkStealingPool, Test_Normal_Submit_While_Stop) { /*{{{*/
+  using namespace base;
+  WorkStealingPool pool;
+  Code ret = pool.Init(2, 4, 50);
+  EXPECT_EQ(kOk, ret);
+
+  // NOTE:htt, every task accepted before Stop is executed, and none rejected by it is queued
+  const int kSubmitThreadsNum = 4;
+  uint32_t exec_num = 0;
+  pthread_t ids[kSubmitThreadsNum];
+  SubmitParam params[kSubmitThreadsNum];
+  for (int i = 0; i < kSubmitThreadsNum; ++i) {
+    params[i].pool = &pool;
+    params[i].exec_num = &exec_num;
+    params[i].ok_num = 0;
+    pthread_create(ids + i, NULL, SubmitUntilStop, params + i);
+  }
+  usleep(50000);
+  ret = pool.Stop();
+  EXPECT_EQ(kOk, ret);
+
+  uint32_t ok_num = 0;
+  for (int i = 0; i < kSubmitThreadsNum; ++i) {
+    pthread_join(ids[i], NULL);
+    ok_num += params[i].ok_num;
+  }
+  EXPECT_GT(ok_num, 0u);
+  EXPECT_EQ(ok_num, exec_num);
+  EXPECT_EQ(0u, pool.GetPendingNum());
+  EXPECT_EQ(0, pool.GetThreadsNum());
+} /*}}}*/
+
+static base::Code RunSlowTasks(std::vector<base::WorkStealingPool *> *pools, uint64_t *max_queue_us,
+                               uint64_t *cost_us) { /*{{{*/
+  // NOTE:htt, every 40th task is slow, and all of them are on the same queue by round robin of 4 threads
+  const int kTaskNum = 400;
+  uint64_t start_us = GetNowUs();
+  for (int i = 0; i < kTaskNum; ++i) {
+    useconds_t sleep_us = (i % 40 == 0) ? 20000 : 200;
+    base::WorkStealingPool *pool = (*pools)[i % pools->size()];
+    base::Code ret = pool->Submit([sleep_us]() { usleep(sleep_us); });
+    if (ret != base::kOk) return ret;
+  }
+
+  *max_queue_us = 0;
+  for (size_t i = 0; i < pools->size(); ++i) {
+    base::WorkStealingPool *pool = (*pools)[i];
+    pool->Stop();
+    for (int j = 0; j < pool->GetMaxThreadsNum(); ++j) {
+      base::PoolWorkerStat stat;
+      pool->GetWorkerStat(j, &stat);
+      if (stat.max_queue_us > *max_queue_us) *max_queue_us = stat.max_queue_us;
+    }
+  }
+  *cost_us = GetNowUs() - start_us;
+  return base::kOk;
+} /*}}}*/
+
+TEST(WorkStealingPool, Test_Press_Slow_Tasks) { /*{{{*/
+  using namespace base;
+  const int kThreadsNum = 4;
+
+  // NOTE:htt, fixed queue per thread, which is the same as RealWorker without pool
+  std::vector<WorkStealingPool *> fixed_pools;
+  for (int i = 0; i < kThreadsNum; ++i) {
+    WorkStealingPool *pool = new WorkStealingPool();
+    pool->Init(1, 1);
+    fixed_pools.push_back(pool);
+  }
+  uint64_t fixed_max_queue_us = 0;
+  uint64_t fixed_cost_us = 0;
+  Code ret = RunSlowTasks(&fixed_pools, &fixed_max_queue_us, &fixed_cost_us);
+  EXPECT_EQ(kOk, ret);
+  for (int i = 0; i < kThreadsNum; ++i) {
+    delete fixed_pools[i];
+  }
+
+  std::vector<WorkStealingPool *> steal_pools;
+  WorkStealingPool steal_pool;
+  steal_pool.Init(kThreadsNum, kThreadsNum);
+  for (int i = 0; i < kThreadsNum; ++i) {
+    steal_pools.push_back(&steal_pool);
+  }
+  uint64_t steal_max_queue_us = 0;
+  uint64_t steal_cost_us = 0;
+  ret = RunSlowTasks(&steal_pools, &steal_max_queue_us, &steal_cost_us);
+  EXPECT_EQ(kOk, ret);
+
+  fprintf(stderr, "fixed queues, max_queue_us:%llu, cost_us:%llu\n", (unsigned long long)fixed_max_queue_us,
+          (unsigned long long)fixed_cost_us);
+  fprintf(stderr, "work stealing, max_queue_us:%llu, cost_us:%llu\n", (unsigned long long)steal_max_queue_us,
+          (unsigned long long)steal_cost_us);
+  EXPECT_LT(steal_max_queue_us, fixed_max_queue_us);
+} /*}}}*/
@@ -0,0 +1,103 @@
+// Copyright (c) 2015 The CSUTIL Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <deque>
+
+#include "base/common.h"
+#include "base/log.h"
+#include "base/status.h"
+#include "base/util.h"
+
+#include "test_press_base/include/test_press_base.h"
+#include "test_press_base/include/test_press_controller.h"
+
+/**
+ * NOTE:htt, short connection press: every ExecBody connects, does one request and closes,
+ * so qps of result is new connections per second the server could accept and serve;
+ * run it against RpcServer with accept_mode = main and accept_mode = reuseport to compare both modes
+ * ex: ./press_test -p 127.0.0.1:9090:sock_rpc -n 32 -m 1000 -x 0 -c PressConnect
+ */
+class PressConnectObject : public test::PressObject {
+ public:
+  PressConnectObject(const std::string &test_name) : test::PressObject(test_name) { num_ = 0; }
+
+  virtual ~PressConnectObject() {}
+
+ public:
+  virtual test::PressObject *Create();
+
+  virtual base::Code Init(const std::string &dst_ip_port_protos);
+  virtual base::Code ExecBody();
+  virtual bool IsOver();
+
+ private:
+  int num_;
+  std::string dst_ip_port_proto_;
+  std::string proto_name_;
+};
+
+// NOTE: this is vary import! So register a press object
+Register(PressConnect, PressConnectObject);
+
+test::PressObject *PressConnectObject::Create() { /*{{{*/
+  return new PressConnectObject(*this);
+} /*}}}*/
+
+base::Code PressConnectObject::Init(const std::string &dst_ip_port_protos) { /*{{{*/
+  // NOTE:htt, not call PressObject::Init, which keeps long connections to every dst
+  dst_ip_port_protos_ = dst_ip_port_protos;
+
+  std::deque<std::string> ip_port_protos;
+  base::Code ret = base::Strtok(dst_ip_port_protos, base::kCommaChar, &ip_port_protos);
+  if (ret != base::kOk) return ret;
+  if (ip_port_protos.empty()) return base::kInvalidParam;
+
+  // NOTE:htt, only the first dst is pressed
+  std::deque<std::string> ip_port_proto;
+  ret = base::Strtok(ip_port_protos[0], base::kColon, &ip_port_proto);
+  if (ret != base::kOk) return ret;
+  if (ip_port_proto.size() < 3 || ip_port_proto.size() > 4) return base::kInvalidParam;
+
+  dst_ip_port_proto_ = ip_port_protos[0];
+  proto_name_ = ip_port_proto[2];
+
+  return base::kOk;
+} /*}}}*/
+
+bool PressConnectObject::IsOver() { /*{{{*/
+  return num_ > 10000;
+} /*}}}*/
+
+base::Code PressConnectObject::ExecBody() { /*{{{*/
+  if (IsOver()) {
+    return base::kExitOk;
+  }
+  num_++;
+
+  test::BusiClient *busi_client = NULL;
+  base::Code ret =
+      strategy::Singleton<test::TestPressController>::Instance()->GetNewBusiClient(proto_name_, &busi_client);
+  if (ret != base::kOk) {
+    LOG_ERR("Failed to get %s client, ret:%d", proto_name_.c_str(), ret);
+    return ret;
+  }
+
+  ret = busi_client->Init(dst_ip_port_proto_);  // NOTE:htt, connect
+  if (ret == base::kOk) {
+    // NOTE:htt, empty request is a valid protobuf message, so one round trip is served by any pb rpc server
+    std::string resp;
+    ret = busi_client->SendAndRecv("", &resp);
+  }
+
+  delete busi_client;  // NOTE:htt, close
+  return ret;
+} /*}}}*/
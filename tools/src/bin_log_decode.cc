@@ -0,0 +1,64 @@
+// Copyright (c) 2015 The CSUTIL Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "base/bin_log.h"
+
+#include "bin_log_decode.h"
+
+namespace tools {
+
+static const uint32_t kDecodeReadLen = 1024 * 1024;
+
+base::Code DecodeBinLogFile(const std::string &src_path, const std::string &dst_path) { /*{{{*/
+  if (src_path.empty()) return base::kInvalidParam;
+
+  FILE *src_fp = fopen(src_path.c_str(), "rb");
+  if (src_fp == NULL) return base::kOpenFileFailed;
+
+  FILE *dst_fp = stdout;
+  if (!dst_path.empty()) {
+    dst_fp = fopen(dst_path.c_str(), "w");
+    if (dst_fp == NULL) {
+      fclose(src_fp);
+      return base::kOpenFileFailed;
+    }
+  }
+
+  base::Code ret = base::kOk;
+  base::BinLogDecoder decoder;
+  std::string pending;
+  std::string text;
+  char *buf = new char[kDecodeReadLen];
+  while (true) {
+    size_t read_len = fread(buf, sizeof(char), kDecodeReadLen, src_fp);
+    if (read_len == 0) break;
+    pending.append(buf, read_len);
+
+    uint32_t used_len = 0;
+    text.clear();
+    ret = decoder.Decode(pending.data(), pending.size(), &text, &used_len);
+    if (ret != base::kOk) {
+      fprintf(stderr, "Failed to decode binary log:%s, ret:%d\n", src_path.c_str(), ret);
+      break;
+    }
+    fwrite(text.data(), sizeof(char), text.size(), dst_fp);
+    pending.erase(0, used_len);
+  }
+
+  if (ret == base::kOk && !pending.empty()) {
+    fprintf(stderr, "Binary log:%s is truncated, %zu bytes at the end are ignored\n", src_path.c_str(),
+            pending.size());
+  }
+
+  delete[] buf;
+  fclose(src_fp);
+  if (dst_fp != stdout) fclose(dst_fp);
+
+  return ret;
+} /*}}}*/
+
+}  // namespace tools
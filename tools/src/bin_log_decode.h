@@ -0,0 +1,19 @@
+// Copyright (c) 2015 The CSUTIL Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef TOOLS_BIN_LOG_DECODE_H_
+#define TOOLS_BIN_LOG_DECODE_H_
+
+#include <string>
+
+#include "base/status.h"
+
+namespace tools {
+
+// NOTE: Decode binary log written by BIN_LOG_* into the text layout of LOG_*; dst_path empty means stdout
+base::Code DecodeBinLogFile(const std::string &src_path, const std::string &dst_path);
+
+}  // namespace tools
+
+#endif
@@ -0,0 +1,94 @@
+// Copyright (c) 2015 The CSUTIL Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <vector>
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "store/cache/lru_cache/src/lru_cache.h"
+
+#include "cache_trace_replay.h"
+
+namespace tools {
+
+static const uint32_t kTraceLineLen = 4096;
+
+struct ReplayPolicy { /*{{{*/
+  store::EvictPolicyType type;
+  const char *name;
+}; /*}}}*/
+
+static const ReplayPolicy kReplayPolicies[] = {
+    {store::kEvictLRU, "lru"},
+    {store::kEvictSLRU, "slru"},
+    {store::kEvictARC, "arc"},
+    {store::kEvictWTinyLFU, "w-tinylfu"},
+};
+
+static uint64_t GetNowUs() { /*{{{*/
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return (uint64_t)now.tv_sec * 1000000 + now.tv_usec;
+} /*}}}*/
+
+static base::Code LoadTrace(const std::string &trace_path, std::vector<std::string> *keys) { /*{{{*/
+  FILE *fp = fopen(trace_path.c_str(), "r");
+  if (fp == NULL) return base::kOpenFileFailed;
+
+  char buf[kTraceLineLen] = "\0";
+  while (fgets(buf, sizeof(buf), fp) != NULL) {
+    size_t len = strlen(buf);
+    while (len > 0 && (buf[len - 1] == '\n' || buf[len - 1] == '\r')) --len;
+    if (len == 0) continue;
+    keys->push_back(std::string(buf, len));
+  }
+  fclose(fp);
+
+  return base::kOk;
+} /*}}}*/
+
+base::Code ReplayCacheTrace(const std::string &trace_path, uint32_t cache_size) { /*{{{*/
+  if (trace_path.empty() || cache_size == 0) return base::kInvalidParam;
+
+  std::vector<std::string> keys;
+  base::Code ret = LoadTrace(trace_path, &keys);
+  if (ret != base::kOk) return ret;
+  fprintf(stderr, "trace:%s, requests:%zu, cache_size:%u\n", trace_path.c_str(), keys.size(), cache_size);
+
+  std::string value;
+  for (size_t i = 0; i < sizeof(kReplayPolicies) / sizeof(kReplayPolicies[0]); ++i) {
+    const ReplayPolicy &policy = kReplayPolicies[i];
+    store::LRUCache cache;
+    ret = cache.Init(cache_size, 0, policy.type);
+    if (ret != base::kOk) return ret;
+
+    uint64_t hit_num = 0;
+    uint64_t start_us = GetNowUs();
+    std::vector<std::string>::const_iterator it = keys.begin();
+    for (; it != keys.end(); ++it) {
+      ret = cache.Get(*it, &value);
+      if (ret == base::kOk) {
+        ++hit_num;
+        continue;
+      }
+      if (ret != base::kNotFound) return ret;
+
+      // NOTE: key is used as value, since only hit ratio matters
+      ret = cache.Put(*it, *it);
+      if (ret != base::kOk) return ret;
+    }
+    uint64_t cost_us = GetNowUs() - start_us;
+
+    double hit_ratio = keys.empty() ? 0 : (double)hit_num / keys.size();
+    fprintf(stderr, "policy:%-10s hits:%llu, misses:%llu, hit_ratio:%.4f, cost_us:%llu\n", policy.name,
+            (unsigned long long)hit_num, (unsigned long long)(keys.size() - hit_num), hit_ratio,
+            (unsigned long long)cost_us);
+  }
+
+  return base::kOk;
+} /*}}}*/
+
+}  // namespace tools
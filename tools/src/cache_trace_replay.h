@@ -0,0 +1,24 @@
+// Copyright (c) 2015 The CSUTIL Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef TOOLS_CACHE_TRACE_REPLAY_H_
+#define TOOLS_CACHE_TRACE_REPLAY_H_
+
+#include <string>
+
+#include <stdint.h>
+
+#include "base/status.h"
+
+namespace tools {
+
+const uint32_t kDefaultReplayCacheSize = 10000;  // NOTE: cache size of tools case 91 if -n is not set
+
+// NOTE: Replay trace of one key per line on LRUCache of every evict policy, Put is done when Get misses,
+// then hit ratio of each policy is printed
+base::Code ReplayCacheTrace(const std::string &trace_path, uint32_t cache_size);
+
+}  // namespace tools
+
+#endif
@@ -20,6 +20,8 @@
 #include "base/util.h"
 #include "data_process/src/data_process.h"
 
+#include "bin_log_decode.h"
+#include "cache_trace_replay.h"
 #include "create_cc_file.h"
 #include "create_java_file.h"
 #include "file_content_replace.h"
@@ -43,6 +45,8 @@ void Help(const std::string &program) { /*{{{*/
           "lines if containing find_name_prefix\n"
           "12 [-s dir] [-l find_name_prefix] [-n log interval lines]: Log 'log_interval_logs' lines if "
           "containing find_name_prefix in dir\n"
+          "13 [-s src_file] [-d dst_file]: Decode binary log of BIN_LOG_* into text log, dst_file is stdout if "
+          "not set\n"
           "21 [-s src_file] [-f func_name]: create a src_file of cplusplus template including function "
           "with func_name\n"
           "31 [-s str]: BKDHash this str\n"
@@ -60,7 +64,9 @@ void Help(const std::string &program) { /*{{{*/
           "72 [-s src_cnt -k init_keys]: Set the value of the init keys specified in src_cnt to default value "
           "init_keys: concatenated by commas\n"
           "81 [-s src_file -d dst_file -e level]: Serialize protobuf which content is json type! "
-          "level means how many protobuf should be encapsulated, which default is 1, and range is [1, 20]\n",
+          "level means how many protobuf should be encapsulated, which default is 1, and range is [1, 20]\n"
+          "91 [-s trace_file] [-n cache_size]: Replay trace of one key per line on LRUCache of every evict "
+          "policy, and print hit ratio of them, cache_size is 10000 if not set\n",
           program.c_str());
 } /*}}}*/
 }  // namespace tools
@@ -258,6 +264,16 @@ int main(int argc, char *argv[]) { /*{{{*/
         }
         ret = LogContentInDir(src_path, log_name, log_interval_lines);
       } /*}}}*/
+      break;
+      case 13: { /*{{{*/
+        if (src_path.empty()) {
+          fprintf(stderr, "Invalid src_path\n");
+          Help(argv[0]);
+          return -1;
+        }
+        ret = DecodeBinLogFile(src_path, dst_path);
+      } /*}}}*/
+      break;
       case 21: { /*{{{*/
         if (src_path.empty() || func_name.empty()) {
           fprintf(stderr, "Invalid src_path or function name\n");
@@ -329,6 +345,16 @@ int main(int argc, char *argv[]) { /*{{{*/
         ret = SerializePBForJsonContent(src_path, dst_path, level);
       } /*}}}*/
       break;
+      case 91: { /*{{{*/
+        if (src_path.empty() || log_interval_lines < 0) {
+          fprintf(stderr, "Invalid trace_file or cache_size\n");
+          Help(argv[0]);
+          return -1;
+        }
+        uint32_t cache_size = (log_interval_lines == 0) ? kDefaultReplayCacheSize : log_interval_lines;
+        ret = ReplayCacheTrace(src_path, cache_size);
+      } /*}}}*/
+      break;
       default:
         fprintf(stderr, "Invalid case num:%d\n", num_case);
         Help(argv[0]);